@@ -39,6 +39,7 @@ end
 
 --------------------------------------------------------------------------------
 local cmd_classifier = clink.classifier(1)
+cmd_classifier._native = "cmd"
 function cmd_classifier:classify(commands) -- luacheck: no self
     if commands and commands[1] then
         -- Redirection symbols and @ sign.
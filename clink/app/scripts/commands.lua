@@ -84,12 +84,85 @@ function clink._popup_show_help(rl_buffer)
     end
 end
 
+--------------------------------------------------------------------------------
+local function diag_gc(arg)
+    local stats = clink._get_gc_stats()
+    clink.print("\x1b[1mlua gc:\x1b[m")
+    print(string.format("  %-16s  %d KB", "memory", stats.kb))
+    print(string.format("  %-16s  %.1f ms in %d steps, %d cycles", "idle collection", stats.idle_ms, stats.idle_steps, stats.idle_cycles))
+    if stats.slab_kb then
+        print(string.format("  %-16s  %d KB in %d blocks, %d KB in slabs", "small blocks", stats.small_kb, stats.small_blocks, stats.slab_kb))
+        print(string.format("  %-16s  %d KB in %d blocks", "large blocks", stats.large_kb, stats.large_blocks))
+    end
+    if arg then
+        print(string.format("  %-16s  %d", "pause", stats.pause))
+        print(string.format("  %-16s  %d", "stepmul", stats.stepmul))
+        print(string.format("  %-16s  %d", "suspended", stats.suspended))
+        print(string.format("  %-16s  %d", "soft cap hits", stats.cap_collections))
+    end
+end
+
+--------------------------------------------------------------------------------
+local function diag_profile(arg)
+    local enabled, entries = clink._get_profile()
+    if not enabled and not entries[1] then
+        return
+    end
+
+    clink.print("\x1b[1mlua profile:\x1b[m")
+    if not entries[1] then
+        print("  no samples yet")
+        return
+    end
+
+    local limit = arg and 30 or 10
+    local longest = 0
+    for i = 1, math.min(#entries, limit) do
+        longest = math.max(longest, #entries[i].src)
+    end
+    for i = 1, math.min(#entries, limit) do
+        local e = entries[i]
+        print(string.format("  %-"..longest.."s  %9.1f ms  %9.1f KB", e.src, e.ms, e.kb))
+    end
+    if #entries > limit then
+        print(string.format("  (%d more)", #entries - limit))
+    end
+end
+
+--------------------------------------------------------------------------------
+local function diag_perf()
+    local entries = clink._get_perf()
+    if not entries[1] then
+        return
+    end
+
+    clink.print("\x1b[1mlua timers and counters:\x1b[m")
+
+    local longest = 0
+    for _, e in ipairs(entries) do
+        longest = math.max(longest, #e.name)
+    end
+    for _, e in ipairs(entries) do
+        local s = "  "..e.name..string.rep(" ", longest - #e.name)
+        if e.calls > 0 then
+            s = s..string.format("  %9.1f ms in %d calls", e.ms, e.calls)
+        end
+        if e.count ~= 0 then
+            s = s..string.format("  count %g", e.count)
+        end
+        print(s)
+    end
+end
+
 --------------------------------------------------------------------------------
 function clink._diagnostics(rl_buffer)
     local arg = rl_buffer:getargument()
+    diag_gc(arg)
     clink._diag_coroutines(arg)
     clink._diag_refilter()
     clink._diag_events(arg)
+    diag_profile(arg)
+    diag_perf()
     if arg then
         clink._diag_argmatchers(arg)
         clink._diag_prompts(arg)
@@ -63,18 +63,6 @@ local function add_commands(line_state, match_builder)
     match_builder:addmatches(clink._get_cmd_commands(), "cmd")
 end
 
---------------------------------------------------------------------------------
-local function get_environment_paths()
-    local paths = (os.getenv("path") or ""):explode(";")
-
-    -- Append slashes.
-    for i = 1, #paths, 1 do
-        paths[i] = paths[i].."\\"
-    end
-
-    return paths
-end
-
 --------------------------------------------------------------------------------
 local exec_generator = clink.generator(50)
 
@@ -121,7 +109,7 @@ local function exec_matches(line_state, match_builder, chained, no_aliases)
     local match_dirs = settings.get("exec.dirs")
     local match_cwd = settings.get("exec.cwd")
 
-    local paths = nil
+    local match_path = false
     local text, expanded = rl.expandtilde(endword) -- luacheck: no unused
     local text_dir = (path.getdirectory(text) or ""):gsub("/", "\\")
     if #text_dir == 0 then
@@ -131,10 +119,8 @@ local function exec_matches(line_state, match_builder, chained, no_aliases)
             match_builder:addmatches(aliases, "alias")
         end
 
-        -- Add environment's PATH variable as paths to search.
-        if settings.get("exec.path") then
-            paths = get_environment_paths()
-        end
+        -- Search the directories in the environment's PATH variable.
+        match_path = settings.get("exec.path")
     else
         -- 'text' is an absolute or relative path so override settings and
         -- match current directory and its directories too.
@@ -142,10 +128,6 @@ local function exec_matches(line_state, match_builder, chained, no_aliases)
         match_cwd = true
     end
 
-    if not paths then
-        paths = {}
-    end
-
     local _, ismain = coroutine.running()
 
     local add_files = function(pattern, rooted, only_files)
@@ -208,15 +190,27 @@ local function exec_matches(line_state, match_builder, chained, no_aliases)
         added = add_files(endword.."*", true) or added
     end
 
-    -- Search 'paths' for files ending in executable extensions (and/or
+    -- Search PATH for files ending in executable extensions (and/or
     -- registered file associations) and look for matches.
     local suffices = (os.getenv("pathext") or ""):explode(";")
     for _, suffix in ipairs(suffices) do
         associations[suffix:lower()] = true
     end
     local include_associations = settings.get("exec.associations")
-    for _, dir in ipairs(paths) do
-        added = add_files_by_association(dir.."*", false, include_associations) or added
+    if match_path then
+        -- The native PATH index only needs to return names that start with
+        -- the word, unless substring or fuzzy matching could select others.
+        local prefix = text
+        if settings.get("match.substring") or settings.get("match.fuzzy") or text:find("[*?]") then
+            prefix = ""
+        end
+        local matches, unindexed = os.getpathexecutables(prefix, include_associations)
+        added = (match_builder:addmatches(matches) > 0) or added
+        -- Directories the index doesn't cover (e.g. remote directories) are
+        -- globbed the same as before.
+        for _, dir in ipairs(unindexed) do
+            added = add_files_by_association(path.join(dir, "*"), false, include_associations) or added
+        end
     end
 
     -- Should we also consider the path referenced by 'text'?
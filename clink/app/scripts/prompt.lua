@@ -17,6 +17,11 @@ end
 --------------------------------------------------------------------------------
 local prompt_filter_current = nil       -- Current running prompt filter.
 local prompt_filter_coroutines = {}     -- Up to one coroutine per prompt filter, with cached return value.
+local prompt_refilter_clock = nil       -- The os.clock() of the most recent refilter by prompt coroutines.
+local prompt_refilter_deferred = nil    -- Coroutine waiting to refilter, if any.
+
+-- Refilters by prompt coroutines are at least this many seconds apart.
+local c_min_refilter_interval = 0.1
 
 --------------------------------------------------------------------------------
 local bold = "\x1b[1m"                  -- Bold (bright).
@@ -31,13 +36,16 @@ end
 
 
 
+-- How many of the most recent timings are kept for percentiles.
+local c_cost_samples = 64
+
 --------------------------------------------------------------------------------
 local function log_cost(tick, filter, func_name)
     local elapsed = (os.clock() - tick) * 1000
     local tname = "cost"..func_name
     local cost = filter[tname]
     if not cost then
-        cost = { last=0, total=0, num=0, peak=0 }
+        cost = { last=0, total=0, num=0, peak=0, samples={} }
         filter[tname] = cost
     end
 
@@ -47,6 +55,78 @@ local function log_cost(tick, filter, func_name)
     if cost.peak < elapsed then
         cost.peak = elapsed
     end
+    cost.samples[(cost.num - 1) % c_cost_samples + 1] = elapsed
+    return elapsed
+end
+
+--------------------------------------------------------------------------------
+-- Returns the given percentile of the recent timings in a cost table.
+local function get_cost_percentile(cost, percentile)
+    local sorted = {}
+    for _, elapsed in ipairs(cost.samples) do
+        table.insert(sorted, elapsed)
+    end
+    table.sort(sorted)
+    local index = math.ceil(#sorted * percentile / 100)
+    return sorted[math.max(index, 1)] or 0
+end
+
+--------------------------------------------------------------------------------
+-- A synchronous filter function that takes longer than the prompt.filter_budget
+-- setting makes its prompt filter run in a prompt coroutine from then on.
+local function check_filter_budget(filter, elapsed, transient)
+    if transient or filter._demoted or prompt_filter_coroutines[filter] then
+        return
+    end
+    local budget = settings.get("prompt.filter_budget")
+    if budget and budget > 0 and elapsed > budget and settings.get("prompt.async") then
+        filter._demoted = true
+        local info = debug.getinfo(filter.segments or filter.filter, 'S')
+        log.info(string.format("prompt filter %s took %u ms; running it asynchronously from now on",
+                info.short_src..":"..info.linedefined, elapsed))
+    end
+end
+
+--------------------------------------------------------------------------------
+-- Returns a string describing the inputs to a prompt filter plus everything
+-- its cache table says it depends on, or nil if it can't be cached.
+local function get_cache_key(filter, kind, prompt, rprompt)
+    local deps = filter.cache
+    if type(deps) ~= "table" or prompt_filter_coroutines[filter] then
+        return
+    end
+
+    return clink._get_deps_key(deps, { kind, prompt or "", rprompt or "" })
+end
+
+--------------------------------------------------------------------------------
+-- Joins the segments returned by a prompt filter's :segments() function, and
+-- returns the prompt text and the transient prompt text.
+local function join_segments(segments)
+    local text = {}
+    local ttext = {}
+    for _, seg in ipairs(segments) do
+        if type(seg) == "string" then
+            table.insert(text, seg)
+        elseif type(seg) == "table" and type(seg.text) == "string" then
+            table.insert(text, seg.text)
+            if seg.transient == true then
+                table.insert(ttext, seg.text)
+            elseif type(seg.transient) == "string" then
+                table.insert(ttext, seg.transient)
+            end
+        end
+    end
+    return table.concat(text), table.concat(ttext)
+end
+
+--------------------------------------------------------------------------------
+local function has_transient_filter_funcs()
+    for _, filter in ipairs(prompt_filters) do
+        if filter.transientfilter or filter.transientrightfilter then
+            return true
+        end
+    end
 end
 
 --------------------------------------------------------------------------------
@@ -68,57 +148,142 @@ local function _do_filter_prompt(type, prompt, rprompt, line, cursor, final)
     local rpre = os.getenv("CLINK_RPROMPT_PREFIX") or ""
     local rsuf = os.getenv("CLINK_RPROMPT_SUFFIX") or ""
 
-    -- Protected call to prompt filters.
-    local impl = function(prompt, rprompt) -- luacheck: ignore 432
-        local filtered, onwards
-        for _, filter in ipairs(prompt_filters) do
-            set_current_prompt_filter(filter)
+    -- Calls a prompt filter's filter functions.  Returns the prompt, the right
+    -- side prompt, whether to continue to further filters, whether a transient
+    -- filter disabled the transient prompt, how many milliseconds the slowest
+    -- filter function took, and the transient prompt text from segments.
+    local call_filter_funcs = function(filter, prompt, rprompt) -- luacheck: ignore 432
+        local filtered, onwards, ttext
+        local slowest = 0
+
+        -- Always call :filter() to help people to write backward compatible
+        -- prompt filters.  Otherwise it's too easy to write Lua code that
+        -- works on "new" Clink versions but throws a Lua exception on Clink
+        -- versions that don't support RPROMPT.
+        local func
+        func = filter[filter_func_name]
+        if #type == 0 and filter.segments then
+            -- Segments take the place of :filter(), and also provide the text
+            -- for the transient prompt.
+            local tick = os.clock()
+            local segments
+            segments, onwards = filter:segments(prompt)
+            slowest = log_cost(tick, filter, "segments")
+            if segments ~= nil then
+                prompt, ttext = join_segments(segments)
+            end
+        elseif not func and transient and filter._transient_text then
+            -- Use the transient text from the segments the filter provided
+            -- for the most recent prompt.
+            prompt, onwards = filter._transient_text, filter._transient_onwards
+        elseif func or #type == 0 then
+            local tick = os.clock()
+            filtered, onwards = func(filter, prompt)
+            slowest = log_cost(tick, filter, filter_func_name)
+            if filtered ~= nil then
+                prompt = filtered
+            elseif transient and onwards == false then
+                -- Transient filter can disable transient prompt by returning
+                -- nil, false.
+                return prompt, rprompt, onwards, true
+            end
+        end
 
-            -- Always call :filter() to help people to write backward compatible
-            -- prompt filters.  Otherwise it's too easy to write Lua code that
-            -- works on "new" Clink versions but throws a Lua exception on Clink
-            -- versions that don't support RPROMPT.
-            local func
-            func = filter[filter_func_name]
-            if func or #type == 0 then
+        if onwards ~= false then
+            func = filter[right_filter_func_name]
+            if func then
                 local tick = os.clock()
-                filtered, onwards = func(filter, prompt)
-                log_cost(tick, filter, filter_func_name)
+                filtered, onwards = func(filter, rprompt)
+                slowest = math.max(slowest, log_cost(tick, filter, right_filter_func_name))
                 if filtered ~= nil then
-                    prompt = filtered
+                    rprompt = filtered
                 elseif transient and onwards == false then
                     -- Transient filter can disable transient prompt by
                     -- returning nil, false.
-                    return nil, nil
+                    return prompt, rprompt, onwards, true
                 end
             end
+        end
 
-            if onwards ~= false then
-                func = filter[right_filter_func_name]
-                if func then
-                    local tick = os.clock()
-                    filtered, onwards = func(filter, rprompt)
-                    log_cost(tick, filter, right_filter_func_name)
-                    if filtered ~= nil then
-                        rprompt = filtered
-                    elseif transient and onwards == false then
-                        -- Transient filter can disable transient prompt by
-                        -- returning nil, false.
+        return prompt, rprompt, onwards, false, slowest, ttext
+    end
+
+    -- The transient prompt assembled from segments while filtering the normal
+    -- prompt, and whether a prompt coroutine left it incomplete.
+    local tprompt, tpending
+
+    -- Protected call to prompt filters.
+    local impl = function(prompt, rprompt) -- luacheck: ignore 432
+        local onwards
+        for _, filter in ipairs(prompt_filters) do
+            set_current_prompt_filter(filter)
+
+            -- Reuse the previous results if nothing the filter depends on has
+            -- changed.
+            local key = get_cache_key(filter, type, prompt, rprompt)
+            local cached = key and filter._cache
+            local a,b,c,d
+            local ttext
+            if cached and cached.key == key then
+                prompt, rprompt, onwards = cached.prompt, cached.rprompt, cached.onwards
+                ttext = cached.ttext
+                a,b,c,d = cached.a, cached.b, cached.c, cached.d
+                cached.hits = cached.hits + 1
+            else
+                if filter._demoted and not transient and settings.get("prompt.async") then
+                    -- Run a demoted filter in a prompt coroutine, and use its
+                    -- results once it finishes, as long as they were for the
+                    -- same input.  Otherwise run it again synchronously.
+                    local input = (prompt or "").."\0"..(rprompt or "")
+                    local p, rp = prompt, rprompt
+                    local r = clink.promptcoroutine(function ()
+                        local fp, frp, fo, _, _, ft = call_filter_funcs(filter, p, rp)
+                        return { input=input, prompt=fp, rprompt=frp, onwards=fo, ttext=ft }
+                    end)
+                    if not r then
+                        -- Leave the prompt alone until the coroutine finishes.
+                        tpending = true
+                    elseif r.input == input then
+                        prompt, rprompt, onwards, ttext = r.prompt, r.rprompt, r.onwards, r.ttext
+                    else
+                        local _
+                        prompt, rprompt, onwards, _, _, ttext = call_filter_funcs(filter, prompt, rprompt)
+                    end
+                else
+                    local disable, elapsed
+                    prompt, rprompt, onwards, disable, elapsed, ttext = call_filter_funcs(filter, prompt, rprompt)
+                    if disable then
                         return nil, nil
                     end
+                    check_filter_budget(filter, elapsed, transient)
+                end
+
+                local func = filter.surround
+                if func then
+                    a,b,c,d = func(filter)
+                end
+
+                -- A filter that started a prompt coroutine will be refiltered
+                -- when the coroutine finishes, so don't cache it.
+                if key and not prompt_filter_coroutines[filter] then
+                    filter._cache = { key=key, prompt=prompt, rprompt=rprompt, onwards=onwards, ttext=ttext, a=a, b=b, c=c, d=d, hits=0 }
                 end
             end
 
-            func = filter.surround
-            if func then
-                local a,b,c,d = func(filter)
-                -- Earlier prompt filters take precedence
-                if a then pre = pre .. a end
-                if b then suf = b .. suf end
-                if c then rpre = rpre .. c end
-                if d then rsuf = d .. rsuf end
+            if not transient then
+                filter._transient_text = ttext
+                filter._transient_onwards = ttext and onwards
+                if ttext then
+                    tprompt = ttext
+                end
             end
 
+            -- Earlier prompt filters take precedence
+            if a then pre = pre .. a end
+            if b then suf = b .. suf end
+            if c then rpre = rpre .. c end
+            if d then rsuf = d .. rsuf end
+
             if onwards == false then
                 break
             end
@@ -157,15 +322,30 @@ local function _do_filter_prompt(type, prompt, rprompt, line, cursor, final)
         suf = suf .. "\x1b]133;B\a"
     end
 
-    if ret then
-        local leading, trailing = ret:match("^(.*\n)([^\n]+)$")
-        ret = (leading or "") .. clink._expand_prompt_codes(pre) .. (trailing or ret) .. clink._expand_prompt_codes(suf)
+    local function apply_surround(p, rp)
+        if p then
+            local leading, trailing = p:match("^(.*\n)([^\n]+)$")
+            p = (leading or "") .. clink._expand_prompt_codes(pre) .. (trailing or p) .. clink._expand_prompt_codes(suf)
+        end
+        if rp and rp ~= "" then
+            rp = clink._expand_prompt_codes(rpre, true) .. rp .. clink._expand_prompt_codes(rsuf, true)
+        end
+        return p, rp
     end
-    if rret and rret ~= "" then
-        rret = clink._expand_prompt_codes(rpre, true) .. rret .. clink._expand_prompt_codes(rsuf, true)
+
+    ret, rret = apply_surround(ret, rret)
+
+    -- When segments provided the transient prompt and there are no transient
+    -- filter functions to call, then the transient prompt is already complete.
+    -- Clink keeps it and uses it when the command is accepted, instead of
+    -- filtering the prompt again.
+    local tret, trret
+    if ok and not transient and tprompt and not tpending and not has_transient_filter_funcs() then
+        local trp = clink._expand_prompt_codes(os.getenv("clink_transient_rprompt") or "", true)
+        tret, trret = apply_surround(tprompt, trp)
     end
 
-    return ret, rret, ok
+    return ret, rret, ok, tret, trret
 end
 
 --------------------------------------------------------------------------------
@@ -206,6 +386,29 @@ end
 --- -show:  &nbsp;   -- Insert the date at the beginning of the prompt.
 --- -show:  &nbsp;   return os.date("%a %H:%M").." "..prompt
 --- -show:  end
+---
+--- Starting in v1.6.17, a prompt filter can set a <code>cache</code> table
+--- that declares what its output depends on.  Then when the prompt is filtered
+--- again and none of those have changed (and the prompt passed into the filter
+--- is the same), the filter's previous results are reused instead of calling
+--- its functions.  The <code>cache</code> table can contain these fields:
+--- -show:  -- cache.cwd          [boolean] The current directory.
+--- -show:  -- cache.errorlevel   [boolean] The exit code from the previous command.
+--- -show:  -- cache.env          [table] Names of environment variables.
+--- -show:  -- cache.files        [table] Names of files, whose modified time and size are checked;
+--- -show:  --                            relative names are relative to the current directory.
+--- -show:  -- cache.persist      [boolean] Save prompt coroutine results for new sessions (v1.6.17 and higher).
+--- -show:  -- cache.name         [string] Name for persisted results (defaults to the coroutine's source location).
+--- A filter that uses
+--- <a href="#clink.promptcoroutine">clink.promptcoroutine()</a> is not
+--- cached during an input line session where it started a coroutine.  But
+--- when <code>cache.persist</code> is true, the result of its prompt coroutine
+--- is saved in the profile directory along with the dependency key, and
+--- <a href="#clink.promptcoroutine">clink.promptcoroutine()</a> returns the
+--- saved result (from this or an earlier session) while the coroutine runs
+--- again in the background.
+--- -show:  local branch_prompt = clink.promptfilter(60)
+--- -show:  branch_prompt.cache = { cwd=true, files={ ".git/HEAD" } }
 function clink.promptfilter(priority)
     if priority == nil then priority = 999 end
 
@@ -275,7 +478,7 @@ local function collect_filter_src(t, type)
             if not clink._is_internal_script(info.short_src) then
                 local src = info.short_src..":"..info.linedefined
                 local cost = prompt["cost"..type]
-                table.insert(tsub, { src=src, cost=cost })
+                table.insert(tsub, { src=src, cost=cost, demoted=prompt._demoted })
                 if longest < #src then
                     longest = #src
                 end
@@ -296,16 +499,18 @@ local function print_filter_src(t, type)
     if tsub[1] then
         local longest = t.longest
         if tsub.any_cost then
-            clink.print(string.format("  %s           %slast    avg     peak%s",
+            clink.print(string.format("  %s           %slast    avg     p50     p95     peak%s",
                     pad_string(type..":", longest), header, norm))
         else
             clink.print("  "..type..":")
         end
         for _,entry in ipairs (tsub) do
             if entry.cost then
-                clink.print(string.format("        %s  %4u ms %4u ms %4u ms",
+                clink.print(string.format("        %s  %4u ms %4u ms %4u ms %4u ms %4u ms%s",
                         pad_string(entry.src, longest),
-                        entry.cost.last, entry.cost.total / entry.cost.num, entry.cost.peak))
+                        entry.cost.last, entry.cost.total / entry.cost.num,
+                        get_cost_percentile(entry.cost, 50), get_cost_percentile(entry.cost, 95),
+                        entry.cost.peak, entry.demoted and "  (async)" or ""))
             else
                 clink.print(string.format("        %s", entry.src))
             end
@@ -326,12 +531,14 @@ function clink._diag_prompts(arg)
     local t = {}
     collect_filter_src(t, "filter")
     collect_filter_src(t, "rightfilter")
+    collect_filter_src(t, "segments")
     collect_filter_src(t, "transientfilter")
     collect_filter_src(t, "transientrightfilter")
 
     local any = false
     any = print_filter_src(t, "filter") or any
     any = print_filter_src(t, "rightfilter") or any
+    any = print_filter_src(t, "segments") or any
     any = print_filter_src(t, "transientfilter") or any
     any = print_filter_src(t, "transientrightfilter") or any
 
@@ -342,15 +549,118 @@ end
 
 
 
+--------------------------------------------------------------------------------
+-- Prompt coroutine results saved for prompt filters whose cache table has
+-- persist=true, so that new sessions can show the last known results right
+-- away while the coroutines run again in the background.  Entries are
+-- { time=, value= }, keyed by the filter's name plus its dependency key.
+local prompt_persisted = nil
+local c_max_persisted = 64
+
+--------------------------------------------------------------------------------
+local function get_prompt_cache_file()
+    local dir = os.getenv("=clink.profile")
+    if not dir or dir == "" then
+        return
+    end
+    return path.join(dir, "clink_promptcache")
+end
+
+--------------------------------------------------------------------------------
+local function read_prompt_cache()
+    local file = get_prompt_cache_file()
+    local f = file and io.open(file, "r")
+    if not f then
+        return {}
+    end
+    local text = f:read("a")
+    f:close()
+    local t = text and json.decode(text)
+    return type(t) == "table" and t or {}
+end
+
+--------------------------------------------------------------------------------
+local function get_persist_key(filter, src)
+    local deps = filter.cache
+    if type(deps) ~= "table" or not deps.persist then
+        return
+    end
+    local name = (type(deps.name) == "string" and deps.name ~= "") and deps.name or src
+    return clink._get_deps_key(deps, { name })
+end
+
+--------------------------------------------------------------------------------
+local function load_persisted_result(key)
+    if not prompt_persisted then
+        prompt_persisted = read_prompt_cache()
+    end
+    local entry = prompt_persisted[key]
+    if type(entry) == "table" then
+        return entry.value
+    end
+end
+
+--------------------------------------------------------------------------------
+local function save_persisted_result(key, value)
+    -- Only values that can be encoded as JSON can be saved, and there's no
+    -- need to write the file if the value hasn't changed.
+    local text = (value ~= nil) and json.encode(value)
+    if not text then
+        return
+    end
+    local old = prompt_persisted and prompt_persisted[key]
+    if type(old) == "table" and json.encode(old.value) == text then
+        return
+    end
+
+    -- Reread the file so entries saved by other sessions aren't lost.
+    local t = read_prompt_cache()
+    t[key] = { time=os.time(), value=value }
+
+    local keys = {}
+    for k, e in pairs(t) do
+        if type(e) == "table" and type(e.time) == "number" then
+            table.insert(keys, k)
+        else
+            t[k] = nil
+        end
+    end
+    if #keys > c_max_persisted then
+        table.sort(keys, function (a, b) return t[a].time > t[b].time end)
+        for i = c_max_persisted + 1, #keys do
+            t[keys[i]] = nil
+        end
+    end
+    prompt_persisted = t
+
+    local file = get_prompt_cache_file()
+    local f = file and io.open(file, "w")
+    if f then
+        f:write(json.encode(t) or "{}")
+        f:close()
+    end
+end
+
 --------------------------------------------------------------------------------
 local function clear_prompt_coroutines()
     prompt_filter_coroutines = {}
+    prompt_refilter_clock = nil
+    prompt_refilter_deferred = nil
 end
 clink.onbeginedit(clear_prompt_coroutines)
 
+--------------------------------------------------------------------------------
+local function refilterprompt_now()
+    prompt_refilter_clock = os.clock()
+    clink.refilterprompt()
+end
+
 --------------------------------------------------------------------------------
 -- Refilter at most once per resume; so if N prompt coroutines finish in the
--- same pass the prompt doesn't refilter separately N times.
+-- same pass the prompt doesn't refilter separately N times.  Prompt coroutines
+-- run in parallel and often finish in quick succession over several passes, so
+-- refilters are also kept c_min_refilter_interval apart; a refilter that comes
+-- too soon is deferred, and any others that arrive meanwhile join it.
 local function refilterprompt_after_coroutines()
     local refilter = false
     for _,entry in pairs(prompt_filter_coroutines) do
@@ -359,9 +669,27 @@ local function refilterprompt_after_coroutines()
             entry.refilter = false
         end
     end
-    if refilter then
-        clink.refilterprompt()
+    if not refilter or prompt_refilter_deferred then
+        return
     end
+
+    local wait = prompt_refilter_clock and (prompt_refilter_clock + c_min_refilter_interval - os.clock())
+    if not wait or wait <= 0 then
+        refilterprompt_now()
+        return
+    end
+
+    local c
+    c = coroutine.create(function ()
+        -- The first resume is immediate; the interval applies after that.
+        coroutine.yield()
+        if prompt_refilter_deferred == c then
+            prompt_refilter_deferred = nil
+            refilterprompt_now()
+        end
+    end)
+    clink.setcoroutineinterval(c, wait)
+    prompt_refilter_deferred = c
 end
 
 --------------------------------------------------------------------------------
@@ -385,6 +713,15 @@ end
 --- <span class="arg">func</span> function returned.  The API returns one value;
 --- if multiple return values are needed, return them in a table.
 ---
+--- In v1.6.17 and higher, if the prompt filter's <code>cache</code> table has
+--- <code>persist=true</code> (see
+--- <a href="#clink.promptfilter">clink.promptfilter()</a>), then until the
+--- <span class="arg">func</span> function finishes the API returns the result
+--- saved from the last time it finished with the same dependency key, even in
+--- an earlier session.  That lets a new session show a complete prompt right
+--- away.  Only results that can be encoded by
+--- <a href="#json.encode">json.encode()</a> are saved.
+---
 --- If the <code><a href="#prompt_async">prompt.async</a></code> setting is
 --- disabled, then the coroutine runs to completion immediately before
 --- returning.  Otherwise, the coroutine runs during idle while editing the
@@ -407,7 +744,13 @@ function clink.promptcoroutine(func)
         local info = debug.getinfo(func, 'S')
         local src=info.short_src..":"..info.linedefined
 
-        entry = { done=false, refilter=false, result=nil, src=src }
+        local async = settings.get("prompt.async")
+
+        -- Start with the saved result, if any, while the coroutine runs.
+        local persist_key = async and get_persist_key(prompt_filter_current, src)
+        local persisted = persist_key and load_persisted_result(persist_key)
+
+        entry = { done=false, refilter=false, result=persisted, src=src }
         prompt_filter_coroutines[prompt_filter_current] = entry
 
         -- Wrap the supplied function to track completion and end result.
@@ -420,10 +763,11 @@ function clink.promptcoroutine(func)
             entry.done = true
             entry.refilter = true
             entry.result = o
+            if persist_key then
+                save_persisted_result(persist_key, o)
+            end
         end)
 
-        local async = settings.get("prompt.async")
-
         if async then
             -- Add the coroutine.
             clink._after_coroutines(refilterprompt_after_coroutines)
@@ -5,6 +5,12 @@
 clink = clink or {}
 local suggesters = {}
 local _cancel
+local _strategy_text
+local _strategy
+
+-- How many matches to generate for suggestions when only the built-in
+-- suggesters are used.
+local suggestion_match_limit = 1000
 
 if settings.get("lua.debug") or clink.DEBUG then
     -- Make it possible to inspect these locals in the debugger.
@@ -23,8 +29,13 @@ local function _do_suggest(line, lines, matches) -- luacheck: no unused
     -- Protected call to suggesters.
     local impl = function(line, matches) -- luacheck: ignore 432
         local suggestion, offset
-        local strategy = settings.get("autosuggest.strategy"):explode()
-        for _, name in ipairs(strategy) do
+        -- Only split the setting again when it changes.
+        local strategy_text = settings.get("autosuggest.strategy")
+        if strategy_text ~= _strategy_text then
+            _strategy_text = strategy_text
+            _strategy = strategy_text:explode()
+        end
+        for _, name in ipairs(_strategy) do
             local suggester = suggesters[name]
             if suggester then
                 local func = suggester.suggest
@@ -60,6 +71,24 @@ local function _do_suggest(line, lines, matches) -- luacheck: no unused
     clink.set_suggestion_result(line:getline(), info and info.offset or 1, ret, ret2)
 end
 
+--------------------------------------------------------------------------------
+-- The built-in completion suggester only looks at the first few matches, so
+-- when the strategy uses only built-in suggesters there's no need to generate
+-- every match for a huge directory.  Reaching the limit makes the matches
+-- volatile, so completion still generates all of them.
+local function get_generate_limit()
+    local native = clink._native_suggesters
+    if not native or not _strategy then
+        return
+    end
+    for _, name in ipairs(_strategy) do
+        if not native[name] then
+            return
+        end
+    end
+    return suggestion_match_limit
+end
+
 --------------------------------------------------------------------------------
 local function deferred_generate(line, lines, matches, builder, generation_id)
     -- Cancel the current _do_suggest.
@@ -68,28 +97,41 @@ local function deferred_generate(line, lines, matches, builder, generation_id)
     -- Make sure volatile matches don't cause an infinite cycle.
     clink.set_suggestion_started(line:getline())
 
+    builder:set_limit(get_generate_limit())
+
     -- Start coroutine for match generation.
     clink._make_match_generate_coroutine(line, lines, matches, builder, generation_id)
 end
 
 --------------------------------------------------------------------------------
-local function wrap(line, lines, matches, builder, generation_id)
-    local w = { _line = line, _lines = lines, _matches = matches, _generation_id = generation_id }
-    function w:ensure()
-        if not self._ensured then
-            self._ensured = true
-            deferred_generate(line, lines, matches, builder, generation_id)
-        end
+-- The wrapper methods are made once and shared by all wrappers, so wrapping the
+-- matches on each keystroke only allocates the wrapper table itself.
+local wrap_meta = {}
+local wrap_source
+
+local function ensure(w)
+    if not w._ensured then
+        w._ensured = true
+        deferred_generate(w._line, w._lines, w._matches, w._builder, w._generation_id)
     end
+end
 
-    for key, func in pairs(debug.getmetatable(matches).__index) do
-        w[key] = function (...)
-            w:ensure()
-            return func(matches, table.unpack({...}, 2))
+local function wrap(line, lines, matches, builder, generation_id)
+    local source = debug.getmetatable(matches).__index
+    if wrap_source ~= source then
+        local methods = { ensure=ensure }
+        for key, func in pairs(source) do
+            methods[key] = function (w, ...)
+                ensure(w)
+                return func(w._matches, ...)
+            end
         end
+        wrap_meta.__index = methods
+        wrap_source = source
     end
 
-    return w
+    local w = { _line=line, _lines=lines, _matches=matches, _builder=builder, _generation_id=generation_id }
+    return setmetatable(w, wrap_meta)
 end
 
 --------------------------------------------------------------------------------
@@ -176,6 +218,11 @@ function clink.suggester(name)
     local ret = {}
     suggesters[name] = ret
 
+    -- A replaced built-in suggester must be called through Lua.
+    if clink._native_suggesters then
+        clink._native_suggesters[name] = nil
+    end
+
     return ret
 end
 
@@ -246,6 +293,12 @@ function prevcmd_suggester:suggest(line, matches) -- luacheck: no unused
     return clink.history_suggester(line:getline(), true)
 end
 
+--------------------------------------------------------------------------------
+local cwd_history_suggester = clink.suggester("cwd_history")
+function cwd_history_suggester:suggest(line, matches) -- luacheck: no unused
+    return clink.history_suggester(line:getline(), false, true)
+end
+
 --------------------------------------------------------------------------------
 local completion_suggester = clink.suggester("completion")
 function completion_suggester:suggest(line, matches) -- luacheck: no unused
@@ -265,3 +318,10 @@ function completion_suggester:suggest(line, matches) -- luacheck: no unused
         end
     end
 end
+
+--------------------------------------------------------------------------------
+-- The built-in suggesters above are also implemented natively, so that they
+-- don't need to call into Lua.  Their Lua versions are still used when any
+-- suggester in the strategy needs Lua.  Redefining one of them via
+-- clink.suggester() removes it from this list.
+clink._native_suggesters = { history=true, match_prev_cmd=true, cwd_history=true, completion=true }
@@ -21,10 +21,6 @@ local function concat_error(specific, general)
 end
 
 --------------------------------------------------------------------------------
-local powershell_exe
-local checked_prereqs
-local prereq_error
-
 local this_install_type
 local this_install_key
 local latest_cloud_tag
@@ -75,51 +71,6 @@ local function is_rhs_version_newer(lhs, rhs)
     end
 end
 
-local function make_file_at_path(root, rhs)
-    if root and rhs then
-        if root ~= "" and rhs ~= "" then
-            local ret = path.join(root, rhs)
-            if os.isfile(ret) then
-                return '"' .. ret .. '"'
-            end
-        end
-    end
-end
-
-local function find_prereqs()
-    if not checked_prereqs then
-        local sysroot = os.getenv("systemroot")
-        powershell_exe = make_file_at_path(sysroot, "System32\\WindowsPowerShell\\v1.0\\powershell.exe")
-        checked_prereqs = true
-
-        if not powershell_exe then
-            prereq_error = log_info("unable to find PowerShell v5.")
-        else
-            local f = io.popen('2>&1 ' .. powershell_exe .. ' -Command "Get-Host | Select-Object Version"')
-            if not f then
-                powershell_exe = nil
-            else
-                for line in f:lines() do
-                    local ver = line:match("^ *([0-9]+%.[0-9]+)")
-                    if not prereq_error and ver then
-                        if is_rhs_version_newer("v" .. ver, "v5.0") then
-                            powershell_exe = nil
-                            prereq_error = log_info("found PowerShell v" .. ver .. ".")
-                        end
-                    end
-                end
-                f:close()
-            end
-        end
-    end
-
-    if prereq_error then
-        return nil, prereq_error
-    end
-
-    return true
-end
-
 --------------------------------------------------------------------------------
 local function get_update_dir()
     local target = os.gettemppath()
@@ -165,25 +116,28 @@ local function get_installation_type()
 end
 
 --------------------------------------------------------------------------------
-local function collect_output(output, line)
-    local num = #output
-    if num < 10 then
-        table.insert(output, line)
-    elseif num == 10 then
-        table.insert(output, "...")
-    end
-end
-
-local function log_output(command, output)
-    log_info(command)
-    if #output > 0 then
-        log_info("output from command:")
-        for _,line in ipairs(output) do
-            log_info("    "..line)
+-- Performs an HTTPS GET request on a background thread, yielding until it
+-- completes when called from a coroutine.  When FILE is given, the response
+-- body is written to it.
+--
+-- Returns the response body (or true when FILE is given), or nil and an error
+-- message.
+local function http_get(url, file)
+    local _, ismain = coroutine.running()
+    local request, asyncyield = clink._http_request(not ismain, url, file)
+    if not request then
+        return nil, "unable to start request."
+    end
+    if asyncyield then
+        clink._set_coroutine_asyncyield(asyncyield)
+        while not asyncyield:ready() do
+            coroutine.yield()
         end
+        clink._set_coroutine_asyncyield(nil)
     else
-        log_info("no output from command.")
+        request:wait()
     end
+    return request:results()
 end
 
 --------------------------------------------------------------------------------
@@ -205,47 +159,16 @@ local function unzip(zip, out)
         return nil, log_info("output directory '" .. tostring(out) .. "' does not exist.")
     end
 
-    local success_tag = "CLINK-UNZIP-SUCCEEDED"
-    local failure_tag = "CLINK-UNZIP-FAILED"
-    -- Including the module name avoids problems if something overrides the Expand-Archive cmdlet.
-    -- For example, older versions of PowerShell Community Extensions did (https://github.com/pscx/pscx).
-    local expand_archive = string.format([[$ProgressPreference='SilentlyContinue' ; Microsoft.PowerShell.Archive\Expand-Archive -Force -LiteralPath \"%s\" -DestinationPath \"%s\"]], zip, out) -- luacheck: no max line length
-    local powershell_command = string.format([[try { %s ; echo "%s" } catch { echo "%s" ; echo $_.Exception.Message ; echo "`nALL ERRORS:`n" ; echo $error }]], expand_archive, success_tag, failure_tag) -- luacheck: no max line length
-    local cmd = string.format([[2>&1 %s -Command "%s"]], powershell_exe, powershell_command)
-    local f, err = io.popen(cmd)
-    if not f then
-        log_info(cmd)
-        return nil, err
-    end
-
-    local result
-    local output = {}
-    local saw_success
-    local saw_failure
-    for line in f:lines() do
-        local utf8 = unicode.fromcodepage(line)
-        line = utf8 or line
-        collect_output(output, line)
-        if line == success_tag then
-            saw_success = true
-        elseif line == failure_tag then
-            saw_failure = true
-        end
-    end
-    if saw_success and not saw_failure then
-        result = true
-    end
-    f:close()
-
-    if not result then
-        log_output(cmd, output)
+    local ok, err = clink._unzip(zip, out)
+    if not ok then
+        log_info("unable to expand '" .. zip .. "'; " .. tostring(err) .. ".")
         -- Delete the zip file; it might have been damaged, and re-downloading
         -- it might be necessary.
         os.remove(zip)
-        return nil
+        return nil, err
     end
 
-    return result
+    return true
 end
 
 local function install_file(from_dir, to_dir, name)
@@ -380,43 +303,34 @@ local function internal_check_for_update(force)
     local install_type = get_installation_type()
 
     -- Use github API to query latest release.
-    --
-    -- PowerShell needs -UseBasicParsing to prevent assuming the response is
-    -- HTML and attempting to use IE to parse the DOM and execute scripts, and
-    -- and needs to force TLS 1.2 because older versions of PowerShell default
-    -- to using TLS 1.0.
     if force then
         need_lf = true
         print("Checking latest version...")
     end
-    local cloud_tag
-    local api = string.format([[2>&1 ]] .. powershell_exe .. [[ -Command "$ProgressPreference='SilentlyContinue' ; [System.Net.ServicePointManager]::SecurityProtocol = [System.Net.SecurityProtocolType]::Tls12 ; Invoke-WebRequest -Headers @{\"cache-control\"=\"no-cache\"} -UseBasicParsing https://api.github.com/repos/%s/releases/latest | Select-Object -ExpandProperty Content"]], github_repo) -- luacheck: no max line length
-    local f, err = io.popen(api)
-    if not f then
-        log_info(api)
+    local api = string.format("https://api.github.com/repos/%s/releases/latest", github_repo)
+    local content, err = http_get(api)
+    if not content then
         return nil, concat_error(err, log_info("unable to query github api."))
     end
+    local release = json.decode(content)
+    if type(release) ~= "table" then
+        return nil, log_info("unable to parse latest release information.")
+    end
+    local cloud_tag = type(release.tag_name) == "string" and release.tag_name or nil
     local latest_update_file
-    local output = {}
-    for line in f:lines() do
-        local utf8 = unicode.fromcodepage(line)
-        line = utf8 or line
-        local tag = line:match('"tag_name": *"([^"]-)"')
-        local match = line:match('"browser_download_url": *"([^"]-%.' .. install_type .. ')"')
-        if not cloud_tag and tag then
-            cloud_tag = tag
-        end
-        if not latest_update_file and match then
-            latest_update_file = match
+    if type(release.assets) == "table" then
+        local suffix = "." .. install_type
+        for _, asset in ipairs(release.assets) do
+            local url = type(asset) == "table" and asset.browser_download_url
+            if type(url) == "string" and url:sub(-#suffix):lower() == suffix then
+                latest_update_file = url
+                break
+            end
         end
-        collect_output(output, line)
     end
-    f:close()
     if not cloud_tag then
-        log_output(api, output)
         return nil, log_info("unable to find latest release.")
     elseif not latest_update_file then
-        log_output(api, output)
         return nil, log_info("unable to find latest release " .. install_type .. " file.")
     end
     latest_cloud_tag = cloud_tag
@@ -449,32 +363,12 @@ local function internal_check_for_update(force)
         return nil, err
     end
     log_info("downloading " .. latest_update_file .. " to " .. local_update_file .. ".")
-    local cmd = string.format([[2>&1 ]] .. powershell_exe .. [[ -Command "$ProgressPreference='SilentlyContinue' ; [System.Net.ServicePointManager]::SecurityProtocol = [System.Net.SecurityProtocolType]::Tls12 ; Invoke-WebRequest '%s' -OutFile '%s'"]], latest_update_file, local_update_file) -- luacheck: no max line length
-    f, err = io.popen(cmd)
-    if not f then
-        log_info(cmd)
+    local ok
+    ok, err = http_get(latest_update_file, local_update_file)
+    if not ok or not os.isfile(local_update_file) then
         os.remove(local_update_file)
         return nil, concat_error(err, log_info("failed to download " .. install_type .. " file."))
     end
-    output = {}
-    for line in f:lines() do
-        local utf8 = unicode.fromcodepage(line)
-        line = utf8 or line
-        collect_output(output, line)
-    end
-    f:close()
-
-    local ok = os.isfile(local_update_file)
-    if ok then
-        local info = os.globfiles(local_update_file, 2)
-        if not info or not info[1] or not info[1].size or info[1].size == 0 then
-            ok = false
-        end
-    end
-    if not ok then
-        log_output(cmd, output)
-        return nil, log_info("failed to download " .. install_type .. " file.")
-    end
 
     return local_update_file
 end
@@ -526,11 +420,6 @@ local function is_update_ready(force)
         return nil, err
     end
 
-    local ok, err = find_prereqs() -- luacheck: ignore 411
-    if not ok then
-        return nil, concat_error(err, log_info("autoupdate requires PowerShell v5."))
-    end
-
     -- Download latest update file, or use update file that's already been
     -- downloaded.
     local update_file, stop
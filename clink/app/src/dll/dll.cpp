@@ -13,6 +13,7 @@
 #include <core/os.h>
 #include <core/path.h>
 #include <core/settings.h>
+#include <core/startup_profile.h>
 #include <core/str.h>
 #include <core/str_tokeniser.h>
 #include <lib/recognizer.h>
@@ -140,6 +141,14 @@ INT_PTR WINAPI initialise_clink(const app_context::desc& app_desc)
 
     app_ctx->start_logger();
 
+    // Continue the startup profile from where the loader left off.
+    for (uint32 i = 0; i < min<uint32>(app_desc.num_loader_phases, sizeof_array(app_desc.loader_phases)); ++i)
+    {
+        const startup_phase_info& phase = app_desc.loader_phases[i];
+        startup_profile::add(phase.name, phase.elapsed, phase.depth);
+    }
+    startup_phase phase("initialise_clink");
+
     // What process is the DLL loaded into?
     str<64> host_name;
     if (!app_ctx->get_host_name(host_name))
@@ -174,7 +183,12 @@ INT_PTR WINAPI initialise_clink(const app_context::desc& app_desc)
     if (validate <= 0)
         return validate;
 
-    if (!g_host->initialise())
+    bool initialised;
+    {
+        startup_phase init_phase("host_cmd::initialise");
+        initialised = g_host->initialise();
+    }
+    if (!initialised)
     {
         failed();
         return false;
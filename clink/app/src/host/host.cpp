@@ -5,10 +5,13 @@
 #include "host.h"
 #include "host_lua.h"
 
+#include <core/file_watcher.h>
 #include <core/globber.h>
+#include <core/housekeeping.h>
 #include <core/os.h>
 #include <core/path.h>
 #include <core/settings.h>
+#include <core/startup_profile.h>
 #include <core/str.h>
 #include <core/str_compare.h>
 #include <core/str_tokeniser.h>
@@ -21,6 +24,7 @@
 #include <lib/match_generator.h>
 #include <lib/line_editor.h>
 #include <lib/line_editor_integration.h>
+#include <lib/deferred_init.h>
 #include <lib/intercept.h>
 #include <lib/clink_ctrlevent.h>
 #include <lib/clink_rl_signal.h>
@@ -44,6 +48,7 @@ extern "C" {
 #include <lua.h>
 #include <lauxlib.h>
 #include <readline/readline.h>
+#include <readline/history.h>
 #include <readline/rldefs.h>
 #include <readline/rlprivate.h>
 }
@@ -160,6 +165,14 @@ static setting_int g_clink_update_interval(
     5);
 
 
+static setting_bool g_debug_log_prompt_steps(
+    "debug.log_prompt_steps",
+    "Log the setup steps before each prompt",
+    "When true, the time taken by each setup step before an interactive prompt is\n"
+    "written to the log file, along with which steps were skipped because their\n"
+    "inputs hadn't changed since the previous prompt.",
+    false);
+
 #ifdef DEBUG
 static setting_bool g_debug_heap_stats(
     "debug.heap_stats",
@@ -182,6 +195,68 @@ extern bool g_suppress_signal_assert;
 
 
 
+//------------------------------------------------------------------------------
+// Times a setup step before a prompt, for debug.log_prompt_steps.  Steps
+// record their inputs and skip their work when the inputs haven't changed
+// since the previous prompt; skipped steps are reported as such.
+class prompt_step
+{
+public:
+                    prompt_step(const char* name) : m_name(name) {}
+                    ~prompt_step();
+    void            skip() { m_skipped = true; }
+private:
+    const char*     m_name;
+    os::high_resolution_clock m_clock;
+    bool            m_skipped = false;
+};
+
+static str_moveable s_prompt_steps;
+
+//------------------------------------------------------------------------------
+prompt_step::~prompt_step()
+{
+    if (!g_debug_log_prompt_steps.get())
+        return;
+
+    str<64> tmp;
+    tmp.format("\n  %-20s %8.3f ms%s", m_name, m_clock.elapsed() * 1000, m_skipped ? " (skipped)" : "");
+    s_prompt_steps.concat(tmp.c_str(), tmp.length());
+}
+
+//------------------------------------------------------------------------------
+static void log_prompt_steps()
+{
+    if (!s_prompt_steps.empty())
+    {
+        LOG("Prompt setup steps:%s", s_prompt_steps.c_str());
+        s_prompt_steps.clear();
+    }
+}
+
+//------------------------------------------------------------------------------
+// Appends the size and last write time of a file, or returns false if the file
+// doesn't exist.
+static bool append_file_stamp(str_base& out, const char* file)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    wstr<> wfile(file);
+    if (!GetFileAttributesExW(wfile.c_str(), GetFileExInfoStandard, &fad))
+    {
+        out << "|" << file << "|-";
+        return false;
+    }
+
+    str<64> tmp;
+    tmp.format("|%08x%08x|%08x%08x",
+               fad.nFileSizeHigh, fad.nFileSizeLow,
+               fad.ftLastWriteTime.dwHighDateTime, fad.ftLastWriteTime.dwLowDateTime);
+    out << "|" << file << tmp;
+    return true;
+}
+
+
+
 //------------------------------------------------------------------------------
 static void get_errorlevel_tmp_name(str_base& out, const char* ext, bool wild=false)
 {
@@ -208,70 +283,123 @@ static void get_errorlevel_tmp_name(str_base& out, const char* ext, bool wild=fa
 
 
 //------------------------------------------------------------------------------
-class dir_history_entry : public no_copy
+// Fixed size ring of directories, oldest first.  When full, adding a directory
+// drops the oldest one, without allocating anything except the new string.
+class dir_history : public no_copy
 {
 public:
-                    dir_history_entry(const char* s);
-                    dir_history_entry(dir_history_entry&& d) { dir = d.dir; d.dir = nullptr; }
-                    ~dir_history_entry() { free(dir); }
+                    ~dir_history() { clear(); }
 
-    const char*     get() const { return dir; }
+    uint32          size() const { return m_count; }
+    bool            empty() const { return !m_count; }
+    const char*     get(uint32 index) const { return m_dirs[slot(index)]; }
+    const char*     back() const { return m_count ? get(m_count - 1) : nullptr; }
+    void            push_back(const char* dir);
+    bool            erase(uint32 index);
+    void            clear();
 
 private:
-    char* dir;
+    uint32          slot(uint32 index) const { return (m_head + index) % c_max; }
+
+    static const uint32 c_max = 100;
+    char*           m_dirs[c_max] = {};
+    uint32          m_head = 0;
+    uint32          m_count = 0;
 };
 
 //------------------------------------------------------------------------------
-dir_history_entry::dir_history_entry(const char* s)
+void dir_history::push_back(const char* dir)
 {
-    size_t alloc = strlen(s) + 1;
-    dir = (char *)malloc(alloc);
-    memcpy(dir, s, alloc);
+    const size_t alloc = strlen(dir) + 1;
+    char* copy = (char*)malloc(alloc);
+    if (!copy)
+        return;
+    memcpy(copy, dir, alloc);
+
+    if (m_count < c_max)
+    {
+        m_dirs[slot(m_count++)] = copy;
+    }
+    else
+    {
+        free(m_dirs[m_head]);
+        m_dirs[m_head] = copy;
+        m_head = slot(1);
+    }
 }
 
 //------------------------------------------------------------------------------
-const int32 c_max_dir_history = 100;
-static std::list<dir_history_entry> s_dir_history;
+bool dir_history::erase(uint32 index)
+{
+    if (index >= m_count)
+        return false;
+
+    free(m_dirs[slot(index)]);
+    for (uint32 i = index + 1; i < m_count; ++i)
+        m_dirs[slot(i - 1)] = m_dirs[slot(i)];
+    m_dirs[slot(--m_count)] = nullptr;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void dir_history::clear()
+{
+    for (uint32 i = 0; i < m_count; ++i)
+    {
+        free(m_dirs[slot(i)]);
+        m_dirs[slot(i)] = nullptr;
+    }
+    m_head = 0;
+    m_count = 0;
+}
+
+//------------------------------------------------------------------------------
+static dir_history s_dir_history;
 
 //------------------------------------------------------------------------------
 static void update_dir_history()
 {
+    prompt_step step("dir history");
+
     str<> cwd;
     os::get_current_dir(cwd);
 
+    // Nothing changes if the cwd is already the most recent entry, since
+    // 'erase_prev' has already removed any earlier entries for it.
+    static int32 s_dupe_mode = -1;
+    const int32 dupe_mode = g_directories_dupe_mode.get();
+    if (dupe_mode == s_dupe_mode &&
+        !s_dir_history.empty() &&
+        _stricmp(s_dir_history.back(), cwd.c_str()) == 0)
+    {
+        step.skip();
+        return;
+    }
+    s_dupe_mode = dupe_mode;
+
     bool add = true;                    // 'add'
-    switch (g_directories_dupe_mode.get())
+    switch (dupe_mode)
     {
     case 1:                             // 'erase_prev'
+        for (uint32 i = s_dir_history.size(); i--;)
         {
-            auto iter = s_dir_history.begin();
-            while (iter != s_dir_history.end())
-            {
-                auto next(iter);
-                ++next;
-                if (_stricmp(iter->get(), cwd.c_str()) == 0)
-                    s_dir_history.erase(iter);
-                iter = next;
-            }
+            if (_stricmp(s_dir_history.get(i), cwd.c_str()) == 0)
+                s_dir_history.erase(i);
         }
         break;
     }
 
-    if (!s_dir_history.size())
+    if (s_dir_history.empty())
         add = true;
-    else if (add && _stricmp(s_dir_history.back().get(), cwd.c_str()) == 0)
+    else if (add && _stricmp(s_dir_history.back(), cwd.c_str()) == 0)
         add = false;
 
-    // Add cwd to tail.
+    // Add cwd to tail; the ring drops the oldest entry when it's full.
     if (add)
     {
         dbg_ignore_scope(snapshot, "History");
         s_dir_history.push_back(cwd.c_str());
     }
-
-    // Trim overflow from head.
-    while (s_dir_history.size() > c_max_dir_history)
-        s_dir_history.pop_front();
 }
 
 //------------------------------------------------------------------------------
@@ -282,24 +410,13 @@ static void prev_dir_history(str_base& inout)
     if (s_dir_history.size() < 2)
         return;
 
-    auto a = s_dir_history.rbegin();
-    a++;
-
-    make_cd_command(a->get(), inout);
+    make_cd_command(s_dir_history.get(s_dir_history.size() - 2), inout);
 }
 
 //------------------------------------------------------------------------------
 bool host_remove_dir_history(int32 index)
 {
-    for (auto iter = s_dir_history.begin(); iter != s_dir_history.end(); ++iter, --index)
-    {
-        if (index == 0)
-        {
-            s_dir_history.erase(iter);
-            return true;
-        }
-    }
-    return false;
+    return index >= 0 && s_dir_history.erase(index);
 }
 
 //------------------------------------------------------------------------------
@@ -343,6 +460,8 @@ static void adjust_prompt_spacing()
         // was inspired by Powerlevel10k, which doesn't consume blank lines,
         // but CMD causes blank lines more often than zsh does.  So to achieve
         // a similar effect it's necessary to actively consume blank lines.
+        // Pending output must reach the console before reading the cursor.
+        wait_for_console_output();
         CONSOLE_SCREEN_BUFFER_INFO csbi;
         HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
         if (GetConsoleScreenBufferInfo(h, &csbi) && csbi.dwCursorPosition.X == 0)
@@ -458,18 +577,23 @@ host::host(const char* name)
 
     assert(!get_lua_terminal_input());
     set_lua_terminal(m_terminal.in, m_terminal.out);
+
+    start_purge_old_files();
 }
 
 //------------------------------------------------------------------------------
 host::~host()
 {
-    purge_old_files();
+    m_purger.reset();
+    m_settings_watcher.reset();
 
     delete m_prompt_filter;
     delete m_suggester;
     delete m_lua;
     delete m_printer;
 
+    lua_state::discard_standby();
+
     set_lua_terminal(nullptr, nullptr);
     terminal_destroy(m_terminal);
 }
@@ -670,16 +794,18 @@ bool host::call_lua_rl_global_function(const char* func_name, const line_state*
 //------------------------------------------------------------------------------
 const char** host::copy_dir_history(int32* total)
 {
-    if (!s_dir_history.size())
+    if (s_dir_history.empty())
         return nullptr;
 
     // Copy the directory list (just a shallow copy of the dir pointers).
-    const char** history = (const char**)malloc(sizeof(*history) * s_dir_history.size());
-    int32 i = 0;
-    for (auto const& it : s_dir_history)
-        history[i++] = it.get();
+    const uint32 count = s_dir_history.size();
+    const char** history = (const char**)malloc(sizeof(*history) * count);
+    if (!history)
+        return nullptr;
+    for (uint32 i = 0; i < count; ++i)
+        history[i] = s_dir_history.get(i);
 
-    *total = i;
+    *total = int32(count);
     return history;
 }
 
@@ -738,6 +864,11 @@ bool host::edit_line(const char* prompt, const char* rprompt, str_base& out, boo
 {
     assert(!m_prompt); // Reentrancy not supported!
 
+    // Something other than CMD or Clink may have changed the environment.
+    // Likewise, a doskey command may have changed the aliases.
+    os::invalidate_env_cache();
+    os::invalidate_alias_cache();
+
     const app_context* app = app_context::get();
     bool reset = app->update_env();
 
@@ -761,8 +892,49 @@ bool host::edit_line(const char* prompt, const char* rprompt, str_base& out, boo
     app->get_settings_path(settings_file);
     app->get_default_settings_file(default_settings_file);
     app->get_state_dir(state_dir);
-    settings::load(settings_file.c_str(), default_settings_file.c_str());
-    reset_keyseq_to_name_map();
+    {
+        // Skip reloading when neither file has changed since the last load.
+        // Changes made through Clink (e.g. settings.set() or `clink set`)
+        // are saved to the file, so they still get picked up.
+        //
+        // The watcher avoids querying the files on every prompt, which can be
+        // slow on network shares; the stamps are only compared after it sees
+        // a change (or if it can't watch the files).
+        if (!m_settings_watcher)
+            m_settings_watcher = std::make_unique<file_watcher>();
+        m_settings_watcher->watch({ settings_file.c_str(), default_settings_file.c_str() });
+
+        static str_moveable s_settings_stamp;
+        str<> stamp;
+        bool exists = true;
+        if (m_settings_watcher->check_changed() || s_settings_stamp.empty())
+        {
+            exists = append_file_stamp(stamp, settings_file.c_str());
+            append_file_stamp(stamp, default_settings_file.c_str());
+        }
+        else
+        {
+            stamp = s_settings_stamp.c_str();
+        }
+
+        prompt_step step("settings");
+        if (exists && stamp.equals(s_settings_stamp.c_str()))
+        {
+            step.skip();
+        }
+        else
+        {
+            startup_phase phase("settings::load");
+            settings::load(settings_file.c_str(), default_settings_file.c_str());
+            s_settings_stamp = stamp.c_str();
+
+            // Settings can affect key sequence processing.
+            reset_keyseq_to_name_map();
+
+            // Settings can affect which matches are generated.
+            clear_completion_cache();
+        }
+    }
 
     // Set up the string comparison mode.
     static_assert(str_compare_scope::exact == 0, "g_ignore_case values must match str_compare_scope values");
@@ -788,11 +960,22 @@ bool host::edit_line(const char* prompt, const char* rprompt, str_base& out, boo
 
     // Run " echo %ERRORLEVEL% >tmpfile 2>nul" before every interactive prompt.
     static bool s_inspect_errorlevel = true;
+    static str_moveable s_errfile_verified;
     bool inspect_errorlevel = false;
     if (g_get_errorlevel.get())
     {
         if (interactive)
         {
+            prompt_step step("errorlevel");
+
+            int32 exit_code;
+            if (get_exit_code(exit_code))
+            {
+                os::set_errorlevel(exit_code);
+                s_inspect_errorlevel = true;
+                goto done_errorlevel;
+            }
+
             str<> tmp_errfile;
             get_errorlevel_tmp_name(tmp_errfile, "txt");
 
@@ -802,6 +985,9 @@ bool host::edit_line(const char* prompt, const char* rprompt, str_base& out, boo
                 // then skip interrogating it.  Otherwise a confusing error
                 // message may appear.  For example if the profile directory
                 // points at a file by mistake, or access is denied, or etc.
+                // Once the file has been written, it doesn't need to be
+                // checked again.
+                if (!tmp_errfile.equals(s_errfile_verified.c_str()))
                 {
                     wstr<> wtmp_errfile(tmp_errfile.c_str());
                     DWORD share_flags = FILE_SHARE_READ|FILE_SHARE_WRITE;
@@ -813,6 +999,7 @@ bool host::edit_line(const char* prompt, const char* rprompt, str_base& out, boo
                         goto skip_errorlevel;
                     }
                     CloseHandle(errfile);
+                    s_errfile_verified = tmp_errfile.c_str();
                 }
 
                 inspect_errorlevel = true;
@@ -852,6 +1039,8 @@ bool host::edit_line(const char* prompt, const char* rprompt, str_base& out, boo
             }
             s_inspect_errorlevel = !s_inspect_errorlevel;
         }
+done_errorlevel:
+        ;
     }
     else
     {
@@ -869,7 +1058,10 @@ skip_errorlevel:
 
     // Update last cwd and whether transient prompt can be applied later.
     if (init_editor)
+    {
+        prompt_step step("last cwd");
         update_last_cwd();
+    }
 
     // Set up Lua.
     bool local_lua = g_reload_scripts.get();
@@ -885,6 +1077,7 @@ skip_errorlevel:
         //      scripts.
         // Reloading settings again after deleting Lua resolves the problem.
         const bool reload_settings = !!m_lua;
+        os::high_resolution_clock clock;
         delete m_prompt_filter;
         delete m_suggester;
         delete m_lua;
@@ -892,7 +1085,10 @@ skip_errorlevel:
         m_suggester = nullptr;
         m_lua = nullptr;
         if (reload_settings)
+        {
+            LOG("Shut down Lua in %u ms", unsigned(clock.elapsed() * 1000));
             settings::load(settings_file.c_str(), default_settings_file.c_str());
+        }
     }
     if (!local_lua && m_lua)
         init_scripts = false;
@@ -918,7 +1114,11 @@ skip_errorlevel:
         extern void initialise_readline(const char* shell_name, const char* state_dir, const char* default_inputrc, bool no_user=false);
         initialise_readline("clink", state_dir.c_str(), default_inputrc.c_str());
         initialise_lua(lua);
-        lua.load_scripts();
+        {
+            startup_phase phase("load scripts");
+            lua.load_scripts();
+        }
+        clear_completion_cache();
     }
 
     // Detect light vs dark console theme.
@@ -1000,6 +1200,11 @@ skip_errorlevel:
     history_database* history = history_database::get();
     if (init_history)
     {
+        prompt_step step("history");
+
+        // Finish loading history if it was deferred and never got loaded.
+        ensure_deferred_init(deferred_init_task::history);
+
         if (history)
         {
             str<> history_path;
@@ -1022,8 +1227,27 @@ skip_errorlevel:
 
         if (history)
         {
+            startup_phase phase("load history");
             history->initialise();
-            history->load_rl_history();
+
+            // Loading the history banks isn't needed to display the first
+            // prompt, so it's deferred until input is idle or the history is
+            // first used.  Later prompts only reload what changed, which is
+            // usually cheap, so they load synchronously.
+            static bool s_history_loaded = false;
+            if (!s_history_loaded)
+            {
+                s_history_loaded = true;
+                defer_init(deferred_init_task::history, [history] ()
+                {
+                    history->load_rl_history();
+                    using_history();
+                });
+            }
+            else
+            {
+                history->load_rl_history();
+            }
         }
     }
 
@@ -1035,7 +1259,18 @@ skip_errorlevel:
         bool ok; // Not needed for the initial filter call.
         m_prompt = prompt ? prompt : "";
         m_rprompt = rprompt ? rprompt : "";
-        desc.prompt = filter_prompt(&desc.rprompt, ok);
+        {
+            startup_phase phase("prompt filter");
+            desc.prompt = filter_prompt(&desc.rprompt, ok);
+        }
+
+        // The first prompt is ready, so startup is complete.
+        if (!startup_profile::is_finished())
+        {
+            str<280> profile_path;
+            app->get_startup_profile_path(profile_path);
+            startup_profile::finish(profile_path.c_str());
+        }
     }
 
     // Create the editor and add components to it.
@@ -1171,12 +1406,16 @@ skip_errorlevel:
 
         // Give the directory history queue a crack at the current directory.
         update_dir_history();
+        log_prompt_steps();
 
         // Call the editor to accept a line of input.
         ret = skip_editor || (editor && editor->edit(out, edit));
         if (!ret)
             break;
 
+        // The history must be loaded before adding to it.
+        ensure_deferred_init(deferred_init_task::history);
+
         // Determine whether to add the line to history.  Must happen before
         // calling expand() because that resets the history position.
         bool add_history = true;
@@ -1379,7 +1618,13 @@ const char* host::filter_prompt(const char** rprompt, bool& ok, bool transient,
 
         m_filtered_prompt.clear();
         m_filtered_rprompt.clear();
-        if (g_filter_prompt.get() && m_prompt_filter)
+        if (transient && g_filter_prompt.get() && m_prompt_filter &&
+            m_prompt_filter->take_transient(m_filtered_prompt, m_filtered_rprompt))
+        {
+            // Prompt filter segments already provided the transient prompt
+            // while filtering the normal prompt, so no need to filter again.
+        }
+        else if (g_filter_prompt.get() && m_prompt_filter)
         {
             str_moveable tmp;
             str_moveable rtmp;
@@ -1430,18 +1675,24 @@ const char* host::filter_prompt(const char** rprompt, bool& ok, bool transient,
 }
 
 //------------------------------------------------------------------------------
-void host::purge_old_files()
+void host::start_purge_old_files()
 {
-    str<> tmp;
-    get_errorlevel_tmp_name(tmp, nullptr, true/*wild*/);
+    // Globbing the temp directory can be slow, so purge in the background, and
+    // at most once every 10 minutes across all sessions.
+    m_purger = std::make_unique<housekeeper>("errorlevel_purge", 10 * 60);
+    m_purger->start([] (const volatile bool& cancel)
+    {
+        str<> tmp;
+        get_errorlevel_tmp_name(tmp, nullptr, true/*wild*/);
 
-    // Purge orphaned clink_errorlevel temporary files older than 30 minutes.
-    const int32 seconds = 30 * 60/*seconds per minute*/;
+        // Purge orphaned clink_errorlevel temporary files older than 30 minutes.
+        const int32 seconds = 30 * 60/*seconds per minute*/;
 
-    globber i(tmp.c_str());
-    i.older_than(seconds);
-    while (i.next(tmp))
-        _unlink(tmp.c_str());
+        globber i(tmp.c_str());
+        i.older_than(seconds);
+        while (!cancel && i.next(tmp))
+            _unlink(tmp.c_str());
+    });
 }
 
 //------------------------------------------------------------------------------
@@ -15,7 +15,9 @@
 
 class lua_state;
 class str_base;
+class file_watcher;
 class host_lua;
+class housekeeper;
 class prompt_filter;
 class suggester;
 class printer_context;
@@ -77,9 +79,10 @@ protected:
     bool            edit_line(const char* prompt, const char* rprompt, str_base& out, bool edit=true);
     virtual void    initialise_lua(lua_state& lua) = 0;
     virtual void    initialise_editor_desc(line_editor::desc& desc) = 0;
+    virtual bool    get_exit_code(int32& exit_code) { return false; }
 
 private:
-    void            purge_old_files();
+    void            start_purge_old_files();
     void            update_last_cwd();
     void            pop_queued_line();
 
@@ -91,6 +94,8 @@ private:
     host_lua*       m_lua = nullptr;
     prompt_filter*  m_prompt_filter = nullptr;
     suggester*      m_suggester = nullptr;
+    std::unique_ptr<housekeeper> m_purger;
+    std::unique_ptr<file_watcher> m_settings_watcher;
     const char*     m_prompt = nullptr;
     const char*     m_rprompt = nullptr;
     str<256>        m_filtered_prompt;
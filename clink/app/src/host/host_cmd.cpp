@@ -58,6 +58,16 @@ static setting_enum g_autoanswer(
     "off,answer_yes,answer_no",
     0);
 
+static setting_bool g_errorlevel_in_process(
+    "cmd.errorlevel_in_process",
+    "Get the last exit code without running a command",
+    "When this is enabled, cmd.get_errorlevel reads the exit code that cmd.exe\n"
+    "records for the last program it ran, instead of running a hidden command that\n"
+    "writes %errorlevel% to a temporary file.  This avoids the extra command and\n"
+    "file access before each prompt, but it only sees exit codes of programs, not\n"
+    "errorlevels set by internal commands such as 'cd' or 'exit /b'.",
+    false);
+
 static setting_str g_admin_title_prefix(
     "cmd.admin_title_prefix",
     "Replaces the console title prefix when elevated",
@@ -422,23 +432,34 @@ void host_cmd::edit_line(wchar_t* chars, int32 max_chars, bool edit)
     bool resolved = false;
     wstr_base wout(chars, max_chars);
 
-    // Convert the prompt to Utf8 and parse backspaces in the string.
+    // Convert the prompt to Utf8 and parse backspaces in the string.  Batch
+    // scripts can use the same prompt many times (e.g. `set /p` in a loop), so
+    // the result is kept for as long as the raw prompt stays the same.
     // BUGBUG: This mishandles multi-byte characters!
     // BUGBUG: This mishandles surrogate pairs and combining characters!
     // BUGBUG: This mishandles backspaces inside envvars expanded by OSC codes!
-    str_moveable utf8_prompt(m_prompt.get());
+    const wchar_t* const raw_prompt = m_prompt.get() ? m_prompt.get() : L"";
+    if (!m_prompt_key.equals(raw_prompt))
+    {
+        m_prompt_key = raw_prompt;
+        m_prompt_utf8.clear();
+        to_utf8(m_prompt_utf8, raw_prompt);
+
+        char* write = m_prompt_utf8.data();
+        char* read = write;
+        while (char c = *read++)
+            if (c != '\b')
+                *write++ = c;
+            else if (write > m_prompt_utf8.c_str())
+                --write;
+        *write = '\0';
+        m_prompt_utf8.truncate(uint32(write - m_prompt_utf8.c_str()));
+    }
+    const str_base& utf8_prompt = m_prompt_utf8;
+
     str_moveable utf8_rprompt;
     prompt_utils::get_rprompt(utf8_rprompt);
 
-    char* write = utf8_prompt.data();
-    char* read = write;
-    while (char c = *read++)
-        if (c != '\b')
-            *write++ = c;
-        else if (write > utf8_prompt.c_str())
-            --write;
-    *write = '\0';
-
     // Call readline.
     {
         str<1024> out;
@@ -701,11 +722,26 @@ BOOL WINAPI host_cmd::write_console(
 #ifndef CAPTURE_PUSHD_STACK
 static void update_pushd_depth(const wchar_t* chars, int32 char_count)
 {
+    // The same prompt from the same PROMPT format has the same depth, so the
+    // most recent result is kept to avoid expanding and converting the prompt
+    // again when a batch script shows the same prompt many times.
+    static wstr_moveable s_last_chars;
+    static str_moveable s_last_var;
+    static int32 s_last_depth = -1;
+
     int32 depth = -1;
 
     str<> var;
     if (os::get_env("prompt", var) && strstr(var.c_str(), "$+"))
     {
+        if (s_last_var.equals(var.c_str()) &&
+            s_last_chars.length() == uint32(char_count) &&
+            wcsncmp(s_last_chars.c_str(), chars, char_count) == 0)
+        {
+            os::set_pushd_depth(s_last_depth);
+            return;
+        }
+
         str<> expanded;
         str<> captured;
         to_utf8(captured, wstr_iter(chars, char_count));
@@ -746,6 +782,11 @@ static void update_pushd_depth(const wchar_t* chars, int32 char_count)
                 depth = 0;
             }
         }
+
+        s_last_chars.clear();
+        s_last_chars.concat(chars, char_count);
+        s_last_var = var.c_str();
+        s_last_depth = depth;
     }
 
     os::set_pushd_depth(depth);
@@ -777,12 +818,39 @@ BOOL WINAPI host_cmd::set_env_var(const wchar_t* name, const wchar_t* value)
 {
     seh_scope seh;
 
+    BOOL ok;
     if (value == nullptr || _wcsicmp(name, L"prompt") != 0)
-        return __Real_SetEnvironmentVariableW(name, value);
+    {
+        ok = __Real_SetEnvironmentVariableW(name, value);
+    }
+    else
+    {
+        tagged_prompt prompt;
+        prompt.tag(value);
+        ok = __Real_SetEnvironmentVariableW(name, prompt.get());
+    }
 
-    tagged_prompt prompt;
-    prompt.tag(value);
-    return __Real_SetEnvironmentVariableW(name, prompt.get());
+    os::invalidate_env_cache();
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+// cmd.exe keeps the exit code of the last program it ran in the "=ExitCode"
+// pseudo environment variable, as 8 hex digits.  Reading it is much cheaper
+// than running a command to echo %errorlevel%, but internal commands that set
+// the errorlevel don't update it.
+bool host_cmd::get_exit_code(int32& exit_code)
+{
+    if (!g_errorlevel_in_process.get())
+        return false;
+
+    WCHAR buffer[16];
+    const DWORD len = __Real_GetEnvironmentVariableW(L"=ExitCode", buffer, sizeof_array(buffer));
+    if (!len || len >= sizeof_array(buffer))
+        exit_code = 0;                  // No program has run yet.
+    else
+        exit_code = int32(wcstoul(buffer, nullptr, 16));
+    return true;
 }
 
 //------------------------------------------------------------------------------
@@ -791,6 +859,7 @@ BOOL WINAPI host_cmd::set_env_strs(wchar_t* enviro)
     seh_scope seh;
 
     const BOOL ok = __Real_SetEnvironmentStringsW(enviro);
+    os::invalidate_env_cache();
     tag_prompt();
 
     return ok;
@@ -41,12 +41,15 @@ private:
     bool                initialise_system();
     virtual void        initialise_lua(lua_state& lua) override;
     virtual void        initialise_editor_desc(line_editor::desc& desc) override;
+    virtual bool        get_exit_code(int32& exit_code) override;
     void                make_aliases(str_base& clink, str_base& history);
     void                add_aliases(bool force);
     void                edit_line(wchar_t* chars, int32 max_chars, bool edit=true);
     bool                capture_prompt(const wchar_t* chars, int32 char_count);
     bool                is_interactive() const;
     tagged_prompt       m_prompt;
+    wstr_moveable       m_prompt_key;       // Raw prompt that m_prompt_utf8 is from.
+    str_moveable        m_prompt_utf8;
     doskey              m_doskey;
     cmd_command_tokeniser m_command_tokeniser;
     cmd_word_tokeniser  m_word_tokeniser;
@@ -4,6 +4,7 @@
 #include "pch.h"
 #include "host_lua.h"
 #include "utils/app_context.h"
+#include "version.h"
 
 #include <core/globber.h>
 #include <core/os.h>
@@ -13,8 +14,11 @@
 #include <core/str_transform.h>
 #include <core/str_unordered_set.h>
 #include <core/settings.h>
+#include <core/startup_profile.h>
 #include <core/log.h>
 #include <lib/rl_integration.h>
+#include <lua/script_settings.h>
+#include <terminal/printer.h>
 #include <terminal/terminal_helpers.h>
 
 #include <vector>
@@ -28,6 +32,9 @@ namespace host_lua_callbacks {
 
 void before_read_stdin(lua_saved_console_mode* saved, void* stream)
 {
+    if (g_printer)
+        g_printer->release_output();
+
     saved->h = 0;
     HANDLE h_stdin = GetStdHandle(STD_INPUT_HANDLE);
     HANDLE h_stream = HANDLE(_get_osfhandle(_fileno((FILE*)stream)));
@@ -48,12 +55,19 @@ void after_read_stdin(lua_saved_console_mode* saved)
     }
 }
 
+void before_write_console()
+{
+    if (g_printer)
+        g_printer->release_output();
+}
+
 };
 
 static const lua_clink_callbacks g_lua_callbacks =
 {
     host_lua_callbacks::before_read_stdin,
     host_lua_callbacks::after_read_stdin,
+    host_lua_callbacks::before_write_console,
 };
 
 
@@ -74,6 +88,14 @@ host_lua::host_lua()
     str<280> exe_path;
     exe_path << bin_path << "\\" CLINK_EXE;
 
+    str<280> cache_dir;
+    app_context::get()->get_state_dir(cache_dir);
+    if (!cache_dir.empty())
+    {
+        path::append(cache_dir, "luacache");
+        m_state.set_bytecode_cache_dir(cache_dir.c_str());
+    }
+
     lua_State* state = m_state.get_state();
     lua_pushlstring(state, exe_path.c_str(), exe_path.length());
     lua_setglobal(state, "CLINK_EXE");
@@ -109,7 +131,9 @@ void host_lua::load_scripts()
     // Load scripts.
     str<280> script_path;
     app_context::get()->get_script_path(script_path);
-    load_scripts(script_path.c_str());
+    std::vector<lua_compiled_file> files;
+    collect_script_files(script_path.c_str(), files);
+    load_scripts(files);
     m_prev_script_path = script_path.c_str();
     clear_force_reload_scripts();
 
@@ -118,6 +142,7 @@ void host_lua::load_scripts()
         lua_State* state = m_state.get_state();
         save_stack_top ss(state);
 
+
         lua_getglobal(state, "clink");
         lua_pushliteral(state, "_set_completion_dirs");
         lua_rawget(state, -2);
@@ -126,18 +151,73 @@ void host_lua::load_scripts()
 
         m_state.pcall(1, 0);
     }
+
+    // Update the registry of settings added by scripts, so `clink set` can
+    // use it instead of loading scripts.
+    str<280> registry;
+    if (get_script_settings_file(registry))
+    {
+        str_moveable stamp;
+        get_scripts_stamp(files, stamp);
+        save_script_settings(registry.c_str(), stamp.c_str());
+    }
 }
 
 //------------------------------------------------------------------------------
-bool host_lua::load_scripts(const char* paths)
+// Adds the settings that scripts added the last time they were loaded, if the
+// scripts haven't changed since then.  Returns false if the scripts need to be
+// loaded to find out their settings.
+bool host_lua::load_script_settings(std::vector<std::unique_ptr<setting>>& out)
 {
-    if (paths == nullptr || paths[0] == '\0')
+    str<280> registry;
+    if (!get_script_settings_file(registry))
         return false;
 
+    str<280> script_path;
+    app_context::get()->get_script_path(script_path);
+    std::vector<lua_compiled_file> files;
+    collect_script_files(script_path.c_str(), files);
+
+    str_moveable stamp;
+    get_scripts_stamp(files, stamp);
+    return ::load_script_settings(registry.c_str(), stamp.c_str(), out);
+}
+
+//------------------------------------------------------------------------------
+void host_lua::load_scripts(std::vector<lua_compiled_file>& files)
+{
     os::high_resolution_clock clock;
     unsigned num_loaded = 0;
     unsigned num_failed = 0;
 
+    {
+        startup_phase phase("compile scripts");
+        m_state.compile_files(files);
+    }
+
+    for (const auto& file : files)
+    {
+        startup_phase phase("script", file.path.c_str());
+        if (m_state.do_compiled_file(file))
+            num_loaded++;
+        else
+            num_failed++;
+    }
+
+    if (num_failed)
+        LOG("Loaded %u Lua scripts in %u ms (%u failed)", num_loaded, unsigned(clock.elapsed() * 1000), num_failed);
+    else
+        LOG("Loaded %u Lua scripts in %u ms", num_loaded, unsigned(clock.elapsed() * 1000));
+}
+
+//------------------------------------------------------------------------------
+// Collects the scripts first, so they can be compiled in parallel.  Then they
+// are executed one at a time, in order.
+void host_lua::collect_script_files(const char* paths, std::vector<lua_compiled_file>& files)
+{
+    if (paths == nullptr || paths[0] == '\0')
+        return;
+
     bool first = true;
 
     std::vector<wstr_moveable> seen_strings;
@@ -162,12 +242,7 @@ bool host_lua::load_scripts(const char* paths)
             str<280> clink;
             if (path::join(token.c_str(), "clink.lua", clink) &&
                 os::get_path_type(clink.c_str()) == os::path_type_file)
-            {
-                if (m_state.do_file(clink.c_str()))
-                    num_loaded++;
-                else
-                    num_failed++;
-            }
+                files.emplace_back(clink.c_str());
         }
 
         // Expand and normalize the directory.
@@ -183,19 +258,12 @@ bool host_lua::load_scripts(const char* paths)
         seen.emplace(out.c_str());
         seen_strings.emplace_back(std::move(out));
 
-        load_script(tmp.c_str(), num_loaded, num_failed);
+        collect_scripts(tmp.c_str(), files);
     }
-
-    if (num_failed)
-        LOG("Loaded %u Lua scripts in %u ms (%u failed)", num_loaded, unsigned(clock.elapsed() * 1000), num_failed);
-    else
-        LOG("Loaded %u Lua scripts in %u ms", num_loaded, unsigned(clock.elapsed() * 1000));
-
-    return true;
 }
 
 //------------------------------------------------------------------------------
-void host_lua::load_script(const char* path, unsigned& num_loaded, unsigned& num_failed)
+void host_lua::collect_scripts(const char* path, std::vector<lua_compiled_file>& files)
 {
     str_moveable buffer;
     path::join(path, "*.lua", buffer);
@@ -231,10 +299,38 @@ void host_lua::load_script(const char* path, unsigned& num_loaded, unsigned& num
             continue;
 #endif
 
-        if (m_state.do_file(buffer.c_str()))
-            num_loaded++;
-        else
-            num_failed++;
+        files.emplace_back(buffer.c_str());
+    }
+}
+
+//------------------------------------------------------------------------------
+bool host_lua::get_script_settings_file(str_base& out)
+{
+    app_context::get()->get_state_dir(out);
+    if (out.empty())
+        return false;
+    return path::append(out, "script_settings.cache");
+}
+
+//------------------------------------------------------------------------------
+// The stamp identifies the Clink version (for the embedded scripts) and the
+// name, size, and last write time of each script file.
+void host_lua::get_scripts_stamp(const std::vector<lua_compiled_file>& files, str_base& out)
+{
+    out.format("%u.%s", CLINK_VERSION_ENCODED, AS_STR(CLINK_COMMIT));
+
+    wstr<280> wfile;
+    str<64> tmp;
+    for (const auto& file : files)
+    {
+        WIN32_FILE_ATTRIBUTE_DATA fad;
+        wfile = file.path.c_str();
+        if (!GetFileAttributesExW(wfile.c_str(), GetFileExInfoStandard, &fad))
+            memset(&fad, 0, sizeof(fad));
+        tmp.format("|%08x%08x|%08x%08x",
+                   fad.nFileSizeHigh, fad.nFileSizeLow,
+                   fad.ftLastWriteTime.dwHighDateTime, fad.ftLastWriteTime.dwLowDateTime);
+        out << "|" << file.path.c_str() << tmp;
     }
 }
 
@@ -9,6 +9,10 @@
 #include <lua/lua_input_idle.h>
 #include <lua/lua_state.h>
 #include <functional>
+#include <memory>
+#include <vector>
+
+class setting;
 
 //------------------------------------------------------------------------------
 class host_lua
@@ -21,6 +25,7 @@ public:
                         operator input_idle* ();
     void                load_scripts();
     bool                is_script_path_changed() const;
+    static bool         load_script_settings(std::vector<std::unique_ptr<setting>>& out);
 
     bool                send_event(const char* event_name, int32 nargs=0);
     bool                send_event_string_out(const char* event_name, str_base& out, int32 nargs=0);
@@ -37,8 +42,11 @@ public:
 #endif
 
 private:
-    bool                load_scripts(const char* paths);
-    void                load_script(const char* path, unsigned& num_loaded, unsigned& num_failed);
+    void                load_scripts(std::vector<lua_compiled_file>& files);
+    static void         collect_script_files(const char* paths, std::vector<lua_compiled_file>& files);
+    static void         collect_scripts(const char* path, std::vector<lua_compiled_file>& files);
+    static bool         get_script_settings_file(str_base& out);
+    static void         get_scripts_stamp(const std::vector<lua_compiled_file>& files, str_base& out);
     lua_state           m_state;
     lua_match_generator m_generator;
     lua_word_classifier m_classifier;
@@ -35,6 +35,10 @@ if _%1==_ (
 rem -- Test for autorun.
 if defined CLINK_NOAUTORUN if /i "%~1"=="inject" if /i "%~2"=="--autorun" goto :end
 
+rem -- Skip starting the loader at all when autorun is in a non-interactive
+rem -- cmd.exe (e.g. `cmd /c` in build scripts).
+if /i "%~1"=="inject" if /i "%~2"=="--autorun" call :is_noninteractive && goto :end
+
 rem -- Forward to appropriate loader, and endlocal before inject tags the prompt.
 if /i "%processor_architecture%"=="x86" (
         endlocal
@@ -54,6 +58,22 @@ if /i "%processor_architecture%"=="x86" (
 
 goto :end
 
+:is_noninteractive
+rem -- Like cmd.exe, look for /c, /r, or /k in its command line, but only
+rem -- after the executable, since its path may use forward slashes.  When
+rem -- the executable can't be found, or /k is present, the loader decides.
+setlocal enabledelayedexpansion
+set "clink_cmdline=!cmdcmdline!"
+set "clink_args=!clink_cmdline:*cmd.exe=!"
+if "!clink_args!"=="!clink_cmdline!" (
+    if /i not "!clink_cmdline:~0,4!"=="cmd " exit /b 1
+    set "clink_args=!clink_cmdline:~4!"
+)
+if not "!clink_args:/k=!"=="!clink_args!" exit /b 1
+if not "!clink_args:/c=!"=="!clink_args!" exit /b 0
+if not "!clink_args:/r=!"=="!clink_args!" exit /b 0
+exit /b 1
+
 :launch
 setlocal enableextensions
 set WT_PROFILE_ID=
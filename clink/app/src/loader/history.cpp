@@ -9,6 +9,7 @@
 #include <core/log.h>
 #include <core/settings.h>
 #include <core/str.h>
+#include <core/str_compare.h>
 #include <core/str_tokeniser.h>
 #include <lib/history_db.h>
 #include <lib/history_timeformatter.h>
@@ -22,15 +23,25 @@
 #include <stdlib.h>
 #include <ctime>
 #include <assert.h>
+#include <vector>
 
 //------------------------------------------------------------------------------
 static bool is_console(HANDLE h);
 extern setting_bool g_save_history;
 extern setting_enum g_history_timestamp;
+extern setting_enum g_ignore_case;
+extern setting_bool g_fuzzy_accent;
+
+//------------------------------------------------------------------------------
+enum class print_format { normal, raw, tsv };
 
 //------------------------------------------------------------------------------
 static bool s_diag = false;
+static print_format s_format = print_format::normal;
 static bool s_showtime = false;
+static const char* s_search = nullptr;
+static time_t s_since = 0;
+static time_t s_until = 0;
 static history_timeformatter s_timeformatter(!is_console(GetStdHandle(STD_OUTPUT_HANDLE)));
 
 //------------------------------------------------------------------------------
@@ -115,6 +126,60 @@ static bool is_console(HANDLE h)
     return !!GetConsoleMode(h, &dw);
 }
 
+//------------------------------------------------------------------------------
+// Collects output into large blocks, which is much faster than writing each
+// line separately when printing a long history.  When stdout is redirected
+// the blocks are written directly to the file or pipe.
+class output_buffer
+{
+public:
+                    output_buffer();
+                    ~output_buffer() { flush(); }
+    void            write(const char* text, uint32 len);
+    void            flush();
+
+private:
+    static const uint32 c_block_size = 64 * 1024;
+    HANDLE          m_handle;
+    const bool      m_console;
+    str_moveable    m_block;
+};
+
+//------------------------------------------------------------------------------
+output_buffer::output_buffer()
+: m_handle(GetStdHandle(STD_OUTPUT_HANDLE))
+, m_console(is_console(m_handle))
+{
+    // Anything already written through the CRT goes first.
+    fflush(stdout);
+}
+
+//------------------------------------------------------------------------------
+void output_buffer::write(const char* text, uint32 len)
+{
+    m_block.concat(text, len);
+    if (m_block.length() >= c_block_size)
+        flush();
+}
+
+//------------------------------------------------------------------------------
+void output_buffer::flush()
+{
+    if (m_block.empty())
+        return;
+
+    if (m_console)
+    {
+        g_printer->print(m_block.c_str(), m_block.length());
+    }
+    else
+    {
+        DWORD written;
+        WriteFile(m_handle, m_block.c_str(), m_block.length(), &written, nullptr);
+    }
+    m_block.clear();
+}
+
 //------------------------------------------------------------------------------
 static void translate_history_line(str_base& out, const char* in, uint32 len)
 {
@@ -135,30 +200,116 @@ static void translate_history_line(str_base& out, const char* in, uint32 len)
 }
 
 //------------------------------------------------------------------------------
-static void print_history(uint32 tail_count, bool bare)
+// Escapes tabs, backslashes, and line breaks so that each history item is a
+// single TSV field.
+static void escape_tsv_field(str_base& out, const char* in, uint32 len)
 {
-    history_scope history;
+    for (const char* end = in + len; in < end; ++in)
+    {
+        const uint8 c = *in;
+        switch (c)
+        {
+        case '\t':  out.concat("\\t", 2); break;
+        case '\\':  out.concat("\\\\", 2); break;
+        case '\r':  out.concat("\\r", 2); break;
+        case '\n':  out.concat("\\n", 2); break;
+        default:    out.concat(in, 1); break;
+        }
+    }
+}
 
-    str_iter line;
-    history_read_buffer buffer;
+//------------------------------------------------------------------------------
+// Returns true if LINE contains s_search (or if there is no search string).
+// This is a single pass over the history, so there's nothing to gain from
+// building a search index first; the popup list is where an index pays off.
+static bool search_line(const str_iter& line)
+{
+    if (!s_search)
+        return true;
 
-    uint32 count = 0;
-    uint32 skip = 0;
-    if (tail_count != UINT_MAX)
+    const int32 needle_len = int32(strlen(s_search));
+    str_iter sift(line);
+    while (sift.more())
     {
-        history_db::iter iter = history->read_lines(buffer.data(), buffer.size());
-        while (iter.next(line))
-            ++count;
-        if (count > tail_count)
-            skip = count - tail_count;
+        str_iter lhs(s_search, needle_len);
+        str_iter rhs(sift);
+        const int32 cmp = str_compare(lhs, rhs);
+        if (cmp == -1 || cmp == needle_len)
+            return true;
+        sift.next();
     }
 
-    uint32 index = 1;
-    history_db::iter iter = history->read_lines(buffer.data(), buffer.size());
+    return false;
+}
+
+//------------------------------------------------------------------------------
+// Parses either a relative time (a number followed by s, m, h, d, or w, meaning
+// that long ago) or a local date and time (YYYY-MM-DD with an optional HH:MM
+// or HH:MM:SS, separated by a space or T).
+static bool parse_time_arg(const char* arg, time_t& out)
+{
+    if (!arg || !*arg)
+        return false;
 
-    for (uint32 i = 0; i < skip; ++i, ++index, iter.next(line));
+    char unit = 0;
+    uint32 num = 0;
+    int32 len = 0;
+    if (sscanf(arg, "%u%c%n", &num, &unit, &len) == 2 && !arg[len])
+    {
+        time_t scale = 0;
+        switch (unit)
+        {
+        case 's':   scale = 1; break;
+        case 'm':   scale = 60; break;
+        case 'h':   scale = 60 * 60; break;
+        case 'd':   scale = 24 * 60 * 60; break;
+        case 'w':   scale = 7 * 24 * 60 * 60; break;
+        }
+        if (scale)
+        {
+            out = time(nullptr) - time_t(num) * scale;
+            return out > 0;
+        }
+    }
+
+    struct tm tm = {};
+    char sep = 0;
+    len = 0;
+    int32 fields = sscanf(arg, "%d-%d-%d%n%c%d:%d%n:%d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &len,
+                          &sep, &tm.tm_hour, &tm.tm_min, &len, &tm.tm_sec, &len);
+    if (fields < 3 || arg[len])
+        return false;
+    if (fields > 3 && sep != ' ' && sep != 'T')
+        return false;
+
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    out = mktime(&tm);
+    return out > 0;
+}
+
+//------------------------------------------------------------------------------
+static void print_history(uint32 tail_count, bool bare)
+{
+    history_scope history;
+
+    // Time ranges seek to the range using the history's time index, so the
+    // history numbers of the items aren't known.
+    const bool ranged = (s_since || s_until);
+    auto read_lines = [&] (history_read_buffer& buffer) {
+        if (ranged)
+            return history->read_lines_in_range(buffer.data(), buffer.size(), s_since, s_until);
+        return history->read_lines(buffer.data(), buffer.size());
+    };
+
+    int32 mode = g_ignore_case.get();
+    if (mode < 0 || mode >= str_compare_scope::num_scope_values)
+        mode = str_compare_scope::exact;
+    str_compare_scope _(mode, g_fuzzy_accent.get());
 
     str<> utf8;
+    output_buffer out;
     const bool translate = is_console(GetStdHandle(STD_OUTPUT_HANDLE));
 
     uint32 timelen = 0;
@@ -166,20 +317,40 @@ static void print_history(uint32 tail_count, bool bare)
     if (s_showtime)
         timelen = s_timeformatter.max_timelen();
 
-    str<32> timestamp;
     uint32 num_from[2] = {};
-    for (; iter.next(line, &timestamp); ++index)
-    {
+    auto print_line = [&] (const str_iter& line, str_base& timestamp, uint32 index, uint32 bank) {
         if (s_diag)
         {
-            assert(iter.get_bank() < sizeof_array(num_from));
-            num_from[iter.get_bank()]++;
+            assert(bank < sizeof_array(num_from));
+            num_from[bank]++;
         }
 
         utf8.clear();
+        if (s_format == print_format::raw)
+        {
+            // Exactly the history items, one per line, e.g. for import.
+            out.write(line.get_pointer(), line.length());
+            out.write("\n", 1);
+            return;
+        }
+        if (s_format == print_format::tsv)
+        {
+            // Item number, timestamp in seconds since 1970, and the item.
+            if (!ranged)
+                utf8.format("%u", index);
+            utf8.concat("\t", 1);
+            utf8.concat(timestamp.c_str(), timestamp.length());
+            utf8.concat("\t", 1);
+            escape_tsv_field(utf8, line.get_pointer(), line.length());
+            utf8.concat("\n", 1);
+            out.write(utf8.c_str(), utf8.length());
+            return;
+        }
+
         if (!bare)
         {
-            utf8.format("%5u  ", index);
+            if (!ranged)
+                utf8.format("%5u  ", index);
             if (s_showtime)
             {
                 if (!timestamp.empty())
@@ -195,17 +366,78 @@ static void print_history(uint32 tail_count, bool bare)
         }
 
         if (translate)
-        {
             translate_history_line(utf8, line.get_pointer(), line.length());
-            utf8.concat("\r\n", 2);
-            g_printer->print(utf8.c_str(), utf8.length());
-        }
         else
-        {
             utf8.concat(line.get_pointer(), line.length());
-            puts(utf8.c_str());
+        utf8.concat("\r\n", 2);
+        out.write(utf8.c_str(), utf8.length());
+    };
+
+    str_iter line;
+    str<32> timestamp;
+    history_read_buffer buffer;
+
+    // When neither item numbers nor timestamps are printed, the tail can be
+    // read newest first, stopping as soon as it's complete.
+    const bool plain = (s_format == print_format::raw ||
+                        (s_format == print_format::normal && bare));
+    if (tail_count != UINT_MAX && !ranged && plain)
+    {
+        struct tail_line
+        {
+            str_moveable text;
+            uint32 bank;
+        };
+
+        std::vector<tail_line> tail;
+        history_db::iter iter = history->read_lines_reverse(buffer.data(), buffer.size());
+        while (tail.size() < tail_count && iter.next(line))
+        {
+            if (!search_line(line))
+                continue;
+            tail.push_back({ str_moveable(), iter.get_bank() });
+            tail.back().text.concat(line.get_pointer(), line.length());
         }
+
+        timestamp.clear();
+        for (auto i = tail.rbegin(); i != tail.rend(); ++i)
+            print_line(str_iter(i->text.c_str(), i->text.length()), timestamp, 0, i->bank);
     }
+    else
+    {
+        uint32 count = 0;
+        uint32 skip = 0;
+        if (tail_count != UINT_MAX)
+        {
+            history_db::iter iter = read_lines(buffer);
+            while (iter.next(line))
+            {
+                if (search_line(line))
+                    ++count;
+            }
+            if (count > tail_count)
+                skip = count - tail_count;
+        }
+
+        uint32 index = 1;
+        history_db::iter iter = read_lines(buffer);
+        for (; iter.next(line, &timestamp); ++index)
+        {
+            // Matching items keep their history numbers, so they can be used
+            // with 'history delete' and with history expansion.
+            if (!search_line(line))
+                continue;
+            if (skip)
+            {
+                --skip;
+                continue;
+            }
+
+            print_line(line, timestamp, index, iter.get_bank());
+        }
+    }
+
+    out.flush();
 
     if (s_diag)
     {
@@ -257,6 +489,42 @@ static int32 add(const char* line)
     return !ok;
 }
 
+//------------------------------------------------------------------------------
+static int32 import_lines(const char* path)
+{
+    // Read the whole file, or stdin if the path is "-".
+    HANDLE h;
+    const bool use_stdin = (strcmp(path, "-") == 0);
+    if (use_stdin)
+    {
+        h = GetStdHandle(STD_INPUT_HANDLE);
+    }
+    else
+    {
+        wstr<> wpath(path);
+        h = CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE, nullptr,
+                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    }
+    if (h == INVALID_HANDLE_VALUE || !h)
+    {
+        fprintf(stderr, "history: unable to open '%s'.\n", path);
+        return 1;
+    }
+
+    str_moveable text;
+    char chunk[64 * 1024];
+    DWORD read;
+    while (ReadFile(h, chunk, sizeof(chunk), &read, nullptr) && read)
+        text.concat(chunk, read);
+    if (!use_stdin)
+        CloseHandle(h);
+
+    history_scope history;
+    const uint32 count = history->add_lines(text.c_str(), text.length());
+    printf("Imported %u items into history.\n", count);
+    return 0;
+}
+
 //------------------------------------------------------------------------------
 static int32 remove(int32 index)
 {
@@ -347,14 +615,20 @@ static int32 print_help()
         "delete <n>",    "Delete Nth item (negative N indexes history backwards).",
         "add <...>",     "Join remaining arguments and appends to the history.",
         "expand <...>",  "Print substitution result.",
+        "import <file>", "Append the lines in the file to the history ('-' reads stdin).",
         nullptr
     };
 
     static const char* const help_options[] = {
         "--bare",        "Omit item numbers and timestamps when printing history.",
         "--diag",        "Print diagnostic info to stderr.",
+        "--raw",         "Print only history items, without any translation.",
+        "--tsv",         "Print number, timestamp, and item separated by tabs.",
         "--show-time",   "Show history item timestamps, if any.",
         "--no-show-time",   "Omit history item timestamps when printing history.",
+        "--search <text>",  "Print only history items that contain the text.",
+        "--since <time>",   "Print only history items added at or after the time.",
+        "--until <time>",   "Print only history items added at or before the time.",
         "--time-format", "Override the format string for showing timestamps.",
         "--unique",      "Remove duplicates when compacting history.",
         nullptr
@@ -374,7 +648,20 @@ static int32 print_help()
 
     puts("The 'history compact' command can shrink the history file by removing any\n"
          "leftover placeholders for deleted items.  Use 'history compact <n>' to also\n"
-         "prune the history to no more than N items.");
+         "prune the history to no more than N items.\n");
+
+    puts("The --since and --until options accept a relative time such as 30m, 2h, 1d,\n"
+         "or 1w, or a local date and time such as 2026-01-31 or 2026-01-31T14:30.\n"
+         "Only items with timestamps can match (see 'history.time_stamp').  Items are\n"
+         "printed with their timestamps instead of their history numbers.\n");
+
+    puts("The --raw format prints each item on its own line, suitable for use with\n"
+         "'history import'.  The --tsv format escapes tabs, backslashes, and line\n"
+         "breaks in items as \\t, \\\\, \\r, and \\n.  The 'history import' command adds\n"
+         "all of the lines at once and doesn't check for duplicates; use 'history\n"
+         "compact' with --unique afterwards to remove duplicates.  Imported items\n"
+         "get the current time as their timestamp; the original timestamps are not\n"
+         "preserved.");
 
     return 1;
 }
@@ -465,6 +752,10 @@ int32 history(int32 argc, char** argv)
             bare = true;
         else if (is_flag(argv[i], "--diag", 3))
             s_diag = true;
+        else if (is_flag(argv[i], "--raw", 3))
+            s_format = print_format::raw;
+        else if (is_flag(argv[i], "--tsv", 3))
+            s_format = print_format::tsv;
         else if (is_flag(argv[i], "--unique", 3))
             uniq = true;
         else if (is_flag(argv[i], "--show-time", 3))
@@ -477,6 +768,35 @@ int32 history(int32 argc, char** argv)
             s_timeformatter.set_timeformat(argv[++i]);
             remove++;
         }
+        else if (is_flag(argv[i], "--since", 4) || is_flag(argv[i], "--until", 3))
+        {
+            const bool since = is_flag(argv[i], "--since", 4);
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, "history: missing time for '%s'\n", argv[i]);
+                return print_help();
+            }
+            const char* flag = argv[i];
+            if (!parse_time_arg(argv[++i], since ? s_since : s_until))
+            {
+                fprintf(stderr, "history: invalid time for '%s'\n", flag);
+                return print_help();
+            }
+            s_showtime = true;
+            remove++;
+        }
+        else if (is_flag(argv[i], "--search", 4))
+        {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, "history: missing text for '%s'\n", argv[i]);
+                return print_help();
+            }
+            s_search = argv[++i];
+            if (!*s_search)
+                s_search = nullptr;
+            remove++;
+        }
         else
             remove = 0;
 
@@ -549,6 +869,17 @@ int32 history(int32 argc, char** argv)
             return line.empty() ? print_help() : add(line.c_str());
         }
 
+        // 'import' command
+        if (_stricmp(verb, "import") == 0)
+        {
+            if (argc < 3)
+            {
+                fputs("history: argument required for verb 'import'", stderr);
+                return print_help();
+            }
+            return import_lines(argv[2]);
+        }
+
         // 'expand' command
         if (_stricmp(verb, "expand") == 0)
         {
@@ -3,6 +3,7 @@
 
 #include "pch.h"
 #include "utils/app_context.h"
+#include "utils/usage.h"
 #include "version.h"
 
 #include <core/str.h>
@@ -97,9 +98,94 @@ static bool is_injected(str_base& module, str_base& version)
     return injected;
 }
 
+//------------------------------------------------------------------------------
+static int32 print_startup_profile(HANDLE h)
+{
+    str<280> path;
+    app_context::get()->get_startup_profile_path(path);
+
+    FILE* file = fopen(path.c_str(), "rt");
+    if (!file)
+    {
+        fprintf(stderr, "No startup profile found.  Start a new Clink session and then try again.\n");
+        return 1;
+    }
+
+    char buffer[512];
+    while (fgets(buffer, sizeof_array(buffer), file))
+        print_info_line(h, buffer);
+    fclose(file);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Gets the elapsed milliseconds for a phase from the startup profile.
+static bool get_startup_phase_ms(const char* name, float& ms)
+{
+    str<280> path;
+    app_context::get()->get_startup_profile_path(path);
+
+    FILE* file = fopen(path.c_str(), "rt");
+    if (!file)
+        return false;
+
+    bool found = false;
+    const size_t name_len = strlen(name);
+    char buffer[512];
+    while (!found && fgets(buffer, sizeof_array(buffer), file))
+    {
+        const char* p = buffer;
+        while (*p == ' ')
+            ++p;
+        if (strncmp(p, name, name_len) == 0 && p[name_len] == ' ')
+            found = (sscanf(p + name_len, "%f", &ms) == 1);
+    }
+
+    fclose(file);
+    return found;
+}
+
 //------------------------------------------------------------------------------
 int32 clink_info(int32 argc, char** argv)
 {
+    static const char* help_usage = "Usage: info [options]\n";
+
+    static const struct option options[] = {
+        { "help",               no_argument,        nullptr, 'h' },
+        { "startup-profile",    no_argument,        nullptr, 'p' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    static const char* const help[] = {
+        "-h, --help",               "Shows this help text.",
+        "-p, --startup-profile",    "Shows how long each phase of the most recent Clink startup took.",
+        nullptr
+    };
+
+    int32 i;
+    int32 ret = 1;
+    bool startup_profile = false;
+    while ((i = getopt_long(argc, argv, "?hp", options, nullptr)) != -1)
+    {
+        switch (i)
+        {
+        case 'p':
+            startup_profile = true;
+            break;
+        case '?':
+        case 'h':
+            ret = 0;
+            // fall through
+        default:
+            puts_clink_header();
+            puts(help_usage);
+            puts("Options:");
+            puts_help(help);
+            puts("Prints information about Clink's directories and files.");
+            return ret;
+        }
+    }
+
     static const struct {
         const char* name;
         void        (app_context::*method)(str_base&) const;
@@ -126,6 +212,9 @@ int32 clink_info(int32 argc, char** argv)
 
     HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
 
+    if (startup_profile)
+        return print_startup_profile(h);
+
     // Load the settings from disk, since script paths are affected by settings.
     str<280> settings_file;
     str<280> default_settings_file;
@@ -162,6 +251,13 @@ int32 clink_info(int32 argc, char** argv)
             printf("%-*s : %s (%s)\n", spacing, "injected", dll.c_str(), version.c_str());
     }
 
+    // Time saved per non-interactive cmd.exe by rejecting autorun before the
+    // loader starts.  The loader's time until its own host check in the most
+    // recent inject is a lower bound; it excludes starting the process.
+    float host_check_ms;
+    if (get_startup_phase_ms("host check", host_check_ms))
+        printf("%-*s : precheck saves over %.2f ms per non-interactive cmd.exe\n", spacing, "autorun", host_check_ms);
+
     // Output the values.
     str<> s;
     for (const auto& output : outputs)
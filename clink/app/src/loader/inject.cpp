@@ -11,6 +11,7 @@
 #include <core/log.h>
 #include <core/os.h>
 #include <core/path.h>
+#include <core/startup_profile.h>
 #include <core/str.h>
 #include <core/str_hash.h>
 #include <getopt.h>
@@ -21,46 +22,117 @@
 #include <memory>
 
 //------------------------------------------------------------------------------
-static bool get_file_info(const wchar_t* file, FILETIME& ft, ULONGLONG& size)
+// The manifest describes the origin DLL that a cached DLL was copied from, so
+// that later injections can reuse the cached DLL (and the result of its version
+// check) after only comparing the origin's size and timestamp.  The content
+// hash lets a touched but otherwise unchanged origin DLL reuse the cached DLL
+// instead of copying over it (it may be in use by other cmd.exe processes).
+struct dll_manifest
 {
-    WIN32_FIND_DATAW fd;
-    HANDLE h = FindFirstFileW(file, &fd);
+    bool            matches(const dll_manifest& other) const { return size == other.size && time == other.time; }
+    ULONGLONG       size = 0;
+    ULONGLONG       time = 0;
+    ULONGLONG       hash = 0;
+    int32           version_ok = 0;
+};
+
+//------------------------------------------------------------------------------
+static bool get_file_info(const wchar_t* file, dll_manifest& info)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!GetFileAttributesExW(file, GetFileExInfoStandard, &fad))
+        return false;
+    info.time = (ULONGLONG(fad.ftLastWriteTime.dwHighDateTime) << 32) | fad.ftLastWriteTime.dwLowDateTime;
+    info.size = (ULONGLONG(fad.nFileSizeHigh) << 32) | fad.nFileSizeLow;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+static bool get_file_hash(const wchar_t* file, ULONGLONG& hash)
+{
+    HANDLE h = CreateFileW(file, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
     if (h == INVALID_HANDLE_VALUE)
         return false;
-    ft = fd.ftLastWriteTime;
-    size = (ULONGLONG(fd.nFileSizeHigh) << 32) | fd.nFileSizeLow;
-    FindClose(h);
+
+    // 64 bit FNV-1a.
+    hash = 0xcbf29ce484222325ull;
+
+    DWORD bytes;
+    std::unique_ptr<uint8[]> buffer(new uint8[64 * 1024]);
+    while (ReadFile(h, buffer.get(), 64 * 1024, &bytes, nullptr) && bytes)
+    {
+        for (DWORD i = 0; i < bytes; ++i)
+        {
+            hash ^= buffer[i];
+            hash *= 0x100000001b3ull;
+        }
+    }
+
+    CloseHandle(h);
     return true;
 }
 
 //------------------------------------------------------------------------------
-static bool is_file_newer(const char* origin, const char* cached)
+static bool read_manifest(const char* path, dll_manifest& manifest)
 {
-    FILETIME ftO;
-    FILETIME ftC;
-    ULONGLONG sizeO;
-    ULONGLONG sizeC;
-    wstr<> tmp;
-
-    tmp = origin;
-    if (!get_file_info(tmp.c_str(), ftO, sizeO))
+    wstr<280> wpath(path);
+    HANDLE h = CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
         return false;
 
-    tmp = cached;
-    if (!get_file_info(tmp.c_str(), ftC, sizeC))
+    char buffer[128];
+    DWORD bytes = 0;
+    const bool read = ReadFile(h, buffer, sizeof(buffer) - 1, &bytes, nullptr);
+    CloseHandle(h);
+    if (!read)
         return false;
+    buffer[bytes] = '\0';
 
-    return CompareFileTime(&ftO, &ftC) > 0 || sizeO != sizeC;
+    char version[32];
+    if (sscanf(buffer, "%31s %llx %llx %llx %d", version,
+               &manifest.size, &manifest.time, &manifest.hash, &manifest.version_ok) != 5)
+        return false;
+
+    return strcmp(version, CLINK_VERSION_STR) == 0;
 }
 
 //------------------------------------------------------------------------------
-static void copy_dll(str_base& dll_path)
+static void write_manifest(const char* path, const dll_manifest& manifest)
+{
+    str<128> content;
+    content.format("%s %llx %llx %llx %d\n", CLINK_VERSION_STR,
+                   manifest.size, manifest.time, manifest.hash, manifest.version_ok);
+
+    wstr<280> wpath(path);
+    HANDLE h = CreateFileW(wpath.c_str(), GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        ERR("Failed to create manifest file at '%s'", path);
+        return;
+    }
+
+    DWORD written;
+    WriteFile(h, content.c_str(), content.length(), &written, nullptr);
+    CloseHandle(h);
+}
+
+//------------------------------------------------------------------------------
+static int32 check_dll_version(const char* clink_dll);
+
+//------------------------------------------------------------------------------
+// Copies the DLL into a versioned cache directory, and updates DLL_PATH to
+// refer to the cached DLL.  Returns whether the cached DLL's version has
+// already been verified.
+static bool copy_dll(str_base& dll_path)
 {
     str<280> target_path;
     if (!os::get_temp_dir(target_path))
     {
         ERR("Unable to get temp path");
-        return;
+        return false;
     }
 
     target_path << "clink\\dll_cache\\" CLINK_VERSION_STR;
@@ -69,14 +141,6 @@ static void copy_dll(str_base& dll_path)
     path_salt.format("_%08x", str_hash(dll_path.c_str()));
     target_path << path_salt;
 
-    if (!os::make_dir(target_path.c_str()))
-    {
-        ERR("Unable to create path '%s'", target_path.c_str());
-        return;
-    }
-
-    target_path << "\\" CLINK_DLL;
-
 #if !defined(CLINK_FINAL)
     // The DLL id only changes on a commit-premake cycle. During development
     // this doesn't work so well so we'll force it through.
@@ -86,6 +150,36 @@ static void copy_dll(str_base& dll_path)
     bool always = false;
 #endif
 
+    const int32 dir_length = target_path.length();
+    target_path << "\\" CLINK_DLL;
+
+    str<280> manifest_path(target_path.c_str());
+    manifest_path << ".manifest";
+
+    // Fast path:  when the manifest matches the origin DLL, the cached DLL is
+    // used as is.  This avoids copying and re-reading the version resources
+    // every time cmd.exe starts.
+    wstr<280> worigin(dll_path.c_str());
+    dll_manifest origin;
+    dll_manifest manifest;
+    const bool have_origin = get_file_info(worigin.c_str(), origin);
+    const bool have_manifest = !always && have_origin && read_manifest(manifest_path.c_str(), manifest);
+    if (have_manifest && manifest.matches(origin) && manifest.version_ok &&
+        os::get_path_type(target_path.c_str()) == os::path_type_file)
+    {
+        dll_path = target_path.c_str();
+        return true;
+    }
+
+    target_path.truncate(dir_length);
+    if (!os::make_dir(target_path.c_str()))
+    {
+        ERR("Unable to create path '%s'", target_path.c_str());
+        return false;
+    }
+
+    target_path << "\\" CLINK_DLL;
+
     // Write out origin path to a file so we can backtrack from the cached DLL.
     int32 target_length = target_path.length();
     target_path << ".origin";
@@ -99,7 +193,7 @@ static void copy_dll(str_base& dll_path)
             bool sharing_violation = (GetLastError() == ERROR_SHARING_VIOLATION);
             ERR("Failed to create origin file at '%s'", target_path.c_str());
             if (!always || !sharing_violation)
-                return;
+                return false;
             always = false;
         }
         else
@@ -112,17 +206,20 @@ static void copy_dll(str_base& dll_path)
 
     target_path.truncate(target_length);
 
-    // Copy the DLL.
-    if (always ||
-        os::get_path_type(target_path.c_str()) != os::path_type_file ||
-        is_file_newer(dll_path.c_str(), target_path.c_str()))
+    // Copy the DLL, unless the cached DLL has the same content as the origin.
+    bool copy = (always || !have_manifest || os::get_path_type(target_path.c_str()) != os::path_type_file);
+    if (have_origin && !get_file_hash(worigin.c_str(), origin.hash))
+        copy = true;
+    else if (!copy && !manifest.matches(origin))
+        copy = (origin.hash != manifest.hash);
+    if (copy)
     {
         if (!os::copy(dll_path.c_str(), target_path.c_str()))
         {
             bool sharing_violation = (GetLastError() == ERROR_SHARING_VIOLATION);
             ERR("Failed to copy DLL to '%s'", target_path.c_str());
             if (!always || !sharing_violation)
-                return;
+                return false;
             always = false;
         }
     }
@@ -143,6 +240,13 @@ static void copy_dll(str_base& dll_path)
     }
 
     dll_path = target_path.c_str();
+
+    // Record the version check in the manifest, so later injections can skip
+    // reading the version resources.
+    origin.version_ok = check_dll_version(dll_path.c_str());
+    if (have_origin)
+        write_manifest(manifest_path.c_str(), origin);
+    return !!origin.version_ok;
 }
 
 //------------------------------------------------------------------------------
@@ -233,6 +337,39 @@ private:
     DWORD m_elapsed = 0;
 };
 
+//------------------------------------------------------------------------------
+// Parses the cmd.exe command line for /c or /k to determine whether the host is
+// interactive.  Returns 1 if interactive, 0 if not, or -1 on error.
+static int32 is_host_interactive(DWORD target_pid)
+{
+    process cmd_process(target_pid);
+    if (!cmd_process.is_arch_match())
+        return 1; // Let inject_dll() report the mismatch.
+
+    wstr<> command_line;
+    if (!cmd_process.get_command_line(command_line))
+    {
+        ERR("Unable to get host command line.");
+        return -1;
+    }
+
+    for (const wchar_t* args = command_line.c_str(); args && (args = wcschr(args, '/'));)
+    {
+        ++args;
+        switch (tolower(*args))
+        {
+        case 'c':
+        case 'r': // A little-known synonym for /c.
+            return 0;
+        case 'k':
+            args = nullptr;
+            break;
+        }
+    }
+
+    return 1;
+}
+
 //------------------------------------------------------------------------------
 static remote_result inject_dll(DWORD target_pid, bool is_autorun, bool force_host=false)
 {
@@ -247,8 +384,6 @@ static remote_result inject_dll(DWORD target_pid, bool is_autorun, bool force_ho
     path::get_directory(dll_path);
     path::append(dll_path, CLINK_DLL);
 
-    copy_dll(dll_path);
-
     // Reset log file, start logging!
 #if 0
     /* GetVersionEx() is deprecated and the VerifyVersioninfo() replacement
@@ -274,18 +409,9 @@ static remote_result inject_dll(DWORD target_pid, bool is_autorun, bool force_ho
 #endif
     DEFER_LOG("Version: %s", CLINK_VERSION_STR);
     DEFER_LOG("Arch: %s", AS_STR(ARCHITECTURE_NAME));
-    DEFER_LOG("DLL: %s", dll_path.c_str());
 
     DEFER_LOG("Parent pid: %d", target_pid);
 
-    // Check Dll's version.
-    if (!check_dll_version(dll_path.c_str()))
-    {
-        LOG("EXE version: %08x %08x", MAKELONG(CLINK_VERSION_MINOR, CLINK_VERSION_MAJOR), MAKELONG(CLINK_VERSION_PATCH, 0));
-        fprintf(stderr, "DLL version mismatch.\n");
-        return {};
-    }
-
     // Check for supported host (keep in sync with initialise_clink in dll.cpp).
     process cmd_process(target_pid);
     {
@@ -327,38 +453,34 @@ static remote_result inject_dll(DWORD target_pid, bool is_autorun, bool force_ho
         // match.
         if (!cmd_process.is_arch_match())
             return {};
+    }
 
-        // Parse cmd.exe command line for /c or /k to determine whether the host
-        // is interactive.  Don't waste time injecting a remote thread if Clink
-        // will cancel the inject anyway.  This helps make autorun more
-        // reasonable to use.
-        wstr<> command_line;
-        if (!cmd_process.get_command_line(command_line))
-        {
-            ERR("Unable to get host command line.");
-            return {};
-        }
-        for (const wchar_t* args = command_line.c_str(); args && (args = wcschr(args, '/'));)
-        {
-            ++args;
-            switch (tolower(*args))
-            {
-            case 'c':
-                // Only log this is something else has already gotten logged.
-                // The intent is to avoid filling a log file with a ton of these
-                // when Clink is configured in the CMD AutoRun regkey.
-                if (!logger::can_defer())
-                    LOG("Host is not interactive; cancelling inject.");
-                return { -1 };
-            case 'k':
-                args = nullptr;
-                break;
-            }
-        }
+    // Copy the DLL only once the host is known to be interactive, so that
+    // non-interactive hosts (e.g. `cmd /c` in build scripts) don't pay for it.
+    bool dll_version_ok;
+    {
+        startup_phase phase("copy_dll");
+        dll_version_ok = copy_dll(dll_path);
+    }
+
+    DEFER_LOG("DLL: %s", dll_path.c_str());
+
+    // Check Dll's version, unless the DLL cache's manifest already verified it.
+    if (!dll_version_ok)
+    {
+        startup_phase phase("check_dll_version");
+        dll_version_ok = !!check_dll_version(dll_path.c_str());
+    }
+    if (!dll_version_ok)
+    {
+        LOG("EXE version: %08x %08x", MAKELONG(CLINK_VERSION_MINOR, CLINK_VERSION_MAJOR), MAKELONG(CLINK_VERSION_PATCH, 0));
+        fprintf(stderr, "DLL version mismatch.\n");
+        return {};
     }
 
     // Inject Clink DLL.
     wait_monitor monitor("Injecting Clink");
+    startup_phase phase("inject_module");
     return cmd_process.inject_module(dll_path.c_str(), &monitor);
 }
 
@@ -485,6 +607,8 @@ int32 inject(int32 argc, char** argv, app_context::desc& app_desc)
     // other scripts (e.g. VS postbuild steps, which causes CMake to be unable
     // to build anything).  https://github.com/mridgers/clink/issues/373
 
+    const os::high_resolution_clock clock;
+
     static const char* help_usage = "Usage: inject [options]\n";
 
     static const struct option options[] = {
@@ -632,6 +756,25 @@ int32 inject(int32 argc, char** argv, app_context::desc& app_desc)
             return ret;
     }
 
+    // Don't waste time copying the DLL or injecting a remote thread if Clink
+    // will cancel the inject anyway because the host isn't interactive.  This
+    // happens before the (slower) module snapshot, to keep `cmd /c` fast when
+    // Clink is configured in the CMD AutoRun regkey, e.g. in build scripts.
+    switch (is_host_interactive(target_pid))
+    {
+    case 0:
+        // Only log this is something else has already gotten logged.  The
+        // intent is to avoid filling a log file with a ton of these when
+        // Clink is configured in the CMD AutoRun regkey.
+        if (!logger::can_defer())
+            LOG("Host is not interactive; cancelling inject.");
+        errrep.set_ok();
+        return exit_code_success;
+    case -1:
+        return ret;
+    }
+    startup_profile::add("host check", float(clock.elapsed() * 1000));
+
     // Check to see if clink is already installed.
     if (is_clink_present(target_pid))
     {
@@ -691,6 +834,10 @@ int32 inject(int32 argc, char** argv, app_context::desc& app_desc)
 
     DEFER_LOG("Initializing Clink...");
 
+    // Pass the loader's startup phases to the DLL for its startup profile.
+    startup_profile::add("loader total", float(clock.elapsed() * 1000));
+    app_desc.num_loader_phases = startup_profile::export_phases(app_desc.loader_phases, sizeof_array(app_desc.loader_phases));
+
     // Remotely call Clink's initialisation function.
     void* our_dll_base = vm().get_alloc_base((void*)"");
     uintptr_t init_func = uintptr_t(remote_dll_base.result);
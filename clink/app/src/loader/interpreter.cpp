@@ -69,7 +69,10 @@ void after_read_stdin(lua_saved_console_mode* saved)
     if (saved->h)
         SetConsoleMode(saved->h, saved->mode);
 }
-static lua_clink_callbacks g_lua_callbacks = { before_read_stdin, after_read_stdin };
+void before_write_console()
+{
+}
+static lua_clink_callbacks g_lua_callbacks = { before_read_stdin, after_read_stdin, before_write_console };
 
 //------------------------------------------------------------------------------
 static char const *progname = LUA_PROGNAME;
@@ -189,9 +189,29 @@ int32 loader(int32 argc, char** argv)
     return ret;
 }
 
+//------------------------------------------------------------------------------
+// Autorun runs `clink inject --autorun` in every cmd.exe, including ones that
+// aren't interactive.  clink.bat already rejects `cmd /c`, and this rejects
+// redirected or piped input or output as early as possible, before parsing
+// arguments or doing any settings or profile work.
+static bool is_noninteractive_autorun()
+{
+    const wchar_t* command_line = GetCommandLineW();
+    if (!wcsstr(command_line, L" inject") || !wcsstr(command_line, L" --autorun"))
+        return false;
+
+    // Keep in sync with host_cmd::is_interactive().
+    return (GetFileType(GetStdHandle(STD_INPUT_HANDLE)) != FILE_TYPE_CHAR ||
+            GetFileType(GetStdHandle(STD_OUTPUT_HANDLE)) != FILE_TYPE_CHAR);
+}
+
 //------------------------------------------------------------------------------
 int32 loader_main_impl()
 {
+    // Autorun injection must always return success.
+    if (is_noninteractive_autorun())
+        return 0;
+
     int32 argc = 0;
     LPWSTR* argvw = CommandLineToArgvW(GetCommandLineW(), &argc);
 
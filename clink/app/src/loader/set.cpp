@@ -30,18 +30,26 @@ static void list_keys()
 }
 
 //------------------------------------------------------------------------------
-static void list_options(lua_state& lua, const char* key)
+static bool needs_lua_for_options(const char* key)
+{
+    return stricmp(key, "autosuggest.strategy") == 0;
+}
+
+//------------------------------------------------------------------------------
+static void list_options(lua_state* lua, const char* key)
 {
     const setting* setting = settings::find(key);
     if (setting == nullptr)
         return;
 
-    if (stricmp(key, "autosuggest.strategy") == 0)
+    if (needs_lua_for_options(key))
     {
-        lua_State *state = lua.get_state();
+        if (!lua)
+            return;
+        lua_State *state = lua->get_state();
         save_stack_top ss(state);
-        lua.push_named_function(state, "clink._print_suggesters");
-        lua.pcall_silent(state, 0, 0);
+        lua->push_named_function(state, "clink._print_suggesters");
+        lua->pcall_silent(state, 0, 0);
         return;
     }
 
@@ -318,17 +326,27 @@ int32 set(int32 argc, char** argv)
     app_context::get()->get_default_settings_file(default_settings_file);
     settings::load(settings_file.c_str(), default_settings_file.c_str());
 
-    // Load all lua state too as there is settings declared in scripts.  The
-    // load function handles deferred load for settings declared in scripts.
-    host_lua lua;
-    prompt_filter prompt_filter(lua);
-    host_load_app_scripts(lua);
-    lua.load_scripts();
+    // Settings declared in scripts come from the registry that is written when
+    // scripts are loaded, as long as the scripts haven't changed since then.
+    // Otherwise load all lua state too; the load function handles deferred
+    // load for settings declared in scripts.
+    std::vector<std::unique_ptr<setting>> script_settings;
+    std::unique_ptr<host_lua> lua;
+    std::unique_ptr<prompt_filter> filter;
+    const bool need_lua = (complete && optind < argc && needs_lua_for_options(argv[0]));
+    if (need_lua || !host_lua::load_script_settings(script_settings))
+    {
+        script_settings.clear();
+        lua = std::make_unique<host_lua>();
+        filter = std::make_unique<prompt_filter>(*lua);
+        host_load_app_scripts(*lua);
+        lua->load_scripts();
+    }
 
     // List or set Clink's settings.
     if (complete)
     {
-        (optind < argc) ? list_options(lua, argv[0]) : list_keys();
+        (optind < argc) ? list_options(lua ? &static_cast<lua_state&>(*lua) : nullptr, argv[0]) : list_keys();
         return 0;
     }
 
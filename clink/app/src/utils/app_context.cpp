@@ -84,6 +84,7 @@ app_context::desc::desc()
 {
     state_dir[0] = '\0';
     script_path[0] = '\0';
+    num_loader_phases = 0;
 }
 
 
@@ -238,6 +239,13 @@ void app_context::get_settings_path(str_base& out) const
     path::append(out, "clink_settings");
 }
 
+//------------------------------------------------------------------------------
+void app_context::get_startup_profile_path(str_base& out) const
+{
+    get_state_dir(out);
+    path::append(out, "clink_startup_profile.txt");
+}
+
 //------------------------------------------------------------------------------
 void app_context::get_history_path(str_base& out) const
 {
@@ -467,7 +475,7 @@ void app_context::start_logger() const
         str<256> log_path;
         get_log_path(log_path);
         unlink(log_path.c_str()); // Restart the log file on every inject.
-        new file_logger(log_path.c_str());
+        new file_logger(log_path.c_str(), true/*async*/);
 
         SYSTEMTIME now;
         GetLocalTime(&now);
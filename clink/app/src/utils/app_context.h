@@ -4,6 +4,7 @@
 #pragma once
 
 #include <core/singleton.h>
+#include <core/startup_profile.h>
 #include <core/str.h>
 
 //------------------------------------------------------------------------------
@@ -22,6 +23,8 @@ public:
         bool    detours = false;    // Use Detours for hooking, instead of IAT.
         char    state_dir[510];     // = {}; (this crashes cl.exe v18.00.21005.1)
         char    script_path[510];   // = {}; (this crashes cl.exe v18.00.21005.1)
+        uint32  num_loader_phases;  // Startup profile phases from the loader.
+        startup_phase_info loader_phases[8];
     };
 
                 app_context(const desc& desc);
@@ -36,6 +39,7 @@ public:
     void        get_default_settings_file(str_base& out) const;
     void        get_settings_path(str_base& out) const;
     void        get_history_path(str_base& out) const;
+    void        get_startup_profile_path(str_base& out) const;
     void        get_script_path(str_base& out) const;
     void        get_script_path_readable(str_base& out) const;
     void        get_default_init_file(str_base& out) const;
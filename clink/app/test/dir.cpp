@@ -6,6 +6,7 @@
 #include "line_editor_tester.h"
 
 #include <core/base.h>
+#include <core/os.h>
 #include <core/str.h>
 #include <core/str_compare.h>
 #include <core/settings.h>
@@ -131,12 +132,14 @@ TEST_CASE("Directory match generation.")
         const char* home = getenv("HOME");
         s.format("HOME=%s\\nest_1", fs.get_root());
         putenv(s.c_str());
+        os::invalidate_env_cache();
 
         tester.set_input("cd ~\\");
         tester.set_expected_matches("~\\nest_2\\");
         tester.run();
 
         putenv(home ? home : "HOME=");
+        os::invalidate_env_cache();
     }
 
     SECTION("Tilde expansion on")
@@ -149,6 +152,7 @@ TEST_CASE("Directory match generation.")
         const char* home = getenv("HOME");
         s.format("HOME=%s\\nest_1", fs.get_root());
         putenv(s.c_str());
+        os::invalidate_env_cache();
 
         tester.set_input("cd ~\\");
         s.format("%s\\nest_1\\nest_2\\", fs.get_root());
@@ -156,6 +160,7 @@ TEST_CASE("Directory match generation.")
         tester.run();
 
         putenv(home ? home : "HOME=");
+        os::invalidate_env_cache();
     }
 
     setting->set();
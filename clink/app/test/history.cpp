@@ -11,10 +11,16 @@
 #include <core/os.h>
 #include <core/settings.h>
 #include <core/str.h>
+#include <core/str_compare.h>
+#include <lib/history_command_index.h>
 #include <lib/history_db.h>
+#include <lib/history_event_index.h>
+#include <lib/history_prefix_index.h>
+#include <lib/trigram_index.h>
 #include <utils/app_context.h>
 
 #include <initializer_list>
+#include <vector>
 
 extern "C" {
 #include <readline/history.h>
@@ -85,6 +91,19 @@ struct test_history_db
         rollback<void *> revert(m_bank_handles[bank_session].m_handle_removals, nullptr);
         return remove(line);
     }
+
+    bool compact_in_background(uint32 timeout_ms)
+    {
+        start_background_compact(0);
+        for (uint32 waited = 0; m_compactor; waited += 10)
+        {
+            if (waited >= timeout_ms)
+                return false;
+            Sleep(10);
+            start_background_compact(0); // Resets the compactor once finished.
+        }
+        return true;
+    }
 };
 
 //------------------------------------------------------------------------------
@@ -288,6 +307,308 @@ TEST_CASE("history db")
 
     }
 
+    SECTION("Memory mapped")
+    {
+        const char* index_path = "clink_history.index";
+
+        settings::find("history.shared")->set("true");
+        settings::find("history.dupe_mode")->set("add");
+        settings::find("history.memory_map")->set("true");
+
+        {
+            test_history_db history;
+            for (const char* line : line_set0)
+                REQUIRE(history.add(line));
+            for (const char* line : line_set1)
+                REQUIRE(history.add(line));
+
+            history.load_rl_history(false/*can_clean*/);
+            REQUIRE(size_t(history_length) == sizeof_array(line_set0) + sizeof_array(line_set1));
+            REQUIRE(history.get_master_length() == uint32(history_length));
+
+            REQUIRE(history.find(line_set0[3]));
+            REQUIRE(history.remove(line_set0[3]) == 1);
+            REQUIRE(!history.find(line_set0[3]));
+            REQUIRE(history.find(line_set1[2]));
+        }
+
+        expect_files({master_path, index_path});
+
+        {
+            test_history_db history;
+            history.load_rl_history(false/*can_clean*/);
+            REQUIRE(size_t(history_length) == sizeof_array(line_set0) + sizeof_array(line_set1) - 1);
+            REQUIRE(history.get_master_deleted_count() == 1);
+            REQUIRE(!history.find(line_set0[3]));
+
+            // Lines appended after the index was saved are still found.
+            REQUIRE(history.add("appended"));
+            REQUIRE(history.find("appended"));
+        }
+
+        // Duplicates are found through the index's hash lookup.
+        settings::find("history.dupe_mode")->set("erase_prev");
+        {
+            test_history_db history;
+            const history_db::line_id before = history.find(line_set1[0]);
+            REQUIRE(before);
+            REQUIRE(history.add(line_set1[0]));
+            const history_db::line_id after = history.find(line_set1[0]);
+            REQUIRE(after);
+            REQUIRE(after != before);
+
+            history.load_rl_history(false/*can_clean*/);
+            REQUIRE(size_t(history_length) == sizeof_array(line_set0) + sizeof_array(line_set1));
+        }
+
+        settings::find("history.memory_map")->set("false");
+    }
+
+    SECTION("Binary format")
+    {
+        settings::find("history.shared")->set("true");
+        settings::find("history.dupe_mode")->set("add");
+
+        {
+            test_history_db history;
+            for (const char* line : line_set0)
+                REQUIRE(history.add(line));
+        }
+
+        // Existing text history is converted.
+        settings::find("history.file_format")->set("binary");
+        {
+            test_history_db history;
+            history.load_rl_history(false/*can_clean*/);
+            REQUIRE(size_t(history_length) == sizeof_array(line_set0));
+
+            for (const char* line : line_set1)
+                REQUIRE(history.add(line));
+            REQUIRE(history.remove(line_set0[3]) == 1);
+            REQUIRE(!history.find(line_set0[3]));
+            REQUIRE(history.find(line_set1[2]));
+        }
+
+        {
+            FILE* in = fopen(master_path, "rb");
+            REQUIRE(in);
+            char signature[8] = {};
+            fread(signature, sizeof(signature), 1, in);
+            fclose(in);
+            REQUIRE(signature[0] == '\0');
+            REQUIRE(memcmp(signature + 1, "CLHBNK", 6) == 0);
+        }
+
+        {
+            test_history_db history;
+            history.load_rl_history(false/*can_clean*/);
+            REQUIRE(size_t(history_length) == sizeof_array(line_set0) + sizeof_array(line_set1) - 1);
+            REQUIRE(history.get_master_deleted_count() == 1);
+        }
+
+        // And converted back.
+        settings::find("history.file_format")->set("text");
+        {
+            test_history_db history;
+            history.load_rl_history(false/*can_clean*/);
+            REQUIRE(size_t(history_length) == sizeof_array(line_set0) + sizeof_array(line_set1) - 1);
+            REQUIRE(history.find(line_set1[2]));
+        }
+
+        {
+            FILE* in = fopen(master_path, "rb");
+            REQUIRE(in);
+            char buffer[8] = {};
+            fread(buffer, sizeof(buffer), 1, in);
+            fclose(in);
+            REQUIRE(strncmp(buffer, "|CTAG", 5) == 0);
+        }
+    }
+
+    SECTION("Directories")
+    {
+        settings::find("history.shared")->set("true");
+        settings::find("history.dupe_mode")->set("add");
+
+        str<> cwd;
+        os::get_current_dir(cwd);
+
+        REQUIRE(history_db::hash_dir("C:\\Foo\\Bar\\") == history_db::hash_dir("c:/foo/bar"));
+        REQUIRE(history_db::hash_dir("c:\\foo") != history_db::hash_dir("c:\\foo\\bar"));
+        REQUIRE(history_db::hash_dir("") == 0);
+
+        for (const char* format : { "text", "binary" })
+        {
+            settings::find("history.file_format")->set(format);
+            {
+                test_history_db history;
+                history.clear();
+                settings::find("history.save_dir")->set("true");
+                REQUIRE(history.add(line_set0[0]));
+                settings::find("history.save_dir")->set("false");
+                REQUIRE(history.add(line_set0[1]));
+                settings::find("history.save_dir")->set("true");
+                REQUIRE(history.add(line_set0[2]));
+            }
+
+            {
+                test_history_db history;
+                history.load_rl_history(false/*can_clean*/);
+                REQUIRE(history_length == 3);
+                const std::vector<int32>* entries = history.find_dir_entries(cwd.c_str());
+                REQUIRE(entries);
+                REQUIRE(*entries == std::vector<int32>({ 0, 2 }));
+
+                // Compacting keeps the directory hashes.
+                history.compact(true/*force*/);
+                history.load_rl_history(false/*can_clean*/);
+                entries = history.find_dir_entries(cwd.c_str());
+                REQUIRE(entries);
+                REQUIRE(*entries == std::vector<int32>({ 0, 2 }));
+            }
+        }
+
+        settings::find("history.save_dir")->set("false");
+        settings::find("history.file_format")->set("text");
+    }
+
+    SECTION("Archive")
+    {
+        const char* archive_path = "clink_history.archive";
+        const char* archive_removals_path = "clink_history.archive.removals";
+
+        settings::find("history.shared")->set("true");
+        settings::find("history.dupe_mode")->set("add");
+        settings::find("history.archive")->set("true");
+
+        const uint32 num_lines = 1500;
+        str<> text;
+        for (uint32 i = 0; i < num_lines; ++i)
+        {
+            str<16> line;
+            line.format("line_%u\n", i);
+            text << line;
+        }
+
+        {
+            test_history_db history;
+            REQUIRE(history.add_lines(text.c_str(), text.length()) == num_lines);
+            history.load_rl_history(false/*can_clean*/);
+            history.compact(true/*force*/);
+        }
+
+        expect_files({master_path, archive_path});
+
+        {
+            test_history_db history;
+            history.load_rl_history(false/*can_clean*/);
+            REQUIRE(uint32(history_length) == num_lines);
+            REQUIRE(history.get_master_length() == num_lines);
+            REQUIRE(strcmp(history_get(history_base)->line, "line_0") == 0);
+            REQUIRE(strcmp(history_get(history_base + num_lines - 1)->line, "line_1499") == 0);
+
+            // Archived lines are also read by the line iterators.
+            history_read_buffer buffer;
+            str_iter out;
+            uint32 count = 0;
+            history_db::iter iter = history.read_lines(buffer.data(), buffer.size());
+            while (iter.next(out))
+                ++count;
+            REQUIRE(count == num_lines);
+
+            // Removing an archived line is recorded next to the archive.
+            REQUIRE(history.remove(0, "line_0"));
+            REQUIRE(history.get_master_length() == num_lines - 1);
+        }
+
+        expect_files({master_path, archive_path, archive_removals_path});
+
+        {
+            test_history_db history;
+            history.load_rl_history(false/*can_clean*/);
+            REQUIRE(uint32(history_length) == num_lines - 1);
+            REQUIRE(strcmp(history_get(history_base)->line, "line_1") == 0);
+        }
+
+        // Disabling the archive moves the archived lines back into the master
+        // bank.
+        settings::find("history.archive")->set("false");
+        {
+            test_history_db history;
+            history.load_rl_history(false/*can_clean*/);
+            history.compact(true/*force*/);
+        }
+
+        expect_files({master_path});
+
+        {
+            test_history_db history;
+            history.load_rl_history(false/*can_clean*/);
+            REQUIRE(uint32(history_length) == num_lines - 1);
+            REQUIRE(strcmp(history_get(history_base)->line, "line_1") == 0);
+            REQUIRE(strcmp(history_get(history_base + num_lines - 2)->line, "line_1499") == 0);
+        }
+    }
+
+    SECTION("Add lines")
+    {
+        settings::find("history.shared")->set("true");
+        settings::find("history.dupe_mode")->set("add");
+        settings::find("history.ignore_space")->set("true");
+
+        const char* text = "one\r\ntwo\n\n skipped\nthree";
+        const char* expected[] = { "one", "two", "three" };
+
+        for (const char* format : { "text", "binary" })
+        {
+            settings::find("history.file_format")->set(format);
+            {
+                test_history_db history;
+                history.clear();
+                REQUIRE(history.add_lines(text, uint32(strlen(text))) == sizeof_array(expected));
+            }
+
+            test_history_db history;
+            history.load_rl_history(false/*can_clean*/);
+            REQUIRE(size_t(history_length) == sizeof_array(expected));
+            for (int32 i = 0; i < history_length; ++i)
+                REQUIRE(strcmp(history_get(history_base + i)->line, expected[i]) == 0);
+        }
+
+        settings::find("history.file_format")->set("text");
+    }
+
+    SECTION("Change feed")
+    {
+        settings::find("history.shared")->set("true");
+        settings::find("history.dupe_mode")->set("add");
+
+        test_history_db history;
+        for (const char* line : line_set0)
+            REQUIRE(history.add(line));
+        history.load_rl_history(false/*can_clean*/);
+        REQUIRE(size_t(history_length) == sizeof_array(line_set0));
+
+        // Lines added by another session are appended.
+        {
+            test_history_db other;
+            REQUIRE(other.add(line_set1[0]));
+        }
+        history.load_rl_history(false/*can_clean*/);
+        REQUIRE(size_t(history_length) == sizeof_array(line_set0) + 1);
+        REQUIRE(history.get_master_length() == uint32(history_length));
+        REQUIRE(strcmp(history_list()[history_length - 1]->line, line_set1[0]) == 0);
+
+        // Lines removed by another session cause a full reload.
+        {
+            test_history_db other;
+            REQUIRE(other.remove(line_set0[0]) == 1);
+        }
+        history.load_rl_history(false/*can_clean*/);
+        REQUIRE(size_t(history_length) == sizeof_array(line_set0));
+        REQUIRE(strcmp(history_list()[0]->line, line_set0[1]) == 0);
+    }
+
     SECTION("line iter")
     {
         str<> lines;
@@ -322,6 +643,94 @@ TEST_CASE("history db")
             }
         }
     }
+
+    SECTION("Reverse line iter")
+    {
+        settings::find("history.shared")->set("true");
+        settings::find("history.dupe_mode")->set("add");
+        settings::find("history.time_stamp")->set("save");
+
+        for (const char* format : { "text", "binary" })
+        {
+            settings::find("history.file_format")->set(format);
+
+            test_history_db history;
+            history.clear();
+            for (const char* line : line_set0)
+                REQUIRE(history.add(line));
+            REQUIRE(history.remove(line_set0[2]) == 1);
+
+            std::vector<str_moveable> forward;
+            str_iter line;
+            str<32> timestamp;
+            history_read_buffer buffer;
+            {
+                history_db::iter iter = history.read_lines(buffer.data(), buffer.size());
+                while (iter.next(line))
+                {
+                    forward.emplace_back();
+                    forward.back().concat(line.get_pointer(), line.length());
+                }
+            }
+            REQUIRE(forward.size() == sizeof_array(line_set0) - 1);
+
+            size_t i = forward.size();
+            history_db::iter iter = history.read_lines_reverse(buffer.data(), buffer.size());
+            while (iter.next(line, &timestamp))
+            {
+                REQUIRE(i > 0);
+                --i;
+                REQUIRE(forward[i].length() == line.length());
+                REQUIRE(strncmp(forward[i].c_str(), line.get_pointer(), line.length()) == 0);
+                REQUIRE(!timestamp.empty());
+            }
+            REQUIRE(i == 0);
+        }
+
+        settings::find("history.file_format")->set("text");
+        settings::find("history.time_stamp")->set("off");
+    }
+
+    SECTION("Time range")
+    {
+        settings::find("history.shared")->set("true");
+        settings::find("history.dupe_mode")->set("add");
+        settings::find("history.time_stamp")->set("save");
+
+        for (const char* format : { "text", "binary" })
+        {
+            settings::find("history.file_format")->set(format);
+
+            test_history_db history;
+            history.clear();
+            for (const char* line : line_set0)
+                REQUIRE(history.add(line));
+            REQUIRE(history.remove(line_set0[2]) == 1);
+
+            const time_t now = time(nullptr);
+            auto count_range = [&] (time_t since, time_t until) {
+                str_iter line;
+                history_read_buffer buffer;
+                history_db::iter iter = history.read_lines_in_range(buffer.data(), buffer.size(), since, until);
+                uint32 count = 0;
+                while (iter.next(line))
+                    ++count;
+                return count;
+            };
+
+            REQUIRE(count_range(now - 3600, 0) == sizeof_array(line_set0) - 1);
+            REQUIRE(count_range(now - 3600, now + 3600) == sizeof_array(line_set0) - 1);
+            REQUIRE(count_range(now + 3600, 0) == 0);
+            REQUIRE(count_range(1, now - 3600) == 0);
+
+            // The time index is extended as lines are added.
+            REQUIRE(history.add(line_set1[0]));
+            REQUIRE(count_range(now - 3600, 0) == sizeof_array(line_set0));
+        }
+
+        settings::find("history.file_format")->set("text");
+        settings::find("history.time_stamp")->set("off");
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -540,6 +949,172 @@ TEST_CASE("history rl")
     }
 }
 
+//------------------------------------------------------------------------------
+TEST_CASE("history prefix index")
+{
+    clear_history();
+    for (const char* line : { "dir /b", "DIR /s", "git status", "git-log", "dir", "cd \\foo" })
+        add_history(line);
+
+    history_prefix_index index;
+    std::vector<int32> found;
+    auto collect = [&] (const char* prefix) {
+        found.clear();
+        index.find(prefix, [&] (int32 i) {
+            found.push_back(i);
+            return true;
+        });
+    };
+
+    SECTION("Exact")
+    {
+        str_compare_scope _(str_compare_scope::exact, false);
+        collect("dir");
+        REQUIRE(found == std::vector<int32>({ 0 }));
+        collect("git");
+        REQUIRE(found == std::vector<int32>({ 3, 2 }));
+        collect("git_");
+        REQUIRE(found.empty());
+    }
+
+    SECTION("Caseless")
+    {
+        str_compare_scope _(str_compare_scope::caseless, false);
+        collect("dir");
+        REQUIRE(found == std::vector<int32>({ 1, 0 }));
+    }
+
+    SECTION("Relaxed")
+    {
+        str_compare_scope _(str_compare_scope::relaxed, false);
+        collect("git_");
+        REQUIRE(found == std::vector<int32>({ 3 }));
+    }
+
+    SECTION("Updates")
+    {
+        str_compare_scope _(str_compare_scope::exact, false);
+        collect("git");
+        REQUIRE(found.size() == 2);
+
+        add_history("git diff");
+        collect("git");
+        REQUIRE(found == std::vector<int32>({ 6, 3, 2 }));
+
+        free_history_entry(remove_history(3));
+        collect("git");
+        REQUIRE(found == std::vector<int32>({ 5, 2 }));
+    }
+
+    SECTION("Many")
+    {
+        str_compare_scope _(str_compare_scope::exact, false);
+        str<> line;
+        for (int32 i = 0; i < 40; ++i)
+        {
+            line.format("git %c", 'z' - (i % 26));
+            add_history(line.c_str());
+        }
+
+        collect("git");
+        REQUIRE(found.size() == 42);
+        for (size_t i = 1; i < found.size(); ++i)
+            REQUIRE(found[i - 1] > found[i]);
+        REQUIRE(found.front() == 45);
+        REQUIRE(found.back() == 2);
+    }
+
+    clear_history();
+}
+
+//------------------------------------------------------------------------------
+TEST_CASE("history event index")
+{
+    clear_history();
+    for (const char* line : { "dir /b", "DIR /s", "git status", "dir", "echo Status", "cd \\foo" })
+        add_history(line);
+
+    str_compare_scope _(str_compare_scope::caseless, false);
+    history_event_index index;
+
+    SECTION("Prefix")
+    {
+        REQUIRE(index.find("dir", false, 99) == 3);
+        REQUIRE(index.find("dir", false, 2) == 0);
+        REQUIRE(index.find("DIR", false, 5) == 1);
+        REQUIRE(index.find("gi", false, 5) == 2);
+        REQUIRE(index.find("git", false, 1) == history_event_index::not_found);
+        REQUIRE(index.find("xyz", false, 5) == history_event_index::not_found);
+    }
+
+    SECTION("Substring")
+    {
+        REQUIRE(index.find("status", true, 5) == 2);
+        REQUIRE(index.find("Status", true, 5) == 4);
+        REQUIRE(index.find("Status", true, 3) == history_event_index::not_found);
+        REQUIRE(index.find("\\fo", true, 5) == 5);
+        REQUIRE(index.find("us", true, 5) == history_event_index::unindexed);
+
+        add_history("git status -s");
+        REQUIRE(index.find("status", true, 99) == 6);
+
+        free_history_entry(remove_history(2));
+        REQUIRE(index.find("status", true, 4) == history_event_index::not_found);
+    }
+
+    clear_history();
+}
+
+//------------------------------------------------------------------------------
+TEST_CASE("history command index")
+{
+    clear_history();
+    for (const char* line : { "git status", "dir /b & git log", "git", "\"my app\" -x", "cd \\foo" })
+        add_history(line);
+
+    history_command_index index;
+    std::vector<int32> found;
+    std::vector<str_moveable> asked;
+    auto collect = [&] (const char* command) {
+        found.clear();
+        asked.clear();
+        index.find([&] (const char* word, bool quoted) {
+            asked.emplace_back(word);
+            return strcmp(word, command) == 0;
+        }, [&] (int32 i) {
+            found.push_back(i);
+            return true;
+        });
+    };
+
+    SECTION("Commands")
+    {
+        collect("git");
+        REQUIRE(found == std::vector<int32>({ 0, 1 }));
+        REQUIRE(asked.size() == 4); // git, dir, my app, cd (without args).
+        collect("dir");
+        REQUIRE(found == std::vector<int32>({ 1 }));
+        collect("my app");
+        REQUIRE(found == std::vector<int32>({ 3 }));
+    }
+
+    SECTION("Updates")
+    {
+        collect("git");
+        REQUIRE(found.size() == 2);
+
+        add_history("git diff");
+        collect("git");
+        REQUIRE(found == std::vector<int32>({ 0, 1, 5 }));
+
+        free_history_entry(remove_history(0));
+        collect("git");
+        REQUIRE(found == std::vector<int32>({ 0, 4 }));
+    }
+
+    clear_history();
+}
+
 //------------------------------------------------------------------------------
 TEST_CASE("history limit")
 {
@@ -659,6 +1234,62 @@ TEST_CASE("history limit")
     }
 }
 
+//------------------------------------------------------------------------------
+TEST_CASE("history background compact")
+{
+    const char* master_path = "clink_history";
+
+    // Start with an empty state dir.
+    const char* empty_fs[] = { nullptr };
+    fs_fixture fs(empty_fs);
+
+    // This sets the state id to something explicit.
+    static const char* env_desc[] = {
+        "=clink.id", "493",
+        nullptr
+    };
+    env_fixture env(env_desc);
+
+    app_context::desc context_desc;
+    context_desc.inherit_id = true;
+    str_base(context_desc.state_dir).copy(fs.get_root());
+    app_context context(context_desc);
+
+    settings::find("history.shared")->set("true");
+    settings::find("history.time_stamp")->set("off");
+
+    {
+        test_history_db history;
+        history.clear();
+        REQUIRE(history.add("echo one"));
+        REQUIRE(history.add("echo two"));
+    }
+
+    // Leave the last line in the master bank unterminated, as if a session
+    // was interrupted while writing it.
+    FILE* out = fopen(master_path, "ab");
+    REQUIRE(out != nullptr);
+    fputs("echo three", out);
+    fclose(out);
+
+    test_history_db history;
+    str<> old_ctag(history.get_master_tag());
+
+    // Compaction must finish rather than wait forever for the last line.
+    REQUIRE(history.compact_in_background(5000));
+
+    char content[256] = {};
+    FILE* in = fopen(master_path, "rb");
+    REQUIRE(in != nullptr);
+    fread(content, 1, sizeof(content) - 1, in);
+    fclose(in);
+
+    const char* lines = strchr(content, '\n');
+    REQUIRE(lines != nullptr);
+    REQUIRE(strncmp(content, old_ctag.c_str(), old_ctag.length()) != 0);
+    REQUIRE(strcmp(lines + 1, "echo one\necho two\necho three\n") == 0);
+}
+
 //------------------------------------------------------------------------------
 TEST_CASE("history unique")
 {
@@ -734,6 +1365,16 @@ TEST_CASE("history unique")
         REQUIRE(strcmp(history_get(2)->line, "aaa") == 0);
         REQUIRE(strcmp(history_get(3)->line, "bbb") == 0);
     }
+
+    SECTION("Unique with limit")
+    {
+        history.compact(true/*force*/, true/*uniq*/, 2/*limit*/);
+        history.load_rl_history();
+
+        REQUIRE(history.get_master_length() == 2);
+        REQUIRE(strcmp(history_get(1)->line, "aaa") == 0);
+        REQUIRE(strcmp(history_get(2)->line, "bbb") == 0);
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -926,3 +1567,102 @@ TEST_CASE("history removals ctag")
         }
     }
 }
+
+//------------------------------------------------------------------------------
+TEST_CASE("history trigram index")
+{
+    static const char* const lines[] = {
+        "dir /b c:\\windows",
+        "git status",
+        "GIT log --oneline",
+        "cd c:/windows//system32",
+        "echo hi",
+    };
+
+    trigram_index index;
+    std::vector<int32> found;
+    auto build = [&] () {
+        index.clear();
+        for (int32 i = 0; i < int32(sizeof_array(lines)); ++i)
+            index.add(i, lines[i]);
+    };
+
+    SECTION("Exact")
+    {
+        str_compare_scope _(str_compare_scope::exact, false);
+        build();
+        REQUIRE(index.is_compatible());
+        REQUIRE(index.query("git", found));
+        REQUIRE(found == std::vector<int32>({ 1 }));
+        REQUIRE(index.query("tus", found));
+        REQUIRE(found == std::vector<int32>({ 1 }));
+        REQUIRE(index.query("xyz", found));
+        REQUIRE(found.empty());
+        REQUIRE(!index.query("gi", found));
+    }
+
+    SECTION("Caseless")
+    {
+        str_compare_scope _(str_compare_scope::caseless, false);
+        build();
+        REQUIRE(index.query("Git ", found));
+        REQUIRE(found == std::vector<int32>({ 1, 2 }));
+        REQUIRE(index.query("c:/windows", found));
+        REQUIRE(found == std::vector<int32>({ 0, 3 }));
+        REQUIRE(index.query("windows\\\\system", found));
+        REQUIRE(found == std::vector<int32>({ 3 }));
+    }
+
+    SECTION("Compatibility")
+    {
+        {
+            str_compare_scope _(str_compare_scope::exact, false);
+            build();
+        }
+        str_compare_scope _(str_compare_scope::caseless, false);
+        REQUIRE(!index.is_compatible());
+    }
+}
+
+//------------------------------------------------------------------------------
+const char* find_history_suggestion(const char* line, bool match_prev_cmd);
+void prefetch_history_suggestions();
+
+TEST_CASE("history suggestion prefetch")
+{
+    settings::find("history.dupe_mode")->set("add");
+    settings::find("autosuggest.enable")->set("true");
+    settings::find("autosuggest.strategy")->set("match_prev_cmd");
+    settings::find("match.ignore_case")->set("off");
+    str_compare_scope _(str_compare_scope::exact, false);
+
+    clear_history();
+    for (const char* line : { "cd src", "git status", "cd src", "dir", "make", "cd src", "go", "cx", "cd src" })
+        add_history(line);
+
+    const char* const prefixes[] = { "", "g", "d", "m", "x", "G", "go", "dir" };
+    const char* expected[sizeof_array(prefixes)];
+    for (size_t i = 0; i < sizeof_array(prefixes); ++i)
+        expected[i] = find_history_suggestion(prefixes[i], true);
+
+    prefetch_history_suggestions();
+
+    for (size_t i = 0; i < sizeof_array(prefixes); ++i)
+        REQUIRE(find_history_suggestion(prefixes[i], true) == expected[i]);
+
+    REQUIRE(expected[0] && strcmp(expected[0], "go") == 0);
+    REQUIRE(expected[1] && strcmp(expected[1], "go") == 0);
+    REQUIRE(expected[2] && strcmp(expected[2], "dir") == 0);
+    REQUIRE(!expected[3]);
+    REQUIRE(!expected[4]);
+    REQUIRE(!expected[5]);
+
+    // Adding to the history invalidates the prefetched suggestions.
+    add_history("make");
+    add_history("cd src");
+    REQUIRE(strcmp(find_history_suggestion("m", true), "make") == 0);
+
+    settings::find("autosuggest.strategy")->set();
+    settings::find("match.ignore_case")->set();
+    settings::find("history.dupe_mode")->set();
+}
@@ -0,0 +1,130 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+
+#include <core/base.h>
+#include <core/str.h>
+#include <lua/lua_script_loader.h>
+#include <lua/lua_state.h>
+#include <lua/prompt.h>
+
+extern "C" {
+#include <lua.h>
+}
+
+//------------------------------------------------------------------------------
+TEST_CASE("Prompt filter cache")
+{
+    lua_state lua;
+    prompt_filter prompt_filter(lua);
+    lua_load_script(lua, app, prompt);
+
+    const char* script = "\
+    _calls = 0\
+    _value = 'a'\
+    local getenv = os.getenv\
+    function os.getenv(name)\
+        if name == 'CACHE_TEST' then return _value end\
+        return getenv(name)\
+    end\
+    \
+    local pf = clink.promptfilter(1)\
+    pf.cache = { env={ 'CACHE_TEST' } }\
+    function pf:filter(prompt)\
+        _calls = _calls + 1\
+        return prompt..'>'.._value\
+    end\
+    ";
+
+    REQUIRE_LUA_DO_STRING(lua, script);
+
+    auto get_calls = [&] ()
+    {
+        lua_State* state = lua.get_state();
+        lua_getglobal(state, "_calls");
+        const int32 calls = int32(lua_tointeger(state, -1));
+        lua_pop(state, 1);
+        return calls;
+    };
+
+    str<> out;
+
+    prompt_filter.filter("x", out);
+    REQUIRE(out.equals("x>a"));
+    REQUIRE(get_calls() == 1);
+
+    // Nothing changed, so the previous result is reused.
+    prompt_filter.filter("x", out);
+    REQUIRE(out.equals("x>a"));
+    REQUIRE(get_calls() == 1);
+
+    // The input prompt changed.
+    prompt_filter.filter("y", out);
+    REQUIRE(out.equals("y>a"));
+    REQUIRE(get_calls() == 2);
+
+    // A dependency changed.
+    REQUIRE_LUA_DO_STRING(lua, "_value = 'b'");
+    prompt_filter.filter("y", out);
+    REQUIRE(out.equals("y>b"));
+    REQUIRE(get_calls() == 3);
+}
+
+//------------------------------------------------------------------------------
+TEST_CASE("Prompt filter segments")
+{
+    lua_state lua;
+    prompt_filter prompt_filter(lua);
+    lua_load_script(lua, app, prompt);
+
+    const char* script = "\
+    local pf = clink.promptfilter(1)\
+    function pf:segments(prompt)\
+        return { 'dir', { text=' ' }, { text='>', transient=true }, { text='!', transient='T' } }\
+    end\
+    ";
+
+    REQUIRE_LUA_DO_STRING(lua, script);
+
+    str<> out;
+    str<> rout;
+
+    SECTION("Assembled")
+    {
+        prompt_filter.filter("x", "", out, rout);
+        REQUIRE(out.equals("dir >!"));
+
+        // The transient prompt is available without filtering again, once.
+        REQUIRE(prompt_filter.take_transient(out, rout));
+        REQUIRE(out.equals(">T"));
+        REQUIRE(rout.empty());
+        REQUIRE(!prompt_filter.take_transient(out, rout));
+
+        // Filtering the transient prompt uses the segments, too.
+        REQUIRE(prompt_filter.filter("$g", "", out, rout, true/*transient*/));
+        REQUIRE(out.equals(">T"));
+    }
+
+    SECTION("Transient filter")
+    {
+        const char* other = "\
+        local tf = clink.promptfilter(2)\
+        function tf:filter() end\
+        function tf:transientfilter(prompt)\
+            return prompt..'+'\
+        end\
+        ";
+
+        REQUIRE_LUA_DO_STRING(lua, other);
+
+        // A transient filter function has to run, so the transient prompt is
+        // not assembled ahead of time.
+        prompt_filter.filter("x", "", out, rout);
+        REQUIRE(out.equals("dir >!"));
+        REQUIRE(!prompt_filter.take_transient(out, rout));
+
+        REQUIRE(prompt_filter.filter("$g", "", out, rout, true/*transient*/));
+        REQUIRE(out.equals(">T+"));
+    }
+}
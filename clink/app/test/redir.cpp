@@ -325,3 +325,58 @@ TEST_CASE("Redir parsing")
         }
     }
 }
+
+//------------------------------------------------------------------------------
+TEST_CASE("Word collector cache")
+{
+    cmd_command_tokeniser command_tokeniser;
+    cmd_word_tokeniser word_tokeniser;
+    word_collector collector(&command_tokeniser, &word_tokeniser);
+
+    auto same = [] (const std::vector<word>& a, const std::vector<word>& b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            if (a[i].offset != b[i].offset ||
+                a[i].length != b[i].length ||
+                a[i].command_word != b[i].command_word ||
+                a[i].is_alias != b[i].is_alias ||
+                a[i].is_redir_arg != b[i].is_redir_arg ||
+                a[i].quoted != b[i].quoted ||
+                a[i].delim != b[i].delim)
+                return false;
+        }
+        return true;
+    };
+
+    const char* const lines[] = {
+        "echo a & dir /b \"x y\" | findstr -i:z & (cd foo) && echo b",
+        "echo ab & dir /b \"x y\" | findstr -i:z & (cd foo) && echo b",
+        "echo ab & dir /b \"x y\" | findstr -i:z & (cd foo) && echo b",
+        "echo \"ab & dir /b \"x y\" | findstr -i:z & (cd foo) && echo b",
+        "x=echo a & dir /b \"x y\" | findstr -i:z & (cd foo) && echo b",
+    };
+
+    for (const char* line : lines)
+    {
+        const uint32 len = uint32(strlen(line));
+        for (auto mode : { collect_words_mode::stop_at_cursor, collect_words_mode::whole_command })
+        {
+            for (uint32 cursor : { len, len / 2 })
+            {
+                std::vector<word> cached;
+                std::vector<word> fresh;
+                collector.collect_words(line, len, cursor, cached, mode, nullptr);
+
+                word_collector uncached(&command_tokeniser, &word_tokeniser);
+                uncached.collect_words(line, len, cursor, fresh, mode, nullptr);
+
+                REQUIRE(same(cached, fresh), [&] () {
+                    printf("line '%s', cursor %u\n", line, cursor);
+                });
+            }
+        }
+    }
+}
@@ -0,0 +1,162 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "bench.h"
+#include "version.h"
+
+#include <core/os.h>
+#include <core/str.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace bench {
+
+//------------------------------------------------------------------------------
+struct result
+{
+    str_moveable        name;
+    uint32              iterations;
+    double              mean;           // All times are in milliseconds.
+    double              median;
+    double              min;
+    double              max;
+};
+
+static std::vector<result> s_results;
+static const char* s_case_name = "";
+static float s_scale = 1.0f;
+
+//------------------------------------------------------------------------------
+void measure(const char* name, uint32 iterations, const std::function<void()>& body, const std::function<void()>& setup)
+{
+    iterations = max<uint32>(1, uint32(iterations * s_scale));
+
+    std::vector<double> times;
+    times.reserve(iterations);
+
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        if (setup)
+            setup();
+
+        const os::high_resolution_clock clock;
+        body();
+        times.push_back(clock.elapsed() * 1000);
+    }
+
+    std::sort(times.begin(), times.end());
+
+    double total = 0;
+    for (double t : times)
+        total += t;
+
+    result r;
+    r.name.format("%s/%s", s_case_name, name);
+    r.iterations = iterations;
+    r.mean = total / iterations;
+    r.median = times[iterations / 2];
+    r.min = times.front();
+    r.max = times.back();
+
+    printf("  %-52s %6u x %10.3f ms\n", r.name.c_str(), r.iterations, r.median);
+    s_results.emplace_back(std::move(r));
+}
+
+//------------------------------------------------------------------------------
+static void append_json_string(str_base& out, const char* s)
+{
+    out << "\"";
+    for (; *s; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+            out.concat("\\", 1);
+        out.concat(s, 1);
+    }
+    out << "\"";
+}
+
+//------------------------------------------------------------------------------
+static void format_json(str_base& out, uint32 failed)
+{
+    str<> tmp;
+
+    out << "{\n  \"version\": ";
+    append_json_string(out, CLINK_VERSION_STR);
+    tmp.format(",\n  \"failed\": %u,\n  \"benchmarks\": [", failed);
+    out << tmp;
+
+    for (size_t i = 0; i < s_results.size(); ++i)
+    {
+        const result& r = s_results[i];
+        out << (i ? ",\n    { \"name\": " : "\n    { \"name\": ");
+        append_json_string(out, r.name.c_str());
+        tmp.format(", \"iterations\": %u, \"mean_ms\": %.4f, \"median_ms\": %.4f, \"min_ms\": %.4f, \"max_ms\": %.4f }",
+                   r.iterations, r.mean, r.median, r.min, r.max);
+        out << tmp;
+    }
+
+    out << "\n  ]\n}\n";
+}
+
+//------------------------------------------------------------------------------
+bool run(const char* prefix, const char* json_file, float scale)
+{
+    s_scale = scale;
+    s_results.clear();
+
+    // Workloads are built with the test fixtures, which use REQUIRE() and
+    // expect an enclosing clatch section.
+    clatch::section root;
+    clatch::section::get_outer_store() = &root;
+
+    uint32 failed = 0;
+    for (bench_case* bc = bench_case::get_head(); bc != nullptr; bc = bc->m_next)
+    {
+        // Cheap lower-case prefix test.
+        const char* a = prefix, *b = bc->m_name;
+        for (; *a && (*a & ~0x20) == (*b & ~0x20); ++a, ++b);
+        if (*a)
+            continue;
+
+        printf("%s\n", bc->m_name);
+        s_case_name = bc->m_name;
+
+        try
+        {
+            (bc->m_func)();
+        }
+        catch (...)
+        {
+            printf("  %sfailed%s\n", clatch::colors::get_error(), clatch::colors::get_normal());
+            ++failed;
+        }
+    }
+
+    clatch::section::get_outer_store() = nullptr;
+
+    str_moveable json;
+    format_json(json, failed);
+
+    if (!json_file)
+    {
+        fputs("\n", stdout);
+        fputs(json.c_str(), stdout);
+    }
+    else
+    {
+        FILE* file = fopen(json_file, "wt");
+        if (!file)
+        {
+            fprintf(stderr, "Unable to write '%s'.\n", json_file);
+            return false;
+        }
+        fputs(json.c_str(), file);
+        fclose(file);
+    }
+
+    return (failed == 0);
+}
+
+} // namespace bench
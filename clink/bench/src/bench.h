@@ -0,0 +1,56 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <functional>
+
+namespace bench {
+
+//------------------------------------------------------------------------------
+// A benchmark case sets up a workload and then measures one or more operations
+// on it.  Cases are registered at static init time, like clatch tests, and run
+// in declaration order.
+struct bench_case
+{
+    typedef void        (bench_func)();
+    static bench_case*& get_head() { static bench_case* head; return head; }
+    static bench_case*& get_tail() { static bench_case* tail; return tail; }
+    bench_case*         m_next = nullptr;
+    bench_func*         m_func;
+    const char*         m_name;
+
+    bench_case(const char* name, bench_func* func)
+    : m_func(func)
+    , m_name(name)
+    {
+        if (get_head() == nullptr)
+            get_head() = this;
+
+        if (bench_case* tail = get_tail())
+            tail->m_next = this;
+        get_tail() = this;
+    }
+};
+
+//------------------------------------------------------------------------------
+// Runs body() the requested number of iterations (scaled by the -n option) and
+// records how long each iteration took.  If setup is given, it runs before
+// each iteration and is excluded from the time.
+void                    measure(const char* name, uint32 iterations, const std::function<void()>& body, const std::function<void()>& setup=nullptr);
+
+// Runs the cases whose names start with prefix, and writes the results as JSON
+// to json_file (or stdout if json_file is null).
+bool                    run(const char* prefix, const char* json_file, float scale);
+
+} // namespace bench
+
+//------------------------------------------------------------------------------
+#define BENCH_IDENT__(d, b) _bench_##d##_##b
+#define BENCH_IDENT_(d, b)  BENCH_IDENT__(d, b)
+#define BENCH_IDENT(d)      BENCH_IDENT_(d, __LINE__)
+
+#define BENCH_CASE(name)\
+    static void BENCH_IDENT(bench_func)();\
+    static bench::bench_case BENCH_IDENT(bench)(name, BENCH_IDENT(bench_func));\
+    static void BENCH_IDENT(bench_func)()
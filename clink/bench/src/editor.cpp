@@ -0,0 +1,142 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "bench.h"
+#include "env_fixture.h"
+#include "fs_fixture.h"
+#include "line_editor_tester.h"
+
+#include <core/os.h>
+#include <core/settings.h>
+#include <core/str.h>
+#include <lua/lua_match_generator.h>
+#include <lua/lua_word_classifier.h>
+#include <lua/lua_script_loader.h>
+#include <lua/lua_state.h>
+
+#include <vector>
+
+//------------------------------------------------------------------------------
+static const uint32 c_dir_files = 50000;
+static const uint32 c_argmatchers = 500;
+static const uint32 c_long_line = 4000;
+
+//------------------------------------------------------------------------------
+// Runs one line of input through a fresh line editor, since the tester adds a
+// module per run.
+static void run_editor(const line_editor::desc& desc, lua_match_generator& generator, lua_word_classifier* classifier, const char* input)
+{
+    line_editor_tester tester(desc, nullptr, nullptr);
+    tester.get_editor()->set_generator(generator);
+    if (classifier)
+        tester.get_editor()->set_classifier(*classifier);
+    tester.set_input(input);
+    tester.run(true/*expectationless*/);
+}
+
+//------------------------------------------------------------------------------
+BENCH_CASE("match pipeline")
+{
+    // A directory with many files, with a few distinct prefixes so that
+    // restricting the matches by typing more text has work to do.
+    std::vector<str_moveable> names;
+    std::vector<const char*> fs_list;
+    names.reserve(c_dir_files);
+    for (uint32 i = 0; i < c_dir_files; ++i)
+    {
+        static const char* const c_prefixes[] = { "file", "File_", "source", "readme", "build." };
+        str_moveable name;
+        name.format("%s%05u.%s", c_prefixes[i % sizeof_array(c_prefixes)], i, (i & 1) ? "cpp" : "txt");
+        names.emplace_back(std::move(name));
+    }
+    for (const auto& name : names)
+        fs_list.push_back(name.c_str());
+    fs_list.push_back(nullptr);
+
+    fs_fixture fs(fs_list.data());
+
+    static const char* env_inputrc[] = {
+        "clink_inputrc", "dummy_to_use_defaults",
+        nullptr
+    };
+    env_fixture env(env_inputrc);
+
+    settings::find("match.translate_slashes")->set("system");
+
+    lua_state lua;
+    lua_match_generator lua_generator(lua);
+
+    line_editor::desc desc(nullptr, nullptr, nullptr, nullptr);
+
+    bench::measure("generate all", 5, [&] () {
+        run_editor(desc, lua_generator, nullptr, DO_COMPLETE);
+    });
+    bench::measure("generate prefix", 5, [&] () {
+        run_editor(desc, lua_generator, nullptr, "sour" DO_COMPLETE);
+    });
+    bench::measure("restrict", 5, [&] () {
+        run_editor(desc, lua_generator, nullptr, "f" DO_COMPLETE "ile1" DO_COMPLETE);
+    });
+}
+
+//------------------------------------------------------------------------------
+BENCH_CASE("classify")
+{
+    const char* empty_fs[] = { nullptr };
+    fs_fixture fs(empty_fs);
+
+    lua_state lua;
+    lua_match_generator lua_generator(lua);
+    lua_load_script(lua, app, cmd);
+    lua_load_script(lua, app, dir);
+    lua_word_classifier lua_classifier(lua);
+
+    settings::find("clink.colorize_input")->set("true");
+
+    // Many argmatchers, each with nested flags and arguments.
+    str<> script;
+    script.format("for i = 1, %u do\n"
+                  "    local sub = clink.argmatcher():addarg('one', 'two', 'three'):addflags('-x', '-y'):loop()\n"
+                  "    clink.argmatcher('cmd'..i)\n"
+                  "    :addarg('add'..sub, 'remove'..sub, 'list', 'show')\n"
+                  "    :addflags('-a', '-b', '--verbose', '--output='..clink.argmatcher():addarg('json', 'text'))\n"
+                  "end\n", c_argmatchers);
+    REQUIRE_LUA_DO_STRING(lua, script.c_str());
+
+    str<> line;
+    for (uint32 i = 1; i <= 20; ++i)
+    {
+        str<64> command;
+        command.format("%scmd%u add one two -x --output=json three -y ", i > 1 ? "& " : "", i * 23);
+        line << command;
+    }
+
+    line_editor::desc desc(nullptr, nullptr, nullptr, nullptr);
+
+    bench::measure("20 commands", 10, [&] () {
+        run_editor(desc, lua_generator, &lua_classifier, line.c_str());
+    });
+}
+
+//------------------------------------------------------------------------------
+BENCH_CASE("display")
+{
+    const char* empty_fs[] = { nullptr };
+    fs_fixture fs(empty_fs);
+
+    lua_state lua;
+    lua_match_generator lua_generator(lua);
+
+    // A long pasted line redisplays after each character, so it exercises
+    // display_manager::display() with a line that wraps many times.
+    str_moveable line;
+    while (line.length() < c_long_line)
+        line << "echo \"some quoted text\" & dir /b c:\\windows\\system32\\*.dll | findstr /i kernel & ";
+
+    line_editor::desc desc(nullptr, nullptr, nullptr, nullptr);
+
+    bench::measure("long line", 3, [&] () {
+        run_editor(desc, lua_generator, nullptr, line.c_str());
+    });
+}
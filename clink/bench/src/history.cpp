@@ -0,0 +1,108 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "bench.h"
+#include "env_fixture.h"
+#include "fs_fixture.h"
+
+#include <core/base.h>
+#include <core/os.h>
+#include <core/settings.h>
+#include <core/str.h>
+#include <lib/history_db.h>
+#include <utils/app_context.h>
+
+extern "C" {
+#include <readline/history.h>
+};
+
+//------------------------------------------------------------------------------
+static const uint32 c_history_lines = 100000;
+
+//------------------------------------------------------------------------------
+static void make_history_line(uint32 i, str_base& out)
+{
+    static const char* const c_commands[] = {
+        "git status", "git log --oneline -n %u", "cd c:\\src\\project%u",
+        "dir /s /b *.cpp", "premake5 vs2022 --tag=%u", "msbuild /m /p:Configuration=Release",
+        "echo %u", "findstr /s /i \"needle%u\" *.h",
+    };
+
+    out.format(c_commands[i % sizeof_array(c_commands)], i);
+    str<16> suffix;
+    suffix.format(" #%u", i);
+    out << suffix;
+}
+
+//------------------------------------------------------------------------------
+BENCH_CASE("history_db")
+{
+    const char* empty_fs[] = { nullptr };
+    fs_fixture fs(empty_fs);
+
+    static const char* env_desc[] = {
+        "=clink.id", "493",
+        nullptr
+    };
+    env_fixture env(env_desc);
+
+    app_context::desc context_desc;
+    context_desc.inherit_id = true;
+    str_base(context_desc.state_dir).copy(fs.get_root());
+    app_context context(context_desc);
+
+    settings::find("history.shared")->set("true");
+    settings::find("history.dupe_mode")->set("add");
+
+    str<> path;
+    context.get_history_path(path);
+
+    // Write the history file directly; the first history_db to open it will
+    // add a concurrency tag and convert it to the configured format.
+    {
+        FILE* file = fopen(path.c_str(), "wt");
+        REQUIRE(file);
+        str<> line;
+        for (uint32 i = 0; i < c_history_lines; ++i)
+        {
+            make_history_line(i, line);
+            fputs(line.c_str(), file);
+            fputc('\n', file);
+        }
+        fclose(file);
+
+        history_db history(path.c_str(), context.get_id(), true/*use_master_bank*/);
+        history.initialise();
+    }
+
+    bench::measure("load", 10, [&] () {
+        history_db history(path.c_str(), context.get_id(), true/*use_master_bank*/);
+        history.initialise();
+        history.load_rl_history();
+    });
+
+    REQUIRE(history_length == c_history_lines);
+
+    {
+        history_db history(path.c_str(), context.get_id(), true/*use_master_bank*/);
+        history.initialise();
+        history.load_rl_history();
+
+        str<> newest, middle;
+        make_history_line(c_history_lines - 1, newest);
+        make_history_line(c_history_lines / 2, middle);
+
+        bench::measure("find newest", 100, [&] () {
+            REQUIRE(history.find(newest.c_str()));
+        });
+        bench::measure("find middle", 100, [&] () {
+            REQUIRE(history.find(middle.c_str()));
+        });
+        bench::measure("find missing", 100, [&] () {
+            REQUIRE(!history.find("this line is not in the history"));
+        });
+    }
+
+    clear_history();
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "bench.h"
+
+#include <core/str.h>
+#include <core/settings.h>
+#include <core/os.h>
+#include <lib/recognizer.h>
+#include <lua/lua_task_manager.h>
+
+extern "C" {
+#include <readline/readline.h>
+#include <readline/rldefs.h>
+#include <readline/rlprivate.h>
+}
+
+#include <list>
+#include <assert.h>
+
+//------------------------------------------------------------------------------
+void set_noasync_recognizer();
+void set_test_harness();
+
+//------------------------------------------------------------------------------
+// NOTE:  If you get a linker error about these being "already defined", then
+// probably a new global function has been added in app/src/ that needs to be
+// stubbed out here (and in test/src/main.cpp).
+#ifdef DEBUG
+bool g_suppress_signal_assert = false;
+#endif
+void host_cmd_enqueue_lines(std::list<str_moveable>& lines, bool hide_prompt, bool show_line) { assert(false); }
+void host_cleanup_after_signal() {}
+void host_set_last_prompt(const char* prompt, uint32 length) { assert(false); }
+
+//------------------------------------------------------------------------------
+int32 main(int32 argc, char** argv)
+{
+    argc--, argv++;
+
+#ifdef DEBUG
+    settings::TEST_set_ever_loaded();
+#endif
+
+    os::set_shellname(L"clink_test_harness");
+    set_noasync_recognizer();
+    set_test_harness();
+
+    _rl_bell_preference = VISIBLE_BELL;     // Because audible is annoying.
+
+    const char* json_file = nullptr;
+    float scale = 1.0f;
+
+    while (argc > 0)
+    {
+        if (!strcmp(argv[0], "-?") || !strcmp(argv[0], "--help"))
+        {
+            puts("Usage:  clink_bench [options] [prefix]\n"
+                 "\n"
+                 "Options:\n"
+                 "  -?        Show this help.\n"
+                 "  -n scale  Scale the iteration counts (e.g. 0.1 or 10).\n"
+                 "  -o file   Write the JSON results to file instead of stdout.");
+            return 1;
+        }
+        else if (!strcmp(argv[0], "-n") && argc > 1)
+        {
+            argc--, argv++;
+            scale = float(atof(argv[0]));
+            if (scale <= 0)
+                scale = 1.0f;
+        }
+        else if (!strcmp(argv[0], "-o") && argc > 1)
+        {
+            argc--, argv++;
+            json_file = argv[0];
+        }
+        else if (!strcmp(argv[0], "--"))
+        {
+        }
+        else
+        {
+            break;
+        }
+
+        argc--, argv++;
+    }
+
+    clatch::colors::initialize();
+
+    const char* prefix = (argc > 0) ? argv[0] : "";
+    int32 result = (bench::run(prefix, json_file, scale) != true);
+
+    shutdown_recognizer();
+    shutdown_task_manager(true/*final*/);
+
+    return result;
+}
@@ -0,0 +1,166 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "bench.h"
+
+#include <core/path.h>
+#include <core/str.h>
+#include <core/str_hash.h>
+#include <core/str_unordered_set.h>
+#include <lib/cmd_tokenisers.h>
+#include <lib/word_collector.h>
+#include <terminal/ecma48_iter.h>
+
+#include <vector>
+
+//------------------------------------------------------------------------------
+BENCH_CASE("word_collector")
+{
+    str_moveable line;
+    while (line.length() < 8000)
+        line << "git commit -m \"fix the thing\" --amend & dir /s /b \"c:\\program files\\*.exe\" >nul 2>&1 | sort & ";
+
+    cmd_command_tokeniser command_tokeniser;
+    cmd_word_tokeniser word_tokeniser;
+    std::vector<word> words;
+    std::vector<command> commands;
+
+    bench::measure("long line", 200, [&] () {
+        word_collector collector(&command_tokeniser, &word_tokeniser);
+        collector.collect_words(line.c_str(), line.length(), line.length(), words, collect_words_mode::whole_command, &commands);
+    });
+
+    // Appending to the line reuses the cached words of unchanged commands.
+    word_collector collector(&command_tokeniser, &word_tokeniser);
+    collector.collect_words(line.c_str(), line.length(), line.length(), words, collect_words_mode::whole_command, &commands);
+    line << "x";
+    bench::measure("long line, cached", 200, [&] () {
+        collector.collect_words(line.c_str(), line.length(), line.length(), words, collect_words_mode::whole_command, &commands);
+    });
+}
+
+//------------------------------------------------------------------------------
+BENCH_CASE("ecma48_iter")
+{
+    // Colored output typical of a prompt or a match display, with a mix of
+    // plain text, SGR codes, and OSC strings.
+    str_moveable text;
+    while (text.length() < 64 * 1024)
+    {
+        text << "\x1b[1;32muser@host\x1b[m \x1b[33mc:\\src\\clink\x1b[m (\x1b[36mmaster\x1b[m) "
+                "\x1b]0;title text\a\x1b]8;;file:///c:/src\x1b\\link\x1b]8;;\x1b\\ plain text follows\r\n";
+    }
+
+    bench::measure("64k colored text", 200, [&] () {
+        ecma48_state state;
+        ecma48_iter iter(text.c_str(), state, text.length());
+        uint32 count = 0;
+        while (iter.next())
+            ++count;
+        REQUIRE(count > 0);
+    });
+}
+
+//------------------------------------------------------------------------------
+BENCH_CASE("str_hash")
+{
+    // File names and paths, like the keys of the match dedup table and the
+    // recognizer and path type caches.
+    std::vector<str_moveable> keys;
+    keys.resize(50000);
+    for (uint32 i = 0; i < keys.size(); ++i)
+    {
+        if (i & 1)
+            keys[i].format("c:\\Program Files\\Some Vendor\\Product %u\\bin\\Tool_%u.exe", i % 97, i);
+        else
+            keys[i].format("file_%05u.txt", i);
+    }
+
+    uint32 sum = 0;
+    bench::measure("str_hash", 50, [&] () {
+        for (const auto& key : keys)
+            sum += str_hash(key.c_str(), key.length());
+    });
+    bench::measure("str_fast_hash", 50, [&] () {
+        for (const auto& key : keys)
+            sum += str_fast_hash(key.c_str(), key.length());
+    });
+    bench::measure("str_fast_ihash", 50, [&] () {
+        for (const auto& key : keys)
+            sum += str_fast_ihash(key.c_str(), key.length());
+    });
+
+    bench::measure("str_unordered_set", 20, [&] () {
+        str_unordered_set set;
+        for (const auto& key : keys)
+            set.insert(key.c_str());
+        for (const auto& key : keys)
+            REQUIRE(set.find(key.c_str()) != set.end());
+    });
+
+    bench::measure("str_unordered_map_caseless", 20, [&] () {
+        str_unordered_map_caseless<uint32> map;
+        for (uint32 i = 0; i < keys.size(); ++i)
+            map.emplace(keys[i].c_str(), i);
+        for (const auto& key : keys)
+            REQUIRE(map.find(key.c_str()) != map.end());
+    });
+
+    // Keep the hashes from being optimized away.
+    static volatile uint32 s_sink;
+    s_sink = sum;
+}
+
+//------------------------------------------------------------------------------
+BENCH_CASE("str_convert")
+{
+    // Mostly ASCII output with occasional non-ASCII characters, like prompts,
+    // match displays, and file names.
+    str_moveable utf8;
+    while (utf8.length() < 256 * 1024)
+        utf8 << "\x1b[1;32mc:\\src\\clink\x1b[m dir listing r\xc3\xa9sum\xc3\xa9.txt and some plain ASCII text \xe2\x86\x92 next\r\n";
+    wstr_moveable utf16;
+    utf16.from_utf8(utf8.c_str());
+
+    bench::measure("to_utf16 256k", 200, [&] () {
+        wstr_moveable out;
+        out.from_utf8(utf8.c_str());
+    });
+
+    bench::measure("to_utf8 256k", 200, [&] () {
+        str_moveable out;
+        out.from_utf16(utf16.c_str());
+    });
+
+    bench::measure("utf16_length 256k", 200, [&] () {
+        REQUIRE(utf16_length(utf8.c_str(), utf8.length()) == int32(utf16.length()));
+    });
+}
+
+//------------------------------------------------------------------------------
+BENCH_CASE("path")
+{
+    // Compares the fixed buffer overloads against the str<> versions, which
+    // can allocate.
+    const char* const lhs = "c:\\Program Files\\Some Vendor\\Some Product\\bin/../lib";
+    const char* const rhs = "subdir\\..\\another\\file.name.ext";
+
+    str<> expected;
+    path::join(lhs, rhs, expected);
+    path::normalise(expected);
+
+    bench::measure("join+normalise str<>", 20000, [&] () {
+        str<> s;
+        path::join(lhs, rhs, s);
+        path::normalise(s);
+        REQUIRE(s.length() == expected.length());
+    });
+
+    bench::measure("join+normalise fixed buffer", 20000, [&] () {
+        char buffer[280];
+        REQUIRE(path::join(lhs, rhs, buffer));
+        path::normalise(buffer);
+        REQUIRE(strlen(buffer) == expected.length());
+    });
+}
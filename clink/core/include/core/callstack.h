@@ -23,7 +23,9 @@
 CALLSTACK_EXTERN_C size_t format_callstack(int32 skip_frames, int32 total_frames, char* buffer, size_t capacity, int32 newlines);
 
 // Copies stack frame pointers.  They can can formatted later with
-// format_frames().
+// format_frames().  This is much cheaper than format_callstack(), since symbols
+// are only resolved when the frames are formatted.  Resolved symbols are cached
+// by address, so formatting the same frames again is cheap.
 CALLSTACK_EXTERN_C int32 get_callstack_frames(int32 skip_frames, int32 total_frames, void** frames, DWORD* hash);
 
 // Formats buffer (capacity is size of buffer) with up to total_frames.  The
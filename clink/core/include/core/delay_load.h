@@ -0,0 +1,14 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+//------------------------------------------------------------------------------
+// Non-critical system DLLs are loaded on first use instead of when Clink is
+// injected, so that they don't add to the time spent inside cmd.exe's loader
+// lock.  Both the linker's /DELAYLOAD imports and the explicit delay_load_*
+// classes load through delay_load_library(), which only loads from the system
+// directory and records how long each load took.  The load times are added to
+// the startup profile when it's finished.
+HMODULE delay_load_library(const char* dll);
+void add_delay_loads_to_startup_profile();
@@ -0,0 +1,45 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include "str.h"
+
+#include <atomic>
+#include <initializer_list>
+#include <memory>
+#include <thread>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Watches a set of files for changes using ReadDirectoryChangesW on a
+// background thread, so that checking whether any of them changed only needs
+// to read a flag instead of querying the file system (which can be slow, e.g.
+// when the profile directory is redirected to a network share).
+//
+// When the files can't be watched (e.g. the file system doesn't support change
+// notifications), check_changed() always reports a change, so that callers
+// fall back to checking the files themselves.
+class file_watcher
+    : public no_copy
+{
+public:
+                        file_watcher() = default;
+                        ~file_watcher();
+    void                watch(std::initializer_list<const char*> files);
+    bool                check_changed();
+
+private:
+    struct dir_watch;
+    void                start();
+    void                stop();
+    void                proc();
+    bool                arm(dir_watch& watch);
+    bool                is_watched(const dir_watch& watch, const wchar_t* name, uint32 len) const;
+    str_moveable        m_files;            // Identifies the watched files, to detect when they change.
+    std::vector<std::unique_ptr<dir_watch>> m_dirs;
+    std::unique_ptr<std::thread> m_thread;
+    void*               m_stop_event = nullptr;
+    std::atomic<bool>   m_changed = { true };
+    std::atomic<bool>   m_failed = { false };
+};
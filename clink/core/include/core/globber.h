@@ -5,10 +5,25 @@
 
 #include "str.h"
 
+#include <memory>
+
+struct glob_snapshot;
+
 //------------------------------------------------------------------------------
 class globber
 {
 public:
+    // While in scope, globbers on the current thread never wait on network
+    // directories; they list them only from cached snapshots.
+    class nonblocking_scope
+    {
+    public:
+                        nonblocking_scope(bool nonblocking=true);
+                        ~nonblocking_scope();
+    private:
+        const bool      m_prev;
+    };
+
     struct extrainfo
     {
         int32               st_mode;
@@ -30,14 +45,20 @@ public:
     bool                older_than(int32 seconds);
     bool                next(str_base& out, bool rooted=true, extrainfo* extrainfo=nullptr);
     void                close();
+    static bool         is_nonblocking();
 
 private:
                         globber(const globber&) = delete;
     void                operator = (const globber&) = delete;
     void                next_file();
+    void                next_snapshot_file();
     WIN32_FIND_DATAW    m_data;
     HANDLE              m_handle;
     str<280>            m_root;
+    std::shared_ptr<const glob_snapshot> m_snapshot;   // Reading a cached snapshot.
+    std::shared_ptr<glob_snapshot> m_recording;         // Recording a new snapshot.
+    wstr<32>            m_prefix;
+    size_t              m_snapshot_index;
     bool                m_files;
     bool                m_directories;
     bool                m_dir_suffix;
@@ -0,0 +1,43 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include "str.h"
+
+#include <functional>
+#include <memory>
+#include <thread>
+
+//------------------------------------------------------------------------------
+// Runs a housekeeping task (e.g. deleting orphaned files) on a low priority
+// background thread, so that it never blocks input.  A named mutex ensures
+// only one session at a time runs a given task, and a shared timestamp rate
+// limits it across sessions:  the task is skipped if any session finished it
+// within the last INTERVAL seconds (while any of those sessions is still
+// running).
+//
+// The task should check the cancel flag periodically; destroying the
+// housekeeper sets the flag and waits for the task to return.
+class housekeeper
+    : public no_copy
+{
+public:
+    typedef std::function<void(const volatile bool& cancel)> task_func;
+
+                        housekeeper(const char* name, uint32 interval);
+                        ~housekeeper();
+    void                start(task_func&& task);
+    void                wait();
+
+private:
+    static void         proc(housekeeper* h);
+    void                run();
+    volatile uint64*    map_time(void*& mapping) const;
+    str_moveable        m_name;
+    const uint32        m_interval;
+    task_func           m_task;
+    std::unique_ptr<std::thread> m_thread;
+    void*               m_mapping = nullptr;    // Keeps the shared timestamp alive.
+    volatile bool       m_cancel = false;
+};
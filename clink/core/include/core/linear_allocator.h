@@ -3,11 +3,13 @@
 
 #pragma once
 
+#include "mem_stats.h"
+
 //------------------------------------------------------------------------------
 class linear_allocator
 {
 public:
-                            linear_allocator(uint32 size);
+                            linear_allocator(uint32 size, mem_tag tag=mem_tag::other);
                             linear_allocator(linear_allocator&& o) = delete;
                             ~linear_allocator();
     linear_allocator&       operator = (linear_allocator&& o);
@@ -18,10 +20,11 @@ public:
     template <class T> T*   calloc(uint32 count=1);
     bool                    fits(uint32) const;
     bool                    oversized(uint32) const;
+    static void             get_pool_stats(size_t& bytes, uint32& pages);
 #ifdef DEBUG
     uint32                  pagesize() const { return m_max; }
-    uint32                  footprint() const { return m_footprint; }
 #endif
+    uint32                  footprint() const { return m_footprint; }
 
     bool                    unittest_at_end(void* ptr, uint32 size) const;
     bool                    unittest_in_prev_page(void* ptr, uint32 size) const;
@@ -30,11 +33,16 @@ private:
     bool                    new_page();
     void                    free_chain(bool keep_one=false);
     char*                   m_ptr = nullptr;
+    char*                   m_oversized = nullptr;
     uint32                  m_used;
     uint32                  m_max;
-#ifdef DEBUG
     uint32                  m_footprint = 0;
-#endif
+    uint32                  m_pages = 0;        // Regular pages in the chain.
+    uint32                  m_blocks = 0;       // Regular and oversized pages.
+    mem_tag                 m_tag;
+
+    static const uint32     c_grow_after_pages = 4;
+    static const uint32     c_max_grown_page = 1024 * 1024;
 };
 
 //------------------------------------------------------------------------------
@@ -82,8 +90,8 @@ inline bool linear_allocator::unittest_at_end(void* ptr, uint32 size) const
 inline bool linear_allocator::unittest_in_prev_page(void* _ptr, uint32 size) const
 {
     char* ptr = (char*)_ptr;
-    char* prev_page = *reinterpret_cast<char**>(m_ptr);
     if (oversized(size))
-        return ptr == prev_page + sizeof(m_ptr);
+        return ptr == m_oversized + sizeof(m_ptr);
+    char* prev_page = *reinterpret_cast<char**>(m_ptr);
     return ptr >= prev_page + sizeof(m_ptr) && ptr + size <= prev_page + m_max;
 }
@@ -32,6 +32,8 @@ public:
     static bool     can_defer();
     static void     defer_info(const char* function, int32 line, const char* fmt, ...);
 
+    virtual void    flush() {}
+
 protected:
     virtual void    emit(const char* function, int32 line, const char* fmt, va_list args) = 0;
 
@@ -43,18 +45,27 @@ private:
 };
 
 //------------------------------------------------------------------------------
+// When async is true, formatted lines go into a lock-free ring and a background
+// thread appends them to the log file in batches, so logging doesn't slow down
+// the thread that logs.  Lines that don't fit in a ring record are written
+// synchronously after draining the ring, to preserve order.  ERR() flushes the
+// ring so errors are never left sitting in it.
 class file_logger
     : public logger
 {
 public:
-                    file_logger(const char* log_path);
+                    file_logger(const char* log_path, bool async=false);
                     ~file_logger();
     virtual void    emit(const char* function, int32 line, const char* fmt, va_list args) override;
+    virtual void    flush() override;
 
     static const char* get_path() { return s_this ? s_this->m_log_path.c_str() : nullptr; }
 
 private:
+    void            write_sync(const char* prefix, const char* fmt, va_list args);
+
     str<256>        m_log_path;
+    struct log_ring* m_ring = nullptr;
 
     static const file_logger* s_this;
 };
@@ -47,6 +47,31 @@ bool match_char_impl(int32 pc, int32 fc)
     return true;
 }
 
+//------------------------------------------------------------------------------
+// Advances FILE past ASCII characters that can't match the pattern character
+// C, stopping early at anything that needs match_char_impl() to decide.
+template <class T, int32 MODE>
+void skip_unmatchable_ascii(str_iter_impl<T>& file, int32 c, bool stop_at_separator)
+{
+    if (c <= 0 || c >= 0x80)
+        return;
+
+    char c1 = char(c);
+    char c2 = char(c);
+    if (MODE > 0 && c >= 'A' && c <= 'Z')
+        c2 = char(c + 'a' - 'A');
+    else if (MODE > 0 && c >= 'a' && c <= 'z')
+        c2 = char(c - 'a' + 'A');
+    else if (MODE > 1 && (c == '-' || c == '_'))
+        c1 = '-', c2 = '_';
+    else if (c == '/' || c == '\\')
+        c1 = '/', c2 = '\\';
+
+    const uint32 skip = str_scan_ascii_until(file.get_pointer(), file.max_units(), c1, c2, stop_at_separator);
+    if (skip)
+        file.skip_units(skip);
+}
+
 //------------------------------------------------------------------------------
 template <class T, int32 MODE, bool fuzzy_accents>
 bool match_wild_impl(const str_iter_impl<T>& _pattern, const str_iter_impl<T>& _file, bool dot_prefix=false, star_matches_everything match_everything=no)
@@ -113,11 +138,14 @@ back_track:
             {
                 // Iterate until file char matches pattern char after wildcard.
                 const T* push_scout = file.get_pointer();
+                skip_unmatchable_ascii<T,MODE>(file, c, match_everything != yes);
+                d = file.peek();
                 while (d &&
                        (match_everything == yes || !path::is_separator(d)) &&
                        !match_char_impl<T,MODE,fuzzy_accents>(d, c))
                 {
                     file.next();
+                    skip_unmatchable_ascii<T,MODE>(file, c, match_everything != yes);
                     d = file.peek();
                 }
                 if (!match_char_impl<T,MODE,fuzzy_accents>(d, c))
@@ -0,0 +1,45 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+class str_base;
+
+//------------------------------------------------------------------------------
+// Low-overhead memory accounting for release builds, to show which subsystem
+// holds memory in a long-lived session.  Heap allocations through operator new
+// are charged to the tag of the innermost mem_tag_scope on the current thread,
+// and linear_allocator pages are charged to the allocator's tag.
+//
+// Debug builds use the debug heap instead (see debugheap.h), so there only the
+// linear_allocator pages are counted.
+enum class mem_tag : uint8
+{
+    other,
+    editor,
+    matches,
+    history,
+    recognizer,
+    lua,
+    max
+};
+
+//------------------------------------------------------------------------------
+class mem_tag_scope
+{
+public:
+                    mem_tag_scope(mem_tag tag);
+                    ~mem_tag_scope();
+private:
+    mem_tag         m_prev;
+};
+
+//------------------------------------------------------------------------------
+namespace mem_stats
+{
+void                add(mem_tag tag, size_t bytes, uint32 blocks=1);
+void                sub(mem_tag tag, size_t bytes, uint32 blocks=1);
+mem_tag             get_current_tag();
+bool                counts_heap();
+void                format(str_base& out);
+};
@@ -69,6 +69,8 @@ struct cwd_restorer
 
 DWORD   get_file_attributes(const wchar_t* path, bool* symlink=nullptr);
 DWORD   get_file_attributes(const char* path, bool* symlink=nullptr);
+bool    is_unreachable_path(const wchar_t* path);
+void    note_path_failure(const wchar_t* path, DWORD error, DWORD elapsed);
 int32   get_path_type(const char* path);
 int32   get_drive_type(const char* path, uint32 len=-1);
 int32   get_file_size(const char* path);
@@ -85,8 +87,12 @@ FILE*   create_temp_file(str_base* out=nullptr, const char* prefix=nullptr, cons
 bool    expand_env(const char* in, uint32 in_len, str_base& out, int32* point=nullptr);
 bool    get_env(const char* name, str_base& out);
 bool    set_env(const char* name, const char* value);
+void    invalidate_env_cache();
+uint32  get_env_generation();
 bool    get_alias(const char* name, str_base& out);
 bool    set_alias(const char* name, const char* command);
+void    invalidate_alias_cache();
+uint32  get_alias_generation();
 bool    get_short_path_name(const char* path, str_base& out);
 bool    get_long_path_name(const char* path, str_base& out);
 bool    get_full_path_name(const char* path, str_base& out, uint32 len=-1);
@@ -121,7 +127,7 @@ void    set_shellname(const wchar_t* shell_name);
 const wchar_t* get_shellname();
 
 int32   system(const char* command, const char* cwd);
-HANDLE  spawn_internal(const char* command, const char* cwd, HANDLE hin, HANDLE hout);
+HANDLE  spawn_internal(const char* command, const char* cwd, HANDLE hin, HANDLE hout, HANDLE* suspended_thread=nullptr);
 
 HANDLE  dup_handle(HANDLE process_handle, HANDLE h, bool inherit=false);
 
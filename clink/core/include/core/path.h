@@ -45,6 +45,14 @@ bool        is_unc(const wchar_t* path, const wchar_t** past_unc=nullptr);
 bool        is_incomplete_unc(const char* path);
 bool        is_executable_extension(const char* in);
 
+// Variants that write into a fixed buffer supplied by the caller (e.g. a stack
+// array) and never allocate.  They return false and leave OUT empty if the
+// result doesn't fit.  OUT must not overlap the inputs.
+bool        join(const char* lhs, const char* rhs, char* out, uint32 out_size);
+bool        normalise(const char* in, char* out, uint32 out_size, int32 sep=0);
+template <uint32 N> bool join(const char* lhs, const char* rhs, char (&out)[N]) { return join(lhs, rhs, out, N); }
+template <uint32 N> bool normalise(const char* in, char (&out)[N], int32 sep=0) { return normalise(in, out, N, sep); }
+
 template<typename TYPE> static void skip_sep(const TYPE*& path)
 {
     while (path::is_separator(*path))
@@ -55,6 +55,7 @@ struct setting_name_value
 
 setting_iter        first();
 setting*            find(const char* name);
+uint32              get_registry_generation();
 bool                load(const char* file, const char* default_file=nullptr);
 bool                save(const char* file);
 
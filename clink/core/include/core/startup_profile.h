@@ -0,0 +1,46 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include "os.h"
+
+class str_base;
+
+//------------------------------------------------------------------------------
+// The startup profile records named phases of startup and how long each took,
+// in a small ring buffer.  The loader passes its phases to the DLL, and the DLL
+// finishes the profile and writes it to a file once the first prompt is ready,
+// so that `clink info --startup-profile` can print it.  Phases after finishing
+// are not recorded.
+struct startup_phase_info
+{
+    char            name[96];
+    uint8           depth;
+    float           elapsed;            // Milliseconds; negative while running.
+};
+
+//------------------------------------------------------------------------------
+// Times a phase for as long as it's in scope.  Phases begun while another phase
+// is in scope are nested under it.
+class startup_phase
+{
+public:
+                    startup_phase(const char* name, const char* detail=nullptr);
+                    ~startup_phase();
+private:
+    os::high_resolution_clock m_clock;
+    uint32          m_seq;
+};
+
+//------------------------------------------------------------------------------
+namespace startup_profile
+{
+void                add(const char* name, float elapsed, uint8 depth=0);
+uint32              count();
+const startup_phase_info* get(uint32 index);   // Oldest first.
+uint32              export_phases(startup_phase_info* out, uint32 max_count);
+void                format(str_base& out);
+bool                is_finished();
+bool                finish(const char* path);
+};
@@ -573,6 +573,10 @@ int32 to_utf16(class wstr_base& out, str_iter_impl<char>& iter);
 int32 to_utf16(wchar_t* out, int32 max_count, const char* utf8);
 int32 to_utf16(wchar_t* out, int32 max_count, str_iter_impl<char>& iter);
 
+// Return how many code units the converted string needs, excluding the nul.
+int32 utf8_length(const wchar_t* utf16, int32 len=-1);
+int32 utf16_length(const char* utf8, int32 len=-1);
+
 
 
 //------------------------------------------------------------------------------
@@ -735,6 +739,14 @@ private:
     void        reset_empty();
 };
 
+//------------------------------------------------------------------------------
+// Growable strings that store short strings inline and occupy 24 bytes, for
+// containers of mostly short strings:  str_moveable is smaller but always
+// allocates, and str<> is 128+ bytes.  Moving a short string copies it, so
+// pointers into one don't survive it being moved (e.g. by vector growth).
+typedef str<int32(24 - sizeof(str_base))> str_compact;
+typedef wstr<int32((24 - sizeof(wstr_base)) / sizeof(wchar_t))> wstr_compact;
+
 
 
 //------------------------------------------------------------------------------
@@ -40,6 +40,29 @@ private:
 //------------------------------------------------------------------------------
 int32 normalize_accent(int32 c);
 
+//------------------------------------------------------------------------------
+// Folds C the same way str_compare_impl() folds characters before comparing
+// them, so that two characters match exactly when their folded values are
+// equal.  Runs of path separators after a '/' must be skipped by the caller.
+int32 str_compare_fold(int32 c, int32 mode, bool fuzzy_accents, bool exact_slash);
+
+//------------------------------------------------------------------------------
+// Vectorized helpers for str_compare_impl() and match_wild_impl().  They only
+// handle ASCII, and stop at anything that needs the full comparison logic, so
+// callers continue with the scalar code from wherever these stop.  They return
+// 0 when SIMD isn't available.
+uint32 str_compare_ascii_prefix(const char* lhs, uint32 lhs_max, const char* rhs, uint32 rhs_max, int32 mode, bool exact_slash);
+uint32 str_scan_ascii_until(const char* s, uint32 max, char c1, char c2, bool stop_at_separator);
+
+//------------------------------------------------------------------------------
+inline uint32 str_compare_ascii_prefix(const wchar_t*, uint32, const wchar_t*, uint32, int32, bool) { return 0; }
+inline uint32 str_scan_ascii_until(const wchar_t*, uint32, char, char, bool) { return 0; }
+
+//------------------------------------------------------------------------------
+// Returns the number of leading bytes in S that are plain ASCII, i.e. 0x20
+// through 0x7f.  Unlike the helpers above, this also scans without SIMD.
+uint32 str_scan_plain_ascii(const char* s, uint32 max);
+
 //------------------------------------------------------------------------------
 // Returns how many characters match at the beginning of the strings.
 // If the entire strings match and compute_lcd is false, it returns -1.
@@ -48,6 +71,14 @@ int32 str_compare_impl(str_iter_impl<T>& lhs, str_iter_impl<T>& rhs)
 {
     const T* start = lhs.get_pointer();
 
+    // Skip the leading run of ASCII characters that match.
+    const uint32 ascii = str_compare_ascii_prefix(lhs.get_pointer(), lhs.max_units(), rhs.get_pointer(), rhs.max_units(), MODE, exact_slash);
+    if (ascii)
+    {
+        lhs.skip_units(ascii);
+        rhs.skip_units(ascii);
+    }
+
     while (1)
     {
         int32 c = lhs.peek();
@@ -29,3 +29,78 @@ inline uint32 wstr_hash(const wchar_t* in, int32 length=-1)
 {
     return str_hash_impl<wchar_t>(in, length);
 }
+
+
+
+//------------------------------------------------------------------------------
+// str_hash() values are stored in history index files and in shared memory,
+// so they must never change.  The functions below are faster and distribute
+// better, but are only for in-process hash tables; their values may change
+// between versions, so never persist them or share them between processes.
+//
+// They read 8 bytes at a time and fold ASCII case 8 bytes at a time, with an
+// FxHash-style multiply-rotate step and a Murmur3 finalizer so that the low
+// bits are well mixed (hash tables index by the low bits).
+
+//------------------------------------------------------------------------------
+inline uint64 fast_hash_fold_ascii(uint64 w)
+{
+    const uint64 c_high = 0x8080808080808080ull;
+    const uint64 heptets = w & ~c_high;
+    const uint64 ge_A = heptets + 0x3f3f3f3f3f3f3f3full;   // High bit set if >= 'A'.
+    const uint64 gt_Z = heptets + 0x2525252525252525ull;   // High bit set if > 'Z'.
+    const uint64 upper = (ge_A ^ gt_Z) & ~w & c_high;
+    return w | (upper >> 2);
+}
+
+//------------------------------------------------------------------------------
+inline uint32 fast_hash_impl(const void* data, size_t length, bool caseless)
+{
+    const uint64 c_mul = 0x517cc1b727220a95ull;
+    const char* in = static_cast<const char*>(data);
+    uint64 hash = uint64(length) * c_mul;
+
+    for (; length >= 8; in += 8, length -= 8)
+    {
+        uint64 w;
+        memcpy(&w, in, 8);
+        if (caseless)
+            w = fast_hash_fold_ascii(w);
+        hash = (((hash << 5) | (hash >> 59)) ^ w) * c_mul;
+    }
+
+    if (length)
+    {
+        uint64 w = 0;
+        memcpy(&w, in, length);
+        if (caseless)
+            w = fast_hash_fold_ascii(w);
+        hash = (((hash << 5) | (hash >> 59)) ^ w) * c_mul;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return uint32(hash);
+}
+
+//------------------------------------------------------------------------------
+inline uint32 str_fast_hash(const char* in, int32 length=-1)
+{
+    return fast_hash_impl(in, (length < 0) ? strlen(in) : length, false);
+}
+
+//------------------------------------------------------------------------------
+// Case insensitive for ASCII letters only, like stricmp() in the C locale.
+inline uint32 str_fast_ihash(const char* in, int32 length=-1)
+{
+    return fast_hash_impl(in, (length < 0) ? strlen(in) : length, true);
+}
+
+//------------------------------------------------------------------------------
+inline uint32 wstr_fast_hash(const wchar_t* in, int32 length=-1)
+{
+    return fast_hash_impl(in, ((length < 0) ? wcslen(in) : length) * sizeof(*in), false);
+}
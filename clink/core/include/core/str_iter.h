@@ -16,11 +16,13 @@ public:
     const T*        get_pointer() const;
     const T*        get_next_pointer();
     void            reset_pointer(const T* ptr);
+    void            skip_units(uint32 count);
     void            truncate(uint32 len);
     int32           peek();
     int32           next();
     bool            more() const;
     uint32          length() const;
+    uint32          max_units() const;
 
 private:
     const T*        m_ptr;
@@ -72,6 +74,15 @@ template <typename T> void str_iter_impl<T>::reset_pointer(const T* ptr)
     m_ptr = ptr;
 }
 
+//------------------------------------------------------------------------------
+// Advances past COUNT code units, which must not contain a nul and must not end
+// in the middle of an encoded character.
+template <typename T> void str_iter_impl<T>::skip_units(uint32 count)
+{
+    assert(count <= max_units());
+    m_ptr += count;
+}
+
 //------------------------------------------------------------------------------
 template <typename T> void str_iter_impl<T>::truncate(uint32 len)
 {
@@ -95,6 +106,15 @@ template <typename T> bool str_iter_impl<T>::more() const
     return (m_ptr != m_end && *m_ptr != '\0');
 }
 
+//------------------------------------------------------------------------------
+// Returns the number of code units before the end of the iterator, or UINT_MAX
+// if the iterator ends at a nul terminator.  Unlike length(), this doesn't need
+// to scan for the nul terminator.
+template <typename T> uint32 str_iter_impl<T>::max_units() const
+{
+    return (m_ptr <= m_end) ? uint32(m_end - m_ptr) : UINT_MAX;
+}
+
 
 
 //------------------------------------------------------------------------------
@@ -19,3 +19,18 @@ enum transform_mode : int32
 
 //------------------------------------------------------------------------------
 void str_transform(const wchar_t* in, uint32 len, wstr_base& out, transform_mode mode);
+
+//------------------------------------------------------------------------------
+// ASCII-only case folding, for keys and hashes that must not depend on the
+// user's locale.
+inline char ascii_tolower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? char(c + ('a' - 'A')) : c;
+}
+
+//------------------------------------------------------------------------------
+inline void str_ascii_tolower(char* p)
+{
+    for (; *p; ++p)
+        *p = ascii_tolower(*p);
+}
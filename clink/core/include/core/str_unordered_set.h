@@ -12,11 +12,20 @@ struct match_hasher
 {
     size_t operator()(const char* match) const
     {
-        return str_hash(match);
+        return str_fast_hash(match);
     }
     size_t operator()(const wchar_t* match) const
     {
-        return wstr_hash(match);
+        return wstr_fast_hash(match);
+    }
+};
+
+//------------------------------------------------------------------------------
+struct match_hasher_caseless
+{
+    size_t operator()(const char* match) const
+    {
+        return str_fast_ihash(match);
     }
 };
 
@@ -33,8 +42,18 @@ struct match_comparator
     }
 };
 
+//------------------------------------------------------------------------------
+struct match_comparator_caseless
+{
+    bool operator()(const char* m1, const char* m2) const
+    {
+        return stricmp(m1, m2) == 0;
+    }
+};
+
 //------------------------------------------------------------------------------
 typedef std::unordered_set<const char*, match_hasher, match_comparator> str_unordered_set;
 typedef std::unordered_set<const wchar_t*, match_hasher, match_comparator> wstr_unordered_set;
 template <typename ValTy> class str_unordered_map : public std::unordered_map<const char*, ValTy, match_hasher, match_comparator> {};
+template <typename ValTy> class str_unordered_map_caseless : public std::unordered_map<const char*, ValTy, match_hasher_caseless, match_comparator_caseless> {};
 template <typename ValTy> class wstr_unordered_map : public std::unordered_map<const wchar_t*, ValTy, match_hasher, match_comparator> {};
@@ -0,0 +1,17 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <vector>
+
+class str_base;
+
+//------------------------------------------------------------------------------
+// Minimal zip support, enough to expand Clink's release zip files without
+// launching another program.  Only stored and deflated entries are supported
+// (no encryption, no zip64, no multi-disk archives).  zip_inflate() fails if
+// the output would exceed max_out bytes.
+bool    zip_inflate(const uint8* in, size_t in_len, std::vector<uint8>& out, size_t max_out=size_t(-1));
+uint32  zip_crc32(const uint8* data, size_t len, uint32 crc=0);
+bool    unzip_file(const char* zip, const char* out_dir, str_base& error);
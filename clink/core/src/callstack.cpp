@@ -390,6 +390,31 @@ static DWORD_PTR load_module_symbols(function_access& fa, HANDLE process, void*
     return 0;
 }
 
+// Resolving a frame loads the module's symbols and searches them, which can
+// take milliseconds.  The same frames show up over and over (callers that
+// allocate repeatedly, or repeated clink.getcallstack calls), so resolved
+// frames are cached by address.  The cache is direct mapped and comes from the
+// process heap, since this runs inside the debug heap's allocation hooks.  It
+// must only be used while holding the dbghelp lock.
+struct symbol_cache_entry
+{
+    void*       frame;
+    symbol_info info;
+};
+
+static const size_t c_symbol_cache_size = 4096; // Must be a power of two.
+
+static symbol_cache_entry* find_symbol_cache_entry(void* frame)
+{
+    static symbol_cache_entry* s_cache = static_cast<symbol_cache_entry*>(HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, c_symbol_cache_size * sizeof(*s_cache)));
+    if (!s_cache || !frame)
+        return nullptr;
+
+    const size_t addr = size_t(frame);
+    const size_t slot = (addr ^ (addr >> 12)) & (c_symbol_cache_size - 1);
+    return &s_cache[slot];
+}
+
 static void get_symbol_info(void* frame, symbol_info& info)
 {
     memset(&info, 0, sizeof(info));
@@ -397,6 +422,13 @@ static void get_symbol_info(void* frame, symbol_info& info)
     dbghelp dh;
     if (function_access fa = dh.lock())
     {
+        symbol_cache_entry* const cached = find_symbol_cache_entry(frame);
+        if (cached && cached->frame == frame)
+        {
+            info = cached->info;
+            return;
+        }
+
         IMAGEHLP_MODULE mi;
         mi.SizeOfStruct = sizeof(mi);
 
@@ -453,6 +485,14 @@ static void get_symbol_info(void* frame, symbol_info& info)
         {
             info.offset = reinterpret_cast<size_t>(frame);
         }
+
+        // Don't cache failures; the module's symbols may load successfully
+        // on a later attempt.
+        if (cached && info.module[0])
+        {
+            cached->frame = frame;
+            cached->info = info;
+        }
     }
 }
 
@@ -0,0 +1,101 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "delay_load.h"
+#include "os.h"
+#include "startup_profile.h"
+#include "str.h"
+#include "log.h"
+
+#ifdef _MSC_VER
+#include <delayimp.h>
+#endif
+
+//------------------------------------------------------------------------------
+struct delay_load_info
+{
+    char            dll[24];
+    float           elapsed;            // Milliseconds.
+};
+
+static const uint32 c_max_delay_loads = 16;
+static delay_load_info s_loads[c_max_delay_loads];
+static uint32 s_num_loads = 0;
+static SRWLOCK s_lock = SRWLOCK_INIT;
+
+//------------------------------------------------------------------------------
+HMODULE delay_load_library(const char* dll)
+{
+    wstr<32> wdll(dll);
+
+    // Only actual loads are recorded, but a module that's already loaded is
+    // still loaded again so that it holds a reference.
+    const bool already_loaded = !!GetModuleHandleW(wdll.c_str());
+
+    os::high_resolution_clock clock;
+    HMODULE hlib = LoadLibraryExW(wdll.c_str(), nullptr, LOAD_LIBRARY_SEARCH_SYSTEM32);
+    if (!hlib && GetLastError() == ERROR_INVALID_PARAMETER)
+    {
+        // LOAD_LIBRARY_SEARCH_SYSTEM32 requires Windows 8, or Windows 7 with
+        // KB2533623.
+        hlib = LoadLibraryW(wdll.c_str());
+    }
+    const float elapsed = float(clock.elapsed() * 1000);
+
+    if (!hlib)
+    {
+        ERR("unable to load '%s'", dll);
+        return nullptr;
+    }
+
+    if (already_loaded)
+        return hlib;
+
+    LOG("Delay loaded '%s' in %.2f ms", dll, elapsed);
+
+    AcquireSRWLockExclusive(&s_lock);
+    if (s_num_loads < c_max_delay_loads)
+    {
+        delay_load_info& info = s_loads[s_num_loads++];
+        str_base name(info.dll, sizeof_array(info.dll));
+        name = dll;
+        info.elapsed = elapsed;
+    }
+    ReleaseSRWLockExclusive(&s_lock);
+
+    return hlib;
+}
+
+//------------------------------------------------------------------------------
+void add_delay_loads_to_startup_profile()
+{
+    AcquireSRWLockShared(&s_lock);
+    if (s_num_loads)
+    {
+        float total = 0;
+        for (uint32 i = 0; i < s_num_loads; ++i)
+            total += s_loads[i].elapsed;
+
+        startup_profile::add("delay loaded dlls", total);
+        for (uint32 i = 0; i < s_num_loads; ++i)
+            startup_profile::add(s_loads[i].dll, s_loads[i].elapsed, 1);
+    }
+    ReleaseSRWLockShared(&s_lock);
+}
+
+
+
+#ifdef _MSC_VER
+//------------------------------------------------------------------------------
+// Routes the linker's /DELAYLOAD imports through delay_load_library(), so
+// they're loaded the same way and their load times are recorded too.
+static FARPROC WINAPI delay_load_notify(unsigned notify, PDelayLoadInfo info)
+{
+    if (notify == dliNotePreLoadLibrary && info && info->szDll)
+        return FARPROC(delay_load_library(info->szDll));
+    return nullptr;
+}
+
+extern "C" const PfnDliHook __pfnDliNotifyHook2 = delay_load_notify;
+#endif
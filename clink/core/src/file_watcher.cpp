@@ -0,0 +1,231 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "file_watcher.h"
+#include "debugheap.h"
+#include "path.h"
+#include "log.h"
+
+//------------------------------------------------------------------------------
+struct file_watcher::dir_watch
+{
+    wstr_moveable       dir;
+    std::vector<wstr_moveable> names;   // Names of the watched files in dir.
+    HANDLE              handle = INVALID_HANDLE_VALUE;
+    OVERLAPPED          overlapped = {};
+    DWORD               buffer[1024];   // DWORD aligned, as required.
+};
+
+
+
+//------------------------------------------------------------------------------
+file_watcher::~file_watcher()
+{
+    stop();
+}
+
+//------------------------------------------------------------------------------
+// Watches FILES, replacing any previously watched files.  Watching the same
+// files again keeps the existing watch (and its pending changes).
+void file_watcher::watch(std::initializer_list<const char*> files)
+{
+    str<> key;
+    for (const char* file : files)
+    {
+        if (file && *file)
+            key << file << "|";
+    }
+
+    if (!key.empty() && key.equals(m_files.c_str()))
+        return;
+
+    stop();
+    m_files = key.c_str();
+    m_changed = true;
+    m_failed = false;
+
+    dbg_ignore_scope(snapshot, "File watcher");
+
+    str<280> dir;
+    str<280> name;
+    for (const char* file : files)
+    {
+        if (!file || !*file || !path::get_directory(file, dir) || !path::get_name(file, name))
+            continue;
+
+        wstr<280> wdir(dir.c_str());
+        dir_watch* watch = nullptr;
+        for (auto& d : m_dirs)
+        {
+            if (d->dir.iequals(wdir.c_str()))
+            {
+                watch = d.get();
+                break;
+            }
+        }
+
+        if (!watch)
+        {
+            m_dirs.emplace_back(std::make_unique<dir_watch>());
+            watch = m_dirs.back().get();
+            watch->dir = wdir.c_str();
+        }
+
+        wstr<280> wname(name.c_str());
+        watch->names.emplace_back(wname.c_str());
+    }
+
+    start();
+}
+
+//------------------------------------------------------------------------------
+// Returns true if any of the watched files changed since the last call (or if
+// they can't be watched), and clears the changed flag.
+bool file_watcher::check_changed()
+{
+    return m_changed.exchange(false) || m_failed || !m_thread;
+}
+
+//------------------------------------------------------------------------------
+void file_watcher::start()
+{
+    if (m_dirs.empty())
+        return;
+
+    for (auto& d : m_dirs)
+    {
+        d->handle = CreateFileW(d->dir.c_str(), FILE_LIST_DIRECTORY,
+                                FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, nullptr,
+                                OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS|FILE_FLAG_OVERLAPPED, nullptr);
+        d->overlapped.hEvent = CreateEventW(nullptr, true, false, nullptr);
+        if (d->handle == INVALID_HANDLE_VALUE || !d->overlapped.hEvent || !arm(*d))
+        {
+            LOG("unable to watch directory '%ls'; error %u", d->dir.c_str(), GetLastError());
+            m_failed = true;
+        }
+    }
+
+    // Up to MAXIMUM_WAIT_OBJECTS - 1 directories can be watched, since the
+    // stop event uses one wait slot.
+    if (m_failed || m_dirs.size() >= MAXIMUM_WAIT_OBJECTS)
+    {
+        m_failed = true;
+        stop();
+        return;
+    }
+
+    m_stop_event = CreateEventW(nullptr, true, false, nullptr);
+    if (!m_stop_event)
+    {
+        m_failed = true;
+        stop();
+        return;
+    }
+
+    m_thread = std::make_unique<std::thread>(&file_watcher::proc, this);
+}
+
+//------------------------------------------------------------------------------
+void file_watcher::stop()
+{
+    if (m_thread)
+    {
+        SetEvent(m_stop_event);
+        m_thread->join();
+        m_thread.reset();
+    }
+
+    if (m_stop_event)
+    {
+        CloseHandle(m_stop_event);
+        m_stop_event = nullptr;
+    }
+
+    for (auto& d : m_dirs)
+    {
+        if (d->handle != INVALID_HANDLE_VALUE)
+        {
+            // Cancel the pending read and wait for it, since it writes into
+            // the buffer that's about to be freed.
+            DWORD bytes;
+            if (CancelIoEx(d->handle, &d->overlapped) || GetLastError() != ERROR_NOT_FOUND)
+                GetOverlappedResult(d->handle, &d->overlapped, &bytes, true);
+            CloseHandle(d->handle);
+        }
+        if (d->overlapped.hEvent)
+            CloseHandle(d->overlapped.hEvent);
+    }
+    m_dirs.clear();
+}
+
+//------------------------------------------------------------------------------
+void file_watcher::proc()
+{
+    HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+    DWORD count = 0;
+    handles[count++] = m_stop_event;
+    for (auto& d : m_dirs)
+        handles[count++] = d->overlapped.hEvent;
+
+    while (true)
+    {
+        const DWORD waited = WaitForMultipleObjects(count, handles, false, INFINITE);
+        if (waited <= WAIT_OBJECT_0 || waited >= WAIT_OBJECT_0 + count)
+            break;
+
+        dir_watch& d = *m_dirs[waited - WAIT_OBJECT_0 - 1];
+
+        DWORD bytes;
+        if (!GetOverlappedResult(d.handle, &d.overlapped, &bytes, false))
+        {
+            m_failed = true;
+            break;
+        }
+
+        // Zero bytes means the notification buffer overflowed, so any file
+        // may have changed.
+        bool changed = !bytes;
+        for (const BYTE* p = reinterpret_cast<const BYTE*>(d.buffer); bytes && !changed;)
+        {
+            const auto* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(p);
+            changed = is_watched(d, info->FileName, info->FileNameLength / sizeof(WCHAR));
+            if (!info->NextEntryOffset)
+                break;
+            p += info->NextEntryOffset;
+        }
+
+        if (changed)
+            m_changed = true;
+
+        if (!arm(d))
+        {
+            m_failed = true;
+            break;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+bool file_watcher::arm(dir_watch& watch)
+{
+    ResetEvent(watch.overlapped.hEvent);
+
+    const DWORD filter = (FILE_NOTIFY_CHANGE_FILE_NAME|
+                          FILE_NOTIFY_CHANGE_SIZE|
+                          FILE_NOTIFY_CHANGE_LAST_WRITE|
+                          FILE_NOTIFY_CHANGE_CREATION);
+    return !!ReadDirectoryChangesW(watch.handle, watch.buffer, sizeof(watch.buffer), false,
+                                   filter, nullptr, &watch.overlapped, nullptr);
+}
+
+//------------------------------------------------------------------------------
+bool file_watcher::is_watched(const dir_watch& watch, const wchar_t* name, uint32 len) const
+{
+    for (const auto& n : watch.names)
+    {
+        if (n.length() == len && _wcsnicmp(n.c_str(), name, len) == 0)
+            return true;
+    }
+    return false;
+}
@@ -3,12 +3,335 @@
 
 #include "pch.h"
 #include "globber.h"
+#include "debugheap.h"
 #include "os.h"
 #include "path.h"
 #include "str.h"
+#include "str_iter.h"
 
 #include <sys/stat.h>
 
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//------------------------------------------------------------------------------
+struct glob_snapshot
+{
+    struct entry
+    {
+        std::wstring        name;
+        DWORD               attr;
+        DWORD               reserved0;
+        DWORD               size_high;
+        DWORD               size_low;
+        FILETIME            created;
+        FILETIME            accessed;
+        FILETIME            modified;
+    };
+
+    str_moveable            dir;
+    FILETIME                stamp;
+    ULONGLONG               taken;
+    bool                    remote;
+    std::vector<entry>      entries;
+};
+
+
+
+//------------------------------------------------------------------------------
+static bool is_remote_dir(const char* dir)
+{
+    str<280> full;
+    if (!os::get_full_path_name(*dir ? dir : ".", full))
+        return false;
+    if (path::is_unc(full.c_str()))
+        return true;
+
+    path::get_drive(full);
+    path::append(full, "");
+    return os::get_drive_type(full.c_str()) == os::drive_type_remote;
+}
+
+
+
+//------------------------------------------------------------------------------
+// Remembers the full listings of recently enumerated directories, so that
+// globbing the same directory again (repeated completions, argmatchers that
+// glob, os.globfiles() and os.globdirs() from scripts, etc) doesn't have to
+// enumerate it again.
+//
+// A snapshot is valid while the directory's last write time is unchanged,
+// which covers creating, deleting, and renaming entries.  It doesn't cover
+// changes to the size or times of existing files, and some file systems don't
+// update the time at all, so snapshots also expire after a few seconds.
+//
+// Snapshots of network directories are kept longer, so that non-blocking
+// globbers can serve them (stale or not) while a background thread refreshes
+// them.
+//
+// Globbers can run on worker threads, so the cache is guarded by a mutex.
+class glob_snapshot_cache
+{
+public:
+    std::shared_ptr<const glob_snapshot> find(const char* dir);
+    std::shared_ptr<const glob_snapshot> find_stale(const char* dir, bool& fresh);
+    std::shared_ptr<glob_snapshot> begin(const char* dir);
+    void                    store(std::shared_ptr<glob_snapshot>&& snapshot);
+    void                    refresh(const char* dir);
+
+private:
+    static bool             get_key(const char* dir, str_base& out);
+    static bool             get_stamp(const char* dir, FILETIME& out);
+    std::mutex              m_mutex;
+    std::vector<std::shared_ptr<const glob_snapshot>> m_snapshots; // Most recent first.
+    std::vector<str_moveable> m_refreshing;
+
+    static const size_t     c_max_snapshots = 8;
+    static const size_t     c_max_refreshes = 2;
+    static const ULONGLONG  c_max_age = 10 * 1000;
+    static const ULONGLONG  c_max_stale_age = 5 * 60 * 1000;
+};
+
+//------------------------------------------------------------------------------
+static glob_snapshot_cache s_snapshot_cache;
+static thread_local bool s_nonblocking = false;
+
+//------------------------------------------------------------------------------
+std::shared_ptr<const glob_snapshot> glob_snapshot_cache::find(const char* dir)
+{
+    str<280> key;
+    if (!get_key(dir, key))
+        return nullptr;
+
+    std::shared_ptr<const glob_snapshot> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto iter = m_snapshots.begin(); iter != m_snapshots.end(); ++iter)
+        {
+            if ((*iter)->dir.iequals(key.c_str()))
+            {
+                snapshot = *iter;
+                const ULONGLONG age = GetTickCount64() - snapshot->taken;
+                if (age > c_max_age)
+                {
+                    if (!snapshot->remote || age > c_max_stale_age)
+                        m_snapshots.erase(iter);
+                    return nullptr;
+                }
+                break;
+            }
+        }
+    }
+
+    if (!snapshot)
+        return nullptr;
+
+    FILETIME stamp;
+    if (!get_stamp(key.c_str(), stamp) || CompareFileTime(&stamp, &snapshot->stamp) != 0)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto iter = m_snapshots.begin(); iter != m_snapshots.end(); ++iter)
+        {
+            if (*iter == snapshot)
+            {
+                m_snapshots.erase(iter);
+                break;
+            }
+        }
+        return nullptr;
+    }
+
+    return snapshot;
+}
+
+//------------------------------------------------------------------------------
+// Returns the snapshot for DIR without checking the directory's time, since
+// that can block on a network directory.  FRESH is set to false if the
+// snapshot is missing or old enough that it should be refreshed.
+std::shared_ptr<const glob_snapshot> glob_snapshot_cache::find_stale(const char* dir, bool& fresh)
+{
+    fresh = false;
+
+    str<280> key;
+    if (!get_key(dir, key))
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto iter = m_snapshots.begin(); iter != m_snapshots.end(); ++iter)
+    {
+        if ((*iter)->dir.iequals(key.c_str()))
+        {
+            const ULONGLONG age = GetTickCount64() - (*iter)->taken;
+            if (age > c_max_stale_age)
+            {
+                m_snapshots.erase(iter);
+                return nullptr;
+            }
+            fresh = (age <= c_max_age);
+            return *iter;
+        }
+    }
+
+    return nullptr;
+}
+
+//------------------------------------------------------------------------------
+// Returns a new empty snapshot for DIR, to be filled in while enumerating it.
+// The directory's time is read before enumerating, so that changes made while
+// enumerating invalidate the snapshot.
+std::shared_ptr<glob_snapshot> glob_snapshot_cache::begin(const char* dir)
+{
+    str<280> key;
+    FILETIME stamp;
+    if (!get_key(dir, key) || !get_stamp(key.c_str(), stamp))
+        return nullptr;
+
+    std::shared_ptr<glob_snapshot> snapshot = std::make_shared<glob_snapshot>();
+    snapshot->dir = key.c_str();
+    snapshot->stamp = stamp;
+    snapshot->taken = GetTickCount64();
+    snapshot->remote = is_remote_dir(key.c_str());
+    return snapshot;
+}
+
+//------------------------------------------------------------------------------
+void glob_snapshot_cache::store(std::shared_ptr<glob_snapshot>&& snapshot)
+{
+    snapshot->entries.shrink_to_fit();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto iter = m_snapshots.begin(); iter != m_snapshots.end(); ++iter)
+    {
+        if ((*iter)->dir.iequals(snapshot->dir.c_str()))
+        {
+            m_snapshots.erase(iter);
+            break;
+        }
+    }
+
+    if (m_snapshots.size() >= c_max_snapshots)
+        m_snapshots.pop_back();
+
+    m_snapshots.insert(m_snapshots.begin(), std::move(snapshot));
+}
+
+//------------------------------------------------------------------------------
+// Enumerates DIR on a background thread, which records a new snapshot of it.
+// Only a couple of refreshes run at once, so that an unresponsive server
+// can't accumulate threads.
+void glob_snapshot_cache::refresh(const char* dir)
+{
+    str_moveable key;
+    if (!get_key(dir, key))
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_refreshing.size() >= c_max_refreshes)
+            return;
+        for (const auto& r : m_refreshing)
+        {
+            if (r.iequals(key.c_str()))
+                return;
+        }
+        m_refreshing.emplace_back(key.c_str());
+    }
+
+    str_moveable pattern(key.c_str());
+    path::append(pattern, "*");
+
+    dbg_ignore_scope(snapshot, "Glob snapshot refresh");
+
+    std::thread([this, key=std::move(key), pattern=std::move(pattern)]()
+    {
+        {
+            globber globber(pattern.c_str());
+            str<280> file;
+            while (globber.next(file, false))
+            {
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto iter = m_refreshing.begin(); iter != m_refreshing.end(); ++iter)
+        {
+            if (iter->iequals(key.c_str()))
+            {
+                m_refreshing.erase(iter);
+                break;
+            }
+        }
+    }).detach();
+}
+
+//------------------------------------------------------------------------------
+bool glob_snapshot_cache::get_key(const char* dir, str_base& out)
+{
+    return os::get_full_path_name(*dir ? dir : ".", out);
+}
+
+//------------------------------------------------------------------------------
+bool glob_snapshot_cache::get_stamp(const char* dir, FILETIME& out)
+{
+    wstr<280> wdir(dir);
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(wdir.c_str(), GetFileExInfoStandard, &data) ||
+        !(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        return false;
+
+    out = data.ftLastWriteTime;
+    return true;
+}
+
+
+
+//------------------------------------------------------------------------------
+// Snapshots can answer patterns whose name part is a plain prefix followed by
+// `*`.  Anything else (other wildcards, short names, the `.` and `..`
+// patterns, and Windows' special handling of trailing dots) is left to
+// FindFirstFileW.
+static bool get_snapshot_prefix(const char* name, wstr_base& out)
+{
+    if (!name)
+        return false;
+
+    const size_t len = strlen(name);
+    if (!len || name[len - 1] != '*')
+        return false;
+
+    for (const char* p = name; p < name + len - 1; ++p)
+        if (strchr("*?<>\"~", *p))
+            return false;
+
+    if (len > 1 && name[len - 2] == '.')
+        return false;
+
+    str_iter iter(name, int32(len - 1));
+    out.clear();
+    to_utf16(out, iter);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+static void record_entry(glob_snapshot& snapshot, const WIN32_FIND_DATAW& data)
+{
+    glob_snapshot::entry e;
+    e.name = data.cFileName;
+    e.attr = data.dwFileAttributes;
+    e.reserved0 = data.dwReserved0;
+    e.size_high = data.nFileSizeHigh;
+    e.size_low = data.nFileSizeLow;
+    e.created = data.ftCreationTime;
+    e.accessed = data.ftLastAccessTime;
+    e.modified = data.ftLastWriteTime;
+    snapshot.entries.emplace_back(std::move(e));
+}
+
+
+
 //------------------------------------------------------------------------------
 globber::globber(const char* pattern)
 : m_files(true)
@@ -62,13 +385,67 @@ globber::globber(const char* pattern)
         }
     }
 
+    path::get_directory(pattern, m_root);
+    path::normalise_separators(m_root.data());
+
+    m_handle = nullptr;
+    m_snapshot_index = 0;
+
+    // In non-blocking mode a network directory is only listed from its
+    // snapshot, even a stale one, and a missing or stale snapshot is
+    // refreshed in the background for next time.
+    if (s_nonblocking && is_remote_dir(m_root.c_str()))
+    {
+        bool fresh = false;
+        if (get_snapshot_prefix(path::get_name(pattern), m_prefix))
+            m_snapshot = s_snapshot_cache.find_stale(m_root.c_str(), fresh);
+        if (!fresh)
+            s_snapshot_cache.refresh(m_root.c_str());
+        if (m_snapshot)
+            next_snapshot_file();
+        return;
+    }
+
+    // Use a snapshot of the directory if there is one, otherwise record one
+    // while listing the whole directory.
+    if (get_snapshot_prefix(path::get_name(pattern), m_prefix))
+    {
+        m_snapshot = s_snapshot_cache.find(m_root.c_str());
+        if (m_snapshot)
+        {
+            next_snapshot_file();
+            return;
+        }
+
+        if (m_prefix.empty())
+            m_recording = s_snapshot_cache.begin(m_root.c_str());
+    }
+
+    // Short names are never used, so skip asking for them.  On network drives
+    // ask for entries in large batches, since each FindNextFileW otherwise
+    // tends to be a round trip to the server.
+    const DWORD find_flags = is_remote_dir(m_root.c_str()) ? FIND_FIRST_EX_LARGE_FETCH : 0;
+
+    // Don't wait on a volume that recently timed out.
     wstr<280> wglob(pattern);
-    m_handle = FindFirstFileW(wglob.c_str(), &m_data);
+    if (os::is_unreachable_path(wglob.c_str()))
+    {
+        m_recording.reset();
+        return;
+    }
+
+    const DWORD tick = GetTickCount();
+    m_handle = FindFirstFileExW(wglob.c_str(), FindExInfoBasic, &m_data, FindExSearchNameMatch, nullptr, find_flags);
     if (m_handle == INVALID_HANDLE_VALUE)
+    {
+        os::note_path_failure(wglob.c_str(), GetLastError(), GetTickCount() - tick);
         m_handle = nullptr;
-
-    path::get_directory(pattern, m_root);
-    path::normalise_separators(m_root.data());
+        m_recording.reset();
+    }
+    else if (m_recording)
+    {
+        record_entry(*m_recording, m_data);
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -77,6 +454,25 @@ globber::~globber()
     close();
 }
 
+//------------------------------------------------------------------------------
+bool globber::is_nonblocking()
+{
+    return s_nonblocking;
+}
+
+//------------------------------------------------------------------------------
+globber::nonblocking_scope::nonblocking_scope(bool nonblocking)
+: m_prev(s_nonblocking)
+{
+    s_nonblocking = m_prev || nonblocking;
+}
+
+//------------------------------------------------------------------------------
+globber::nonblocking_scope::~nonblocking_scope()
+{
+    s_nonblocking = m_prev;
+}
+
 //------------------------------------------------------------------------------
 bool globber::older_than(int32 seconds)
 {
@@ -106,7 +502,7 @@ bool globber::next(str_base& out, bool rooted, extrainfo* extrainfo)
 {
     while (true)
     {
-        if (m_handle == nullptr)
+        if (m_handle == nullptr && !m_snapshot)
             return false;
 
         bool again = false;
@@ -129,12 +525,22 @@ bool globber::next(str_base& out, bool rooted, extrainfo* extrainfo)
         next_file();
     }
 
-    out.clear();
-    if (rooted)
-        out << m_root;
-
     str<280> file_name(m_data.cFileName);
-    path::append(out, file_name.c_str());
+
+    // Join in a stack buffer, so OUT is sized once instead of growing for the
+    // root and again for the name.
+    char joined[280];
+    if (rooted && path::join(m_root.c_str(), file_name.c_str(), joined))
+    {
+        out = joined;
+    }
+    else
+    {
+        out.clear();
+        if (rooted)
+            out << m_root;
+        path::append(out, file_name.c_str());
+    }
 
     const uint32 attr = m_data.dwFileAttributes;
     if ((attr & FILE_ATTRIBUTE_DIRECTORY) && m_dir_suffix)
@@ -177,11 +583,61 @@ void globber::close()
         FindClose(m_handle);
         m_handle = nullptr;
     }
+
+    m_snapshot.reset();
+    m_recording.reset();
 }
 
 //------------------------------------------------------------------------------
 void globber::next_file()
 {
-    if (m_handle && !FindNextFileW(m_handle, &m_data))
+    if (m_snapshot)
+    {
+        next_snapshot_file();
+        return;
+    }
+
+    if (!m_handle)
+        return;
+
+    if (!FindNextFileW(m_handle, &m_data))
+    {
+        // Only a complete listing is worth keeping.
+        if (m_recording && GetLastError() == ERROR_NO_MORE_FILES)
+            s_snapshot_cache.store(std::move(m_recording));
         close();
+    }
+    else if (m_recording)
+    {
+        record_entry(*m_recording, m_data);
+    }
+}
+
+//------------------------------------------------------------------------------
+void globber::next_snapshot_file()
+{
+    const uint32 prefix_len = m_prefix.length();
+    while (m_snapshot_index < m_snapshot->entries.size())
+    {
+        const auto& e = m_snapshot->entries[m_snapshot_index++];
+        if (prefix_len)
+        {
+            if (e.name.length() < prefix_len ||
+                CompareStringOrdinal(e.name.c_str(), int32(prefix_len), m_prefix.c_str(), int32(prefix_len), TRUE) != CSTR_EQUAL)
+                continue;
+        }
+
+        wcsncpy_s(m_data.cFileName, e.name.c_str(), _TRUNCATE);
+        m_data.cAlternateFileName[0] = '\0';
+        m_data.dwFileAttributes = e.attr;
+        m_data.dwReserved0 = e.reserved0;
+        m_data.nFileSizeHigh = e.size_high;
+        m_data.nFileSizeLow = e.size_low;
+        m_data.ftCreationTime = e.created;
+        m_data.ftLastAccessTime = e.accessed;
+        m_data.ftLastWriteTime = e.modified;
+        return;
+    }
+
+    m_snapshot.reset();
 }
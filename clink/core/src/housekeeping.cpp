@@ -0,0 +1,120 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "housekeeping.h"
+#include "debugheap.h"
+#include "log.h"
+
+//------------------------------------------------------------------------------
+static uint64 get_now_seconds()
+{
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    return ((uint64(ft.dwHighDateTime) << 32) | ft.dwLowDateTime) / 10000000;
+}
+
+
+
+//------------------------------------------------------------------------------
+housekeeper::housekeeper(const char* name, uint32 interval)
+: m_name(name)
+, m_interval(interval)
+{
+}
+
+//------------------------------------------------------------------------------
+housekeeper::~housekeeper()
+{
+    m_cancel = true;
+    wait();
+
+    if (m_mapping)
+        CloseHandle(m_mapping);
+}
+
+//------------------------------------------------------------------------------
+void housekeeper::start(task_func&& task)
+{
+    if (m_thread)
+        return;
+
+    m_task = std::move(task);
+
+    dbg_ignore_scope(snapshot, "Housekeeping thread");
+    m_thread = std::make_unique<std::thread>(&proc, this);
+}
+
+//------------------------------------------------------------------------------
+void housekeeper::wait()
+{
+    if (m_thread)
+    {
+        m_thread->join();
+        m_thread.reset();
+    }
+}
+
+//------------------------------------------------------------------------------
+void housekeeper::proc(housekeeper* h)
+{
+    // Background mode lowers the I/O priority as well as the CPU priority.
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+    h->run();
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+}
+
+//------------------------------------------------------------------------------
+void housekeeper::run()
+{
+    // Only one session at a time runs the task; others skip it rather than
+    // waiting, since the running one does the work for everyone.
+    wstr<64> name;
+    name.format(L"Local\\clink_housekeeping_%S", m_name.c_str());
+    HANDLE mutex = CreateMutexW(nullptr, false, name.c_str());
+    if (!mutex)
+        return;
+
+    const DWORD wait = WaitForSingleObject(mutex, 0);
+    if (wait == WAIT_OBJECT_0 || wait == WAIT_ABANDONED)
+    {
+        void* mapping;
+        volatile uint64* last = map_time(mapping);
+        if (!last || get_now_seconds() >= *last + m_interval)
+        {
+            LOG("Housekeeping:  %s", m_name.c_str());
+            m_task(m_cancel);
+            if (last && !m_cancel)
+                *last = get_now_seconds();
+        }
+
+        if (last)
+        {
+            UnmapViewOfFile(const_cast<uint64*>(last));
+            m_mapping = mapping;
+        }
+        ReleaseMutex(mutex);
+    }
+
+    CloseHandle(mutex);
+}
+
+//------------------------------------------------------------------------------
+// The time when the task was last finished is kept in a shared section, which
+// lives as long as any session has it open.
+volatile uint64* housekeeper::map_time(void*& mapping) const
+{
+    wstr<64> name;
+    name.format(L"Local\\clink_housekeeping_%S_time", m_name.c_str());
+    mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(uint64), name.c_str());
+    if (!mapping)
+        return nullptr;
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, sizeof(uint64));
+    if (!view)
+    {
+        CloseHandle(mapping);
+        mapping = nullptr;
+    }
+    return static_cast<volatile uint64*>(view);
+}
@@ -9,9 +9,106 @@
 #include <assert.h>
 
 //------------------------------------------------------------------------------
-linear_allocator::linear_allocator(uint32 size)
+// Process-wide pool of free pages.  Allocators that are reset or cleared on
+// every completion would otherwise return their pages to the heap only to
+// allocate them again moments later.  Only power of two page sizes from 1 KB
+// to 1 MB are pooled, each in its own size class, and the pool holds at most
+// c_max_pooled bytes in total.
+class page_pool
+{
+public:
+    static char*        take(uint32 size);
+    static bool         give(char* page, uint32 size);
+    static void         get_stats(size_t& bytes, uint32& pages);
+
+private:
+    static int32        size_class(uint32 size);
+
+    static const uint32 c_min_shift = 10;
+    static const uint32 c_max_shift = 20;
+    static const size_t c_max_pooled = 4 * 1024 * 1024;
+
+    static SRWLOCK      s_lock;
+    static char*        s_free[c_max_shift - c_min_shift + 1];
+    static size_t       s_bytes;
+    static uint32       s_pages;
+};
+
+SRWLOCK page_pool::s_lock = SRWLOCK_INIT;
+char* page_pool::s_free[c_max_shift - c_min_shift + 1] = {};
+size_t page_pool::s_bytes = 0;
+uint32 page_pool::s_pages = 0;
+
+//------------------------------------------------------------------------------
+int32 page_pool::size_class(uint32 size)
+{
+    if (size & (size - 1))
+        return -1;
+    for (uint32 shift = c_min_shift; shift <= c_max_shift; ++shift)
+        if (size == (1u << shift))
+            return shift - c_min_shift;
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+char* page_pool::take(uint32 size)
+{
+    const int32 index = size_class(size);
+    if (index >= 0)
+    {
+        AcquireSRWLockExclusive(&s_lock);
+        char* page = s_free[index];
+        if (page)
+        {
+            s_free[index] = *reinterpret_cast<char**>(page);
+            s_bytes -= size;
+            --s_pages;
+        }
+        ReleaseSRWLockExclusive(&s_lock);
+        if (page)
+            return page;
+    }
+
+    return (char*)malloc(size);
+}
+
+//------------------------------------------------------------------------------
+bool page_pool::give(char* page, uint32 size)
+{
+    const int32 index = size_class(size);
+    if (index < 0)
+        return false;
+
+    bool pooled = false;
+    AcquireSRWLockExclusive(&s_lock);
+    if (s_bytes + size <= c_max_pooled)
+    {
+        *reinterpret_cast<char**>(page) = s_free[index];
+        s_free[index] = page;
+        s_bytes += size;
+        ++s_pages;
+        pooled = true;
+    }
+    ReleaseSRWLockExclusive(&s_lock);
+    return pooled;
+}
+
+//------------------------------------------------------------------------------
+void page_pool::get_stats(size_t& bytes, uint32& pages)
+{
+    AcquireSRWLockShared(&s_lock);
+    bytes = s_bytes;
+    pages = s_pages;
+    ReleaseSRWLockShared(&s_lock);
+}
+
+
+
+//------------------------------------------------------------------------------
+linear_allocator::linear_allocator(uint32 size, mem_tag tag)
 : m_used(size)
 , m_max(size)
+, m_tag(tag)
 {
     assert(size > sizeof(m_ptr)); // Warn since allocations will never succeed.
 }
@@ -28,11 +125,26 @@ linear_allocator& linear_allocator::operator = (linear_allocator&& o)
     free_chain();
 
     m_ptr = o.m_ptr;
+    m_oversized = o.m_oversized;
     m_used = o.m_used;
     m_max = o.m_max;
+    m_pages = o.m_pages;
+    m_blocks = o.m_blocks;
+
+    // The pages now belong to this allocator's tag.
+    if (m_tag != o.m_tag && o.m_footprint)
+    {
+        mem_stats::sub(o.m_tag, o.m_footprint, o.m_blocks);
+        mem_stats::add(m_tag, o.m_footprint, o.m_blocks);
+    }
+    m_footprint = o.m_footprint;
 
     o.m_ptr = nullptr;
+    o.m_oversized = nullptr;
     o.m_used = o.m_max;
+    o.m_footprint = 0;
+    o.m_pages = 0;
+    o.m_blocks = 0;
 
     return *this;
 }
@@ -47,16 +159,16 @@ void* linear_allocator::alloc(uint32 size)
     {
         if (!m_ptr && !new_page())
             return nullptr;
-        // An over-sized allocation gets its own "page", which gets inserted
-        // into the chain without discarding the current page.
+        // An over-sized allocation gets its own "page", which goes in a
+        // separate chain without discarding the current page.
         char* oversized = (char*)malloc(size + sizeof(m_ptr));
         if (oversized == nullptr)
             return nullptr;
-#ifdef DEBUG
         m_footprint += size + sizeof(m_ptr);
-#endif
-        *reinterpret_cast<char**>(oversized) = *reinterpret_cast<char**>(m_ptr);
-        *reinterpret_cast<char**>(m_ptr) = oversized;
+        ++m_blocks;
+        mem_stats::add(m_tag, size + sizeof(m_ptr));
+        *reinterpret_cast<char**>(oversized) = m_oversized;
+        m_oversized = oversized;
         return oversized + sizeof(m_ptr);
     }
 
@@ -80,19 +192,26 @@ const char* linear_allocator::store(const char* str)
     return ret;
 }
 
+//------------------------------------------------------------------------------
+void linear_allocator::get_pool_stats(size_t& bytes, uint32& pages)
+{
+    page_pool::get_stats(bytes, pages);
+}
+
 //------------------------------------------------------------------------------
 bool linear_allocator::new_page()
 {
     if (m_max < sizeof(m_ptr))
         return false;
 
-    char* temp = (char*)malloc(m_max);
+    char* temp = page_pool::take(m_max);
     if (temp == nullptr)
         return false;
 
-#ifdef DEBUG
     m_footprint += m_max;
-#endif
+    ++m_pages;
+    ++m_blocks;
+    mem_stats::add(m_tag, m_max);
 
     *reinterpret_cast<char**>(temp) = m_ptr;
     m_used = sizeof(m_ptr);
@@ -103,26 +222,52 @@ bool linear_allocator::new_page()
 //------------------------------------------------------------------------------
 void linear_allocator::free_chain(bool keep_one)
 {
-    m_used = m_ptr && keep_one ? sizeof(m_ptr) : m_max;
-#ifdef DEBUG
-    m_footprint = m_ptr && keep_one ? m_max : 0;
-#endif
+    // A workload that keeps needing many pages gets bigger pages next time.
+    // All pages in a chain are the same size, so a bigger page can't be mixed
+    // with the kept one.
+    uint32 new_max = m_max;
+    if (m_pages > c_grow_after_pages && m_max <= c_max_grown_page / 2)
+    {
+        new_max = m_max * 2;
+        keep_one = false;
+    }
 
-    char* ptr = m_ptr;
+    const bool keep = m_ptr && keep_one;
+    const uint32 freed = m_footprint - (keep ? m_max : 0);
+    const uint32 freed_blocks = m_blocks - (keep ? 1 : 0);
 
-    if (!keep_one)
+    char* ptr = m_ptr;
+    if (keep)
+    {
+        ptr = *reinterpret_cast<char**>(m_ptr);
+        *reinterpret_cast<char**>(m_ptr) = nullptr;
+    }
+    else
+    {
         m_ptr = nullptr;
+    }
 
     while (ptr)
     {
         char* tmp = ptr;
         ptr = *reinterpret_cast<char**>(ptr);
-        if (keep_one)
-        {
-            *reinterpret_cast<char**>(tmp) = nullptr;
-            tmp = nullptr;
-            keep_one = false;
-        }
+        if (!page_pool::give(tmp, m_max))
+            free(tmp);
+    }
+
+    while (m_oversized)
+    {
+        char* tmp = m_oversized;
+        m_oversized = *reinterpret_cast<char**>(m_oversized);
         free(tmp);
     }
+
+    if (freed_blocks)
+        mem_stats::sub(m_tag, freed, freed_blocks);
+
+    m_max = new_max;
+    m_used = keep ? sizeof(m_ptr) : m_max;
+    m_footprint = keep ? m_max : 0;
+    m_pages = keep ? 1 : 0;
+    m_blocks = keep ? 1 : 0;
 }
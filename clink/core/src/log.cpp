@@ -51,6 +51,9 @@ void logger::error(const char* function, int32 line, const char* fmt, ...)
     logger::info(function, line, "(last error = %d)", last_error);
 
     va_end(args);
+
+    // Errors often precede a crash, so make sure they reach the log.
+    instance->flush();
 }
 
 //------------------------------------------------------------------------------
@@ -93,41 +96,285 @@ void logger::emit_deferred()
 
 
 
+//------------------------------------------------------------------------------
+// Bounded multi-producer ring of formatted lines (after Dmitry Vyukov's bounded
+// queue).  A producer claims a record by advancing m_enqueue, fills it, and then
+// publishes it by setting its sequence number.  Records are only consumed while
+// holding m_drain_lock, so there's only ever one consumer at a time.
+//
+// m_pending counts published records that haven't been drained yet; the writer
+// thread sleeps until a producer moves it from 0 to 1.
+struct log_ring
+{
+    struct record
+    {
+        volatile LONG   seq;
+        uint32          len;
+        char            text[500];
+    };
+
+    static const LONG   c_count = 1024;     // Must be a power of two.
+
+                        log_ring(const char* path);
+    bool                push(const char* text, uint32 len);
+    bool                drain();
+    static DWORD WINAPI writer_proc(void* param);
+
+    record*             m_records;
+    volatile LONG       m_enqueue = 0;
+    LONG                m_dequeue = 0;
+    volatile LONG       m_pending = 0;
+    SRWLOCK             m_drain_lock = SRWLOCK_INIT;
+    HANDLE              m_wake = nullptr;
+    HANDLE              m_thread = nullptr;
+    volatile bool       m_stop = false;
+    const char*         m_path;
+};
+
+//------------------------------------------------------------------------------
+// Plain volatile reads have no acquire ordering on ARM64, so sequence numbers
+// are read with an interlocked operation that doesn't change the value.
+static LONG load_acquire(volatile LONG* value)
+{
+    return InterlockedOr(value, 0);
+}
+
+//------------------------------------------------------------------------------
+log_ring::log_ring(const char* path)
+: m_path(path)
+{
+    // VirtualAlloc, so the ring can be abandoned at process exit without the
+    // debug heap reporting it.
+    m_records = static_cast<record*>(VirtualAlloc(nullptr, sizeof(record) * c_count, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE));
+    if (m_records)
+    {
+        for (LONG i = 0; i < c_count; ++i)
+            m_records[i].seq = i;
+    }
+}
+
+//------------------------------------------------------------------------------
+bool log_ring::push(const char* text, uint32 len)
+{
+    if (len > sizeof(record::text))
+        return false;
+
+    for (;;)
+    {
+        LONG pos = m_enqueue;
+        record& r = m_records[pos & (c_count - 1)];
+        const LONG diff = load_acquire(&r.seq) - pos;
+        if (diff == 0)
+        {
+            if (InterlockedCompareExchange(&m_enqueue, pos + 1, pos) != pos)
+                continue;
+
+            memcpy(r.text, text, len);
+            r.len = len;
+            InterlockedExchange(&r.seq, pos + 1);
+
+            // Wake the writer when the ring goes from empty to non-empty.
+            if (InterlockedIncrement(&m_pending) == 1)
+                SetEvent(m_wake);
+            return true;
+        }
+        else if (diff < 0)
+        {
+            // Full; wait for the writer to catch up.
+            SetEvent(m_wake);
+            Sleep(1);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// The caller must hold m_drain_lock.  Returns true if records are still
+// pending; callers other than the writer thread must then wake it, since
+// producers only wake it when the ring goes from empty to non-empty.
+bool log_ring::drain()
+{
+    FILE* file = nullptr;
+    LONG drained = 0;
+    for (;;)
+    {
+        record& r = m_records[m_dequeue & (c_count - 1)];
+        if (load_acquire(&r.seq) != m_dequeue + 1)
+            break;
+
+        if (!file)
+            file = fopen(m_path, "at");
+        if (file)
+            fwrite(r.text, 1, r.len, file);
+
+        InterlockedExchange(&r.seq, m_dequeue + c_count);
+        ++m_dequeue;
+        ++drained;
+    }
+
+    if (file)
+        fclose(file);
+
+    // A producer can publish a record before counting it, so this can go
+    // negative briefly; the producer's increment then brings it back to 0
+    // without waking the writer, which is fine because the record was
+    // already drained.
+    return InterlockedExchangeAdd(&m_pending, -drained) - drained > 0;
+}
+
+//------------------------------------------------------------------------------
+DWORD WINAPI log_ring::writer_proc(void* param)
+{
+    log_ring* ring = static_cast<log_ring*>(param);
+    DWORD timeout = INFINITE;
+    while (!ring->m_stop)
+    {
+        WaitForSingleObject(ring->m_wake, timeout);
+        AcquireSRWLockExclusive(&ring->m_drain_lock);
+        const bool more = ring->drain();
+        ReleaseSRWLockExclusive(&ring->m_drain_lock);
+
+        // A record can be counted while an earlier one is still being filled
+        // in, so check again shortly instead of waiting for the next wake.
+        timeout = more ? 1 : INFINITE;
+    }
+    return 0;
+}
+
+
+
 //------------------------------------------------------------------------------
 const file_logger* file_logger::s_this = nullptr;
 
 //------------------------------------------------------------------------------
-file_logger::file_logger(const char* log_path)
+file_logger::file_logger(const char* log_path, bool async)
 {
     m_log_path << log_path;
     s_this = this;
+
+    if (async)
+    {
+        log_ring* ring = new log_ring(m_log_path.c_str());
+        if (ring->m_records)
+        {
+            ring->m_wake = CreateEvent(nullptr, false, false, nullptr);
+            if (ring->m_wake)
+                ring->m_thread = CreateThread(nullptr, 0, log_ring::writer_proc, ring, 0, nullptr);
+        }
+
+        if (ring->m_thread)
+        {
+            m_ring = ring;
+        }
+        else
+        {
+            if (ring->m_wake)
+                CloseHandle(ring->m_wake);
+            if (ring->m_records)
+                VirtualFree(ring->m_records, 0, MEM_RELEASE);
+            delete ring;
+        }
+    }
 }
 
 //------------------------------------------------------------------------------
 file_logger::~file_logger()
 {
+    if (m_ring)
+    {
+        // This can run during process exit, when the writer thread may have
+        // been terminated (possibly while draining), and waiting for a thread
+        // could deadlock on the loader lock.  So write out whatever is left
+        // only if that's safe, and free the ring only if the thread is gone.
+        m_ring->m_stop = true;
+        SetEvent(m_ring->m_wake);
+        if (TryAcquireSRWLockExclusive(&m_ring->m_drain_lock))
+        {
+            m_ring->drain();
+            ReleaseSRWLockExclusive(&m_ring->m_drain_lock);
+        }
+
+        if (WaitForSingleObject(m_ring->m_thread, 0) == WAIT_OBJECT_0)
+        {
+            CloseHandle(m_ring->m_thread);
+            CloseHandle(m_ring->m_wake);
+            VirtualFree(m_ring->m_records, 0, MEM_RELEASE);
+            delete m_ring;
+        }
+        else
+        {
+            // The thread still refers to the path.
+            m_ring->m_path = _strdup(m_log_path.c_str());
+        }
+        m_ring = nullptr;
+    }
+
     s_this = nullptr;
 }
 
 //------------------------------------------------------------------------------
 void file_logger::emit(const char* function, int32 line, const char* fmt, va_list args)
 {
-    FILE* file;
+    DWORD pid = GetCurrentProcessId();
 
-    file = fopen(m_log_path.c_str(), "at");
-    if (file == nullptr)
-        return;
+    char prefix[128];
+    _snprintf_s(prefix, _TRUNCATE, "%04x %-24s %4d ", pid, function, line);
 
-    str<24> func_name;
-    func_name << function;
+    if (m_ring)
+    {
+        // Format into a record-sized buffer on the stack; no allocations.
+        char text[sizeof(log_ring::record::text)];
+        const int32 prefix_len = int32(strlen(prefix));
+        memcpy(text, prefix, prefix_len);
 
-    DWORD pid = GetCurrentProcessId();
+        va_list copy;
+        va_copy(copy, args);
+        const int32 room = int32(sizeof(text)) - prefix_len - 1;
+        const int32 len = vsnprintf(text + prefix_len, room + 1, fmt, copy);
+        va_end(copy);
 
-    str<256> buffer;
-    buffer.format("%04x %-24s %4d ", pid, func_name.c_str(), line);
-    fputs(buffer.c_str(), file);
-    vfprintf(file, fmt, args);
-    fputs("\n", file);
+        if (len >= 0 && len < room)
+        {
+            text[prefix_len + len] = '\n';
+            if (m_ring->push(text, prefix_len + len + 1))
+                return;
+        }
+    }
 
-    fclose(file);
+    write_sync(prefix, fmt, args);
+}
+
+//------------------------------------------------------------------------------
+void file_logger::write_sync(const char* prefix, const char* fmt, va_list args)
+{
+    // Drain the ring first, to keep lines in order.
+    if (m_ring)
+    {
+        AcquireSRWLockExclusive(&m_ring->m_drain_lock);
+        if (m_ring->drain())
+            SetEvent(m_ring->m_wake);
+    }
+
+    FILE* file = fopen(m_log_path.c_str(), "at");
+    if (file)
+    {
+        fputs(prefix, file);
+        vfprintf(file, fmt, args);
+        fputs("\n", file);
+        fclose(file);
+    }
+
+    if (m_ring)
+        ReleaseSRWLockExclusive(&m_ring->m_drain_lock);
+}
+
+//------------------------------------------------------------------------------
+void file_logger::flush()
+{
+    if (m_ring)
+    {
+        AcquireSRWLockExclusive(&m_ring->m_drain_lock);
+        if (m_ring->drain())
+            SetEvent(m_ring->m_wake);
+        ReleaseSRWLockExclusive(&m_ring->m_drain_lock);
+    }
 }
@@ -0,0 +1,170 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "mem_stats.h"
+#include "str.h"
+
+#include <new>
+#include <stdlib.h>
+
+//------------------------------------------------------------------------------
+static const char* const c_tag_names[] =
+{
+    "other",
+    "editor",
+    "matches",
+    "history",
+    "recognizer",
+    "lua",
+};
+static_assert(sizeof_array(c_tag_names) == size_t(mem_tag::max), "c_tag_names must match mem_tag");
+
+//------------------------------------------------------------------------------
+// Interlocked, since background threads allocate too.
+struct mem_tally
+{
+    volatile LONG64 bytes;              // Bytes currently held.
+    volatile LONG64 count;              // Allocations currently held.
+    volatile LONG64 total;              // Allocations ever made.
+};
+
+static mem_tally s_tallies[size_t(mem_tag::max)];
+static thread_local mem_tag t_current_tag = mem_tag::other;
+
+//------------------------------------------------------------------------------
+mem_tag_scope::mem_tag_scope(mem_tag tag)
+: m_prev(t_current_tag)
+{
+    t_current_tag = tag;
+}
+
+//------------------------------------------------------------------------------
+mem_tag_scope::~mem_tag_scope()
+{
+    t_current_tag = m_prev;
+}
+
+
+
+namespace mem_stats
+{
+
+//------------------------------------------------------------------------------
+void add(mem_tag tag, size_t bytes, uint32 blocks)
+{
+    mem_tally& tally = s_tallies[size_t(tag)];
+    InterlockedExchangeAdd64(&tally.bytes, LONG64(bytes));
+    InterlockedExchangeAdd64(&tally.count, blocks);
+    InterlockedExchangeAdd64(&tally.total, blocks);
+}
+
+//------------------------------------------------------------------------------
+void sub(mem_tag tag, size_t bytes, uint32 blocks)
+{
+    mem_tally& tally = s_tallies[size_t(tag)];
+    InterlockedExchangeAdd64(&tally.bytes, -LONG64(bytes));
+    InterlockedExchangeAdd64(&tally.count, -LONG64(blocks));
+}
+
+//------------------------------------------------------------------------------
+mem_tag get_current_tag()
+{
+    return t_current_tag;
+}
+
+//------------------------------------------------------------------------------
+bool counts_heap()
+{
+#ifdef USE_MEMORY_TRACKING
+    return false;
+#else
+    return true;
+#endif
+}
+
+//------------------------------------------------------------------------------
+void format(str_base& out)
+{
+    str<> tmp;
+    LONG64 bytes = 0;
+    LONG64 count = 0;
+    for (size_t i = 0; i < size_t(mem_tag::max); ++i)
+    {
+        const mem_tally& tally = s_tallies[i];
+        tmp.format("  %-16s  %8llu KB in %llu blocks (%llu allocated since start)\n",
+                   c_tag_names[i], tally.bytes / 1024, tally.count, tally.total);
+        out.concat(tmp.c_str(), tmp.length());
+        bytes += tally.bytes;
+        count += tally.count;
+    }
+    tmp.format("  %-16s  %8llu KB in %llu blocks\n", "total", bytes / 1024, count);
+    out.concat(tmp.c_str(), tmp.length());
+}
+
+}; // namespace mem_stats
+
+
+
+#ifndef USE_MEMORY_TRACKING
+
+//------------------------------------------------------------------------------
+// Counting operator new/delete.  A small header before each block remembers its
+// size and tag, so delete can charge the same tag regardless of the scope it
+// runs in.  The header keeps the alignment that malloc guarantees.
+union alloc_header
+{
+    struct
+    {
+        size_t      size;
+        mem_tag     tag;
+    };
+    max_align_t     align;
+};
+
+//------------------------------------------------------------------------------
+static void* counted_alloc(size_t size)
+{
+    alloc_header* header = static_cast<alloc_header*>(malloc(sizeof(alloc_header) + size));
+    if (!header)
+        throw std::bad_alloc();
+
+    header->size = size;
+    header->tag = t_current_tag;
+    mem_stats::add(header->tag, size);
+    return header + 1;
+}
+
+//------------------------------------------------------------------------------
+static void counted_free(void* p)
+{
+    if (!p)
+        return;
+
+    alloc_header* header = static_cast<alloc_header*>(p) - 1;
+    mem_stats::sub(header->tag, header->size);
+    free(header);
+}
+
+//------------------------------------------------------------------------------
+void* __cdecl operator new(size_t size)
+{
+    return counted_alloc(size);
+}
+
+void __cdecl operator delete(void* pv)
+{
+    counted_free(pv);
+}
+
+void* __cdecl operator new[](size_t size)
+{
+    return counted_alloc(size);
+}
+
+void __cdecl operator delete[](void* pv)
+{
+    counted_free(pv);
+}
+
+#endif // !USE_MEMORY_TRACKING
@@ -3,6 +3,7 @@
 
 #include "pch.h"
 #include "os.h"
+#include "delay_load.h"
 #include "path.h"
 #include "str.h"
 #include "str_iter.h"
@@ -19,6 +20,12 @@
 #include <vector>
 #endif
 
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #ifndef _MSC_VER
 #define USE_PORTABLE
 #endif
@@ -81,7 +88,7 @@ bool delay_load_mpr::init()
     if (!m_initialized)
     {
         m_initialized = true;
-        HMODULE hlib = LoadLibrary("mpr.dll");
+        HMODULE hlib = delay_load_library("mpr.dll");
         if (hlib)
             m_procs.proc[0] = GetProcAddress(hlib, "WNetGetConnectionW");
         m_ok = !!m_procs.WNetGetConnectionW;
@@ -133,7 +140,7 @@ bool delay_load_shell32::init()
     if (!m_initialized)
     {
         m_initialized = true;
-        HMODULE hlib = LoadLibrary("shell32.dll");
+        HMODULE hlib = delay_load_library("shell32.dll");
         if (hlib)
         {
             do
@@ -392,7 +399,183 @@ static bool has_wildcard(const wchar_t* path)
 }
 
 //------------------------------------------------------------------------------
-DWORD get_file_attributes(const wchar_t* path, bool* symlink)
+// Paths on a dead network share or a stale mapped drive can take many seconds
+// to fail (SMB timeouts), and the same paths tend to be queried over and over
+// while typing.  So failures that were slow are remembered for a while, and a
+// slow failure with a network error marks the whole volume unreachable for a
+// while, so nothing else on it is attempted either.  Fast failures (the usual
+// case, e.g. a missing file) and failures on local volumes are never
+// remembered.
+class unreachable_paths
+{
+    struct entry
+    {
+        std::wstring    key;
+        DWORD           error;
+        ULONGLONG       expires;
+    };
+
+public:
+    bool                check(const wchar_t* path, DWORD& error);
+    void                note(const wchar_t* path, DWORD error, DWORD elapsed);
+
+private:
+    static bool         get_keys(const wchar_t* path, std::wstring& full, std::wstring& volume);
+    static bool         is_network_error(DWORD error);
+    static bool         find(std::vector<entry>& entries, const std::wstring& key, DWORD& error);
+    std::mutex          m_mutex;
+    std::vector<entry>  m_paths;
+    std::vector<entry>  m_volumes;
+
+    static const DWORD  c_slow = 500;
+    static const ULONGLONG c_path_ttl = 10 * 1000;
+    static const ULONGLONG c_volume_ttl = 30 * 1000;
+    static const size_t c_max_paths = 64;
+};
+
+//------------------------------------------------------------------------------
+static unreachable_paths s_unreachable;
+
+//------------------------------------------------------------------------------
+bool unreachable_paths::check(const wchar_t* path, DWORD& error)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_paths.empty() && m_volumes.empty())
+            return false;
+    }
+
+    std::wstring full;
+    std::wstring volume;
+    if (!get_keys(path, full, volume))
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return (find(m_volumes, volume, error) || find(m_paths, full, error));
+}
+
+//------------------------------------------------------------------------------
+void unreachable_paths::note(const wchar_t* path, DWORD error, DWORD elapsed)
+{
+    if (elapsed < c_slow)
+        return;
+
+    std::wstring full;
+    std::wstring volume;
+    if (!get_keys(path, full, volume))
+        return;
+
+    // Only remember paths on network volumes; a local disk that was briefly
+    // slow shouldn't hide a file created moments later.
+    if (volume.empty())
+        return;
+    if (!path::is_unc(volume.c_str()))
+    {
+        const wchar_t root[] = { volume[0], ':', '\\', '\0' };
+        if (GetDriveTypeW(root) != DRIVE_REMOTE)
+            return;
+    }
+
+    const ULONGLONG now = GetTickCount64();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    DWORD ignored;
+    if (is_network_error(error) && !find(m_volumes, volume, ignored))
+        m_volumes.push_back({ std::move(volume), error, now + c_volume_ttl });
+
+    if (!find(m_paths, full, ignored))
+    {
+        if (m_paths.size() >= c_max_paths)
+            m_paths.erase(m_paths.begin());
+        m_paths.push_back({ std::move(full), error, now + c_path_ttl });
+    }
+}
+
+//------------------------------------------------------------------------------
+bool unreachable_paths::get_keys(const wchar_t* path, std::wstring& full, std::wstring& volume)
+{
+    wchar_t buffer[MAX_PATH + 1];
+    const DWORD len = GetFullPathNameW(path, sizeof_array(buffer), buffer, nullptr);
+    if (!len || len >= sizeof_array(buffer))
+        return false;
+
+    full.assign(buffer, len);
+
+    const wchar_t* past_unc;
+    if (path::is_unc(buffer, &past_unc))
+        volume.assign(buffer, past_unc - buffer);
+    else if (iswalpha(buffer[0]) && buffer[1] == ':')
+        volume.assign(buffer, 2);
+    else
+        volume.clear();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool unreachable_paths::is_network_error(DWORD error)
+{
+    switch (error)
+    {
+    case ERROR_BAD_NETPATH:
+    case ERROR_BAD_NET_NAME:
+    case ERROR_NETNAME_DELETED:
+    case ERROR_NETWORK_UNREACHABLE:
+    case ERROR_HOST_UNREACHABLE:
+    case ERROR_UNEXP_NET_ERR:
+    case ERROR_SEM_TIMEOUT:
+    case ERROR_NETWORK_BUSY:
+    case ERROR_REM_NOT_LIST:
+    case ERROR_DEV_NOT_EXIST:
+        return true;
+    default:
+        return false;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Caller must hold the mutex.  Also removes expired entries.
+bool unreachable_paths::find(std::vector<entry>& entries, const std::wstring& key, DWORD& error)
+{
+    const ULONGLONG now = GetTickCount64();
+    for (auto iter = entries.begin(); iter != entries.end();)
+    {
+        if (iter->expires <= now)
+        {
+            iter = entries.erase(iter);
+            continue;
+        }
+
+        if (_wcsicmp(iter->key.c_str(), key.c_str()) == 0)
+        {
+            error = iter->error;
+            return true;
+        }
+
+        ++iter;
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+bool is_unreachable_path(const wchar_t* path)
+{
+    DWORD error;
+    if (!s_unreachable.check(path, error))
+        return false;
+
+    map_errno(error);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void note_path_failure(const wchar_t* path, DWORD error, DWORD elapsed)
+{
+    s_unreachable.note(path, error, elapsed);
+}
+
+//------------------------------------------------------------------------------
+static DWORD get_file_attributes_uncached(const wchar_t* path, bool* symlink)
 {
     // FindFirstFileW can handle cases that GetFileAttributesW can't (e.g. files
     // open exclusively, some hidden/system files in the system root directory).
@@ -404,10 +587,7 @@ DWORD get_file_attributes(const wchar_t* path, bool* symlink)
     {
         DWORD attr = GetFileAttributesW(path);
         if (attr == INVALID_FILE_ATTRIBUTES)
-        {
-            map_errno();
             return INVALID_FILE_ATTRIBUTES;
-        }
         if (symlink)
             *symlink = false;
         return attr;
@@ -416,10 +596,7 @@ DWORD get_file_attributes(const wchar_t* path, bool* symlink)
     WIN32_FIND_DATAW fd;
     HANDLE h = FindFirstFileW(path, &fd);
     if (h == INVALID_HANDLE_VALUE)
-    {
-        map_errno();
         return INVALID_FILE_ATTRIBUTES;
-    }
 
     if (symlink)
     {
@@ -432,6 +609,24 @@ DWORD get_file_attributes(const wchar_t* path, bool* symlink)
     return fd.dwFileAttributes;
 }
 
+//------------------------------------------------------------------------------
+DWORD get_file_attributes(const wchar_t* path, bool* symlink)
+{
+    if (*path && is_unreachable_path(path))
+        return INVALID_FILE_ATTRIBUTES;
+
+    const DWORD tick = GetTickCount();
+    const DWORD attr = get_file_attributes_uncached(path, symlink);
+    if (attr == INVALID_FILE_ATTRIBUTES)
+    {
+        const DWORD error = GetLastError();
+        if (*path)
+            note_path_failure(path, error, GetTickCount() - tick);
+        map_errno(error);
+    }
+    return attr;
+}
+
 //------------------------------------------------------------------------------
 DWORD get_file_attributes(const char* path, bool* symlink)
 {
@@ -770,12 +965,91 @@ LLiteral:
 }
 
 //------------------------------------------------------------------------------
-bool get_env(const char* name, str_base& out)
+// Environment variable reads are cached until the environment changes, since
+// they're frequent (PATH, PATHEXT, etc) and each one is a UTF-16 round trip.
+// CMD's changes arrive through the SetEnvironmentVariableW and
+// SetEnvironmentStringsW hooks and Clink's own go through set_env(), which all
+// invalidate the cache; the host also invalidates it at the start of each
+// input line, in case something else changed the environment.
+struct env_cache_entry
+{
+    str_moveable        value;
+    DWORD               error;              // Nonzero if the variable isn't set.
+};
+static std::unordered_map<std::string, env_cache_entry> s_env_cache;
+static std::mutex s_env_cache_mutex;
+static std::atomic<uint32> s_env_generation(1);
+
+//------------------------------------------------------------------------------
+void invalidate_env_cache()
+{
+    std::lock_guard<std::mutex> lock(s_env_cache_mutex);
+    s_env_cache.clear();
+    ++s_env_generation;
+}
+
+//------------------------------------------------------------------------------
+uint32 get_env_generation()
+{
+    return s_env_generation;
+}
+
+//------------------------------------------------------------------------------
+static bool get_env_cached(const char* name, str_base& out, DWORD& error)
 {
+    uint32 generation;
+    {
+        std::lock_guard<std::mutex> lock(s_env_cache_mutex);
+        const auto iter = s_env_cache.find(name);
+        if (iter != s_env_cache.end())
+        {
+            error = iter->second.error;
+            if (error)
+                return false;
+            out = iter->second.value.c_str();
+            return true;
+        }
+        generation = s_env_generation;
+    }
+
     wstr<32> wname(name);
 
+    env_cache_entry entry;
     int32 len = GetEnvironmentVariableW(wname.c_str(), nullptr, 0);
     if (!len)
+    {
+        entry.error = GetLastError();
+        if (!entry.error)
+            entry.error = ERROR_ENVVAR_NOT_FOUND;
+    }
+    else
+    {
+        wstr<> wvalue;
+        wvalue.reserve(len);
+        len = GetEnvironmentVariableW(wname.c_str(), wvalue.data(), wvalue.size());
+
+        entry.error = 0;
+        entry.value.reserve(len);
+        entry.value = wvalue.c_str();
+    }
+
+    error = entry.error;
+    if (!error)
+        out = entry.value.c_str();
+
+    // Don't cache a value read while the environment was being changed.
+    std::lock_guard<std::mutex> lock(s_env_cache_mutex);
+    if (generation == s_env_generation)
+        s_env_cache[name] = std::move(entry);
+
+    return !error;
+}
+
+//------------------------------------------------------------------------------
+bool get_env(const char* name, str_base& out)
+{
+    DWORD error;
+    if (!get_env_cached(name, out, error))
     {
         if (stricmp(name, "HOME") == 0)
         {
@@ -815,16 +1089,10 @@ bool get_env(const char* name, str_base& out)
             return true;
         }
 
-        map_errno();
+        map_errno(error);
         return false;
     }
 
-    wstr<> wvalue;
-    wvalue.reserve(len);
-    len = GetEnvironmentVariableW(wname.c_str(), wvalue.data(), wvalue.size());
-
-    out.reserve(len);
-    out = wvalue.c_str();
     return true;
 }
 
@@ -852,13 +1120,31 @@ bool set_env(const char* name, const char* value)
     // NOTE:  This does not invoke the hooked version, and it does not intercept
     // setting PROMPT from inside Clink.
     const wchar_t* value_arg = (value != nullptr) ? wvalue.c_str() : nullptr;
-    if (SetEnvironmentVariableW(wname.c_str(), value_arg) != 0)
+    const BOOL ok = SetEnvironmentVariableW(wname.c_str(), value_arg);
+    invalidate_env_cache();
+    if (ok)
         return true;
 
     map_errno();
     return false;
 }
 
+//------------------------------------------------------------------------------
+static std::atomic<uint32> s_alias_generation(1);
+
+//------------------------------------------------------------------------------
+// Tells alias snapshots (see alias_cache) that doskey aliases may have changed.
+void invalidate_alias_cache()
+{
+    ++s_alias_generation;
+}
+
+//------------------------------------------------------------------------------
+uint32 get_alias_generation()
+{
+    return s_alias_generation;
+}
+
 //------------------------------------------------------------------------------
 bool get_alias(const char* name, str_base& out)
 {
@@ -896,7 +1182,10 @@ bool set_alias(const char* name, const char* command)
         wstr<32> wname(name);
         wstr<32> wcommand(command);
         if (AddConsoleAliasW(wname.data(), wcommand.data(), const_cast<wchar_t*>(s_shell_name)))
+        {
+            invalidate_alias_cache();
             return true;
+        }
         map_errno();
     }
     return false;
@@ -963,23 +1252,29 @@ bool get_long_path_name(const char* path, str_base& out)
 //------------------------------------------------------------------------------
 bool get_full_path_name(const char* _path, str_base& out, uint32 len)
 {
-    wstr<> wpath;
+    // This is called very often, so use buffers big enough for nearly all
+    // paths, and only size the output buffer by asking first if it's too
+    // small.
+    wstr<280> wpath;
     str_iter path(_path, len);
     to_utf16(wpath, path);
 
     out.clear();
 
-    len = GetFullPathNameW(wpath.c_str(), 0, nullptr, nullptr);
-    if (len)
+    wstr<280> wout;
+    len = GetFullPathNameW(wpath.c_str(), wout.size(), wout.data(), nullptr);
+    if (len >= wout.size())
     {
-        wstr<> wout;
         wout.reserve(len);
-        len = GetFullPathNameW(wpath.c_str(), wout.size() - 1, wout.data(), nullptr);
-        if (len)
-        {
-            wstr_iter tmpi(wout.c_str(), wout.length());
-            to_utf8(out, tmpi);
-        }
+        len = GetFullPathNameW(wpath.c_str(), wout.size(), wout.data(), nullptr);
+        if (len >= wout.size())
+            len = 0;
+    }
+
+    if (len)
+    {
+        wstr_iter tmpi(wout.c_str(), len);
+        to_utf8(out, tmpi);
     }
 
     if (!len)
@@ -1192,7 +1487,9 @@ int32 system(const char* command, const char* cwd)
 }
 
 //------------------------------------------------------------------------------
-HANDLE spawn_internal(const char* command, const char* cwd, HANDLE hStdin, HANDLE hStdout)
+// If SUSPENDED_THREAD is not null, the process is created suspended and it
+// receives the main thread's handle; the caller must resume and close it.
+HANDLE spawn_internal(const char* command, const char* cwd, HANDLE hStdin, HANDLE hStdout, HANDLE* suspended_thread)
 {
     // Determine which command processor to use:  command.com or cmd.exe:
     static wchar_t const default_cmd_exe[] = L"cmd.exe";
@@ -1252,7 +1549,7 @@ HANDLE spawn_internal(const char* command, const char* cwd, HANDLE hStdin, HANDL
         nullptr,
         nullptr,
         TRUE/*bInheritHandles*/,
-        0,
+        suspended_thread ? CREATE_SUSPENDED : 0,
         nullptr,
         wcwd,
         &startup_info,
@@ -1264,7 +1561,10 @@ HANDLE spawn_internal(const char* command, const char* cwd, HANDLE hStdin, HANDL
         return 0;
     }
 
-    CloseHandle(process_info.hThread);
+    if (suspended_thread)
+        *suspended_thread = process_info.hThread;
+    else
+        CloseHandle(process_info.hThread);
     return process_info.hProcess;
 }
 
@@ -1319,7 +1619,78 @@ void make_version_string(str_base& out)
 }
 
 //------------------------------------------------------------------------------
-bool disambiguate_abbreviated_path(const char*& in, str_base& out)
+// A directory's child names can only have changed if its creation or last write
+// time changed (a directory that was deleted and recreated gets a new creation
+// time).
+struct dir_stamp
+{
+    bool                read();
+    bool                is_current() const;
+    bool                is_settled() const;
+
+    wstr_moveable       dir;
+    FILETIME            created = {};
+    FILETIME            written = {};
+};
+
+//------------------------------------------------------------------------------
+bool dir_stamp::read()
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!GetFileAttributesExW(dir.c_str(), GetFileExInfoStandard, &fad))
+        return false;
+    created = fad.ftCreationTime;
+    written = fad.ftLastWriteTime;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool dir_stamp::is_current() const
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    return (GetFileAttributesExW(dir.c_str(), GetFileExInfoStandard, &fad) &&
+            CompareFileTime(&fad.ftCreationTime, &created) == 0 &&
+            CompareFileTime(&fad.ftLastWriteTime, &written) == 0);
+}
+
+//------------------------------------------------------------------------------
+// File times only advance every clock tick (or every 2 seconds on FAT), so a
+// directory changed again within the same tick would keep the same stamp.  A
+// stamp is only trusted once it's old enough that any such change would have
+// produced a different time.
+bool dir_stamp::is_settled() const
+{
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    ULARGE_INTEGER a, b;
+    a.LowPart = now.dwLowDateTime;
+    a.HighPart = now.dwHighDateTime;
+    b.LowPart = written.dwLowDateTime;
+    b.HighPart = written.dwHighDateTime;
+    return a.QuadPart > b.QuadPart + 2 * 10000000ull;
+}
+
+//------------------------------------------------------------------------------
+// Prompt filters may expand the same abbreviated paths on every prompt, so
+// recent expansions are remembered along with the stamps of the directories
+// that were searched.  Checking the stamps is much cheaper than enumerating the
+// directories again.
+struct abbrev_expansion
+{
+    str_moveable        key;                // Current dir + '|' + input.
+    str_moveable        out;
+    uint32              consumed = 0;
+    bool                unique = false;
+    std::vector<dir_stamp> stamps;
+};
+
+static const uint32 c_max_abbrev_expansions = 16;
+static abbrev_expansion s_abbrev_expansions[c_max_abbrev_expansions];
+static uint32 s_next_abbrev_expansion = 0;
+static std::mutex s_abbrev_expansions_mutex;
+
+//------------------------------------------------------------------------------
+static bool disambiguate_uncached(const char*& in, str_base& out, std::vector<dir_stamp>& stamps)
 {
     out.clear();
 
@@ -1412,8 +1783,21 @@ bool disambiguate_abbreviated_path(const char*& in, str_base& out)
             break;
         }
 
-        // Append star to check for ambiguous matches.
+        // Remember the directory being searched, so a cached result can tell
+        // when its children may have changed.
         const uint32 committed = disambiguated.length();
+        {
+            wstr<280> parent(disambiguated.c_str());
+            for (const wchar_t* sep = wnext.c_str(); path::is_separator(*sep); ++sep)
+                parent.concat(sep, 1);
+            dir_stamp stamp;
+            stamp.dir = parent.length() ? parent.c_str() : L".";
+            if (!stamp.read())
+                return false;
+            stamps.emplace_back(std::move(stamp));
+        }
+
+        // Append star to check for ambiguous matches.
         disambiguated << wnext << L"*";
 
         // Lookup in file system.
@@ -1559,6 +1943,75 @@ close_bail:
     return unique;
 }
 
+//------------------------------------------------------------------------------
+bool disambiguate_abbreviated_path(const char*& in, str_base& out)
+{
+    str_moveable key;
+    get_current_dir(key);
+    key << "|" << in;
+
+    {
+        std::lock_guard<std::mutex> lock(s_abbrev_expansions_mutex);
+        for (const auto& entry : s_abbrev_expansions)
+        {
+            if (!entry.key.equals(key.c_str()))
+                continue;
+
+            bool current = true;
+            for (const auto& stamp : entry.stamps)
+            {
+                if (!stamp.is_current())
+                {
+                    current = false;
+                    break;
+                }
+            }
+            if (!current)
+                break;
+
+            out = entry.out.c_str();
+            in += entry.consumed;
+            return entry.unique;
+        }
+    }
+
+    const char* const start = in;
+    std::vector<dir_stamp> stamps;
+    const bool unique = disambiguate_uncached(in, out, stamps);
+
+    // Only results that searched directories are worth remembering; the rest
+    // bail out before touching the file system.
+    bool cacheable = !stamps.empty();
+    for (const auto& stamp : stamps)
+        cacheable = cacheable && stamp.is_settled();
+
+    if (cacheable)
+    {
+        std::lock_guard<std::mutex> lock(s_abbrev_expansions_mutex);
+        abbrev_expansion* entry = nullptr;
+        for (auto& e : s_abbrev_expansions)
+        {
+            if (e.key.equals(key.c_str()))
+            {
+                entry = &e;
+                break;
+            }
+        }
+        if (!entry)
+        {
+            entry = &s_abbrev_expansions[s_next_abbrev_expansion];
+            s_next_abbrev_expansion = (s_next_abbrev_expansion + 1) % c_max_abbrev_expansions;
+        }
+        entry->key = std::move(key);
+        entry->out = out.c_str();
+        entry->consumed = uint32(in - start);
+        entry->unique = unique;
+        entry->stamps = std::move(stamps);
+    }
+
+    return unique;
+}
+
 //------------------------------------------------------------------------------
 bool is_user_admin()
 {
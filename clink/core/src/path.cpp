@@ -26,7 +26,7 @@ struct ext_comparer
 };
 
 //------------------------------------------------------------------------------
-static bool s_have_pathexts = false;
+static uint32 s_pathexts_generation = 0;    // Environment generation s_pathexts came from.
 static std::map<std::wstring, bool, ext_comparer> s_pathexts;
 
 namespace path {
@@ -117,7 +117,7 @@ static int32 get_directory_end(const char* path)
 //------------------------------------------------------------------------------
 void refresh_pathext()
 {
-    s_have_pathexts = false;
+    s_pathexts_generation = 0;
     s_pathexts.clear();
 }
 
@@ -543,6 +543,46 @@ bool join(const char* lhs, const char* rhs, str_base& out)
     return append(out, rhs);
 }
 
+//------------------------------------------------------------------------------
+bool join(const char* lhs, const char* rhs, char* out, uint32 out_size)
+{
+    assert(!out_size || (lhs + strlen(lhs) < out || lhs >= out + out_size));
+    assert(!out_size || (rhs + strlen(rhs) < out || rhs >= out + out_size));
+
+    if (!out_size)
+        return false;
+
+    // A non-growable str_base over OUT; it fails instead of allocating.  A
+    // result that exactly fills OUT is treated as not fitting, since appending
+    // a separator can be truncated without reporting it.
+    str_base s(out, int32(out_size));
+    if (!s.copy(lhs) || !append(s, rhs) || s.length() >= out_size - 1)
+    {
+        s.clear();
+        return false;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool normalise(const char* in, char* out, uint32 out_size, int32 sep)
+{
+    if (!out_size)
+        return false;
+
+    const size_t len = strlen(in);
+    if (len >= out_size)
+    {
+        *out = '\0';
+        return false;
+    }
+
+    memcpy(out, in, len + 1);
+    normalise(out, sep);
+    return true;
+}
+
 //------------------------------------------------------------------------------
 bool append(str_base& out, const char* rhs)
 {
@@ -760,8 +800,11 @@ bool is_executable_extension(const char* in)
     if (!ext)
         return false;
 
-    if (!s_have_pathexts)
+    const uint32 generation = os::get_env_generation();
+    if (s_pathexts_generation != generation)
     {
+        s_pathexts.clear();
+
         str<> pathext;
         if (!os::get_env("pathext", pathext))
             return false;
@@ -780,7 +823,7 @@ bool is_executable_extension(const char* in)
             s_pathexts.emplace(wtoken.c_str(), true);
         }
 
-        s_have_pathexts = true;
+        s_pathexts_generation = generation;
     }
 
     wstr<> wext(ext);
@@ -6,6 +6,7 @@
 #include "str.h"
 #include "str_tokeniser.h"
 #include "str_compare.h"
+#include "str_transform.h"
 #include "path.h"
 #include "os.h"
 
@@ -13,6 +14,7 @@
 #include <string>
 #include <map>
 #include <functional>
+#include <memory>
 
 #include "debugheap.h"
 
@@ -64,6 +66,111 @@ static auto& get_custom_default_map()
 
 
 
+//------------------------------------------------------------------------------
+// settings::find() is called very often (e.g. settings.get() from Lua scripts
+// on every keystroke), so lookups go through a perfect hash over the names in
+// the registry instead of traversing the map.  The index is rebuilt lazily the
+// next time a lookup happens after a setting is added or removed.
+static uint32 s_registry_generation = 1;
+
+struct setting_index
+{
+    const setting_map*      map = nullptr;
+    uint32                  generation = 0;
+    uint32                  seed = 0;
+    uint32                  mask = 0;       // 0 means fall back to the map.
+    std::vector<setting*>   slots;
+};
+
+static setting_index* g_setting_index = nullptr;
+
+static auto& get_index()
+{
+    // Allocated on demand like the map, since settings are constructed during
+    // static initialization.
+    if (!g_setting_index)
+        g_setting_index = new setting_index;
+    return *g_setting_index;
+}
+
+//------------------------------------------------------------------------------
+static uint32 hash_name(const char* name, uint32 seed)
+{
+    // Caseless FNV-1a, to match cmp_str_caseless.
+    uint32 hash = 0x811c9dc5 ^ seed;
+    for (; *name; ++name)
+    {
+        const uint8 c = uint8(ascii_tolower(*name));
+        hash = (hash ^ c) * 0x01000193;
+    }
+    return hash;
+}
+
+//------------------------------------------------------------------------------
+static void build_index(const setting_map& map)
+{
+    setting_index& index = get_index();
+    index.map = &map;
+    index.generation = s_registry_generation;
+    index.mask = 0;
+
+    uint32 size = 16;
+    while (size < map.size() * 2)
+        size <<= 1;
+
+    // Search for a seed that gives every name its own slot.  Growing the table
+    // makes that easy quickly; if it somehow fails, lookups use the map.
+    for (const uint32 max_size = size << 3; size <= max_size; size <<= 1)
+    {
+        for (uint32 seed = 0; seed < 32; ++seed)
+        {
+            index.slots.clear();
+            index.slots.resize(size);
+
+            bool collided = false;
+            for (const auto& i : map)
+            {
+                setting*& slot = index.slots[hash_name(i.first, seed) & (size - 1)];
+                if (slot)
+                {
+                    collided = true;
+                    break;
+                }
+                slot = i.second;
+            }
+
+            if (!collided)
+            {
+                index.seed = seed;
+                index.mask = size - 1;
+                return;
+            }
+        }
+    }
+
+    index.slots.clear();
+}
+
+//------------------------------------------------------------------------------
+static setting* find_in_registry(const char* name)
+{
+    const setting_map& map = get_map();
+    setting_index& index = get_index();
+    if (index.map != &map || index.generation != s_registry_generation)
+        build_index(map);
+
+    if (index.mask)
+    {
+        setting* s = index.slots[hash_name(name, index.seed) & index.mask];
+        return (s && stricmp(s->get_name(), name) == 0) ? s : nullptr;
+    }
+
+    auto i = map.find(name);
+    return (i != map.end()) ? i->second : nullptr;
+}
+
+
+
 //------------------------------------------------------------------------------
 setting_iter::setting_iter(setting_map& map)
 : m_map(map)
@@ -319,6 +426,235 @@ static bool parse_ini(FILE* in, std::vector<settings::setting_name_value>& out)
 
 
 
+//------------------------------------------------------------------------------
+// The settings cache is a binary snapshot of what was loaded from the settings
+// file and the default settings file.  It's only used while both files still
+// have the same size and timestamp as when the snapshot was written, so that
+// most loads read one small file instead of parsing the text files.
+//
+// Layout (strings are a uint32 length, the text, and a NUL terminator):
+//      magic, total size, settings file size + time, default file size + time,
+//      default file path, num defaults, { name, value }...,
+//      num settings, { name, value, comment }...
+static const uint32 c_settings_cache_magic = 0x31637363;   // "csc1"
+
+//------------------------------------------------------------------------------
+struct settings_cache_source
+{
+    bool            operator==(const settings_cache_source& other) const { return size == other.size && time == other.time; }
+    uint64          size = 0;
+    uint64          time = 0;
+};
+
+//------------------------------------------------------------------------------
+static settings_cache_source get_cache_source(const char* file)
+{
+    settings_cache_source source;
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    wstr<280> wfile(file ? file : "");
+    if (*wfile.c_str() && GetFileAttributesExW(wfile.c_str(), GetFileExInfoStandard, &fad))
+    {
+        source.size = (uint64(fad.nFileSizeHigh) << 32) | fad.nFileSizeLow;
+        source.time = (uint64(fad.ftLastWriteTime.dwHighDateTime) << 32) | fad.ftLastWriteTime.dwLowDateTime;
+    }
+    return source;
+}
+
+//------------------------------------------------------------------------------
+static bool can_cache(const char* file)
+{
+    return file && *file && !path::is_device(file);
+}
+
+//------------------------------------------------------------------------------
+static void get_cache_path(const char* file, str_base& out)
+{
+    out = file;
+    out << ".cache";
+}
+
+//------------------------------------------------------------------------------
+class settings_cache_writer
+{
+public:
+                    settings_cache_writer(const char* file, const char* default_file);
+    void            add(const char* name, const char* value, const char* comment=nullptr);
+    void            end_defaults();
+    void            write(const char* file);
+private:
+    void            append(const void* data, uint32 len) { m_data.append(static_cast<const char*>(data), len); }
+    void            append(uint32 value) { append(&value, sizeof(value)); }
+    void            append(uint64 value) { append(&value, sizeof(value)); }
+    void            append(const char* s);
+    std::string     m_data;
+    size_t          m_count_offset = 0;
+    uint32          m_count = 0;
+};
+
+//------------------------------------------------------------------------------
+settings_cache_writer::settings_cache_writer(const char* file, const char* default_file)
+{
+    const settings_cache_source source = get_cache_source(file);
+    const settings_cache_source default_source = get_cache_source(default_file);
+
+    append(c_settings_cache_magic);
+    append(uint32(0));
+    append(source.size);
+    append(source.time);
+    append(default_source.size);
+    append(default_source.time);
+    append(default_file ? default_file : "");
+
+    m_count_offset = m_data.length();
+    append(uint32(0));
+}
+
+//------------------------------------------------------------------------------
+void settings_cache_writer::add(const char* name, const char* value, const char* comment)
+{
+    append(name);
+    append(value);
+    if (comment)
+        append(comment);
+    ++m_count;
+}
+
+//------------------------------------------------------------------------------
+void settings_cache_writer::end_defaults()
+{
+    memcpy(&m_data[m_count_offset], &m_count, sizeof(m_count));
+    m_count_offset = m_data.length();
+    m_count = 0;
+    append(uint32(0));
+}
+
+//------------------------------------------------------------------------------
+void settings_cache_writer::write(const char* file)
+{
+    memcpy(&m_data[m_count_offset], &m_count, sizeof(m_count));
+    const uint32 total = uint32(m_data.length());
+    memcpy(&m_data[sizeof(uint32)], &total, sizeof(total));
+
+    str<280> cache_path;
+    get_cache_path(file, cache_path);
+    FILE* out = fopen(cache_path.c_str(), "wb");
+    if (!out)
+        return;
+    fwrite(m_data.c_str(), m_data.length(), 1, out);
+    fclose(out);
+}
+
+//------------------------------------------------------------------------------
+void settings_cache_writer::append(const char* s)
+{
+    const uint32 len = uint32(strlen(s));
+    append(len);
+    append(s, len + 1);
+}
+
+//------------------------------------------------------------------------------
+class settings_cache_reader
+{
+public:
+    bool            open(const char* file, const char* default_file);
+    bool            next(const char*& name, const char*& value, const char** comment=nullptr);
+    bool            next_section();
+    bool            ok() const { return !m_error; }
+private:
+    bool            read(void* out, uint32 len);
+    bool            read(const char*& s);
+    std::unique_ptr<char[]> m_data;
+    uint32          m_pos = 0;
+    uint32          m_size = 0;
+    uint32          m_remaining = 0;
+    bool            m_error = false;
+};
+
+//------------------------------------------------------------------------------
+// Reads the whole cache, and verifies it still matches its sources.
+bool settings_cache_reader::open(const char* file, const char* default_file)
+{
+    str<280> cache_path;
+    get_cache_path(file, cache_path);
+    FILE* in = fopen(cache_path.c_str(), "rb");
+    if (!in)
+        return false;
+
+    fseek(in, 0, SEEK_END);
+    const long size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    if (size > 0 && size < 16 * 1024 * 1024)
+    {
+        m_size = uint32(size);
+        m_data = std::unique_ptr<char[]>(new char[m_size]);
+        if (fread(m_data.get(), m_size, 1, in) != 1)
+            m_size = 0;
+    }
+    fclose(in);
+
+    uint32 magic;
+    uint32 total;
+    settings_cache_source source;
+    settings_cache_source default_source;
+    const char* cached_default_file;
+    if (!read(&magic, sizeof(magic)) || magic != c_settings_cache_magic ||
+        !read(&total, sizeof(total)) || total != m_size ||
+        !read(&source, sizeof(source)) ||
+        !read(&default_source, sizeof(default_source)) ||
+        !read(cached_default_file))
+        return false;
+
+    if (strcmp(cached_default_file, default_file ? default_file : "") != 0)
+        return false;
+    if (!(source == get_cache_source(file)) || !(default_source == get_cache_source(default_file)))
+        return false;
+
+    return next_section();
+}
+
+//------------------------------------------------------------------------------
+bool settings_cache_reader::next_section()
+{
+    if (!m_error && !m_remaining && read(&m_remaining, sizeof(m_remaining)))
+        return true;
+    m_error = true;
+    return false;
+}
+
+//------------------------------------------------------------------------------
+bool settings_cache_reader::next(const char*& name, const char*& value, const char** comment)
+{
+    if (!m_remaining || m_error)
+        return false;
+    --m_remaining;
+    if (read(name) && read(value) && (!comment || read(*comment)))
+        return true;
+    m_error = true;
+    return false;
+}
+
+//------------------------------------------------------------------------------
+bool settings_cache_reader::read(void* out, uint32 len)
+{
+    if (m_size - m_pos < len)
+        return false;
+    memcpy(out, m_data.get() + m_pos, len);
+    m_pos += len;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool settings_cache_reader::read(const char*& s)
+{
+    uint32 len;
+    if (!read(&len, sizeof(len)) || m_size - m_pos <= len || m_data[m_pos + len])
+        return false;
+    s = m_data.get() + m_pos;
+    m_pos += len + 1;
+    return true;
+}
+
+
 namespace settings
 {
 
@@ -331,9 +667,8 @@ setting_iter first()
 //------------------------------------------------------------------------------
 setting* find(const char* name)
 {
-    auto i = get_map().find(name);
-    if (i != get_map().end())
-        return i->second;
+    if (setting* s = find_in_registry(name))
+        return s;
 
     size_t len = strlen(name);
     if (len > c_max_len_name)
@@ -346,6 +681,12 @@ setting* find(const char* name)
     return nullptr;
 }
 
+//------------------------------------------------------------------------------
+uint32 get_registry_generation()
+{
+    return s_registry_generation;
+}
+
 //------------------------------------------------------------------------------
 static bool set_setting(const char* name, const char* value, const char* comment=nullptr)
 {
@@ -512,6 +853,55 @@ bool migrate_setting(const char* name, const char* value, std::vector<setting_na
 //------------------------------------------------------------------------------
 static bool save_internal(const char* file, bool migrating);
 
+//------------------------------------------------------------------------------
+// Applies the cached settings.  Returns false without applying anything if the
+// cache is missing, stale, or damaged.
+static bool load_cache(const char* file, const char* default_file)
+{
+    settings_cache_reader cache;
+    if (!cache.open(file, default_file))
+        return false;
+
+    struct entry
+    {
+        const char* name;
+        const char* value;
+        const char* comment;
+    };
+
+    std::vector<entry> defaults;
+    std::vector<entry> loaded;
+    entry e = {};
+    while (cache.next(e.name, e.value))
+        defaults.push_back(e);
+    if (!cache.next_section())
+        return false;
+    while (cache.next(e.name, e.value, &e.comment))
+        loaded.push_back(e);
+    if (!cache.ok())
+        return false;
+
+    auto& map = get_custom_default_map();
+    map.clear();
+    for (const auto& d : defaults)
+    {
+        loaded_setting custom_default;
+        custom_default.value = d.value;
+        map.emplace(d.name, std::move(custom_default));
+    }
+
+    get_loaded_map().clear();
+
+    // Reset settings to default.
+    for (auto iter = settings::first(); auto* next = iter.next();)
+        next->set();
+
+    for (const auto& l : loaded)
+        set_setting(l.name, l.value, l.comment);
+
+    return true;
+}
+
 //------------------------------------------------------------------------------
 bool load(const char* file, const char* default_file)
 {
@@ -527,6 +917,10 @@ bool load(const char* file, const char* default_file)
             *g_last_file = file;
     }
 
+    // Use the binary cache when the files haven't changed since it was written.
+    if (can_cache(file) && load_cache(file, default_file))
+        return true;
+
     load_custom_defaults(default_file);
     get_loaded_map().clear();
 
@@ -555,7 +949,13 @@ bool load(const char* file, const char* default_file)
         migrating = true;
     }
 
-    load_internal(in, [migrating](const char* name, const char* value, const char* comment)
+    // Record what's loaded, for the binary cache.
+    settings_cache_writer cache(file, default_file);
+    for (const auto& custom_default : get_custom_default_map())
+        cache.add(custom_default.first.c_str(), custom_default.second.value.c_str());
+    cache.end_defaults();
+
+    load_internal(in, [migrating, &cache](const char* name, const char* value, const char* comment)
     {
         // Migrate old setting.
         if (migrating)
@@ -571,6 +971,7 @@ bool load(const char* file, const char* default_file)
 
         // Find the setting and set its value.
         set_setting(name, value, comment);
+        cache.add(name, value, comment);
     });
 
     // When migrating, ensure the new settings file is created so that the old
@@ -578,6 +979,8 @@ bool load(const char* file, const char* default_file)
     // clean up the old settings file, so don't rely on it staying around.
     if (migrating)
         save_internal(file, migrating);
+    else if (can_cache(file))
+        cache.write(file);
 
     return true;
 }
@@ -659,6 +1062,15 @@ static bool save_internal(const char* file, bool migrating)
         }
 
     fclose(out);
+
+    // Don't rely only on the timestamp to invalidate the binary cache, since
+    // some file systems have coarse timestamps.
+    if (can_cache(file))
+    {
+        str<280> cache_path;
+        get_cache_path(file, cache_path);
+        os::unlink(cache_path.c_str());
+    }
     return true;
 }
 
@@ -776,6 +1188,7 @@ setting::setting(
     assert(!settings::find(m_name.c_str()));
 
     get_map()[m_name.c_str()] = this;
+    ++s_registry_generation;
 }
 
 //------------------------------------------------------------------------------
@@ -784,7 +1197,10 @@ setting::~setting()
     auto i = settings::find(m_name.c_str());
 
     if (i && i == this)
+    {
         get_map().erase(m_name.c_str());
+        ++s_registry_generation;
+    }
 }
 
 //------------------------------------------------------------------------------
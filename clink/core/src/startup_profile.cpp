@@ -0,0 +1,164 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "startup_profile.h"
+#include "delay_load.h"
+#include "str.h"
+
+//------------------------------------------------------------------------------
+static const uint32 c_max_phases = 64;
+static startup_phase_info s_phases[c_max_phases];
+static uint32 s_seq = 0;                // Total number of phases ever recorded.
+static uint8 s_depth = 0;
+static bool s_finished = false;
+static const os::high_resolution_clock s_clock; // Since the module was loaded.
+
+//------------------------------------------------------------------------------
+static startup_phase_info* get_phase(uint32 seq)
+{
+    if (seq >= s_seq || seq + c_max_phases < s_seq)
+        return nullptr;
+    return &s_phases[seq % c_max_phases];
+}
+
+//------------------------------------------------------------------------------
+static uint32 add_phase(const char* name, const char* detail, float elapsed, uint8 depth)
+{
+    startup_phase_info& phase = s_phases[s_seq % c_max_phases];
+
+    str_base out(phase.name, sizeof_array(phase.name));
+    out.clear();
+    out.concat(name);
+    if (detail && *detail)
+    {
+        // Keep the end of a long detail string (e.g. a script's file name).
+        out.concat(" ");
+        const uint32 avail = out.size() - 1 - out.length();
+        const uint32 len = uint32(strlen(detail));
+        if (len > avail && avail > 3)
+        {
+            out.concat("...");
+            detail += len - (avail - 3);
+        }
+        out.concat(detail);
+    }
+
+    phase.depth = depth;
+    phase.elapsed = elapsed;
+    return s_seq++;
+}
+
+
+
+//------------------------------------------------------------------------------
+startup_phase::startup_phase(const char* name, const char* detail)
+{
+    if (s_finished)
+    {
+        m_seq = uint32(-1);
+        return;
+    }
+
+    m_seq = add_phase(name, detail, -1, s_depth);
+    ++s_depth;
+}
+
+//------------------------------------------------------------------------------
+startup_phase::~startup_phase()
+{
+    if (m_seq == uint32(-1))
+        return;
+
+    --s_depth;
+    if (startup_phase_info* phase = get_phase(m_seq))
+        phase->elapsed = float(m_clock.elapsed() * 1000);
+}
+
+
+
+namespace startup_profile
+{
+
+//------------------------------------------------------------------------------
+void add(const char* name, float elapsed, uint8 depth)
+{
+    if (!s_finished)
+        add_phase(name, nullptr, elapsed, uint8(s_depth + depth));
+}
+
+//------------------------------------------------------------------------------
+uint32 count()
+{
+    return min<uint32>(s_seq, c_max_phases);
+}
+
+//------------------------------------------------------------------------------
+const startup_phase_info* get(uint32 index)
+{
+    if (index >= count())
+        return nullptr;
+    return get_phase(s_seq - count() + index);
+}
+
+//------------------------------------------------------------------------------
+uint32 export_phases(startup_phase_info* out, uint32 max_count)
+{
+    uint32 num = 0;
+    for (uint32 i = 0; i < count() && num < max_count; ++i)
+        out[num++] = *get(i);
+    return num;
+}
+
+//------------------------------------------------------------------------------
+void format(str_base& out)
+{
+    str<> tmp;
+    for (uint32 i = 0; i < count(); ++i)
+    {
+        const startup_phase_info* phase = get(i);
+        const int32 indent = phase->depth * 2;
+        if (phase->elapsed < 0)
+            tmp.format("  %*s%-*s %12s\n", indent, "", 48 - indent, phase->name, "(running)");
+        else
+            tmp.format("  %*s%-*s %9.2f ms\n", indent, "", 48 - indent, phase->name, phase->elapsed);
+        out.concat(tmp.c_str(), tmp.length());
+    }
+}
+
+//------------------------------------------------------------------------------
+bool is_finished()
+{
+    return s_finished;
+}
+
+//------------------------------------------------------------------------------
+bool finish(const char* path)
+{
+    if (s_finished)
+        return false;
+
+    add_delay_loads_to_startup_profile();
+    add_phase("total since load", nullptr, float(s_clock.elapsed() * 1000), 0);
+    s_finished = true;
+
+    FILE* file = fopen(path, "wt");
+    if (!file)
+        return false;
+
+    SYSTEMTIME now;
+    GetLocalTime(&now);
+
+    str<> tmp;
+    tmp.format("session %u, %04u/%02u/%02u %02u:%02u:%02u\n",
+               GetCurrentProcessId(),
+               now.wYear, now.wMonth, now.wDay,
+               now.wHour, now.wMinute, now.wSecond);
+    format(tmp);
+
+    fputs(tmp.c_str(), file);
+    fclose(file);
+    return true;
+}
+
+}; // namespace startup_profile
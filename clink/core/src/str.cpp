@@ -19,6 +19,9 @@ static_assert(sizeof(wstr_moveable) <= sizeof(void*) * 3, "unexpected wstr_movea
 #endif
 #endif
 
+static_assert(sizeof(str_compact) == 24, "unexpected str_compact size");
+static_assert(sizeof(wstr_compact) == 24, "unexpected wstr_compact size");
+
 //------------------------------------------------------------------------------
 str_moveable::str_moveable()
 : str_base(&m_reservation, 1)
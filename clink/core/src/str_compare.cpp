@@ -4,6 +4,12 @@
 #include "pch.h"
 #include "str_compare.h"
 
+#if defined(_M_X64) || defined(_M_IX86)
+#define USE_SSE2
+#include <emmintrin.h>
+#include <intrin.h>
+#endif
+
 threadlocal int32 str_compare_scope::ts_mode = str_compare_scope::exact;
 threadlocal bool str_compare_scope::ts_fuzzy_accents = false;
 
@@ -39,6 +45,162 @@ bool str_compare_scope::current_fuzzy_accents()
     return ts_fuzzy_accents;
 }
 
+//------------------------------------------------------------------------------
+int32 str_compare_fold(int32 c, int32 mode, bool fuzzy_accents, bool exact_slash)
+{
+    if (mode > str_compare_scope::exact)
+        c = (c > 0xffff) ? c : int32(uintptr_t(CharLowerW(LPWSTR(uintptr_t(c)))));
+    if (mode > str_compare_scope::caseless && c == '-')
+        c = '_';
+    if (!exact_slash && c == '\\')
+        c = '/';
+    if (fuzzy_accents)
+        c = normalize_accent(c);
+    return c;
+}
+
+#ifdef USE_SSE2
+//------------------------------------------------------------------------------
+// Can 16 bytes be loaded from P without reading past MAX bytes or, when the
+// string is nul terminated, crossing into a page that might not exist?
+static bool can_load_16(const char* p, uint32 max)
+{
+    if (max != UINT_MAX)
+        return max >= 16;
+    return (uintptr_t(p) & 0xfff) <= 0x1000 - 16;
+}
+
+//------------------------------------------------------------------------------
+static uint32 first_zero_bit(uint32 mask)
+{
+    unsigned long index;
+    _BitScanForward(&index, ~mask);
+    return index;
+}
+
+//------------------------------------------------------------------------------
+static __m128i fold_ascii_16(__m128i x, int32 mode, bool exact_slash)
+{
+    if (mode > str_compare_scope::exact)
+    {
+        const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('A' - 1)),
+                                            _mm_cmplt_epi8(x, _mm_set1_epi8('Z' + 1)));
+        x = _mm_or_si128(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+    }
+    if (mode > str_compare_scope::caseless)
+    {
+        const __m128i dash = _mm_cmpeq_epi8(x, _mm_set1_epi8('-'));
+        x = _mm_or_si128(_mm_andnot_si128(dash, x), _mm_and_si128(dash, _mm_set1_epi8('_')));
+    }
+    if (!exact_slash)
+    {
+        const __m128i backslash = _mm_cmpeq_epi8(x, _mm_set1_epi8('\\'));
+        x = _mm_or_si128(_mm_andnot_si128(backslash, x), _mm_and_si128(backslash, _mm_set1_epi8('/')));
+    }
+    return x;
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Returns the number of leading bytes that are ASCII and equal in LHS and RHS,
+// folded the same way str_compare_impl() folds them.  The result never ends
+// after a path separator, since str_compare_impl() must see the whole run of
+// separators to collapse it.
+uint32 str_compare_ascii_prefix(const char* lhs, uint32 lhs_max, const char* rhs, uint32 rhs_max, int32 mode, bool exact_slash)
+{
+    uint32 n = 0;
+
+#ifdef USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    while (can_load_16(lhs + n, (lhs_max == UINT_MAX) ? lhs_max : lhs_max - n) &&
+           can_load_16(rhs + n, (rhs_max == UINT_MAX) ? rhs_max : rhs_max - n))
+    {
+        const __m128i a = fold_ascii_16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + n)), mode, exact_slash);
+        const __m128i b = fold_ascii_16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + n)), mode, exact_slash);
+
+        // Equal, not nul, and not part of a multibyte sequence.
+        uint32 ok = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+        ok &= ~uint32(_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero)));
+        ok &= ~uint32(_mm_movemask_epi8(_mm_or_si128(a, b)));
+        ok &= 0xffff;
+
+        uint32 k = (ok == 0xffff) ? 16 : first_zero_bit(ok);
+        while (k && path::is_separator(lhs[n + k - 1]))
+            --k;
+
+        n += k;
+        if (k < 16)
+            break;
+    }
+#endif
+
+    return n;
+}
+
+//------------------------------------------------------------------------------
+// Returns the number of leading bytes in S that are ASCII and are neither C1
+// nor C2 (nor a path separator, if STOP_AT_SEPARATOR).
+uint32 str_scan_ascii_until(const char* s, uint32 max, char c1, char c2, bool stop_at_separator)
+{
+    uint32 n = 0;
+
+#ifdef USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i v1 = _mm_set1_epi8(c1);
+    const __m128i v2 = _mm_set1_epi8(c2);
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    while (can_load_16(s + n, (max == UINT_MAX) ? max : max - n))
+    {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + n));
+
+        __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(x, v1), _mm_cmpeq_epi8(x, v2));
+        stop = _mm_or_si128(stop, _mm_cmpeq_epi8(x, zero));
+        if (stop_at_separator)
+            stop = _mm_or_si128(stop, _mm_or_si128(_mm_cmpeq_epi8(x, slash), _mm_cmpeq_epi8(x, backslash)));
+
+        // Bytes >= 0x80 set their own high bit.
+        const uint32 mask = uint32(_mm_movemask_epi8(_mm_or_si128(stop, x)));
+        if (mask)
+        {
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return n + index;
+        }
+
+        n += 16;
+    }
+#endif
+
+    return n;
+}
+
+//------------------------------------------------------------------------------
+uint32 str_scan_plain_ascii(const char* s, uint32 max)
+{
+    uint32 n = 0;
+
+#ifdef USE_SSE2
+    const __m128i space = _mm_set1_epi8(' ' - 1);
+    while (can_load_16(s + n, (max == UINT_MAX) ? max : max - n))
+    {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + n));
+
+        // Signed compare:  bytes >= 0x80 are negative, so they also stop.
+        const uint32 plain = uint32(_mm_movemask_epi8(_mm_cmpgt_epi8(x, space)));
+        if (plain != 0xffff)
+            return n + first_zero_bit(plain);
+
+        n += 16;
+    }
+#endif
+
+    while (n < max && uint8(s[n]) >= 0x20 && uint8(s[n]) < 0x80)
+        ++n;
+
+    return n;
+}
+
 //------------------------------------------------------------------------------
 int32 normalize_accent(int32 c)
 {
@@ -377,6 +539,11 @@ int32 normalize_accent(int32 c)
     }
 #endif
 
+    // Most text is ASCII, and nothing below the first accented character
+    // needs the binary search.
+    if (c < fuzzy_accent_map[0].accent)
+        return c;
+
     int32 lo = 0;
     int32 hi = sizeof_array(fuzzy_accent_map);
 
@@ -9,6 +9,12 @@
 #include <assert.h>
 #endif
 
+#if defined(_M_X64) || defined(_M_IX86)
+#define USE_SSE2
+#include <emmintrin.h>
+#include <intrin.h>
+#endif
+
 //------------------------------------------------------------------------------
 template <typename TYPE>
 struct builder
@@ -62,6 +68,105 @@ builder<char>& builder<char>::operator << (int32 value)
 
 
 
+#ifdef USE_SSE2
+//------------------------------------------------------------------------------
+// Can 16 bytes be loaded from P without reading past MAX bytes or, when the
+// string is nul terminated, crossing into a page that might not exist?
+static bool can_load_16(const void* p, uint32 max)
+{
+    if (max != UINT_MAX)
+        return max >= 16;
+    return (uintptr_t(p) & 0xfff) <= 0x1000 - 16;
+}
+
+//------------------------------------------------------------------------------
+static uint32 first_set_bit(uint32 mask)
+{
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Copies the run of ASCII characters at the start of IN into OUT (or only
+// counts them if OUT is null), 16 at a time where possible.  MAX_IN is the
+// number of units IN may be read (UINT_MAX when nul terminated), and ROOM is
+// how many units OUT has room for.  Stops at the first nul or non-ASCII unit.
+static uint32 widen_ascii(const char* in, uint32 max_in, wchar_t* out, uint32 room)
+{
+    const uint32 limit = min(max_in, room);
+    uint32 n = 0;
+
+#ifdef USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    while (limit - n >= 16 && can_load_16(in + n, max_in == UINT_MAX ? UINT_MAX : max_in - n))
+    {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + n));
+        const uint32 stop = _mm_movemask_epi8(chunk) | _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero));
+        const uint32 count = stop ? first_set_bit(stop) : 16;
+        if (out)
+        {
+            // Storing all 16 is fine, since ROOM allows it and anything past
+            // COUNT gets overwritten later.
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + n), _mm_unpacklo_epi8(chunk, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + n + 8), _mm_unpackhi_epi8(chunk, zero));
+        }
+        n += count;
+        if (stop)
+            return n;
+    }
+#endif
+
+    for (; n < limit; ++n)
+    {
+        const uint8 c = in[n];
+        if (!c || c >= 0x80)
+            break;
+        if (out)
+            out[n] = c;
+    }
+    return n;
+}
+
+//------------------------------------------------------------------------------
+// The reverse of widen_ascii().
+static uint32 narrow_ascii(const wchar_t* in, uint32 max_in, char* out, uint32 room)
+{
+    const uint32 limit = min(max_in, room);
+    uint32 n = 0;
+
+#ifdef USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i high = _mm_set1_epi16(short(0xff80));
+    while (limit - n >= 8 && can_load_16(in + n, max_in == UINT_MAX ? UINT_MAX : (max_in - n) * 2))
+    {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + n));
+        const __m128i bad = _mm_or_si128(_mm_cmpeq_epi16(chunk, zero),
+                                         _mm_xor_si128(_mm_cmpeq_epi16(_mm_and_si128(chunk, high), zero), _mm_set1_epi16(-1)));
+        const uint32 stop = _mm_movemask_epi8(bad);
+        const uint32 count = stop ? first_set_bit(stop) / 2 : 8;
+        if (out)
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + n), _mm_packus_epi16(chunk, chunk));
+        n += count;
+        if (stop)
+            return n;
+    }
+#endif
+
+    for (; n < limit; ++n)
+    {
+        const wchar_t c = in[n];
+        if (!c || c >= 0x80)
+            break;
+        if (out)
+            out[n] = char(c);
+    }
+    return n;
+}
+
+
+
 //------------------------------------------------------------------------------
 int32 to_utf8(char* out, int32 max_count, wstr_iter& iter)
 {
@@ -98,8 +203,16 @@ int32 to_utf8(char* out, int32 max_count, wstr_iter& iter)
     builder<char> builder(out, max_count);
 
     int32 c;
-    while (!builder.truncated() && (c = iter.next()))
+    while (!builder.truncated())
     {
+        // Runs of ASCII are common, and convert in bulk.
+        const uint32 room = builder.start ? uint32(builder.end - builder.write) : UINT_MAX;
+        const uint32 ascii = narrow_ascii(iter.get_pointer(), iter.max_units(), builder.start ? builder.write : nullptr, room);
+        iter.skip_units(ascii);
+        builder.write += ascii;
+        if (builder.truncated() || !(c = iter.next()))
+            break;
+
         if (c < 0x80)
         {
             builder << c;
@@ -157,6 +270,13 @@ int32 to_utf8(str_base& out, const wchar_t* utf16)
     return to_utf8(out, iter);
 }
 
+//------------------------------------------------------------------------------
+int32 utf8_length(const wchar_t* utf16, int32 len)
+{
+    wstr_iter iter(utf16, len);
+    return to_utf8(nullptr, 0, iter);
+}
+
 
 
 //------------------------------------------------------------------------------
@@ -199,8 +319,18 @@ int32 to_utf16(wchar_t* out, int32 max_count, str_iter& iter)
     builder<wchar_t> builder(out, max_count);
 
     int32 c;
-    while (!builder.truncated() && (c = iter.next()))
+    while (!builder.truncated())
+    {
+        // Runs of ASCII are common, and convert in bulk.
+        const uint32 room = builder.start ? uint32(builder.end - builder.write) : UINT_MAX;
+        const uint32 ascii = widen_ascii(iter.get_pointer(), iter.max_units(), builder.start ? builder.write : nullptr, room);
+        iter.skip_units(ascii);
+        builder.write += ascii;
+        if (builder.truncated() || !(c = iter.next()))
+            break;
+
         builder << c;
+    }
 
     return builder.get_written();
 }
@@ -233,3 +363,10 @@ int32 to_utf16(wstr_base& out, const char* utf8)
     str_iter iter(utf8);
     return to_utf16(out, iter);
 }
+
+//------------------------------------------------------------------------------
+int32 utf16_length(const char* utf8, int32 len)
+{
+    str_iter iter(utf8, len);
+    return to_utf16(nullptr, 0, iter);
+}
@@ -0,0 +1,616 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "zip.h"
+#include "os.h"
+#include "path.h"
+#include "str.h"
+#include "log.h"
+
+#include <memory>
+
+//------------------------------------------------------------------------------
+// Raw deflate decoder (RFC 1951).  This favors simplicity over speed; release
+// zip files are only a few megabytes, so decoding one code bit at a time is
+// plenty fast enough.
+namespace {
+
+struct huffman
+{
+    uint16              counts[16];     // Number of codes of each length.
+    uint16              symbols[288];   // Symbols ordered by code.
+};
+
+class inflater
+{
+public:
+                        inflater(const uint8* in, size_t len, std::vector<uint8>& out, size_t max_out);
+    bool                run();
+
+private:
+    bool                bits(uint32 need, uint32& val);
+    bool                room(size_t len) const { return m_max_out - m_out.size() >= len; }
+    bool                decode(const huffman& h, int32& sym);
+    bool                stored();
+    bool                codes(const huffman& lit, const huffman& dist);
+    bool                fixed();
+    bool                dynamic();
+    static bool         build(huffman& h, const uint8* lengths, uint32 n);
+    const uint8* const  m_in;
+    const size_t        m_len;
+    size_t              m_pos = 0;
+    uint32              m_bitbuf = 0;
+    uint32              m_bitcnt = 0;
+    std::vector<uint8>& m_out;
+    const size_t        m_max_out;
+};
+
+//------------------------------------------------------------------------------
+inflater::inflater(const uint8* in, size_t len, std::vector<uint8>& out, size_t max_out)
+: m_in(in)
+, m_len(len)
+, m_out(out)
+, m_max_out(max_out)
+{
+}
+
+//------------------------------------------------------------------------------
+bool inflater::run()
+{
+    uint32 last;
+    do
+    {
+        uint32 type;
+        if (!bits(1, last) || !bits(2, type))
+            return false;
+
+        bool ok;
+        switch (type)
+        {
+        case 0:     ok = stored(); break;
+        case 1:     ok = fixed(); break;
+        case 2:     ok = dynamic(); break;
+        default:    ok = false; break;
+        }
+
+        if (!ok)
+            return false;
+    }
+    while (!last);
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool inflater::bits(uint32 need, uint32& val)
+{
+    uint32 buf = m_bitbuf;
+    while (m_bitcnt < need)
+    {
+        if (m_pos >= m_len)
+            return false;
+        buf |= uint32(m_in[m_pos++]) << m_bitcnt;
+        m_bitcnt += 8;
+    }
+
+    val = buf & ((1u << need) - 1);
+    m_bitbuf = buf >> need;
+    m_bitcnt -= need;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Codes are canonical, so a code of a given length is the next value after the
+// codes of that length that precede it; walking one bit at a time finds the
+// length where the code falls inside the range for that length.
+bool inflater::decode(const huffman& h, int32& sym)
+{
+    int32 code = 0;
+    int32 first = 0;
+    int32 index = 0;
+    for (int32 len = 1; len < 16; ++len)
+    {
+        uint32 bit;
+        if (!bits(1, bit))
+            return false;
+        code |= bit;
+
+        const int32 count = h.counts[len];
+        if (code - count < first)
+        {
+            sym = h.symbols[index + (code - first)];
+            return true;
+        }
+
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+
+    return false;
+}
+
+//------------------------------------------------------------------------------
+bool inflater::build(huffman& h, const uint8* lengths, uint32 n)
+{
+    memset(h.counts, 0, sizeof(h.counts));
+    for (uint32 sym = 0; sym < n; ++sym)
+        h.counts[lengths[sym]]++;
+    if (h.counts[0] == n)
+        return true;
+
+    // Reject over-subscribed codes.  Incomplete codes are allowed; decoding a
+    // missing code fails instead.
+    int32 left = 1;
+    for (uint32 len = 1; len < 16; ++len)
+    {
+        left = (left << 1) - h.counts[len];
+        if (left < 0)
+            return false;
+    }
+
+    uint16 offsets[16];
+    offsets[1] = 0;
+    for (uint32 len = 1; len < 15; ++len)
+        offsets[len + 1] = offsets[len] + h.counts[len];
+
+    for (uint32 sym = 0; sym < n; ++sym)
+    {
+        if (lengths[sym])
+            h.symbols[offsets[lengths[sym]]++] = uint16(sym);
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool inflater::stored()
+{
+    // Stored blocks start at a byte boundary.
+    m_bitbuf = 0;
+    m_bitcnt = 0;
+
+    if (m_len - m_pos < 4)
+        return false;
+    const uint32 len = m_in[m_pos] | (m_in[m_pos + 1] << 8);
+    const uint32 nlen = m_in[m_pos + 2] | (m_in[m_pos + 3] << 8);
+    if (len != (~nlen & 0xffff))
+        return false;
+    m_pos += 4;
+
+    if (m_len - m_pos < len || !room(len))
+        return false;
+    m_out.insert(m_out.end(), m_in + m_pos, m_in + m_pos + len);
+    m_pos += len;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool inflater::codes(const huffman& lit, const huffman& dist)
+{
+    static const uint16 c_len_base[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8 c_len_extra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16 c_dist_base[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+        8193, 12289, 16385, 24577 };
+    static const uint8 c_dist_extra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    while (true)
+    {
+        int32 sym;
+        if (!decode(lit, sym))
+            return false;
+
+        if (sym < 256)
+        {
+            if (!room(1))
+                return false;
+            m_out.push_back(uint8(sym));
+            continue;
+        }
+        if (sym == 256)
+            return true;
+
+        sym -= 257;
+        if (sym >= 29)
+            return false;
+        uint32 extra;
+        if (!bits(c_len_extra[sym], extra))
+            return false;
+        const uint32 len = c_len_base[sym] + extra;
+
+        if (!decode(dist, sym) || sym >= 30)
+            return false;
+        if (!bits(c_dist_extra[sym], extra))
+            return false;
+        const uint32 distance = c_dist_base[sym] + extra;
+        if (distance > m_out.size() || !room(len))
+            return false;
+
+        // The copy may overlap the bytes it produces, so copy a byte at a
+        // time (by index, since push_back may reallocate).
+        const size_t from = m_out.size() - distance;
+        for (uint32 i = 0; i < len; ++i)
+            m_out.push_back(m_out[from + i]);
+    }
+}
+
+//------------------------------------------------------------------------------
+bool inflater::fixed()
+{
+    uint8 lengths[288 + 30];
+    uint32 sym = 0;
+    for (; sym < 144; ++sym) lengths[sym] = 8;
+    for (; sym < 256; ++sym) lengths[sym] = 9;
+    for (; sym < 280; ++sym) lengths[sym] = 7;
+    for (; sym < 288; ++sym) lengths[sym] = 8;
+    for (; sym < 288 + 30; ++sym) lengths[sym] = 5;
+
+    huffman lit;
+    huffman dist;
+    build(lit, lengths, 288);
+    build(dist, lengths + 288, 30);
+    return codes(lit, dist);
+}
+
+//------------------------------------------------------------------------------
+bool inflater::dynamic()
+{
+    static const uint8 c_order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    uint32 nlen, ndist, ncode;
+    if (!bits(5, nlen) || !bits(5, ndist) || !bits(4, ncode))
+        return false;
+    nlen += 257;
+    ndist += 1;
+    ncode += 4;
+    if (nlen > 286 || ndist > 30)
+        return false;
+
+    uint8 lengths[286 + 30] = {};
+    for (uint32 i = 0; i < ncode; ++i)
+    {
+        uint32 len;
+        if (!bits(3, len))
+            return false;
+        lengths[c_order[i]] = uint8(len);
+    }
+
+    huffman lencode;
+    if (!build(lencode, lengths, 19))
+        return false;
+
+    // Read the literal/length and distance code lengths, which are themselves
+    // coded, including run lengths that may cross from one set to the other.
+    uint32 index = 0;
+    while (index < nlen + ndist)
+    {
+        int32 sym;
+        if (!decode(lencode, sym))
+            return false;
+
+        if (sym < 16)
+        {
+            lengths[index++] = uint8(sym);
+            continue;
+        }
+
+        uint8 len = 0;
+        uint32 repeat;
+        if (sym == 16)
+        {
+            if (!index || !bits(2, repeat))
+                return false;
+            len = lengths[index - 1];
+            repeat += 3;
+        }
+        else if (sym == 17)
+        {
+            if (!bits(3, repeat))
+                return false;
+            repeat += 3;
+        }
+        else
+        {
+            if (!bits(7, repeat))
+                return false;
+            repeat += 11;
+        }
+
+        if (index + repeat > nlen + ndist)
+            return false;
+        while (repeat--)
+            lengths[index++] = len;
+    }
+
+    // Without an end-of-block code the block can't end.
+    if (!lengths[256])
+        return false;
+
+    huffman lit;
+    huffman dist;
+    if (!build(lit, lengths, nlen) || !build(dist, lengths + nlen, ndist))
+        return false;
+    return codes(lit, dist);
+}
+
+}
+
+
+
+//------------------------------------------------------------------------------
+bool zip_inflate(const uint8* in, size_t in_len, std::vector<uint8>& out, size_t max_out)
+{
+    // Output already present counts toward the limit.
+    if (out.size() > max_out)
+        return false;
+
+    inflater inflater(in, in_len, out, max_out);
+    return inflater.run();
+}
+
+//------------------------------------------------------------------------------
+uint32 zip_crc32(const uint8* data, size_t len, uint32 crc)
+{
+    static const struct crc_table
+    {
+        crc_table()
+        {
+            for (uint32 i = 0; i < 256; ++i)
+            {
+                uint32 c = i;
+                for (int32 k = 0; k < 8; ++k)
+                    c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+                table[i] = c;
+            }
+        }
+        uint32 table[256];
+    } s_crc;
+
+    crc = ~crc;
+    while (len--)
+        crc = s_crc.table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+
+
+//------------------------------------------------------------------------------
+static uint32 read16(const uint8* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+//------------------------------------------------------------------------------
+static uint32 read32(const uint8* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32(p[3]) << 24);
+}
+
+//------------------------------------------------------------------------------
+static bool read_whole_file(const char* name, std::vector<uint8>& out)
+{
+    wstr<280> wname(name);
+    HANDLE h = CreateFileW(wname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+
+    bool ok = false;
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(h, &size) && size.QuadPart < 0x7fffffff)
+    {
+        out.resize(size_t(size.QuadPart));
+        DWORD read = 0;
+        ok = (!out.size() || ReadFile(h, out.data(), DWORD(out.size()), &read, nullptr)) && read == out.size();
+    }
+
+    CloseHandle(h);
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+static bool write_whole_file(const char* name, const uint8* data, size_t len)
+{
+    wstr<280> wname(name);
+    HANDLE h = CreateFileW(wname.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+
+    DWORD written = 0;
+    const bool ok = (!len || WriteFile(h, data, DWORD(len), &written, nullptr)) && written == len;
+    CloseHandle(h);
+    if (!ok)
+        DeleteFileW(wname.c_str());
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+// Rejects names that could write outside the output directory.
+static bool is_safe_entry_name(const char* name)
+{
+    if (!*name || *name == '/' || *name == '\\' || strchr(name, ':'))
+        return false;
+
+    for (const char* p = name; *p;)
+    {
+        const char* end = p;
+        while (*end && *end != '/' && *end != '\\')
+            ++end;
+        if (end - p == 2 && p[0] == '.' && p[1] == '.')
+            return false;
+        p = *end ? end + 1 : end;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool unzip_file(const char* zip, const char* out_dir, str_base& error)
+{
+    std::vector<uint8> data;
+    if (!read_whole_file(zip, data))
+    {
+        error.format("unable to read '%s'", zip);
+        return false;
+    }
+
+    // Find the end of central directory record; it's followed by a comment
+    // of up to 64KB.
+    const size_t c_eocd_size = 22;
+    const uint8* eocd = nullptr;
+    if (data.size() >= c_eocd_size)
+    {
+        const size_t stop = (data.size() > c_eocd_size + 0xffff) ? data.size() - c_eocd_size - 0xffff : 0;
+        for (size_t i = data.size() - c_eocd_size + 1; i-- > stop;)
+        {
+            if (read32(data.data() + i) == 0x06054b50)
+            {
+                eocd = data.data() + i;
+                break;
+            }
+        }
+    }
+    if (!eocd)
+    {
+        error = "not a zip file";
+        return false;
+    }
+
+    const uint32 count = read16(eocd + 10);
+    size_t offset = read32(eocd + 16);
+
+    str<280> out;
+    std::vector<uint8> inflated;
+    for (uint32 i = 0; i < count; ++i)
+    {
+        const uint8* p = data.data() + offset;
+        if (offset + 46 > data.size() || read32(p) != 0x02014b50)
+        {
+            error = "corrupt central directory";
+            return false;
+        }
+
+        const uint32 flags = read16(p + 8);
+        const uint32 method = read16(p + 10);
+        const uint32 crc = read32(p + 16);
+        const size_t comp_size = read32(p + 20);
+        const size_t size = read32(p + 24);
+        const uint32 name_len = read16(p + 28);
+        const uint32 extra_len = read16(p + 30);
+        const uint32 comment_len = read16(p + 32);
+        const size_t local = read32(p + 42);
+        if (offset + 46 + name_len > data.size())
+        {
+            error = "corrupt central directory";
+            return false;
+        }
+
+        str<280> name;
+        name.concat(reinterpret_cast<const char*>(p + 46), name_len);
+        offset += 46 + name_len + extra_len + comment_len;
+
+        if (!is_safe_entry_name(name.c_str()))
+        {
+            error.format("unsafe file name '%s'", name.c_str());
+            return false;
+        }
+        if (flags & 0x0001)
+        {
+            error.format("'%s' is encrypted", name.c_str());
+            return false;
+        }
+        if (comp_size == 0xffffffff || size == 0xffffffff || local == 0xffffffff)
+        {
+            error.format("'%s' requires zip64", name.c_str());
+            return false;
+        }
+
+        out = out_dir;
+        path::append(out, name.c_str());
+        path::normalise(out);
+
+        // Directory entry.
+        if (name.c_str()[name.length() - 1] == '/')
+        {
+            if (!os::make_dir(out.c_str()))
+            {
+                error.format("unable to create directory '%s'", out.c_str());
+                return false;
+            }
+            continue;
+        }
+
+        // Locate the data via the local header, whose name and extra field
+        // lengths can differ from the central directory's.
+        const uint8* l = data.data() + local;
+        if (local + 30 > data.size() || read32(l) != 0x04034b50)
+        {
+            error.format("corrupt local header for '%s'", name.c_str());
+            return false;
+        }
+        const size_t start = local + 30 + read16(l + 26) + read16(l + 28);
+        if (start > data.size() || data.size() - start < comp_size)
+        {
+            error.format("truncated data for '%s'", name.c_str());
+            return false;
+        }
+
+        const uint8* contents = data.data() + start;
+        if (method == 8)
+        {
+            inflated.clear();
+            // Deflate can't expand data more than 1032:1, so don't trust a
+            // declared size beyond that when reserving memory.
+            inflated.reserve(min<size_t>(size, comp_size * 1032));
+            if (!zip_inflate(contents, comp_size, inflated, size))
+            {
+                error.format("unable to inflate '%s'", name.c_str());
+                return false;
+            }
+            contents = inflated.data();
+        }
+        else if (method != 0)
+        {
+            error.format("'%s' uses unsupported compression method %u", name.c_str(), method);
+            return false;
+        }
+
+        // The entry must be exactly the size the central directory says.
+        const size_t len = (method == 8) ? inflated.size() : comp_size;
+        if (len != size)
+        {
+            error.format("size mismatch for '%s'", name.c_str());
+            return false;
+        }
+        if (zip_crc32(contents, len) != crc)
+        {
+            error.format("checksum mismatch for '%s'", name.c_str());
+            return false;
+        }
+
+        str<280> parent(out.c_str());
+        if (path::to_parent(parent, nullptr) && !os::make_dir(parent.c_str()))
+        {
+            error.format("unable to create directory '%s'", parent.c_str());
+            return false;
+        }
+
+        if (!write_whole_file(out.c_str(), contents, len))
+        {
+            error.format("unable to write '%s'; error %u", out.c_str(), GetLastError());
+            return false;
+        }
+    }
+
+    LOG("Expanded %u entries from '%s' into '%s'.", count, zip, out_dir);
+    return true;
+}
@@ -62,3 +62,25 @@ TEST_CASE("linear_allocator: calloc")
     REQUIRE(allocator.fits(sizeof(int32) * 7));
     REQUIRE(!allocator.fits(sizeof(int32) * 7 + 1));
 }
+
+//------------------------------------------------------------------------------
+TEST_CASE("linear_allocator: growth")
+{
+    linear_allocator allocator(1024);
+
+    // Needing more than a few pages makes the next cycle use bigger pages.
+    for (int32 i = 0; i < 64; ++i)
+        REQUIRE(allocator.alloc(100) != nullptr);
+    REQUIRE(allocator.footprint() == 7 * 1024);
+
+    allocator.reset();
+    REQUIRE(allocator.footprint() == 0);
+    REQUIRE(allocator.alloc(100) != nullptr);
+    REQUIRE(allocator.footprint() == 2048);
+
+    // Needing only one page keeps it.
+    allocator.reset();
+    REQUIRE(allocator.footprint() == 2048);
+    REQUIRE(allocator.alloc(100) != nullptr);
+    REQUIRE(allocator.footprint() == 2048);
+}
@@ -95,4 +95,17 @@ TEST_CASE("path::match_wild()")
         REQUIRE(path::match_wild("*st*", "origin/master", false, path::star_matches_everything::yes));
         REQUIRE(!path::match_wild("*st*", "origin/master", false, path::star_matches_everything::at_end));
     }
+
+    SECTION("Long names")
+    {
+        str_compare_scope _(str_compare_scope::caseless, false);
+
+        REQUIRE(path::match_wild("*Z", "abcdefghijklmnopqrstuvwxyz"));
+        REQUIRE(path::match_wild("*xyz.txt", "abcdefghijklmnopqrstuvwxyz.TXT"));
+        REQUIRE(!path::match_wild("*q", "abcdefghijklmnopqrstuvwxyz"));
+        REQUIRE(!path::match_wild("*z", "abcdefghijklmnopqrstuvwxy/z"));
+        REQUIRE(path::match_wild("*z", "abcdefghijklmnopqrstuvwxy/z", false, path::star_matches_everything::yes));
+        REQUIRE(path::match_wild("*/z", "abcdefghijklmnopqrstuvwxy\\z"));
+        REQUIRE(path::match_wild("*z", "abcdefghijklmnop\xc2\x80qrstuvwxyz"));
+    }
 }
@@ -699,3 +699,38 @@ TEST_CASE("path::normalise() 2")
     test("//?/UNC/foo/bar/..", "//?/UNC/foo/bar");
     test("//?/UNC/foo/bar/../abc", "//?/UNC/foo/bar/abc");
 }
+
+//------------------------------------------------------------------------------
+TEST_CASE("path fixed buffers")
+{
+    SECTION("Join")
+    {
+        char buffer[16];
+
+        REQUIRE(path::join("one/two", "three", buffer));
+        REQUIRE(strcmp(buffer, "one/two\\three") == 0);
+
+        REQUIRE(path::join("x:", "one", buffer));
+        REQUIRE(strcmp(buffer, "x:one") == 0);
+
+        REQUIRE(path::join("one", "/rooted", buffer));
+        REQUIRE(strcmp(buffer, "/rooted") == 0);
+
+        REQUIRE(!path::join("one/two/three", "four", buffer));
+        REQUIRE(buffer[0] == '\0');
+
+        REQUIRE(!path::join("0123456789abcdefgh", "", buffer));
+        REQUIRE(buffer[0] == '\0');
+    }
+
+    SECTION("Normalise")
+    {
+        char buffer[16];
+
+        REQUIRE(path::normalise("a:/1/x/../2/", buffer, '/'));
+        REQUIRE(strcmp(buffer, "a:/1/2/") == 0);
+
+        REQUIRE(!path::normalise("a:/0123456789abcdef", buffer));
+        REQUIRE(buffer[0] == '\0');
+    }
+}
@@ -68,6 +68,33 @@ TEST_CASE("settings : list")
     REQUIRE(settings::first().next() == first);
 }
 
+//------------------------------------------------------------------------------
+TEST_CASE("settings : find")
+{
+    REQUIRE(settings::find("!find.one") == nullptr);
+
+    const uint32 generation = settings::get_registry_generation();
+    {
+        setting_int one("!find.one", "", "", 1);
+        REQUIRE(settings::get_registry_generation() != generation);
+        REQUIRE(settings::find("!find.one") == &one);
+        REQUIRE(settings::find("!FIND.One") == &one);
+        REQUIRE(settings::find("!find.on") == nullptr);
+        REQUIRE(settings::find("!find.two") == nullptr);
+
+        {
+            setting_int two("!find.two", "", "", 2);
+            REQUIRE(settings::find("!find.one") == &one);
+            REQUIRE(settings::find("!find.two") == &two);
+        }
+
+        REQUIRE(settings::find("!find.one") == &one);
+        REQUIRE(settings::find("!find.two") == nullptr);
+    }
+
+    REQUIRE(settings::find("!find.one") == nullptr);
+}
+
 //------------------------------------------------------------------------------
 TEST_CASE("settings : bool")
 {
@@ -214,6 +214,29 @@ TEST_CASE("Strings" NAME_SUFFIX)
         REQUIRE(z.c_str() != a_empty);
         REQUIRE(z.c_str() != b_empty);
     }
+
+    SECTION("Compact")
+    {
+        str_compact a;
+        REQUIRE(sizeof(a) == 24);
+        REQUIRE(a.is_growable());
+
+        // Short strings are inline, and moving them copies them.
+        a = STR("abc");
+        const auto* inline_a = a.c_str();
+        str_compact b(std::move(a));
+        REQUIRE(b.equals(STR("abc")));
+        REQUIRE(b.c_str() != inline_a);
+
+        // Long strings are allocated, and moving them moves the pointer.
+        b = STR("a string too long to be stored inline");
+        const auto* heap_b = b.c_str();
+        str_compact c;
+        c = std::move(b);
+        REQUIRE(c.c_str() == heap_b);
+        REQUIRE(c.equals(STR("a string too long to be stored inline")));
+        REQUIRE(b.empty());
+    }
 }
 
 #undef STR
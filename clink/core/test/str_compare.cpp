@@ -118,4 +118,20 @@ TEST_CASE("String compare")
         REQUIRE(str_compare(L"abc123", L"abc123") == -1);
         REQUIRE(str_compare(L"\xd800\xdc00" L"abc", L"\xd800\xdc00") == 2);
     }
+
+    SECTION("Long strings")
+    {
+        str_compare_scope _(str_compare_scope::relaxed, false);
+
+        REQUIRE(str_compare("abcdefghijklmnopqrstuvwxyz-0123456789", "ABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789") == -1);
+        REQUIRE(str_compare("abcdefghijklmnopqrstuvwxyz-0123456789", "ABCDEFGHIJKLMNOPQRSTUVWXYZ_012345678") == 36);
+        REQUIRE(str_compare("abcdefghijklmnopqrstuvwxyz-0123456789", "abcdefghijklmnopqrstuvwxyz_0123x56789") == 31);
+        REQUIRE(str_compare("abcdefghijklmno\\\\pqrstuvwxyz", "abcdefghijklmno/pqrstuvwxyz") == -1);
+        REQUIRE(str_compare("abcdefghijklmnop\xc2\x80qrstuvwxyz", "abcdefghijklmnop\xc2\x80qrstuvwxyz") == -1);
+
+        str_iter lhs_iter("abcdefghijklmnopqrstuvwxyz0123456789", 20);
+        str_iter rhs_iter("abcdefghijklmnopqrstuvwxyz0123456789");
+        REQUIRE(str_compare(lhs_iter, rhs_iter) == 20);
+        REQUIRE(rhs_iter.peek() == 'u');
+    }
 }
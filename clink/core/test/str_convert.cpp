@@ -167,4 +167,30 @@ TEST_CASE("Wide character/UTF-8 conversion")
             REQUIRE(!iter.more());
         }
     }
+
+    SECTION("Mixed runs")
+    {
+        // Long enough to use the 16 at a time path on both sides of the
+        // non-ASCII characters.
+        const char* utf8 = "0123456789abcdefghij\xc2\x80klmnopqrstuvwxyz0123456789\xf0\x90\x80\x80" "ABCDEFGHIJKLMNOPQRSTUV";
+        const wchar_t* utf16 = L"0123456789abcdefghij\x0080klmnopqrstuvwxyz0123456789\xd800\xdc00" L"ABCDEFGHIJKLMNOPQRSTUV";
+
+        REQUIRE(utf16_length(utf8) == int32(wcslen(utf16)));
+        REQUIRE(utf8_length(utf16) == int32(strlen(utf8)));
+        REQUIRE(utf16_length(utf8, 20) == 20);
+        REQUIRE(utf8_length(utf16, 21) == 22);
+
+        wstr<> w;
+        w.from_utf8(utf8);
+        REQUIRE(w.equals(utf16));
+
+        str<> s;
+        s.from_utf16(utf16);
+        REQUIRE(s.equals(utf8));
+
+        wstr<24, false> wt;
+        wt.from_utf8(utf8);
+        REQUIRE(wt.length() == 23);
+        REQUIRE(wt.equals(L"0123456789abcdefghij\x0080kl"));
+    }
 }
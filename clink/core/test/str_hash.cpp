@@ -0,0 +1,41 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+
+#include <core/str_hash.h>
+
+//------------------------------------------------------------------------------
+TEST_CASE("String hash")
+{
+    SECTION("Fold ASCII")
+    {
+        // Every byte value, in every position within the word.
+        for (uint32 c = 0; c < 256; ++c)
+        {
+            const uint8 expected = uint8((c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c);
+            for (uint32 shift = 0; shift < 64; shift += 8)
+            {
+                const uint64 w = (uint64(c) << shift) | (uint64('Q') << ((shift + 8) % 64));
+                const uint64 folded = fast_hash_fold_ascii(w);
+                REQUIRE(uint8(folded >> shift) == expected);
+            }
+        }
+    }
+
+    SECTION("Case insensitive")
+    {
+        REQUIRE(str_fast_ihash("C:\\Program Files\\Clink") == str_fast_ihash("c:\\program files\\CLINK"));
+        REQUIRE(str_fast_ihash("ABC") == str_fast_ihash("abc"));
+        REQUIRE(str_fast_ihash("@[`{") != str_fast_ihash("`{@["));
+        REQUIRE(str_fast_hash("ABC") != str_fast_hash("abc"));
+    }
+
+    SECTION("Length")
+    {
+        REQUIRE(str_fast_hash("abcdefgh", 4) == str_fast_hash("abcd"));
+        REQUIRE(str_fast_hash("abcdefghijk", 9) == str_fast_hash("abcdefghi"));
+        REQUIRE(str_fast_hash("a") != str_fast_hash(""));
+        REQUIRE(wstr_fast_hash(L"abc") == wstr_fast_hash(L"abcdef", 3));
+    }
+}
@@ -7,8 +7,10 @@
 
 #define str             wstr
 #define str_moveable    wstr_moveable
+#define str_compact     wstr_compact
 #define STR(x)          L##x
 #define NAME_SUFFIX     " (wchar_t)"
 #include "str.cpp"
 #undef str
 #undef str_moveable
+#undef str_compact
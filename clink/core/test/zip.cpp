@@ -0,0 +1,78 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+
+#include <core/zip.h>
+
+#include <string>
+
+//------------------------------------------------------------------------------
+static bool inflate_to_string(const uint8* in, size_t len, std::string& out, size_t max_out=size_t(-1))
+{
+    std::vector<uint8> bytes;
+    const bool ok = zip_inflate(in, len, bytes, max_out);
+    out.assign(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+TEST_CASE("Zip")
+{
+    SECTION("CRC32")
+    {
+        REQUIRE(zip_crc32(reinterpret_cast<const uint8*>("123456789"), 9) == 0xcbf43926);
+        REQUIRE(zip_crc32(reinterpret_cast<const uint8*>("56789"), 5,
+                          zip_crc32(reinterpret_cast<const uint8*>("1234"), 4)) == 0xcbf43926);
+    }
+
+    SECTION("Stored")
+    {
+        static const uint8 c_data[] = {
+            0x01, 0x06, 0x00, 0xf9, 0xff, 0x73, 0x74, 0x6f, 0x72, 0x65, 0x64 };
+        std::string out;
+        REQUIRE(inflate_to_string(c_data, sizeof(c_data), out));
+        REQUIRE(out == "stored");
+    }
+
+    SECTION("Fixed codes")
+    {
+        static const uint8 c_data[] = {
+            0x73, 0xce, 0xc9, 0xcc, 0xcb, 0x56, 0x70, 0x46, 0x27, 0x15, 0x01 };
+        std::string out;
+        REQUIRE(inflate_to_string(c_data, sizeof(c_data), out));
+        REQUIRE(out == "Clink Clink Clink Clink!");
+        REQUIRE(zip_crc32(reinterpret_cast<const uint8*>(out.c_str()), out.length()) == 0xcd28d832);
+    }
+
+    SECTION("Overlapping copy")
+    {
+        static const uint8 c_data[] = {
+            0x4b, 0x4c, 0x4a, 0x4e, 0x44, 0x45, 0x5c, 0x89, 0xe4, 0x0a, 0x01, 0x00 };
+        std::string out;
+        REQUIRE(inflate_to_string(c_data, sizeof(c_data), out));
+        REQUIRE(out == "abcabcabcabcabcabc\nabcabcabcabcabcabc\nabcabcabcabcabcabc\nabcabcabcabcabcabc\n");
+    }
+
+    SECTION("Output limit")
+    {
+        static const uint8 c_stored[] = {
+            0x01, 0x06, 0x00, 0xf9, 0xff, 0x73, 0x74, 0x6f, 0x72, 0x65, 0x64 };
+        static const uint8 c_fixed[] = {
+            0x73, 0xce, 0xc9, 0xcc, 0xcb, 0x56, 0x70, 0x46, 0x27, 0x15, 0x01 };
+        std::string out;
+        REQUIRE(inflate_to_string(c_stored, sizeof(c_stored), out, 6));
+        REQUIRE(!inflate_to_string(c_stored, sizeof(c_stored), out, 5));
+        REQUIRE(inflate_to_string(c_fixed, sizeof(c_fixed), out, 24));
+        REQUIRE(!inflate_to_string(c_fixed, sizeof(c_fixed), out, 23));
+        REQUIRE(out.length() <= 23);
+    }
+
+    SECTION("Truncated")
+    {
+        static const uint8 c_data[] = {
+            0x73, 0xce, 0xc9, 0xcc, 0xcb, 0x56, 0x70 };
+        std::string out;
+        REQUIRE(!inflate_to_string(c_data, sizeof(c_data), out));
+    }
+}
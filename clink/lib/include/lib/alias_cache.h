@@ -4,18 +4,27 @@
 #pragma once
 
 #include <core/str.h>
-#include <core/str_map.h>
-#include <core/auto_free_str.h>
+#include <core/str_unordered_set.h>
 #include <core/linear_allocator.h>
 
+#include <functional>
+
 //------------------------------------------------------------------------------
+// Snapshot of the doskey aliases, so that checking whether a word is an alias
+// is a hash lookup instead of a round trip to conhost.  The snapshot is taken
+// on the first lookup after clear(), and is retaken after os::set_alias() or
+// anything else that calls os::invalidate_alias_cache().
 class alias_cache
 {
 public:
-    alias_cache() : m_names(4096) {}
+    alias_cache() : m_strings(4096, mem_tag::editor) {}
     void clear();
     bool get_alias(const char* name, str_base& out);
+    static bool enum_aliases(const wchar_t* shell_name, const std::function<void(const char* name, const char* text)>& func);
 private:
-    str_map_caseless<auto_free_str>::type m_map;
-    linear_allocator m_names;
+    bool load();
+    str_unordered_map_caseless<const char*> m_map;
+    linear_allocator m_strings;
+    uint32 m_generation = 0;
+    bool m_loaded = false;
 };
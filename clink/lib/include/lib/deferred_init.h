@@ -0,0 +1,25 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <functional>
+
+//------------------------------------------------------------------------------
+// Work that isn't needed to draw the prompt and accept input can be deferred
+// until the input loop goes idle.  Anything that depends on a deferred task
+// must call ensure_deferred_init() first, which runs the task immediately if
+// it's still pending; so first use blocks until the task is done.
+enum class deferred_init_task : uint8
+{
+    match_colors,
+    history,
+    max
+};
+
+//------------------------------------------------------------------------------
+void defer_init(deferred_init_task task, std::function<void()>&& func);
+bool has_deferred_init();
+bool run_deferred_init();
+void ensure_deferred_init(deferred_init_task task);
+void ensure_deferred_init();
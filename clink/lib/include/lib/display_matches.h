@@ -28,6 +28,7 @@ int32 append_filename(char* to_print, const char* full_pathname, int32 prefix_by
 void pad_filename(int32 len, int32 pad_to_width, int32 selected);
 
 int32 printable_len(const char* match, match_type type);
+int32 printable_len(const char* match, match_type type, int32 printable_cells);
 int32 __fnwidth(const char* string);
 
 #define DESC_ONE_COLUMN_THRESHOLD       9
@@ -36,6 +37,7 @@ int32 __fnwidth(const char* string);
 #define MATCH_FLAG_APPEND_DISPLAY       0x01
 #define MATCH_FLAG_HAS_SUPPRESS_APPEND  0x02
 #define MATCH_FLAG_SUPPRESS_APPEND      0x04
+#define MATCH_FLAG_LAZY_DESCRIPTION     0x08
 
 // For display_matches, the matches array must contain specially formatted
 // match entries:
@@ -21,7 +21,7 @@ typedef struct _history_expansion history_expansion;
 void refresh_terminal_size();
 void display_readline();
 void set_history_expansions(history_expansion* list=nullptr);
-void resize_readline_display(const char* prompt, const line_buffer& buffer, const char* _prompt, const char* _rprompt);
+bool resize_readline_display(const char* prompt, const line_buffer& buffer, const char* _prompt, const char* _rprompt);
 bool translate_xy_to_readline(uint32 x, uint32 y, int32& pos, bool clip=false);
 COORD measure_readline_display(const char* prompt=nullptr, const char* buffer=nullptr, uint32 len=-1);
 bool use_display_manager();
@@ -96,10 +96,12 @@ public:
                     ~display_accumulator();
     static void     flush();
 private:
+    static void     write_buffer();
     static void     fwrite_proc(FILE*, const char*, int32);
     static void     fflush_proc(FILE*);
     static void (*s_saved_fwrite)(FILE*, const char*, int32);
     static void (*s_saved_fflush)(FILE*);
     static int32    s_nested;
     static bool     s_active;
+    static bool     s_synchronized;
 };
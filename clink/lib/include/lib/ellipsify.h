@@ -9,6 +9,7 @@ typedef void (*vstrlen_func_t)(const char* s, int32 len);
 
 int32 ellipsify(const char* in, int32 limit, str_base& out, bool expand_ctrl);
 int32 ellipsify_to_callback(const char* in, int32 limit, int32 expand_ctrl, vstrlen_func_t callback);
+int32 printable_ascii_len(const char* in, int32 max_len);
 
 extern const char* const ellipsis;
 #ifdef USE_ASCII_ELLIPSIS
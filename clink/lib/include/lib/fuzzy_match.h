@@ -0,0 +1,56 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <core/base.h>
+
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Scores how well a needle matches candidates as a subsequence, in the style of
+// fzf.  Characters are folded according to the current str_compare_scope.
+// Matches at the start of words, camel case humps, and consecutive matches
+// score higher, and gaps between matched characters score lower.
+class fuzzy_matcher
+    : public no_copy
+{
+public:
+    struct result
+    {
+        int32           score;
+        uint32          index;
+    };
+
+                        fuzzy_matcher(const char* needle);
+    bool                empty() const { return m_needle.empty(); }
+    int32               score(const char* text, int32 len=-1);
+    static bool         better(const result& a, const result& b);
+
+    // Returns up to LIMIT results for the candidates returned by
+    // GET_TEXT(index), best first.  LIMIT 0 means no limit.
+    template <typename T> void top(uint32 count, uint32 limit, T&& get_text, std::vector<result>& out);
+
+    static const int32  no_match = -1;
+
+private:
+    void                fold(const char* text, int32 len);
+    void                select_top(uint32 limit, std::vector<result>& out) const;
+    std::vector<int32>  m_needle;
+    std::vector<int32>  m_text;
+    std::vector<uint8>  m_bonus;
+    std::vector<int32>  m_rows;
+};
+
+//------------------------------------------------------------------------------
+template <typename T> void fuzzy_matcher::top(uint32 count, uint32 limit, T&& get_text, std::vector<result>& out)
+{
+    out.clear();
+    for (uint32 i = 0; i < count; ++i)
+    {
+        const int32 s = score(get_text(i));
+        if (s != no_match)
+            out.push_back({ s, i });
+    }
+    select_top(limit, out);
+}
@@ -0,0 +1,93 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <core/base.h>
+#include <core/linear_allocator.h>
+#include <core/str_unordered_set.h>
+
+#include <vector>
+
+class word_collector;
+
+//------------------------------------------------------------------------------
+// Index of the command words used in Readline's history list.  Each distinct
+// command word is kept once in a vocabulary, along with how many commands use
+// it and the newest history entry that uses it, and each history entry refers
+// to the vocabulary words of its commands.  Commands without any arguments
+// are omitted, since there's nothing to generate from them.
+//
+// Finding the history entries that use certain commands then only needs to
+// test each distinct command word once, instead of tokenising every line.
+//
+// The index is synced with Readline's history list on each query; lines added
+// to the end of the history are tokenised incrementally, and any other change
+// to the history list rebuilds the index.
+class history_command_index
+    : public no_copy
+{
+public:
+                            history_command_index();
+    void                    clear();
+    template <typename A, typename T> bool find(A&& accept, T&& callback);
+
+private:
+    struct vocab
+    {
+        const char*         word;
+        uint32              uses;
+        int32               newest;         // Index in Readline's history list.
+        bool                quoted;
+    };
+
+    struct entry
+    {
+        uint32              first;          // Index in m_commands.
+        uint32              count;
+    };
+
+    void                    sync();
+    void                    add_line(word_collector& collector, const char* line, int32 index);
+    uint32                  add_word(const char* word, bool quoted, int32 index);
+    linear_allocator        m_store;
+    std::vector<vocab>      m_vocab;
+    str_unordered_map<uint32> m_words;      // Quoted words are prefixed with ".
+    std::vector<uint32>     m_commands;     // Index in m_vocab.
+    std::vector<entry>      m_entries;
+    int32                   m_count = 0;
+    const void*             m_first = nullptr;
+    const void*             m_last = nullptr;
+    const char*             m_last_line = nullptr;
+};
+
+//------------------------------------------------------------------------------
+// Calls ACCEPT(word, quoted) once per distinct command word, and then calls
+// CALLBACK with the Readline history index of each entry that has a command
+// word that was accepted, oldest first.  The callback returns false to stop.
+// Returns false if no entries matched.
+template <typename A, typename T> bool history_command_index::find(A&& accept, T&& callback)
+{
+    sync();
+
+    bool any = false;
+    std::vector<int8> verdicts(m_vocab.size(), -1);
+    for (int32 i = 0; i < int32(m_entries.size()); ++i)
+    {
+        const entry& e = m_entries[i];
+        for (uint32 j = e.first; j < e.first + e.count; ++j)
+        {
+            const uint32 id = m_commands[j];
+            if (verdicts[id] < 0)
+                verdicts[id] = !!accept(m_vocab[id].word, m_vocab[id].quoted);
+            if (verdicts[id])
+            {
+                any = true;
+                if (!callback(i))
+                    return true;
+                break;
+            }
+        }
+    }
+    return any;
+}
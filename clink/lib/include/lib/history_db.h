@@ -6,8 +6,22 @@
 #include <core/str_iter.h>
 #include <core/singleton.h>
 
+#include <ctime>
+#include <memory>
 #include <vector>
 
+class history_archive;
+class history_change_feed;
+class history_compactor;
+class history_dir_index;
+class history_index;
+class history_mapped_view;
+class history_time_index;
+class housekeeper;
+class read_lock;
+class write_lock;
+struct removal_file_data;
+
 //------------------------------------------------------------------------------
 class concurrency_tag
 {
@@ -42,6 +56,7 @@ struct bank_handles
     explicit        operator bool () const;
     void*           m_handle_lines = nullptr;
     void*           m_handle_removals = nullptr;
+    bool            m_binary = false;   // Format to use when creating a bank.
 };
 
 //------------------------------------------------------------------------------
@@ -120,33 +135,58 @@ public:
     void                        clear();
     bool                        compact(bool force=false, bool uniq=false, int32 limit=-1);
     bool                        add(const char* line);
+    uint32                      add_lines(const char* text, uint32 length);
     int32                       remove(const char* line);
     bool                        remove(line_id id) { return remove_internal(id, true); }
     bool                        remove(int32 rl_history_index, const char* line);
     line_id                     find(const char* line) const;
     template <int32 S> iter     read_lines(char (&buffer)[S]);
     iter                        read_lines(char* buffer, uint32 buffer_size);
+    template <int32 S> iter     read_lines_reverse(char (&buffer)[S]);
+    iter                        read_lines_reverse(char* buffer, uint32 buffer_size);
+    template <int32 S> iter     read_lines_in_range(char (&buffer)[S], time_t since, time_t until);
+    iter                        read_lines_in_range(char* buffer, uint32 buffer_size, time_t since, time_t until);
 
     void                        enable_diagnostic_output() { m_diagnostic = true; }
     bool                        has_bank(bank_t bank) const;
     bool                        is_stale_name(const char* path) const;
     void                        get_history_path(str_base& out) const;
 
+    const std::vector<int32>*   find_dir_entries(const char* dir) const;
+
     static expand_result        expand(const char* line, str_base& out);
+    static uint32               hash_dir(const char* dir);
 
 private:
     friend                      class read_line_iter;
+    friend                      class history_compactor;
     bool                        is_valid() const;
     void                        get_file_path(str_base& out, bool session) const;
     void                        load_internal();
-    void                        reap();
+    void                        load_archive();
+    bool                        read_archive(history_archive& archive) const;
+    void                        get_archive_path(str_base& out) const;
+    bool                        load_incremental();
+    void                        reap(const bank_handles& master, const volatile bool* cancel=nullptr);
+    void                        start_background_reap();
     template <typename T> void  for_each_bank(T&& callback);
     template <typename T> void  for_each_bank(T&& callback) const;
     template <typename T> void  for_each_session(T&& callback) const;
     bank_t                      get_active_bank() const;
     bank_handles                get_bank(uint32 index) const;
     bool                        remove_internal(line_id id, bool guard_ctag);
+    bool                        remove_archived(line_id id);
     void                        make_open_error(str_base* error_message, bank_t bank) const;
+    history_index*              sync_bank_index(uint32 bank_index, const read_lock& lock, history_mapped_view& view) const;
+    bool                        load_bank_mapped(uint32 bank_index, const read_lock& lock, uint32& num_lines, uint32& num_deleted);
+    template <typename T> bool  find_mapped(uint32 bank_index, const read_lock& lock, const char* line, T&& callback) const;
+    void                        save_bank_index(bool force) const;
+    void                        get_time_range(uint32 bank_index, const read_lock& lock, time_t since, time_t until, uint32& start, uint32& end) const;
+    void                        collect_removals_files(write_lock& dest, std::vector<removal_file_data>& removals_files) const;
+    void                        start_background_compact(size_t limit);
+    void                        convert_master_bank();
+    void                        publish_add() const;
+    void                        publish_change() const;
     void*                       m_alive_file = nullptr;
     str_moveable                m_path;
     int32                       m_id;
@@ -155,8 +195,21 @@ private:
     DWORD                       m_bank_error[bank_count];
     concurrency_tag             m_master_ctag;
     std::vector<line_id>        m_index_map;
+    std::unique_ptr<history_dir_index> m_dir_index;     // Parallel to m_index_map.
+    size_t                      m_archive_len = 0;      // Archived lines precede the master bank's lines.
     size_t                      m_master_len;
     size_t                      m_master_deleted_count;
+    mutable std::unique_ptr<history_index> m_bank_index[bank_count];
+    mutable std::unique_ptr<history_time_index> m_time_index;
+    std::unique_ptr<history_compactor> m_compactor;
+    std::unique_ptr<housekeeper> m_reaper;
+    std::unique_ptr<history_change_feed> m_feed;
+    uint32                      m_archive_tag = 0;      // Tag of the archive when last loaded.
+    uint32                      m_loaded_size = 0;      // Size of master bank when last loaded.
+    uint32                      m_loaded_adds = 0;      // Change feed stamp when last loaded.
+    uint32                      m_loaded_changes = 0;
+    bool                        m_loaded = false;
+    bool                        m_binary_format = false;
 
     size_t                      m_min_compact_threshold = 200;
 
@@ -170,6 +223,18 @@ template <int32 S> history_db::iter history_db::read_lines(char (&buffer)[S])
     return read_lines(buffer, S);
 }
 
+//------------------------------------------------------------------------------
+template <int32 S> history_db::iter history_db::read_lines_reverse(char (&buffer)[S])
+{
+    return read_lines_reverse(buffer, S);
+}
+
+//------------------------------------------------------------------------------
+template <int32 S> history_db::iter history_db::read_lines_in_range(char (&buffer)[S], time_t since, time_t until)
+{
+    return read_lines_in_range(buffer, S, since, until);
+}
+
 //------------------------------------------------------------------------------
 class history_database : public history_db, public singleton<history_database>
 {
@@ -0,0 +1,40 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include "history_prefix_index.h"
+#include "trigram_index.h"
+
+#include <core/base.h>
+
+//------------------------------------------------------------------------------
+// Finds the history entries named by "!prefix" and "!?substring?" history
+// event designators, without scanning the whole history list.  Prefix lookups
+// use a history_prefix_index, and substring lookups use a trigram_index over
+// the history lines.  The indexes fold characters, so candidates are verified
+// against the exact (case sensitive) comparisons that Readline's history
+// searches use.
+//
+// The trigram index is built on first use, and is synced with Readline's
+// history list the same way as history_prefix_index.
+class history_event_index
+    : public no_copy
+{
+public:
+    enum : int32 { not_found = -1, unindexed = -2 };
+
+    void                    clear();
+    int32                   find(const char* string, bool substring, int32 start);
+
+private:
+    int32                   find_prefix(const char* string, int32 start);
+    int32                   find_substring(const char* string, int32 start);
+    void                    sync_trigrams();
+    history_prefix_index    m_prefixes;
+    trigram_index           m_trigrams;
+    int32                   m_count = 0;
+    const void*             m_first = nullptr;
+    const void*             m_last = nullptr;
+    const char*             m_last_line = nullptr;
+};
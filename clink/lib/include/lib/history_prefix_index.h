@@ -0,0 +1,73 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <core/base.h>
+
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Index of Readline's history list sorted by case folded line, for finding the
+// newest history entries that begin with a prefix without scanning the whole
+// history.  Lines are folded according to the current str_compare_scope, the
+// same as str_compare<char, false, true/*exact_slash*/>() compares them.
+//
+// The index is synced with Readline's history list on each query; lines added
+// to the end of the history are inserted incrementally, and any other change
+// to the history list rebuilds the index.
+class history_prefix_index
+    : public no_copy
+{
+public:
+    void                    clear();
+    template <typename T> bool find(const char* prefix, T&& callback, bool include_equal=false);
+
+private:
+    struct entry
+    {
+        uint32              key_offset;
+        uint32              key_length;
+        int32               index;          // Index in Readline's history list.
+    };
+
+    void                    sync();
+    bool                    find_range(const char* prefix, bool include_equal, uint32& first, uint32& last);
+    bool                    next_batch(uint32 first, uint32 last, int32 below, std::vector<int32>& out) const;
+    void                    fold(const char* line, std::vector<wchar_t>& out) const;
+    bool                    less(const entry& a, const entry& b) const;
+    std::vector<wchar_t>    m_keys;
+    std::vector<entry>      m_entries;
+    std::vector<wchar_t>    m_tmp;
+    int32                   m_count = 0;
+    const void*             m_first = nullptr;
+    const void*             m_last = nullptr;
+    const char*             m_last_line = nullptr;
+    int32                   m_mode = -1;
+    bool                    m_fuzzy_accents = false;
+};
+
+//------------------------------------------------------------------------------
+// Calls CALLBACK with the Readline history index of each entry that begins
+// with PREFIX and is longer than PREFIX (or equal to it, if INCLUDE_EQUAL),
+// newest first.  The callback returns false to stop.  Returns false if no
+// entries matched.
+template <typename T> bool history_prefix_index::find(const char* prefix, T&& callback, bool include_equal)
+{
+    uint32 first, last;
+    if (!find_range(prefix, include_equal, first, last))
+        return false;
+
+    // Callers usually stop at the first entry or two, so the newest entries
+    // are selected in small batches instead of sorting every match.
+    std::vector<int32> batch;
+    for (int32 below = INT_MAX; next_batch(first, last, below, batch); below = batch.back())
+    {
+        for (int32 index : batch)
+        {
+            if (!callback(index))
+                return true;
+        }
+    }
+    return true;
+}
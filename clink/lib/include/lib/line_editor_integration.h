@@ -26,14 +26,20 @@ void set_prompt(const char* prompt, const char* rprompt, bool redisplay, bool tr
 
 //------------------------------------------------------------------------------
 void force_update_internal(bool restrict=false);
+void begin_edit_batch();
+void end_edit_batch();
 
 //------------------------------------------------------------------------------
 bool is_regen_blocked();
-void reset_generate_matches();
+void reset_generate_matches(bool keep_cache=false);
+void clear_completion_cache();
 void update_matches();
+uint32 get_speculate_matches_timeout();
+void speculate_matches();
 void reselect_matches();
 matches* maybe_regenerate_matches(const char* needle, display_filter_flags flags);
 matches* get_mutable_matches(bool nosort=false);
+const char* get_lazy_match_description(const char* match);
 
 //------------------------------------------------------------------------------
 uint32 collect_words(const line_buffer& buffer, std::vector<word>& words, collect_words_mode mode);
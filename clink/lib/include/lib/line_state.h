@@ -49,6 +49,7 @@ public:
     bool                overwrite_from(const line_state* other);
 
     static void         set_can_strip_quotes(bool can);
+    static bool         can_strip_quotes();
 
 private:
     const std::vector<word>& m_words;
@@ -3,6 +3,7 @@
 
 #pragma once
 
+class str_base;
 class line_state;
 class line_states;
 class match_builder;
@@ -27,6 +28,8 @@ public:
     virtual void    get_word_break_info(const line_state& line, word_break_info& info) const = 0;
     virtual bool    match_display_filter(const char* needle, char** matches, match_builder* builder, display_filter_flags flag, bool nosort, bool* old_filtering=nullptr) { return false; }
     virtual bool    filter_matches(char** matches, char completion_type, bool filename_completion_desired) { return false; }
+    virtual void    reset_display_filter() {}
+    virtual bool    get_lazy_description(const char* match, str_base& out) { return false; }
 
 private:
 };
@@ -140,6 +140,7 @@ public:
     match_type              get_match_type() const;
     const char*             get_match_display() const;
     const char*             get_match_description() const;
+    bool                    is_match_description_lazy() const;
     char                    get_match_append_char() const;
     shadow_bool             get_match_suppress_append() const;
     bool                    get_match_append_display() const;
@@ -184,11 +185,15 @@ public:
     virtual match_type      get_match_type(uint32 index) const = 0;
     virtual const char*     get_match_display(uint32 index) const = 0;
     virtual const char*     get_match_description(uint32 index) const = 0;
+    virtual bool            is_match_description_lazy(uint32 index) const = 0;
     virtual uint32          get_match_ordinal(uint32 index) const = 0;
     virtual char            get_match_append_char(uint32 index) const = 0;
     virtual shadow_bool     get_match_suppress_append(uint32 index) const = 0;
     virtual bool            get_match_append_display(uint32 index) const = 0;
     virtual bool            get_match_custom_display(uint32 index) const = 0;
+    virtual uint32          get_match_printable_cells(uint32 index) const = 0;
+    virtual uint32          get_match_display_cells(uint32 index) const = 0;
+    virtual uint32          get_match_description_cells(uint32 index) const = 0;
     virtual bool            is_suppress_append() const = 0;
     virtual shadow_bool     is_filename_completion_desired() const = 0;
     virtual shadow_bool     is_filename_display_desired() const = 0;
@@ -234,6 +239,7 @@ struct match_desc
     char                    suppress_append;// Suppress appending character after match; negative means not specified.
     bool                    append_display; // Print match text followed by display string.
     bool                    missing_match;  // Match display filter returned "display" but no "match".
+    bool                    lazy_description; // The generator provides the description when it's needed.
 };
 
 //------------------------------------------------------------------------------
@@ -247,6 +253,7 @@ public:
     bool                    add_match(const char* match, match_type type, bool already_normalised=false);
     bool                    add_match(const match_desc& desc, bool already_normalised=false);
     bool                    is_empty();
+    void                    reserve(uint32 count);
     void                    set_append_character(char append);
     void                    set_suppress_append(bool suppress=true);
     void                    set_suppress_quoting(int32 suppress=1); //0=no, 1=yes, 2=suppress end quote
@@ -255,10 +262,15 @@ public:
     void                    set_no_sort();
     void                    set_has_descriptions();
     void                    set_volatile();
+    void                    set_cacheable();
+    void                    set_limit(uint32 count);
+    uint32                  get_limit() const;
+    bool                    is_full() const;
 
     void                    set_deprecated_mode();
     void                    set_matches_are_files(bool files=true);
     void                    set_input_line(const char* text);
+    void                    disable_cache();
 
 private:
     matches&                m_matches;
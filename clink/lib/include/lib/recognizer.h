@@ -3,12 +3,29 @@
 
 #pragma once
 
-class str_base;
+#include <core/str.h>
+
+#include <vector>
 
 enum class recognition : char { unrecognized = -1, unknown, executable, navigate, max };
 
 recognition recognize_command(const char* line, const char* word, bool quoted, bool& ready, str_base* file);
 
+struct path_executable
+{
+    str_moveable name;
+    uint32 attr;
+};
+
+struct path_executables_flags
+{
+    bool associations = false;      // Include files with file associations.
+    bool hidden = true;
+    bool system = false;
+};
+
+void get_path_executables(const char* prefix, const path_executables_flags& flags, std::vector<path_executable>& out, std::vector<str_moveable>& unindexed);
+
 HANDLE get_recognizer_event();
 bool check_recognizer_refresh();
 
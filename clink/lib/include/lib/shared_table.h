@@ -0,0 +1,68 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <core/base.h>
+#include <core/str.h>
+
+#include <mutex>
+
+//------------------------------------------------------------------------------
+// Fixed size table of string keys and small values in a named shared memory
+// section, so that sessions can reuse results that other sessions of the same
+// user already found.  The section is zero initialized when it's created, and
+// lives as long as any session has it open.
+//
+// Each slot is guarded by a sequence number, so readers never block and
+// writers skip slots that another session is writing.  A generation number in
+// the section's header invalidates every slot at once.
+//
+// Sharing can be turned off with the clink.shared_cache setting, in which case
+// open() fails and callers just use their own session's caches.
+class shared_table
+    : public no_copy
+{
+public:
+                        shared_table(uint32 key_size, uint32 value_size, uint32 slots);
+                        ~shared_table();
+    bool                open(const wchar_t* name);
+    void                close();
+    bool                find(const char* key, void* value);
+    void                store(const char* key, const void* value, uint32 value_len);
+    void                invalidate();
+
+private:
+    struct header
+    {
+        volatile LONG   generation;
+        uint32          layout;             // Guards against other versions.
+    };
+
+    struct slot
+    {
+        volatile LONG   seq;                // Odd while being written.
+        LONG            generation;
+        uint32          hash;
+        uint32          reserved;
+        // Followed by key_size bytes of key and value_size bytes of value.
+    };
+
+    void                unmap();
+    slot*               get_slot(uint32 index) const;
+    char*               get_key(slot* s) const { return reinterpret_cast<char*>(s + 1); }
+    char*               get_value(slot* s) const { return get_key(s) + m_key_size; }
+    uint32              get_bucket(uint32 hash) const;
+
+    static const uint32 c_ways = 4;
+
+    const uint32        m_key_size;
+    const uint32        m_value_size;
+    const uint32        m_slots;
+    const uint32        m_slot_size;
+    const uint32        m_layout;
+    void*               m_mapping = nullptr;
+    header*             m_header = nullptr;
+    wstr_moveable       m_name;
+    std::mutex          m_mutex;
+};
@@ -30,6 +30,7 @@ public:
 
 private:
     void            resync_suggestion_iterator(uint32 old_cursor);
+    bool            extend_suggestion();
     str_iter        m_iter;
     str_moveable    m_suggestion;
     str_moveable    m_line;         // Input line that generated the suggestion.
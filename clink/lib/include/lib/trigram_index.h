@@ -0,0 +1,34 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <core/base.h>
+
+#include <unordered_map>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Substring search index.  Each text is split into trigrams of folded
+// characters (folded according to the current str_compare_scope, the same as
+// str_compare() folds them), and each trigram maps to the ids of the texts that
+// contain it.  Querying an index yields candidates that contain every trigram
+// of the needle; callers must still verify each candidate, since trigrams
+// match in any order.
+class trigram_index
+    : public no_copy
+{
+public:
+    void                clear();
+    bool                empty() const { return m_postings.empty(); }
+    bool                is_compatible() const;
+    void                add(int32 id, const char* text);
+    bool                query(const char* needle, std::vector<int32>& out) const;
+
+private:
+    void                fold(const char* text, std::vector<int32>& out) const;
+    std::unordered_map<uint64, std::vector<int32>> m_postings;
+    mutable std::vector<int32> m_tmp;
+    int32               m_mode = -1;
+    bool                m_fuzzy_accents = false;
+};
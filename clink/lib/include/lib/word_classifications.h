@@ -5,7 +5,7 @@
 
 #include <core/base.h>
 #include <core/str.h>
-#include <core/str_map.h>
+#include <core/str_unordered_set.h>
 
 #include <vector>
 
@@ -39,10 +39,31 @@ struct word_class_info
     bool            flush;
 };
 
+//------------------------------------------------------------------------------
+// A range of the input line that uses one face.  Characters that aren't in
+// any run use the default color.
+struct face_run
+{
+    uint32          start;
+    uint32          end;
+    char            face;
+};
+
+//------------------------------------------------------------------------------
+// The classifications for one command, with offsets relative to the start of
+// the command, so they can be reapplied while the command is unchanged.
+struct command_classifications
+{
+    void            clear();
+    std::vector<word_class_info> words;
+    std::vector<face_run> faces;
+    std::vector<str_compact> face_definitions;
+};
+
 //------------------------------------------------------------------------------
 class word_classifications : public no_copy
 {
-    typedef str_map_caseless<char>::type faces_map;
+    typedef str_unordered_map_caseless<char> faces_map;
 
 public:
                     word_classifications() = default;
@@ -54,6 +75,9 @@ public:
     uint32          add_command(const line_state& line);
     void            set_word_has_argmatcher(uint32 index);
     void            finish(bool show_argmatchers);
+    void            save_command(uint32 start, uint32 length, command_classifications& out) const;
+    void            restore_command(uint32 start, const command_classifications& in);
+    void            sort_words();
 
     uint32          size() const { return uint32(m_info.size()); }
     uint32          length() const { return m_length; }
@@ -74,9 +98,14 @@ public:
     void            flush_unbreak();
 
 private:
+    typedef std::vector<face_run>::iterator run_iter;
+    run_iter        insert_run(run_iter it, const face_run& run);
+    void            fill_gaps(uint32 start, uint32 end, char face);
+
     std::vector<word_class_info> m_info;
     std::vector<str_moveable> m_face_definitions;
-    char*           m_faces = nullptr;
+    std::vector<face_run> m_runs;           // Sorted and non-overlapping.
+    mutable uint32  m_run_hint = 0;         // Where get_face() last found a run.
     uint32          m_length = 0;
     faces_map       m_face_map;             // Points into m_face_definitions.
 };
@@ -5,9 +5,11 @@
 
 #include "line_state.h"
 
+#include <core/str.h>
 #include <core/str_iter.h>
 #include <core/str_tokeniser.h>
 
+#include <deque>
 #include <vector>
 
 class line_buffer;
@@ -53,6 +55,7 @@ public:
     ~word_collector();
 
     void init_alias_cache();
+    void clear_cache();
 
     uint32 collect_words(const char* buffer, uint32 length, uint32 cursor,
                          std::vector<word>& words, collect_words_mode mode,
@@ -69,12 +72,29 @@ private:
     bool get_alias(const char* name, str_base& out) const;
     bool is_alias_allowed(const char* buffer, uint32 offset) const;
 
+    // The words of recently collected commands, so that editing one command
+    // in a line with many commands only tokenises the command that changed.
+    struct cached_command
+    {
+        str_moveable text;              // Command text, preceded by context.
+        uint32 context;                 // Length of preceding context.
+        uint32 doskey_len;
+        bool first;
+        bool deprecated_argmatcher;
+        bool enhanced_doskey;
+        std::vector<word> words;        // Offsets are relative to the command.
+    };
+    static const uint32 c_max_cached_commands = 32;
+    const cached_command* find_cached_command(const char* text, uint32 len, uint32 context, uint32 doskey_len, bool first, bool deprecated_argmatcher, bool enhanced_doskey) const;
+
 private:
     collector_tokeniser* const m_command_tokeniser;
     collector_tokeniser* m_word_tokeniser;
     alias_cache* m_alias_cache = nullptr;
     const char* const m_quote_pair;
     bool m_delete_word_tokeniser = false;
+    mutable std::vector<cached_command> m_cached_commands;
+    mutable uint32 m_next_cached_command = 0;
 };
 
 //------------------------------------------------------------------------------
@@ -108,7 +128,8 @@ public:
     const line_state& get_linestate(const line_buffer& buffer) const;
 private:
     void clear_internal();
-    std::vector<std::vector<word>> m_words_storage;
+    std::deque<std::vector<word>> m_words_storage;      // Reused across calls to set().
+    uint32 m_words_used = 0;
     line_states m_linestates;
 #ifdef DEBUG
     bool m_broke_end_word;
@@ -6,31 +6,94 @@
 
 #include <core/os.h>
 
+#include <memory>
+
 //------------------------------------------------------------------------------
 void alias_cache::clear()
 {
     m_map.clear();
-    m_names.clear();
+    m_strings.clear();
+    m_generation = 0;
+    m_loaded = false;
 }
 
 //------------------------------------------------------------------------------
 bool alias_cache::get_alias(const char* name, str_base& out)
 {
-    const auto& iter = m_map.find(name);
-    if (iter != m_map.end())
+    if (m_generation != os::get_alias_generation())
     {
-        const char* value = iter->second.get();
-        if (!value || !*value)
-            return false;
-        out = value;
-        return true;
+        clear();
+        m_generation = os::get_alias_generation();
+        m_loaded = load();
     }
 
-    const bool exists = os::get_alias(name, out);
+    // If the snapshot couldn't be taken, look up each alias individually.
+    if (!m_loaded)
+        return os::get_alias(name, out);
+
+    const auto& iter = m_map.find(name);
+    if (iter == m_map.end())
+        return false;
+
+    out = iter->second;
+    return true;
+}
 
-    const char* cache_name = m_names.store(name);
-    auto_free_str cache_value(out.c_str(), out.length());
-    m_map.emplace(cache_name, std::move(cache_value));
+//------------------------------------------------------------------------------
+bool alias_cache::load()
+{
+    return enum_aliases(os::get_shellname(), [this](const char* name, const char* text) {
+        const char* cache_name = m_strings.store(name);
+        const char* cache_text = m_strings.store(text);
+        if (cache_name && cache_text)
+            m_map.emplace(cache_name, cache_text);
+    });
+}
+
+//------------------------------------------------------------------------------
+// Takes a snapshot of all the aliases for SHELL_NAME in one call, and passes
+// each alias' name and text to FUNC.  Returns false if the snapshot couldn't
+// be taken.
+bool alias_cache::enum_aliases(const wchar_t* shell_name, const std::function<void(const char* name, const char* text)>& func)
+{
+    // Not const because Windows' alias API won't accept it.
+    wchar_t* name_arg = const_cast<wchar_t*>(shell_name);
+
+    // The aliases can change between getting the length and getting the
+    // aliases, so retry once if the buffer turns out to be too small.
+    for (int32 attempt = 0; attempt < 2; ++attempt)
+    {
+        // The length is in bytes, and is 0 when there are no aliases.
+        const DWORD bytes = GetConsoleAliasesLengthW(name_arg);
+        if (!bytes)
+            return true;
+
+        // Don't use wstr<> because it only uses 15 bits to store the buffer size.
+        const DWORD count = bytes / sizeof(wchar_t) + 1;
+        std::unique_ptr<wchar_t[]> buffer(new wchar_t[count]);
+        ZeroMemory(buffer.get(), count * sizeof(wchar_t));
+        if (!GetConsoleAliasesW(buffer.get(), count * sizeof(wchar_t), name_arg))
+            continue;
+
+        // The aliases are "name=text" strings, each followed by a nul.
+        str<> name;
+        str<> text;
+        const wchar_t* const end = buffer.get() + count;
+        for (wchar_t* alias = buffer.get(); alias < end && *alias;)
+        {
+            const size_t len = wcslen(alias);
+            wchar_t* equals = wcschr(alias, '=');
+            if (equals && equals[1])
+            {
+                *equals = '\0';
+                name = alias;
+                text = equals + 1;
+                func(name.c_str(), text.c_str());
+            }
+            alias += len + 1;
+        }
+        return true;
+    }
 
-    return exists;
+    return false;
 }
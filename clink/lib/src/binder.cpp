@@ -111,6 +111,9 @@ binder::binder()
     m_nodes[1] = { 0 };
     m_next_node = 2;
 
+    memset(m_compiled_root, 0, sizeof(m_compiled_root));
+    m_num_compiled_roots = 0;
+
     static_assert(sizeof(node) == sizeof(group_node), "Size assumption");
 }
 
@@ -186,6 +189,15 @@ bool binder::bind(
     if (module_index < 0)
         return false;
 
+    // Recompile the group's root however the bind turns out, since even a
+    // failed bind may have added children to the root.
+    struct recompile
+    {
+        ~recompile() { m_binder->compile_root(m_root); }
+        binder* m_binder;
+        int32 m_root;
+    } recompile = { this, int32(group) };
+
     // Add the chord of keys into the node graph.
     int32 depth = 0;
     int32 head = group;
@@ -278,7 +290,7 @@ int32 binder::is_bound(uint32 group, const char* seq, int32 len) const
 //------------------------------------------------------------------------------
 int32 binder::insert_child(int32 parent, uint8 key, bool has_params)
 {
-    if (int32 child = find_child(parent, key))
+    if (int32 child = find_child_uncompiled(parent, key))
     {
         assert(get_node(child).has_params == has_params);
         return child;
@@ -289,6 +301,18 @@ int32 binder::insert_child(int32 parent, uint8 key, bool has_params)
 
 //------------------------------------------------------------------------------
 int32 binder::find_child(int32 parent, uint8 key) const
+{
+    if (uint32(parent) < sizeof_array(m_compiled_root))
+    {
+        if (const uint8 slot = m_compiled_root[parent])
+            return m_compiled_children[slot - 1][key];
+    }
+
+    return find_child_uncompiled(parent, key);
+}
+
+//------------------------------------------------------------------------------
+int32 binder::find_child_uncompiled(int32 parent, uint8 key) const
 {
     const node* node = m_nodes + parent;
 
@@ -308,6 +332,28 @@ int32 binder::find_child(int32 parent, uint8 key) const
     return 0;
 }
 
+//------------------------------------------------------------------------------
+// Once there are more than max_compiled_roots groups with binds, the rest
+// simply aren't compiled and walk their list of children instead.
+void binder::compile_root(int32 root)
+{
+    if (uint32(root) >= sizeof_array(m_compiled_root))
+        return;
+
+    uint8 slot = m_compiled_root[root];
+    if (!slot)
+    {
+        if (m_num_compiled_roots >= max_compiled_roots)
+            return;
+        slot = uint8(++m_num_compiled_roots);
+        m_compiled_root[root] = slot;
+    }
+
+    unsigned short* children = m_compiled_children[slot - 1];
+    for (int32 key = 0; key < 256; ++key)
+        children[key] = static_cast<unsigned short>(find_child_uncompiled(root, uint8(key)));
+}
+
 //------------------------------------------------------------------------------
 int32 binder::add_child(int32 parent, uint8 key, bool has_params)
 {
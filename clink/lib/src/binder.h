@@ -25,6 +25,7 @@ public:
 private:
     static const int32  link_bits = 9;
     static const int32  module_bits = 5;
+    static const int32  max_compiled_roots = 16;
 
     struct node
     {
@@ -55,6 +56,8 @@ private:
     friend class        bind_resolver;
     int32               insert_child(int32 parent, uint8 key, bool has_params);
     int32               find_child(int32 parent, uint8 key) const;
+    int32               find_child_uncompiled(int32 parent, uint8 key) const;
+    void                compile_root(int32 root);
     int32               add_child(int32 parent, uint8 key, bool has_params);
     int32               find_tail(int32 head);
     int32               append(int32 head, uint8 key);
@@ -66,4 +69,11 @@ private:
     modules             m_modules;
     node                m_nodes[1 << link_bits];
     uint32              m_next_node;
+
+    // The root node of each group that has binds gets a table of its children
+    // indexed by key, so the first key of an input sequence (usually the only
+    // key) resolves without walking the root's list of children.
+    uint8               m_compiled_root[1 << link_bits]; // Slot + 1, or 0.
+    unsigned short      m_compiled_children[max_compiled_roots][256];
+    uint32              m_num_compiled_roots;
 };
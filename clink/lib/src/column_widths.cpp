@@ -56,7 +56,15 @@ static struct columns_info* s_columns_info = nullptr;
 int32 printable_len(const char* match, match_type type)
 {
     const char* temp = __printable_part((char*)match);
-    int32 len = __fnwidth(temp);
+    return printable_len(match, type, __fnwidth(temp));
+}
+
+//------------------------------------------------------------------------------
+// PRINTABLE_CELLS is the width of __printable_part() of MATCH, for callers
+// that already know it.
+int32 printable_len(const char* match, match_type type, int32 printable_cells)
+{
+    int32 len = printable_cells;
 
     // Use the match type to determine whether there will be a visible stat
     // character, and include it in the max length calculation.
@@ -271,7 +279,7 @@ column_widths calculate_columns(const match_adapter& adapter, int32 max_matches,
         {
             if (append)
             {
-                match_len += printable_len(match, type);
+                match_len += adapter.get_match_printable_len(filesno, type);
                 match_len += adapter.get_match_visible_display(filesno);
             }
             else if (presuf)
@@ -286,7 +294,7 @@ column_widths calculate_columns(const match_adapter& adapter, int32 max_matches,
         }
         else
         {
-            match_len += printable_len(match, type);
+            match_len += adapter.get_match_printable_len(filesno, type);
         }
 
         if (cdelta)
@@ -0,0 +1,153 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "completion_cache.h"
+#include "line_state.h"
+#include "matches_impl.h"
+
+#include <core/base.h>
+#include <core/os.h>
+#include <core/path.h>
+#include <core/settings.h>
+#include <core/str.h>
+
+extern "C" {
+#include <compat/config.h>
+#include <readline/readline.h>
+#include <readline/rlprivate.h>
+};
+
+//------------------------------------------------------------------------------
+extern setting_bool g_files_hidden;
+extern setting_bool g_files_system;
+extern setting_enum g_translate_slashes;
+
+//------------------------------------------------------------------------------
+completion_cache& completion_cache::get()
+{
+    static completion_cache s_cache;
+    return s_cache;
+}
+
+//------------------------------------------------------------------------------
+bool completion_cache::lookup(const line_state& line, matches_impl& out)
+{
+    if (m_entries.empty())
+        return false;
+
+    cache_key key;
+    make_key(line, key);
+
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+    {
+        if (!is_same(it->key, key))
+            continue;
+
+        // Only check the directory once there's a candidate, since lookups
+        // happen every time matches are generated.
+        if (!get_stamp(line, key.stamp) || CompareFileTime(&it->key.stamp, &key.stamp) != 0)
+        {
+            m_entries.erase(it);
+            return false;
+        }
+
+        out.copy(*it->matches);
+        it->last_used = ++m_clock;
+        return true;
+    }
+
+    return false;
+}
+
+//------------------------------------------------------------------------------
+void completion_cache::store(const line_state& line, const matches_impl& matches)
+{
+    cache_key key;
+    make_key(line, key);
+    if (!get_stamp(line, key.stamp))
+        return;
+
+    entry* slot = nullptr;
+    for (auto& e : m_entries)
+    {
+        if (is_same(e.key, key))
+        {
+            slot = &e;
+            break;
+        }
+    }
+
+    if (!slot)
+    {
+        if (m_entries.size() < c_max_entries)
+        {
+            m_entries.emplace_back();
+            slot = &m_entries.back();
+            slot->matches = std::make_unique<matches_impl>();
+        }
+        else
+        {
+            slot = &m_entries[0];
+            for (auto& e : m_entries)
+                if (e.last_used < slot->last_used)
+                    slot = &e;
+        }
+    }
+
+    slot->key = std::move(key);
+    slot->matches->copy(matches);
+    slot->last_used = ++m_clock;
+}
+
+//------------------------------------------------------------------------------
+void completion_cache::clear()
+{
+    m_entries.clear();
+}
+
+//------------------------------------------------------------------------------
+void completion_cache::make_key(const line_state& line, cache_key& out)
+{
+    const str_iter end_word = line.get_end_word();
+    const uint32 len = uint32(end_word.get_pointer() + end_word.length() - line.get_line());
+    out.line.clear();
+    out.line.concat(line.get_line(), len);
+
+    os::get_current_dir(out.cwd);
+
+    out.flags = ((g_files_hidden.get() ? 0x01 : 0) |
+                 (g_files_system.get() ? 0x02 : 0) |
+                 (_rl_match_hidden_files ? 0x04 : 0) |
+                 (g_translate_slashes.get() << 4));
+}
+
+//------------------------------------------------------------------------------
+bool completion_cache::get_stamp(const line_state& line, FILETIME& out)
+{
+    // The directory part of the end word; relative paths are resolved against
+    // the cwd by the OS.
+    const str_iter end_word = line.get_end_word();
+    str<280> dir;
+    dir.concat(end_word.get_pointer(), end_word.length());
+    path::get_directory(dir);
+    if (dir.empty())
+        dir = ".";
+
+    wstr<280> wdir(dir.c_str());
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(wdir.c_str(), GetFileExInfoStandard, &data) ||
+        !(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        return false;
+
+    out = data.ftLastWriteTime;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool completion_cache::is_same(const cache_key& a, const cache_key& b)
+{
+    return (a.flags == b.flags &&
+            a.line.equals(b.line.c_str()) &&
+            a.cwd.iequals(b.cwd.c_str()));
+}
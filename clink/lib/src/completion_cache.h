@@ -0,0 +1,56 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <core/str.h>
+
+#include <memory>
+#include <vector>
+
+class line_state;
+class matches_impl;
+
+//------------------------------------------------------------------------------
+// Remembers recently generated matches that generators marked as cacheable,
+// so that completing the same words again in the same directory reuses them
+// instead of running the generators again.  Entries are keyed by the input
+// line up to the end of the end word, the cwd, the settings that shape file
+// matches, and the last write time of the directory the end word refers to,
+// so creating, deleting, or renaming files in that directory invalidates them.
+//
+// The cache outlives line editors, since a new line editor is created for
+// each input line.
+class completion_cache
+{
+public:
+    static completion_cache& get();
+
+    bool                lookup(const line_state& line, matches_impl& out);
+    void                store(const line_state& line, const matches_impl& matches);
+    void                clear();
+
+private:
+    struct cache_key
+    {
+        str_moveable    line;
+        str_moveable    cwd;
+        uint32          flags;          // Settings that shape file matches.
+        FILETIME        stamp;
+    };
+
+    struct entry
+    {
+        cache_key       key;
+        std::unique_ptr<matches_impl> matches;
+        uint32          last_used;
+    };
+
+    static void         make_key(const line_state& line, cache_key& out);
+    static bool         get_stamp(const line_state& line, FILETIME& out);
+    static bool         is_same(const cache_key& a, const cache_key& b);
+    std::vector<entry>  m_entries;
+    uint32              m_clock = 0;
+
+    static const uint32 c_max_entries = 4;
+};
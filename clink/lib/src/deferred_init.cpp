@@ -0,0 +1,73 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "deferred_init.h"
+
+//------------------------------------------------------------------------------
+static std::function<void()> s_tasks[uint32(deferred_init_task::max)];
+static uint32 s_pending = 0;
+
+//------------------------------------------------------------------------------
+static void run_task(uint32 index)
+{
+    // Remove the task before running it, so that anything it calls which in
+    // turn ensures the same task doesn't run it again.
+    std::function<void()> func(std::move(s_tasks[index]));
+    s_tasks[index] = nullptr;
+    s_pending &= ~(1 << index);
+
+    if (func)
+        func();
+}
+
+
+
+//------------------------------------------------------------------------------
+// Replaces the task's pending work, if any.
+void defer_init(deferred_init_task task, std::function<void()>&& func)
+{
+    const uint32 index = uint32(task);
+    s_tasks[index] = std::move(func);
+    if (s_tasks[index])
+        s_pending |= 1 << index;
+    else
+        s_pending &= ~(1 << index);
+}
+
+//------------------------------------------------------------------------------
+bool has_deferred_init()
+{
+    return !!s_pending;
+}
+
+//------------------------------------------------------------------------------
+// Runs the next pending task, if any.  Returns whether any tasks are still
+// pending, so that the idle handler can spread the work across idle calls.
+bool run_deferred_init()
+{
+    for (uint32 index = 0; index < uint32(deferred_init_task::max); ++index)
+    {
+        if (s_pending & (1 << index))
+        {
+            run_task(index);
+            break;
+        }
+    }
+    return has_deferred_init();
+}
+
+//------------------------------------------------------------------------------
+void ensure_deferred_init(deferred_init_task task)
+{
+    const uint32 index = uint32(task);
+    if (s_pending & (1 << index))
+        run_task(index);
+}
+
+//------------------------------------------------------------------------------
+void ensure_deferred_init()
+{
+    while (s_pending)
+        run_deferred_init();
+}
@@ -289,6 +289,15 @@ path_isdir(match_type type, const char *filename)
     if (!is_zero(type) && !is_match_type(type, match_type::none))
         return is_match_type(type, match_type::dir);
 
+    // Generation already resolved none matches against the file system when
+    // filename completion was desired, and gave directories a trailing path
+    // separator.  So don't hit the file system again for each match shown.
+    if (is_match_type(type, match_type::none))
+    {
+        const char* sep = rl_last_path_separator(filename);
+        return sep && !sep[1];
+    }
+
     struct stat finfo;
     return (stat(filename, &finfo) == 0 && S_ISDIR(finfo.st_mode));
 }
@@ -1036,6 +1045,37 @@ static int32 display_match_list_internal(const match_adapter& adapter, const col
     return 0;
 }
 
+//------------------------------------------------------------------------------
+// Returns which of bit_prefix and bit_suffix apply to every match that uses its
+// display string.  This compares strings for each match, so it's deferred until
+// the matches are actually going to be displayed.
+static int32 calc_presuf(const match_adapter& adapter)
+{
+    str<32> lcd;
+    adapter.get_lcd(lcd);
+    if (!*__printable_part(const_cast<char*>(lcd.c_str())))
+        return 0;
+
+    int32 presuf = bit_prefix|bit_suffix;
+    for (int32 l = adapter.get_match_count(); presuf && l--;)
+    {
+        if (adapter.is_append_display(l))
+            continue;
+
+        const match_type type = adapter.get_match_type(l);
+        if (!adapter.use_display(l, type, false))
+            continue;
+
+        const char* const match = adapter.get_match(l);
+        const char* const display = adapter.get_match_display(l);
+        const char* const visible = __printable_part(const_cast<char*>(match));
+        const int32 bits = calc_prefix_or_suffix(visible, display);
+        presuf &= bits;
+    }
+
+    return presuf;
+}
+
 //------------------------------------------------------------------------------
 static int32 prompt_display_matches(int32 len)
 {
@@ -1111,46 +1151,35 @@ extern "C" void display_matches(char** matches)
         adapter.set_alt_matches(matches, false);
     }
 
-    int32 presuf = 0;
-    str<32> lcd;
-    adapter.get_lcd(lcd);
-    if (*__printable_part(const_cast<char*>(lcd.c_str())))
-    {
-        presuf = bit_prefix|bit_suffix;
-        for (int32 l = adapter.get_match_count(); presuf && l--;)
-        {
-            if (adapter.is_append_display(l))
-                continue;
-
-            const match_type type = adapter.get_match_type(l);
-            if (!adapter.use_display(l, type, false))
-                continue;
-
-            const char* const match = adapter.get_match(l);
-            const char* const display = adapter.get_match_display(l);
-            const char* const visible = __printable_part(const_cast<char*>(match));
-            const int32 bits = calc_prefix_or_suffix(visible, display);
-            presuf &= bits;
-        }
-    }
-
     const int32 count = adapter.get_match_count();
     const bool best_fit = g_match_best_fit.get();
     const int32 limit_fit = g_match_limit_fitted.get();
     const bool one_column = adapter.has_descriptions() && count <= DESC_ONE_COLUMN_THRESHOLD;
-    const column_widths widths = calculate_columns(adapter, best_fit ? limit_fit : -1, one_column, false, 0, presuf);
 
     // If there are many items, then ask the user if she really wants to see
-    // them all.
-    if ((rl_completion_auto_query_items && _rl_screenheight > 0) ?
-        display_match_list_internal(adapter, widths, 1, presuf) >= (_rl_screenheight - (_rl_vis_botlin + 1)) :
-        rl_completion_query_items > 0 && count >= rl_completion_query_items)
+    // them all.  When the query doesn't depend on the layout, ask before
+    // calculating the layout, since measuring a very large number of matches
+    // takes a while and is wasted if the user declines.
+    const bool auto_query = (rl_completion_auto_query_items && _rl_screenheight > 0);
+    if (!auto_query && rl_completion_query_items > 0 && count >= rl_completion_query_items)
     {
         if (!prompt_display_matches(count))
             goto done;
     }
 
-    display_match_list_internal(adapter, widths, 0, presuf);
+    {
+        const int32 presuf = calc_presuf(adapter);
+        const column_widths widths = calculate_columns(adapter, best_fit ? limit_fit : -1, one_column, false, 0, presuf);
+
+        if (auto_query &&
+            display_match_list_internal(adapter, widths, 1, presuf) >= (_rl_screenheight - (_rl_vis_botlin + 1)))
+        {
+            if (!prompt_display_matches(count))
+                goto done;
+        }
+
+        display_match_list_internal(adapter, widths, 0, presuf);
+    }
 
 done:
     destroy_matches_lookaside(rebuilt);
@@ -160,6 +160,7 @@ static void tputs(const char* s)
 //------------------------------------------------------------------------------
 static bool get_console_screen_buffer_info(CONSOLE_SCREEN_BUFFER_INFO* info)
 {
+    wait_for_console_output();
     HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
     return !!GetConsoleScreenBufferInfo(h, info);
 }
@@ -184,9 +185,18 @@ static void append_expand_ctrl(str_base& out, const char* in, uint32 len=-1)
     }
 }
 
+//------------------------------------------------------------------------------
+// The display checks the prompt each time it redraws the prompt, so the result
+// for the most recent prompt is remembered (only when details aren't wanted).
+static str_moveable s_problem_codes_prompt;
+static int32 s_problem_codes_result = -1;
+
 //------------------------------------------------------------------------------
 int32 prompt_contains_problem_codes(const char* prompt, std::vector<prompt_problem_details>* out)
 {
+    if (!out && s_problem_codes_result >= 0 && s_problem_codes_prompt.equals(prompt))
+        return s_problem_codes_result;
+
     const char* const lf = strrchr(prompt, '\n');
     const char* const last_line = lf ? lf + 1 : prompt;
 
@@ -283,6 +293,12 @@ int32 prompt_contains_problem_codes(const char* prompt, std::vector<prompt_probl
     }
 
 done:
+    if (!out)
+    {
+        dbg_ignore_scope(snapshot, "display_readline");
+        s_problem_codes_prompt = prompt;
+        s_problem_codes_result = ret;
+    }
     return ret;
 }
 
@@ -360,14 +376,16 @@ struct display_line
     display_line&       operator=(display_line&& d);
 
     void                clear();
+    void                copy(const display_line& d);
     void                append(char c, char face);
     void                appendspace();
     void                appendnul();
+    bool                reserve(uint32 len);
 
     char*               m_chars = nullptr;  // Characters in line.
-    char*               m_faces = nullptr;  // Faces for characters in line.
+    char*               m_faces = nullptr;  // Faces for characters in line (same allocation as m_chars).
     uint32              m_len = 0;          // Bytes used in m_chars and m_faces.
-    uint32              m_allocated = 0;    // Bytes allocated in m_chars and m_faces.
+    uint32              m_allocated = 0;    // Bytes allocated for each of m_chars and m_faces.
 
     uint32              m_start = 0;        // Index of start in line buffer.
     uint32              m_end = 0;          // Index of end in line buffer.
@@ -391,7 +409,6 @@ private:
 display_line::~display_line()
 {
     free(m_chars);
-    free(m_faces);
 }
 
 //------------------------------------------------------------------------------
@@ -430,30 +447,72 @@ void display_line::clear()
 }
 
 //------------------------------------------------------------------------------
-void display_line::appendinternal(char c, char face)
+// Copies the content of another display line into this one, which must be
+// empty.  The m_toeol field is left as-is, since it depends on the width of
+// the display_lines that owns the line.
+void display_line::copy(const display_line& d)
 {
-    if (m_len >= m_allocated)
-    {
+    assert(!m_len);
+    if (!reserve(d.m_len + 1))
+        return;
+    memcpy(m_chars, d.m_chars, d.m_len);
+    memcpy(m_faces, d.m_faces, d.m_len);
+    m_len = d.m_len;
+    appendnul();
+
+    m_start = d.m_start;
+    m_end = d.m_end;
+    m_x = d.m_x;
+    m_lastcol = d.m_lastcol;
+    m_lead = d.m_lead;
+    m_trail = d.m_trail;
+
+    m_newline = d.m_newline;
+#ifdef USE_SUGGESTION_HINT_COMMENTROW
+    m_has_suggestion = d.m_has_suggestion;
+#endif
+    m_scroll_mark = d.m_scroll_mark;
+}
+
+//------------------------------------------------------------------------------
+// The chars and faces share one allocation, and it only ever grows.  Display
+// lines are pooled in display_lines and reused from frame to frame, so once
+// the pool has grown to fit the input line, redrawing allocates nothing.
+bool display_line::reserve(uint32 len)
+{
+    if (len <= m_allocated)
+        return true;
+
 #ifdef DEBUG
-        const uint32 min_alloc = 40;
+    const uint32 min_alloc = 40;
 #else
-        const uint32 min_alloc = 160;
+    const uint32 min_alloc = 160;
 #endif
 
-        const uint32 alloc = max<uint32>(min_alloc, m_allocated * 3 / 2);
-        char* chars = static_cast<char*>(realloc(m_chars, alloc));
-        char* faces = static_cast<char*>(realloc(m_faces, alloc));
-        if (!chars || !faces)
-        {
-            free(chars);
-            free(faces);
-            return;
-        }
+    const uint32 alloc = max<uint32>(len, max<uint32>(min_alloc, m_allocated * 3 / 2));
+    char* chars = static_cast<char*>(malloc(alloc * 2));
+    if (!chars)
+        return false;
 
-        m_chars = chars;
-        m_faces = faces;
-        m_allocated = alloc;
+    char* faces = chars + alloc;
+    if (m_len)
+    {
+        memcpy(chars, m_chars, m_len);
+        memcpy(faces, m_faces, m_len);
     }
+    free(m_chars);
+
+    m_chars = chars;
+    m_faces = faces;
+    m_allocated = alloc;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void display_line::appendinternal(char c, char face)
+{
+    if (m_len >= m_allocated && !reserve(m_len + 1))
+        return;
 
     m_chars[m_len] = c;
     m_faces[m_len] = face;
@@ -505,7 +564,7 @@ public:
                         display_lines() = default;
                         ~display_lines() = default;
 
-    void                parse(uint32 prompt_botlin, uint32 col, const char* buffer, uint32 len);
+    void                parse(uint32 prompt_botlin, uint32 col, const char* buffer, uint32 len, const display_lines* ref=nullptr);
     void                horz_parse(uint32 prompt_botlin, uint32 col, const char* buffer, uint32 point, uint32 len, const display_lines& ref);
     void                apply_scroll_markers(uint32 top, uint32 bottom);
     void                set_top(uint32 top);
@@ -534,6 +593,7 @@ public:
 
 private:
     display_line*       next_line(uint32 start);
+    bool                reuse_lines(const display_lines& ref, uint32 col, const char* buffer, uint32 len, uint32& index);
     bool                adjust_columns(uint32& point, int32 delta, const char* buffer, uint32 len) const;
 
     std::vector<display_line> m_lines;
@@ -547,10 +607,14 @@ private:
     bool                m_horz_scroll = false;
     str_moveable        m_comment_row;
     comment_row_type    m_comment_row_type = comment_row_type::custom;
+    str_moveable        m_buffer;           // The line buffer that parse() used.
 };
 
 //------------------------------------------------------------------------------
-void display_lines::parse(uint32 prompt_botlin, uint32 col, const char* buffer, uint32 len)
+// When ref is provided, rows from ref that come before the first edit are
+// reused as long as they still look the same, and parsing begins after them.
+// This keeps typing responsive in long multi-row input lines.
+void display_lines::parse(uint32 prompt_botlin, uint32 col, const char* buffer, uint32 len, const display_lines* ref)
 {
     assert(col < _rl_screenwidth);
     dbg_ignore_scope(snapshot, "display_readline");
@@ -562,10 +626,6 @@ void display_lines::parse(uint32 prompt_botlin, uint32 col, const char* buffer,
     while (prompt_botlin--)
         next_line(0);
 
-    display_line* d = next_line(0);
-    d->m_x = col;
-    m_cpos = col;
-
     int32 hl_begin = -1;
     int32 hl_end = -1;
 
@@ -578,10 +638,26 @@ void display_lines::parse(uint32 prompt_botlin, uint32 col, const char* buffer,
         }
     }
 
-    str<16> tmp;
     uint32 index = 0;
+    display_line* d;
+    if (ref && hl_begin < 0 && reuse_lines(*ref, col, buffer, len, index))
+    {
+        d = next_line(index);
+        col = 0;
+    }
+    else
+    {
+        d = next_line(0);
+        d->m_x = col;
+        m_cpos = col;
+    }
 
-    wcwidth_iter iter(buffer, len);
+    m_buffer.clear();
+    m_buffer.concat(buffer, len);
+
+    str<16> tmp;
+
+    wcwidth_iter iter(buffer + index, len - index);
     while (const uint32 c = iter.next())
     {
         if (c == '\n' && !_rl_horizontal_scroll_mode && _rl_term_up && *_rl_term_up)
@@ -992,6 +1068,7 @@ void display_lines::swap(display_lines& d)
     std::swap(m_horz_start, d.m_horz_start);
     std::swap(m_horz_scroll, d.m_horz_scroll);
     std::swap(m_comment_row, d.m_comment_row);
+    std::swap(m_buffer, d.m_buffer);
 }
 
 //------------------------------------------------------------------------------
@@ -1008,6 +1085,7 @@ void display_lines::clear()
     m_horz_start = 0;
     m_horz_scroll = false;
     m_comment_row.clear();
+    m_buffer.clear();
 }
 
 //------------------------------------------------------------------------------
@@ -1076,7 +1154,8 @@ bool display_lines::has_suggestion() const
     // Can check only the last 2 lines.  Must check 2 instead of 1 because
     // wrapping might cause the last line to be completely empty, in which
     // case the second to the last line is where the suggestion will be.
-    for (uint32 i = std::max<int32>(0, int32(m_lines.size()) - 2); i < m_lines.size(); ++i)
+    // Only the first m_count lines are in use; the rest of the pool is idle.
+    for (uint32 i = std::max<int32>(0, int32(m_count) - 2); i < m_count; ++i)
     {
         if (m_lines[i].m_has_suggestion)
             return true;
@@ -1100,11 +1179,69 @@ display_line* display_lines::next_line(uint32 start)
     display_line* d = &m_lines[m_count++];
     assert(!d->m_x);
     assert(!d->m_len);
+    d->reserve(m_width + 1); // Usually enough for the whole row, in one step.
     d->m_start = start;
     d->m_toeol = (m_width == _rl_screenwidth);
     return d;
 }
 
+//------------------------------------------------------------------------------
+// Copies the leading rows from ref that lie entirely before the first byte that
+// differs from the buffer ref was parsed from, and before the cursor.  Only
+// rows whose characters map one to one with the bytes in the buffer are
+// reused, and only if the faces are still the same; classifications can
+// change anywhere in the line, not just near the edit.  Returns true if any
+// rows were reused, and sets index to where parsing should continue.
+bool display_lines::reuse_lines(const display_lines& ref, uint32 col, const char* buffer, uint32 len, uint32& index)
+{
+    if (ref.m_horz_scroll ||
+        ref.m_width != m_width ||
+        ref.m_prompt_botlin != m_prompt_botlin ||
+        ref.m_count <= m_prompt_botlin + 1 ||
+        ref.m_lines[m_prompt_botlin].m_x != col)
+        return false;
+
+    const uint32 ref_len = ref.m_buffer.length();
+    const uint32 common = min<uint32>(len, ref_len);
+    uint32 limit = 0;
+    while (limit < common && buffer[limit] == ref.m_buffer.c_str()[limit])
+        ++limit;
+    if (uint32(rl_point) < limit)
+        limit = rl_point;
+
+    uint32 row = m_prompt_botlin;
+    for (; row + 1 < ref.m_count; ++row)
+    {
+        const display_line& o = ref.m_lines[row];
+        const display_line& next = ref.m_lines[row + 1];
+        if (o.m_end >= limit || o.m_scroll_mark || o.m_lead || next.m_lead)
+            break;
+#ifdef USE_SUGGESTION_HINT_COMMENTROW
+        if (o.m_has_suggestion)
+            break;
+#endif
+
+        const uint32 bytes = o.m_end - o.m_start;
+        if (o.m_len - o.m_trail != bytes || (bytes && memcmp(o.m_chars, buffer + o.m_start, bytes) != 0))
+            break;
+
+        uint32 i = 0;
+        while (i < bytes && rl_get_face_func(o.m_start + i, -1, -1) == o.m_faces[i])
+            ++i;
+        if (i < bytes)
+            break;
+    }
+
+    if (row == m_prompt_botlin)
+        return false;
+
+    for (uint32 i = m_prompt_botlin; i < row; ++i)
+        next_line(0)->copy(ref.m_lines[i]);
+
+    index = ref.m_lines[row].m_start;
+    return true;
+}
+
 //------------------------------------------------------------------------------
 bool display_lines::adjust_columns(uint32& index, int32 delta, const char* buffer, uint32 len) const
 {
@@ -1152,6 +1289,27 @@ bool display_lines::adjust_columns(uint32& index, int32 delta, const char* buffe
 
 
 
+//------------------------------------------------------------------------------
+// Prompts are measured on every redisplay and every resize, but rarely change,
+// so the results of measuring them are remembered.  The results depend on the
+// terminal width and on how character widths are resolved.
+struct prompt_measurement
+{
+    str_moveable        text;
+    uint32              width = 0;
+    uint32              generation = 0;
+    int32               mode = -1;
+    int32               start_col = 0;
+    bool                color_emoji = false;
+
+    int32               col = 0;            // Column after the text.
+    int32               lines = 0;          // Lines added by the text.
+    int32               joins = 0;          // Joined lines added by the text.
+    bool                ends_with_lf = false;
+};
+static prompt_measurement s_prompt_measurements[4];
+static uint32 s_next_prompt_measurement = 0;
+
 //------------------------------------------------------------------------------
 class measure_columns
 {
@@ -1184,6 +1342,43 @@ measure_columns::measure_columns(measure_mode mode, uint32 width)
 //------------------------------------------------------------------------------
 void measure_columns::measure(const char* text, uint32 length, bool is_prompt)
 {
+    extern bool g_color_emoji;
+    prompt_measurement* cache = nullptr;
+    if (is_prompt)
+    {
+        if (length == uint32(-1))
+            length = uint32(strlen(text));
+
+        const uint32 generation = get_wcwidths_generation();
+        for (const auto& m : s_prompt_measurements)
+        {
+            if (m.mode == m_mode &&
+                m.width == m_width &&
+                m.start_col == m_col &&
+                m.generation == generation &&
+                m.color_emoji == g_color_emoji &&
+                m.text.length() == length &&
+                memcmp(m.text.c_str(), text, length) == 0)
+            {
+                m_col = m.col;
+                m_line_count += m.lines;
+                m_join_count += m.joins;
+                m_force_wrap = (m_col == 0 && m_line_count > 1 && !m.ends_with_lf);
+                return;
+            }
+        }
+
+        cache = &s_prompt_measurements[s_next_prompt_measurement++ % sizeof_array(s_prompt_measurements)];
+        cache->mode = m_mode;
+        cache->width = m_width;
+        cache->start_col = m_col;
+        cache->generation = generation;
+        cache->color_emoji = g_color_emoji;
+    }
+
+    const int32 start_lines = m_line_count;
+    const int32 start_joins = m_join_count;
+
     ecma48_state state;
     ecma48_iter iter(text, state, length);
     const char* last_lf = nullptr;
@@ -1293,6 +1488,17 @@ ctrl_char:
     }
 
     m_force_wrap = (m_col == 0 && m_line_count > 1 && last_lf != iter.get_pointer());
+
+    if (cache)
+    {
+        dbg_ignore_scope(snapshot, "display_readline");
+        cache->text.clear();
+        cache->text.concat(text, length);
+        cache->col = m_col;
+        cache->lines = m_line_count - start_lines;
+        cache->joins = m_join_count - start_joins;
+        cache->ends_with_lf = (last_lf == iter.get_pointer());
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -1329,6 +1535,7 @@ COORD measure_readline_display(const char* prompt, const char* buffer, uint32 le
 void (*display_accumulator::s_saved_fwrite)(FILE*, const char*, int32) = nullptr;
 void (*display_accumulator::s_saved_fflush)(FILE*) = nullptr;
 bool display_accumulator::s_active = false;
+bool display_accumulator::s_synchronized = false;
 int32 display_accumulator::s_nested = 0;
 static str_moveable s_buf;
 
@@ -1368,6 +1575,13 @@ display_accumulator::display_accumulator()
 
     rl_fwrite_function = fwrite_proc;
     rl_fflush_function = fflush_proc;
+
+    // Let the terminal draw the whole frame at once.
+    if (s_nested == 1 && use_synchronized_output())
+    {
+        s_buf.concat("\x1b[?2026h");
+        s_synchronized = true;
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -1375,7 +1589,17 @@ display_accumulator::~display_accumulator()
 {
     if (--s_nested == 0)
     {
-        flush();
+        if (s_synchronized)
+        {
+            s_buf.concat("\x1b[?2026l");
+            s_synchronized = false;
+        }
+        {
+            // The finished update can be written by the render thread, so
+            // the next key can be handled without waiting for the console.
+            async_output_scope async;
+            write_buffer();
+        }
         rl_fwrite_function = s_saved_fwrite;
         rl_fflush_function = s_saved_fflush;
         s_saved_fwrite = nullptr;
@@ -1386,7 +1610,16 @@ display_accumulator::~display_accumulator()
 }
 
 //------------------------------------------------------------------------------
+// Writes the accumulated output and waits until it reaches the console, so the
+// caller can use the console state (e.g. the cursor position).
 void display_accumulator::flush()
+{
+    write_buffer();
+    wait_for_console_output();
+}
+
+//------------------------------------------------------------------------------
+void display_accumulator::write_buffer()
 {
     assertimplies(!s_active, s_buf.empty());
     if (s_active && !s_buf.empty())
@@ -1778,7 +2011,7 @@ void display_manager::display()
         if (m_horz_scroll)
             m_next.horz_parse(m_last_prompt_line_botlin, m_last_prompt_line_width, rl_line_buffer, rl_point, rl_end, m_curr);
         else
-            m_next.parse(m_last_prompt_line_botlin, m_last_prompt_line_width, rl_line_buffer, rl_end);
+            m_next.parse(m_last_prompt_line_botlin, m_last_prompt_line_width, rl_line_buffer, rl_end, &m_curr);
         assert(m_next.count() > 0);
     }
 #define m_next __use_next_instead__
@@ -1874,7 +2107,7 @@ void display_manager::display()
                 if (m_horz_scroll)
                     m_next.horz_parse(m_last_prompt_line_botlin, m_last_prompt_line_width, rl_line_buffer, rl_point, rl_end, m_curr);
                 else
-                    m_next.parse(m_last_prompt_line_botlin, m_last_prompt_line_width, rl_line_buffer, rl_end);
+                    m_next.parse(m_last_prompt_line_botlin, m_last_prompt_line_width, rl_line_buffer, rl_end, &m_curr);
 #define m_next __use_next_instead__
             }
         }
@@ -2754,8 +2987,20 @@ void set_history_expansions(history_expansion* list)
 }
 
 //------------------------------------------------------------------------------
-void resize_readline_display(const char* prompt, const line_buffer& buffer, const char* _prompt, const char* _rprompt)
+bool resize_readline_display(const char* prompt, const line_buffer& buffer, const char* _prompt, const char* _rprompt)
 {
+    // Only the width affects how the prompt and input line wrap.  When only the
+    // height changed, the existing layout is still valid, so just update
+    // Readline's perception of the terminal dimensions and skip the redraw.
+    {
+        CONSOLE_SCREEN_BUFFER_INFO csbi;
+        if (get_console_screen_buffer_info(&csbi) && csbi.dwSize.X == _rl_screenwidth)
+        {
+            refresh_terminal_size();
+            return false;
+        }
+    }
+
     // Clink tries to put the cursor on the original top row, compensating for
     // terminal wrapping behavior, and redisplay the prompt and input buffer.
     //
@@ -2857,6 +3102,8 @@ void resize_readline_display(const char* prompt, const line_buffer& buffer, cons
     if (g_debug_log_terminal.get())
         LOG("terminal size %u x %u", _rl_screenwidth, _rl_screenheight);
 #endif
+
+    return true;
 }
 
 //------------------------------------------------------------------------------
@@ -2872,6 +3119,7 @@ uint32 get_readline_display_top_offset()
 //------------------------------------------------------------------------------
 bool translate_xy_to_readline(uint32 x, uint32 y, int32& pos, bool clip)
 {
+    wait_for_console_output();
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi);
 
@@ -3,18 +3,24 @@
 
 #include "pch.h"
 #include "doskey.h"
+#include "alias_cache.h"
 #include "cmd_tokenisers.h"
 
 #include <core/base.h>
+#include <core/os.h>
 #include <core/settings.h>
 #include <core/str.h>
 #include <core/str_iter.h>
 #include <core/str_tokeniser.h>
+#include <core/str_unordered_set.h>
+#include <core/linear_allocator.h>
 #include <core/debugheap.h>
 
 #include "terminal/printer.h"
 #include "terminal/terminal_helpers.h"
 
+#include <vector>
+
 //------------------------------------------------------------------------------
 setting_bool g_enhanced_doskey(
     "doskey.enhanced",
@@ -29,10 +35,166 @@ setting_bool g_enhanced_doskey(
 
 
 //------------------------------------------------------------------------------
-static bool get_alias(const wchar_t* shell_name, str_iter& in, uint32& skipped, str_base& alias, str_base& text, int32& parens, bool relaxed=false)
+// A macro's text compiled into literal text (with the $G, $T, $$, etc tags
+// already converted) interleaved with argument slots, so that expanding it is
+// one pass with no reparsing.
+struct doskey_macro
+{
+    static const int8       c_no_arg = -2;
+    static const int8       c_star = -1;
+
+    struct slot
+    {
+        uint32              literal_end;    // Literal text up to here precedes the slot.
+        int8                arg;            // 0..8 for $1..$9, c_star for $*, or c_no_arg.
+    };
+
+    void                    compile(const char* text);
+
+    str_moveable            literals;
+    std::vector<slot>       slots;          // Always ends with a c_no_arg slot.
+    bool                    arg_in_quotes = false;
+};
+
+//------------------------------------------------------------------------------
+void doskey_macro::compile(const char* text)
 {
-    alias.clear();
-    text.clear();
+    literals.clear();
+    slots.clear();
+    arg_in_quotes = false;
+
+    bool quote = false;
+    for (const char* read = text; *read; ++read)
+    {
+        char c = *read;
+        if (c != '$')
+        {
+            if (c == '\"')
+                quote = !quote;
+            literals.concat(&c, 1);
+            continue;
+        }
+
+        c = *++read;
+        if (!c)
+            break;
+
+        // Convert $x tags.
+        char o = 0;
+        switch (c)
+        {
+        case '$':           o = '$';  break;
+        case 'g': case 'G': o = '>';  break;
+        case 'l': case 'L': o = '<';  break;
+        case 'b': case 'B': o = '|';  break;
+        case 't': case 'T': o = '\n'; break;
+        }
+        if (o)
+        {
+            literals.concat(&o, 1);
+            continue;
+        }
+
+        // Unknown tag? Perhaps it is a argument one?
+        int8 arg;
+        if (unsigned(c - '1') < 9)  arg = int8(c - '1');
+        else if (c == '*')          arg = c_star;
+        else
+        {
+            if (c == '\"')
+                quote = !quote;
+            literals.concat("$", 1);
+            literals.concat(&c, 1);
+            continue;
+        }
+
+        // $* or $1..9 exists inside quotes:  don't split.  Suppose
+        // `ps=powershell "$*"`, then the `|` should be passed to powershell
+        // when `ps applet |Format-Table` is used.
+        if (quote)
+            arg_in_quotes = true;
+
+        slots.push_back({ literals.length(), arg });
+    }
+
+    slots.push_back({ literals.length(), c_no_arg });
+}
+
+
+
+//------------------------------------------------------------------------------
+// Compiled macros for all the aliases, built from one bulk snapshot of the
+// aliases (see alias_cache) and rebuilt after os::invalidate_alias_cache().
+class doskey_macro_cache
+{
+public:
+                            doskey_macro_cache() : m_strings(4096, mem_tag::editor) {}
+    const doskey_macro*     find(const wchar_t* shell_name, const char* name);
+
+private:
+    void                    load(const wchar_t* shell_name);
+    str_unordered_map_caseless<doskey_macro> m_map;
+    linear_allocator        m_strings;
+    wstr_moveable           m_shell_name;
+    doskey_macro            m_single;       // When the snapshot couldn't be taken.
+    uint32                  m_generation = 0;
+    bool                    m_loaded = false;
+};
+
+//------------------------------------------------------------------------------
+static doskey_macro_cache s_macro_cache;
+
+//------------------------------------------------------------------------------
+const doskey_macro* doskey_macro_cache::find(const wchar_t* shell_name, const char* name)
+{
+    if (m_generation != os::get_alias_generation() || !m_shell_name.equals(shell_name))
+        load(shell_name);
+
+    if (m_loaded)
+    {
+        const auto& iter = m_map.find(name);
+        return (iter == m_map.end()) ? nullptr : &iter->second;
+    }
+
+    // If the snapshot couldn't be taken, look up the alias individually.
+    wstr<32> walias(name);
+    wstr_moveable wtext;
+    wtext.reserve(8192, true/*exact*/);
+    if (!GetConsoleAliasW(walias.data(), wtext.data(), wtext.size(), const_cast<wchar_t*>(shell_name)) ||
+        !wtext.length())
+        return nullptr;
+
+    str<> text;
+    text = wtext.c_str();
+    m_single.compile(text.c_str());
+    return &m_single;
+}
+
+//------------------------------------------------------------------------------
+void doskey_macro_cache::load(const wchar_t* shell_name)
+{
+    dbg_ignore_scope(snapshot, "Doskey macros");
+
+    m_map.clear();
+    m_strings.clear();
+    m_shell_name.copy(shell_name);
+    m_generation = os::get_alias_generation();
+    m_loaded = alias_cache::enum_aliases(shell_name, [this](const char* name, const char* text) {
+        const char* cache_name = m_strings.store(name);
+        if (!cache_name)
+            return;
+        doskey_macro macro;
+        macro.compile(text);
+        m_map.emplace(cache_name, std::move(macro));
+    });
+}
+
+
+
+//------------------------------------------------------------------------------
+static const doskey_macro* get_alias(const wchar_t* shell_name, str_iter& in, uint32& skipped, int32& parens, bool relaxed=false)
+{
+    str<32> alias;
 
     // Skip leading spaces and parens.
     bool first = true;
@@ -45,7 +207,7 @@ static bool get_alias(const wchar_t* shell_name, str_iter& in, uint32& skipped,
     if (in.more() && *start == ' ')
     {
         in.reset_pointer(orig);
-        return false;
+        return nullptr;
     }
 
     while (true)
@@ -71,32 +233,23 @@ static bool get_alias(const wchar_t* shell_name, str_iter& in, uint32& skipped,
         in.next();
     }
 
-    if (alias.empty())
+    // Find the alias' compiled macro.
+    const doskey_macro* macro = nullptr;
+    if (!alias.empty())
+        macro = s_macro_cache.find(shell_name, alias.c_str());
+
+    if (!macro)
     {
-fallback:
         in.reset_pointer(orig);
         if (relaxed || !g_enhanced_doskey.get())
-            return false;
-        return get_alias(shell_name, in, skipped, alias, text, parens, true);
+            return nullptr;
+        return get_alias(shell_name, in, skipped, parens, true);
     }
 
-    // Find the alias' text. First check it exists.
-    wchar_t unused;
-    wstr<32> walias(alias.c_str());
-    if (!GetConsoleAliasW(walias.data(), &unused, sizeof(unused), const_cast<wchar_t*>(shell_name)))
-        if (GetLastError() != ERROR_INSUFFICIENT_BUFFER)
-            goto fallback;
-
-    // It does. Allocate space and fetch it.
-    wstr_moveable wtext;
-    wtext.reserve(8192, true/*exact*/);
-    GetConsoleAliasW(walias.data(), wtext.data(), wtext.size(), const_cast<wchar_t*>(shell_name));
-    text = wtext.c_str();
-
     // Advance the iterator.
     while (in.peek() == ' ')
         in.next();
-    return true;
+    return macro;
 }
 
 //------------------------------------------------------------------------------
@@ -152,6 +305,7 @@ public:
                             ~str_stream();
     void                    operator << (TYPE c);
     void                    operator << (const range_desc desc);
+    void                    reserve(uint32 count);
     uint32                  length() const;
     uint32                  trimmed_length() const;
     void                    collect(str_impl<TYPE>& out);
@@ -198,6 +352,15 @@ void str_stream::operator << (const range_desc desc)
         *m_cursor = desc.ptr[i];
 }
 
+//------------------------------------------------------------------------------
+// Makes room for COUNT more characters, so that appending them doesn't grow
+// the buffer more than once.
+void str_stream::reserve(uint32 count)
+{
+    if (m_cursor + count >= m_end)
+        grow(count + 1);
+}
+
 //------------------------------------------------------------------------------
 str_stream::range_desc str_stream::range(const TYPE* ptr, uint32 count)
 {
@@ -301,6 +464,7 @@ bool doskey::add_alias(const char* alias, const char* text)
 {
     wstr<64> walias(alias);
     wstr<> wtext(text);
+    os::invalidate_alias_cache();
     return (AddConsoleAliasW(walias.data(), wtext.data(), m_shell_name.data()) == TRUE);
 }
 
@@ -308,6 +472,7 @@ bool doskey::add_alias(const char* alias, const char* text)
 bool doskey::remove_alias(const char* alias)
 {
     wstr<64> walias(alias);
+    os::invalidate_alias_cache();
     return (AddConsoleAliasW(walias.data(), nullptr, m_shell_name.data()) == TRUE);
 }
 
@@ -319,12 +484,11 @@ bool doskey::resolve_impl(str_iter& s, str_stream& out, int32* _point)
     str_iter command = s;
     str_iter in = s;
 
-    // Get alias and macro text.
-    str<32> alias;
-    str<32> text;
+    // Get the alias' compiled macro.
     uint32 skipped;
     int32 parens;
-    if (!get_alias(m_shell_name.data(), in, skipped, alias, text, parens))
+    const doskey_macro* macro = get_alias(m_shell_name.data(), in, skipped, parens);
+    if (!macro)
         return false;
     out << str_stream::range(s.get_pointer(), skipped);
 
@@ -363,38 +527,7 @@ bool doskey::resolve_impl(str_iter& s, str_stream& out, int32* _point)
 
     // Either split the input at the next command separator, or use the entire
     // input, depending on the doskey.enhanced setting and the macro text.
-    bool split = g_enhanced_doskey.get();
-    if (split)
-    {
-        bool quote = false;
-        str_iter macro(text.c_str(), text.length());
-        while (macro.more())
-        {
-            const int32 c = macro.next();
-            if (c == '\"')
-                quote = !quote;
-            if (c != '$')
-                continue;
-
-            const int32 tag = macro.peek();
-            if ((tag == '*') || (tag >= '1' && tag <= '9'))
-            {
-                // $* or $1..9 exists inside quotes:  don't split.
-                // Suppose `ps=powershell "$*"`, then the `|` should be passed
-                // to powershell when `ps applet |Format-Table` is used.
-                if (quote)
-                {
-                    split = false;
-                    break;
-                }
-            }
-            else if (tag == '$')
-            {
-                // Skip both chars of '$$' tag.
-                macro.next();
-            }
-        }
-    }
+    const bool split = g_enhanced_doskey.get() && !macro->arg_in_quotes;
     if (split)
     {
         // Restrict to resolve only up to the command separator.
@@ -483,53 +616,29 @@ bool doskey::resolve_impl(str_iter& s, str_stream& out, int32* _point)
     }
 #endif
 
-    // Expand the alias' text into 'out'.
-    bool set_point = !!point;
+    // Size the output exactly, then expand the macro into 'out'.
+    const int32 arg_count = args.size();
+    uint32 needed = macro->literals.length();
+    for (const auto& slot : macro->slots)
+    {
+        if (slot.arg == doskey_macro::c_star && arg_count)
+            needed += uint32(command.get_pointer() + command.length() - args.front()->ptr);
+        else if (slot.arg >= 0 && slot.arg < arg_count)
+            needed += args.front()[slot.arg].length;
+    }
+    out.reserve(needed);
+
     str_stream& stream = out;
-    const char* read = text.c_str();
+    const char* const literals = macro->literals.c_str();
+    uint32 literal_start = 0;
     int32 last_arg_resolved = -1;
-    for (int32 c = *read; c = *read; ++read)
+    for (const auto& slot : macro->slots)
     {
-        if (c != '$')
-        {
-            stream << c;
-            continue;
-        }
-
-        c = *++read;
-        if (!c)
-            break;
-
-        // Convert $x tags.
-        char o = 0;
-        switch (c)
-        {
-        case '$':           o = '$';  break;
-        case 'g': case 'G': o = '>';  break;
-        case 'l': case 'L': o = '<';  break;
-        case 'b': case 'B': o = '|';  break;
-        case 't': case 'T': o = '\n'; break;
-        }
-        if (o)
-        {
-            if (o == '\n')
-                set_point = false; // Only adjust point for the first line.
-            stream << o;
-            continue;
-        }
+        stream << str_stream::range(literals + literal_start, slot.literal_end - literal_start);
+        literal_start = slot.literal_end;
 
-        // Unknown tag? Perhaps it is a argument one?
-        if (unsigned(c - '1') < 9)  c -= '1';
-        else if (c == '*')          c = -1;
-        else
-        {
-            stream << '$';
-            stream << c;
-            continue;
-        }
-
-        int32 arg_count = args.size();
-        if (!arg_count)
+        int32 c = slot.arg;
+        if (c == doskey_macro::c_no_arg || !arg_count)
             continue;
 
         // Adjust point.
@@ -641,8 +750,12 @@ void doskey::resolve(const char* chars, doskey_alias& out, int32* point)
 
     str_stream stream;
 
+    // Most of the input is usually copied to the output.
+    const int32 len = int32(strlen(chars));
+    stream.reserve(len + 1);
+
     bool resolves = false;
-    str_iter text(chars, int32(strlen(chars)));
+    str_iter text(chars, len);
     while (text.more())
     {
         if (resolve_impl(text, stream, point))
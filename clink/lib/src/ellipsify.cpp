@@ -33,6 +33,18 @@ int32 ellipsify_to_callback(const char* in, int32 limit, int32 expand_ctrl, vstr
     return visible_len;
 }
 
+//------------------------------------------------------------------------------
+// Returns how many leading bytes of IN are printable ASCII, up to MAX_LEN.  Each
+// of those bytes is exactly one cell wide, so callers can truncate them without
+// measuring the text character by character.
+int32 printable_ascii_len(const char* in, int32 max_len)
+{
+    int32 len = 0;
+    while (len < max_len && uint8(in[len]) >= 0x20 && uint8(in[len]) < 0x7f)
+        ++len;
+    return len;
+}
+
 //------------------------------------------------------------------------------
 // Parse ANSI escape codes to determine the visible character length of the
 // string (which gets used for column alignment).  Truncate the string with an
@@ -50,6 +62,28 @@ int32 ellipsify(const char* in, int32 limit, str_base& out, bool expand_ctrl)
 
     out.clear();
 
+    // Fast path for plain printable ASCII text, which is the common case.
+    if (limit >= 0)
+    {
+        const int32 ascii = printable_ascii_len(in, limit + 1);
+        if (ascii <= limit && !in[ascii])
+        {
+            out.concat(in, ascii);
+            return ascii;
+        }
+        if (ascii > limit)
+        {
+            const int32 keep = max<int32>(0, limit - ellipsis_cells);
+            out.concat(in, keep);
+#ifdef USE_ASCII_ELLIPSIS
+            out.concat(ellipsis, min<int32>(ellipsis_len, limit - keep));
+#else
+            out.concat(ellipsis, ellipsis_len);
+#endif
+            return keep + cell_count(ellipsis);
+        }
+    }
+
     ecma48_state state;
     ecma48_iter iter(in, state);
     while (visible_len <= limit)
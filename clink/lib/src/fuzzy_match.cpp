@@ -0,0 +1,193 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "fuzzy_match.h"
+
+#include <core/base.h>
+#include <core/path.h>
+#include <core/str_compare.h>
+#include <core/str_iter.h>
+
+#include <algorithm>
+#include <wctype.h>
+
+//------------------------------------------------------------------------------
+static const int32 c_score_match = 16;
+static const int32 c_gap_start = -3;
+static const int32 c_gap_extend = -1;
+static const int32 c_bonus_path = 9;
+static const int32 c_bonus_boundary = 8;
+static const int32 c_bonus_camel = 7;
+static const int32 c_bonus_consecutive = 4;
+static const int32 c_first_char_multiplier = 2;
+static const int32 c_none = -(1 << 28);
+
+//------------------------------------------------------------------------------
+enum char_class : uint8 { class_other, class_lower, class_upper, class_digit, class_separator, class_delimiter };
+
+//------------------------------------------------------------------------------
+static char_class classify(int32 c)
+{
+    if (path::is_separator(c))
+        return class_separator;
+    if (c == ' ' || c == '_' || c == '-' || c == '.' || c == ':' || c == ',' || c == ';')
+        return class_delimiter;
+    if (c > 0xffff)
+        return class_other;
+    if (iswdigit(wint_t(c)))
+        return class_digit;
+    if (iswupper(wint_t(c)))
+        return class_upper;
+    if (iswalpha(wint_t(c)))
+        return class_lower;
+    return class_other;
+}
+
+//------------------------------------------------------------------------------
+static uint8 get_bonus(char_class prev, char_class cur)
+{
+    if (cur == class_separator || cur == class_delimiter)
+        return 0;
+    if (prev == class_separator)
+        return c_bonus_path;
+    if (prev == class_delimiter)
+        return c_bonus_boundary;
+    if (prev == class_lower && cur == class_upper)
+        return c_bonus_camel;
+    if (prev != class_digit && cur == class_digit)
+        return c_bonus_camel;
+    return 0;
+}
+
+
+
+//------------------------------------------------------------------------------
+fuzzy_matcher::fuzzy_matcher(const char* needle)
+{
+    const int32 mode = str_compare_scope::current();
+    const bool fuzzy_accents = str_compare_scope::current_fuzzy_accents();
+
+    str_iter iter(needle);
+    while (int32 c = iter.next())
+        m_needle.push_back(str_compare_fold(c, mode, fuzzy_accents, false/*exact_slash*/));
+}
+
+//------------------------------------------------------------------------------
+// Returns the score for TEXT, or no_match if the needle isn't a subsequence of
+// TEXT.  Scores are never negative.
+int32 fuzzy_matcher::score(const char* text, int32 len)
+{
+    if (!text)
+        return no_match;
+
+    fold(text, len);
+
+    const uint32 m = uint32(m_needle.size());
+    const uint32 n = uint32(m_text.size());
+    if (!m)
+        return 0;
+    if (m > n)
+        return no_match;
+
+    // Cheap subsequence test first; most candidates fail it.
+    {
+        uint32 i = 0;
+        for (uint32 j = 0; j < n && i < m; ++j)
+            if (m_text[j] == m_needle[i])
+                ++i;
+        if (i < m)
+            return no_match;
+    }
+
+    // Two rows each of M (best score with needle[i] matched at text[j]) and H
+    // (best score with needle[i] matched at or before text[j]), in one buffer.
+    m_rows.resize(n * 4);
+    int32* prev_m = m_rows.data();
+    int32* prev_h = prev_m + n;
+    int32* cur_m = prev_h + n;
+    int32* cur_h = cur_m + n;
+
+    int32 best = c_none;
+    for (uint32 i = 0; i < m; ++i)
+    {
+        const int32 nc = m_needle[i];
+        int32 gap = c_none;
+        for (uint32 j = 0; j < n; ++j)
+        {
+            int32 s = c_none;
+            if (m_text[j] == nc)
+            {
+                if (!i)
+                {
+                    s = c_score_match + m_bonus[j] * c_first_char_multiplier;
+                }
+                else if (j)
+                {
+                    const int32 after_gap = prev_h[j - 1] + c_score_match + m_bonus[j];
+                    const int32 consecutive = prev_m[j - 1] + c_score_match + max<int32>(m_bonus[j], c_bonus_consecutive);
+                    s = max(after_gap, consecutive);
+                }
+            }
+
+            if (j)
+                gap = max(cur_m[j - 1] + c_gap_start, gap + c_gap_extend);
+
+            cur_m[j] = (s < c_none) ? c_none : s;
+            cur_h[j] = max(cur_m[j], gap);
+
+            if (i == m - 1 && cur_m[j] > best)
+                best = cur_m[j];
+        }
+
+        std::swap(prev_m, cur_m);
+        std::swap(prev_h, cur_h);
+    }
+
+    if (best <= c_none / 2)
+        return no_match;
+    return max<int32>(best, 0);
+}
+
+//------------------------------------------------------------------------------
+bool fuzzy_matcher::better(const result& a, const result& b)
+{
+    if (a.score != b.score)
+        return a.score > b.score;
+    return a.index < b.index;
+}
+
+//------------------------------------------------------------------------------
+void fuzzy_matcher::fold(const char* text, int32 len)
+{
+    const int32 mode = str_compare_scope::current();
+    const bool fuzzy_accents = str_compare_scope::current_fuzzy_accents();
+
+    m_text.clear();
+    m_bonus.clear();
+
+    char_class prev = class_separator;
+    str_iter iter(text, len);
+    while (int32 c = iter.next())
+    {
+        const char_class cur = classify(c);
+        m_text.push_back(str_compare_fold(c, mode, fuzzy_accents, false/*exact_slash*/));
+        m_bonus.push_back(get_bonus(prev, cur));
+        prev = cur;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Orders only as much of OUT as is needed to find the best LIMIT results.
+void fuzzy_matcher::select_top(uint32 limit, std::vector<result>& out) const
+{
+    if (limit && limit < out.size())
+    {
+        std::partial_sort(out.begin(), out.begin() + limit, out.end(), &better);
+        out.resize(limit);
+    }
+    else
+    {
+        std::sort(out.begin(), out.end(), &better);
+    }
+}
@@ -0,0 +1,460 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "history_archive.h"
+
+#include <core/base.h>
+#include <core/str.h>
+#include <core/log.h>
+
+#include <ctime>
+
+//------------------------------------------------------------------------------
+static const char c_archive_signature[8] = { '\0', 'C', 'L', 'H', 'A', 'R', 'C', '\x01' };
+static const uint32 c_max_archive_size = 0x40000000;
+
+enum : uint32
+{
+    method_stored   = 0,
+    method_lznt1    = COMPRESSION_FORMAT_LZNT1,
+};
+
+struct archive_header
+{
+    char            signature[8];
+    uint32          tag;
+    uint32          count;
+    uint32          method;
+    uint32          raw_size;
+    uint32          packed_size;
+};
+
+// The raw payload is a table of uint32 offsets (one per entry), followed by
+// the entries.  Each entry is an archive_record followed by its text.
+struct archive_record
+{
+    uint32          length;
+    uint32          time;
+    uint32          dir;
+};
+
+
+
+//------------------------------------------------------------------------------
+// LZNT1 compression is available in every supported version of Windows via
+// ntdll, whereas the Compression API requires Windows 8.
+static class delay_load_ntdll
+{
+public:
+                        delay_load_ntdll();
+    bool                init();
+    bool                compress(const char* in, uint32 in_size, std::vector<char>& out);
+    bool                decompress(const char* in, uint32 in_size, char* out, uint32 out_size);
+private:
+    bool                m_initialized = false;
+    bool                m_ok = false;
+    union
+    {
+        FARPROC         proc[3];
+        struct {
+            LONG (WINAPI* RtlGetCompressionWorkSpaceSize)(USHORT format, ULONG* buffer_workspace, ULONG* fragment_workspace);
+            LONG (WINAPI* RtlCompressBuffer)(USHORT format, UCHAR* in, ULONG in_size, UCHAR* out, ULONG out_size, ULONG chunk_size, ULONG* final_size, void* workspace);
+            LONG (WINAPI* RtlDecompressBuffer)(USHORT format, UCHAR* out, ULONG out_size, UCHAR* in, ULONG in_size, ULONG* final_size);
+        };
+    } m_procs;
+} s_ntdll;
+
+//------------------------------------------------------------------------------
+delay_load_ntdll::delay_load_ntdll()
+{
+    ZeroMemory(&m_procs, sizeof(m_procs));
+}
+
+//------------------------------------------------------------------------------
+bool delay_load_ntdll::init()
+{
+    if (!m_initialized)
+    {
+        m_initialized = true;
+        HMODULE hlib = GetModuleHandle("ntdll.dll");
+        if (hlib)
+        {
+            m_procs.proc[0] = GetProcAddress(hlib, "RtlGetCompressionWorkSpaceSize");
+            m_procs.proc[1] = GetProcAddress(hlib, "RtlCompressBuffer");
+            m_procs.proc[2] = GetProcAddress(hlib, "RtlDecompressBuffer");
+        }
+        m_ok = !!m_procs.proc[0] && !!m_procs.proc[1] && !!m_procs.proc[2];
+    }
+
+    return m_ok;
+}
+
+//------------------------------------------------------------------------------
+bool delay_load_ntdll::compress(const char* in, uint32 in_size, std::vector<char>& out)
+{
+    if (!init())
+        return false;
+
+    const USHORT format = COMPRESSION_FORMAT_LZNT1|COMPRESSION_ENGINE_MAXIMUM;
+    ULONG workspace_size = 0;
+    ULONG fragment_size = 0;
+    if (m_procs.RtlGetCompressionWorkSpaceSize(format, &workspace_size, &fragment_size) < 0)
+        return false;
+
+    // LZNT1 stores incompressible 4KB chunks as-is, with a 2 byte header.
+    std::vector<char> workspace(workspace_size);
+    out.resize(in_size + (in_size / 2048) + 4096);
+
+    ULONG final_size = 0;
+    if (m_procs.RtlCompressBuffer(format, (UCHAR*)in, in_size, (UCHAR*)out.data(), ULONG(out.size()), 4096, &final_size, workspace.data()) < 0)
+        return false;
+
+    out.resize(final_size);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool delay_load_ntdll::decompress(const char* in, uint32 in_size, char* out, uint32 out_size)
+{
+    if (!init())
+        return false;
+
+    ULONG final_size = 0;
+    if (m_procs.RtlDecompressBuffer(COMPRESSION_FORMAT_LZNT1, (UCHAR*)out, out_size, (UCHAR*)in, in_size, &final_size) < 0)
+        return false;
+
+    return final_size == out_size;
+}
+
+
+
+//------------------------------------------------------------------------------
+static HANDLE open_archive(const char* path, bool write)
+{
+    wstr<280> wpath(path);
+    const DWORD access = write ? GENERIC_READ|GENERIC_WRITE : GENERIC_READ;
+    const DWORD share = FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE;
+    return CreateFileW(wpath.c_str(), access, share, nullptr, write ? OPEN_ALWAYS : OPEN_EXISTING,
+                       FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+}
+
+//------------------------------------------------------------------------------
+static bool read_header(HANDLE h, archive_header& header)
+{
+    DWORD read;
+    return (ReadFile(h, &header, sizeof(header), &read, nullptr) &&
+            read == sizeof(header) &&
+            memcmp(header.signature, c_archive_signature, sizeof(header.signature)) == 0);
+}
+
+//------------------------------------------------------------------------------
+static void get_removals_path(const char* path, str_base& out)
+{
+    out = path;
+    out << ".removals";
+}
+
+
+
+//------------------------------------------------------------------------------
+void history_archive::clear()
+{
+    m_text.clear();
+    m_entries.clear();
+    m_tag = 0;
+    m_removed = 0;
+}
+
+//------------------------------------------------------------------------------
+// Loads and decompresses the archive, skipping any entries that have been
+// removed.  Returns false if there is no archive, or if it is invalid.
+bool history_archive::load(const char* path)
+{
+    clear();
+
+    HANDLE h = open_archive(path, false);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+
+    archive_header header;
+    const DWORD file_size = GetFileSize(h, nullptr);
+    bool ok = (read_header(h, header) &&
+               header.packed_size == file_size - sizeof(header) &&
+               header.raw_size <= c_max_archive_size &&
+               header.count <= header.raw_size / sizeof(uint32));
+
+    std::vector<char> packed;
+    if (ok)
+    {
+        DWORD read;
+        packed.resize(header.packed_size);
+        ok = (ReadFile(h, packed.data(), header.packed_size, &read, nullptr) && read == header.packed_size);
+    }
+    CloseHandle(h);
+
+    if (ok)
+    {
+        m_text.resize(header.raw_size);
+        if (header.method == method_lznt1)
+            ok = s_ntdll.decompress(packed.data(), header.packed_size, m_text.data(), header.raw_size);
+        else if (header.method == method_stored && header.packed_size == header.raw_size)
+            memcpy(m_text.data(), packed.data(), header.raw_size);
+        else
+            ok = false;
+    }
+
+    if (!ok)
+    {
+        LOG("ignoring invalid history archive '%s'", path);
+        clear();
+        return false;
+    }
+
+    // Collect the removals that apply to this archive.
+    std::vector<bool> removed;
+    {
+        str<280> removals;
+        get_removals_path(path, removals);
+        h = open_archive(removals.c_str(), false);
+        if (h != INVALID_HANDLE_VALUE)
+        {
+            DWORD read;
+            uint32 tag;
+            if (ReadFile(h, &tag, sizeof(tag), &read, nullptr) && read == sizeof(tag) && tag == header.tag)
+            {
+                removed.resize(header.count);
+                uint32 ordinal;
+                while (ReadFile(h, &ordinal, sizeof(ordinal), &read, nullptr) && read == sizeof(ordinal))
+                {
+                    if (ordinal < header.count)
+                        removed[ordinal] = true;
+                }
+            }
+            CloseHandle(h);
+        }
+    }
+
+    const uint32* offsets = reinterpret_cast<const uint32*>(m_text.data());
+    const uint32 first = header.count * sizeof(uint32);
+    m_entries.reserve(header.count);
+    for (uint32 i = 0; i < header.count; ++i)
+    {
+        const uint32 offset = offsets[i];
+        if (offset < first || offset > header.raw_size - sizeof(archive_record))
+        {
+            LOG("ignoring corrupt history archive '%s'", path);
+            clear();
+            return false;
+        }
+
+        archive_record record;
+        memcpy(&record, m_text.data() + offset, sizeof(record));
+        if (record.length > header.raw_size - offset - sizeof(record))
+        {
+            LOG("ignoring corrupt history archive '%s'", path);
+            clear();
+            return false;
+        }
+
+        if (!removed.empty() && removed[i])
+        {
+            ++m_removed;
+            continue;
+        }
+
+        entry e;
+        e.text = offset + sizeof(record);
+        e.length = record.length;
+        e.time = record.time;
+        e.dir = record.dir;
+        e.ordinal = i;
+        m_entries.push_back(e);
+    }
+
+    m_tag = header.tag;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Writes the entries to a new archive (with a new tag), replacing the existing
+// archive and discarding its removals.  If the archive is empty, the archive
+// is deleted instead.
+bool history_archive::save(const char* path)
+{
+    if (m_entries.empty())
+    {
+        erase(path);
+        m_tag = 0;
+        m_removed = 0;
+        return true;
+    }
+
+    // Build the raw payload.
+    std::vector<char> raw;
+    {
+        size_t raw_size = m_entries.size() * sizeof(uint32);
+        for (const auto& e : m_entries)
+            raw_size += sizeof(archive_record) + e.length;
+        if (raw_size > c_max_archive_size)
+            return false;
+
+        raw.resize(raw_size);
+        uint32* offsets = reinterpret_cast<uint32*>(raw.data());
+        uint32 offset = uint32(m_entries.size() * sizeof(uint32));
+        for (size_t i = 0; i < m_entries.size(); ++i)
+        {
+            const entry& e = m_entries[i];
+            const archive_record record = { e.length, e.time, e.dir };
+            offsets[i] = offset;
+            memcpy(raw.data() + offset, &record, sizeof(record));
+            memcpy(raw.data() + offset + sizeof(record), m_text.data() + e.text, e.length);
+            offset += sizeof(record) + e.length;
+        }
+    }
+
+    archive_header header = {};
+    memcpy(header.signature, c_archive_signature, sizeof(header.signature));
+    header.count = uint32(m_entries.size());
+    header.raw_size = uint32(raw.size());
+
+    // Fall back to storing the payload uncompressed if compression isn't
+    // available.
+    std::vector<char> packed;
+    const char* payload = raw.data();
+    if (s_ntdll.compress(raw.data(), uint32(raw.size()), packed) && packed.size() < raw.size())
+    {
+        header.method = method_lznt1;
+        header.packed_size = uint32(packed.size());
+        payload = packed.data();
+    }
+    else
+    {
+        header.method = method_stored;
+        header.packed_size = header.raw_size;
+    }
+
+    do
+    {
+        header.tag = GetTickCount() ^ (GetCurrentProcessId() << 16) ^ uint32(time(nullptr));
+    }
+    while (!header.tag || header.tag == m_tag);
+
+    // Write to a temporary file and then replace the archive, so that other
+    // processes never see a partially written archive.
+    str<280> tmp;
+    tmp.format("%s.%u", path, GetCurrentProcessId());
+
+    wstr<280> wtmp(tmp.c_str());
+    HANDLE h = CreateFileW(wtmp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+
+    DWORD written;
+    bool ok = (WriteFile(h, &header, sizeof(header), &written, nullptr) && written == sizeof(header) &&
+               WriteFile(h, payload, header.packed_size, &written, nullptr) && written == header.packed_size);
+    CloseHandle(h);
+
+    wstr<280> wpath(path);
+    if (ok)
+        ok = !!MoveFileExW(wtmp.c_str(), wpath.c_str(), MOVEFILE_REPLACE_EXISTING);
+    if (!ok)
+    {
+        DeleteFileW(wtmp.c_str());
+        return false;
+    }
+
+    str<280> removals;
+    get_removals_path(path, removals);
+    wstr<280> wremovals(removals.c_str());
+    DeleteFileW(wremovals.c_str());
+
+    for (uint32 i = 0; i < header.count; ++i)
+        m_entries[i].ordinal = i;
+    m_tag = header.tag;
+    m_removed = 0;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void history_archive::add(const char* line, uint32 length, uint32 time, uint32 dir)
+{
+    entry e;
+    e.text = uint32(m_text.size());
+    e.length = length;
+    e.time = time;
+    e.dir = dir;
+    e.ordinal = uint32(-1);
+    m_text.insert(m_text.end(), line, line + length);
+    m_entries.push_back(e);
+}
+
+//------------------------------------------------------------------------------
+// Drops the oldest entries so that at most LIMIT remain.  The space used by
+// their text is reclaimed when the archive is saved and reloaded.
+void history_archive::trim(size_t limit)
+{
+    if (m_entries.size() > limit)
+        m_entries.erase(m_entries.begin(), m_entries.end() - limit);
+}
+
+//------------------------------------------------------------------------------
+// Drops the newest entries so that COUNT remain.  Their text stays available
+// via get_text() until the archive is cleared or loaded.
+void history_archive::truncate(size_t count)
+{
+    if (m_entries.size() > count)
+        m_entries.resize(count);
+}
+
+//------------------------------------------------------------------------------
+// Records that the entry at ORDINAL has been removed from the archive tagged
+// TAG.  Fails if the archive has since been rewritten.  The caller must hold
+// the master bank's lock, which serialises removals with rewriting the archive.
+bool history_archive::remove(const char* path, uint32 tag, uint32 ordinal)
+{
+    HANDLE h = open_archive(path, false);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+
+    archive_header header;
+    const bool ok = (read_header(h, header) && (!tag || header.tag == tag) && ordinal < header.count);
+    CloseHandle(h);
+    if (!ok)
+        return false;
+
+    str<280> removals;
+    get_removals_path(path, removals);
+    h = open_archive(removals.c_str(), true);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+
+    // Removals left over from a previous archive are discarded.
+    DWORD read;
+    DWORD written;
+    uint32 removals_tag = 0;
+    if (!ReadFile(h, &removals_tag, sizeof(removals_tag), &read, nullptr) || read != sizeof(removals_tag) || removals_tag != header.tag)
+    {
+        SetFilePointer(h, 0, nullptr, FILE_BEGIN);
+        SetEndOfFile(h);
+        WriteFile(h, &header.tag, sizeof(header.tag), &written, nullptr);
+    }
+
+    SetFilePointer(h, 0, nullptr, FILE_END);
+    const bool wrote = (WriteFile(h, &ordinal, sizeof(ordinal), &written, nullptr) && written == sizeof(ordinal));
+    CloseHandle(h);
+    return wrote;
+}
+
+//------------------------------------------------------------------------------
+void history_archive::erase(const char* path)
+{
+    str<280> removals;
+    get_removals_path(path, removals);
+
+    wstr<280> wpath(path);
+    wstr<280> wremovals(removals.c_str());
+    DeleteFileW(wpath.c_str());
+    DeleteFileW(wremovals.c_str());
+}
@@ -0,0 +1,55 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <core/base.h>
+
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Compressed, immutable archive of the oldest history lines in the master bank.
+// The master bank then only holds a small tail of recent lines, which is the
+// only part that has to be appended to, rewritten, and locked.  Compacting the
+// master bank rolls the older lines from the tail into a new archive.
+//
+// The archive starts with a table of the offsets of its entries, so loading it
+// only needs to decompress it, without scanning for line breaks.  Removing an
+// archived entry appends its ordinal to a removals file next to the archive,
+// which is applied the next time the archive is loaded or rolled.  The archive
+// and the removals file both carry a tag that changes each time the archive is
+// rewritten, so stale removals are ignored.
+class history_archive
+    : public no_copy
+{
+public:
+    struct entry
+    {
+        uint32          text;           // Offset in m_text.
+        uint32          length;
+        uint32          time;           // 0 if none.
+        uint32          dir;            // 0 if none.
+        uint32          ordinal;        // Position in the archive file, or -1 if added.
+    };
+
+    void                clear();
+    bool                load(const char* path);
+    bool                save(const char* path);
+    void                add(const char* line, uint32 length, uint32 time, uint32 dir);
+    void                trim(size_t limit);
+    void                truncate(size_t count);
+    size_t              size() const { return m_entries.size(); }
+    const entry&        get(size_t index) const { return m_entries[index]; }
+    const char*         get_text(const entry& e) const { return m_text.data() + e.text; }
+    uint32              get_tag() const { return m_tag; }
+    uint32              get_removed_count() const { return m_removed; }
+
+    static bool         remove(const char* path, uint32 tag, uint32 ordinal);
+    static void         erase(const char* path);
+
+private:
+    std::vector<char>   m_text;
+    std::vector<entry>  m_entries;
+    uint32              m_tag = 0;
+    uint32              m_removed = 0;
+};
@@ -0,0 +1,132 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "history_command_index.h"
+#include "cmd_tokenisers.h"
+#include "word_collector.h"
+
+#include <core/base.h>
+#include <core/str.h>
+
+extern "C" {
+#include <readline/history.h>
+}
+
+//------------------------------------------------------------------------------
+history_command_index::history_command_index()
+: m_store(4096, mem_tag::history)
+{
+}
+
+//------------------------------------------------------------------------------
+void history_command_index::clear()
+{
+    m_store.clear();
+    m_vocab.clear();
+    m_words.clear();
+    m_commands.clear();
+    m_entries.clear();
+    m_count = 0;
+    m_first = nullptr;
+    m_last = nullptr;
+    m_last_line = nullptr;
+}
+
+//------------------------------------------------------------------------------
+void history_command_index::sync()
+{
+    HIST_ENTRY** list = history_list();
+    const int32 length = list ? history_length : 0;
+
+    // Anything other than appending to the history list (removing entries,
+    // replacing entries, reloading the history) requires rebuilding the index.
+    bool rebuild = (length < m_count);
+    if (!rebuild && m_count)
+    {
+        const HIST_ENTRY* last = list[m_count - 1];
+        rebuild = (list[0] != m_first || last != m_last || last->line != m_last_line);
+    }
+
+    if (rebuild)
+        clear();
+
+    if (m_count == length)
+        return;
+
+    cmd_command_tokeniser command_tokeniser;
+    cmd_word_tokeniser word_tokeniser;
+    word_collector collector(&command_tokeniser, &word_tokeniser);
+    for (int32 i = m_count; i < length; ++i)
+        add_line(collector, list[i]->line, i);
+
+    m_count = length;
+    m_first = list[0];
+    m_last = list[length - 1];
+    m_last_line = list[length - 1]->line;
+}
+
+//------------------------------------------------------------------------------
+void history_command_index::add_line(word_collector& collector, const char* line, int32 index)
+{
+    entry e;
+    e.first = uint32(m_commands.size());
+    e.count = 0;
+
+    const uint32 len = uint32(strlen(line));
+    std::vector<word> words;
+    std::vector<command> commands;
+    command_line_states command_line_states;
+    collector.collect_words(line, len, len/*cursor*/, words, collect_words_mode::whole_command, &commands);
+    command_line_states.set(line, len, 0, words, commands);
+
+    str<> tmp;
+    for (const line_state& state : command_line_states.get_linestates(line, len))
+    {
+        const uint32 command_word_index = state.get_command_word_index();
+        const auto& state_words = state.get_words();
+        if (command_word_index + 1 >= state_words.size())
+            continue;
+        if (!state.get_word(command_word_index, tmp) || tmp.empty())
+            continue;
+
+        m_commands.push_back(add_word(tmp.c_str(), state_words[command_word_index].quoted, index));
+        ++e.count;
+    }
+
+    m_entries.push_back(e);
+}
+
+//------------------------------------------------------------------------------
+uint32 history_command_index::add_word(const char* word, bool quoted, int32 index)
+{
+    str<> key;
+    if (quoted)
+        key << "\"";
+    key << word;
+
+    uint32 id;
+    const auto it = m_words.find(key.c_str());
+    if (it != m_words.end())
+    {
+        id = it->second;
+    }
+    else
+    {
+        const char* stored = m_store.store(key.c_str());
+        id = uint32(m_vocab.size());
+
+        vocab v;
+        v.word = stored + (quoted ? 1 : 0);
+        v.uses = 0;
+        v.newest = index;
+        v.quoted = quoted;
+        m_vocab.push_back(v);
+        m_words.emplace(stored, id);
+    }
+
+    vocab& v = m_vocab[id];
+    ++v.uses;
+    v.newest = index;
+    return id;
+}
@@ -3,17 +3,27 @@
 
 #include "pch.h"
 #include "history_db.h"
+#include "history_archive.h"
+#include "history_dir_index.h"
+#include "history_event_index.h"
+#include "history_feed.h"
+#include "history_index.h"
+#include "history_time_index.h"
 
 #include <core/base.h>
 #include <core/globber.h>
+#include <core/housekeeping.h>
 #include <core/os.h>
 #include <core/settings.h>
 #include <core/str.h>
+#include <core/str_hash.h>
+#include <core/str_transform.h>
 #include <core/str_tokeniser.h>
 #include <core/str_map.h>
 #include <core/auto_free_str.h>
 #include <core/path.h>
 #include <core/log.h>
+#include <core/mem_stats.h>
 #include <assert.h>
 
 #include <new>
@@ -23,10 +33,12 @@ extern "C" {
 #include <readline/rlprivate.h> // Needed for _rl_free_undo_list().
 #include <readline/history.h>
 #include <readline/histlib.h>   // Depends on config.h.
+#include <readline/xmalloc.h>
 }
 
 #include <algorithm>
 #include <memory>
+#include <thread>
 #include <unordered_set>
 
 #include <core/debugheap.h>
@@ -69,6 +81,44 @@ setting_enum g_dupe_mode(
     "add,ignore,erase_prev",
     2);
 
+static setting_bool g_memory_map(
+    "history.memory_map",
+    "Use memory mapped history files",
+    "When enabled, history files are memory mapped and an index of line offsets\n"
+    "and line hashes is saved next to the master history file.  This makes\n"
+    "loading large histories faster, because only lines added since the index\n"
+    "was saved need to be scanned, and it makes finding duplicate lines faster.",
+    false);
+
+static setting_bool g_background_compact(
+    "history.background_compact",
+    "Compact the master history file in the background",
+    "When enabled, automatically compacting the master history file happens on\n"
+    "a background thread, and the history file is only locked briefly at a time.\n"
+    "This avoids pausing at the prompt when the history file is compacted.",
+    false);
+
+static setting_bool g_archive(
+    "history.archive",
+    "Archive old history in a compressed file",
+    "When enabled, compacting the master history file moves all but the most\n"
+    "recent lines into a compressed archive file next to it.  The master history\n"
+    "file then stays small, so it's faster to load, lock, and sync (e.g. with\n"
+    "roaming profiles).  When disabled, the archived lines are moved back into\n"
+    "the master history file the next time it's compacted.  Older versions of\n"
+    "Clink ignore the archive.",
+    false);
+
+static setting_enum g_file_format(
+    "history.file_format",
+    "The format for history files",
+    "When set to 'binary', history files are stored as length-prefixed records\n"
+    "instead of lines of text, which are faster to read.  Existing history files\n"
+    "are converted to the configured format when a new session starts.  Older\n"
+    "versions of Clink can only read the 'text' format.",
+    "text,binary",
+    0);
+
 static setting_enum g_expand_mode(
     "history.expand_mode",
     "Sets how command history expansion is applied",
@@ -80,6 +130,15 @@ static setting_enum g_expand_mode(
     "off,on,not_squoted,not_dquoted,not_quoted",
     4);
 
+static setting_bool g_save_dir(
+    "history.save_dir",
+    "Save the current directory for history items",
+    "When enabled, a hash of the current directory is saved for each history\n"
+    "item, so that history can be scoped to the directory where commands were\n"
+    "entered.  This is used by the 'cwd_history' suggestion strategy and the\n"
+    "'clink-popup-cwd-history' command.",
+    false);
+
 setting_enum g_history_timestamp(
     "history.time_stamp",
     "History item timestamps",
@@ -129,6 +188,13 @@ static int32 history_expand_control(char* line, int32 marker_pos)
     return 0;
 }
 
+//------------------------------------------------------------------------------
+static history_event_index s_history_event_index;
+static int32 history_event_search(const char* string, int32 substring, int32 start)
+{
+    return s_history_event_index.find(string, !!substring, start);
+}
+
 //------------------------------------------------------------------------------
 static void* open_file(const char* path, bool if_exists=false)
 {
@@ -203,6 +269,64 @@ union line_id_impl
 
 static const line_id_impl c_max_line_id(uint32(-1));
 
+// Archived lines use this bank index, and their offset is their ordinal in the
+// archive.  There are no bank handles for it.
+static const uint32 c_bank_archive = bank_count;
+static_assert(c_bank_archive < 4, "c_bank_archive must fit in line_id_impl::bank_index");
+
+// When the archive is enabled, the master bank is rolled into the archive once
+// it has more than c_archive_roll_lines lines, keeping the newest lines.
+static const size_t c_archive_roll_lines = 5000;
+static const size_t c_archive_hot_lines = 1000;
+
+// Orphaned session files are reaped in the background at most this often (in
+// seconds) across all sessions sharing a master bank.
+static const uint32 c_reap_interval = 5 * 60;
+
+
+
+//------------------------------------------------------------------------------
+// Binary bank format:
+//
+//  - The file begins with an 8 byte signature, ending with the format version.
+//  - Each record is a header (text length, flags, directory hash, timestamp),
+//    followed by the text (not NUL terminated), followed by the total size of
+//    the record so the bank can also be walked backwards.
+//  - In the master bank the first record is the concurrency tag.
+//  - A line id is the offset of its record.  Removing a line sets the removed
+//    flag in its record, in place.
+static const char c_binary_signature[8] = { '\0', 'C', 'L', 'H', 'B', 'N', 'K', '\x01' };
+
+struct binary_record
+{
+    uint32          length;
+    uint8           flags;
+    uint8           dir[3];             // 24 bit hash; see hash_dir().
+    uint32          time;
+};
+
+enum : uint8
+{
+    record_removed  = 0x01,
+    record_ctag     = 0x02,
+    record_time     = 0x04,
+    record_dir      = 0x08,
+};
+
+static_assert(sizeof(binary_record) == 12, "unexpected binary_record size");
+static const uint32 c_record_overhead = sizeof(binary_record) + sizeof(uint32);
+
+// Records must fit in a history_read_buffer, and load_internal() needs room to
+// NUL terminate the text.
+static const uint32 c_max_record_text = 64000 - c_record_overhead - 64;
+
+//------------------------------------------------------------------------------
+static bool is_binary_signature(const char* data, uint32 size)
+{
+    return (size >= sizeof(c_binary_signature) &&
+            memcmp(data, c_binary_signature, sizeof(c_binary_signature)) == 0);
+}
+
 
 
 //------------------------------------------------------------------------------
@@ -241,14 +365,18 @@ protected:
                     bank_lock(bank_lock&& other);
                     ~bank_lock();
     bank_lock&      operator = (bank_lock&& other);
+    bool            is_binary() const;
     void*           m_handle_lines = nullptr;       // From bank_master or bank_session.
     void*           m_handle_removals = nullptr;    // Always from bank_session, or nullptr.
+    bool            m_prefer_binary = false;        // Format for empty banks.
+    mutable int8    m_binary = -1;                  // Format of the bank, once known.
 };
 
 //------------------------------------------------------------------------------
 bank_lock::bank_lock(const bank_handles& handles, bool exclusive)
 : m_handle_lines(handles.m_handle_lines)
 , m_handle_removals(handles.m_handle_removals)
+, m_prefer_binary(handles.m_binary)
 {
     if (m_handle_lines == nullptr)
         return;
@@ -289,11 +417,51 @@ bank_lock& bank_lock::operator = (bank_lock&& other)
 {
     m_handle_lines = other.m_handle_lines;
     m_handle_removals = other.m_handle_removals;
+    m_prefer_binary = other.m_prefer_binary;
+    m_binary = other.m_binary;
     other.m_handle_lines = nullptr;
     other.m_handle_removals = nullptr;
     return *this;
 }
 
+//------------------------------------------------------------------------------
+// Returns 1 if the bank is binary, 0 if it's text, or -1 if it's empty.  The
+// file pointer is preserved.
+static int8 sniff_bank_format(void* handle)
+{
+    const DWORD file_ptr = SetFilePointer(handle, 0, nullptr, FILE_CURRENT);
+    SetFilePointer(handle, 0, nullptr, FILE_BEGIN);
+
+    DWORD read = 0;
+    char signature[sizeof(c_binary_signature)];
+    if (!ReadFile(handle, signature, sizeof(signature), &read, nullptr))
+        read = 0;
+    SetFilePointer(handle, file_ptr, nullptr, FILE_BEGIN);
+
+    if (!read)
+        return -1;
+
+    return is_binary_signature(signature, read) ? 1 : 0;
+}
+
+//------------------------------------------------------------------------------
+bool bank_lock::is_binary() const
+{
+    if (m_binary < 0)
+    {
+        if (!m_handle_lines)
+            return m_prefer_binary;
+
+        // Empty banks use the preferred format; otherwise the signature at
+        // the beginning of the bank determines the format.
+        m_binary = sniff_bank_format(m_handle_lines);
+        if (m_binary < 0)
+            return m_prefer_binary;
+    }
+
+    return !!m_binary;
+}
+
 //------------------------------------------------------------------------------
 bank_lock::operator bool () const
 {
@@ -323,6 +491,7 @@ public:
         char*               get_buffer() const          { return m_buffer; }
         uint32              get_buffer_size() const     { return m_buffer_size; }
         uint32              get_remaining() const       { return m_remaining; }
+        void*               get_handle() const          { return m_handle; }
         void                set_file_offset(uint32 offset);
 
     private:
@@ -342,22 +511,49 @@ public:
         template <int32 S>  line_iter(const read_lock& lock, char (&buffer)[S]);
         template <int32 S>  line_iter(void* handle, char (&buffer)[S]);
                             ~line_iter() = default;
-        line_id_impl        next(str_iter& out, str_base* timestamp=nullptr, history_db::line_id* timestamp_id=nullptr);
+        line_id_impl        next(str_iter& out, str_base* timestamp=nullptr, history_db::line_id* timestamp_id=nullptr, uint32* dir=nullptr);
         void                set_file_offset(uint32 offset);
         uint32              get_deleted_count() const { return m_deleted; }
 
     private:
         bool                provision();
+        bool                provision_more();
+        line_id_impl        next_record(str_iter& out, str_base* timestamp, uint32* dir);
         file_iter           m_file_iter;
         uint32              m_remaining = 0;
         uint32              m_deleted = 0;
+        int8                m_binary = -1;
         bool                m_first_line = true;
         bool                m_eating_ctag = false;
         std::unordered_set<uint32> m_removals;
     };
 
+    class reverse_line_iter : public no_copy
+    {
+    public:
+                            reverse_line_iter() = default;
+                            reverse_line_iter(const read_lock& lock, char* buffer, int32 buffer_size);
+        line_id_impl        next(str_iter& out, str_base* timestamp=nullptr, history_db::line_id* timestamp_id=nullptr);
+
+    private:
+        bool                provision();
+        bool                find_line_start(uint32 end, uint32& start) const;
+        line_id_impl        next_record(str_iter& out, str_base* timestamp);
+        void*               m_handle = nullptr;
+        char*               m_buffer = nullptr;
+        uint32              m_buffer_size = 0;
+        uint32              m_buffer_offset = 0;    // File offset of m_buffer[0].
+        uint32              m_remaining = 0;        // Unconsumed bytes at the start of m_buffer.
+        uint32              m_first_offset = 0;     // File offset of the first line or record.
+        bool                m_binary = false;
+        std::unordered_set<uint32> m_removals;
+    };
+
     explicit                read_lock() = default;
     explicit                read_lock(const bank_handles& handles, bool exclusive=false);
+    void*                   get_lines_handle() const { return m_handle_lines; }
+    using                   bank_lock::is_binary;
+    void                    get_removals(std::unordered_set<uint32>& removals) const;
     line_id_impl            find(const char* line) const;
     template <class T> void find(const char* line, T&& callback) const;
     int32                   apply_removals(write_lock& lock) const;
@@ -375,9 +571,15 @@ public:
                     write_lock() = default;
     explicit        write_lock(const bank_handles& handles);
     void            clear();
-    line_id_impl    add(const char* line);
+    line_id_impl    add(const char* line, int32 length=-1);
+    line_id_impl    add_line(const char* line, int32 length, const char* time, line_id_impl* time_id=nullptr, uint32 dir=0);
+    line_id_impl    add_ctag(const char* tag);
     bool            remove(line_id_impl id);
     void            append(const read_lock& src);
+    void            append_bytes(const char* data, uint32 length);
+
+private:
+    line_id_impl    add_record(const char* text, uint32 length, uint8 flags, uint32 time, uint32 dir=0);
 };
 
 //------------------------------------------------------------------------------
@@ -427,6 +629,15 @@ line_id_impl read_lock::find(const char* line) const
     return id;
 }
 
+//------------------------------------------------------------------------------
+void read_lock::get_removals(std::unordered_set<uint32>& removals) const
+{
+    for_each_removal(*this, [&] (uint32 offset)
+    {
+        removals.insert(offset);
+    });
+}
+
 //------------------------------------------------------------------------------
 int32 read_lock::apply_removals(write_lock& lock) const
 {
@@ -593,8 +804,8 @@ void read_lock::file_iter::set_file_offset(uint32 offset)
     m_remaining = GetFileSize(m_handle, nullptr);
     offset = clamp(offset, (uint32)0, m_remaining);
     m_remaining -= offset;
-    // BUGBUG: Should this be `offset - m_buffer_offset`?
-    m_buffer_offset = static_cast<unsigned __int64>(0) - m_buffer_size;
+    // The next call to next() advances m_buffer_offset by m_buffer_size.
+    m_buffer_offset = static_cast<unsigned __int64>(offset) - m_buffer_size;
     SetFilePointer(m_handle, offset, nullptr, FILE_BEGIN);
     m_buffer[0] = '\0';
 }
@@ -635,6 +846,78 @@ bool read_lock::line_iter::provision()
     return !!(m_remaining = m_file_iter.next(m_remaining));
 }
 
+//------------------------------------------------------------------------------
+bool read_lock::line_iter::provision_more()
+{
+    // Keeps the unconsumed bytes and appends more; returns false when there are
+    // no more bytes to read.
+    const uint32 before = m_remaining;
+    provision();
+    return m_remaining > before;
+}
+
+//------------------------------------------------------------------------------
+line_id_impl read_lock::line_iter::next_record(str_iter& out, str_base* timestamp, uint32* dir)
+{
+    while (true)
+    {
+        if (m_remaining < c_record_overhead)
+        {
+            if (!provision_more())
+                break;
+            continue;
+        }
+
+        const char* start = m_file_iter.get_buffer() + m_file_iter.get_buffer_size() - m_remaining;
+
+        binary_record header;
+        memcpy(&header, start, sizeof(header));
+        if (header.length > c_max_record_text)
+        {
+            LOG("corrupt history record; length %u is too large", header.length);
+            break;
+        }
+
+        const uint32 record_size = header.length + c_record_overhead;
+        if (m_remaining < record_size)
+        {
+            if (!provision_more())
+                break;
+            continue;
+        }
+
+        m_remaining -= record_size;
+
+        uint32 offset_in_buffer = uint32(start - m_file_iter.get_buffer());
+        const unsigned __int64 real_offset = m_file_iter.get_buffer_offset() + offset_in_buffer;
+        const bool too_big = (real_offset >= c_max_line_id.offset);
+        assert(!too_big);
+        const uint32 offset = too_big ? c_max_line_id.offset : uint32(real_offset);
+
+        if (header.flags & record_ctag)
+            continue;
+
+        // Removals from master are deferred when `history.shared` is false, so
+        // also test for deferred removals here.
+        if ((header.flags & record_removed) || (!too_big && m_removals.find(offset) != m_removals.end()))
+        {
+            ++m_deleted;
+            continue;
+        }
+
+        if (timestamp && (header.flags & record_time))
+            timestamp->format("%u", header.time);
+        if (dir && (header.flags & record_dir))
+            *dir = header.dir[0] | (header.dir[1] << 8) | (header.dir[2] << 16);
+
+        new (&out) str_iter(start + sizeof(header), int32(header.length));
+        return line_id_impl(offset);
+    }
+
+    m_remaining = 0;
+    return line_id_impl();
+}
+
 //------------------------------------------------------------------------------
 inline bool is_line_breaker(uint8 c)
 {
@@ -642,12 +925,30 @@ inline bool is_line_breaker(uint8 c)
 }
 
 //------------------------------------------------------------------------------
-line_id_impl read_lock::line_iter::next(str_iter& out, str_base* timestamp, history_db::line_id* timestamp_id)
+line_id_impl read_lock::line_iter::next(str_iter& out, str_base* timestamp, history_db::line_id* timestamp_id, uint32* dir)
 {
     if (timestamp)
         timestamp->clear();
     if (timestamp_id)
         *timestamp_id = 0;
+    if (dir)
+        *dir = 0;
+
+    if (m_binary < 0)
+    {
+        if (!m_remaining && !provision())
+            return line_id_impl();
+
+        m_binary = (m_file_iter.get_buffer_offset() == 0 &&
+                    is_binary_signature(m_file_iter.get_buffer(), m_remaining));
+        if (m_binary)
+            m_remaining -= sizeof(c_binary_signature);
+    }
+
+    // Binary records carry their timestamp in the record header, so there is
+    // no separate timestamp line id to report.
+    if (m_binary)
+        return next_record(out, timestamp, dir);
 
     while (m_remaining || provision())
     {
@@ -705,9 +1006,17 @@ line_id_impl read_lock::line_iter::next(str_iter& out, str_base* timestamp, hist
 
         // Timestamps precede the line they're associated with, so that the
         // iterator can easily determine whether there's a timestamp and return
-        // both the line and the timestamp in a single call.
+        // both the line and the timestamp in a single call.  Directory hashes
+        // precede the timestamp, so that older versions still associate the
+        // timestamp with the line.
         if (*start == '|')
         {
+            if (bytes > 6 && strncmp(start, "|\tdir=", 6) == 0)
+            {
+                if (dir)
+                    *dir = history_dir_index::parse_hash(start + 6, end);
+                continue;
+            }
             if (strncmp(start, "|\ttime=", 7) == 0)
             {
                 if (timestamp)
@@ -732,6 +1041,8 @@ line_id_impl read_lock::line_iter::next(str_iter& out, str_base* timestamp, hist
         {
             if (!eating_ctag)
                 ++m_deleted;
+            if (dir)
+                *dir = 0;
             continue;
         }
 
@@ -747,825 +1058,2584 @@ line_id_impl read_lock::line_iter::next(str_iter& out, str_base* timestamp, hist
 void read_lock::line_iter::set_file_offset(uint32 offset)
 {
     m_file_iter.set_file_offset(offset);
+    m_remaining = 0;
+    m_first_line = !offset;
     m_eating_ctag = false;
-}
 
+    // The format can only be detected from the beginning of the bank.
+    m_binary = offset ? max<int8>(0, sniff_bank_format(m_file_iter.get_handle())) : -1;
+}
 
 
-//------------------------------------------------------------------------------
-write_lock::write_lock(const bank_handles& handles)
-: read_lock(handles, true)
-{
-}
 
 //------------------------------------------------------------------------------
-void write_lock::clear()
+read_lock::reverse_line_iter::reverse_line_iter(const read_lock& lock, char* buffer, int32 buffer_size)
+: m_handle(lock.m_handle_lines)
+, m_buffer(buffer)
+, m_buffer_size(buffer_size)
+, m_binary(lock.is_binary())
 {
-    SetFilePointer(m_handle_lines, 0, nullptr, FILE_BEGIN);
-    SetEndOfFile(m_handle_lines);
-    if (m_handle_removals)
+    lock.for_each_removal(lock, [&] (uint32 offset)
     {
-        SetFilePointer(m_handle_removals, 0, nullptr, FILE_BEGIN);
-        SetEndOfFile(m_handle_removals);
-    }
-}
+        m_removals.insert(offset);
+    });
 
-//------------------------------------------------------------------------------
-line_id_impl write_lock::add(const char* line)
-{
-    DWORD written;
-    const DWORD offset = SetFilePointer(m_handle_lines, 0, nullptr, FILE_END);
-    if (offset == INVALID_SET_FILE_POINTER)
-        return line_id_impl();
-    WriteFile(m_handle_lines, line, int32(strlen(line)), &written, nullptr);
-    WriteFile(m_handle_lines, "\n", 1, &written, nullptr);
-    if (offset >= c_max_line_id.offset)
-        return c_max_line_id;
-    return line_id_impl(offset);
+    const DWORD file_size = GetFileSize(m_handle, nullptr);
+    m_first_offset = m_binary ? min<uint32>(sizeof(c_binary_signature), file_size) : 0;
+    m_buffer_offset = (file_size == INVALID_FILE_SIZE) ? 0 : file_size;
 }
 
 //------------------------------------------------------------------------------
-bool write_lock::remove(line_id_impl id)
+bool read_lock::reverse_line_iter::provision()
 {
-    if (id.offset == c_max_line_id.offset)
-    {
-        assert(false);
-        LOG("can't remove history line; offset is too large");
+    // Keeps the unconsumed bytes and prepends the bytes that precede them in
+    // the file; returns false when there are no more bytes to read.
+    const uint32 room = m_buffer_size - m_remaining;
+    const uint32 needed = min(room, m_buffer_offset - m_first_offset);
+    if (!needed)
         return false;
-    }
 
-    if (m_handle_removals && id.bank_index == bank_master)
-    {
-        str<> s;
-        s.format("%d\n", id.offset);
+    memmove(m_buffer + needed, m_buffer, m_remaining);
 
-        DWORD written;
-        SetFilePointer(m_handle_removals, 0, nullptr, FILE_END);
-        WriteFile(m_handle_removals, s.c_str(), s.length(), &written, nullptr);
-    }
-    else
+    DWORD read = 0;
+    SetFilePointer(m_handle, m_buffer_offset - needed, nullptr, FILE_BEGIN);
+    if (!ReadFile(m_handle, m_buffer, needed, &read, nullptr) || read != needed)
     {
-        DWORD written;
-        SetFilePointer(m_handle_lines, id.offset, nullptr, FILE_BEGIN);
-        WriteFile(m_handle_lines, "|", 1, &written, nullptr);
+        // The bank can't change while it's locked, so this is unexpected.
+        assert(false);
+        memmove(m_buffer, m_buffer + needed, m_remaining);
+        m_buffer_offset = m_first_offset;
+        return false;
     }
 
+    m_buffer_offset -= needed;
+    m_remaining += needed;
     return true;
 }
 
 //------------------------------------------------------------------------------
-void write_lock::append(const read_lock& src)
+bool read_lock::reverse_line_iter::find_line_start(uint32 end, uint32& start) const
 {
-    DWORD written;
-
-    SetFilePointer(m_handle_lines, 0, nullptr, FILE_END);
+    for (start = end; start > 0; --start)
+        if (is_line_breaker(m_buffer[start - 1]))
+            return true;
 
-    history_read_buffer buffer;
-    read_lock::file_iter src_iter(src, buffer.data(), buffer.size());
-    while (int32 bytes_read = src_iter.next())
-        WriteFile(m_handle_lines, buffer.data(), bytes_read, &written, nullptr);
+    // The line is only known to be complete at the beginning of the bank.
+    return (m_buffer_offset <= m_first_offset);
 }
 
-
-
 //------------------------------------------------------------------------------
-class read_line_iter
+line_id_impl read_lock::reverse_line_iter::next(str_iter& out, str_base* timestamp, history_db::line_id* timestamp_id)
 {
-public:
-                            read_line_iter(const history_db& db, uint32 this_size);
-    history_db::line_id     next(str_iter& out, str_base* timestamp=nullptr, history_db::line_id* timestamp_id=nullptr);
-    uint32                  get_bank() const { return m_bank_index; }
+    if (timestamp)
+        timestamp->clear();
+    if (timestamp_id)
+        *timestamp_id = 0;
 
-private:
-    bool                    next_bank();
-    const history_db&       m_db;
-    read_lock               m_lock;
-    read_lock::line_iter    m_line_iter;
-    uint32                  m_buffer_size;
-    uint32                  m_bank_index = bank_none;
-};
+    if (!m_handle)
+        return line_id_impl();
 
-//------------------------------------------------------------------------------
-read_line_iter::read_line_iter(const history_db& db, uint32 this_size)
-: m_db(db)
-, m_buffer_size(this_size - sizeof(*this))
-{
-    next_bank();
-}
+    // Binary records carry their timestamp in the record header, so there is
+    // no separate timestamp line id to report.
+    if (m_binary)
+        return next_record(out, timestamp);
 
-//------------------------------------------------------------------------------
-bool read_line_iter::next_bank()
-{
-    while (++m_bank_index < sizeof_array(m_db.m_bank_handles))
+    while (true)
     {
-        bank_handles handles = m_db.get_bank(m_bank_index);
-        if (handles)
+        while (m_remaining && is_line_breaker(m_buffer[m_remaining - 1]))
+            --m_remaining;
+
+        if (!m_remaining)
         {
-            char* buffer = (char*)(this + 1);
-            m_lock.~read_lock();
-            m_line_iter.~line_iter();
-            new (&m_lock) read_lock(handles);
-            new (&m_line_iter) read_lock::line_iter(m_lock, buffer, m_buffer_size);
-            return true;
+            if (!provision())
+                break;
+            continue;
         }
-    }
-
-    return false;
-}
 
-//------------------------------------------------------------------------------
-history_db::line_id read_line_iter::next(str_iter& out, str_base* timestamp, history_db::line_id* timestamp_id)
-{
-    if (m_bank_index >= sizeof_array(m_db.m_bank_handles))
-        return 0;
+        // Lines longer than the buffer are truncated at the beginning of the
+        // buffer.
+        uint32 start;
+        if (!find_line_start(m_remaining, start) && provision())
+            continue;
 
-    do
-    {
-        if (line_id_impl ret = m_line_iter.next(out, timestamp, timestamp_id))
+        // Timestamps precede the line they're associated with, so the
+        // preceding line must be available before the line can be returned.
+        uint32 time_start = 0;
+        uint32 time_end = start;
+        if ((timestamp || timestamp_id) && m_buffer[start] != '|')
         {
-            ret.bank_index = m_bank_index;
-            return ret.outer;
+            while (time_end && is_line_breaker(m_buffer[time_end - 1]))
+                --time_end;
+            if (time_end ? !find_line_start(time_end, time_start) : (m_buffer_offset > m_first_offset))
+            {
+                if (provision())
+                    continue;
+                time_end = 0;
+            }
         }
-    }
-    while (next_bank());
 
-    return 0;
-}
+        const uint32 end = m_remaining;
+        m_remaining = start;
 
+        const char* line = m_buffer + start;
+        const unsigned __int64 real_offset = m_buffer_offset + start;
+        const bool too_big = (real_offset >= c_max_line_id.offset);
+        assert(!too_big);
+        const uint32 offset = too_big ? c_max_line_id.offset : uint32(real_offset);
 
+        // Skip the ctag, removed lines, and timestamp lines (they're handled
+        // along with the line that follows them).
+        if (*line == '|')
+            continue;
 
-//------------------------------------------------------------------------------
-history_db::iter::iter(iter&& other)
-{
-    impl = other.impl;
-    other.impl = 0;
+        // Removals from master are deferred when `history.shared` is false, so
+        // also test for deferred removals here.
+        if (!too_big && m_removals.find(offset) != m_removals.end())
+            continue;
+
+        if (time_end > time_start && strncmp(m_buffer + time_start, "|\ttime=", 7) == 0)
+        {
+            if (timestamp)
+                timestamp->concat(m_buffer + time_start + 7, time_end - time_start - 7);
+            if (timestamp_id)
+                *timestamp_id = line_id_impl(m_buffer_offset + time_start).outer;
+        }
+
+        new (&out) str_iter(line, int32(end - start));
+        return line_id_impl(offset);
+    }
+
+    return line_id_impl();
 }
 
 //------------------------------------------------------------------------------
-history_db::iter::~iter()
+line_id_impl read_lock::reverse_line_iter::next_record(str_iter& out, str_base* timestamp)
 {
-    if (impl)
-        ((read_line_iter*)impl)->~read_line_iter();
+    while (true)
+    {
+        if (m_remaining < c_record_overhead)
+        {
+            if (!provision())
+                break;
+            continue;
+        }
+
+        // The total size of a record follows its text.
+        uint32 record_size;
+        memcpy(&record_size, m_buffer + m_remaining - sizeof(record_size), sizeof(record_size));
+        if (record_size < c_record_overhead || record_size > c_max_record_text + c_record_overhead)
+        {
+            LOG("corrupt history record; size %u is invalid", record_size);
+            break;
+        }
+
+        if (m_remaining < record_size)
+        {
+            if (!provision())
+                break;
+            continue;
+        }
+
+        const uint32 start = m_remaining - record_size;
+        m_remaining = start;
+
+        binary_record header;
+        memcpy(&header, m_buffer + start, sizeof(header));
+        if (header.length + c_record_overhead != record_size)
+        {
+            LOG("corrupt history record; size %u does not match length %u", record_size, header.length);
+            break;
+        }
+
+        const unsigned __int64 real_offset = m_buffer_offset + start;
+        const bool too_big = (real_offset >= c_max_line_id.offset);
+        assert(!too_big);
+        const uint32 offset = too_big ? c_max_line_id.offset : uint32(real_offset);
+
+        if (header.flags & (record_ctag|record_removed))
+            continue;
+
+        // Removals from master are deferred when `history.shared` is false, so
+        // also test for deferred removals here.
+        if (!too_big && m_removals.find(offset) != m_removals.end())
+            continue;
+
+        if (timestamp && (header.flags & record_time))
+            timestamp->format("%u", header.time);
+
+        new (&out) str_iter(m_buffer + start + sizeof(header), int32(header.length));
+        return line_id_impl(offset);
+    }
+
+    m_remaining = 0;
+    m_buffer_offset = m_first_offset;
+    return line_id_impl();
 }
 
+
+
 //------------------------------------------------------------------------------
-history_db::line_id history_db::iter::next(str_iter& out, str_base* timestamp, history_db::line_id* timestamp_id)
+write_lock::write_lock(const bank_handles& handles)
+: read_lock(handles, true)
 {
-    return impl ? ((read_line_iter*)impl)->next(out, timestamp, timestamp_id) : 0;
 }
 
 //------------------------------------------------------------------------------
-uint32 history_db::iter::get_bank() const
+void write_lock::clear()
 {
-    return impl ? ((read_line_iter*)impl)->get_bank() : bank_none;
+    SetFilePointer(m_handle_lines, 0, nullptr, FILE_BEGIN);
+    SetEndOfFile(m_handle_lines);
+    m_binary = -1;
+    if (m_handle_removals)
+    {
+        SetFilePointer(m_handle_removals, 0, nullptr, FILE_BEGIN);
+        SetEndOfFile(m_handle_removals);
+    }
 }
 
+//------------------------------------------------------------------------------
+line_id_impl write_lock::add(const char* line, int32 length)
+{
+    if (length < 0)
+        length = int32(strlen(line));
 
+    if (is_binary())
+        return add_record(line, length, 0, 0);
+
+    DWORD written;
+    const DWORD offset = SetFilePointer(m_handle_lines, 0, nullptr, FILE_END);
+    if (offset == INVALID_SET_FILE_POINTER)
+        return line_id_impl();
+    WriteFile(m_handle_lines, line, length, &written, nullptr);
+    WriteFile(m_handle_lines, "\n", 1, &written, nullptr);
+    if (offset >= c_max_line_id.offset)
+        return c_max_line_id;
+    return line_id_impl(offset);
+}
 
 //------------------------------------------------------------------------------
-static bool extract_ctag(read_lock::file_iter& iter, char* buffer, int32 buffer_size, concurrency_tag& tag)
+// Adds LINE with the timestamp TIME (which may be null or empty) and the
+// directory hash DIR (which may be 0).  In the text format the directory hash
+// and the timestamp are separate lines preceding LINE, and the timestamp's id
+// is returned in TIME_ID; in the binary format they are part of LINE's record.
+line_id_impl write_lock::add_line(const char* line, int32 length, const char* time, line_id_impl* time_id, uint32 dir)
 {
-    int32 bytes_read = iter.next();
-    if (bytes_read <= 0)
+    if (time_id)
+        *time_id = line_id_impl();
+
+    if (length < 0)
+        length = int32(strlen(line));
+
+    const bool has_time = (time && *time);
+
+    if (is_binary())
     {
-        LOG("read %d bytes", bytes_read);
-        return false;
+        const uint8 flags = (has_time ? record_time : 0) | (dir ? record_dir : 0);
+        return add_record(line, length, flags, has_time ? uint32(atoi(time)) : 0, dir);
     }
 
-    if (bytes_read >= buffer_size)
-        bytes_read = buffer_size - 1;
-    buffer[bytes_read] = 0;
-
-    if (strncmp(buffer, "|CTAG_", 6) != 0)
+    if (dir)
     {
-        LOG("first line not a ctag");
-        return false;
+        str<16> dir_line;
+        dir_line.format("|\tdir=%06x", dir);
+        add(dir_line.c_str(), dir_line.length());
     }
 
-    char* eol = strpbrk(buffer, "\r\n");
-    if (!eol)
+    if (has_time)
     {
-        LOG("first line has no line ending");
-        return false;
+        str<> timestamp;
+        timestamp.format("|\ttime=%s", time);
+        line_id_impl id = add(timestamp.c_str(), timestamp.length());
+        if (time_id)
+            *time_id = id;
     }
-    *eol = '\0';
 
-    tag.set(buffer);
-    return true;
+    return add(line, length);
 }
 
 //------------------------------------------------------------------------------
-static bool extract_ctag(const read_lock& lock, concurrency_tag& tag)
+line_id_impl write_lock::add_ctag(const char* tag)
 {
-    char buffer[max_ctag_size];
-    read_lock::file_iter iter(lock, buffer);
-    return extract_ctag(iter, buffer, sizeof(buffer), tag);
+    if (is_binary())
+    {
+        // The tag follows the signature, and skips the "|CTAG_" prefix that
+        // identifies it in the text format.
+        assert(strncmp(tag, "|CTAG_", 6) == 0);
+        return add_record(tag + 6, uint32(strlen(tag + 6)), record_ctag, 0);
+    }
+
+    return add(tag);
 }
 
 //------------------------------------------------------------------------------
-static void rewrite_master_bank(write_lock& lock, size_t limit=0, size_t* _kept=nullptr, size_t* _deleted=nullptr, bool uniq=false, size_t* _dups=nullptr, std::map<line_id_impl, line_id_impl>* remap=nullptr)
+line_id_impl write_lock::add_record(const char* text, uint32 length, uint8 flags, uint32 time, uint32 dir)
 {
-    history_read_buffer buffer;
-    str_map_case<size_t>::type seen;
-
-    if (_dups)
-        *_dups = 0;
+    DWORD written;
+    DWORD offset = SetFilePointer(m_handle_lines, 0, nullptr, FILE_END);
+    if (offset == INVALID_SET_FILE_POINTER)
+        return line_id_impl();
 
-    struct remap_history_line
-    {
-        auto_free_str   m_line;
-        line_id_impl    m_old;
-        line_id_impl    m_new;
-    };
-    struct keep_line_pair
+    if (!offset)
     {
-        remap_history_line m_line;
-        remap_history_line m_timestamp;
-    };
+        WriteFile(m_handle_lines, c_binary_signature, sizeof(c_binary_signature), &written, nullptr);
+        offset = sizeof(c_binary_signature);
+        m_binary = 1;
+    }
 
-    // Read lines to keep into vector.
-    str_iter out;
-    str<> tmp;
-    str<> timestamp;
-    line_id_impl timestamp_id;
-    read_lock::line_iter iter(lock, buffer.data(), buffer.size());
-    std::vector<std::unique_ptr<keep_line_pair>> lines_to_keep;
-    while (const line_id_impl id = iter.next(out, &timestamp, &timestamp_id.outer))
+    // Truncate pathologically long lines so records always fit in a read
+    // buffer, without splitting a UTF8 sequence.
+    if (length > c_max_record_text)
     {
-        std::unique_ptr<keep_line_pair> keep = std::make_unique<keep_line_pair>();
-
-        // Initialize the line to keep.  The string pointer allocated here
-        // must live until the loop is finished, because its raw pointer is
-        // used as the key in the seen map.
-        keep->m_line.m_line.set(out.get_pointer(), out.length());
+        length = c_max_record_text;
+        while (length && (uint8(text[length]) & 0xc0) == 0x80)
+            --length;
+    }
 
-        // Initialize the timestamp to keep, if any.
-        tmp.clear();
-        if (!timestamp.empty())
-            tmp.format("|\ttime=%s", timestamp.c_str());
+    binary_record header = {};
+    header.length = length;
+    header.flags = flags;
+    header.dir[0] = uint8(dir);
+    header.dir[1] = uint8(dir >> 8);
+    header.dir[2] = uint8(dir >> 16);
+    header.time = time;
 
-        // Maybe apply uniq and keep only the latest.
-        if (uniq)
-        {
-            auto const lookup = seen.find(keep->m_line.m_line.get());
-            if (lookup != seen.end())
-            {
-                // Reuse the old entry so the map stays valid.  Leave the old
-                // entry present but empty, so the indices don't shift.
-                keep = std::move(lines_to_keep[lookup->second]);
-                assert(!lines_to_keep[lookup->second].get());
-                // Update number of duplicate entries.
-                if (_dups)
-                    ++(*_dups);
-            }
-            seen.insert_or_assign(keep->m_line.m_line.get(), lines_to_keep.size());
-        }
+    const uint32 total = length + c_record_overhead;
+    WriteFile(m_handle_lines, &header, sizeof(header), &written, nullptr);
+    WriteFile(m_handle_lines, text, length, &written, nullptr);
+    WriteFile(m_handle_lines, &total, sizeof(total), &written, nullptr);
 
-        // Initialize the rest of the keep struct.
-        keep->m_timestamp.m_line.set(tmp.empty() ? nullptr : tmp.c_str());
-        keep->m_timestamp.m_old = timestamp_id;
-        keep->m_line.m_old = id;
+    if (offset >= c_max_line_id.offset)
+        return c_max_line_id;
+    return line_id_impl(offset);
+}
 
-        // And keep them.
-        lines_to_keep.emplace_back(std::move(keep));
-        assert(!keep.get());
+//------------------------------------------------------------------------------
+bool write_lock::remove(line_id_impl id)
+{
+    if (id.offset == c_max_line_id.offset)
+    {
+        assert(false);
+        LOG("can't remove history line; offset is too large");
+        return false;
     }
 
-    if (_kept)
-        *_kept = lines_to_keep.size();
-    if (_deleted)
-        *_deleted = iter.get_deleted_count();
+    if (m_handle_removals && id.bank_index == bank_master)
+    {
+        str<> s;
+        s.format("%d\n", id.offset);
 
-    // Clear and write new tag.
-    concurrency_tag tag;
-    tag.generate_new_tag();
-    lock.clear();
-    lock.add(tag.get());
+        DWORD written;
+        SetFilePointer(m_handle_removals, 0, nullptr, FILE_END);
+        WriteFile(m_handle_removals, s.c_str(), s.length(), &written, nullptr);
+    }
+    else if (is_binary())
+    {
+        const DWORD flags_offset = id.offset + offsetof(binary_record, flags);
 
-    // Decide how many lines to keep.
-    size_t start = 0;
-    if (0 < limit && limit < lines_to_keep.size())
+        DWORD read = 0;
+        uint8 flags = 0;
+        SetFilePointer(m_handle_lines, flags_offset, nullptr, FILE_BEGIN);
+        if (!ReadFile(m_handle_lines, &flags, sizeof(flags), &read, nullptr) || !read)
+            return false;
+
+        DWORD written;
+        flags |= record_removed;
+        SetFilePointer(m_handle_lines, flags_offset, nullptr, FILE_BEGIN);
+        WriteFile(m_handle_lines, &flags, sizeof(flags), &written, nullptr);
+    }
+    else
     {
-        for (start = lines_to_keep.size(); limit && start--;)
-            if (lines_to_keep[start].get())
-                --limit;
+        DWORD written;
+        SetFilePointer(m_handle_lines, id.offset, nullptr, FILE_BEGIN);
+        WriteFile(m_handle_lines, "|", 1, &written, nullptr);
     }
 
-    // Write lines from vector.
-    for (size_t ii = start; ii < lines_to_keep.size(); ++ii)
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void write_lock::append(const read_lock& src)
+{
+    history_read_buffer buffer;
+
+    if (src.is_binary() != is_binary())
     {
-        const auto& keep = lines_to_keep[ii];
-        if (keep)
-        {
-            if (keep->m_timestamp.m_line.get())
-                keep->m_timestamp.m_new = lock.add(keep->m_timestamp.m_line.get());
-            else
-                keep->m_timestamp.m_new.outer = 0;
-            keep->m_line.m_new = lock.add(keep->m_line.m_line.get());
-        }
+        // Convert between formats line by line.  The source is a session bank,
+        // so it has no ctag.
+        str<32> timestamp;
+        str_iter line;
+        uint32 dir;
+        read_lock::line_iter iter(src.get_lines_handle(), buffer.data(), buffer.size());
+        while (iter.next(line, &timestamp, nullptr, &dir))
+            add_line(line.get_pointer(), line.length(), timestamp.c_str(), nullptr, dir);
+        return;
     }
 
-    // Verify ids monotonically increase.
-#ifdef DEBUG
-    const keep_line_pair* prev = nullptr;
-    for (size_t ii = start; ii < lines_to_keep.size(); ++ii)
+    DWORD written;
+
+    const DWORD offset = SetFilePointer(m_handle_lines, 0, nullptr, FILE_END);
+
+    // Both banks are binary; only an empty target keeps the signature.
+    uint32 skip = (is_binary() && offset) ? sizeof(c_binary_signature) : 0;
+
+    read_lock::file_iter src_iter(src, buffer.data(), buffer.size());
+    while (int32 bytes_read = src_iter.next())
     {
-        const auto& keep = lines_to_keep[ii];
-        if (keep)
-        {
-            if (prev)
-            {
-                if (keep->m_timestamp.m_line.get())
-                {
-                    assert(keep->m_timestamp.m_old.outer > prev->m_line.m_old.outer);
-                    assert(keep->m_line.m_old.outer > keep->m_timestamp.m_old.outer);
-                    assert(keep->m_timestamp.m_new.outer > prev->m_line.m_new.outer);
-                    assert(keep->m_line.m_new.outer > keep->m_timestamp.m_new.outer);
-                }
-                assert(keep->m_line.m_old.outer > prev->m_line.m_old.outer);
-                assert(keep->m_line.m_new.outer > prev->m_line.m_new.outer);
-            }
-            prev = keep.get();
-        }
+        const uint32 skipped = min<uint32>(skip, bytes_read);
+        WriteFile(m_handle_lines, buffer.data() + skipped, bytes_read - skipped, &written, nullptr);
+        skip -= skipped;
     }
-#endif
+}
+
+//------------------------------------------------------------------------------
+void write_lock::append_bytes(const char* data, uint32 length)
+{
+    DWORD written;
+    SetFilePointer(m_handle_lines, 0, nullptr, FILE_END);
+    WriteFile(m_handle_lines, data, length, &written, nullptr);
+}
+
+
+
+//------------------------------------------------------------------------------
+class read_line_iter
+{
+public:
+                            read_line_iter(const history_db& db, uint32 this_size, bool reverse=false);
+                            read_line_iter(const history_db& db, uint32 this_size, time_t since, time_t until);
+    history_db::line_id     next(str_iter& out, str_base* timestamp=nullptr, history_db::line_id* timestamp_id=nullptr);
+    uint32                  get_bank() const { return m_archived ? uint32(bank_master) : m_bank_index; }
+
+private:
+    bool                    next_bank();
+    line_id_impl            next_archived(str_iter& out, str_base* timestamp, history_db::line_id* timestamp_id);
+    void                    load_archive();
+    bool                    in_range(const str_base& timestamp) const;
+    const history_db&       m_db;
+    std::unique_ptr<history_archive> m_archive;
+    size_t                  m_archive_pos = 0;
+    bool                    m_archived = false;
+    read_lock               m_lock;
+    read_lock::line_iter    m_line_iter;
+    read_lock::reverse_line_iter m_reverse_iter;
+    uint32                  m_buffer_size;
+    uint32                  m_bank_index;
+    uint32                  m_end_offset = UINT_MAX;
+    const time_t            m_since = 0;
+    const time_t            m_until = 0;
+    const bool              m_reverse;
+    const bool              m_ranged = false;
+};
+
+//------------------------------------------------------------------------------
+read_line_iter::read_line_iter(const history_db& db, uint32 this_size, bool reverse)
+: m_db(db)
+, m_buffer_size(this_size - sizeof(*this))
+, m_bank_index(reverse ? uint32(sizeof_array(db.m_bank_handles)) : uint32(bank_none))
+, m_reverse(reverse)
+{
+    load_archive();
+    next_bank();
+}
+
+//------------------------------------------------------------------------------
+// Only yields lines with timestamps from SINCE through UNTIL (inclusive).  An
+// UNTIL of 0 means there's no upper limit.
+read_line_iter::read_line_iter(const history_db& db, uint32 this_size, time_t since, time_t until)
+: m_db(db)
+, m_buffer_size(this_size - sizeof(*this))
+, m_bank_index(uint32(bank_none))
+, m_since(since)
+, m_until(until)
+, m_reverse(false)
+, m_ranged(true)
+{
+    load_archive();
+    next_bank();
+}
+
+//------------------------------------------------------------------------------
+// Archived lines precede the master bank's lines.
+void read_line_iter::load_archive()
+{
+    auto archive = std::make_unique<history_archive>();
+    if (m_db.read_archive(*archive))
+        m_archive = std::move(archive);
+}
+
+//------------------------------------------------------------------------------
+bool read_line_iter::next_bank()
+{
+    // Banks are ordered oldest to newest, so reverse iteration visits them in
+    // reverse order.
+    while (m_reverse ? m_bank_index-- > 0 : ++m_bank_index < sizeof_array(m_db.m_bank_handles))
+    {
+        bank_handles handles = m_db.get_bank(m_bank_index);
+        if (handles)
+        {
+            char* buffer = (char*)(this + 1);
+            m_lock.~read_lock();
+            new (&m_lock) read_lock(handles);
+            if (m_reverse)
+            {
+                m_reverse_iter.~reverse_line_iter();
+                new (&m_reverse_iter) read_lock::reverse_line_iter(m_lock, buffer, m_buffer_size);
+            }
+            else
+            {
+                m_line_iter.~line_iter();
+                new (&m_line_iter) read_lock::line_iter(m_lock, buffer, m_buffer_size);
+            }
+            if (m_ranged)
+            {
+                uint32 start;
+                m_db.get_time_range(m_bank_index, m_lock, m_since, m_until, start, m_end_offset);
+                if (start)
+                    m_line_iter.set_file_offset(start);
+            }
+            return true;
+        }
+    }
+
+    m_bank_index = sizeof_array(m_db.m_bank_handles);
+    return false;
+}
+
+//------------------------------------------------------------------------------
+line_id_impl read_line_iter::next_archived(str_iter& out, str_base* timestamp, history_db::line_id* timestamp_id)
+{
+    m_archived = false;
+    if (!m_archive)
+        return line_id_impl();
+
+    str<32> tmp;
+    if (!timestamp)
+        timestamp = &tmp;
+
+    while (m_archive_pos < m_archive->size())
+    {
+        const size_t index = m_reverse ? m_archive->size() - ++m_archive_pos : m_archive_pos++;
+        const history_archive::entry& entry = m_archive->get(index);
+
+        timestamp->clear();
+        if (entry.time)
+            timestamp->format("%u", entry.time);
+        if (m_ranged && !in_range(*timestamp))
+            continue;
+
+        if (timestamp_id)
+            *timestamp_id = 0;
+        new (&out) str_iter(m_archive->get_text(entry), int32(entry.length));
+
+        line_id_impl ret(entry.ordinal);
+        ret.bank_index = c_bank_archive;
+        m_archived = true;
+        return ret;
+    }
+
+    return line_id_impl();
+}
+
+//------------------------------------------------------------------------------
+history_db::line_id read_line_iter::next(str_iter& out, str_base* timestamp, history_db::line_id* timestamp_id)
+{
+    if (!m_reverse)
+    {
+        if (const line_id_impl ret = next_archived(out, timestamp, timestamp_id))
+            return ret.outer;
+    }
+
+    if (m_bank_index >= sizeof_array(m_db.m_bank_handles))
+        return m_reverse ? next_archived(out, timestamp, timestamp_id).outer : 0;
+
+    str<32> tmp;
+    if (m_ranged && !timestamp)
+        timestamp = &tmp;
+
+    do
+    {
+        line_id_impl ret;
+        while (true)
+        {
+            if (m_reverse)
+                ret = m_reverse_iter.next(out, timestamp, timestamp_id);
+            else
+                ret = m_line_iter.next(out, timestamp, timestamp_id);
+
+            if (!ret || !m_ranged)
+                break;
+            if (ret.offset >= m_end_offset)
+            {
+                ret = line_id_impl();
+                break;
+            }
+            if (in_range(*timestamp))
+                break;
+        }
+
+        if (ret)
+        {
+            ret.bank_index = m_bank_index;
+            return ret.outer;
+        }
+    }
+    while (next_bank());
+
+    return m_reverse ? next_archived(out, timestamp, timestamp_id).outer : 0;
+}
+
+//------------------------------------------------------------------------------
+bool read_line_iter::in_range(const str_base& timestamp) const
+{
+    // Lines without timestamps are never in range.
+    const uint64 time = history_time_index::parse_time(timestamp.c_str());
+    if (!time)
+        return false;
+    return time >= uint64(m_since) && (!m_until || time <= uint64(m_until));
+}
+
+
+
+//------------------------------------------------------------------------------
+history_db::iter::iter(iter&& other)
+{
+    impl = other.impl;
+    other.impl = 0;
+}
+
+//------------------------------------------------------------------------------
+history_db::iter::~iter()
+{
+    if (impl)
+        ((read_line_iter*)impl)->~read_line_iter();
+}
+
+//------------------------------------------------------------------------------
+history_db::line_id history_db::iter::next(str_iter& out, str_base* timestamp, history_db::line_id* timestamp_id)
+{
+    return impl ? ((read_line_iter*)impl)->next(out, timestamp, timestamp_id) : 0;
+}
+
+//------------------------------------------------------------------------------
+uint32 history_db::iter::get_bank() const
+{
+    return impl ? ((read_line_iter*)impl)->get_bank() : bank_none;
+}
+
+
+
+//------------------------------------------------------------------------------
+static bool extract_ctag(read_lock::file_iter& iter, char* buffer, int32 buffer_size, concurrency_tag& tag)
+{
+    int32 bytes_read = iter.next();
+    if (bytes_read <= 0)
+    {
+        LOG("read %d bytes", bytes_read);
+        return false;
+    }
+
+    if (bytes_read >= buffer_size)
+        bytes_read = buffer_size - 1;
+    buffer[bytes_read] = 0;
+
+    if (is_binary_signature(buffer, bytes_read))
+    {
+        binary_record header;
+        const uint32 header_offset = sizeof(c_binary_signature);
+        if (uint32(bytes_read) < header_offset + sizeof(header))
+        {
+            LOG("first record is incomplete");
+            return false;
+        }
+
+        memcpy(&header, buffer + header_offset, sizeof(header));
+        const uint32 text_offset = header_offset + sizeof(header);
+        if (!(header.flags & record_ctag) || header.length > uint32(bytes_read) - text_offset)
+        {
+            LOG("first record not a ctag");
+            return false;
+        }
+
+        str<max_ctag_size> tmp;
+        tmp << "|CTAG_";
+        tmp.concat(buffer + text_offset, header.length);
+        tag.set(tmp.c_str());
+        return true;
+    }
+
+    if (strncmp(buffer, "|CTAG_", 6) != 0)
+    {
+        LOG("first line not a ctag");
+        return false;
+    }
+
+    char* eol = strpbrk(buffer, "\r\n");
+    if (!eol)
+    {
+        LOG("first line has no line ending");
+        return false;
+    }
+    *eol = '\0';
+
+    tag.set(buffer);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+static bool extract_ctag(const read_lock& lock, concurrency_tag& tag)
+{
+    char buffer[sizeof(c_binary_signature) + c_record_overhead + max_ctag_size];
+    read_lock::file_iter iter(lock, buffer);
+    return extract_ctag(iter, buffer, sizeof(buffer), tag);
+}
+
+//------------------------------------------------------------------------------
+static void rewrite_master_bank(write_lock& lock, size_t limit=0, size_t* _kept=nullptr, size_t* _deleted=nullptr, bool uniq=false, size_t* _dups=nullptr, std::map<line_id_impl, line_id_impl>* remap=nullptr)
+{
+    history_read_buffer buffer;
+    str_map_case<size_t>::type seen;
+
+    if (_dups)
+        *_dups = 0;
+
+    struct remap_history_line
+    {
+        auto_free_str   m_line;
+        line_id_impl    m_old;
+        line_id_impl    m_new;
+    };
+    struct keep_line_pair
+    {
+        remap_history_line m_line;
+        remap_history_line m_timestamp;
+        uint32          m_dir = 0;
+    };
+
+    // Read lines to keep into vector.
+    str_iter out;
+    str<> tmp;
+    str<> timestamp;
+    line_id_impl timestamp_id;
+    uint32 dir;
+    read_lock::line_iter iter(lock, buffer.data(), buffer.size());
+    std::vector<std::unique_ptr<keep_line_pair>> lines_to_keep;
+    while (const line_id_impl id = iter.next(out, &timestamp, &timestamp_id.outer, &dir))
+    {
+        std::unique_ptr<keep_line_pair> keep = std::make_unique<keep_line_pair>();
+
+        // Initialize the line to keep.  The string pointer allocated here
+        // must live until the loop is finished, because its raw pointer is
+        // used as the key in the seen map.
+        keep->m_line.m_line.set(out.get_pointer(), out.length());
+
+        // Initialize the timestamp to keep, if any.
+        tmp = timestamp.c_str();
+
+        // Maybe apply uniq and keep only the latest.
+        if (uniq)
+        {
+            auto const lookup = seen.find(keep->m_line.m_line.get());
+            if (lookup != seen.end())
+            {
+                // Reuse the old entry so the map stays valid.  Leave the old
+                // entry present but empty, so the indices don't shift.
+                keep = std::move(lines_to_keep[lookup->second]);
+                assert(!lines_to_keep[lookup->second].get());
+                // Update number of duplicate entries.
+                if (_dups)
+                    ++(*_dups);
+            }
+            seen.insert_or_assign(keep->m_line.m_line.get(), lines_to_keep.size());
+        }
+
+        // Initialize the rest of the keep struct.
+        keep->m_timestamp.m_line.set(tmp.empty() ? nullptr : tmp.c_str());
+        keep->m_timestamp.m_old = timestamp_id;
+        keep->m_line.m_old = id;
+        keep->m_dir = dir;
+
+        // And keep them.
+        lines_to_keep.emplace_back(std::move(keep));
+        assert(!keep.get());
+    }
+
+    if (_kept)
+        *_kept = lines_to_keep.size();
+    if (_deleted)
+        *_deleted = iter.get_deleted_count();
+
+    // Clear and write new tag.
+    concurrency_tag tag;
+    tag.generate_new_tag();
+    lock.clear();
+    lock.add_ctag(tag.get());
+
+    // Decide how many lines to keep.
+    size_t start = 0;
+    if (0 < limit && limit < lines_to_keep.size())
+    {
+        for (start = lines_to_keep.size(); limit && start--;)
+            if (lines_to_keep[start].get())
+                --limit;
+    }
+
+    // Write lines from vector.
+    for (size_t ii = start; ii < lines_to_keep.size(); ++ii)
+    {
+        const auto& keep = lines_to_keep[ii];
+        if (keep)
+        {
+            // In the binary format the timestamp is part of the line's record,
+            // and has no id of its own.
+            keep->m_line.m_new = lock.add_line(keep->m_line.m_line.get(), -1, keep->m_timestamp.m_line.get(), &keep->m_timestamp.m_new, keep->m_dir);
+        }
+    }
+
+    // Verify ids monotonically increase.
+#ifdef DEBUG
+    const keep_line_pair* prev = nullptr;
+    for (size_t ii = start; ii < lines_to_keep.size(); ++ii)
+    {
+        const auto& keep = lines_to_keep[ii];
+        if (keep)
+        {
+            if (prev)
+            {
+                if (keep->m_timestamp.m_old.outer)
+                {
+                    assert(keep->m_timestamp.m_old.outer > prev->m_line.m_old.outer);
+                    assert(keep->m_line.m_old.outer > keep->m_timestamp.m_old.outer);
+                }
+                if (keep->m_timestamp.m_new.outer)
+                {
+                    assert(keep->m_timestamp.m_new.outer > prev->m_line.m_new.outer);
+                    assert(keep->m_line.m_new.outer > keep->m_timestamp.m_new.outer);
+                }
+                assert(keep->m_line.m_old.outer > prev->m_line.m_old.outer);
+                assert(keep->m_line.m_new.outer > prev->m_line.m_new.outer);
+            }
+            prev = keep.get();
+        }
+    }
+#endif
+
+    if (remap)
+    {
+        for (size_t ii = start; ii < lines_to_keep.size(); ++ii)
+        {
+            const auto& keep = lines_to_keep[ii];
+            if (keep)
+            {
+                if (keep->m_timestamp.m_old.outer && keep->m_timestamp.m_new.outer)
+                    remap->emplace(keep->m_timestamp.m_old.outer, keep->m_timestamp.m_new.outer);
+                remap->emplace(keep->m_line.m_old.outer, keep->m_line.m_new.outer);
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+static void migrate_history(const char* path, bool m_diagnostic)
+{
+    bank_handles handles;
+    handles.m_handle_lines = open_file(path);
+    handles.m_binary = (g_file_format.get() == 1);
+    if (!handles)
+        return;
+
+    // First lock the history bank.
+    write_lock lock(handles);
+
+    // Then test if it's empty -- only migrate if it's empty.
+    DWORD high = 0;
+    DWORD low = GetFileSize(handles.m_handle_lines, &high);
+    if (!low && !high)
+    {
+        // Build the old history file name.
+        str<> old_file;
+        path::get_directory(path, old_file);
+        path::append(old_file, ".history");
+        DIAG("... migrate from '%s'\n", old_file.c_str());
+
+        // Open the old history file and try to migrate.
+        FILE* old = fopen(old_file.c_str(), "r");
+        if (old)
+        {
+            // Clear and write new tag.
+            concurrency_tag tag;
+            tag.generate_new_tag();
+            lock.clear();
+            lock.add_ctag(tag.get());
+
+            // Copy old history.
+            int32 buffer_size = 8192;
+            char* buffer = static_cast<char*>(malloc(buffer_size));
+            while (fgets(buffer, buffer_size, old))
+            {
+                size_t len = strlen(buffer);
+                while (len--)
+                {
+                    char c = buffer[len];
+                    if (c != '\n' && c != '\r')
+                        break;
+                    buffer[len] = '\0';
+                }
+                lock.add(buffer);
+            }
+
+            fclose(old);
+        }
+    }
+
+    handles.close();
+}
+
+
+
+//------------------------------------------------------------------------------
+history_db::history_db(const char* path, int32 id, bool use_master_bank)
+: m_path(path)
+, m_id(id)
+, m_use_master_bank(use_master_bank)
+{
+    static_assert(sizeof(line_id) == sizeof(line_id_impl), "");
+
+    memset(m_bank_handles, 0, sizeof(m_bank_handles));
+    m_master_len = 0;
+    m_master_deleted_count = 0;
+    m_dir_index = std::make_unique<history_dir_index>();
+
+    history_inhibit_expansion_function = history_expand_control;
+    history_event_search_hook = history_event_search;
+
+    if (path::is_device(m_path.c_str()))
+    {
+        m_path.clear();
+        return;
+    }
+
+    // Remember the bank file names so they are stable for the lifetime of this
+    // history_db.  Otherwise changing %CLINK_HISTORY_LABEL% can change the file
+    // name prematurely and history can bleed across during reap().  This also
+    // enables is_stale_name() to identify when the history_db instance needs to
+    // be recreated.
+    get_file_path(m_bank_filenames[bank_master], false);
+    get_file_path(m_bank_filenames[bank_session], true);
+
+    // Create a self-deleting file to used to indicate this session's alive
+    str<280> alive(m_bank_filenames[bank_session].c_str());
+    alive << "~";
+
+    wstr<> walive(alive.c_str());
+    DWORD flags = FILE_FLAG_DELETE_ON_CLOSE|FILE_ATTRIBUTE_HIDDEN;
+    m_alive_file = CreateFileW(walive.c_str(), 0, 0, nullptr, CREATE_ALWAYS, flags, nullptr);
+    m_alive_file = (m_alive_file == INVALID_HANDLE_VALUE) ? nullptr : m_alive_file;
+}
+
+//------------------------------------------------------------------------------
+history_db::~history_db()
+{
+    m_reaper.reset();
+    m_compactor.reset();
+    save_bank_index(true/*force*/);
+
+    // Close alive handle
+    if (m_alive_file)
+        CloseHandle(m_alive_file);
+
+    // Close all but the master bank. We're going to append to the master one.
+    for (int32 i = 1; i < sizeof_array(m_bank_handles); ++i)
+        m_bank_handles[i].close();
+
+    reap(get_bank(bank_master));
+
+    m_bank_handles[bank_master].close();
+}
+
+//------------------------------------------------------------------------------
+void history_db::reap(const bank_handles& master, const volatile bool* cancel)
+{
+    if (!is_valid())
+        return;
+
+    dbg_ignore_scope(snapshot, "History");
+
+    str<280> removals;
+
+    for_each_session([&](str_base& path, bool local)
+    {
+        if (cancel && *cancel)
+            return;
+
+        path << "~";
+        if (os::get_path_type(path.c_str()) == os::path_type_file)
+            if (!os::unlink(path.c_str())) // abandoned alive files will unlink
+                return;
+
+        path.truncate(path.length() - 1);
+        DIAG("... reap session file '%s'\n", path.c_str());
+
+        if (local)
+        {
+            os::unlink(path.c_str()); // simply delete local files, i.e. `history.save` is false.
+            return;
+        }
+
+        removals = path.c_str();
+        removals << ".removals";
+
+        if (!m_use_master_bank)
+        {
+            // Don't copy; only delete.
+        }
+        else if (os::get_file_size(path.c_str()) > 0 ||
+                 os::get_file_size(removals.c_str()) > 0)
+        {
+            bank_handles reap_handles;
+            reap_handles.m_handle_lines = open_file(path.c_str());
+            reap_handles.m_handle_removals = open_file(removals.c_str(), true/*if_exists*/);
+
+            if (reap_handles.m_handle_removals)
+                DIAG("... reap session file '%s'\n", removals.c_str());
+
+            {
+                // WARNING: ALWAYS LOCK MASTER BEFORE SESSION!
+                bank_handles master_handles = master;
+                master_handles.m_handle_removals = nullptr; // Don't redirect removals.
+                write_lock dest(master_handles);
+                read_lock src(reap_handles);
+                if (src && dest)
+                {
+                    dest.append(src);
+                    if (src.apply_removals(dest) > 0)
+                        publish_change();
+                    publish_add();
+                }
+            }
+
+            reap_handles.close();
+        }
+
+        os::unlink(removals.c_str());
+        os::unlink(path.c_str());
+    });
+}
+
+//------------------------------------------------------------------------------
+void history_db::initialise(str_base* error_message)
+{
+    if (m_bank_handles[bank_master] || m_bank_handles[bank_session] || !is_valid())
+        return;
+
+    str<280> path;
+    path << m_bank_filenames[bank_master];
+
+    m_binary_format = (g_file_format.get() == 1);
+
+    if (m_use_master_bank)
+    {
+        DIAG("... master file '%s'\n", path.c_str());
+
+        // Migrate existing history.
+        if (os::get_path_type(path.c_str()) == os::path_type_invalid)
+            migrate_history(path.c_str(), m_diagnostic);
+
+        // Open the master bank file.
+        m_bank_handles[bank_master].m_handle_lines = open_file(path.c_str(), m_bank_error[bank_master]);
+        make_open_error(error_message, bank_master);
+
+        // Open the change feed shared with other sessions.
+        if (!m_feed)
+            m_feed = std::make_unique<history_change_feed>(path.c_str());
+
+        // Retrieve concurrency tag from start of master bank.
+        m_master_ctag.clear();
+        {
+            read_lock lock(get_bank(bank_master), false);
+            extract_ctag(lock, m_master_ctag);
+        }
+
+        // No concurrency tag?  Inject one.
+        if (m_master_ctag.empty())
+        {
+            write_lock lock(get_bank(bank_master));
+            if (!extract_ctag(lock, m_master_ctag))
+            {
+                rewrite_master_bank(lock);
+                extract_ctag(lock, m_master_ctag);
+                publish_change();
+            }
+        }
+
+        // Convert the master bank if it isn't in the configured format.
+        convert_master_bank();
+        LOG("master bank ctag: %s", m_master_ctag.get());
+
+        // If history is shared, there is only the master bank.
+        if (g_shared.get())
+            return;
+    }
+    else
+    {
+        DIAG("... no master file\n");
+        assert(!m_bank_handles[bank_master].m_handle_lines);
+        assert(!m_bank_handles[bank_master].m_handle_removals);
+        m_master_ctag.clear();
+    }
+
+    path.clear();
+    path << m_bank_filenames[bank_session];
+    if (!m_use_master_bank)
+        path << ".local";
+    DIAG("... session file '%s'\n", path.c_str());
+
+    assert(!m_bank_handles[bank_session].m_handle_lines);
+    assert(!m_bank_handles[bank_session].m_handle_removals);
+
+    m_bank_handles[bank_session].m_handle_lines = open_file(path.c_str(), m_bank_error[bank_session]);
+    make_open_error(error_message, bank_session);
+    if (m_use_master_bank && g_dupe_mode.get() == 2) // 'erase_prev'
+    {
+        str<280> removals;
+        removals << path << ".removals";
+        DIAG("... removals file '%s'\n", removals.c_str());
+
+        m_bank_handles[bank_session].m_handle_removals = make_removals_file(removals.c_str(), m_master_ctag.get());
+    }
+
+    start_background_reap(); // collects orphaned history files.
+}
+
+//------------------------------------------------------------------------------
+void history_db::start_background_reap()
+{
+    // Diagnostic output should stay in order, so reap synchronously.
+    if (m_diagnostic)
+    {
+        reap(get_bank(bank_master));
+        return;
+    }
+
+    // Sessions sharing the same master bank share the same reaper, so that
+    // only one of them globs for orphaned session files at a time.
+    str<280> path(m_bank_filenames[bank_master].c_str());
+    str_ascii_tolower(path.data());
+
+    str<32> name;
+    name.format("history_reap_%08x", str_hash(path.c_str(), path.length()));
+
+    m_reaper = std::make_unique<housekeeper>(name.c_str(), c_reap_interval);
+    m_reaper->start([this] (const volatile bool& cancel)
+    {
+        // Use a separate handle, so that the bank locks also serialize against
+        // this session.
+        bank_handles handles;
+        if (m_use_master_bank)
+        {
+            handles.m_handle_lines = open_file(m_bank_filenames[bank_master].c_str(), true/*if_exists*/);
+            if (!handles)
+                return;
+        }
+
+        reap(handles, &cancel);
+        handles.close();
+    });
+}
+
+//------------------------------------------------------------------------------
+bank_t history_db::get_active_bank() const
+{
+    return (m_use_master_bank && !m_bank_handles[bank_session].m_handle_lines) ? bank_master : bank_session;
+}
+
+//------------------------------------------------------------------------------
+bank_handles history_db::get_bank(uint32 index) const
+{
+    // Reading master needs master lines and session removals.
+    // Reading session needs session lines.
+    // Writing master needs master lines and session removals.
+    //   - EXCEPT in apply_removals(), but the caller adjusts that case.
+    // Writing session needs session lines.
+    bank_handles handles;
+    if (index < sizeof_array(m_bank_handles) && is_valid())
+    {
+        handles.m_handle_lines = m_bank_handles[index].m_handle_lines;
+        handles.m_binary = m_binary_format;
+        if (index == bank_master)
+            handles.m_handle_removals = m_bank_handles[bank_session].m_handle_removals;
+    }
+    return handles;
+}
+
+//------------------------------------------------------------------------------
+template <typename T> void history_db::for_each_bank(T&& callback)
+{
+    for (int32 i = 0; i < sizeof_array(m_bank_handles); ++i)
+    {
+        write_lock lock(get_bank(i));
+        if (lock && !callback(i, lock))
+            break;
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename T> void history_db::for_each_bank(T&& callback) const
+{
+    for (int32 i = 0; i < sizeof_array(m_bank_handles); ++i)
+    {
+        read_lock lock(get_bank(i));
+        if (lock && !callback(i, lock))
+            break;
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename T> void history_db::for_each_session(T&& callback) const
+{
+    assert(is_valid());
+
+    // Fold each session found that has no valid alive file.
+    str<280> path;
+    path << m_bank_filenames[bank_master] << "_*";
+
+    for (globber i(path.c_str()); i.next(path);)
+    {
+        // History files have no extension.  (E.g. don't reap supplement files
+        // such as *.removals files).
+        const char* ext = path::get_extension(path.c_str());
+        bool local = (ext && _stricmp(ext, ".local") == 0);
+        if (ext && !local)
+            continue;
+
+        callback(path, local);
+    }
+}
+
+//------------------------------------------------------------------------------
+bool history_db::is_valid() const
+{
+    return !m_path.empty();
+}
+
+//------------------------------------------------------------------------------
+void history_db::get_file_path(str_base& out, bool session) const
+{
+    out = m_path.c_str();
+
+    if (session && is_valid())
+    {
+        str<16> suffix;
+        suffix.format("_%d", m_id);
+        out << suffix;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Each Readline history entry normally owns two heap blocks (the line and its
+// timestamp), so the heap's per-block overhead adds up across a large history
+// in every session.  Loading history packs the strings into large pages
+// instead, and Readline releases them via history_free_string_hook.  The pages
+// are freed once every string has been released, which usually happens when
+// the history is cleared before being reloaded.
+class history_string_pool
+    : public no_copy
+{
+public:
+    char*                       store(const char* s, uint32 len);
+    bool                        release(const char* s);
+
+private:
+    struct page
+    {
+        char*                   begin;
+        char*                   end;
+    };
+
+    static const size_t         c_page_size = 64 * 1024;
+    static const size_t         c_max_packed = 1024;
+    void                        insert_page(char* begin, size_t size);
+    std::vector<page>           m_pages;    // Sorted by address.
+    char*                       m_next = nullptr;
+    char*                       m_end = nullptr;
+    size_t                      m_live = 0;
+};
+
+//------------------------------------------------------------------------------
+char* history_string_pool::store(const char* s, uint32 len)
+{
+    const size_t need = size_t(len) + 1;
+    char* out;
+
+    if (need > c_max_packed)
+    {
+        // Long strings get their own page, so the current page isn't wasted.
+        out = static_cast<char*>(malloc(need));
+        if (!out)
+            return nullptr;
+        insert_page(out, need);
+    }
+    else
+    {
+        if (size_t(m_end - m_next) < need)
+        {
+            char* p = static_cast<char*>(malloc(c_page_size));
+            if (!p)
+                return nullptr;
+            insert_page(p, c_page_size);
+            m_next = p;
+            m_end = p + c_page_size;
+        }
+        out = m_next;
+        m_next += need;
+    }
+
+    memcpy(out, s, len);
+    out[len] = '\0';
+    ++m_live;
+    return out;
+}
+
+//------------------------------------------------------------------------------
+bool history_string_pool::release(const char* s)
+{
+    auto iter = std::upper_bound(m_pages.begin(), m_pages.end(), s, [] (const char* s, const page& p) {
+        return s < p.begin;
+    });
+    if (iter == m_pages.begin())
+        return false;
+    --iter;
+    if (s >= iter->end)
+        return false;
+
+    assert(m_live);
+    if (!--m_live)
+    {
+        for (const auto& p : m_pages)
+            free(p.begin);
+        m_pages.clear();
+        m_pages.shrink_to_fit();
+        m_next = nullptr;
+        m_end = nullptr;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void history_string_pool::insert_page(char* begin, size_t size)
+{
+    const page p = { begin, begin + size };
+    auto iter = std::upper_bound(m_pages.begin(), m_pages.end(), p, [] (const page& a, const page& b) {
+        return a.begin < b.begin;
+    });
+    m_pages.insert(iter, p);
+}
+
+//------------------------------------------------------------------------------
+// The pool is intentionally never destroyed, since Readline's history list may
+// outlive static destructors.
+static history_string_pool& get_string_pool()
+{
+    static history_string_pool* s_pool = new history_string_pool;
+    return *s_pool;
+}
+
+//------------------------------------------------------------------------------
+static void free_history_string(char* s)
+{
+    if (!get_string_pool().release(s))
+        xfree(s);
+}
+
+//------------------------------------------------------------------------------
+static void add_rl_history(const char* line, uint32 len, const char* time)
+{
+    history_string_pool& pool = get_string_pool();
+    history_free_string_hook = free_history_string;
+
+    char* l = pool.store(line, len);
+    if (!l)
+        return;
+    char* ts = (time && *time) ? pool.store(time, uint32(strlen(time))) : nullptr;
+    add_history_nocopy(l, ts);
+}
+
+//------------------------------------------------------------------------------
+static void __clear_history()
+{
+    rl_clear_history();
+    assert(!rl_undo_list);
+
+    history_prev_use_curr = 0;
+
+    free(const_cast<char*>(history_event_lookup_cache.search_string));
+    memset(&history_event_lookup_cache, 0, sizeof(history_event_lookup_cache));
+    s_history_event_index.clear();
+
+#ifdef UNDO_LIST_HEAP_DIAGNOSTICS
+    clink_check_undo_entry_leaks();
+#endif
+}
+
+//------------------------------------------------------------------------------
+void history_db::load_internal()
+{
+    __clear_history();
+    m_index_map.clear();
+    m_dir_index->clear();
+    m_archive_len = 0;
+    m_archive_tag = 0;
+    m_master_len = 0;
+    m_master_deleted_count = 0;
+
+    // Capture the change feed before reading, so that changes published while
+    // reading are noticed by the next load.
+    const history_change_feed::stamp stamp = m_feed ? m_feed->get_stamp() : history_change_feed::stamp();
+    m_loaded_adds = stamp.adds;
+    m_loaded_changes = stamp.changes;
+    m_loaded_size = 0;
+    m_loaded = true;
+
+    history_read_buffer buffer;
+
+    DIAG("... loading history\n");
+
+    const history_db& const_this = *this;
+    const_this.for_each_bank([&] (uint32 bank_index, const read_lock& lock)
+    {
+        DIAG("... ... %s bank", bank_index == bank_master ? "master" : "session");
+
+        if (bank_index == bank_master)
+        {
+            m_master_ctag.clear();
+            extract_ctag(lock, m_master_ctag);
+            m_loaded_size = GetFileSize(lock.get_lines_handle(), nullptr);
+            load_archive();
+        }
+
+        // Memory mapped banks are loaded from the bank's index.
+        {
+            uint32 num_lines = 0;
+            uint32 num_deleted = 0;
+            if (load_bank_mapped(bank_index, lock, num_lines, num_deleted))
+            {
+                if (bank_index == bank_master)
+                    m_master_deleted_count += num_deleted;
+                DIAG(":  lines active %u / deleted %u (mapped)\n", num_lines, num_deleted);
+                return true;
+            }
+        }
+
+        // Subtract 1 from the size to accommodate the forced NUL termination
+        // prior to calling add_history.
+        read_lock::line_iter iter(lock, buffer.data(), buffer.size() - 1);
+
+        dbg_snapshot_heap(snapshot);
+
+        str_iter out;
+        str<32> time;
+        uint32 dir;
+        line_id_impl id;
+        uint32 num_lines = 0;
+        while (id = iter.next(out, &time, nullptr, &dir))
+        {
+            const char* line = out.get_pointer();
+            int32 buffer_offset = int32(line - buffer.data());
+            buffer.data()[buffer_offset + out.length()] = '\0';
+            add_rl_history(line, out.length(), time.c_str());
+
+            num_lines++;
+
+            id.bank_index = bank_index;
+            m_index_map.push_back(id.outer);
+            m_dir_index->push_back(dir);
+            if (bank_index == bank_master)
+            {
+                //LOG("load:  bank %u, offset %u, active %u:  '%s', len %u", id.bank_index, id.offset, id.active, line, out.length());
+                m_master_len = m_index_map.size();
+            }
+        }
+
+        dbg_ignore_since_snapshot(snapshot, "History");
+
+        if (bank_index == bank_master)
+            m_master_deleted_count += iter.get_deleted_count();
+
+        DIAG(":  lines active %u / deleted %u\n", num_lines, iter.get_deleted_count());
+
+        return true;
+    });
+
+    DIAG("... total lines active %zu\n", m_index_map.size());
+
+    save_bank_index(false/*force*/);
+}
+
+//------------------------------------------------------------------------------
+// Loads the archived lines, which precede the master bank's lines.  The master
+// bank must already be locked.
+void history_db::load_archive()
+{
+    str<280> path;
+    get_archive_path(path);
+
+    history_archive archive;
+    if (!archive.load(path.c_str()))
+        return;
+
+    dbg_snapshot_heap(snapshot);
+
+    str<32> time;
+    for (size_t i = 0; i < archive.size(); ++i)
+    {
+        const history_archive::entry& entry = archive.get(i);
+        time.clear();
+        if (entry.time)
+            time.format("%u", entry.time);
+        add_rl_history(archive.get_text(entry), entry.length, time.c_str());
+
+        line_id_impl id(entry.ordinal);
+        id.bank_index = c_bank_archive;
+        m_index_map.push_back(id.outer);
+        m_dir_index->push_back(entry.dir);
+    }
+
+    dbg_ignore_since_snapshot(snapshot, "History");
+
+    m_archive_len = m_index_map.size();
+    m_archive_tag = archive.get_tag();
+    m_master_len = m_archive_len;
+    m_master_deleted_count = archive.get_removed_count();
+
+    DIAG(" (archived lines %zu / deleted %u)", m_archive_len, archive.get_removed_count());
+}
+
+//------------------------------------------------------------------------------
+bool history_db::read_archive(history_archive& archive) const
+{
+    if (!m_use_master_bank)
+        return false;
+
+    read_lock lock(get_bank(bank_master));
+    if (!lock)
+        return false;
+
+    str<280> path;
+    get_archive_path(path);
+    return archive.load(path.c_str());
+}
+
+//------------------------------------------------------------------------------
+void history_db::get_archive_path(str_base& out) const
+{
+    out = m_bank_filenames[bank_master].c_str();
+    out << ".archive";
+}
+
+//------------------------------------------------------------------------------
+bool history_db::load_incremental()
+{
+    // Only shared history can be loaded incrementally, because otherwise the
+    // session bank's lines follow the master bank's lines.
+    if (!m_loaded || !m_feed || !*m_feed || !g_shared.get() || !m_use_master_bank)
+        return false;
+    if (m_bank_handles[bank_session].m_handle_lines)
+        return false;
+
+    // Any change other than appending lines requires reloading everything.
+    const history_change_feed::stamp stamp = m_feed->get_stamp();
+    if (stamp.changes != m_loaded_changes)
+        return false;
+    if (stamp.adds == m_loaded_adds)
+    {
+        DIAG("... history unchanged\n");
+        return true;
+    }
+
+    read_lock lock(get_bank(bank_master));
+    if (!lock)
+        return false;
+
+    concurrency_tag tag;
+    if (!extract_ctag(lock, tag) || strcmp(tag.get(), m_master_ctag.get()) != 0)
+        return false;
+
+    const DWORD size = GetFileSize(lock.get_lines_handle(), nullptr);
+    if (size == INVALID_FILE_SIZE || size < m_loaded_size)
+        return false;
+
+    DIAG("... loading history from offset %u\n", m_loaded_size);
+
+    // Subtract 1 from the size to accommodate the forced NUL termination
+    // prior to calling add_history.
+    history_read_buffer buffer;
+    read_lock::line_iter iter(lock, buffer.data(), buffer.size() - 1);
+    iter.set_file_offset(m_loaded_size);
+
+    dbg_snapshot_heap(snapshot);
+
+    str_iter out;
+    str<32> time;
+    uint32 dir;
+    line_id_impl id;
+    uint32 num_lines = 0;
+    while (id = iter.next(out, &time, nullptr, &dir))
+    {
+        const char* line = out.get_pointer();
+        int32 buffer_offset = int32(line - buffer.data());
+        buffer.data()[buffer_offset + out.length()] = '\0';
+        add_rl_history(line, out.length(), time.c_str());
+
+        num_lines++;
+
+        id.bank_index = bank_master;
+        m_index_map.push_back(id.outer);
+        m_dir_index->push_back(dir);
+    }
+
+    dbg_ignore_since_snapshot(snapshot, "History");
+
+    m_master_len = m_index_map.size();
+    m_master_deleted_count += iter.get_deleted_count();
+    m_loaded_size = size;
+    m_loaded_adds = stamp.adds;
+
+    DIAG("... ... lines added %u / total lines active %zu\n", num_lines, m_index_map.size());
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void history_db::publish_add() const
+{
+    if (m_feed)
+        m_feed->publish_add();
+}
+
+//------------------------------------------------------------------------------
+void history_db::publish_change() const
+{
+    if (m_feed)
+        m_feed->publish_change();
+}
+
+//------------------------------------------------------------------------------
+history_index* history_db::sync_bank_index(uint32 bank_index, const read_lock& lock, history_mapped_view& view) const
+{
+    // The index only understands the text format.
+    if (!g_memory_map.get() || bank_index >= sizeof_array(m_bank_index) || lock.is_binary())
+        return nullptr;
 
-    if (remap)
+    if (!view.map(lock.get_lines_handle()))
+        return nullptr;
+
+    auto& index = m_bank_index[bank_index];
+    if (!index)
     {
-        for (size_t ii = start; ii < lines_to_keep.size(); ++ii)
+        index = std::make_unique<history_index>();
+
+        // Only the master bank's index is saved; session banks are small and
+        // are only indexed for the lifetime of the session.
+        if (bank_index == bank_master)
         {
-            const auto& keep = lines_to_keep[ii];
-            if (keep)
-            {
-                if (keep->m_timestamp.m_line.get())
-                    remap->emplace(keep->m_timestamp.m_old.outer, keep->m_timestamp.m_new.outer);
-                remap->emplace(keep->m_line.m_old.outer, keep->m_line.m_new.outer);
-            }
+            str<280> path;
+            path << m_bank_filenames[bank_master] << ".index";
+            if (index->load(path.c_str()))
+                DIAG("... loaded index '%s'\n", path.c_str());
         }
     }
+
+    if (index->sync(view))
+        DIAG("... rebuilt %s bank index\n", bank_index == bank_master ? "master" : "session");
+
+    return index.get();
 }
 
 //------------------------------------------------------------------------------
-static void migrate_history(const char* path, bool m_diagnostic)
+// Returns the range of offsets in the bank that can contain lines with
+// timestamps from SINCE through UNTIL.  Only the master bank has a time index;
+// session banks are small enough to just read.
+void history_db::get_time_range(uint32 bank_index, const read_lock& lock, time_t since, time_t until, uint32& start, uint32& end) const
 {
-    bank_handles handles;
-    handles.m_handle_lines = open_file(path);
-    if (!handles)
+    start = 0;
+    end = UINT_MAX;
+
+    if (bank_index != bank_master)
         return;
 
-    // First lock the history bank.
-    write_lock lock(handles);
+    str<280> path;
+    path << m_bank_filenames[bank_master] << ".timeindex";
 
-    // Then test if it's empty -- only migrate if it's empty.
-    DWORD high = 0;
-    DWORD low = GetFileSize(handles.m_handle_lines, &high);
-    if (!low && !high)
+    if (!m_time_index)
     {
-        // Build the old history file name.
-        str<> old_file;
-        path::get_directory(path, old_file);
-        path::append(old_file, ".history");
-        DIAG("... migrate from '%s'\n", old_file.c_str());
+        m_time_index = std::make_unique<history_time_index>();
+        if (m_time_index->load(path.c_str()))
+            DIAG("... loaded time index '%s'\n", path.c_str());
+    }
 
-        // Open the old history file and try to migrate.
-        FILE* old = fopen(old_file.c_str(), "r");
-        if (old)
-        {
-            // Clear and write new tag.
-            concurrency_tag tag;
-            tag.generate_new_tag();
-            lock.clear();
-            lock.add(tag.get());
+    concurrency_tag tag;
+    extract_ctag(lock, tag);
+    const DWORD size = GetFileSize(lock.get_lines_handle(), nullptr);
+    if (size == INVALID_FILE_SIZE)
+        return;
 
-            // Copy old history.
-            int32 buffer_size = 8192;
-            char* buffer = static_cast<char*>(malloc(buffer_size));
-            while (fgets(buffer, buffer_size, old))
-            {
-                size_t len = strlen(buffer);
-                while (len--)
-                {
-                    char c = buffer[len];
-                    if (c != '\n' && c != '\r')
-                        break;
-                    buffer[len] = '\0';
-                }
-                lock.add(buffer);
-            }
+    history_time_index& index = *m_time_index;
+    if (!index.is_current(tag.get(), size))
+    {
+        DIAG("... rebuilding time index\n");
+        index.reset(tag.get());
+    }
 
-            fclose(old);
+    // Extend the index over lines added since it was last saved.
+    if (index.indexed_size() < size)
+    {
+        history_read_buffer buffer;
+        read_lock::line_iter iter(lock, buffer.data(), buffer.size());
+        if (index.indexed_size())
+            iter.set_file_offset(index.indexed_size());
+
+        str_iter line;
+        str<32> timestamp;
+        while (line_id_impl id = iter.next(line, &timestamp))
+        {
+            if (!timestamp.empty())
+                index.add(history_time_index::parse_time(timestamp.c_str()), id.offset);
         }
-    }
 
-    handles.close();
-}
+        index.set_indexed_size(size);
+    }
 
+    if (index.is_dirty() && index.save(path.c_str()))
+        DIAG("... saved time index '%s'\n", path.c_str());
 
+    start = index.find_start(since);
+    if (until)
+        end = index.find_end(until);
+}
 
 //------------------------------------------------------------------------------
-history_db::history_db(const char* path, int32 id, bool use_master_bank)
-: m_path(path)
-, m_id(id)
-, m_use_master_bank(use_master_bank)
+bool history_db::load_bank_mapped(uint32 bank_index, const read_lock& lock, uint32& num_lines, uint32& num_deleted)
 {
-    static_assert(sizeof(line_id) == sizeof(line_id_impl), "");
+    history_mapped_view view;
+    history_index* index = sync_bank_index(bank_index, lock, view);
+    if (!index)
+        return false;
 
-    memset(m_bank_handles, 0, sizeof(m_bank_handles));
-    m_master_len = 0;
-    m_master_deleted_count = 0;
+    // Removals from master are deferred when `history.shared` is false, so
+    // also test for deferred removals here.
+    std::unordered_set<uint32> removals;
+    lock.get_removals(removals);
 
-    history_inhibit_expansion_function = history_expand_control;
+    dbg_snapshot_heap(snapshot);
 
-    if (path::is_device(m_path.c_str()))
+    str<> line;
+    str<32> time;
+    const uint32 count = index->count();
+    for (uint32 i = 0; i < count; ++i)
     {
-        m_path.clear();
-        return;
-    }
+        const history_index::entry& entry = index->get(i);
+        if (index->test_removed(i, view) || removals.find(entry.offset) != removals.end())
+        {
+            ++num_deleted;
+            continue;
+        }
 
-    // Remember the bank file names so they are stable for the lifetime of this
-    // history_db.  Otherwise changing %CLINK_HISTORY_LABEL% can change the file
-    // name prematurely and history can bleed across during reap().  This also
-    // enables is_stale_name() to identify when the history_db instance needs to
-    // be recreated.
-    get_file_path(m_bank_filenames[bank_master], false);
-    get_file_path(m_bank_filenames[bank_session], true);
+        history_index::get_line(view, entry, line);
+        const bool has_time = history_index::get_timestamp(view, entry, time);
+        add_rl_history(line.c_str(), line.length(), has_time ? time.c_str() : nullptr);
 
-    // Create a self-deleting file to used to indicate this session's alive
-    str<280> alive(m_bank_filenames[bank_session].c_str());
-    alive << "~";
+        num_lines++;
 
-    wstr<> walive(alive.c_str());
-    DWORD flags = FILE_FLAG_DELETE_ON_CLOSE|FILE_ATTRIBUTE_HIDDEN;
-    m_alive_file = CreateFileW(walive.c_str(), 0, 0, nullptr, CREATE_ALWAYS, flags, nullptr);
-    m_alive_file = (m_alive_file == INVALID_HANDLE_VALUE) ? nullptr : m_alive_file;
+        const bool too_big = (entry.offset >= c_max_line_id.offset);
+        assert(!too_big);
+        line_id_impl id(too_big ? c_max_line_id.offset : entry.offset);
+        id.bank_index = bank_index;
+        m_index_map.push_back(id.outer);
+        m_dir_index->push_back(entry.dir);
+        if (bank_index == bank_master)
+            m_master_len = m_index_map.size();
+    }
+
+    dbg_ignore_since_snapshot(snapshot, "History");
+
+    return true;
 }
 
 //------------------------------------------------------------------------------
-history_db::~history_db()
+template <typename T> bool history_db::find_mapped(uint32 bank_index, const read_lock& lock, const char* line, T&& callback) const
 {
-    // Close alive handle
-    if (m_alive_file)
-        CloseHandle(m_alive_file);
+    history_mapped_view view;
+    history_index* index = sync_bank_index(bank_index, lock, view);
+    if (!index)
+        return false;
 
-    // Close all but the master bank. We're going to append to the master one.
-    for (int32 i = 1; i < sizeof_array(m_bank_handles); ++i)
-        m_bank_handles[i].close();
+    std::unordered_set<uint32> removals;
+    lock.get_removals(removals);
 
-    reap();
+    // The index's hash lookup yields candidates in ascending order, which
+    // matches the order of a linear scan through the bank.
+    const uint32 length = uint32(strlen(line));
+    index->find(line, length, [&] (uint32 i)
+    {
+        const history_index::entry& entry = index->get(i);
+        if (!history_index::matches(view, entry, line, length))
+            return true;
+        if (index->test_removed(i, view) || removals.find(entry.offset) != removals.end())
+            return true;
+        return callback(line_id_impl(entry.offset));
+    });
 
-    m_bank_handles[bank_master].close();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void history_db::save_bank_index(bool force) const
+{
+    const auto& index = m_bank_index[bank_master];
+    if (!index || !(force ? index->is_dirty() : index->needs_save()))
+        return;
+
+    str<280> path;
+    path << m_bank_filenames[bank_master] << ".index";
+    if (index->save(path.c_str()))
+        DIAG("... saved index '%s'\n", path.c_str());
 }
 
 //------------------------------------------------------------------------------
-void history_db::reap()
+void history_db::load_rl_history(bool can_clean)
 {
     if (!is_valid())
         return;
 
-    dbg_ignore_scope(snapshot, "History");
+    mem_tag_scope tag(mem_tag::history);
 
-    str<280> removals;
+    if (!load_incremental())
+        load_internal();
 
-    for_each_session([&](str_base& path, bool local)
+    // The `clink history` command needs to be able to avoid cleaning the master
+    // history file.
+    if (can_clean && m_use_master_bank)
     {
-        path << "~";
-        if (os::get_path_type(path.c_str()) == os::path_type_file)
-            if (!os::unlink(path.c_str())) // abandoned alive files will unlink
-                return;
+        if (compact())
+            load_internal();
+    }
+}
 
-        path.truncate(path.length() - 1);
-        DIAG("... reap session file '%s'\n", path.c_str());
+//------------------------------------------------------------------------------
+void history_db::clear()
+{
+    if (!is_valid())
+        return;
 
-        if (local)
-        {
-            os::unlink(path.c_str()); // simply delete local files, i.e. `history.save` is false.
-            return;
-        }
+    DIAG("... clearing history\n");
 
-        removals = path.c_str();
-        removals << ".removals";
+    for_each_bank([&] (uint32 bank_index, write_lock& lock)
+    {
+        DIAG("... ... %s bank\n", bank_index == bank_master ? "master" : "session");
 
-        if (!m_use_master_bank)
+        lock.clear();
+        if (bank_index == bank_master)
         {
-            // Don't copy; only delete.
+            str<280> path;
+            get_archive_path(path);
+            history_archive::erase(path.c_str());
+
+            m_master_ctag.clear();
+            m_master_ctag.generate_new_tag();
+            lock.add_ctag(m_master_ctag.get());
+            publish_change();
         }
-        else if (os::get_file_size(path.c_str()) > 0 ||
-                 os::get_file_size(removals.c_str()) > 0)
-        {
-            bank_handles reap_handles;
-            reap_handles.m_handle_lines = open_file(path.c_str());
-            reap_handles.m_handle_removals = open_file(removals.c_str(), true/*if_exists*/);
+        return true;
+    });
 
-            if (reap_handles.m_handle_removals)
-                DIAG("... reap session file '%s'\n", removals.c_str());
+    for (auto& index : m_bank_index)
+    {
+        if (index)
+            index->clear();
+    }
+
+    m_index_map.clear();
+    m_dir_index->clear();
+    m_archive_len = 0;
+    m_archive_tag = 0;
+    m_master_len = 0;
+    m_master_deleted_count = 0;
+}
+
+//------------------------------------------------------------------------------
+struct removal_file_data
+{
+    str_moveable                m_file;
+    std::vector<line_id_impl>   m_lines;
+};
+
+//------------------------------------------------------------------------------
+void history_db::collect_removals_files(write_lock& dest, std::vector<removal_file_data>& removals_files) const
+{
+    str_moveable removals;
+
+    for_each_session([&](str_base& path, bool local)
+    {
+        if (m_use_master_bank)
+        {
+            removals = path.c_str();
+            removals << ".removals";
 
+            if (os::get_file_size(path.c_str()) > 0 ||
+                os::get_file_size(removals.c_str()) > 0)
             {
-                // WARNING: ALWAYS LOCK MASTER BEFORE SESSION!
-                bank_handles master_handles = get_bank(bank_master);
-                master_handles.m_handle_removals = nullptr; // Don't redirect removals.
-                write_lock dest(master_handles);
-                read_lock src(reap_handles);
-                if (src && dest)
+                bank_handles compact_handles;
+                compact_handles.m_handle_lines = open_file(path.c_str());
+                compact_handles.m_handle_removals = open_file(removals.c_str(), true/*if_exists*/);
+
+                if (compact_handles.m_handle_removals)
                 {
-                    dest.append(src);
-                    src.apply_removals(dest);
+                    DIAG("... compact:  apply removals from '%s'\n", removals.c_str());
+
+                    // WARNING: ALWAYS LOCK MASTER BEFORE SESSION!
+                    read_lock src(compact_handles);
+                    if (src && dest)
+                    {
+                        removal_file_data data;
+                        if (src.collect_removals(dest, data.m_lines) > 0)
+                        {
+                            data.m_file = std::move(removals);
+                            removals_files.emplace_back(std::move(data));
+                        }
+                    }
                 }
+
+                compact_handles.close();
             }
+        }
+    });
+}
 
-            reap_handles.close();
+//------------------------------------------------------------------------------
+static void rewrite_removals_files(const std::vector<removal_file_data>& removals_files, const std::map<line_id_impl, line_id_impl>& remap_removals, const char* ctag)
+{
+    str<64> tmp;
+    DWORD written;
+    for (const auto& r : removals_files)
+    {
+        assert(os::get_path_type(r.m_file.c_str()) == os::path_type_file);
+        void* handle = make_removals_file(r.m_file.c_str(), ctag);
+
+        // Truncate file immedately after the ctag to keep the file in a
+        // consistent state even while being rewritten.
+        SetEndOfFile(handle);
+
+        // Look up the ids and write the new ids for ones that were kept.
+        for (const auto& id : r.m_lines)
+        {
+            const auto iter = remap_removals.find(id);
+            if (iter != remap_removals.end())
+            {
+                tmp.format("%u\n", iter->second.offset);
+                WriteFile(handle, tmp.c_str(), tmp.length(), &written, nullptr);
+            }
         }
 
-        os::unlink(removals.c_str());
-        os::unlink(path.c_str());
-    });
+        CloseHandle(handle);
+    }
 }
 
+
+
 //------------------------------------------------------------------------------
-void history_db::initialise(str_base* error_message)
+// Finds the newest occurrence of each distinct line by content digest, so that
+// removing duplicates needs memory proportional to the number of distinct
+// lines instead of the total size of the lines.  Each slot is 16 bytes.
+//
+// Lines are told apart by a 64 bit digest, and verified by an independent 32
+// bit check hash.  If two different lines have the same digest, the second is
+// rehashed with the next salt until it gets a digest of its own, so a false
+// match needs both hashes (and the length, which seeds both) to collide.
+class line_digest_table
+    : public no_copy
 {
-    if (m_bank_handles[bank_master] || m_bank_handles[bank_session] || !is_valid())
-        return;
+public:
+    enum : uint32 { none = uint32(-1) };
 
-    str<280> path;
-    path << m_bank_filenames[bank_master];
+    uint32                  add(const char* line, uint32 length, uint32 ordinal);
+    uint32                  find(const char* line, uint32 length) const;
+    uint32                  count() const { return m_count; }
 
-    if (m_use_master_bank)
+private:
+    struct slot
     {
-        DIAG("... master file '%s'\n", path.c_str());
-
-        // Migrate existing history.
-        if (os::get_path_type(path.c_str()) == os::path_type_invalid)
-            migrate_history(path.c_str(), m_diagnostic);
+        uint64              digest;         // 0 means the slot is empty.
+        uint32              newest;         // Ordinal of the newest occurrence.
+        uint32              check;
+    };
+    static_assert(sizeof(slot) == 16, "unexpected slot size");
+
+    static uint64           make_digest(const char* line, uint32 length, uint32 salt);
+    static uint32           make_check(const char* line, uint32 length);
+    slot*                   lookup(uint64 digest) const;
+    void                    grow();
+    std::vector<slot>       m_slots;
+    uint32                  m_count = 0;
+};
 
-        // Open the master bank file.
-        m_bank_handles[bank_master].m_handle_lines = open_file(path.c_str(), m_bank_error[bank_master]);
-        make_open_error(error_message, bank_master);
+//------------------------------------------------------------------------------
+// Records ORDINAL as the newest occurrence of LINE.  Returns the ordinal of
+// the previous occurrence, or none.
+uint32 line_digest_table::add(const char* line, uint32 length, uint32 ordinal)
+{
+    if ((m_count + 1) * 4 > m_slots.size() * 3)
+        grow();
 
-        // Retrieve concurrency tag from start of master bank.
-        m_master_ctag.clear();
+    const uint32 check = make_check(line, length);
+    for (uint32 salt = 0;; ++salt)
+    {
+        const uint64 digest = make_digest(line, length, salt);
+        slot* s = lookup(digest);
+        if (!s->digest)
         {
-            read_lock lock(get_bank(bank_master), false);
-            extract_ctag(lock, m_master_ctag);
+            s->digest = digest;
+            s->newest = ordinal;
+            s->check = check;
+            ++m_count;
+            return none;
         }
-
-        // No concurrency tag?  Inject one.
-        if (m_master_ctag.empty())
+        if (s->check == check)
         {
-            write_lock lock(get_bank(bank_master));
-            if (!extract_ctag(lock, m_master_ctag))
-            {
-                rewrite_master_bank(lock);
-                extract_ctag(lock, m_master_ctag);
-            }
+            const uint32 previous = s->newest;
+            s->newest = ordinal;
+            return previous;
         }
-        LOG("master bank ctag: %s", m_master_ctag.get());
-
-        // If history is shared, there is only the master bank.
-        if (g_shared.get())
-            return;
-    }
-    else
-    {
-        DIAG("... no master file\n");
-        assert(!m_bank_handles[bank_master].m_handle_lines);
-        assert(!m_bank_handles[bank_master].m_handle_removals);
-        m_master_ctag.clear();
     }
+}
 
-    path.clear();
-    path << m_bank_filenames[bank_session];
-    if (!m_use_master_bank)
-        path << ".local";
-    DIAG("... session file '%s'\n", path.c_str());
-
-    assert(!m_bank_handles[bank_session].m_handle_lines);
-    assert(!m_bank_handles[bank_session].m_handle_removals);
+//------------------------------------------------------------------------------
+// Returns the ordinal of the newest occurrence of LINE, or none.
+uint32 line_digest_table::find(const char* line, uint32 length) const
+{
+    if (m_slots.empty())
+        return none;
 
-    m_bank_handles[bank_session].m_handle_lines = open_file(path.c_str(), m_bank_error[bank_session]);
-    make_open_error(error_message, bank_session);
-    if (m_use_master_bank && g_dupe_mode.get() == 2) // 'erase_prev'
+    const uint32 check = make_check(line, length);
+    for (uint32 salt = 0;; ++salt)
     {
-        str<280> removals;
-        removals << path << ".removals";
-        DIAG("... removals file '%s'\n", removals.c_str());
-
-        m_bank_handles[bank_session].m_handle_removals = make_removals_file(removals.c_str(), m_master_ctag.get());
+        const slot* s = lookup(make_digest(line, length, salt));
+        if (!s->digest)
+            return none;
+        if (s->check == check)
+            return s->newest;
     }
+}
 
-    reap(); // collects orphaned history files.
+//------------------------------------------------------------------------------
+uint64 line_digest_table::make_digest(const char* line, uint32 length, uint32 salt)
+{
+    // FNV-1a, seeded with the salt and the length.
+    uint64 digest = 0xcbf29ce484222325ull ^ (uint64(salt) << 32) ^ length;
+    for (const char* end = line + length; line < end; ++line)
+    {
+        digest ^= uint8(*line);
+        digest *= 0x100000001b3ull;
+    }
+    return digest ? digest : 1;
 }
 
 //------------------------------------------------------------------------------
-bank_t history_db::get_active_bank() const
+uint32 line_digest_table::make_check(const char* line, uint32 length)
 {
-    return (m_use_master_bank && !m_bank_handles[bank_session].m_handle_lines) ? bank_master : bank_session;
+    return length ? str_fast_hash(line, length) ^ length : 0;
 }
 
 //------------------------------------------------------------------------------
-bank_handles history_db::get_bank(uint32 index) const
+line_digest_table::slot* line_digest_table::lookup(uint64 digest) const
 {
-    // Reading master needs master lines and session removals.
-    // Reading session needs session lines.
-    // Writing master needs master lines and session removals.
-    //   - EXCEPT in apply_removals(), but the caller adjusts that case.
-    // Writing session needs session lines.
-    bank_handles handles;
-    if (index < sizeof_array(m_bank_handles) && is_valid())
+    // Linear probing; the table is never more than 3/4 full.
+    const size_t mask = m_slots.size() - 1;
+    for (size_t i = size_t(digest ^ (digest >> 32)) & mask;; i = (i + 1) & mask)
     {
-        handles.m_handle_lines = m_bank_handles[index].m_handle_lines;
-        if (index == bank_master)
-            handles.m_handle_removals = m_bank_handles[bank_session].m_handle_removals;
+        const slot& s = m_slots[i];
+        if (!s.digest || s.digest == digest)
+            return const_cast<slot*>(&s);
     }
-    return handles;
 }
 
 //------------------------------------------------------------------------------
-template <typename T> void history_db::for_each_bank(T&& callback)
+void line_digest_table::grow()
 {
-    for (int32 i = 0; i < sizeof_array(m_bank_handles); ++i)
+    std::vector<slot> old;
+    old.swap(m_slots);
+    m_slots.resize(old.empty() ? 1024 : old.size() * 2);
+
+    for (const slot& s : old)
     {
-        write_lock lock(get_bank(i));
-        if (lock && !callback(i, lock))
-            break;
+        if (s.digest)
+            *lookup(s.digest) = s;
     }
 }
 
 //------------------------------------------------------------------------------
-template <typename T> void history_db::for_each_bank(T&& callback) const
+// Rewrites the master bank keeping only the newest occurrence of each line,
+// and applies the limit (if any).  The lines are streamed twice:  first to find
+// the newest occurrence of each line, and then to write the lines to keep into
+// TEMP.  Then the master bank is replaced with TEMP.  Only the ids of lines in
+// removals files are added to REMAP.
+static void rewrite_master_bank_uniq(write_lock& lock, const bank_handles& temp, size_t limit, const std::vector<removal_file_data>& removals_files, size_t* _kept, size_t* _deleted, size_t* _dups, std::map<line_id_impl, line_id_impl>* remap)
 {
-    for (int32 i = 0; i < sizeof_array(m_bank_handles); ++i)
+    history_read_buffer buffer;
+    str_iter out;
+    str<> timestamp;
+    line_id_impl timestamp_id;
+    uint32 dir;
+
+    // Find the newest occurrence of each line.
+    line_digest_table table;
+    uint32 active = 0;
+    size_t deleted = 0;
     {
-        read_lock lock(get_bank(i));
-        if (lock && !callback(i, lock))
-            break;
+        read_lock::line_iter iter(lock, buffer.data(), buffer.size());
+        while (iter.next(out))
+            table.add(out.get_pointer(), out.length(), active++);
+        deleted = iter.get_deleted_count();
+    }
+
+    std::unordered_set<uint32> wanted;
+    if (remap)
+    {
+        for (const auto& r : removals_files)
+        {
+            for (const auto& id : r.m_lines)
+                wanted.insert(id.outer);
+        }
+    }
+
+    // Decide how many lines to skip to apply the limit.
+    uint32 skip = 0;
+    if (0 < limit && limit < table.count())
+        skip = uint32(table.count() - limit);
+
+    // Write the lines to keep into the temporary bank.
+    write_lock dest(temp);
+    concurrency_tag tag;
+    tag.generate_new_tag();
+    dest.clear();
+    dest.add_ctag(tag.get());
+
+    uint32 ordinal = 0;
+    size_t kept = 0;
+    read_lock::line_iter iter(lock, buffer.data(), buffer.size());
+    while (const line_id_impl id = iter.next(out, &timestamp, &timestamp_id.outer, &dir))
+    {
+        if (table.find(out.get_pointer(), out.length()) != ordinal++)
+            continue;
+        if (skip)
+        {
+            --skip;
+            continue;
+        }
+
+        line_id_impl new_timestamp;
+        const line_id_impl new_line = dest.add_line(out.get_pointer(), out.length(), timestamp.c_str(), &new_timestamp, dir);
+        ++kept;
+
+        if (remap)
+        {
+            if (timestamp_id.outer && new_timestamp.outer && wanted.find(timestamp_id.outer) != wanted.end())
+                remap->emplace(timestamp_id.outer, new_timestamp.outer);
+            if (wanted.find(id.outer) != wanted.end())
+                remap->emplace(id.outer, new_line.outer);
+        }
     }
+
+    // Replace the master bank.  Both banks start empty, so the ids in the
+    // temporary bank are also the ids in the master bank.
+    lock.clear();
+    lock.append(dest);
+
+    if (_kept)
+        *_kept = kept;
+    if (_deleted)
+        *_deleted = deleted;
+    if (_dups)
+        *_dups = active - table.count();
 }
 
 //------------------------------------------------------------------------------
-template <typename T> void history_db::for_each_session(T&& callback) const
+// Rolls the master bank into the archive:  all but the newest lines are moved
+// into a new archive, and the master bank is rewritten with only the newest
+// lines.  When UNROLL is true, the archived lines are moved back into the
+// master bank instead, and the archive is deleted.  LIMIT (if not 0) applies
+// to the archive and the master bank combined.  Lines with deferred removals
+// are dropped.
+static bool roll_master_bank(write_lock& lock, const char* archive_path, size_t limit, bool unroll, const std::vector<removal_file_data>& removals_files, size_t* _archived, size_t* _kept, size_t* _deleted, std::map<line_id_impl, line_id_impl>* remap)
 {
-    assert(is_valid());
+    struct roll_ids
+    {
+        line_id_impl    m_line;
+        line_id_impl    m_timestamp;
+    };
 
-    // Fold each session found that has no valid alive file.
-    str<280> path;
-    path << m_bank_filenames[bank_master] << "_*";
+    history_archive archive;
+    archive.load(archive_path);
 
-    for (globber i(path.c_str()); i.next(path);)
+    std::unordered_set<uint32> skip;
+    for (const auto& r : removals_files)
     {
-        // History files have no extension.  (E.g. don't reap supplement files
-        // such as *.removals files).
-        const char* ext = path::get_extension(path.c_str());
-        bool local = (ext && _stricmp(ext, ".local") == 0);
-        if (ext && !local)
+        for (const auto& id : r.m_lines)
+            skip.insert(id.offset);
+    }
+
+    // Read the master bank's lines into the archive after the archived lines.
+    history_read_buffer buffer;
+    str_iter out;
+    str<32> timestamp;
+    line_id_impl timestamp_id;
+    uint32 dir;
+    size_t deleted = archive.get_removed_count();
+    std::vector<roll_ids> ids;
+    read_lock::line_iter iter(lock, buffer.data(), buffer.size());
+    while (const line_id_impl id = iter.next(out, &timestamp, &timestamp_id.outer, &dir))
+    {
+        if (skip.find(id.offset) != skip.end())
+        {
+            ++deleted;
             continue;
+        }
 
-        callback(path, local);
+        const uint32 time = timestamp.empty() ? 0 : strtoul(timestamp.c_str(), nullptr, 10);
+        archive.add(out.get_pointer(), out.length(), time, dir);
+        ids.push_back({ id, timestamp_id });
+    }
+    deleted += iter.get_deleted_count();
+
+    // Apply the limit, dropping the oldest lines.
+    const size_t total = archive.size();
+    if (limit)
+        archive.trim(limit);
+    deleted += total - archive.size();
+
+    // Split off the lines to keep in the master bank.  Lines read from the
+    // master bank are always the newest lines, so they're at the end.
+    const size_t hot = unroll ? archive.size() : min(archive.size(), c_archive_hot_lines);
+    std::vector<history_archive::entry> keep;
+    keep.reserve(hot);
+    for (size_t i = archive.size() - hot; i < archive.size(); ++i)
+        keep.push_back(archive.get(i));
+    archive.truncate(archive.size() - hot);
+
+    // Write the archive before rewriting the master bank, so that an error or
+    // interruption can at worst duplicate lines, but never lose them.
+    if (!unroll && !archive.save(archive_path))
+    {
+        LOG("unable to save history archive '%s'", archive_path);
+        return false;
+    }
+
+    // Clear and write new tag.
+    concurrency_tag tag;
+    tag.generate_new_tag();
+    lock.clear();
+    lock.add_ctag(tag.get());
+
+    // Write the lines to keep.
+    str<32> time;
+    size_t master_index = ids.size();
+    for (const auto& entry : keep)
+    {
+        if (entry.ordinal == uint32(-1))
+            --master_index;
+    }
+    for (const auto& entry : keep)
+    {
+        time.clear();
+        if (entry.time)
+            time.format("%u", entry.time);
+
+        line_id_impl new_timestamp;
+        const line_id_impl new_line = lock.add_line(archive.get_text(entry), int32(entry.length), time.empty() ? nullptr : time.c_str(), &new_timestamp, entry.dir);
+
+        if (entry.ordinal == uint32(-1))
+        {
+            const roll_ids& old = ids[master_index++];
+            if (remap)
+            {
+                if (old.m_timestamp.outer && new_timestamp.outer)
+                    remap->emplace(old.m_timestamp.outer, new_timestamp.outer);
+                remap->emplace(old.m_line.outer, new_line.outer);
+            }
+        }
     }
+
+    if (unroll)
+        archive.save(archive_path);
+
+    if (_archived)
+        *_archived = archive.size();
+    if (_kept)
+        *_kept = keep.size();
+    if (_deleted)
+        *_deleted = deleted;
+    return true;
 }
 
+
+
 //------------------------------------------------------------------------------
-bool history_db::is_valid() const
+// Compacts the master bank on a worker thread.  The master bank is indexed in
+// chunks and the bank lock is released between chunks, so other sessions are
+// only blocked briefly.  Only the final step holds the lock exclusively:  it
+// picks up lines appended in the meantime and rewrites the bank in one write
+// from the lines collected so far.
+class history_compactor
+    : public no_copy
 {
-    return !m_path.empty();
+public:
+                            history_compactor(const history_db& db, size_t limit);
+                            ~history_compactor();
+    bool                    is_finished() const { return m_finished; }
+
+private:
+    static void             proc(history_compactor* c);
+    void                    run();
+    bool                    collect(const history_mapped_view& view, uint32 max_bytes);
+    void                    rewrite(write_lock& lock, const history_mapped_view& view);
+    const history_db&       m_db;
+    const size_t            m_limit;
+    history_index           m_index;
+    str<64>                 m_ctag;
+    std::vector<char>       m_text;             // Line text, NUL, timestamp text, NUL.
+    std::vector<uint32>     m_text_offsets;     // Parallel to m_index entries.
+    std::unique_ptr<std::thread> m_thread;
+    volatile bool           m_cancel = false;
+    volatile bool           m_finished = false;
+
+    static const uint32     c_chunk_size = 256 * 1024;
+};
+
+//------------------------------------------------------------------------------
+history_compactor::history_compactor(const history_db& db, size_t limit)
+: m_db(db)
+, m_limit(limit)
+{
+    dbg_ignore_scope(snapshot, "History compactor thread");
+    m_thread = std::make_unique<std::thread>(&proc, this);
 }
 
 //------------------------------------------------------------------------------
-void history_db::get_file_path(str_base& out, bool session) const
+history_compactor::~history_compactor()
 {
-    out = m_path.c_str();
+    m_cancel = true;
+    if (m_thread)
+        m_thread->join();
+}
 
-    if (session && is_valid())
-    {
-        str<16> suffix;
-        suffix.format("_%d", m_id);
-        out << suffix;
-    }
+//------------------------------------------------------------------------------
+void history_compactor::proc(history_compactor* c)
+{
+    c->run();
+    c->m_finished = true;
 }
 
 //------------------------------------------------------------------------------
-static void __clear_history()
+void history_compactor::run()
 {
-    rl_clear_history();
-    assert(!rl_undo_list);
+    // Use a separate handle, so that the bank locks also serialize against
+    // the session that started the compaction.
+    bank_handles handles;
+    handles.m_handle_lines = open_file(m_db.m_bank_filenames[bank_master].c_str(), true/*if_exists*/);
+    if (!handles)
+        return;
 
-    history_prev_use_curr = 0;
+    LOG("History:  background compact started");
 
-    free(const_cast<char*>(history_event_lookup_cache.search_string));
-    memset(&history_event_lookup_cache, 0, sizeof(history_event_lookup_cache));
+    bool ok = true;
+    while (ok && !m_cancel)
+    {
+        read_lock lock(handles);
+        history_mapped_view view;
+        if (!lock || !view.map(lock.get_lines_handle()) || !collect(view, c_chunk_size))
+            ok = false;
+        else if (m_index.indexed_size() >= view.size())
+            break;
+    }
 
-#ifdef UNDO_LIST_HEAP_DIAGNOSTICS
-    clink_check_undo_entry_leaks();
-#endif
+    if (ok && !m_cancel)
+    {
+        write_lock lock(handles);
+        history_mapped_view view;
+        if (lock && view.map(lock.get_lines_handle()) && collect(view, 0))
+            rewrite(lock, view);
+        else
+            ok = false;
+    }
+
+    if (!ok)
+        LOG("History:  background compact abandoned");
+
+    handles.close();
 }
 
 //------------------------------------------------------------------------------
-void history_db::load_internal()
+bool history_compactor::collect(const history_mapped_view& view, uint32 max_bytes)
 {
-    __clear_history();
-    m_index_map.clear();
-    m_master_len = 0;
-    m_master_deleted_count = 0;
+    // Give up if the bank has been rewritten since compaction started (e.g.
+    // another session compacted or cleared it).
+    str<64> ctag;
+    history_index::get_ctag(view, ctag);
+    if (ctag.empty())
+        return false;
+    if (m_ctag.empty())
+        m_ctag = ctag.c_str();
+    else if (!m_ctag.equals(ctag.c_str()))
+        return false;
 
-    history_read_buffer buffer;
+    // Syncing drops an unterminated last line and scans it again, so its
+    // text must be copied again too.
+    uint32 first = m_index.count();
+    if (first)
+    {
+        const history_index::entry& back = m_index.get(first - 1);
+        if (back.offset + back.length == m_index.indexed_size())
+        {
+            --first;
+            m_text.resize(m_text_offsets[first]);
+            m_text_offsets.pop_back();
+        }
+    }
 
-    DIAG("... loading history\n");
+    const bool had_entries = !!m_index.count();
+    if (m_index.sync(view, max_bytes) && had_entries)
+        return false;
 
-    const history_db& const_this = *this;
-    const_this.for_each_bank([&] (uint32 bank_index, const read_lock& lock)
+    // The view is only valid while the lock is held, so copy the text of the
+    // newly indexed lines.
+    str<32> time;
+    for (uint32 i = first; i < m_index.count(); ++i)
     {
-        DIAG("... ... %s bank", bank_index == bank_master ? "master" : "session");
+        const history_index::entry& entry = m_index.get(i);
+        m_text_offsets.push_back(uint32(m_text.size()));
+        if (m_index.is_removed(i))
+            continue;
 
-        if (bank_index == bank_master)
-        {
-            m_master_ctag.clear();
-            extract_ctag(lock, m_master_ctag);
-        }
+        const char* line = view.data() + entry.offset;
+        m_text.insert(m_text.end(), line, line + entry.length);
+        m_text.push_back('\0');
+        if (history_index::get_timestamp(view, entry, time))
+            m_text.insert(m_text.end(), time.c_str(), time.c_str() + time.length());
+        m_text.push_back('\0');
+    }
 
-        // Subtract 1 from the size to accommodate the forced NUL termination
-        // prior to calling add_history.
-        read_lock::line_iter iter(lock, buffer.data(), buffer.size() - 1);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void history_compactor::rewrite(write_lock& lock, const history_mapped_view& view)
+{
+    // Collect deferred removals before rewriting; they are translated to the
+    // new line ids afterwards, the same as in history_db::compact().
+    std::vector<removal_file_data> removals_files;
+    m_db.collect_removals_files(lock, removals_files);
 
-        dbg_snapshot_heap(snapshot);
+    // Lines may have been removed in place while the lock was released.
+    std::vector<uint32> keep;
+    keep.reserve(m_index.count());
+    for (uint32 i = 0; i < m_index.count(); ++i)
+    {
+        if (!m_index.test_removed(i, view))
+            keep.push_back(i);
+    }
 
-        str_iter out;
-        str<32> time;
-        line_id_impl id;
-        uint32 num_lines = 0;
-        while (id = iter.next(out, &time))
-        {
-            const char* line = out.get_pointer();
-            int32 buffer_offset = int32(line - buffer.data());
-            buffer.data()[buffer_offset + out.length()] = '\0';
-            add_history(line);
-            if (!time.empty())
-                add_history_time(time.c_str());
+    size_t start = 0;
+    if (0 < m_limit && m_limit < keep.size())
+        start = keep.size() - m_limit;
 
-            num_lines++;
+    // Build the new bank in memory, so that it can be written in one go.
+    concurrency_tag tag;
+    tag.generate_new_tag();
 
-            id.bank_index = bank_index;
-            m_index_map.push_back(id.outer);
-            if (bank_index == bank_master)
-            {
-                //LOG("load:  bank %u, offset %u, active %u:  '%s', len %u", id.bank_index, id.offset, id.active, line, out.length());
-                m_master_len = m_index_map.size();
-            }
-        }
+    std::vector<char> out;
+    out.reserve(m_text.size() + tag.size());
+    auto append = [&out] (const char* text, size_t len) {
+        const uint32 offset = uint32(out.size());
+        out.insert(out.end(), text, text + len);
+        out.push_back('\n');
+        return (offset >= c_max_line_id.offset) ? c_max_line_id : line_id_impl(offset);
+    };
 
-        dbg_ignore_since_snapshot(snapshot, "History");
+    append(tag.get(), strlen(tag.get()));
 
-        if (bank_index == bank_master)
-            m_master_deleted_count = iter.get_deleted_count();
+    str<> timestamp;
+    std::map<line_id_impl, line_id_impl> remap_removals;
+    for (size_t ii = start; ii < keep.size(); ++ii)
+    {
+        const history_index::entry& entry = m_index.get(keep[ii]);
+        const char* line = m_text.data() + m_text_offsets[keep[ii]];
+        const char* time = line + entry.length + 1;
+        if (entry.dir)
+        {
+            timestamp.format("|\tdir=%06x", entry.dir);
+            append(timestamp.c_str(), timestamp.length());
+        }
+        if (*time)
+        {
+            timestamp.format("|\ttime=%s", time);
+            const line_id_impl id = append(timestamp.c_str(), timestamp.length());
+            if (entry.time_offset)
+                remap_removals.emplace(line_id_impl(entry.time_offset), id);
+        }
+        remap_removals.emplace(line_id_impl(entry.offset), append(line, entry.length));
+    }
 
-        DIAG(":  lines active %u / deleted %u\n", num_lines, iter.get_deleted_count());
+    lock.clear();
+    lock.append_bytes(out.data(), uint32(out.size()));
 
-        return true;
-    });
+    rewrite_removals_files(removals_files, remap_removals, tag.get());
+    m_db.publish_change();
 
-    DIAG("... total lines active %zu\n", m_index_map.size());
+    LOG("Compacted history in background:  %zu active, %zu deleted", keep.size() - start, size_t(m_index.count()) - keep.size() + start);
 }
 
 //------------------------------------------------------------------------------
-void history_db::load_rl_history(bool can_clean)
+void history_db::start_background_compact(size_t limit)
 {
-    if (!is_valid())
-        return;
-
-    load_internal();
-
-    // The `clink history` command needs to be able to avoid cleaning the master
-    // history file.
-    if (can_clean && m_use_master_bank)
+    if (m_compactor)
     {
-        if (compact())
-            load_internal();
+        // If a background compaction just finished, the history was loaded
+        // before it finished; the next load will see the compacted bank.
+        const bool finished = m_compactor->is_finished();
+        DIAG("... compact:  %s in background\n", finished ? "already compacted" : "already compacting");
+        if (finished)
+            m_compactor.reset();
+        return;
     }
+
+    DIAG("... compact:  rewrite master bank in background\n");
+    m_compactor = std::make_unique<history_compactor>(*this, limit);
 }
 
 //------------------------------------------------------------------------------
-void history_db::clear()
+void history_db::convert_master_bank()
 {
-    if (!is_valid())
+    bank_handles master_handles = get_bank(bank_master);
+    master_handles.m_handle_removals = nullptr; // Don't redirect removals.
+    write_lock dest(master_handles);
+    if (!dest || dest.is_binary() == m_binary_format)
         return;
 
-    DIAG("... clearing history\n");
+    DIAG("... convert master bank to %s format\n", m_binary_format ? "binary" : "text");
 
-    for_each_bank([&] (uint32 bank_index, write_lock& lock)
-    {
-        DIAG("... ... %s bank\n", bank_index == bank_master ? "master" : "session");
+    // Rewriting the master bank writes it in the configured format.  Deferred
+    // removals are translated to the new line ids, the same as in compact().
+    std::vector<removal_file_data> removals_files;
+    collect_removals_files(dest, removals_files);
 
-        lock.clear();
-        if (bank_index == bank_master)
-        {
-            m_master_ctag.clear();
-            m_master_ctag.generate_new_tag();
-            lock.add(m_master_ctag.get());
-        }
-        return true;
-    });
+    size_t kept, deleted;
+    std::map<line_id_impl, line_id_impl> remap_removals;
+    rewrite_master_bank(dest, 0, &kept, &deleted, false, nullptr, &remap_removals);
 
-    m_index_map.clear();
-    m_master_len = 0;
-    m_master_deleted_count = 0;
+    m_master_ctag.clear();
+    extract_ctag(dest, m_master_ctag);
+
+    rewrite_removals_files(removals_files, remap_removals, m_master_ctag.get());
+    publish_change();
+
+    LOG("Converted history to %s format:  %zu active, %zu deleted", m_binary_format ? "binary" : "text", kept, deleted);
 }
 
 //------------------------------------------------------------------------------
@@ -1592,6 +3662,15 @@ bool history_db::compact(bool force, bool uniq, int32 _limit)
     if (limit > c_max_max_history_lines)
         limit = c_max_max_history_lines;
 
+    // Compacting rolls the master bank into the archive when the archive is
+    // enabled, and moves archived lines back into the master bank when it's
+    // disabled.  Removing duplicates only applies to the master bank.
+    str<280> archive_path;
+    get_archive_path(archive_path);
+    const bool archive = g_archive.get();
+    const bool has_archive = (m_archive_len || (force && os::get_path_type(archive_path.c_str()) == os::path_type_file));
+    bool roll = false;
+
     // When force is true, load_internal() was not called, so m_master_len is 0,
     // this loop can't remove entries, and rewrite_master_bank() does instead.
     if (limit > 0 && !force)
@@ -1608,6 +3687,12 @@ bool history_db::compact(bool force, bool uniq, int32 _limit)
             {
                 line_id_impl id;
                 id.outer = m_index_map[0];
+                if (id.bank_index == c_bank_archive)
+                {
+                    // Rolling the archive applies the limit.
+                    roll = true;
+                    break;
+                }
                 if (id.bank_index != bank_master)
                 {
                     LOG("tried to trim from non-master bank");
@@ -1630,76 +3715,70 @@ bool history_db::compact(bool force, bool uniq, int32 _limit)
     // Since the ratio of deleted lines to active lines is already known here,
     // this is the most convenient/performant place to compact the master bank.
     size_t threshold = (limit ? max(limit, m_min_compact_threshold) : 5000);
-    if (!(force || m_master_deleted_count > threshold))
+    if (uniq)
+        roll = false;
+    else if (archive)
+        roll = roll || (m_master_len - m_archive_len > c_archive_roll_lines);
+    else
+        roll = has_archive;
+    if (!(force || roll || m_master_deleted_count > threshold))
     {
         DIAG("... skip compact; threshold is %zu, actual marked for delete is %zu\n", threshold, m_master_deleted_count);
         return false;
     }
 
-    DIAG("... compact:  rewrite master bank\n");
+    if (archive && !uniq)
+        roll = true;
+
+    if (!force && !uniq && !roll && !m_binary_format && g_background_compact.get())
+    {
+        start_background_compact(limit);
+        return false;
+    }
+
+    DIAG("... compact:  %s master bank\n", !roll ? "rewrite" : archive ? "roll" : "unroll");
 
-    size_t kept, deleted, dups;
+    size_t kept, deleted, dups, archived;
     assert(!m_master_ctag.empty());
 
     bank_handles master_handles = get_bank(bank_master);
     master_handles.m_handle_removals = nullptr; // Don't redirect removals.
     write_lock dest(master_handles);
 
-    struct removal_file_data
-    {
-        str_moveable                m_file;
-        std::vector<line_id_impl>   m_lines;
-    };
-
-    std::vector<removal_file_data> removals_files;
-    str_moveable removals;
-
     // Collect line ids from all removals files that match the current
     // master.  After the master bank gets a new concurreny tag the
     // collected line ids will be translated to their corresponding new ids
     // and written back to the respective removals files with the updated
     // concurrency tag.
-    for_each_session([&](str_base& path, bool local)
-    {
-        if (m_use_master_bank)
-        {
-            removals = path.c_str();
-            removals << ".removals";
-
-            if (os::get_file_size(path.c_str()) > 0 ||
-                os::get_file_size(removals.c_str()) > 0)
-            {
-                bank_handles compact_handles;
-                compact_handles.m_handle_lines = open_file(path.c_str());
-                compact_handles.m_handle_removals = open_file(removals.c_str(), true/*if_exists*/);
-
-                if (compact_handles.m_handle_removals)
-                {
-                    DIAG("... compact:  apply removals from '%s'\n", removals.c_str());
-
-                    // WARNING: ALWAYS LOCK MASTER BEFORE SESSION!
-                    read_lock src(compact_handles);
-                    if (src && dest)
-                    {
-                        removal_file_data data;
-                        if (src.collect_removals(dest, data.m_lines) > 0)
-                        {
-                            data.m_file = std::move(removals);
-                            removals_files.emplace_back(std::move(data));
-                        }
-                    }
-                }
-
-                compact_handles.close();
-            }
-        }
-    });
+    std::vector<removal_file_data> removals_files;
+    collect_removals_files(dest, removals_files);
 
     // Rewrite the master bank and apply the limit (if any).  This may also
     // optionally enforce uniqueness.  The result counters are written to
     // the log file.
     std::map<line_id_impl, line_id_impl> remap_removals;
-    rewrite_master_bank(dest, limit, &kept, &deleted, uniq, &dups, &remap_removals);
+    bank_handles temp;
+    if (uniq)
+    {
+        // Removing duplicates streams the lines through a temporary bank, to
+        // avoid holding all of the lines in memory.
+        str<280> temp_path;
+        temp_path.format("%s.%u", m_bank_filenames[bank_master].c_str(), GetCurrentProcessId());
+        wstr<280> wtemp_path(temp_path.c_str());
+        temp.m_handle_lines = CreateFileW(wtemp_path.c_str(), GENERIC_READ|GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                                          FILE_ATTRIBUTE_TEMPORARY|FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+        if (temp.m_handle_lines == INVALID_HANDLE_VALUE)
+            temp.m_handle_lines = nullptr;
+        temp.m_binary = master_handles.m_binary;
+    }
+
+    if (temp)
+        rewrite_master_bank_uniq(dest, temp, limit, removals_files, &kept, &deleted, &dups, &remap_removals);
+    else if (!roll)
+        rewrite_master_bank(dest, limit, &kept, &deleted, uniq, &dups, &remap_removals);
+    else if (!roll_master_bank(dest, archive_path.c_str(), limit, !archive, removals_files, &archived, &kept, &deleted, &remap_removals))
+        return false;
+    temp.close();
 
     // Extract the new master concurrency tag.
     str<64> old_ctag(m_master_ctag.get());
@@ -1709,32 +3788,15 @@ bool history_db::compact(bool force, bool uniq, int32 _limit)
 
     // Rewrite each removals files with the new master concurrency tag and
     // the translated line ids.
-    str<64> tmp;
-    DWORD written;
-    for (const auto& r : removals_files)
-    {
-        assert(os::get_path_type(r.m_file.c_str()) == os::path_type_file);
-        void* handle = make_removals_file(r.m_file.c_str(), m_master_ctag.get());
-
-        // Truncate file immedately after the ctag to keep the file in a
-        // consistent state even while being rewritten.
-        SetEndOfFile(handle);
-
-        // Look up the ids and write the new ids for ones that were kept.
-        for (const auto& id : r.m_lines)
-        {
-            const auto iter = remap_removals.find(id);
-            if (iter != remap_removals.end())
-            {
-                tmp.format("%u\n", iter->second.offset);
-                WriteFile(handle, tmp.c_str(), tmp.length(), &written, nullptr);
-            }
-        }
+    rewrite_removals_files(removals_files, remap_removals, m_master_ctag.get());
+    publish_change();
 
-        CloseHandle(handle);
+    if (roll)
+    {
+        LOG("Compacted history:  %zu archived, %zu active, %zu deleted", archived, kept, deleted);
+        DIAG("... ... lines archived %zu / active %zu / purged %zu\n", archived, kept, deleted);
     }
-
-    if (uniq)
+    else if (uniq)
     {
         LOG("Compacted history:  %zu active, %zu deleted, %zu duplicates removed", kept, deleted, dups);
         DIAG("... ... lines active %zu / purged %zu / duplicates removed %zu\n", kept, deleted, dups);
@@ -1775,24 +3837,107 @@ bool history_db::add(const char* line)
     if (!lock)
         return false;
 
+    str<32> timestamp;
+    if (g_history_timestamp.get() > 0)
+        timestamp.format("%u", time(0));
+
+    str<> cwd;
+    if (g_save_dir.get())
+        os::get_current_dir(cwd);
+
+    lock.add_line(line, -1, timestamp.c_str(), nullptr, hash_dir(cwd.c_str()));
+    if (get_active_bank() == bank_master)
+        publish_add();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Adds each line in TEXT (separated by newlines) while holding a single write
+// lock, which is much faster than adding them one at a time.  Unlike add(),
+// this doesn't handle duplicates; 'history compact --unique' can remove them.
+// Returns the number of lines added.
+uint32 history_db::add_lines(const char* text, uint32 length)
+{
+    write_lock lock(get_bank(get_active_bank()));
+    if (!lock)
+        return 0;
+
+    str<32> timestamp;
     if (g_history_timestamp.get() > 0)
+        timestamp.format("%u", time(0));
+
+    // The text format is written in large blocks instead of per line.
+    const bool binary = lock.is_binary();
+    const uint32 c_block_size = 64 * 1024;
+    str_moveable block;
+
+    const bool ignore_space = g_ignore_space.get();
+    const char* const end = text + length;
+    uint32 count = 0;
+    for (const char* walk = text; walk < end;)
     {
-        str<32> timestamp;
-        const time_t now = time(0);
-        timestamp.format("|\ttime=%u", now);
-        lock.add(timestamp.c_str());
+        const char* eol = static_cast<const char*>(memchr(walk, '\n', end - walk));
+        if (!eol)
+            eol = end;
+
+        uint32 len = uint32(eol - walk);
+        if (len && walk[len - 1] == '\r')
+            --len;
+
+        if (len && !(ignore_space && (walk[0] == ' ' || walk[0] == '\t')))
+        {
+            if (binary)
+            {
+                lock.add_line(walk, len, timestamp.c_str());
+            }
+            else
+            {
+                if (!timestamp.empty())
+                {
+                    block.concat("|\ttime=");
+                    block.concat(timestamp.c_str(), timestamp.length());
+                    block.concat("\n");
+                }
+                block.concat(walk, len);
+                block.concat("\n");
+                if (block.length() >= c_block_size)
+                {
+                    lock.append_bytes(block.c_str(), block.length());
+                    block.clear();
+                }
+            }
+            ++count;
+        }
+
+        walk = eol + 1;
     }
 
-    lock.add(line);
-    return true;
+    if (!block.empty())
+        lock.append_bytes(block.c_str(), block.length());
+
+    if (count && get_active_bank() == bank_master)
+        publish_add();
+    return count;
 }
 
 //------------------------------------------------------------------------------
 int32 history_db::remove(const char* line)
 {
     int32 count = 0;
-    for_each_bank([line, &count] (uint32 index, write_lock& lock)
+    for_each_bank([this, line, &count] (uint32 index, write_lock& lock)
     {
+        const bool mapped = find_mapped(index, lock, line, [&] (line_id_impl id) {
+            // The line id was retrieved inside this lock scope, so it's still
+            // valid.  The mapped view is coherent with writes to the file, and
+            // in-place removals are noticed by the index the next time it's
+            // used.
+            lock.remove(id);
+            count++;
+            return true;
+        });
+        if (mapped)
+            return true;
+
         lock.find(line, [&] (line_id_impl id) {
             // The line id was retrieved inside this lock scope, so it's still
             // valid; no need to guard the ctag.
@@ -1819,6 +3964,9 @@ bool history_db::remove_internal(line_id id, bool guard_ctag)
     line_id_impl id_impl;
     id_impl.outer = id;
 
+    if (id_impl.bank_index == c_bank_archive)
+        return remove_archived(id);
+
     write_lock lock(get_bank(id_impl.bank_index));
     if (!lock)
     {
@@ -1846,10 +3994,14 @@ bool history_db::remove_internal(line_id id, bool guard_ctag)
 
     if (id_impl.bank_index == bank_master)
     {
+        publish_change();
+
+        auto first = m_index_map.begin() + m_archive_len;
         auto last = m_index_map.begin() + m_master_len;
-        auto nth = std::lower_bound(m_index_map.begin(), last, id);
+        auto nth = std::lower_bound(first, last, id);
         if (nth != last && id == *nth)
         {
+            m_dir_index->erase(nth - m_index_map.begin());
             m_index_map.erase(nth);
             --m_master_len;
             ++m_master_deleted_count;
@@ -1862,7 +4014,10 @@ bool history_db::remove_internal(line_id id, bool guard_ctag)
         auto first = m_index_map.begin() + m_master_len;
         auto nth = std::lower_bound(first, m_index_map.end(), id);
         if (nth != m_index_map.end() && id == *nth)
+        {
+            m_dir_index->erase(nth - m_index_map.begin());
             m_index_map.erase(nth);
+        }
         else
             assert(m_index_map.empty()); // Index map is empty when using `clink history delete`.
     }
@@ -1870,6 +4025,50 @@ bool history_db::remove_internal(line_id id, bool guard_ctag)
     return true;
 }
 
+//------------------------------------------------------------------------------
+// Archived lines are immutable, so removing one is recorded in the archive's
+// removals file, and the line is dropped when the archive is next rolled.
+bool history_db::remove_archived(line_id id)
+{
+    line_id_impl id_impl;
+    id_impl.outer = id;
+
+    // Locking the master bank serialises removals with rolling the archive.
+    bank_handles master_handles = get_bank(bank_master);
+    master_handles.m_handle_removals = nullptr;
+    write_lock lock(master_handles);
+    if (!lock)
+    {
+        ERR("couldn't lock");
+        return false;
+    }
+
+    str<280> path;
+    get_archive_path(path);
+    if (!history_archive::remove(path.c_str(), m_archive_tag, id_impl.offset))
+    {
+        LOG("archive changed; couldn't remove archived line %u", id_impl.offset);
+        return false;
+    }
+
+    publish_change();
+
+    auto last = m_index_map.begin() + m_archive_len;
+    auto nth = std::lower_bound(m_index_map.begin(), last, id);
+    if (nth != last && id == *nth)
+    {
+        m_dir_index->erase(nth - m_index_map.begin());
+        m_index_map.erase(nth);
+        --m_archive_len;
+        --m_master_len;
+        ++m_master_deleted_count;
+    }
+    else
+        assert(m_index_map.empty()); // Index map is empty when using `clink history delete`.
+
+    return true;
+}
+
 //------------------------------------------------------------------------------
 void history_db::make_open_error(str_base* error_message, bank_t bank) const
 {
@@ -1921,9 +4120,15 @@ history_db::line_id history_db::find(const char* line) const
 {
     line_id_impl ret;
 
-    for_each_bank([line, &ret] (uint32 index, const read_lock& lock)
+    for_each_bank([this, line, &ret] (uint32 index, const read_lock& lock)
     {
-        if (ret = lock.find(line))
+        const bool mapped = find_mapped(index, lock, line, [&] (line_id_impl id) {
+            ret = id;
+            return false;
+        });
+        if (!mapped)
+            ret = lock.find(line);
+        if (ret)
             ret.bank_index = index;
         return !ret;
     });
@@ -1931,6 +4136,21 @@ history_db::line_id history_db::find(const char* line) const
     return ret.outer;
 }
 
+//------------------------------------------------------------------------------
+// Returns the Readline history indices of the loaded history entries that were
+// entered in DIR, oldest first, or nullptr if there are none.  Lines added
+// since the history was last loaded aren't included.
+const std::vector<int32>* history_db::find_dir_entries(const char* dir) const
+{
+    return m_dir_index->find(hash_dir(dir));
+}
+
+//------------------------------------------------------------------------------
+uint32 history_db::hash_dir(const char* dir)
+{
+    return history_dir_index::hash_dir(dir);
+}
+
 //------------------------------------------------------------------------------
 history_db::expand_result history_db::expand(const char* line, str_base& out)
 {
@@ -1971,6 +4191,26 @@ history_db::iter history_db::read_lines(char* buffer, uint32 size)
     return ret;
 }
 
+//------------------------------------------------------------------------------
+history_db::iter history_db::read_lines_reverse(char* buffer, uint32 size)
+{
+    iter ret;
+    if (size > sizeof(read_line_iter))
+        ret.impl = uintptr_t(new (buffer) read_line_iter(*this, size, true/*reverse*/));
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+history_db::iter history_db::read_lines_in_range(char* buffer, uint32 size, time_t since, time_t until)
+{
+    iter ret;
+    if (size > sizeof(read_line_iter))
+        ret.impl = uintptr_t(new (buffer) read_line_iter(*this, size, since, until));
+
+    return ret;
+}
+
 //------------------------------------------------------------------------------
 bool history_db::has_bank(bank_t bank) const
 {
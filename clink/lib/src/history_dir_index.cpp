@@ -0,0 +1,110 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "history_dir_index.h"
+
+#include <core/base.h>
+#include <core/path.h>
+#include <core/str.h>
+#include <core/str_hash.h>
+#include <core/str_transform.h>
+
+//------------------------------------------------------------------------------
+void history_dir_index::clear()
+{
+    m_dirs.clear();
+    m_entries.clear();
+    m_built = false;
+}
+
+//------------------------------------------------------------------------------
+void history_dir_index::push_back(uint32 dir)
+{
+    m_dirs.push_back(dir);
+    if (m_built && dir)
+        m_entries[dir].push_back(int32(m_dirs.size() - 1));
+}
+
+//------------------------------------------------------------------------------
+void history_dir_index::erase(size_t index)
+{
+    if (index >= m_dirs.size())
+        return;
+
+    // Removing an entry shifts the indices of every entry after it, so the map
+    // is rebuilt on the next query.
+    m_dirs.erase(m_dirs.begin() + index);
+    m_entries.clear();
+    m_built = false;
+}
+
+//------------------------------------------------------------------------------
+// Returns the indices of the history entries entered in the directory DIR (a
+// hash from hash_dir()), oldest first, or nullptr if there are none.
+const std::vector<int32>* history_dir_index::find(uint32 dir) const
+{
+    if (!dir)
+        return nullptr;
+
+    if (!m_built)
+        build();
+
+    const auto it = m_entries.find(dir);
+    return (it != m_entries.end()) ? &it->second : nullptr;
+}
+
+//------------------------------------------------------------------------------
+// Returns a 24 bit hash of DIR (so that it fits in a binary record header), or
+// 0 if DIR is empty.  Directories are compared caselessly and without trailing
+// separators.  The hash is stored in history banks, so it must never change.
+uint32 history_dir_index::hash_dir(const char* dir)
+{
+    if (!dir || !*dir)
+        return 0;
+
+    str<280> normalised(dir);
+    path::normalise(normalised);
+
+    wstr<280> wdir(normalised.c_str());
+    wstr<280> folded;
+    str_transform(wdir.c_str(), wdir.length(), folded, transform_mode::lower);
+    path::maybe_strip_last_separator(folded);
+
+    const uint32 hash = wstr_hash(folded.c_str(), folded.length());
+    const uint32 dir_hash = (hash ^ (hash >> 24)) & 0xffffff;
+    return dir_hash ? dir_hash : 1;
+}
+
+//------------------------------------------------------------------------------
+// Parses the hex digits of a directory hash from a "|\tdir=" line in a text
+// history bank.  TEXT is not NUL terminated, so parsing stops at END.
+uint32 history_dir_index::parse_hash(const char* text, const char* end)
+{
+    uint32 hash = 0;
+    for (; text < end; ++text)
+    {
+        const char c = *text;
+        if (c >= '0' && c <= '9')
+            hash = (hash << 4) | (c - '0');
+        else if (c >= 'a' && c <= 'f')
+            hash = (hash << 4) | (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+            hash = (hash << 4) | (c - 'A' + 10);
+        else
+            break;
+    }
+    return hash & 0xffffff;
+}
+
+//------------------------------------------------------------------------------
+void history_dir_index::build() const
+{
+    m_entries.clear();
+    for (size_t i = 0; i < m_dirs.size(); ++i)
+    {
+        if (m_dirs[i])
+            m_entries[m_dirs[i]].push_back(int32(i));
+    }
+    m_built = true;
+}
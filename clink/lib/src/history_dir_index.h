@@ -0,0 +1,38 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <core/base.h>
+
+#include <unordered_map>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Index of the directories where history entries were entered.  Each history
+// line records a hash of the current directory at the time it was added (see
+// hash_dir()), and the index keeps the hash for each loaded history entry, in
+// the same order as history_db's index map (and Readline's history list).
+//
+// The directory => entries map is built on the first query after entries are
+// removed, and is extended incrementally as entries are appended.
+class history_dir_index
+    : public no_copy
+{
+public:
+    void                clear();
+    void                push_back(uint32 dir);
+    void                erase(size_t index);
+    size_t              size() const { return m_dirs.size(); }
+    uint32              get(size_t index) const { return index < m_dirs.size() ? m_dirs[index] : 0; }
+    const std::vector<int32>* find(uint32 dir) const;
+
+    static uint32       hash_dir(const char* dir);
+    static uint32       parse_hash(const char* text, const char* end);
+
+private:
+    void                build() const;
+    std::vector<uint32> m_dirs;
+    mutable std::unordered_map<uint32, std::vector<int32>> m_entries;
+    mutable bool        m_built = false;
+};
@@ -0,0 +1,110 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "history_event_index.h"
+
+#include <core/base.h>
+
+#include <vector>
+
+extern "C" {
+#include <readline/history.h>
+}
+
+//------------------------------------------------------------------------------
+void history_event_index::clear()
+{
+    m_prefixes.clear();
+    m_trigrams.clear();
+    m_count = 0;
+    m_first = nullptr;
+    m_last = nullptr;
+    m_last_line = nullptr;
+}
+
+//------------------------------------------------------------------------------
+// Returns the index of the newest history entry at or before START that begins
+// with STRING (or contains STRING, if SUBSTRING), or not_found if there is no
+// such entry.  Returns unindexed if the caller must search the history list
+// itself (e.g. the string is too short for the trigram index).
+int32 history_event_index::find(const char* string, bool substring, int32 start)
+{
+    if (!string || !*string)
+        return unindexed;
+
+    HIST_ENTRY** list = history_list();
+    if (!list || !history_length || start < 0)
+        return not_found;
+    if (start >= history_length)
+        start = history_length - 1;
+
+    return substring ? find_substring(string, start) : find_prefix(string, start);
+}
+
+//------------------------------------------------------------------------------
+int32 history_event_index::find_prefix(const char* string, int32 start)
+{
+    HIST_ENTRY** list = history_list();
+    const size_t len = strlen(string);
+
+    int32 found = not_found;
+    m_prefixes.find(string, [&] (int32 i) {
+        if (i > start || strncmp(list[i]->line, string, len) != 0)
+            return true;
+        found = i;
+        return false;
+    }, true/*include_equal*/);
+    return found;
+}
+
+//------------------------------------------------------------------------------
+int32 history_event_index::find_substring(const char* string, int32 start)
+{
+    sync_trigrams();
+
+    std::vector<int32> candidates;
+    if (!m_trigrams.query(string, candidates))
+        return unindexed;
+
+    HIST_ENTRY** list = history_list();
+    for (auto iter = candidates.rbegin(); iter != candidates.rend(); ++iter)
+    {
+        if (*iter <= start && strstr(list[*iter]->line, string))
+            return *iter;
+    }
+    return not_found;
+}
+
+//------------------------------------------------------------------------------
+void history_event_index::sync_trigrams()
+{
+    HIST_ENTRY** list = history_list();
+    const int32 length = list ? history_length : 0;
+
+    // Anything other than appending to the history list (removing entries,
+    // replacing entries, reloading the history) requires rebuilding the index.
+    bool rebuild = (length < m_count || !m_trigrams.is_compatible());
+    if (!rebuild && m_count)
+    {
+        const HIST_ENTRY* last = list[m_count - 1];
+        rebuild = (list[0] != m_first || last != m_last || last->line != m_last_line);
+    }
+
+    if (rebuild)
+    {
+        m_trigrams.clear();
+        m_count = 0;
+    }
+
+    if (m_count == length)
+        return;
+
+    for (int32 i = m_count; i < length; ++i)
+        m_trigrams.add(i, list[i]->line);
+
+    m_count = length;
+    m_first = list[0];
+    m_last = list[length - 1];
+    m_last_line = list[length - 1]->line;
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "history_feed.h"
+
+#include <core/base.h>
+#include <core/str.h>
+#include <core/str_hash.h>
+#include <core/str_transform.h>
+#include <core/log.h>
+
+//------------------------------------------------------------------------------
+history_change_feed::history_change_feed(const char* master_path)
+{
+    // The name is derived from the master bank's path, so that only sessions
+    // sharing the same master bank share the same feed.
+    str<280> path(master_path);
+    str_ascii_tolower(path.data());
+
+    wstr<64> name;
+    name.format(L"Local\\clink_history_feed_%08x", str_hash(path.c_str(), path.length()));
+
+    // The section is zero initialized when it's created, and lives as long as
+    // any session has it open.
+    m_mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(shared_state), name.c_str());
+    if (!m_mapping)
+    {
+        LOG("unable to open history change feed; error %u", GetLastError());
+        return;
+    }
+
+    m_state = static_cast<shared_state*>(MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, sizeof(shared_state)));
+    if (!m_state)
+    {
+        LOG("unable to map history change feed; error %u", GetLastError());
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+}
+
+//------------------------------------------------------------------------------
+history_change_feed::~history_change_feed()
+{
+    if (m_state)
+        UnmapViewOfFile(m_state);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+}
+
+//------------------------------------------------------------------------------
+history_change_feed::stamp history_change_feed::get_stamp() const
+{
+    stamp s;
+    if (m_state)
+    {
+        s.adds = uint32(InterlockedCompareExchange(&m_state->adds, 0, 0));
+        s.changes = uint32(InterlockedCompareExchange(&m_state->changes, 0, 0));
+    }
+    return s;
+}
+
+//------------------------------------------------------------------------------
+void history_change_feed::publish_add()
+{
+    if (m_state)
+        InterlockedIncrement(&m_state->adds);
+}
+
+//------------------------------------------------------------------------------
+void history_change_feed::publish_change()
+{
+    if (m_state)
+        InterlockedIncrement(&m_state->changes);
+}
@@ -0,0 +1,40 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <core/base.h>
+
+//------------------------------------------------------------------------------
+// Change feed shared by all sessions that use the same master history bank.
+// Sessions publish to it whenever they change the master bank, so that other
+// sessions can tell whether lines were only appended (and load just the new
+// lines) or whether existing lines changed (and reload the whole bank).
+class history_change_feed
+    : public no_copy
+{
+public:
+    struct stamp
+    {
+        bool            operator == (const stamp& other) const { return adds == other.adds && changes == other.changes; }
+        uint32          adds = 0;
+        uint32          changes = 0;
+    };
+
+                        history_change_feed(const char* master_path);
+                        ~history_change_feed();
+    explicit            operator bool () const { return !!m_state; }
+    stamp               get_stamp() const;
+    void                publish_add();
+    void                publish_change();
+
+private:
+    struct shared_state
+    {
+        volatile LONG   adds;               // Lines appended.
+        volatile LONG   changes;            // Lines removed, or bank rewritten.
+    };
+
+    void*               m_mapping = nullptr;
+    shared_state*       m_state = nullptr;
+};
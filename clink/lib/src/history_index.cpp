@@ -0,0 +1,489 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "history_index.h"
+#include "history_dir_index.h"
+
+#include <core/base.h>
+#include <core/str.h>
+#include <core/str_hash.h>
+#include <core/log.h>
+#include <assert.h>
+
+#include <algorithm>
+
+//------------------------------------------------------------------------------
+static const char c_index_magic[8] = { 'C', 'L', 'H', 'I', 'D', 'X', 0, 0 };
+static const uint32 c_index_version = 3;
+static const uint32 c_index_ctag_size = 64;
+static const uint32 c_save_threshold = 64000;
+
+//------------------------------------------------------------------------------
+struct history_index_header
+{
+    char                magic[8];
+    uint32              version;
+    uint32              count;
+    uint32              indexed_size;
+    uint32              reserved;
+    char                ctag[c_index_ctag_size];
+};
+
+//------------------------------------------------------------------------------
+inline bool is_line_breaker(uint8 c)
+{
+    return c == 0x00 || c == 0x0a || c == 0x0d;
+}
+
+
+
+//------------------------------------------------------------------------------
+bool history_mapped_view::map(void* handle)
+{
+    unmap();
+
+    LARGE_INTEGER size;
+    if (!handle || !GetFileSizeEx(handle, &size))
+        return false;
+
+    // Bank offsets are limited to 29 bits anyway (see line_id_impl).
+    if (size.HighPart)
+        return false;
+
+    // Empty files can't be mapped, but are valid (and trivially empty).
+    m_size = size.LowPart;
+    if (!m_size)
+    {
+        m_valid = true;
+        return true;
+    }
+
+    m_mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping)
+    {
+        LOG("unable to map history bank; error %u", GetLastError());
+        m_size = 0;
+        return false;
+    }
+
+    m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_data)
+    {
+        LOG("unable to map view of history bank; error %u", GetLastError());
+        unmap();
+        return false;
+    }
+
+    m_valid = true;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void history_mapped_view::unmap()
+{
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    m_mapping = nullptr;
+    m_data = nullptr;
+    m_size = 0;
+    m_valid = false;
+}
+
+
+
+//------------------------------------------------------------------------------
+void history_index::clear()
+{
+    m_ctag.clear();
+    m_entries.clear();
+    m_tombstones.clear();
+    m_lookup.clear();
+    m_lookup_count = 0;
+    m_indexed_size = 0;
+    m_pending_time_offset = 0;
+    m_pending_dir = 0;
+    m_unsaved_bytes = c_save_threshold;
+    m_dirty = true;
+}
+
+//------------------------------------------------------------------------------
+bool history_index::load(const char* path)
+{
+    clear();
+
+    wstr<> wpath(path);
+    HANDLE h = CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_DELETE,
+                           nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+
+    bool ok = false;
+    DWORD read;
+    history_index_header header;
+    const DWORD file_size = GetFileSize(h, nullptr);
+    if (ReadFile(h, &header, sizeof(header), &read, nullptr) &&
+        read == sizeof(header) &&
+        memcmp(header.magic, c_index_magic, sizeof(c_index_magic)) == 0 &&
+        header.version == c_index_version &&
+        memchr(header.ctag, 0, sizeof(header.ctag)))
+    {
+        const DWORD entries_bytes = header.count * sizeof(entry);
+        const DWORD tombstones_bytes = (header.count + 7) / 8;
+        if (file_size == sizeof(header) + entries_bytes + tombstones_bytes)
+        {
+            m_entries.resize(header.count);
+            m_tombstones.resize(tombstones_bytes);
+            if (ReadFile(h, m_entries.data(), entries_bytes, &read, nullptr) && read == entries_bytes &&
+                ReadFile(h, m_tombstones.data(), tombstones_bytes, &read, nullptr) && read == tombstones_bytes)
+            {
+                m_ctag = header.ctag;
+                m_indexed_size = header.indexed_size;
+                m_unsaved_bytes = 0;
+                m_dirty = false;
+                ok = true;
+            }
+        }
+    }
+
+    CloseHandle(h);
+
+    if (!ok)
+    {
+        LOG("ignoring invalid history index '%s'", path);
+        clear();
+    }
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+bool history_index::save(const char* path)
+{
+    if (m_ctag.length() >= c_index_ctag_size)
+        return false;
+
+    // Write to a temporary file and then replace the index, so that other
+    // processes never see a partially written index.
+    str<280> tmp;
+    tmp.format("%s.%u", path, GetCurrentProcessId());
+
+    wstr<280> wtmp(tmp.c_str());
+    HANDLE h = CreateFileW(wtmp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_HIDDEN|FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+
+    history_index_header header = {};
+    memcpy(header.magic, c_index_magic, sizeof(c_index_magic));
+    header.version = c_index_version;
+    header.count = count();
+    header.indexed_size = m_indexed_size;
+    memcpy(header.ctag, m_ctag.c_str(), m_ctag.length());
+
+    DWORD written;
+    const DWORD entries_bytes = header.count * sizeof(entry);
+    const DWORD tombstones_bytes = DWORD(m_tombstones.size());
+    assert(tombstones_bytes == (header.count + 7) / 8);
+    bool ok = (WriteFile(h, &header, sizeof(header), &written, nullptr) && written == sizeof(header) &&
+               WriteFile(h, m_entries.data(), entries_bytes, &written, nullptr) && written == entries_bytes &&
+               WriteFile(h, m_tombstones.data(), tombstones_bytes, &written, nullptr) && written == tombstones_bytes);
+    CloseHandle(h);
+
+    wstr<280> wpath(path);
+    if (ok)
+        ok = !!MoveFileExW(wtmp.c_str(), wpath.c_str(), MOVEFILE_REPLACE_EXISTING);
+    if (!ok)
+    {
+        DeleteFileW(wtmp.c_str());
+    }
+    else
+    {
+        m_unsaved_bytes = 0;
+        m_dirty = false;
+    }
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+bool history_index::sync(const history_mapped_view& view, uint32 max_bytes)
+{
+    assert(view);
+
+    // The master bank begins with a concurrency tag, which changes whenever
+    // the bank is rewritten.  Session banks have no concurrency tag.
+    str<64> ctag;
+    get_ctag(view, ctag);
+
+    // The index can only be extended if the bank still has the same identity
+    // and has only grown since it was last indexed.  A line breaker must end
+    // the indexed region, otherwise the last indexed line has been modified.
+    bool rebuild = (!m_ctag.equals(ctag.c_str()) || view.size() < m_indexed_size);
+    if (!rebuild && m_indexed_size && !is_line_breaker(view.data()[m_indexed_size - 1]))
+    {
+        // An unterminated last line may have been completed since then, so
+        // drop its entry and scan it again.
+        if (!m_entries.empty() && m_entries.back().offset + m_entries.back().length == m_indexed_size)
+        {
+            const entry& back = m_entries.back();
+            m_indexed_size = back.time_offset ? back.time_offset : back.offset;
+            m_pending_time_offset = 0;
+            m_pending_dir = back.dir;
+            m_tombstones[(count() - 1) >> 3] &= ~(1 << ((count() - 1) & 7));
+            m_entries.pop_back();
+            if (m_lookup_count > count())
+            {
+                m_lookup.clear();
+                m_lookup_count = 0;
+            }
+            m_tombstones.resize((m_entries.size() + 7) / 8);
+            m_dirty = true;
+        }
+        else
+        {
+            rebuild = true;
+        }
+    }
+
+    if (rebuild)
+    {
+        clear();
+        m_ctag = ctag.c_str();
+    }
+
+    uint32 to = view.size();
+    if (max_bytes && to > m_indexed_size)
+    {
+        // When indexing in chunks, only index complete lines, so that the next
+        // chunk can resume where this one stopped.
+        const char* const data = view.data();
+        const uint32 limit = (to - m_indexed_size > max_bytes) ? m_indexed_size + max_bytes : to;
+        uint32 end = limit;
+        while (end > m_indexed_size && !is_line_breaker(data[end - 1]))
+            --end;
+        if (end == m_indexed_size)
+        {
+            // The line is longer than the chunk size; index the whole line.
+            // An unterminated last line is indexed too, otherwise chunking
+            // could never get past it.  The next sync scans it again.
+            end = limit;
+            while (end < to && !is_line_breaker(data[end]))
+                ++end;
+            if (end < to)
+                ++end;
+        }
+        to = end;
+    }
+
+    if (m_indexed_size < to)
+    {
+        scan(view.data(), m_indexed_size, to);
+        m_unsaved_bytes += to - m_indexed_size;
+        m_indexed_size = to;
+        m_dirty = true;
+    }
+
+    return rebuild;
+}
+
+//------------------------------------------------------------------------------
+void history_index::scan(const char* data, uint32 from, uint32 to)
+{
+    // A timestamp line and its line are written together, but indexing in
+    // chunks can still separate them.  Likewise for directory hash lines.
+    uint32 time_offset = m_pending_time_offset;
+    uint32 dir = m_pending_dir;
+    bool first_line = (from == 0);
+
+    const char* const last = data + to;
+    for (const char* start = data + from; start < last;)
+    {
+        while (start < last && is_line_breaker(*start))
+            ++start;
+        if (start >= last)
+            break;
+
+        const char* end = start;
+        while (end < last && !is_line_breaker(*end))
+            ++end;
+
+        const uint32 offset = uint32(start - data);
+        const uint32 length = uint32(end - start);
+
+        const bool was_first_line = first_line;
+        first_line = false;
+
+        if (*start == '|')
+        {
+            // The first line is the concurrency tag (if present).
+            if (was_first_line && length >= 6 && strncmp(start, "|CTAG_", 6) == 0)
+            {
+                time_offset = 0;
+                dir = 0;
+            }
+            else if (length > 6 && strncmp(start, "|\tdir=", 6) == 0)
+            {
+                dir = history_dir_index::parse_hash(start + 6, end);
+            }
+            else if (length >= 7 && strncmp(start, "|\ttime=", 7) == 0)
+            {
+                time_offset = offset;
+            }
+            else
+            {
+                // Removed line; index it but tombstone it.
+                m_entries.push_back({ offset, length, 0, 0, 0 });
+                m_tombstones.resize((m_entries.size() + 7) / 8);
+                set_removed(count() - 1);
+                time_offset = 0;
+                dir = 0;
+            }
+        }
+        else
+        {
+            m_entries.push_back({ offset, length, time_offset, hash(start, length), dir });
+            m_tombstones.resize((m_entries.size() + 7) / 8);
+            time_offset = 0;
+            dir = 0;
+        }
+
+        start = end;
+    }
+
+    m_pending_time_offset = time_offset;
+    m_pending_dir = dir;
+}
+
+//------------------------------------------------------------------------------
+bool history_index::needs_save() const
+{
+    // Avoid rewriting the whole index every time a few lines are appended;
+    // a small unindexed tail is cheap to scan.
+    return m_dirty && m_unsaved_bytes >= c_save_threshold;
+}
+
+//------------------------------------------------------------------------------
+void history_index::get_ctag(const history_mapped_view& view, str_base& out)
+{
+    out.clear();
+
+    const char* const data = view.data();
+    const uint32 size = view.size();
+    if (size < 6 || strncmp(data, "|CTAG_", 6) != 0)
+        return;
+
+    uint32 len = 6;
+    while (len < size && !is_line_breaker(data[len]))
+        ++len;
+    out.concat(data, len);
+}
+
+//------------------------------------------------------------------------------
+void history_index::get_line(const history_mapped_view& view, const entry& e, str_base& out)
+{
+    out.clear();
+    out.concat(view.data() + e.offset, e.length);
+}
+
+//------------------------------------------------------------------------------
+bool history_index::get_timestamp(const history_mapped_view& view, const entry& e, str_base& out)
+{
+    out.clear();
+    if (!e.time_offset)
+        return false;
+
+    const char* const last = view.data() + view.size();
+    const char* start = view.data() + e.time_offset + 7;
+    const char* end = start;
+    while (end < last && !is_line_breaker(*end))
+        ++end;
+    out.concat(start, int32(end - start));
+    return !out.empty();
+}
+
+//------------------------------------------------------------------------------
+bool history_index::matches(const history_mapped_view& view, const entry& e, const char* line, uint32 length)
+{
+    return (e.length == length && memcmp(view.data() + e.offset, line, length) == 0);
+}
+
+//------------------------------------------------------------------------------
+uint32 history_index::hash(const char* line, uint32 length)
+{
+    return length ? str_hash(line, length) : 0;
+}
+
+//------------------------------------------------------------------------------
+void history_index::update_lookup()
+{
+    // The lookup is built from the hashes stored in the entries, so building
+    // it never needs to touch the bank file itself.
+    const uint32 num = count();
+    if (m_lookup_count >= num)
+        return;
+
+    m_lookup.reserve(num);
+    for (uint32 i = m_lookup_count; i < num; ++i)
+    {
+        if (!is_removed(i))
+            m_lookup.emplace(m_entries[i].hash, i);
+    }
+    m_lookup_count = num;
+}
+
+//------------------------------------------------------------------------------
+void history_index::get_candidates(uint32 hash, std::vector<uint32>& out)
+{
+    update_lookup();
+
+    out.clear();
+    const auto range = m_lookup.equal_range(hash);
+    for (auto iter = range.first; iter != range.second;)
+    {
+        // Prune entries that have been removed, so the lookup doesn't keep
+        // growing with duplicates that erase_prev has already removed.
+        if (is_removed(iter->second))
+        {
+            iter = m_lookup.erase(iter);
+            continue;
+        }
+        out.push_back(iter->second);
+        ++iter;
+    }
+
+    std::sort(out.begin(), out.end());
+}
+
+//------------------------------------------------------------------------------
+bool history_index::is_removed(uint32 index) const
+{
+    assert(index < count());
+    return !!(m_tombstones[index >> 3] & (1 << (index & 7)));
+}
+
+//------------------------------------------------------------------------------
+bool history_index::test_removed(uint32 index, const history_mapped_view& view)
+{
+    if (is_removed(index))
+        return true;
+
+    // Removals are written in place by overwriting the first byte of the line,
+    // so check whether the line has been removed since it was indexed.
+    const entry& e = m_entries[index];
+    if (e.offset < view.size() && view.data()[e.offset] == '|')
+    {
+        set_removed(index);
+        return true;
+    }
+
+    return false;
+}
+
+//------------------------------------------------------------------------------
+void history_index::set_removed(uint32 index)
+{
+    assert(index < count());
+    m_tombstones[index >> 3] |= (1 << (index & 7));
+    m_dirty = true;
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <core/str.h>
+
+#include <unordered_map>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Read-only memory mapped view of a history bank file.  The view must only be
+// held while the bank is locked, and must be released before the lock is
+// released, since a mapped file cannot be truncated by other processes.
+class history_mapped_view
+    : public no_copy
+{
+public:
+                    history_mapped_view() = default;
+                    ~history_mapped_view() { unmap(); }
+    bool            map(void* handle);
+    void            unmap();
+    explicit        operator bool () const { return m_valid; }
+    const char*     data() const { return m_data; }
+    uint32          size() const { return m_size; }
+
+private:
+    void*           m_mapping = nullptr;
+    const char*     m_data = nullptr;
+    uint32          m_size = 0;
+    bool            m_valid = false;
+};
+
+//------------------------------------------------------------------------------
+// Offset index for a history bank.  Each entry records where a line starts,
+// how long it is, where its timestamp line starts (if any), and a hash of the
+// line's content for finding duplicates without comparing every line.  Removed
+// lines keep their entries and are marked in a tombstone bitmap, which lets
+// the index be extended incrementally as long as the bank's concurrency tag is
+// unchanged and the bank has only grown.
+class history_index
+{
+public:
+    struct entry
+    {
+        uint32          offset;
+        uint32          length;
+        uint32          time_offset;        // 0 means no timestamp.
+        uint32          hash;
+        uint32          dir;                // 0 means no directory hash.
+    };
+
+    void                clear();
+    bool                load(const char* path);
+    bool                save(const char* path);
+    bool                sync(const history_mapped_view& view, uint32 max_bytes=0);
+    uint32              count() const { return uint32(m_entries.size()); }
+    uint32              indexed_size() const { return m_indexed_size; }
+    const entry&        get(uint32 index) const { return m_entries[index]; }
+    bool                is_removed(uint32 index) const;
+    bool                test_removed(uint32 index, const history_mapped_view& view);
+    template <typename T> void find(const char* line, uint32 length, T&& callback);
+    void                set_removed(uint32 index);
+    bool                is_dirty() const { return m_dirty; }
+    bool                needs_save() const;
+
+    static void         get_ctag(const history_mapped_view& view, str_base& out);
+    static void         get_line(const history_mapped_view& view, const entry& e, str_base& out);
+    static bool         get_timestamp(const history_mapped_view& view, const entry& e, str_base& out);
+    static bool         matches(const history_mapped_view& view, const entry& e, const char* line, uint32 length);
+    static uint32       hash(const char* line, uint32 length);
+
+private:
+    void                scan(const char* data, uint32 from, uint32 to);
+    void                update_lookup();
+    void                get_candidates(uint32 hash, std::vector<uint32>& out);
+    str_moveable        m_ctag;
+    std::vector<entry>  m_entries;
+    std::vector<uint8>  m_tombstones;
+    std::unordered_multimap<uint32, uint32> m_lookup; // Hash => entry index.
+    uint32              m_lookup_count = 0;
+    uint32              m_indexed_size = 0;
+    uint32              m_pending_time_offset = 0;
+    uint32              m_pending_dir = 0;
+    uint32              m_unsaved_bytes = 0;
+    bool                m_dirty = false;
+};
+
+//------------------------------------------------------------------------------
+// Calls CALLBACK with the index of each entry whose hash matches LINE, in
+// ascending order.  The callback must still verify the entry (see matches()
+// and test_removed()), and returns false to stop.
+template <typename T> void history_index::find(const char* line, uint32 length, T&& callback)
+{
+    std::vector<uint32> candidates;
+    get_candidates(hash(line, length), candidates);
+    for (uint32 index : candidates)
+    {
+        if (!callback(index))
+            break;
+    }
+}
@@ -0,0 +1,202 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "history_prefix_index.h"
+
+#include <core/base.h>
+#include <core/path.h>
+#include <core/str_compare.h>
+#include <core/str_iter.h>
+
+#include <algorithm>
+
+extern "C" {
+#include <readline/history.h>
+}
+
+//------------------------------------------------------------------------------
+void history_prefix_index::clear()
+{
+    m_keys.clear();
+    m_entries.clear();
+    m_count = 0;
+    m_first = nullptr;
+    m_last = nullptr;
+    m_last_line = nullptr;
+    m_mode = -1;
+}
+
+//------------------------------------------------------------------------------
+void history_prefix_index::sync()
+{
+    HIST_ENTRY** list = history_list();
+    const int32 length = list ? history_length : 0;
+
+    // Anything other than appending to the history list (removing entries,
+    // replacing entries, reloading the history) requires rebuilding the index.
+    const int32 mode = str_compare_scope::current();
+    const bool fuzzy_accents = str_compare_scope::current_fuzzy_accents();
+    bool rebuild = (mode != m_mode || fuzzy_accents != m_fuzzy_accents || length < m_count);
+    if (!rebuild && m_count)
+    {
+        const HIST_ENTRY* last = list[m_count - 1];
+        rebuild = (list[0] != m_first || last != m_last || last->line != m_last_line);
+    }
+
+    if (rebuild)
+    {
+        clear();
+        m_mode = mode;
+        m_fuzzy_accents = fuzzy_accents;
+    }
+
+    if (m_count == length)
+        return;
+
+    const bool sort = !m_count;
+    for (int32 i = m_count; i < length; ++i)
+    {
+        entry e;
+        e.key_offset = uint32(m_keys.size());
+        fold(list[i]->line, m_keys);
+        e.key_length = uint32(m_keys.size()) - e.key_offset;
+        e.index = i;
+
+        if (sort)
+        {
+            m_entries.push_back(e);
+        }
+        else
+        {
+            const auto pos = std::upper_bound(m_entries.begin(), m_entries.end(), e, [this] (const entry& a, const entry& b) {
+                return less(a, b);
+            });
+            m_entries.insert(pos, e);
+        }
+    }
+
+    if (sort)
+    {
+        std::stable_sort(m_entries.begin(), m_entries.end(), [this] (const entry& a, const entry& b) {
+            return less(a, b);
+        });
+    }
+
+    m_count = length;
+    m_first = list[0];
+    m_last = list[length - 1];
+    m_last_line = list[length - 1]->line;
+}
+
+//------------------------------------------------------------------------------
+// Finds the range of entries that begin with PREFIX (excluding entries equal
+// to it, unless INCLUDE_EQUAL).  Returns false if the range is empty.
+bool history_prefix_index::find_range(const char* prefix, bool include_equal, uint32& first, uint32& last)
+{
+    sync();
+    if (m_entries.empty())
+        return false;
+
+    m_tmp.clear();
+    fold(prefix, m_tmp);
+    const uint32 prefix_length = uint32(m_tmp.size());
+
+    // Entries that begin with the prefix are contiguous, starting with the
+    // first entry that is not less than the prefix.  Entries equal to the
+    // prefix sort before the rest of them.
+    const wchar_t* key = m_tmp.data();
+    auto iter = std::lower_bound(m_entries.begin(), m_entries.end(), prefix_length, [&] (const entry& e, uint32 len) {
+        const wchar_t* e_key = m_keys.data() + e.key_offset;
+        const uint32 n = min(e.key_length, len);
+        const int32 cmp = wmemcmp(e_key, key, n);
+        return cmp ? cmp < 0 : e.key_length < len;
+    });
+
+    if (!include_equal)
+    {
+        while (iter != m_entries.end() && iter->key_length == prefix_length &&
+               wmemcmp(m_keys.data() + iter->key_offset, key, prefix_length) == 0)
+            ++iter;
+    }
+
+    auto end = iter;
+    while (end != m_entries.end() && end->key_length >= prefix_length &&
+           wmemcmp(m_keys.data() + end->key_offset, key, prefix_length) == 0)
+        ++end;
+
+    first = uint32(iter - m_entries.begin());
+    last = uint32(end - m_entries.begin());
+    return first < last;
+}
+
+//------------------------------------------------------------------------------
+// Collects the newest entries in [FIRST, LAST) whose history index is less
+// than BELOW, newest first, keeping only the top few.  Returns false when
+// there are none left.
+bool history_prefix_index::next_batch(uint32 first, uint32 last, int32 below, std::vector<int32>& out) const
+{
+    static const size_t c_batch = 16;
+    const auto newer = [] (int32 a, int32 b) { return a > b; };
+
+    // Min-heap of the newest indices seen so far.
+    out.clear();
+    for (uint32 i = first; i < last; ++i)
+    {
+        const int32 index = m_entries[i].index;
+        if (index >= below)
+            continue;
+        if (out.size() < c_batch)
+        {
+            out.push_back(index);
+            std::push_heap(out.begin(), out.end(), newer);
+        }
+        else if (index > out.front())
+        {
+            std::pop_heap(out.begin(), out.end(), newer);
+            out.back() = index;
+            std::push_heap(out.begin(), out.end(), newer);
+        }
+    }
+
+    std::sort_heap(out.begin(), out.end(), newer);
+    return !out.empty();
+}
+
+//------------------------------------------------------------------------------
+// Appends LINE to OUT as UTF16, folded the same way str_compare_impl() folds
+// characters before comparing them.
+void history_prefix_index::fold(const char* line, std::vector<wchar_t>& out) const
+{
+    str_iter iter(line);
+    while (int32 c = iter.next())
+    {
+        c = str_compare_fold(c, m_mode, m_fuzzy_accents, true/*exact_slash*/);
+
+        if (c > 0xffff)
+        {
+            c -= 0x10000;
+            out.push_back(wchar_t(0xd800 + (c >> 10)));
+            out.push_back(wchar_t(0xdc00 + (c & 0x3ff)));
+        }
+        else
+        {
+            out.push_back(wchar_t(c));
+        }
+
+        // Consecutive path separators compare equal to one.
+        if (c == '/')
+        {
+            while (path::is_separator(iter.peek()))
+                iter.next();
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+bool history_prefix_index::less(const entry& a, const entry& b) const
+{
+    const uint32 n = min(a.key_length, b.key_length);
+    const int32 cmp = wmemcmp(m_keys.data() + a.key_offset, m_keys.data() + b.key_offset, n);
+    return cmp ? cmp < 0 : a.key_length < b.key_length;
+}
@@ -0,0 +1,200 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "history_time_index.h"
+
+#include <core/base.h>
+#include <core/str.h>
+#include <core/log.h>
+#include <assert.h>
+
+#include <algorithm>
+
+//------------------------------------------------------------------------------
+static const char c_time_index_magic[8] = { 'C', 'L', 'H', 'T', 'I', 'X', 0, 0 };
+static const uint32 c_time_index_version = 1;
+static const uint32 c_time_index_ctag_size = 64;
+static const uint32 c_sample_interval = 64;
+
+//------------------------------------------------------------------------------
+struct history_time_index_header
+{
+    char                magic[8];
+    uint32              version;
+    uint32              count;
+    uint32              indexed_size;
+    uint32              until_sample;
+    char                ctag[c_time_index_ctag_size];
+};
+
+
+
+//------------------------------------------------------------------------------
+void history_time_index::reset(const char* ctag)
+{
+    m_ctag = ctag;
+    m_samples.clear();
+    m_indexed_size = 0;
+    m_until_sample = 0;
+    m_dirty = true;
+}
+
+//------------------------------------------------------------------------------
+bool history_time_index::load(const char* path)
+{
+    reset("");
+    m_dirty = false;
+
+    wstr<> wpath(path);
+    HANDLE h = CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_DELETE,
+                           nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+
+    bool ok = false;
+    DWORD read;
+    history_time_index_header header;
+    const DWORD file_size = GetFileSize(h, nullptr);
+    if (ReadFile(h, &header, sizeof(header), &read, nullptr) &&
+        read == sizeof(header) &&
+        memcmp(header.magic, c_time_index_magic, sizeof(c_time_index_magic)) == 0 &&
+        header.version == c_time_index_version &&
+        memchr(header.ctag, 0, sizeof(header.ctag)))
+    {
+        const DWORD samples_bytes = header.count * sizeof(sample);
+        if (file_size == sizeof(header) + samples_bytes)
+        {
+            m_samples.resize(header.count);
+            if (ReadFile(h, m_samples.data(), samples_bytes, &read, nullptr) && read == samples_bytes)
+            {
+                m_ctag = header.ctag;
+                m_indexed_size = header.indexed_size;
+                m_until_sample = header.until_sample;
+                ok = true;
+            }
+        }
+    }
+
+    CloseHandle(h);
+
+    if (!ok)
+    {
+        LOG("ignoring invalid history time index '%s'", path);
+        reset("");
+        m_dirty = false;
+    }
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+bool history_time_index::save(const char* path)
+{
+    if (m_ctag.length() >= c_time_index_ctag_size)
+        return false;
+
+    // Write to a temporary file and then replace the index, so that other
+    // processes never see a partially written index.
+    str<280> tmp;
+    tmp.format("%s.%u", path, GetCurrentProcessId());
+
+    wstr<280> wtmp(tmp.c_str());
+    HANDLE h = CreateFileW(wtmp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_HIDDEN|FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+
+    history_time_index_header header = {};
+    memcpy(header.magic, c_time_index_magic, sizeof(c_time_index_magic));
+    header.version = c_time_index_version;
+    header.count = uint32(m_samples.size());
+    header.indexed_size = m_indexed_size;
+    header.until_sample = m_until_sample;
+    memcpy(header.ctag, m_ctag.c_str(), m_ctag.length());
+
+    DWORD written;
+    const DWORD samples_bytes = header.count * sizeof(sample);
+    bool ok = (WriteFile(h, &header, sizeof(header), &written, nullptr) && written == sizeof(header) &&
+               WriteFile(h, m_samples.data(), samples_bytes, &written, nullptr) && written == samples_bytes);
+    CloseHandle(h);
+
+    wstr<280> wpath(path);
+    if (ok)
+        ok = !!MoveFileExW(wtmp.c_str(), wpath.c_str(), MOVEFILE_REPLACE_EXISTING);
+    if (!ok)
+        DeleteFileW(wtmp.c_str());
+    else
+        m_dirty = false;
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+// The index can only be extended if the bank still has the same identity and
+// has only grown since it was last indexed.  Removing a line overwrites it in
+// place, which doesn't move any other lines, so offsets stay valid.
+bool history_time_index::is_current(const char* ctag, uint32 size) const
+{
+    return m_ctag.equals(ctag) && size >= m_indexed_size;
+}
+
+//------------------------------------------------------------------------------
+void history_time_index::set_indexed_size(uint32 size)
+{
+    assert(size >= m_indexed_size);
+    if (size != m_indexed_size)
+    {
+        m_indexed_size = size;
+        m_dirty = true;
+    }
+}
+
+//------------------------------------------------------------------------------
+void history_time_index::add(uint64 time, uint32 offset)
+{
+    if (m_until_sample)
+    {
+        --m_until_sample;
+        return;
+    }
+
+    if (!m_samples.empty() && (time < m_samples.back().time || offset <= m_samples.back().offset))
+        return;
+
+    m_samples.push_back({ time, offset, 0 });
+    m_until_sample = c_sample_interval - 1;
+    m_dirty = true;
+}
+
+//------------------------------------------------------------------------------
+// Returns the offset to start reading from to find lines with timestamps at or
+// after SINCE.  Lines before the returned offset are all older than SINCE.
+uint32 history_time_index::find_start(uint64 since) const
+{
+    auto iter = std::lower_bound(m_samples.begin(), m_samples.end(), since, [] (const sample& s, uint64 t) {
+        return s.time < t;
+    });
+    if (iter == m_samples.begin())
+        return 0;
+    --iter;
+    return iter->offset;
+}
+
+//------------------------------------------------------------------------------
+// Returns the offset at which to stop reading while looking for lines with
+// timestamps at or before UNTIL.  Lines at or after the returned offset are
+// all newer than UNTIL.
+uint32 history_time_index::find_end(uint64 until) const
+{
+    auto iter = std::upper_bound(m_samples.begin(), m_samples.end(), until, [] (uint64 t, const sample& s) {
+        return t < s.time;
+    });
+    if (iter == m_samples.end())
+        return UINT_MAX;
+    return iter->offset;
+}
+
+//------------------------------------------------------------------------------
+uint64 history_time_index::parse_time(const char* timestamp)
+{
+    return (timestamp && *timestamp) ? _strtoui64(timestamp, nullptr, 10) : 0;
+}
@@ -0,0 +1,49 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <core/str.h>
+
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Sparse timestamp index for a history bank.  Every so many timestamped lines,
+// the index records the line's time and file offset, so that a time range
+// query can seek near the start of the range instead of reading the whole
+// bank.  Lines are appended as they're entered, so timestamps increase in file
+// order; samples whose time goes backwards (e.g. the clock was changed) are
+// skipped, which keeps the samples sorted by time.
+//
+// Like history_index, the index is tied to the bank's concurrency tag and is
+// extended incrementally as long as the bank has only grown.
+class history_time_index
+{
+public:
+    struct sample
+    {
+        uint64          time;
+        uint32          offset;
+        uint32          reserved;
+    };
+
+    void                reset(const char* ctag);
+    bool                load(const char* path);
+    bool                save(const char* path);
+    bool                is_current(const char* ctag, uint32 size) const;
+    uint32              indexed_size() const { return m_indexed_size; }
+    void                set_indexed_size(uint32 size);
+    void                add(uint64 time, uint32 offset);
+    bool                is_dirty() const { return m_dirty; }
+    uint32              find_start(uint64 since) const;
+    uint32              find_end(uint64 until) const;
+
+    static uint64       parse_time(const char* timestamp);
+
+private:
+    str_moveable        m_ctag;
+    std::vector<sample> m_samples;
+    uint32              m_indexed_size = 0;
+    uint32              m_until_sample = 0;     // Timestamped lines until the next sample.
+    bool                m_dirty = false;
+};
@@ -3,11 +3,13 @@
 
 #pragma once
 
+class input_idle;
+
 //------------------------------------------------------------------------------
 class input_dispatcher
 {
 public:
-    virtual void    dispatch(int32 bind_group) = 0;
+    virtual void    dispatch(int32 bind_group, input_idle* idle=nullptr) = 0;
     virtual bool    available(uint32 timeout) = 0;
     virtual uint8   peek() = 0;
 };
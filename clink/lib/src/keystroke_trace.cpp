@@ -0,0 +1,227 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "keystroke_trace.h"
+
+#include <core/base.h>
+#include <core/settings.h>
+#include <core/str.h>
+
+#include <algorithm>
+#include <vector>
+
+//------------------------------------------------------------------------------
+static setting_bool g_trace_keystrokes(
+    "debug.trace_keystrokes",
+    "Record how long keystrokes take",
+    "When true, Clink records how long each phase of handling a keystroke takes,\n"
+    "for the most recent keystrokes.  Running clink-diagnostics with a numeric\n"
+    "argument shows percentiles for each phase, and writes a trace file that can\n"
+    "be loaded in Chrome's about://tracing or in Perfetto.",
+    false);
+
+//------------------------------------------------------------------------------
+static const char* const c_phase_names[] =
+{
+    "other",
+    "dispatch",
+    "classify",
+    "words",
+    "suggest",
+    "display",
+};
+static_assert(sizeof_array(c_phase_names) == size_t(keystroke_phase::max), "c_phase_names must match keystroke_phase");
+
+//------------------------------------------------------------------------------
+// Everything happens on the main thread, so the ring buffer needs no locking.
+struct keystroke_record
+{
+    int64           start;
+    uint32          ticks[size_t(keystroke_phase::max)];
+};
+
+static const uint32 c_max_keystrokes = 512;
+static keystroke_record s_records[c_max_keystrokes];
+static uint32 s_seq = 0;                // Total number of keystrokes recorded.
+static bool s_active = false;
+static keystroke_phase s_phase = keystroke_phase::other;
+static int64 s_mark = 0;
+
+//------------------------------------------------------------------------------
+static int64 get_ticks()
+{
+    LARGE_INTEGER li;
+    QueryPerformanceCounter(&li);
+    return li.QuadPart;
+}
+
+//------------------------------------------------------------------------------
+static double ticks_to_ms(int64 ticks)
+{
+    static double s_freq = 0;
+    if (!s_freq)
+    {
+        LARGE_INTEGER li;
+        QueryPerformanceFrequency(&li);
+        s_freq = double(li.QuadPart);
+    }
+    return double(ticks) * 1000 / s_freq;
+}
+
+//------------------------------------------------------------------------------
+// Charges the time since the last mark to the current phase.
+static void charge()
+{
+    const int64 now = get_ticks();
+    s_records[s_seq % c_max_keystrokes].ticks[size_t(s_phase)] += uint32(now - s_mark);
+    s_mark = now;
+}
+
+//------------------------------------------------------------------------------
+static uint32 get_total(const keystroke_record& record)
+{
+    uint32 total = 0;
+    for (uint32 ticks : record.ticks)
+        total += ticks;
+    return total;
+}
+
+
+
+//------------------------------------------------------------------------------
+keystroke_phase_scope::keystroke_phase_scope(keystroke_phase phase)
+: m_prev(s_phase)
+, m_active(s_active)
+{
+    if (!m_active)
+        return;
+
+    charge();
+    s_phase = phase;
+}
+
+//------------------------------------------------------------------------------
+keystroke_phase_scope::~keystroke_phase_scope()
+{
+    if (!m_active || !s_active)
+        return;
+
+    charge();
+    s_phase = m_prev;
+}
+
+
+
+namespace keystroke_trace
+{
+
+//------------------------------------------------------------------------------
+void begin()
+{
+    if (s_active || !g_trace_keystrokes.get())
+        return;
+
+    keystroke_record& record = s_records[s_seq % c_max_keystrokes];
+    memset(&record, 0, sizeof(record));
+    record.start = get_ticks();
+
+    s_mark = record.start;
+    s_phase = keystroke_phase::other;
+    s_active = true;
+}
+
+//------------------------------------------------------------------------------
+void end()
+{
+    if (!s_active)
+        return;
+
+    charge();
+    s_active = false;
+    ++s_seq;
+}
+
+//------------------------------------------------------------------------------
+uint32 count()
+{
+    return min<uint32>(s_seq, c_max_keystrokes);
+}
+
+//------------------------------------------------------------------------------
+void format(str_base& out)
+{
+    const uint32 num = count();
+    if (!num)
+        return;
+
+    str<> tmp;
+    tmp.format("  %-12s %9s %9s %9s %9s   (%u keystrokes, ms)\n", "phase", "p50", "p90", "p99", "max", num);
+    out.concat(tmp.c_str(), tmp.length());
+
+    std::vector<uint32> values;
+    values.resize(num);
+    for (size_t phase = 0; phase <= size_t(keystroke_phase::max); ++phase)
+    {
+        for (uint32 i = 0; i < num; ++i)
+        {
+            const keystroke_record& record = s_records[i];
+            values[i] = (phase < size_t(keystroke_phase::max)) ? record.ticks[phase] : get_total(record);
+        }
+        std::sort(values.begin(), values.end());
+
+        auto percentile = [&](uint32 pct) {
+            return ticks_to_ms(values[min<uint32>(num - 1, num * pct / 100)]);
+        };
+
+        const char* name = (phase < size_t(keystroke_phase::max)) ? c_phase_names[phase] : "total";
+        tmp.format("  %-12s %9.3f %9.3f %9.3f %9.3f\n", name,
+                   percentile(50), percentile(90), percentile(99), ticks_to_ms(values.back()));
+        out.concat(tmp.c_str(), tmp.length());
+    }
+}
+
+//------------------------------------------------------------------------------
+// Writes the recorded keystrokes in the Chrome trace event format.  Phases are
+// recorded as exclusive durations rather than as start and end times, so each
+// keystroke's phases are laid out one after another within the keystroke.
+bool write_chrome_trace(const char* path)
+{
+    const uint32 num = count();
+    if (!num)
+        return false;
+
+    FILE* file = fopen(path, "wt");
+    if (!file)
+        return false;
+
+    const uint32 first = s_seq - num;
+    const int64 origin = s_records[first % c_max_keystrokes].start;
+    const DWORD pid = GetCurrentProcessId();
+
+    fputs("{\"traceEvents\":[\n", file);
+    for (uint32 i = 0; i < num; ++i)
+    {
+        const keystroke_record& record = s_records[(first + i) % c_max_keystrokes];
+        double ts = ticks_to_ms(record.start - origin) * 1000;
+
+        fprintf(file, "%s{\"name\":\"keystroke\",\"ph\":\"X\",\"pid\":%u,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                i ? ",\n" : "", pid, ts, ticks_to_ms(get_total(record)) * 1000);
+
+        for (size_t phase = 0; phase < size_t(keystroke_phase::max); ++phase)
+        {
+            if (!record.ticks[phase])
+                continue;
+            const double dur = ticks_to_ms(record.ticks[phase]) * 1000;
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%u,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                    c_phase_names[phase], pid, ts, dur);
+            ts += dur;
+        }
+    }
+    fputs("\n]}\n", file);
+
+    fclose(file);
+    return true;
+}
+
+}; // namespace keystroke_trace
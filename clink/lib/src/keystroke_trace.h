@@ -0,0 +1,45 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+class str_base;
+
+//------------------------------------------------------------------------------
+// When debug.trace_keystrokes is enabled, the time spent in each phase of
+// handling a keystroke is recorded in a ring buffer of recent keystrokes, so
+// that clink-diagnostics can show where slow keystrokes spend their time.
+//
+// Phases are exclusive:  time spent in a nested phase is not counted in the
+// enclosing phase.  Time outside any phase is counted as "other".
+enum class keystroke_phase : uint8
+{
+    other,
+    dispatch,                           // Key binding handlers (on_input).
+    classify,
+    words,                              // Collecting words, matches state.
+    suggest,
+    display,
+    max
+};
+
+//------------------------------------------------------------------------------
+class keystroke_phase_scope
+{
+public:
+                    keystroke_phase_scope(keystroke_phase phase);
+                    ~keystroke_phase_scope();
+private:
+    keystroke_phase m_prev;
+    bool            m_active;
+};
+
+//------------------------------------------------------------------------------
+namespace keystroke_trace
+{
+void                begin();            // A key was read.
+void                end();              // The keystroke is fully handled.
+uint32              count();
+void                format(str_base& out);
+bool                write_chrome_trace(const char* path);
+};
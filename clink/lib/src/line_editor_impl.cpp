@@ -7,9 +7,11 @@
 #include "line_buffer.h"
 #include "match_generator.h"
 #include "match_pipeline.h"
+#include "completion_cache.h"
 #include "pager.h"
 #include "host_callbacks.h"
 #include "reclassify.h"
+#include "deferred_init.h"
 #include "cmd_tokenisers.h"
 #include "doskey.h"
 #include "display_readline.h"
@@ -17,9 +19,11 @@
 #include "clink_rl_signal.h"
 #include "line_editor_integration.h"
 #include "suggestions.h"
+#include "keystroke_trace.h"
 #include "recognizer.h"
 
 #include <core/base.h>
+#include <core/globber.h>
 #include <core/os.h>
 #include <core/path.h>
 #include <core/str_iter.h>
@@ -35,6 +39,7 @@ extern "C" {
 #include <readline/rlprivate.h>
 #include <readline/rldefs.h>
 #include <readline/history.h>
+#include <readline/xmalloc.h>
 }
 
 //------------------------------------------------------------------------------
@@ -45,6 +50,15 @@ extern setting_bool g_history_autoexpand;
 extern setting_bool g_history_show_preview;
 extern setting_enum g_default_bindings;
 extern setting_color g_color_histexpand;
+
+static setting_int g_match_speculate_delay(
+    "match.speculate_delay",
+    "Delay before generating matches while idle",
+    "When this is greater than 0, matches are generated in the background once\n"
+    "the cursor has rested at the end of a word for this many milliseconds, so\n"
+    "that pressing Tab can use them right away.  Match generators run while\n"
+    "idle when this is enabled, even if completion is never invoked.",
+    0);
 // TODO: line_editor_impl vs rl_module.
 extern int32 g_suggestion_offset;
 
@@ -86,6 +100,14 @@ static bool rl_vi_insert_mode_esc_special_case(int32 key)
 
 
 
+//------------------------------------------------------------------------------
+static bool is_self_insert(const char* chord, uint32 len)
+{
+    return rl_function_of_keyseq_len(chord, len, nullptr, nullptr) == rl_insert;
+}
+
+
+
 //------------------------------------------------------------------------------
 line_editor* line_editor_create(const line_editor::desc& desc)
 {
@@ -123,6 +145,97 @@ bool prev_buffer::equals(const char* s, int32 len) const
 
 
 
+//------------------------------------------------------------------------------
+// classify() runs on every change to the line (and the display on every
+// redraw), but the history expansions only change when the line text or the
+// history list changes.  This remembers the most recent result so it can be
+// reused instead of walking history_expand() again.
+class history_expansion_cache
+{
+public:
+                        ~history_expansion_cache() { clear(); }
+    void                clear();
+    bool                get(const char* line, int32 len, history_expansion*& list) const;
+    void                set(const char* line, int32 len, const history_expansion* list);
+
+private:
+    static history_expansion* copy(const history_expansion* list);
+    prev_buffer         m_line;
+    int32               m_history_length = -1;
+    int32               m_history_base = 0;
+    const void*         m_history_last = nullptr;
+    history_expansion*  m_list = nullptr;
+};
+
+//------------------------------------------------------------------------------
+void history_expansion_cache::clear()
+{
+    history_free_expansions(&m_list);
+    m_line.clear();
+    m_history_length = -1;
+}
+
+//------------------------------------------------------------------------------
+static const void* get_last_history_entry()
+{
+    HIST_ENTRY** list = history_list();
+    return (list && history_length > 0) ? list[history_length - 1] : nullptr;
+}
+
+//------------------------------------------------------------------------------
+bool history_expansion_cache::get(const char* line, int32 len, history_expansion*& list) const
+{
+    if (m_history_length != history_length ||
+        m_history_base != history_base ||
+        m_history_last != get_last_history_entry() ||
+        !m_line.equals(line, len))
+        return false;
+
+    list = copy(m_list);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void history_expansion_cache::set(const char* line, int32 len, const history_expansion* list)
+{
+    history_free_expansions(&m_list);
+    m_list = copy(list);
+    m_line.set(line, len);
+    m_history_length = history_length;
+    m_history_base = history_base;
+    m_history_last = get_last_history_entry();
+}
+
+//------------------------------------------------------------------------------
+history_expansion* history_expansion_cache::copy(const history_expansion* list)
+{
+    history_expansion* head = nullptr;
+    history_expansion** tail = &head;
+    for (const history_expansion* e = list; e; e = e->next)
+    {
+        history_expansion* c = (history_expansion*)xmalloc(sizeof(*c));
+        c->start = e->start;
+        c->len = e->len;
+        c->result = e->result ? savestring(e->result) : nullptr;
+        c->next = nullptr;
+        *tail = c;
+        tail = &c->next;
+    }
+    return head;
+}
+
+static history_expansion_cache s_histexpand_cache;
+
+//------------------------------------------------------------------------------
+static bool may_need_history_expansion(const char* line, int32 len)
+{
+    if (!history_expansion_char)
+        return false;
+    if (history_subst_char && len && line[0] == history_subst_char)
+        return true;
+    return !!memchr(line, history_expansion_char, len);
+}
+
 //------------------------------------------------------------------------------
 static void calc_history_expansions(const line_buffer& buffer, history_expansion*& list)
 {
@@ -135,9 +248,18 @@ static void calc_history_expansions(const line_buffer& buffer, history_expansion
     if (!g_history_show_preview.get() && !(color && (*color)))
         return;
 
+    // Most lines contain nothing that history expansion would change.
+    const char* const line = buffer.get_buffer();
+    const int32 len = buffer.get_length();
+    if (!may_need_history_expansion(line, len))
+        return;
+
+    if (s_histexpand_cache.get(line, len, list))
+        return;
+
     // Counteract auto-suggestion, but restore it afterwards.
-    char* p = const_cast<char*>(buffer.get_buffer());
-    rollback<char> rb(p[buffer.get_length()], '\0');
+    char* p = const_cast<char*>(line);
+    rollback<char> rb(p[len], '\0');
 
     {
         // The history expansion library can have side effects on the global
@@ -160,6 +282,8 @@ static void calc_history_expansions(const line_buffer& buffer, history_expansion
 
     list = history_expansions;
     history_expansions = nullptr;
+
+    s_histexpand_cache.set(line, len, list);
 }
 
 //------------------------------------------------------------------------------
@@ -229,6 +353,8 @@ line_editor_impl::line_editor_impl(const desc& desc)
     add_module(m_selectcomplete);
     add_module(m_textlist);
 
+    m_collector.init_alias_cache();
+
     key_tester* old_tester = desc.input->set_key_tester(this);
     assert(!old_tester);
 }
@@ -290,8 +416,12 @@ void line_editor_impl::begin_line()
 #endif
 
     m_bind_resolver.reset();
+    m_collector.clear_cache();
     m_command_offset = 0;
     m_prev_key.reset();
+    m_input_burst = false;
+    m_edit_batch = 0;
+    m_module.set_input_burst(false);
 
     set_active_line_editor(this, m_desc.callbacks);
 
@@ -304,8 +434,11 @@ void line_editor_impl::begin_line()
     m_buffer.begin_line();
 
     m_prev_generate.clear();
+    m_speculated_line.clear();
+    m_speculated_valid = false;
     m_prev_plain = false;
     m_prev_classify.clear();
+    clear_classify_cache();
     m_prev_command_word.clear();
     m_prev_command_word_offset = -1;
     m_prev_command_word_quoted = false;
@@ -369,6 +502,7 @@ void line_editor_impl::set_generator(match_generator& generator)
     m_generator = &generator;
     m_regen_matches.set_generator(&generator);
     m_matches.set_generator(&generator);
+    m_speculated.set_generator(&generator);
 }
 
 //------------------------------------------------------------------------------
@@ -481,9 +615,13 @@ bool line_editor_impl::update()
     maybe_handle_signal();
 
     if (!check_flag(flag_editing))
+    {
+        keystroke_trace::end();
         return false;
+    }
 
     update_internal();
+    keystroke_trace::end();
     return true;
 }
 
@@ -494,6 +632,8 @@ void line_editor_impl::reset_generate_matches()
     set_flag(flag_select);
     m_prev_key.reset();
     m_prev_generate.clear();
+    m_speculated_line.clear();
+    m_speculated_valid = false;
 }
 
 //------------------------------------------------------------------------------
@@ -510,6 +650,31 @@ void line_editor_impl::force_update_internal(bool restrict)
     set_flag(flag_select);
 }
 
+//------------------------------------------------------------------------------
+void line_editor_impl::begin_edit_batch()
+{
+    if (m_edit_batch++ == 0)
+        m_module.set_input_burst(true);
+}
+
+//------------------------------------------------------------------------------
+void line_editor_impl::end_edit_batch()
+{
+    assert(m_edit_batch > 0);
+    if (!m_edit_batch || --m_edit_batch)
+        return;
+
+    m_module.set_input_burst(m_input_burst);
+
+    // Catch up once for all of the edits in the batch.
+    if (!m_input_burst)
+    {
+        update_internal();
+        classify();
+    }
+    m_buffer.set_need_draw();
+}
+
 //------------------------------------------------------------------------------
 bool line_editor_impl::notify_matches_ready(int32 generation_id, matches* matches)
 {
@@ -528,10 +693,11 @@ bool line_editor_impl::notify_matches_ready(int32 generation_id, matches* matche
     }
     else
     {
-        // There's a newer generation id, so force a new suggestion, since the
-        // newer generation id's autosuggest will have been canceled due to the
-        // match generator coroutine that was already running, and which has
-        // just now signaled its completion.
+        // There's a newer generation id, so force a new suggestion.  A newer
+        // generation normally cancels the match generator coroutine for the
+        // older one, but if the older one couldn't be canceled then the newer
+        // generation id's autosuggest will have been canceled instead, and the
+        // older one has just now signaled its completion.
         clear_suggestion();
     }
 
@@ -548,6 +714,76 @@ bool line_editor_impl::notify_matches_ready(int32 generation_id, matches* matche
     return true;
 }
 
+//------------------------------------------------------------------------------
+// Speculation is only worthwhile once generating is pending for the end word,
+// the cursor rests at the end of a word, and nothing else is in progress.
+bool line_editor_impl::can_speculate() const
+{
+    if (!check_flag(flag_editing) || !check_flag(flag_generate) || !m_generator)
+        return false;
+    if (m_input_burst || m_edit_batch || m_selectcomplete.is_active() || m_buffer.has_override())
+        return false;
+
+    // Already speculated for this line?
+    if (!m_prev_generate.get() ||
+        m_speculated_line.equals(m_prev_generate.get(), m_prev_generate.length()))
+        return false;
+
+    const char* buffer = m_buffer.get_buffer();
+    const uint32 cursor = m_buffer.get_cursor();
+    const uint32 length = m_buffer.get_length();
+    if (!cursor || buffer[cursor - 1] == ' ' || buffer[cursor - 1] == '\t')
+        return false;
+    if (cursor < length && buffer[cursor] != ' ' && buffer[cursor] != '\t')
+        return false;
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Returns how many milliseconds remain until speculate_matches() should run,
+// or INFINITE if there's nothing to speculate.
+uint32 line_editor_impl::get_speculate_timeout() const
+{
+    const int32 delay = g_match_speculate_delay.get();
+    if (delay <= 0 || !can_speculate())
+        return INFINITE;
+
+    const DWORD elapsed = GetTickCount() - m_edit_tick;
+    return (elapsed >= DWORD(delay)) ? 0 : DWORD(delay) - elapsed;
+}
+
+//------------------------------------------------------------------------------
+// Generates matches for the current line into m_speculated, so that a
+// completion command can use them without waiting for the match generators.
+void line_editor_impl::speculate_matches()
+{
+    if (get_speculate_timeout() != 0)
+        return;
+
+    m_speculated_line.set(m_prev_generate.get(), m_prev_generate.length());
+    m_speculated_valid = false;
+
+    // When the completion cache already has matches for the line, completing
+    // will find them there.
+    const auto linestates = get_linestates();
+    if (completion_cache::get().lookup(linestates.back(), m_speculated))
+        return;
+
+    match_pipeline pipeline(m_speculated);
+    pipeline.reset();
+    pipeline.generate(linestates, m_generator);
+
+    if (m_speculated.is_cacheable())
+        completion_cache::get().store(linestates.back(), m_speculated);
+
+    // Discard the matches if a generator reset match generation, or if they
+    // need to be generated again anyway.
+    m_speculated_valid = (!m_speculated.is_volatile() &&
+                          check_flag(flag_generate) &&
+                          m_prev_generate.equals(m_speculated_line.get(), m_speculated_line.length()));
+}
+
 //------------------------------------------------------------------------------
 void line_editor_impl::update_matches()
 {
@@ -573,7 +809,25 @@ void line_editor_impl::update_matches()
         const auto linestates = get_linestates();
         match_pipeline pipeline(m_matches);
         pipeline.reset();
-        pipeline.generate(linestates, m_generator);
+        if (m_speculated_valid && m_prev_generate.get() &&
+            m_speculated_line.equals(m_prev_generate.get(), m_prev_generate.length()))
+        {
+            // Matches were already generated for this line while idle.
+            m_matches.transfer(m_speculated);
+            m_speculated_valid = false;
+        }
+        else if (completion_cache::get().lookup(linestates.back(), m_matches))
+        {
+            if (m_generator)
+                m_generator->reset_display_filter();
+        }
+        else
+        {
+            pipeline.generate(linestates, m_generator);
+            // Matches from non-blocking globs can be stale or incomplete.
+            if (m_matches.is_cacheable() && !globber::is_nonblocking())
+                completion_cache::get().store(linestates.back(), m_matches);
+        }
     }
 
     if (restrict && !m_buffer.has_override())
@@ -619,7 +873,7 @@ void line_editor_impl::update_matches()
 }
 
 //------------------------------------------------------------------------------
-void line_editor_impl::dispatch(int32 bind_group)
+void line_editor_impl::dispatch(int32 bind_group, input_idle* idle)
 {
     assert(check_flag(flag_init));
     assert(check_flag(flag_editing));
@@ -640,7 +894,7 @@ void line_editor_impl::dispatch(int32 bind_group)
 
     do
     {
-        m_desc.input->select();
+        m_desc.input->select(idle);
         m_invalid_dispatch = false;
     }
     while (!update_input() || m_invalid_dispatch);
@@ -749,6 +1003,12 @@ bool line_editor_impl::update_input()
         if (key < 0)
             return true;
 
+        keystroke_trace::begin();
+
+        // Keys may use anything whose initialization was deferred until idle,
+        // so make sure it's finished before dispatching the first key.
+        ensure_deferred_init();
+
         // `quoted-insert` should always behave as though the key resolved a
         // binding, to ensure that Readline gets to handle the key (even Esc).
         if (!m_bind_resolver.step(key) &&
@@ -777,6 +1037,12 @@ bool line_editor_impl::update_input()
         uint8           flags;  // = 0;   <! issues about C2905
     };
 
+    // When more input is already queued (e.g. a paste), then keys that insert
+    // themselves are inserted as a burst.  Classifying, suggesting, and
+    // redisplaying happen once, for the last key of the burst.  Any other key
+    // ends the burst first, so it sees the line as usual.
+    const bool queued = !m_dispatching && m_desc.input->available(0);
+
     while (auto binding = m_bind_resolver.next())
     {
         // Binding found, dispatch it off to the module.
@@ -789,8 +1055,12 @@ bool line_editor_impl::update_input()
         uint8 id = binding.get_id();
         binding.get_chord(chord);
 
+        m_input_burst = (queued && module == &m_module && is_self_insert(chord.c_str(), chord.length()));
+        m_module.set_input_burst(m_input_burst || m_edit_batch);
+
         {
             rollback<bind_resolver::binding*> _(m_pending_binding, &binding);
+            keystroke_phase_scope phase(keystroke_phase::dispatch);
 
             editor_module::context context = get_context();
             editor_module::input input = { chord.c_str(), chord.length(), id, m_bind_resolver.more_than(chord.length()), binding.get_params() };
@@ -828,7 +1098,8 @@ bool line_editor_impl::update_input()
         }
         else
         {
-            classify();
+            if (!m_input_burst)
+                classify();
 
             if (result.flags & result_impl::flag_done)
             {
@@ -843,9 +1114,22 @@ bool line_editor_impl::update_input()
         }
 
         if (result.flags & result_impl::flag_redraw)
+        {
+            keystroke_phase_scope phase(keystroke_phase::display);
             m_buffer.redraw();
+        }
+    }
+
+    // End the burst if the queue drained without reaching another key (e.g.
+    // the rest of the queue was input that doesn't produce keys).
+    if (m_input_burst && !m_desc.input->available(0))
+    {
+        m_input_burst = false;
+        m_module.set_input_burst(m_edit_batch > 0);
+        classify();
     }
 
+    keystroke_phase_scope phase(keystroke_phase::display);
     m_buffer.draw();
     return true;
 }
@@ -858,19 +1142,17 @@ void line_editor_impl::collect_words()
 }
 
 //------------------------------------------------------------------------------
-command_line_states line_editor_impl::collect_command_line_states()
+const command_line_states& line_editor_impl::collect_command_line_states()
 {
-    command_line_states command_line_states;
-    collect_words(m_classify_words, nullptr, collect_words_mode::whole_command, command_line_states);
-    return command_line_states;
+    collect_words(m_classify_words, nullptr, collect_words_mode::whole_command, m_classify_command_line_states);
+    return m_classify_command_line_states;
 }
 
 //------------------------------------------------------------------------------
 uint32 line_editor_impl::collect_words(words& words, matches_impl* matches, collect_words_mode mode, command_line_states& command_line_states)
 {
-    std::vector<command> commands;
-    uint32 command_offset = m_collector.collect_words(m_buffer, words, mode, &commands);
-    command_line_states.set(m_buffer, words, commands);
+    uint32 command_offset = m_collector.collect_words(m_buffer, words, mode, &m_commands);
+    command_line_states.set(m_buffer, words, m_commands);
 
 #ifdef DEBUG
     const int32 dbg_row = dbg_get_env_int("DEBUG_COLLECTWORDS");
@@ -996,11 +1278,12 @@ uint32 line_editor_impl::collect_words(words& words, matches_impl* matches, coll
 //------------------------------------------------------------------------------
 void line_editor_impl::classify()
 {
+    keystroke_phase_scope phase(keystroke_phase::classify);
+
     if (!m_classifier)
     {
         if (g_history_autoexpand.get() && g_history_show_preview.get())
         {
-            command_line_states command_line_states = collect_command_line_states();
             history_expansion* list = nullptr;
             calc_history_expansions(m_buffer, list);
             set_history_expansions(list);
@@ -1029,8 +1312,8 @@ void line_editor_impl::classify()
     else
     {
         // Use the full line; don't stop at the cursor.
-        command_line_states command_line_states = collect_command_line_states();
-        m_classifier->classify(command_line_states.get_linestates(m_buffer), m_classifications);
+        const command_line_states& command_line_states = collect_command_line_states();
+        classify_commands(command_line_states.get_linestates(m_buffer));
         if (g_history_autoexpand.get() &&
             (g_history_show_preview.get() ||
              !is_null_or_empty(g_color_histexpand.get())))
@@ -1095,6 +1378,102 @@ void line_editor_impl::classify()
         m_buffer.set_need_draw();
 }
 
+//------------------------------------------------------------------------------
+static void make_classify_key(const line_state& line, str_moveable& out)
+{
+    // Include up to two preceding characters, since they can affect how the
+    // words were collected (see word_collector::collect_words).
+    const uint32 start = line.get_range_offset();
+    const uint32 length = line.get_range_length();
+    const uint32 context = min<uint32>(start, 2);
+    out.clear();
+    out.concat(line.get_line() + start - context, context + length);
+
+    str<> tmp;
+    for (const auto& word : line.get_words())
+    {
+        tmp.format("\x01%u,%u,%u%u%u%u%u,%u", word.offset - start, word.length,
+                   word.command_word, word.is_alias, word.is_redir_arg,
+                   word.is_merged_away, word.quoted, word.delim);
+        out.concat(tmp.c_str(), tmp.length());
+    }
+
+    // Argmatchers can classify differently depending on where the cursor is
+    // within a command.
+    const uint32 cursor = line.get_cursor();
+    if (cursor >= start && cursor <= start + length)
+    {
+        tmp.format("\x02%u", cursor - start);
+        out.concat(tmp.c_str(), tmp.length());
+    }
+}
+
+//------------------------------------------------------------------------------
+// Only commands that changed since they were last classified are passed to the
+// classifier; unchanged commands reuse their saved classifications (shifted to
+// where the command is now).
+void line_editor_impl::classify_commands(const line_states& lines)
+{
+    line_states changed;
+    std::vector<str_moveable> changed_keys;
+
+    str_moveable key;
+    for (const auto& line : lines)
+    {
+        make_classify_key(line, key);
+
+        const cached_classification* found = nullptr;
+        for (const auto& cached : m_classify_cache)
+        {
+            if (cached.key.length() == key.length() &&
+                memcmp(cached.key.c_str(), key.c_str(), key.length()) == 0)
+            {
+                found = &cached;
+                break;
+            }
+        }
+
+        if (found)
+        {
+            m_classifications.restore_command(line.get_range_offset(), found->classifications);
+        }
+        else
+        {
+            changed.push_back(line);
+            changed_keys.emplace_back(std::move(key));
+        }
+    }
+
+    if (changed.empty())
+        return;
+
+    m_classifier->classify(changed, m_classifications);
+
+    // Remember the changed commands' classifications.
+    for (size_t i = 0; i < changed.size(); ++i)
+    {
+        if (m_classify_cache.size() < c_max_cached_classifications)
+            m_classify_cache.emplace_back();
+        cached_classification& cached = m_classify_cache[m_next_classify_cache];
+        m_next_classify_cache = (m_next_classify_cache + 1) % c_max_cached_classifications;
+        cached.key = std::move(changed_keys[i]);
+        m_classifications.save_command(changed[i].get_range_offset(), changed[i].get_range_length(), cached.classifications);
+    }
+
+    if (changed.size() < lines.size())
+        m_classifications.sort_words();
+}
+
+//------------------------------------------------------------------------------
+// Classifiers can depend on state other than the text of a command (e.g. the
+// recognizer, or argmatchers that finished delayed initialization), so the
+// cache is discarded whenever a reclassify is forced.
+void line_editor_impl::clear_classify_cache()
+{
+    m_classify_cache.clear();
+    m_next_classify_cache = 0;
+}
+
 //------------------------------------------------------------------------------
 void line_editor_impl::maybe_send_oncommand_event()
 {
@@ -1186,6 +1565,7 @@ void line_editor_impl::reclassify(reclassify_reason why)
     {
         m_prev_plain = false;
         m_prev_classify.clear();
+        clear_classify_cache();
         m_buffer.set_need_draw();
         m_buffer.draw();
     }
@@ -1343,6 +1723,10 @@ matches* line_editor_impl::get_mutable_matches(bool nosort)
 //------------------------------------------------------------------------------
 void line_editor_impl::update_internal()
 {
+    keystroke_phase_scope phase(keystroke_phase::words);
+
+    m_edit_tick = GetTickCount();
+
     // This is responsible for updating the matches for the word under the
     // cursor.  It tries to call match generators only once for the current
     // word, and then repeatedly filter the results as the word is edited.
@@ -1385,6 +1769,7 @@ void line_editor_impl::update_internal()
                 // gets called before the deferred generate().
                 set_flag(flag_generate);
                 m_matches.set_word_break_position(line.get_end_word_offset());
+                m_speculated_valid = false;
             }
             update_prev_generate = len;
         }
@@ -1416,11 +1801,13 @@ void line_editor_impl::update_internal()
         m_prev_key = next_key;
     }
 
-    // Send oncommand event when command word changes.
-    maybe_send_oncommand_event();
-
-    // Should we collect suggestions?
-    try_suggest();
+    // Send oncommand event when command word changes, and collect suggestions.
+    // Both wait until a burst of queued input ends.
+    if (!m_input_burst && !m_edit_batch)
+    {
+        maybe_send_oncommand_event();
+        try_suggest();
+    }
 
     // Must defer updating m_prev_generate since the old value is still needed
     // for deciding whether to sort/select, after deciding whether to generate.
@@ -1434,6 +1821,8 @@ void line_editor_impl::update_internal()
 //------------------------------------------------------------------------------
 void line_editor_impl::try_suggest()
 {
+    keystroke_phase_scope phase(keystroke_phase::suggest);
+
     if (!g_autosuggest_enable.get())
         return;
 
@@ -1442,50 +1831,56 @@ void line_editor_impl::try_suggest()
     if (host_can_suggest(line))
     {
         matches_impl* matches = nullptr;
-        matches_impl* empty_matches = nullptr;
+        bool remote = false;
 
         if (m_words.size())
         {
             const word& word = m_words.back();
             if (word.offset < m_buffer.get_length() && m_buffer.get_length() - word.offset >= 2)
             {
-                // Use an empty set of matches when a UNC path is detected.
-                // Or when a remote drive is detected (or unknown or invalid).
+                // Detect a UNC path, or a remote drive (or unknown or invalid).
                 // Removable drives are accepted because typically these are
                 // thumb drives these days, which are fast.
                 const char* end_word = m_buffer.get_buffer() + word.offset;
-                bool no_matches = path::is_unc(end_word);
-                if (!no_matches)
+                remote = path::is_unc(end_word);
+                if (!remote)
                 {
                     str<> full;
                     if (os::get_full_path_name(end_word, full, m_buffer.get_length() - word.offset))
                     {
                         path::get_drive(full);
                         path::append(full, ""); // Because get_drive_type() requires a trailing path separator.
-                        no_matches = (os::get_drive_type(full.c_str()) < os::drive_type_removable);
+                        remote = (os::get_drive_type(full.c_str()) < os::drive_type_removable);
                     }
                 }
-                if (no_matches)
-                    matches = empty_matches = new matches_impl;
             }
         }
 
         // Never generate matches here; let it be deferred and happen on demand
-        // in a coroutine.
-        if (!empty_matches && (!g_autosuggest_async.get() ||
-                               (!check_flag(flag_generate) && !m_matches.is_volatile())))
+        // in a coroutine.  Except for remote paths:  generate them here, but
+        // globs only list cached snapshots of network directories (and refresh
+        // them in the background), so that suggestions never wait on the
+        // network.
+        bool partial = false;
+        if (remote || !g_autosuggest_async.get() ||
+            (!check_flag(flag_generate) && !m_matches.is_volatile()))
         {
             // Suggestions must use the TAB completion type, because they
             // cannot work with wildcards or substrings.
             rollback<int32> rb_completion_type(rl_completion_type, TAB);
+            globber::nonblocking_scope nonblocking(remote);
 
+            partial = remote && (check_flag(flag_generate) || m_matches.is_volatile());
             update_matches();
             matches = &m_matches;
         }
 
         host_suggest(lines, matches, m_generation_id);
 
-        delete empty_matches;
+        // Make completion generate the matches again, since non-blocking
+        // globs may have omitted files.
+        if (partial)
+            reset_generate_matches();
     }
 }
 
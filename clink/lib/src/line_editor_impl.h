@@ -69,7 +69,7 @@ public:
 #endif
 
     // input_dispatcher
-    virtual void        dispatch(int32 bind_group) override;
+    virtual void        dispatch(int32 bind_group, input_idle* idle=nullptr) override;
     virtual bool        available(uint32 timeout) override;
     virtual uint8       peek() override;
 
@@ -84,7 +84,11 @@ public:
     void                reclassify(reclassify_reason why);
     void                try_suggest();
     void                force_update_internal(bool restrict=false);
+    void                begin_edit_batch();
+    void                end_edit_batch();
     bool                notify_matches_ready(int32 generation_id, matches* matches);
+    uint32              get_speculate_timeout() const;
+    void                speculate_matches();
     bool                call_lua_rl_global_function(const char* func_name);
     uint32              collect_words(const line_buffer& buffer, std::vector<word>& words, collect_words_mode mode) const;
 
@@ -94,6 +98,7 @@ private:
     typedef std::vector<word>                   words;
     friend void update_matches();
     friend matches* get_mutable_matches(bool nosort);
+    friend const char* get_lazy_match_description(const char* match);
     friend matches* maybe_regenerate_matches(const char* needle, display_filter_flags flags);
     friend bool is_regen_blocked();
     friend void before_display_readline();
@@ -118,13 +123,23 @@ private:
         uint32          cursor_pos : 16;
     };
 
+    struct cached_classification
+    {
+        str_moveable    key;
+        command_classifications classifications;
+    };
+
+    static const uint32 c_max_cached_classifications = 32;
+
     void                initialise();
     void                begin_line();
     void                end_line();
     void                collect_words();
-    command_line_states collect_command_line_states();
+    const command_line_states& collect_command_line_states();
     uint32              collect_words(words& words, matches_impl* matches, collect_words_mode mode, command_line_states& command_line_states);
     void                classify();
+    void                classify_commands(const line_states& lines);
+    void                clear_classify_cache();
     void                maybe_send_oncommand_event();
     matches*            get_mutable_matches(bool nosort=false);
     void                update_internal();
@@ -136,6 +151,7 @@ private:
     void                clear_flag(uint8 flag);
     bool                check_flag(uint8 flag) const;
     bool                maybe_handle_signal();
+    bool                can_speculate() const;
 
     static bool         is_key_same(const key_t& prev_key, const char* prev_line, int32 prev_length,
                                     const key_t& next_key, const char* next_line, int32 next_length,
@@ -164,13 +180,25 @@ private:
     str<64>             m_needle;
 
     prev_buffer         m_prev_generate;
+
+    // Matches generated while idle for the line in m_speculated_line, waiting
+    // for update_matches() to use them.
+    matches_impl        m_speculated;
+    prev_buffer         m_speculated_line;
+    bool                m_speculated_valid = false;
+    uint32              m_edit_tick = 0;
+
     words               m_words;
     unsigned short      m_command_offset = 0;
     command_line_states m_command_line_states;
+    std::vector<command> m_commands;        // Scratch space, reused by collect_words().
 
     bool                m_prev_plain = false;
     prev_buffer         m_prev_classify;
     words               m_classify_words;
+    command_line_states m_classify_command_line_states;
+    std::vector<cached_classification> m_classify_cache;
+    uint32              m_next_classify_cache = 0;
 
     str<16>             m_prev_command_word;
     uint32              m_prev_command_word_offset;
@@ -190,5 +218,13 @@ private:
     // State for dispatch().
     uint8               m_dispatching = 0;
     bool                m_invalid_dispatch = false;
+
+    // Set while inserting a burst of queued input (e.g. a paste); classifying,
+    // suggesting, and redisplaying wait until the burst ends.
+    bool                m_input_burst = false;
+
+    // Nesting depth of edit batches from Lua key bindings; they defer the same
+    // things as an input burst, until the outermost batch ends.
+    uint32              m_edit_batch = 0;
     bind_resolver::binding* m_pending_binding = nullptr;
 };
@@ -6,6 +6,7 @@
 #include "line_editor_integration.h"
 #include "host_callbacks.h"
 #include "match_pipeline.h"
+#include "completion_cache.h"
 #include "reclassify.h"
 #include "suggestions.h"
 
@@ -80,14 +81,26 @@ bool is_regen_blocked()
 }
 
 //------------------------------------------------------------------------------
-void reset_generate_matches()
+// The completion cache is keyed by the line, the cwd, file settings, and the
+// directory's timestamp, so keep_cache can be used when the line is expected to return to a state it
+// was in before (e.g. reactivating select-complete).
+void reset_generate_matches(bool keep_cache)
 {
+    if (!keep_cache)
+        clear_completion_cache();
+
     if (!s_editor)
         return;
 
     s_editor->reset_generate_matches();
 }
 
+//------------------------------------------------------------------------------
+void clear_completion_cache()
+{
+    completion_cache::get().clear();
+}
+
 //------------------------------------------------------------------------------
 void reselect_matches()
 {
@@ -143,6 +156,21 @@ void force_update_internal(bool restrict)
     s_editor->force_update_internal(restrict);
 }
 
+//------------------------------------------------------------------------------
+void begin_edit_batch()
+{
+    if (s_editor)
+        s_editor->begin_edit_batch();
+}
+
+//------------------------------------------------------------------------------
+// WARNING:  This calls Lua using the MAIN coroutine.
+void end_edit_batch()
+{
+    if (s_editor)
+        s_editor->end_edit_batch();
+}
+
 //------------------------------------------------------------------------------
 // WARNING:  This calls Lua using the MAIN coroutine.
 void update_matches()
@@ -153,6 +181,25 @@ void update_matches()
     s_editor->update_matches();
 }
 
+//------------------------------------------------------------------------------
+uint32 get_speculate_matches_timeout()
+{
+    if (!s_editor)
+        return INFINITE;
+
+    return s_editor->get_speculate_timeout();
+}
+
+//------------------------------------------------------------------------------
+// WARNING:  This calls Lua using the MAIN coroutine.
+void speculate_matches()
+{
+    if (!s_editor)
+        return;
+
+    s_editor->speculate_matches();
+}
+
 //------------------------------------------------------------------------------
 // WARNING:  This calls Lua using the MAIN coroutine.
 matches* get_mutable_matches(bool nosort)
@@ -163,6 +210,16 @@ matches* get_mutable_matches(bool nosort)
     return s_editor->get_mutable_matches(nosort);
 }
 
+//------------------------------------------------------------------------------
+// WARNING:  This calls Lua using the MAIN coroutine.
+const char* get_lazy_match_description(const char* match)
+{
+    if (!s_editor)
+        return nullptr;
+
+    return s_editor->m_matches.get_lazy_description(match);
+}
+
 //------------------------------------------------------------------------------
 // WARNING:  This calls Lua using the MAIN coroutine.
 matches* maybe_regenerate_matches(const char* needle, display_filter_flags flags)
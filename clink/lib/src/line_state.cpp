@@ -212,3 +212,9 @@ void line_state::set_can_strip_quotes(bool can)
 {
     s_can_strip_quotes = can;
 }
+
+//------------------------------------------------------------------------------
+bool line_state::can_strip_quotes()
+{
+    return s_can_strip_quotes;
+}
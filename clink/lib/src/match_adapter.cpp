@@ -302,6 +302,18 @@ const char* match_adapter::get_match_display_raw(uint32 index) const
     return nullptr;
 }
 
+//------------------------------------------------------------------------------
+// Same as printable_len(), but uses the cell widths cached in the matches when
+// possible.  TYPE must be the match type for INDEX.
+uint32 match_adapter::get_match_printable_len(uint32 index, match_type type) const
+{
+    const char* match = get_match(index);
+    const matches* matches = m_filtered_matches ? m_filtered_matches : m_alt_matches ? nullptr : m_matches;
+    if (!matches)
+        return printable_len(match, type);
+    return printable_len(match, type, matches->get_match_printable_cells(index));
+}
+
 //------------------------------------------------------------------------------
 uint32 match_adapter::get_match_visible_display(uint32 index) const
 {
@@ -316,10 +328,14 @@ uint32 match_adapter::get_match_visible_display(uint32 index) const
         return 0;
 
     if (display && *display)
+    {
+        if (m_filtered_matches)
+            return m_filtered_matches->get_match_display_cells(index);
+        if (!m_alt_matches)
+            return m_matches->get_match_display_cells(index);
         return cell_count(display);
-    const char* match = get_match(index);
-    match_type type = get_match_type(index);
-    return printable_len(match, type);
+    }
+    return get_match_printable_len(index, get_match_type(index));
 }
 
 //------------------------------------------------------------------------------
@@ -329,7 +345,13 @@ const char* match_adapter::get_match_description(uint32 index) const
     if (m_filtered_matches)
         description = m_filtered_matches->get_match_description(index);
     else if (m_alt_matches)
-        description = lookup_match(m_alt_matches[index + 1]).get_description();
+    {
+        const char* match = m_alt_matches[index + 1];
+        match_details details = lookup_match(match);
+        description = details.get_description();
+        if ((!description || !*description) && (details.get_flags() & MATCH_FLAG_LAZY_DESCRIPTION))
+            description = get_lazy_match_description(match);
+    }
     else if (m_matches)
         description = m_matches->get_match_description(index);
     else
@@ -340,8 +362,16 @@ const char* match_adapter::get_match_description(uint32 index) const
 //------------------------------------------------------------------------------
 uint32 match_adapter::get_match_visible_description(uint32 index) const
 {
-    const char* description = get_match_description(index);
-    return description ? cell_count(description) : 0;
+    if (m_filtered_matches)
+        return m_filtered_matches->get_match_description_cells(index);
+    if (m_alt_matches)
+    {
+        const char* description = get_match_description(index);
+        return description ? cell_count(description) : 0;
+    }
+    if (m_matches)
+        return m_matches->get_match_description_cells(index);
+    return 0;
 }
 
 //------------------------------------------------------------------------------
@@ -460,7 +490,7 @@ bool match_adapter::has_descriptions() const
                 if (details)
                 {
                     const char* desc = details.get_description();
-                    if (desc && *desc)
+                    if ((desc && *desc) || (details.get_flags() & MATCH_FLAG_LAZY_DESCRIPTION))
                     {
                         m_alt_cached.m_has_descriptions = true;
                         break;
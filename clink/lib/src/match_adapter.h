@@ -32,6 +32,7 @@ public:
     match_type      get_match_type(uint32 index) const;
     const char*     get_match_display(uint32 index) const;
     const char*     get_match_display_raw(uint32 index) const;
+    uint32          get_match_printable_len(uint32 index, match_type type) const;
     uint32          get_match_visible_display(uint32 index) const;
     const char*     get_match_description(uint32 index) const;
     uint32          get_match_visible_description(uint32 index) const;
@@ -33,9 +33,14 @@
 #include <core/os.h>
 #include <core/path.h>
 #include <core/settings.h>
+#include <core/str_transform.h>
 #include <wildmatch/wildmatch.h>
 
+#include <string>
+#include <unordered_map>
+
 #include "match_colors.h"
+#include "deferred_init.h"
 
 extern "C" {
 #define READLINE_LIBRARY
@@ -169,6 +174,8 @@ static const char* s_error_context = nullptr;
 //------------------------------------------------------------------------------
 bool is_colored(indicator_no colored_filetype)
 {
+    ensure_deferred_init(deferred_init_task::match_colors);
+
     char const* s = s_colors[colored_filetype];
     if (!s || !*s)          return false;   // Empty.
     else if (*(s++) != '0') return true;
@@ -182,6 +189,7 @@ bool is_colored(indicator_no colored_filetype)
 struct color_pattern
 {
     str<8> m_pattern;                       // Wildmatch pattern to compare.
+    str<8> m_ext;                           // Lowercase ".ext" if the pattern is just "*.ext".
     bool m_only_filename;                   // Compare pattern to filename portion only.
     bool m_not;                             // Use the inverse of whether it matches.
 };
@@ -192,9 +200,37 @@ struct color_rule
     int32 m_not_cflags;                     // Flags that must NOT be set.
     std::vector<color_pattern> m_patterns;  // Wildmatch patterns to match.
     str<16> m_seq;                          // The sequence to output when matched.
+    bool m_ext_only;                        // Patterns depend only on the extension.
+};
+
+//------------------------------------------------------------------------------
+// Which rule applies to a match depends only on its flags and its filename.
+// For most rules the filename part is just "*.ext" patterns, so the outcome of
+// each (flags, extension) pair is cached.  A lookup either has the final
+// answer, or says which rule needs to be evaluated with wildmatch first.
+struct rule_lookup
+{
+    int32 m_rule;                           // Matched rule, or rule to resume at.
+    bool m_final;                           // Whether m_rule is the final answer (-1 means none).
 };
 
 static std::vector<color_rule> s_color_rules;
+static std::unordered_map<std::string, rule_lookup> s_rule_lookups;
+
+//------------------------------------------------------------------------------
+// Readline's LS_COLORS extension list is compiled into a table keyed by the
+// lowercase extension.  Entries that aren't simple extensions (e.g. "*.tar.gz"
+// or "*README") are kept in list order and checked as suffixes.
+struct ls_ext_entry
+{
+    uint32 m_index;                         // Position in _rl_color_ext_list.
+    const COLOR_EXT_TYPE* m_ext;
+};
+
+static std::unordered_map<std::string, ls_ext_entry> s_ls_ext_map;
+static std::vector<ls_ext_entry> s_ls_ext_suffixes;
+
+static const uint32 c_max_rule_lookups = 1024;
 static str_moveable s_completion_prefix;
 static bool s_using_color_rules = false;
 static bool s_norm_colored = false;
@@ -212,6 +248,177 @@ static char* copy_str(const char* str, int32 len)
     return p;
 }
 
+//------------------------------------------------------------------------------
+// Appends the lowercase extension (including the dot) of the name, or nothing
+// if the name has no extension.  Returns false if the extension contains any
+// non-ASCII characters.
+static bool get_lower_ext(const char* name, int32 len, std::string& out)
+{
+    const char* end = name + len;
+    const char* dot = nullptr;
+    for (const char* p = end; p > name;)
+    {
+        if (*(--p) == '.')
+        {
+            dot = p;
+            break;
+        }
+    }
+
+    if (!dot)
+        return true;
+
+    for (const char* p = dot; p < end; ++p)
+    {
+        if (uint8(*p) >= 0x80)
+            return false;
+        out.push_back(ascii_tolower(*p));
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Returns whether the extension is just a dot followed by plain ASCII
+// characters, so that it can only ever match the last extension of a name.
+static bool is_simple_ext(const char* ext, int32 len)
+{
+    if (len < 2 || ext[0] != '.')
+        return false;
+    for (int32 i = 1; i < len; ++i)
+    {
+        const uint8 c = uint8(ext[i]);
+        if (c >= 0x80 || c <= ' ' || strchr(".*?[\\/", c))
+            return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+static void compile_rule(color_rule& rule)
+{
+    rule.m_ext_only = true;
+    for (auto& pat : rule.m_patterns)
+    {
+        const char* p = pat.m_pattern.c_str();
+        if (pat.m_only_filename && p[0] == '*' && is_simple_ext(p + 1, pat.m_pattern.length() - 1))
+        {
+            std::string ext;
+            get_lower_ext(p + 1, pat.m_pattern.length() - 1, ext);
+            pat.m_ext = ext.c_str();
+        }
+        else
+        {
+            rule.m_ext_only = false;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+static rule_lookup lookup_rule(int32 cflags, const char* name)
+{
+    std::string key;
+    key.push_back(char(cflags + 1));
+    if (!get_lower_ext(name, int32(strlen(name)), key))
+        return { 0, false };
+
+    const auto found = s_rule_lookups.find(key);
+    if (found != s_rule_lookups.end())
+        return found->second;
+
+    const char* const ext = key.c_str() + 1;
+    rule_lookup lookup = { -1, true };
+    for (int32 i = 0; i < int32(s_color_rules.size()); ++i)
+    {
+        const auto& rule = s_color_rules[i];
+        if (rule.m_cflags && (cflags & rule.m_cflags) != rule.m_cflags)
+            continue;
+        if (rule.m_not_cflags && (cflags & rule.m_not_cflags) != 0)
+            continue;
+
+        if (!rule.m_ext_only)
+        {
+            lookup = { i, false };
+            break;
+        }
+
+        bool matched = true;
+        for (const auto& pat : rule.m_patterns)
+        {
+            if (pat.m_ext.equals(ext) == pat.m_not)
+            {
+                matched = false;
+                break;
+            }
+        }
+
+        if (matched)
+        {
+            lookup = { i, true };
+            break;
+        }
+    }
+
+    if (s_rule_lookups.size() >= c_max_rule_lookups)
+        s_rule_lookups.clear();
+    s_rule_lookups.emplace(std::move(key), lookup);
+    return lookup;
+}
+
+//------------------------------------------------------------------------------
+static void compile_ls_ext_list()
+{
+    s_ls_ext_map.clear();
+    s_ls_ext_suffixes.clear();
+
+    uint32 index = 0;
+    for (const COLOR_EXT_TYPE* e = _rl_color_ext_list; e; e = e->next, ++index)
+    {
+        if (!e->ext.string)
+            continue;
+        if (is_simple_ext(e->ext.string, int32(e->ext.len)))
+        {
+            std::string ext;
+            get_lower_ext(e->ext.string, int32(e->ext.len), ext);
+            s_ls_ext_map.emplace(std::move(ext), ls_ext_entry { index, e });
+        }
+        else
+        {
+            s_ls_ext_suffixes.push_back({ index, e });
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+static const COLOR_EXT_TYPE* find_ls_ext(const char* name, size_t len)
+{
+    uint32 limit = UINT32_MAX;
+    const COLOR_EXT_TYPE* found = nullptr;
+
+    std::string ext;
+    if (get_lower_ext(name, int32(len), ext) && !ext.empty())
+    {
+        const auto i = s_ls_ext_map.find(ext);
+        if (i != s_ls_ext_map.end())
+        {
+            limit = i->second.m_index;
+            found = i->second.m_ext;
+        }
+    }
+
+    // An earlier entry in the list takes precedence, same as a linear search.
+    const char* const end = name + len;
+    for (const auto& entry : s_ls_ext_suffixes)
+    {
+        if (entry.m_index >= limit)
+            break;
+        const COLOR_EXT_TYPE* e = entry.m_ext;
+        if (e->ext.len <= len && _strnicmp(end - e->ext.len, e->ext.string, e->ext.len) == 0)
+            return e;
+    }
+
+    return found;
+}
+
 //------------------------------------------------------------------------------
 // Returns the delimiter character that was encountered, or 0 for NUL
 // terminator, or -1 for syntax error.
@@ -619,6 +826,9 @@ void parse_match_colors()
 
     std::vector<color_rule> empty;
     s_color_rules.swap(empty);
+    s_rule_lookups.clear();
+    s_ls_ext_map.clear();
+    s_ls_ext_suffixes.clear();
     g_common_match_prefix.get(s_completion_prefix);
     s_using_color_rules = false;
     s_colored_stats = false;
@@ -641,6 +851,7 @@ void parse_match_colors()
     else if (_rl_colored_stats || _rl_colored_completion_prefix)
     {
         _rl_parse_colors();
+        compile_ls_ext_list();
 
         if (_rl_colored_completion_prefix > 0)
         {
@@ -728,6 +939,7 @@ void parse_match_colors()
                     color_rule rule;
                     if (parse_rule(str_iter(token.c_str(), token.length()), value, rule))
                     {
+                        compile_rule(rule);
                         s_colored_stats = true;
                         s_color_rules.emplace_back(std::move(rule));
                     }
@@ -752,6 +964,7 @@ void parse_match_colors()
 //------------------------------------------------------------------------------
 bool using_match_colors()
 {
+    ensure_deferred_init(deferred_init_task::match_colors);
     return _rl_colored_stats || s_colored_stats;
 }
 
@@ -765,6 +978,8 @@ static void ls_concat_color_indicator(enum indicator_no colored_filetype, str_ba
 //------------------------------------------------------------------------------
 void ls_make_color(const char* seq, int32 len, str_base& out)
 {
+    ensure_deferred_init(deferred_init_task::match_colors);
+
     // Need to reset so not dealing with attribute combinations.
     if (s_norm_colored)
     {
@@ -779,6 +994,8 @@ void ls_make_color(const char* seq, int32 len, str_base& out)
 //------------------------------------------------------------------------------
 void make_color(const char* seq, str_base& out)
 {
+    ensure_deferred_init(deferred_init_task::match_colors);
+
     // Need to reset so not dealing with attribute combinations.
     if (s_norm_colored)
         out << s_colors[C_LEFT] << s_colors[C_RIGHT];
@@ -789,7 +1006,7 @@ void make_color(const char* seq, str_base& out)
 static bool get_ls_color(const char *f, match_type type, str_base& out)
 {
     enum indicator_no colored_filetype;
-    COLOR_EXT_TYPE *ext; // Color extension.
+    const COLOR_EXT_TYPE *ext; // Color extension.
     size_t len;          // Length of name.
 
     const char *name;
@@ -909,13 +1126,7 @@ static bool get_ls_color(const char *f, match_type type, str_base& out)
     {
         // Test if NAME has a recognized suffix.
         len = strlen(name);
-        name += len; // Pointer to final \0.
-        for (ext = _rl_color_ext_list; ext != nullptr; ext = ext->next)
-        {
-            if (ext->ext.len <= len && _strnicmp(name - ext->ext.len, ext->ext.string,
-                                                 ext->ext.len) == 0)
-                break;
-        }
+        ext = find_ls_ext(name, len);
     }
 
     free(filename); // nullptr or savestring return value.
@@ -1104,13 +1315,23 @@ bool get_match_color(const char* f, match_type type, str_base& out)
             colored_filetype = indicator_no(C_DIR);
     }
 
-    // Look for a matching rule.  First match wins.
+    str<> no_trailing_sep(name);
+    if (cflags & CFLAG_DIR)
+        path::maybe_strip_last_separator(no_trailing_sep);
+    str<> only_name(path::get_name(no_trailing_sep.c_str()));
+
+    // Look for a matching rule.  First match wins.  The lookup usually knows
+    // the answer already; otherwise it says where to start using wildmatch.
     const char* seq = nullptr;
     const int32 bits = WM_CASEFOLD|WM_SLASHFOLD|WM_WILDSTAR;
-    str<> no_trailing_sep;
-    str<> only_name;
-    for (const auto& rule : s_color_rules)
+    const rule_lookup lookup = lookup_rule(cflags, only_name.c_str());
+    if (lookup.m_final && lookup.m_rule >= 0)
+        seq = s_color_rules[lookup.m_rule].m_seq.c_str();
+    const size_t first = lookup.m_final ? s_color_rules.size() : size_t(lookup.m_rule);
+    for (size_t i = first; i < s_color_rules.size(); ++i)
     {
+        const auto& rule = s_color_rules[i];
+
         // Try to match flags.
         if (rule.m_cflags && (cflags & rule.m_cflags) != rule.m_cflags)
             goto next_rule;
@@ -1120,23 +1341,7 @@ bool get_match_color(const char* f, match_type type, str_base& out)
         // Try to match patterns.
         for (const auto& pat : rule.m_patterns)
         {
-            const char* n = name;
-            if (cflags & CFLAG_DIR)
-            {
-                if (no_trailing_sep.empty())
-                {
-                    no_trailing_sep = name;
-                    path::maybe_strip_last_separator(no_trailing_sep);
-                }
-                n = no_trailing_sep.c_str();
-            }
-            if (pat.m_only_filename)
-            {
-                if (only_name.empty())
-                    only_name = path::get_name(n);
-                n = only_name.c_str();
-            }
-
+            const char* n = pat.m_only_filename ? only_name.c_str() : no_trailing_sep.c_str();
             if (wildmatch(pat.m_pattern.c_str(), n, bits) != (pat.m_not ? WM_NOMATCH : WM_MATCH))
                 goto next_rule;
         }
@@ -1166,6 +1371,7 @@ next_rule:
 //------------------------------------------------------------------------------
 const char* get_indicator_color(indicator_no colored_filetype)
 {
+    ensure_deferred_init(deferred_init_task::match_colors);
     return s_colors[colored_filetype];
 }
 
@@ -7,6 +7,7 @@
 #include "match_pipeline.h"
 #include "matches_impl.h"
 #include "display_matches.h"
+#include "fuzzy_match.h"
 #include "slash_translation.h"
 
 #include <core/array.h>
@@ -128,30 +129,95 @@ static uint32 pattern_selector(
 
 //------------------------------------------------------------------------------
 template<class INDEXER>
-static void select_matches(const char* needle, INDEXER& indexer, uint32 count)
+static uint32 fuzzy_selector(
+    const char* needle,
+    INDEXER& indexer,
+    int32 count)
 {
-    uint32 found = 0;
-
-    const bool dot_prefix = (rl_completion_type == '%' && g_default_bindings.get() == 1);
-    if (dot_prefix || g_match_wild.get())
+    fuzzy_matcher matcher(needle);
+    int32 select_count = 0;
+    for (int32 i = 0; i < count; ++i)
     {
-        str<> pat(needle);
-        pat << "*";
-        found = pattern_selector(pat.c_str(), indexer, count, dot_prefix);
+        auto& info = indexer.get_info(i);
+        const char* const match = info.match;
+        int32 match_len = int32(strlen(match));
+        while (match_len && path::is_separator(uint8(match[match_len - 1])))
+            match_len--;
+
+        int32 score = fuzzy_matcher::no_match;
+        if ((_rl_match_hidden_files || !HIDDEN_FILE(match)) &&
+            include_match_type(info.type))
+            score = matcher.score(match, match_len);
+
+        const bool select = (score != fuzzy_matcher::no_match);
+        info.select = select;
+        info.score = select ? score : 0;
+        if (select)
+            ++select_count;
     }
-    else
+    return select_count;
+}
+
+//------------------------------------------------------------------------------
+// Only the first SUBSET matches are tested; the rest must already be
+// unselected.  SELECTOR says which selector selected the subset, and receives
+// which selector made this selection.  Each selector is only tried when the
+// ones before it select nothing, so nothing in a subset can match the
+// selectors before the one that selected it.
+template<class INDEXER>
+static void select_matches(const char* needle, INDEXER& indexer, uint32 count, uint32 subset, match_selector& selector)
+{
+    const bool dot_prefix = (rl_completion_type == '%' && g_default_bindings.get() == 1);
+
+    if (selector == match_selector::prefix)
     {
-        found = prefix_selector(needle, indexer, count);
+        uint32 found;
+        if (dot_prefix || g_match_wild.get())
+        {
+            str<> pat(needle);
+            pat << "*";
+            found = pattern_selector(pat.c_str(), indexer, subset, dot_prefix);
+        }
+        else
+        {
+            found = prefix_selector(needle, indexer, subset);
+        }
+
+        if (found)
+            return;
+
+        // Later selectors can match outside a subset selected by an earlier
+        // one.
+        selector = match_selector::substring;
+        subset = count;
     }
 
-    if (!found && can_try_substring_pattern(needle))
+    if (selector == match_selector::substring)
     {
-        char* sub = make_substring_pattern(needle, "*");
-        if (sub)
+        if (can_try_substring_pattern(needle))
         {
-            pattern_selector(sub, indexer, count, dot_prefix);
-            free(sub);
+            char* sub = make_substring_pattern(needle, "*");
+            if (sub)
+            {
+                const uint32 found = pattern_selector(sub, indexer, subset, dot_prefix);
+                free(sub);
+                if (found)
+                    return;
+            }
         }
+
+        selector = match_selector::fuzzy;
+        subset = count;
+    }
+
+    if (can_try_fuzzy_match(needle))
+    {
+        fuzzy_selector(needle, indexer, subset);
+    }
+    else
+    {
+        for (uint32 i = 0; i < subset; ++i)
+            indexer.get_info(i).select = false;
     }
 }
 
@@ -254,10 +320,166 @@ bool compare_matches(const char* l, match_type l_type, const char* r, match_type
     return sort_worker(ltmp, l_type, rtmp, r_type, g_sort_dirs.get());
 }
 
+//------------------------------------------------------------------------------
+// Sorting compares each match many times, so converting matches to UTF16 and
+// calling CompareStringW for every comparison gets expensive with large
+// numbers of matches.  Instead, the sorter builds a sort key per match once,
+// and then sorts by comparing the keys.  The keys produce the same order as
+// sort_worker(), since LCMapStringW sort keys compare the same as
+// CompareStringW with the same flags.
+class match_sort_keys
+{
+public:
+    bool                    build(const match_info* infos, int32 count);
+    bool                    less(uint32 l, uint32 r, int32 order) const;
+
+private:
+    struct entry
+    {
+        uint32              key;                // Offset of caseless key.
+        uint32              key_len;
+        uint32              exact;              // Offset of case sensitive key.
+        uint32              exact_len;
+        uint16              minus;              // Number of leading minus signs.
+        uint8               type_rank;
+        bool                dir;
+    };
+
+    bool                    add_key(DWORD flags, const wstr_base& s, uint32& offset, uint32& len);
+    static int32            compare(const uint8* l, uint32 l_len, const uint8* r, uint32 r_len);
+    static uint8            get_type_rank(match_type type);
+    std::vector<entry>      m_entries;
+    std::vector<uint8>      m_keys;
+};
+
+//------------------------------------------------------------------------------
+bool match_sort_keys::build(const match_info* infos, int32 count)
+{
+    const DWORD flags = SORT_DIGITSASNUMBERS|NORM_LINGUISTIC_CASING;
+
+    m_entries.clear();
+    m_keys.clear();
+    m_entries.reserve(count);
+
+    wstr<> tmp;
+    for (int32 i = 0; i < count; ++i)
+    {
+        tmp.clear();
+        to_utf16(tmp, infos[i].match);
+
+        entry e = {};
+        e.dir = is_dir_match(tmp, infos[i].type);
+        if (e.dir)
+            path::maybe_strip_last_separator(tmp);
+        for (const wchar_t* walk = tmp.c_str(); *walk == '-' && e.minus < 0xffff; ++walk)
+            e.minus++;
+        e.type_rank = get_type_rank(infos[i].type);
+
+        if (!add_key(flags|LINGUISTIC_IGNORECASE, tmp, e.key, e.key_len) ||
+            !add_key(flags, tmp, e.exact, e.exact_len))
+            return false;
+
+        m_entries.push_back(e);
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool match_sort_keys::less(uint32 l, uint32 r, int32 order) const
+{
+    const entry& le = m_entries[l];
+    const entry& re = m_entries[r];
+
+    if (order != 1 && le.dir != re.dir)
+        return (order == 0) ? le.dir : re.dir;
+
+    // Sort first by number of leading minus signs.  This is intended so that
+    // `-` flags precede `--` flags.
+    if (le.minus != re.minus)
+        return le.minus < re.minus;
+
+    // Sort next by the strings, case insensitively and then case sensitively
+    // for consistent ordering.
+    const uint8* keys = m_keys.data();
+    int32 cmp = compare(keys + le.key, le.key_len, keys + re.key, re.key_len);
+    if (cmp) return (cmp < 0);
+    cmp = compare(keys + le.exact, le.exact_len, keys + re.exact, re.exact_len);
+    if (cmp) return (cmp < 0);
+
+    // Finally sort by type (dir, alias, command, word, arg, file).
+    return le.type_rank < re.type_rank;
+}
+
+//------------------------------------------------------------------------------
+bool match_sort_keys::add_key(DWORD flags, const wstr_base& s, uint32& offset, uint32& len)
+{
+    flags |= LCMAP_SORTKEY;
+    const int32 needed = LCMapStringW(LOCALE_USER_DEFAULT, flags, s.c_str(), s.length(), nullptr, 0);
+    if (needed <= 0)
+        return false;
+
+    offset = uint32(m_keys.size());
+    m_keys.resize(m_keys.size() + needed);
+    len = LCMapStringW(LOCALE_USER_DEFAULT, flags, s.c_str(), s.length(), LPWSTR(m_keys.data() + offset), needed);
+    if (!len)
+        return false;
+
+    m_keys.resize(offset + len);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+int32 match_sort_keys::compare(const uint8* l, uint32 l_len, const uint8* r, uint32 r_len)
+{
+    const int32 cmp = memcmp(l, r, min(l_len, r_len));
+    if (cmp)
+        return cmp;
+    return int32(l_len) - int32(r_len);
+}
+
+//------------------------------------------------------------------------------
+// Matches of types that sort_worker() tests earlier sort later; the rank
+// encodes that order so types can be compared with a single comparison.
+uint8 match_sort_keys::get_type_rank(match_type type)
+{
+    switch (uint8(type) & MATCH_TYPE_MASK)
+    {
+    case MATCH_TYPE_DIR:        return 6;
+    case MATCH_TYPE_ALIAS:      return 5;
+    case MATCH_TYPE_COMMAND:    return 4;
+    case MATCH_TYPE_WORD:       return 3;
+    case MATCH_TYPE_ARG:        return 2;
+    case MATCH_TYPE_FILE:       return 1;
+    default:                    return 0;
+    }
+}
+
 //------------------------------------------------------------------------------
 static void alpha_sorter(match_info* infos, int32 count)
 {
     int32 order = g_sort_dirs.get();
+
+    match_sort_keys keys;
+    if (keys.build(infos, count))
+    {
+        std::vector<uint32> indices(count);
+        for (int32 i = 0; i < count; ++i)
+            indices[i] = i;
+
+        std::sort(indices.begin(), indices.end(), [&] (uint32 l, uint32 r) {
+            return keys.less(l, r, order);
+        });
+
+        std::vector<match_info> sorted;
+        sorted.reserve(count);
+        for (uint32 i : indices)
+            sorted.push_back(infos[i]);
+        std::copy(sorted.begin(), sorted.end(), infos);
+        return;
+    }
+
+    // Fall back to comparing the strings directly if sort keys can't be made.
     wstr<> ltmp;
     wstr<> rtmp;
 
@@ -381,17 +603,25 @@ void match_pipeline::restrict(str_base& needle) const
         // WARNING:  This is subtly different from select_matches().
         const bool dot_prefix = (rl_completion_type == '%' && g_default_bindings.get() == 1);
 
+        bool ranked = false;
         match_info_indexer indexer(m_matches.get_infos());
-        if (!pattern_selector(needle.c_str(), indexer, count, dot_prefix) &&
-            can_try_substring_pattern(needle.c_str()))
+        if (!pattern_selector(needle.c_str(), indexer, count, dot_prefix))
         {
-            char* sub = make_substring_pattern(needle.c_str());
-            if (sub)
+            uint32 found = 0;
+            if (can_try_substring_pattern(needle.c_str()))
             {
-                pattern_selector(sub, indexer, count, dot_prefix);
-                free(sub);
+                char* sub = make_substring_pattern(needle.c_str());
+                if (sub)
+                {
+                    found = pattern_selector(sub, indexer, count, dot_prefix);
+                    free(sub);
+                }
             }
+
+            if (!found && can_try_fuzzy_match(needle.c_str()))
+                ranked = !!fuzzy_selector(needle.c_str(), indexer, count);
         }
+        m_matches.m_ranked = ranked;
     }
 
     m_matches.coalesce(count, true/*restrict*/);
@@ -452,12 +682,35 @@ void match_pipeline::select(const char* needle) const
 
     if (count)
     {
+        // When the needle extends the previous needle, the new selection is a
+        // subset of the previous selection, which coalesce() moved to the
+        // front.  Backspacing or changing the needle tests all matches again.
+        auto& prev = m_matches.m_prev_select;
+        const bool wild = (rl_completion_type == '%' && g_default_bindings.get() == 1) || g_match_wild.get();
+        uint32 subset = count;
+        match_selector selector = match_selector::prefix;
+        if (prev.valid &&
+            prev.completion_type == rl_completion_type &&
+            prev.wild == wild &&
+            strncmp(needle, prev.needle.c_str(), prev.needle.length()) == 0)
+        {
+            subset = m_matches.get_match_count();
+            selector = prev.selector;
+        }
+
         match_info_indexer indexer(m_matches.get_infos());
-        select_matches(needle, indexer, count);
+        select_matches(needle, indexer, count, subset, selector);
         m_matches.set_completion_type(rl_completion_type);
+        m_matches.m_ranked = (selector == match_selector::fuzzy);
+
+        prev.needle = needle;
+        prev.completion_type = rl_completion_type;
+        prev.wild = wild;
+        prev.selector = selector;
     }
 
     m_matches.coalesce(count);
+    m_matches.m_prev_select.valid = (count > 0);
 
 #ifdef DEBUG
     if (dbg_get_env_int("DEBUG_PIPELINE"))
@@ -486,4 +739,13 @@ void match_pipeline::sort() const
         ordinal_sorter(m_matches.get_infos(), count); // "no sort" means "original order".
     else
         alpha_sorter(m_matches.get_infos(), count);
+
+    // Fuzzy matches are listed best match first.
+    if (m_matches.m_ranked)
+    {
+        match_info* infos = m_matches.get_infos();
+        std::stable_sort(infos, infos + count, [] (const match_info& a, const match_info& b) {
+            return a.score > b.score;
+        });
+    }
 }
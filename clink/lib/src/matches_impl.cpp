@@ -6,6 +6,7 @@
 #include "match_generator.h"
 #include "match_pipeline.h"
 #include "slash_translation.h"
+#include "display_matches.h"
 
 #include <core/base.h>
 #include <core/os.h>
@@ -16,6 +17,7 @@
 #include <core/str_tokeniser.h>
 #include <core/match_wild.h>
 #include <core/path.h>
+#include <terminal/ecma48_iter.h>
 #include <sys/stat.h>
 
 extern "C" {
@@ -50,28 +52,130 @@ static setting_bool g_substring(
     false
 );
 
+static setting_bool g_fuzzy(
+    "match.fuzzy",
+    "Try fuzzy matching if nothing else matches",
+    "When set, if no completions are found with a prefix search (or a substring\n"
+    "search, when 'match.substring' is set), then completions that contain the\n"
+    "typed characters in order are used.  They are listed best match first;\n"
+    "for example 'mpc' matches 'match_pipeline.cpp'.",
+    false
+);
+
 extern setting_bool g_match_wild;
 extern setting_enum g_default_bindings;
 
 
 
 //------------------------------------------------------------------------------
-struct matches_impl::match_lookup_hasher
+static const char* const c_erased_slot = reinterpret_cast<const char*>(uintptr_t(1));
+
+//------------------------------------------------------------------------------
+void match_dedup_table::clear()
 {
-    size_t operator()(const match_lookup& info) const
+    m_slots = nullptr;
+    m_capacity = 0;
+    m_used = 0;
+}
+
+//------------------------------------------------------------------------------
+bool match_dedup_table::find(const char* match, match_type type) const
+{
+    return m_slots && lookup(match, type, str_fast_hash(match))->match;
+}
+
+//------------------------------------------------------------------------------
+// The caller must ensure MATCH isn't already in the table, and MATCH must
+// remain valid as long as the table does.
+bool match_dedup_table::insert(linear_allocator& store, const char* match, match_type type)
+{
+    assert(!find(match, type));
+
+    // Keep the load factor at or below 1/2, so probe runs stay short.
+    if ((m_used + 1) * 2 > m_capacity && !grow(store))
+        return false;
+
+    const uint32 hash = str_fast_hash(match);
+    const uint32 mask = m_capacity - 1;
+    for (uint32 i = hash & mask;; i = (i + 1) & mask)
     {
-        return str_hash(info.match);
+        slot& s = m_slots[i];
+        if (!s.match || s.match == c_erased_slot)
+        {
+            if (!s.match)
+                ++m_used;
+            s.match = match;
+            s.hash = hash;
+            s.type = type;
+            return true;
+        }
     }
-};
+}
+
+//------------------------------------------------------------------------------
+void match_dedup_table::erase(const char* match, match_type type)
+{
+    if (!m_slots)
+        return;
+
+    slot* s = lookup(match, type, str_fast_hash(match));
+    if (s->match)
+        s->match = c_erased_slot;
+}
 
 //------------------------------------------------------------------------------
-struct matches_impl::match_lookup_comparator
+// Returns the slot containing MATCH, or else the empty slot that ends its probe
+// run.
+match_dedup_table::slot* match_dedup_table::lookup(const char* match, match_type type, uint32 hash) const
 {
-    bool operator()(const match_lookup& i1, const match_lookup& i2) const
+    assert(m_slots);
+    const uint32 mask = m_capacity - 1;
+    for (uint32 i = hash & mask;; i = (i + 1) & mask)
     {
-        return (i1.type == i2.type && strcmp(i1.match, i2.match) == 0);
+        slot* s = m_slots + i;
+        if (!s->match)
+            return s;
+        if (s->match != c_erased_slot &&
+            s->hash == hash &&
+            s->type == type &&
+            strcmp(s->match, match) == 0)
+            return s;
     }
-};
+}
+
+//------------------------------------------------------------------------------
+bool match_dedup_table::grow(linear_allocator& store)
+{
+    const uint32 capacity = m_capacity ? m_capacity * 2 : 256;
+
+    // The store doesn't align its allocations.
+    const uint32 bytes = capacity * sizeof(slot) + alignof(slot) - 1;
+    void* mem = store.alloc(bytes);
+    if (!mem)
+        return false;
+    memset(mem, 0, bytes);
+    slot* slots = reinterpret_cast<slot*>((uintptr_t(mem) + alignof(slot) - 1) & ~uintptr_t(alignof(slot) - 1));
+
+    // Rehash the live slots; erased slots are dropped.
+    uint32 used = 0;
+    const uint32 mask = capacity - 1;
+    for (uint32 j = 0; j < m_capacity; ++j)
+    {
+        const slot& old = m_slots[j];
+        if (!old.match || old.match == c_erased_slot)
+            continue;
+        uint32 i = old.hash & mask;
+        while (slots[i].match)
+            i = (i + 1) & mask;
+        slots[i] = old;
+        ++used;
+    }
+
+    m_slots = slots;
+    m_capacity = capacity;
+    m_used = used;
+    return true;
+}
 
 
 
@@ -232,6 +336,7 @@ match_desc::match_desc(const char* match, const char* display, const char* descr
     suppress_append = -1;
     append_display = false;
     missing_match = false;
+    lazy_description = false;
 
     // Do not append a space after an arg type match that ends with a colon or
     // equal sign, because programs typically require flags and args like
@@ -276,6 +381,13 @@ bool match_builder::is_empty()
     return ((matches_impl&)m_matches).get_match_count() == 0;
 }
 
+//------------------------------------------------------------------------------
+// Makes room for COUNT more matches, for callers that add a batch at once.
+void match_builder::reserve(uint32 count)
+{
+    ((matches_impl&)m_matches).reserve(count);
+}
+
 //------------------------------------------------------------------------------
 void match_builder::set_append_character(char append)
 {
@@ -324,6 +436,41 @@ void match_builder::set_volatile()
     return ((matches_impl&)m_matches).set_volatile();
 }
 
+//------------------------------------------------------------------------------
+// Limits how many matches can be added, for callers that only need the first
+// few matches (e.g. suggestions).  Generators can check is_full() to stop
+// early.
+void match_builder::set_limit(uint32 count)
+{
+    ((matches_impl&)m_matches).set_limit(count);
+}
+
+//------------------------------------------------------------------------------
+uint32 match_builder::get_limit() const
+{
+    return ((const matches_impl&)m_matches).get_limit();
+}
+
+//------------------------------------------------------------------------------
+bool match_builder::is_full() const
+{
+    return ((const matches_impl&)m_matches).is_full();
+}
+
+//------------------------------------------------------------------------------
+void match_builder::set_cacheable()
+{
+    return ((matches_impl&)m_matches).set_cacheable();
+}
+
+//------------------------------------------------------------------------------
+// Called between generators once matches have been added, so that later
+// generators can't mark the combined matches as cacheable.
+void match_builder::disable_cache()
+{
+    return ((matches_impl&)m_matches).disable_cache();
+}
+
 //------------------------------------------------------------------------------
 void match_builder::set_input_line(const char* text)
 {
@@ -489,6 +636,12 @@ const char* matches_iter::get_match_description() const
     return has_match() ? m_matches.get_match_description(m_index) : nullptr;
 }
 
+//------------------------------------------------------------------------------
+bool matches_iter::is_match_description_lazy() const
+{
+    return has_match() && m_matches.is_match_description_lazy(m_index);
+}
+
 //------------------------------------------------------------------------------
 char matches_iter::get_match_append_char() const
 {
@@ -547,7 +700,7 @@ bool matches_iter::try_substring()
 
 //------------------------------------------------------------------------------
 matches_impl::store_impl::store_impl(uint32 size)
-: linear_allocator(max<uint32>(4096, size))
+: linear_allocator(max<uint32>(4096, size), mem_tag::matches)
 {
 }
 
@@ -564,7 +717,6 @@ matches_impl::matches_impl(uint32 store_size)
 //------------------------------------------------------------------------------
 matches_impl::~matches_impl()
 {
-    delete m_dedup;
 }
 
 //------------------------------------------------------------------------------
@@ -600,18 +752,39 @@ match_info* matches_impl::get_infos()
 //------------------------------------------------------------------------------
 void matches_impl::get_lcd(str_base& out) const
 {
-    for (uint32 i = 0; i < m_count; i++)
+    // The prefix depends on the string comparison mode, which callers can
+    // change with str_compare_scope (e.g. suggestions compare caselessly).
+    if (!m_lcd_valid ||
+        m_lcd_mode != str_compare_scope::current() ||
+        m_lcd_fuzzy_accents != str_compare_scope::current_fuzzy_accents())
     {
-        const char *match = m_infos[i].match;
-        if (!i)
-        {
-            out = match;
-        }
-        else
-        {
-            int32 matching = str_compare<char, true/*compute_lcd*/>(out.c_str(), match);
-            out.truncate(matching);
-        }
+        m_lcd.clear();
+        for (uint32 i = 0; i < m_count; i++)
+            narrow_lcd(m_infos[i].match, !i);
+        m_lcd_valid = true;
+    }
+
+    out = m_lcd.c_str();
+}
+
+//------------------------------------------------------------------------------
+void matches_impl::narrow_lcd(const char* match, bool first) const
+{
+    if (first)
+    {
+        m_lcd = match;
+        m_lcd_mode = str_compare_scope::current();
+        m_lcd_fuzzy_accents = str_compare_scope::current_fuzzy_accents();
+    }
+    else if (m_lcd_mode != str_compare_scope::current() ||
+             m_lcd_fuzzy_accents != str_compare_scope::current_fuzzy_accents())
+    {
+        m_lcd_valid = false;
+    }
+    else
+    {
+        int32 matching = str_compare<char, true/*compute_lcd*/>(m_lcd.c_str(), match);
+        m_lcd.truncate(matching);
     }
 }
 
@@ -654,7 +827,16 @@ const char* matches_impl::get_match_description(uint32 index) const
     if (index >= get_match_count())
         return nullptr;
 
-    return m_infos[index].description;
+    return resolve_description(m_infos[index]);
+}
+
+//------------------------------------------------------------------------------
+bool matches_impl::is_match_description_lazy(uint32 index) const
+{
+    if (index >= get_match_count())
+        return false;
+
+    return m_infos[index].lazy_description;
 }
 
 //------------------------------------------------------------------------------
@@ -711,6 +893,60 @@ bool matches_impl::get_match_custom_display(uint32 index) const
     return info.custom_display > 0;
 }
 
+//------------------------------------------------------------------------------
+static void set_cells(uint16& cells, uint32 measured)
+{
+    cells = uint16(min<uint32>(measured, match_info::c_unmeasured - 1));
+}
+
+//------------------------------------------------------------------------------
+// Returns the width in cells of __printable_part() of the match, not including
+// any visible stat character (see printable_len()).
+uint32 matches_impl::get_match_printable_cells(uint32 index) const
+{
+    if (index >= get_match_count())
+        return 0;
+
+    // __printable_part() depends on rl_filename_display_desired, so cache the
+    // width of both forms.
+    const auto& info = m_infos[index];
+    if (rl_filename_display_desired)
+    {
+        if (info.printable_cells == match_info::c_unmeasured)
+            set_cells(info.printable_cells, __fnwidth(__printable_part(const_cast<char*>(info.match))));
+        return info.printable_cells;
+    }
+
+    if (info.match_cells == match_info::c_unmeasured)
+        set_cells(info.match_cells, __fnwidth(info.match));
+    return info.match_cells;
+}
+
+//------------------------------------------------------------------------------
+uint32 matches_impl::get_match_display_cells(uint32 index) const
+{
+    if (index >= get_match_count())
+        return 0;
+
+    const auto& info = m_infos[index];
+    if (info.display_cells == match_info::c_unmeasured)
+        set_cells(info.display_cells, info.display ? cell_count(info.display) : 0);
+    return info.display_cells;
+}
+
+//------------------------------------------------------------------------------
+uint32 matches_impl::get_match_description_cells(uint32 index) const
+{
+    if (index >= get_match_count())
+        return 0;
+
+    const auto& info = m_infos[index];
+    resolve_description(info);
+    if (info.description_cells == match_info::c_unmeasured)
+        set_cells(info.description_cells, info.description ? cell_count(info.description) : 0);
+    return info.description_cells;
+}
+
 //------------------------------------------------------------------------------
 const char* matches_impl::get_unfiltered_match(uint32 index) const
 {
@@ -744,7 +980,7 @@ const char* matches_impl::get_unfiltered_match_description(uint32 index) const
     if (index >= get_info_count())
         return nullptr;
 
-    return m_infos[index].description;
+    return resolve_description(m_infos[index]);
 }
 
 //------------------------------------------------------------------------------
@@ -886,12 +1122,13 @@ bool matches_impl::filter_matches(char** matches, char completion_type, bool fil
 //------------------------------------------------------------------------------
 void matches_impl::reset()
 {
-    delete m_dedup;
-    m_dedup = nullptr;
+    m_dedup.clear();
+    m_lazy_descriptions.clear();
 
     m_store.reset();
     m_infos.clear();
     m_count = 0;
+    m_limit = 0;
     m_any_none_type = false;
     m_deprecated_mode = false;
     m_coalesced = false;
@@ -902,7 +1139,10 @@ void matches_impl::reset()
     m_force_quoting = false;
     m_regen_blocked = false;
     m_nosort = false;
+    m_ranked = false;
     m_volatile = false;
+    m_cacheable = false;
+    m_cache_disabled = false;
     m_sep = '\0';
     m_completion_type = 0;
     m_suppress_quoting = 0;
@@ -910,6 +1150,9 @@ void matches_impl::reset()
     m_filename_completion_desired.reset();
     m_filename_display_desired.reset();
     m_input_line.clear();
+    m_prev_select.valid = false;
+    m_lcd.clear();
+    m_lcd_valid = true;
 
     set_slash_translation(g_translate_slashes.get());
 }
@@ -923,6 +1166,7 @@ void matches_impl::transfer(matches_impl& from)
     m_store = std::move(from.m_store);
     m_infos = std::move(from.m_infos);
     m_count = from.m_count;
+    m_limit = from.m_limit;
     m_any_none_type = from.m_any_none_type;
     m_deprecated_mode = from.m_deprecated_mode;
     m_coalesced = from.m_coalesced;
@@ -933,7 +1177,10 @@ void matches_impl::transfer(matches_impl& from)
     m_force_quoting = from.m_force_quoting;
     m_regen_blocked = from.m_regen_blocked;
     m_nosort = from.m_nosort;
+    m_ranked = from.m_ranked;
     m_volatile = from.m_volatile;
+    m_cacheable = from.m_cacheable;
+    m_cache_disabled = from.m_cache_disabled;
     m_sep = from.m_sep;
     m_completion_type = from.m_completion_type;
     m_suppress_quoting = from.m_suppress_quoting;
@@ -941,10 +1188,17 @@ void matches_impl::transfer(matches_impl& from)
     m_filename_completion_desired = from.m_filename_completion_desired;
     m_filename_display_desired = from.m_filename_display_desired;
     m_input_line = std::move(from.m_input_line);
+    m_prev_select.valid = false;
+    m_lcd = std::move(from.m_lcd);
+    m_lcd_valid = from.m_lcd_valid;
+    m_lcd_mode = from.m_lcd_mode;
+    m_lcd_fuzzy_accents = from.m_lcd_fuzzy_accents;
 
+    // The table's slots are in the store, which moved along with it.
     m_dedup = from.m_dedup;
+    m_lazy_descriptions = std::move(from.m_lazy_descriptions);
 
-    from.m_dedup = nullptr;
+    from.m_dedup.clear();
     from.clear();
 }
 
@@ -966,10 +1220,17 @@ void matches_impl::copy(const matches_impl& from)
         add.append_display = info.append_display;
         add.custom_display = info.custom_display;
         add.select = false; // (Shouldn't matter.)
+        add.lazy_description = info.lazy_description;
+        add.score = info.score;
+        add.match_cells = info.match_cells;
+        add.printable_cells = info.printable_cells;
+        add.display_cells = info.display_cells;
+        add.description_cells = info.description_cells;
         m_infos.emplace_back(std::move(add));
     }
 
     m_count = from.m_count;
+    m_limit = from.m_limit;
     m_any_none_type = from.m_any_none_type;
     m_deprecated_mode = from.m_deprecated_mode;
     m_coalesced = from.m_coalesced;
@@ -980,7 +1241,10 @@ void matches_impl::copy(const matches_impl& from)
     m_force_quoting = from.m_force_quoting;
     m_regen_blocked = from.m_regen_blocked;
     m_nosort = from.m_nosort;
+    m_ranked = from.m_ranked;
     m_volatile = from.m_volatile;
+    m_cacheable = from.m_cacheable;
+    m_cache_disabled = from.m_cache_disabled;
     m_sep = from.m_sep;
     m_completion_type = from.m_completion_type;
     m_suppress_quoting = from.m_suppress_quoting;
@@ -988,6 +1252,11 @@ void matches_impl::copy(const matches_impl& from)
     m_filename_completion_desired = from.m_filename_completion_desired;
     m_filename_display_desired = from.m_filename_display_desired;
     m_input_line << from.m_input_line;
+    m_prev_select.valid = false;
+    m_lcd = from.m_lcd.c_str();
+    m_lcd_valid = from.m_lcd_valid;
+    m_lcd_mode = from.m_lcd_mode;
+    m_lcd_fuzzy_accents = from.m_lcd_fuzzy_accents;
 }
 
 //------------------------------------------------------------------------------
@@ -1084,6 +1353,25 @@ void matches_impl::set_volatile()
     m_volatile = true;
 }
 
+//------------------------------------------------------------------------------
+void matches_impl::set_cacheable()
+{
+    m_cacheable = !m_cache_disabled;
+}
+
+//------------------------------------------------------------------------------
+void matches_impl::disable_cache()
+{
+    m_cacheable = false;
+    m_cache_disabled = true;
+}
+
+//------------------------------------------------------------------------------
+void matches_impl::set_limit(uint32 count)
+{
+    m_limit = count;
+}
+
 //------------------------------------------------------------------------------
 void matches_impl::set_input_line(const char* text)
 {
@@ -1104,7 +1392,7 @@ bool matches_impl::add_match(const match_desc& desc, bool already_normalized)
     const char* match = desc.match;
     match_type type = desc.type;
 
-    if (m_coalesced || match == nullptr || !*match)
+    if (m_coalesced || match == nullptr || !*match || is_full())
         return false;
 
     char* sep = rl_last_path_separator(match);
@@ -1147,10 +1435,7 @@ bool matches_impl::add_match(const match_desc& desc, bool already_normalized)
         match = tmp.c_str();
     }
 
-    if (!m_dedup)
-        m_dedup = new match_lookup_unordered_set;
-
-    if (m_dedup->find({ match, type }) != m_dedup->end())
+    if (m_dedup.find(match, type))
         return false;
 
     if (is_none)
@@ -1180,8 +1465,8 @@ bool matches_impl::add_match(const match_desc& desc, bool already_normalized)
     const char* store_description = (desc.description && *desc.description) ? m_store.store_front(desc.description) : nullptr;
     bool append_display = (desc.append_display && store_display);
 
-    match_lookup lookup = { store_match, type };
-    m_dedup->emplace(std::move(lookup));
+    if (!m_dedup.insert(m_store, store_match, type))
+        return false;
 
     match_info info;
     info.match = store_match;
@@ -1194,15 +1479,79 @@ bool matches_impl::add_match(const match_desc& desc, bool already_normalized)
     info.append_display = append_display;
     info.custom_display = (desc.missing_match ? true : (store_display ? -1 : false));
     info.select = false;
+    info.lazy_description = (desc.lazy_description && !store_description);
+    info.score = 0;
+    info.match_cells = match_info::c_unmeasured;
+    info.printable_cells = match_info::c_unmeasured;
+    info.display_cells = match_info::c_unmeasured;
+    info.description_cells = match_info::c_unmeasured;
     m_infos.emplace_back(std::move(info));
     ++m_count;
+    m_prev_select.valid = false;
+
+    // Matches added after set_cacheable() may not come from the file system.
+    m_cacheable = false;
+
+    if (m_lcd_valid)
+        narrow_lcd(store_match, m_count == 1);
 
-    if (store_description)
+    // Reaching the limit means there may be more matches that weren't
+    // generated, so make completion generate them anew instead of reusing
+    // these.
+    if (is_full())
+        m_volatile = true;
+
+    if (store_description || info.lazy_description)
         m_has_descriptions = true;
 
     return true;
 }
 
+//------------------------------------------------------------------------------
+void matches_impl::reserve(uint32 count)
+{
+    // Keep geometric growth, so that many small batches don't each reallocate.
+    const size_t needed = m_infos.size() + count;
+    if (!m_coalesced && needed > m_infos.capacity())
+        m_infos.reserve(max<size_t>(needed, m_infos.capacity() * 2));
+}
+
+//------------------------------------------------------------------------------
+// Returns the description for a match whose description is provided by the
+// generator when it's needed.  Resolving a description can be expensive, so
+// it's only done for matches that are actually displayed, and the result is
+// kept in the store.
+const char* matches_impl::get_lazy_description(const char* match) const
+{
+    const auto it = m_lazy_descriptions.find(match);
+    if (it != m_lazy_descriptions.end())
+        return it->second;
+
+    const char* key = m_store.store_front(match);
+    if (!key)
+        return nullptr;
+
+    str<> tmp;
+    const char* description = nullptr;
+    if (m_generator && m_generator->get_lazy_description(match, tmp) && !tmp.empty())
+        description = m_store.store_front(tmp.c_str());
+
+    m_lazy_descriptions.emplace(key, description);
+    return description;
+}
+
+//------------------------------------------------------------------------------
+const char* matches_impl::resolve_description(const match_info& info) const
+{
+    if (info.lazy_description)
+    {
+        info.description = get_lazy_description(info.match);
+        info.description_cells = match_info::c_unmeasured;
+        info.lazy_description = false;
+    }
+    return info.description;
+}
+
 //------------------------------------------------------------------------------
 void matches_impl::set_generator(match_generator* generator)
 {
@@ -1235,34 +1584,36 @@ void matches_impl::done_building()
                 // directory, then get_path_type() might yield unexpected
                 // results.  But that will interfere with many things, so no
                 // effort is invested here to compensate.
-                match_lookup lookup = { m_infos[i].match, m_infos[i].type };
+                const char* const match = m_infos[i].match;
 
                 // Remove it from the dup map before modifying it.
-                m_dedup->erase(lookup);
+                m_dedup.erase(match, m_infos[i].type);
 
                 // Apply backward compatibility logic to the match type.
-                lookup.type = backcompat_match_type(lookup.match);
-                m_infos[i].type = lookup.type;
+                const match_type type = backcompat_match_type(match);
+                m_infos[i].type = type;
 
                 // If it's a directory, add a trailing path separator.
-                if (is_match_type(lookup.type, match_type::dir))
+                if (is_match_type(type, match_type::dir))
                 {
-                    const size_t len = strlen(m_infos[i].match);
-                    const_cast<char*>(m_infos[i].match)[len] = sep;
-                    assert(m_infos[i].match[len + 1] == '\0');
+                    const size_t len = strlen(match);
+                    const_cast<char*>(match)[len] = sep;
+                    assert(match[len + 1] == '\0');
+                    m_lcd_valid = false;
                 }
 
                 // Check if it has become a duplicate.
-                if (m_dedup->find(lookup) != m_dedup->end())
+                if (m_dedup.find(match, type) || !m_dedup.insert(m_store, match, type))
+                {
                     m_infos.erase(m_infos.begin() + i);
-                else
-                    m_dedup->emplace(std::move(lookup));
+                    --m_count;
+                    m_lcd_valid = false;
+                }
             }
         }
     }
 
-    delete m_dedup;
-    m_dedup = nullptr;
+    m_dedup.clear();
 }
 
 //------------------------------------------------------------------------------
@@ -1296,11 +1647,17 @@ void matches_impl::coalesce(uint32 count_hint, bool restrict)
     m_filename_completion_desired.set_implicit(any_pathish);
     m_filename_display_desired.set_implicit(any_pathish && all_pathish);
 
+    if (m_count != j)
+        m_lcd_valid = false;
+
     m_count = j;
     m_coalesced = true;
 
     if (restrict)
+    {
         m_infos.resize(j);
+        m_prev_select.valid = false;
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -1327,6 +1684,19 @@ bool can_try_substring_pattern(const char* pattern)
     return false;
 }
 
+//------------------------------------------------------------------------------
+bool can_try_fuzzy_match(const char* pattern)
+{
+    // Can try fuzzy matching when nothing else matches, unless:
+    //  - No pattern.
+    //  - Setting 'match.fuzzy' is off.
+    //  - Pattern starts with '~'.
+    //  - Pattern contains '?' or '*'.
+    if (!pattern || !*pattern || *pattern == '~' || !g_fuzzy.get())
+        return false;
+    return !strpbrk(pattern, "?*");
+}
+
 //------------------------------------------------------------------------------
 char* make_substring_pattern(const char* pattern, const char* append)
 {
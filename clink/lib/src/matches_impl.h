@@ -7,7 +7,7 @@
 
 #include "core/array.h"
 #include "core/linear_allocator.h"
-#include <unordered_set>
+#include "core/str_unordered_set.h"
 #include <vector>
 
 //------------------------------------------------------------------------------
@@ -15,7 +15,7 @@ struct match_info
 {
     const char*     match;
     const char*     display;
-    const char*     description;
+    mutable const char* description;
     unsigned        ordinal;            // Original unsorted order.
     match_type      type;
     char            append_char;        // Zero means not specified.
@@ -23,13 +23,42 @@ struct match_info
     bool            append_display;
     char            custom_display;     // Negative means not calculated yet.
     bool            select;
+    mutable bool    lazy_description;   // The description hasn't been resolved yet.
+    int32           score;              // Fuzzy match score, when selected by fuzzy matching.
+    mutable uint16  match_cells;        // Cell widths, measured on first use;
+    mutable uint16  printable_cells;    // c_unmeasured means not measured yet.
+    mutable uint16  display_cells;
+    mutable uint16  description_cells;
+
+    static const uint16 c_unmeasured = 0xffff;
 };
 
 //------------------------------------------------------------------------------
-struct match_lookup
+// Open addressing hash set of the matches added so far, for rejecting
+// duplicates.  The slots are allocated from the matches' own store, so the
+// table needs no allocations of its own and is freed wholesale when the store
+// is reset.  Growing the table abandons the old slots in the store.
+class match_dedup_table
 {
-    const char*     match;
-    match_type      type;
+    struct slot
+    {
+        const char*     match;              // Points into the store.
+        uint32          hash;
+        match_type      type;
+    };
+
+public:
+    void            clear();
+    bool            find(const char* match, match_type type) const;
+    bool            insert(linear_allocator& store, const char* match, match_type type);
+    void            erase(const char* match, match_type type);
+
+private:
+    slot*           lookup(const char* match, match_type type, uint32 hash) const;
+    bool            grow(linear_allocator& store);
+    slot*           m_slots = nullptr;
+    uint32          m_capacity = 0;     // Always a power of 2.
+    uint32          m_used = 0;         // Includes erased slots.
 };
 
 
@@ -44,6 +73,18 @@ protected:
 
 
 
+//------------------------------------------------------------------------------
+// How matches were selected; each is only tried when the ones before it don't
+// select anything.
+enum class match_selector : uint8
+{
+    prefix,
+    substring,
+    fuzzy,
+};
+
+
+
 //------------------------------------------------------------------------------
 class match_generator;
 
@@ -55,13 +96,9 @@ class matches_impl
 #endif
     public matches
 {
-    struct match_lookup_hasher;
-    struct match_lookup_comparator;
     friend class ignore_volatile_matches;
 
 public:
-    typedef std::unordered_set<match_lookup, match_lookup_hasher, match_lookup_comparator> match_lookup_unordered_set;
-
                             matches_impl(uint32 store_size=0x10000);
                             ~matches_impl();
     matches_iter            get_iter() const;
@@ -73,11 +110,15 @@ public:
     virtual match_type      get_match_type(uint32 index) const override;
     virtual const char*     get_match_display(uint32 index) const override;
     virtual const char*     get_match_description(uint32 index) const override;
+    virtual bool            is_match_description_lazy(uint32 index) const override;
     virtual uint32          get_match_ordinal(uint32 index) const override;
     virtual char            get_match_append_char(uint32 index) const override;
     virtual shadow_bool     get_match_suppress_append(uint32 index) const override;
     virtual bool            get_match_append_display(uint32 index) const override;
     virtual bool            get_match_custom_display(uint32 index) const override;
+    virtual uint32          get_match_printable_cells(uint32 index) const override;
+    virtual uint32          get_match_display_cells(uint32 index) const override;
+    virtual uint32          get_match_description_cells(uint32 index) const override;
     virtual bool            is_suppress_append() const override;
     virtual shadow_bool     is_filename_completion_desired() const override;
     virtual shadow_bool     is_filename_display_desired() const override;
@@ -98,11 +139,13 @@ public:
     int32                   get_completion_type() const { return m_completion_type; }
 
     void                    set_generator(match_generator* generator);
+    const char*             get_lazy_description(const char* match) const;
     void                    done_building();
 
     void                    transfer(matches_impl& from);
     void                    copy(const matches_impl& from);
     void                    clear();
+    bool                    is_cacheable() const { return m_cacheable && !m_volatile; }
 
 private:
     virtual const char*     get_unfiltered_match(uint32 index) const override;
@@ -127,14 +170,21 @@ private:
     void                    set_no_sort();
     void                    set_has_descriptions();
     void                    set_volatile();
+    void                    set_cacheable();
+    void                    disable_cache();
+    void                    set_limit(uint32 count);
+    uint32                  get_limit() const { return m_limit; }
+    bool                    is_full() const { return m_limit && m_count >= m_limit; }
     void                    set_input_line(const char* text);
     bool                    is_from_current_input_line();
     bool                    add_match(const match_desc& desc, bool already_normalised=false);
+    void                    reserve(uint32 count);
     uint32                  get_info_count() const;
     const match_info*       get_infos() const;
     match_info*             get_infos();
     void                    reset();
     void                    coalesce(uint32 count_hint, bool restrict=false);
+    const char*             resolve_description(const match_info& info) const;
 
 private:
     class store_impl : public linear_allocator
@@ -146,11 +196,25 @@ private:
 
     typedef std::vector<match_info> infos;
 
+    void                    narrow_lcd(const char* match, bool first) const;
+
+    // The previous select(), so that extending the needle only needs to test
+    // the matches that were already selected.
+    struct select_state
+    {
+        str_moveable        needle;
+        int32               completion_type = 0;
+        bool                wild = false;
+        match_selector      selector = match_selector::prefix;
+        bool                valid = false;
+    };
+
     match_generator*        m_generator = nullptr;
 
-    store_impl              m_store;
+    mutable store_impl      m_store;
     infos                   m_infos;
-    unsigned short          m_count = 0;
+    uint32                  m_count = 0;
+    uint32                  m_limit = 0;    // Stop adding matches at this many (0 is unlimited).
     bool                    m_any_none_type = false;
     bool                    m_deprecated_mode = false;
     bool                    m_coalesced = false;
@@ -161,7 +225,10 @@ private:
     bool                    m_force_quoting = false;
     bool                    m_regen_blocked = false;
     bool                    m_nosort = false;
+    bool                    m_ranked = false;       // Sort by fuzzy match score.
     bool                    m_volatile = false;
+    bool                    m_cacheable = false;
+    bool                    m_cache_disabled = false;
     char                    m_sep = '\0';
     int32                   m_completion_type = 0;
     int32                   m_suppress_quoting = 0;
@@ -169,8 +236,22 @@ private:
     shadow_bool             m_filename_completion_desired;
     shadow_bool             m_filename_display_desired;
     str_moveable            m_input_line;   // The line the generators were given.
+    select_state            m_prev_select;
+
+    match_dedup_table       m_dedup;
+
+    // Longest common prefix of the matches.  add_match() narrows it as matches
+    // are added; changes that remove or rewrite matches invalidate it, and then
+    // get_lcd() recomputes it once.  It's only valid for the string comparison
+    // mode it was computed with.
+    mutable str_moveable    m_lcd;
+    mutable bool            m_lcd_valid = true;
+    mutable int32           m_lcd_mode = -1;
+    mutable bool            m_lcd_fuzzy_accents = false;
 
-    match_lookup_unordered_set* m_dedup = nullptr;
+    // Lazy descriptions that have been resolved, by match.  Both the keys and
+    // the descriptions are in the store.
+    mutable str_unordered_map<const char*> m_lazy_descriptions;
 };
 
 //------------------------------------------------------------------------------
@@ -186,4 +267,5 @@ private:
 
 //------------------------------------------------------------------------------
 bool can_try_substring_pattern(const char* pattern);
+bool can_try_fuzzy_match(const char* pattern);
 char* make_substring_pattern(const char* pattern, const char* append=nullptr);
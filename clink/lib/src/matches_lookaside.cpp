@@ -4,7 +4,6 @@
 #include "pch.h"
 #include "display_matches.h"
 #include "matches_lookaside.h"
-#include <core/linear_allocator.h>
 #include <terminal/ecma48_iter.h>
 
 #include <list>
@@ -108,19 +107,24 @@ match_details::match_details(const char* match, const match_extra* extra)
 
 
 //------------------------------------------------------------------------------
+// Readline owns its match arrays:  it frees the entries one at a time, swaps
+// entries into the lcd slot, and keeps arrays alive across regenerating the
+// matches (e.g. menu-complete).  So the entries can't point into matches_impl's
+// store, and lookups must confirm that a string really is a packed entry since
+// Readline also looks up strings that aren't (e.g. the lcd).  The extra data is
+// kept inline in the map so building a lookaside is a single allocation.
 class matches_lookaside
 {
-    typedef std::unordered_map<UINT_PTR, match_extra*> match_extra_map;
+    typedef std::unordered_map<const char*, match_extra> match_extra_map;
 public:
                             matches_lookaside(char** matches);
                             ~matches_lookaside();
     bool                    associated(char** matches) const;
     const match_extra*      find(const char* match) const;
 private:
-    bool                    add(const char* match);
+    void                    add(const char* match);
     char**                  m_matches;
     match_extra_map         m_map;
-    linear_allocator        m_allocator;
 };
 
 //------------------------------------------------------------------------------
@@ -129,11 +133,18 @@ static std::list<matches_lookaside*> s_lookasides;
 //------------------------------------------------------------------------------
 matches_lookaside::matches_lookaside(char** matches)
 : m_matches(matches)
-, m_allocator(8192)
 {
     assert(matches);
-    if (matches[1]) // Ignore lcd (the [0] entry); list is always >= 2 entries.
-        while (add(*(++matches))) {}
+    if (!matches[1]) // Ignore lcd (the [0] entry); list is always >= 2 entries.
+        return;
+
+    size_t count = 0;
+    while (matches[count + 1])
+        ++count;
+
+    m_map.reserve(count);
+    while (*(++matches))
+        add(*matches);
 };
 
 //------------------------------------------------------------------------------
@@ -150,39 +161,32 @@ bool matches_lookaside::associated(char** matches) const
 //------------------------------------------------------------------------------
 const match_extra* matches_lookaside::find(const char* match) const
 {
-    auto const iter = m_map.find(reinterpret_cast<UINT_PTR>(match));
+    auto const iter = m_map.find(match);
     if (iter == m_map.end())
         return nullptr;
-    return iter->second;
+    return &iter->second;
 }
 
 //------------------------------------------------------------------------------
-bool matches_lookaside::add(const char* match)
+void matches_lookaside::add(const char* match)
 {
-    if (!match)
-        return false;
-
-    UINT_PTR key = reinterpret_cast<UINT_PTR>(match);
-    match_extra* extra = (match_extra*)m_allocator.alloc(sizeof(*extra));
-    if (!extra)
-        return false;
+    match_extra extra;
 
     size_t len = strlen(match) + 1;
     const uint16 lo_type = static_cast<uint8>(match[len++]);
     const uint16 hi_type = static_cast<uint8>(match[len++]);
-    extra->type = static_cast<match_type>(lo_type | (hi_type << 8));
-    extra->append_char = match[len++];
-    extra->flags = uint8(match[len++]);
+    extra.type = static_cast<match_type>(lo_type | (hi_type << 8));
+    extra.append_char = match[len++];
+    extra.flags = uint8(match[len++]);
 #ifdef DEBUG
     const bool is_magic = (strnicmp(match + len, ":LA:", 4) == 0);
     assert(is_magic);
     len += 4;
 #endif
-    extra->display_offset = static_cast<unsigned short>(len);
-    extra->description_offset = static_cast<unsigned short>(len + strlen(match + len) + 1);
+    extra.display_offset = static_cast<unsigned short>(len);
+    extra.description_offset = static_cast<unsigned short>(len + strlen(match + len) + 1);
 
-    m_map.emplace(key, extra);
-    return true;
+    m_map.emplace(match, extra);
 }
 
 
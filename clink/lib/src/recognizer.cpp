@@ -5,20 +5,32 @@
 #include "intercept.h"
 #include "reclassify.h"
 #include "recognizer.h"
+#include "recognizer_cache.h"
 
 #include <core/os.h>
 #include <core/path.h>
 #include <core/str.h>
+#include <core/str_compare.h>
 #include <core/str_iter.h>
 #include <core/str_tokeniser.h>
+#include <core/str_transform.h>
 #include <core/str_unordered_set.h>
+#include <core/globber.h>
 #include <core/settings.h>
 #include <core/linear_allocator.h>
 #include <core/debugheap.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <shlwapi.h>
 
 extern "C" {
@@ -60,7 +72,7 @@ static bool file_exists(const char* full, str_base& out)
 }
 
 //------------------------------------------------------------------------------
-static bool search_for_extension(str_base& full, const char* word, str_base& out)
+static bool search_for_extension(str_base& full, const char* word, const char* pathext, str_base& out)
 {
     path::append(full, "");
     const uint32 trunc = full.length();
@@ -72,11 +84,10 @@ static bool search_for_extension(str_base& full, const char* word, str_base& out
             return true;
     }
 
-    str<> pathext;
-    if (!os::get_env("pathext", pathext))
+    if (!*pathext)
         return false;
 
-    str_tokeniser tokens(pathext.c_str(), ";");
+    str_tokeniser tokens(pathext, ";");
     const char *start;
     int32 length;
 
@@ -108,6 +119,308 @@ static bool search_for_extension(str_base& full, const char* word, str_base& out
     return false;
 }
 
+//------------------------------------------------------------------------------
+// Index of the files in PATH directories, so that resolving a command word
+// costs one directory listing per PATH directory, instead of probing every
+// PATHEXT extension in every PATH directory for every word.  A listing is
+// reused until the directory's last write time changes, which is checked at
+// most once per input line.  Recognizer workers share the index, so lookups
+// are serialized (remote directories are never indexed, so that's brief).
+class path_index
+{
+    struct indexed_file
+    {
+        bool                operator<(const indexed_file& other) const { return m_folded < other.m_folded; }
+        std::wstring        m_folded;                   // Uppercase file name.
+        std::string         m_name;
+        uint32              m_attr;
+    };
+
+    struct dir_entry
+    {
+        std::vector<indexed_file> m_files;              // Sorted by m_folded.
+        FILETIME            m_stamp;
+        uint32              m_checked = 0;
+        bool                m_missing = false;
+    };
+
+public:
+    int32                   find(const char* dir, const char* word, const char* pathext, str_base& out);
+    bool                    list(const char* dir, const char* prefix, const char* pathext, const path_executables_flags& flags, std::vector<path_executable>& out);
+    void                    next_line() { ++m_generation; }
+    bool                    take_changed() { return m_changed.exchange(false); }
+
+private:
+    const dir_entry&        get_dir(const char* dir);
+    bool                    contains(const dir_entry& entry, const char* name, int32 len=-1) const;
+    bool                    has_association(const char* ext);
+    static void             fold(const char* name, int32 len, std::wstring& out);
+
+    std::unordered_map<std::wstring, dir_entry> m_dirs;
+    std::unordered_map<std::wstring, bool> m_associations;
+    std::atomic<uint32>     m_generation { 1 };
+    std::atomic<bool>       m_changed { false };   // An indexed directory changed.
+    std::mutex              m_mutex;
+
+    static const size_t     c_max_dirs = 256;
+};
+
+//------------------------------------------------------------------------------
+static path_index s_path_index;
+static shared_recognizer_cache s_shared_cache;
+
+//------------------------------------------------------------------------------
+// Looks for WORD in DIR, applying the same rules as search_for_extension().
+// Returns 1 if found, 0 if not found, or -1 if DIR couldn't be indexed and
+// must be probed instead.
+int32 path_index::find(const char* dir, const char* word, const char* pathext, str_base& out)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // A directory that lists no files might just not allow listing, so
+    // probe it instead.
+    const dir_entry& entry = get_dir(dir);
+    if (entry.m_missing)
+        return 0;
+    if (entry.m_files.empty())
+        return -1;
+
+    const char* ext = path::get_extension(word);
+    bool found = (ext && contains(entry, word) && has_association(ext));
+
+    str<32> name;
+    if (!found)
+    {
+        str_tokeniser tokens(pathext, ";");
+        const char *start;
+        int32 length;
+        while (str_token token = tokens.next(start, length))
+        {
+            if (ext && int32(strlen(ext)) == length && _strnicmp(ext, start, length) == 0 && contains(entry, word))
+            {
+                found = true;
+                break;
+            }
+
+            name = word;
+            name.concat(start, length);
+            if (contains(entry, name.c_str(), name.length()))
+            {
+                found = true;
+                word = name.c_str();
+                break;
+            }
+        }
+    }
+
+    if (!found)
+        return 0;
+
+    out = dir;
+    path::append(out, word);
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+// Appends the files in DIR that start with PREFIX and have a PATHEXT extension
+// (or, if requested, an extension with a file association).  Returns false if
+// DIR couldn't be indexed and must be listed some other way.
+bool path_index::list(const char* dir, const char* prefix, const char* pathext, const path_executables_flags& flags, std::vector<path_executable>& out)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const dir_entry& entry = get_dir(dir);
+    if (entry.m_missing)
+        return true;
+    if (entry.m_files.empty())
+        return false;
+
+    std::unordered_set<std::wstring> exts;
+    {
+        str_tokeniser tokens(pathext, ";");
+        const char *start;
+        int32 length;
+        std::wstring ext;
+        while (str_token token = tokens.next(start, length))
+        {
+            fold(start, length, ext);
+            exts.emplace(std::move(ext));
+        }
+    }
+
+    // Narrow the candidates with a binary search on the folded prefix, up to
+    // the first '-', '_', or non-ASCII character (which may compare equal to
+    // other characters, depending on the compare mode).  Then check each
+    // candidate the same way the match pipeline compares.
+    const int32 prefix_len = int32(strlen(prefix));
+    int32 narrow_len = 0;
+    while (narrow_len < prefix_len && prefix[narrow_len] != '-' && prefix[narrow_len] != '_' && uint8(prefix[narrow_len]) < 0x80)
+        ++narrow_len;
+
+    indexed_file key;
+    fold(prefix, narrow_len, key.m_folded);
+    const size_t key_len = key.m_folded.length();
+
+    std::wstring ext;
+    auto iter = std::lower_bound(entry.m_files.begin(), entry.m_files.end(), key);
+    for (; iter != entry.m_files.end(); ++iter)
+    {
+        const indexed_file& file = *iter;
+        if (file.m_folded.compare(0, key_len, key.m_folded) != 0)
+            break;
+
+        if ((file.m_attr & FILE_ATTRIBUTE_HIDDEN) && !flags.hidden)
+            continue;
+        if ((file.m_attr & FILE_ATTRIBUTE_SYSTEM) && !flags.system)
+            continue;
+
+        if (narrow_len < prefix_len)
+        {
+            const int32 matched = str_compare(prefix, file.m_name.c_str());
+            if (matched >= 0 && matched < prefix_len)
+                continue;
+        }
+
+        const size_t dot = file.m_folded.rfind('.');
+        if (dot == std::wstring::npos)
+            continue;
+        ext = file.m_folded.c_str() + dot;
+        if (exts.find(ext) == exts.end())
+        {
+            if (!flags.associations)
+                continue;
+            str<32> narrow_ext(file.m_name.c_str() + file.m_name.rfind('.'));
+            if (!has_association(narrow_ext.c_str()))
+                continue;
+        }
+
+        out.emplace_back();
+        out.back().name = file.m_name.c_str();
+        out.back().attr = file.m_attr;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+const path_index::dir_entry& path_index::get_dir(const char* dir)
+{
+    std::wstring key;
+    fold(dir, -1, key);
+
+    const uint32 generation = m_generation;
+    auto iter = m_dirs.find(key);
+    if (iter != m_dirs.end() && iter->second.m_checked == generation)
+        return iter->second;
+
+    wstr<280> wdir(dir);
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    const bool exists = (GetFileAttributesExW(wdir.c_str(), GetFileExInfoStandard, &data) &&
+                         (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY));
+
+    if (iter != m_dirs.end() && exists && !iter->second.m_missing &&
+        CompareFileTime(&iter->second.m_stamp, &data.ftLastWriteTime) == 0)
+    {
+        iter->second.m_checked = generation;
+        return iter->second;
+    }
+
+    if (iter == m_dirs.end())
+    {
+        if (m_dirs.size() >= c_max_dirs)
+            m_dirs.clear();
+        iter = m_dirs.emplace(std::move(key), dir_entry()).first;
+    }
+    else if (exists || !iter->second.m_missing)
+    {
+        m_changed = true;
+    }
+
+    dir_entry& entry = iter->second;
+    entry.m_files.clear();
+    entry.m_checked = generation;
+    entry.m_missing = !exists;
+    if (!exists)
+        return entry;
+
+    entry.m_stamp = data.ftLastWriteTime;
+
+    str<280> pattern(dir);
+    path::append(pattern, "*");
+
+    globber files(pattern.c_str());
+    files.directories(false);
+    files.hidden(true);
+    files.system(true);
+
+    str<280> file;
+    globber::extrainfo info;
+    while (files.next(file, false/*rooted*/, &info))
+    {
+        entry.m_files.emplace_back();
+        indexed_file& indexed = entry.m_files.back();
+        fold(file.c_str(), file.length(), indexed.m_folded);
+        indexed.m_name.assign(file.c_str(), file.length());
+        indexed.m_attr = info.attr;
+    }
+    std::sort(entry.m_files.begin(), entry.m_files.end());
+
+    return entry;
+}
+
+//------------------------------------------------------------------------------
+bool path_index::contains(const dir_entry& entry, const char* name, int32 len) const
+{
+    indexed_file key;
+    fold(name, len, key.m_folded);
+    return std::binary_search(entry.m_files.begin(), entry.m_files.end(), key);
+}
+
+//------------------------------------------------------------------------------
+bool path_index::has_association(const char* ext)
+{
+    std::wstring key;
+    fold(ext, -1, key);
+
+    auto iter = m_associations.find(key);
+    if (iter != m_associations.end())
+        return iter->second;
+
+    DWORD cchOut = 0;
+    HRESULT hr = AssocQueryStringW(ASSOCF_INIT_IGNOREUNKNOWN|ASSOCF_NOFIXUPS, ASSOCSTR_EXECUTABLE, key.c_str(), nullptr, nullptr, &cchOut);
+    const bool associated = (SUCCEEDED(hr) && cchOut);
+    m_associations.emplace(std::move(key), associated);
+    return associated;
+}
+
+//------------------------------------------------------------------------------
+void path_index::fold(const char* name, int32 len, std::wstring& out)
+{
+    wstr<280> wname;
+    str_iter iter(name, len);
+    to_utf16(wname, iter);
+    out.assign(wname.c_str(), wname.length());
+    if (!out.empty())
+        CharUpperBuffW(&out[0], DWORD(out.length()));
+}
+
+
+
+//------------------------------------------------------------------------------
+// Gets the full path of a PATH entry relative to CWD.  This runs for every PATH
+// entry while recognizing or completing commands, so the join uses a stack
+// buffer and only falls back to a growable string for very long entries.
+static bool get_full_path_entry(const char* cwd, const char* entry, str_base& full)
+{
+    char joined[280];
+    if (path::join(cwd, entry, joined))
+        return os::get_full_path_name(joined, full);
+
+    str<> tmp;
+    path::join(cwd, entry, tmp);
+    return os::get_full_path_name(tmp.c_str(), full, tmp.length());
+}
+
 //------------------------------------------------------------------------------
 static bool search_for_executable(const char* _word, const char* cwd, str_base& out)
 {
@@ -132,18 +445,35 @@ static bool search_for_executable(const char* _word, const char* cwd, str_base&
         paths.concat(tmp.c_str(), tmp.length());
     }
 
-    str<> full;
+    str<> pathext;
+    os::get_env("pathext", pathext);
+
+    str<280> full;
     str<280> token;
+    bool is_cwd = need_cwd;
+    bool checked_shared = false;
     str_tokeniser tokens(paths.c_str(), ";");
     while (tokens.next(token))
     {
+        // The cwd is always probed; it changes too often to be worth indexing.
+        const bool probe = is_cwd;
+        is_cwd = false;
+
+        // After the cwd, check whether another session already found the
+        // word somewhere in PATH.
+        if (!probe && !checked_shared)
+        {
+            checked_shared = true;
+            if (s_shared_cache.find(_word, out))
+                return true;
+        }
+
         token.trim();
         if (token.empty())
             continue;
 
         // Get full path name.
-        path::join(cwd, token.c_str(), tmp);
-        if (!os::get_full_path_name(tmp.c_str(), full, tmp.length()))
+        if (!get_full_path_entry(cwd, token.c_str(), full))
             continue;
 
         // Skip drives that are unknown, invalid, or remote.
@@ -157,14 +487,101 @@ static bool search_for_executable(const char* _word, const char* cwd, str_base&
                 continue;
         }
 
-        // Try PATHEXT extensions.
-        if (search_for_extension(full, _word, out))
+        // Look up the word in the directory's index, or fall back to trying
+        // PATHEXT extensions if the directory couldn't be indexed.
+        const int32 found = probe ? -1 : s_path_index.find(full.c_str(), _word, pathext.c_str(), out);
+
+        // A PATH directory that changed could now shadow commands that other
+        // sessions found further along in PATH.
+        if (s_path_index.take_changed())
+            s_shared_cache.invalidate();
+
+        if (found > 0 || (found < 0 && search_for_extension(full, _word, pathext.c_str(), out)))
+        {
+            if (!probe)
+                s_shared_cache.store(_word, out.c_str());
             return true;
+        }
     }
 
     return false;
 }
 
+//------------------------------------------------------------------------------
+// Collects the executables in PATH directories whose names start with PREFIX,
+// using the same index as command recognition.  Directories that can't be
+// indexed (e.g. remote directories) are added to UNINDEXED instead, so the
+// caller can decide whether to list them.
+void get_path_executables(const char* prefix, const path_executables_flags& flags, std::vector<path_executable>& out, std::vector<str_moveable>& unindexed)
+{
+    str<> paths;
+    if (!os::get_env("PATH", paths))
+        return;
+
+    str<> pathext;
+    os::get_env("pathext", pathext);
+
+    str<280> cwd;
+    os::get_current_dir(cwd);
+
+    str<280> full;
+    str<280> token;
+    str_tokeniser tokens(paths.c_str(), ";");
+    while (tokens.next(token))
+    {
+        token.trim();
+        if (token.empty())
+            continue;
+
+        if (!get_full_path_entry(cwd.c_str(), token.c_str(), full))
+            continue;
+
+        // Remote directories are never indexed; they're left to the caller,
+        // the same as directories that can't be listed.
+        bool remote = (path::is_separator(full.c_str()[0]) && path::is_separator(full.c_str()[1]));
+        if (!remote)
+        {
+            char drive[4];
+            drive[0] = full.c_str()[0];
+            drive[1] = ':';
+            drive[2] = '\\';
+            drive[3] = '\0';
+            const int32 type = os::get_drive_type(drive);
+            if (type < os::drive_type_remote)
+                continue;
+            remote = (type == os::drive_type_remote);
+        }
+
+        if (remote || !s_path_index.list(full.c_str(), prefix, pathext.c_str(), flags, out))
+            unindexed.emplace_back(full.c_str());
+    }
+
+    // A PATH directory that changed could now shadow commands that other
+    // sessions found further along in PATH.
+    if (s_path_index.take_changed())
+        s_shared_cache.invalidate();
+}
+
+//------------------------------------------------------------------------------
+// Gets the volume a word will be searched on:  its drive if it has one, or
+// else the cwd's drive (remote drives in PATH are skipped anyway).
+static void get_volume(const char* word, const char* cwd, str_base& out, bool& remote)
+{
+    if (!path::get_drive(word, out) && !path::get_drive(cwd, out))
+    {
+        // No drive letter means a UNC path.
+        out = "\\\\";
+        remote = true;
+        return;
+    }
+
+    str_ascii_tolower(out.data());
+
+    str<16> root(out.c_str());
+    path::append(root, "");
+    remote = (os::get_drive_type(root.c_str()) == os::drive_type_remote);
+}
+
 //------------------------------------------------------------------------------
 static bool s_immediate = false;
 void set_noasync_recognizer()
@@ -195,9 +612,19 @@ class recognizer
         str_moveable        m_cwd;
     };
 
+    // Words are queued per volume, and at most one worker processes each
+    // volume at a time, so a slow volume only ties up one worker.
+    struct volume_queue
+    {
+        str_moveable        m_volume;
+        bool                m_remote = false;
+        bool                m_busy = false;
+        std::deque<entry>   m_entries;
+    };
+
 public:
                             recognizer();
-                            ~recognizer() { assert(!m_thread); }
+                            ~recognizer() { assert(m_threads.empty()); }
     void                    shutdown();
     void                    clear();
     int32                   find(const char* key, recognition& cached, str_base* file) const;
@@ -210,8 +637,9 @@ public:
 private:
     bool                    usable() const;
     bool                    busy() const;
+    bool                    has_queued() const;
     bool                    store(const char* word, const char* file, recognition cached, bool pending=false);
-    bool                    dequeue(entry& entry);
+    volume_queue*           dequeue(entry& entry);
     bool                    set_result_available(bool available);
     void                    notify_ready(bool available);
     static void             proc(recognizer* r);
@@ -220,15 +648,21 @@ private:
     linear_allocator        m_heap;
     str_unordered_map<cache_entry> m_cache;
     str_unordered_map<cache_entry> m_pending;
-    entry                   m_queue;
+    std::deque<volume_queue> m_queues;      // Never shrinks; workers hold pointers.
     mutable std::recursive_mutex m_mutex;
-    std::unique_ptr<std::thread> m_thread;
-    HANDLE                  m_event = nullptr;
-    bool                    m_processing = false;
+    std::condition_variable_any m_wake;
+    std::vector<std::thread> m_threads;
+    uint32                  m_idle = 0;         // Workers waiting for work.
+    uint32                  m_active = 0;       // Workers processing a word.
+    uint32                  m_active_remote = 0;
     bool                    m_result_available = false;
     volatile bool           m_zombie = false;
 
     static HANDLE           s_ready_event;
+
+    // One worker is always left for local volumes.
+    static const uint32     c_max_threads = 4;
+    static const uint32     c_max_remote = c_max_threads - 1;
 };
 
 //------------------------------------------------------------------------------
@@ -245,7 +679,7 @@ void recognizer::entry::clear()
 
 //------------------------------------------------------------------------------
 recognizer::recognizer()
-: m_heap(1024)
+: m_heap(1024, mem_tag::recognizer)
 {
 #ifdef DEBUG
     // Singleton; assert if there's ever more than one.
@@ -262,7 +696,8 @@ void recognizer::clear()
 {
     std::lock_guard<std::recursive_mutex> lock(m_mutex);
 
-    m_queue.clear();
+    for (auto& queue : m_queues)
+        queue.m_entries.clear();
     m_cache.clear();
     m_pending.clear();
     m_heap.reset();
@@ -309,6 +744,10 @@ bool recognizer::enqueue(const char* key, const char* word, const char* cwd, rec
         return false;
     }
 
+    bool remote;
+    str<16> volume;
+    get_volume(word, cwd, volume, remote);
+
     {
         std::lock_guard<std::recursive_mutex> lock(m_mutex);
 
@@ -317,29 +756,41 @@ bool recognizer::enqueue(const char* key, const char* word, const char* cwd, rec
 
         assert(s_ready_event);
 
-        if (!m_event)
+        volume_queue* queue = nullptr;
+        for (auto& q : m_queues)
+        {
+            if (q.m_volume.equals(volume.c_str()))
+            {
+                queue = &q;
+                break;
+            }
+        }
+        if (!queue)
         {
-            m_event = CreateEvent(nullptr, false, false, nullptr);
-            if (!m_event)
-                return false;
+            m_queues.emplace_back();
+            queue = &m_queues.back();
+            queue->m_volume = volume.c_str();
+            queue->m_remote = remote;
         }
 
-        if (!m_thread)
+        queue->m_entries.emplace_back();
+        entry& e = queue->m_entries.back();
+        e.m_key = key;
+        e.m_word = word;
+        e.m_cwd = cwd;
+
+        if (!m_idle && m_threads.size() < c_max_threads)
         {
             dbg_ignore_scope(snapshot, "Recognizer thread");
-            m_thread = std::make_unique<std::thread>(&proc, this);
+            m_threads.emplace_back(&proc, this);
         }
 
-        m_queue.m_key = key;
-        m_queue.m_word = word;
-        m_queue.m_cwd = cwd;
-
         // Assume unrecognized at first.
         store(key, nullptr, recognition::unrecognized, true/*pending*/);
         if (cached)
             *cached = recognition::unrecognized;
 
-        SetEvent(m_event);  // Signal thread there is work to do.
+        m_wake.notify_all();    // Signal workers there is work to do.
     }
 
     Sleep(0);           // Give up timeslice in case thread gets result quickly.
@@ -415,7 +866,16 @@ bool recognizer::usable() const
 //------------------------------------------------------------------------------
 bool recognizer::busy() const
 {
-    return m_processing || !m_pending.empty();
+    return m_active || !m_pending.empty();
+}
+
+//------------------------------------------------------------------------------
+bool recognizer::has_queued() const
+{
+    for (const auto& queue : m_queues)
+        if (!queue.m_entries.empty())
+            return true;
+    return false;
 }
 
 //------------------------------------------------------------------------------
@@ -453,16 +913,37 @@ bool recognizer::store(const char* word, const char* file, recognition cached, b
 }
 
 //------------------------------------------------------------------------------
-bool recognizer::dequeue(entry& entry)
+// Takes the next word from a volume that no other worker is processing,
+// preferring local volumes.  Must be called with the mutex locked.
+recognizer::volume_queue* recognizer::dequeue(entry& entry)
 {
-    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    if (!usable())
+        return nullptr;
 
-    if (!usable() || m_queue.empty())
-        return false;
+    volume_queue* queue = nullptr;
+    for (auto& q : m_queues)
+    {
+        if (q.m_busy || q.m_entries.empty())
+            continue;
+        if (!q.m_remote)
+        {
+            queue = &q;
+            break;
+        }
+        if (!queue && m_active_remote < c_max_remote)
+            queue = &q;
+    }
 
-    entry = std::move(m_queue);
-    assert(m_queue.empty());
-    return true;
+    if (!queue)
+        return nullptr;
+
+    entry = std::move(queue->m_entries.front());
+    queue->m_entries.pop_front();
+    queue->m_busy = true;
+    ++m_active;
+    if (queue->m_remote)
+        ++m_active_remote;
+    return queue;
 }
 
 //------------------------------------------------------------------------------
@@ -505,25 +986,21 @@ void recognizer::notify_ready(bool available)
 //------------------------------------------------------------------------------
 void recognizer::shutdown()
 {
-    std::unique_ptr<std::thread> thread;
+    std::vector<std::thread> threads;
 
     {
         std::lock_guard<std::recursive_mutex> lock(m_mutex);
 
         clear();
         m_zombie = true;
+        m_wake.notify_all();
 
-        if (m_event)
-            SetEvent(m_event);
-
-        thread = std::move(m_thread);
+        threads = std::move(m_threads);
+        m_threads.clear();
     }
 
-    if (thread)
-        thread->join();
-
-    if (m_event)
-        CloseHandle(m_event);
+    for (auto& thread : threads)
+        thread.join();
 }
 
 //------------------------------------------------------------------------------
@@ -531,45 +1008,52 @@ void recognizer::proc(recognizer* r)
 {
     CoInitialize(0);
 
-    while (true)
+    std::unique_lock<std::recursive_mutex> lock(r->m_mutex);
+    while (!r->m_zombie)
     {
-        if (WaitForSingleObject(r->m_event, INFINITE) != WAIT_OBJECT_0)
+        entry entry;
+        volume_queue* queue = r->dequeue(entry);
+        if (!queue)
         {
-            // Uh oh.
-            Sleep(5000);
+            ++r->m_idle;
+            r->m_wake.wait(lock);
+            --r->m_idle;
+            continue;
         }
 
-        entry entry;
-        while (true)
-        {
-            {
-                std::lock_guard<std::recursive_mutex> lock(r->m_mutex);
-                if (r->m_zombie || !r->dequeue(entry))
-                {
-                    r->m_processing = false;
-                    r->m_pending.clear();
-                    if (!r->m_zombie)
-                        r->notify_ready(false);
-                    break;
-                }
-                r->m_processing = true;
-            }
+        lock.unlock();
 
-            // Search for executable file.
-            str<> found;
-            recognition result = recognition::unrecognized;
-            if (search_for_executable(entry.m_word.c_str(), entry.m_cwd.c_str(), found))
-                result = recognition::executable;
+        // Search for executable file.
+        str<> found;
+        recognition result = recognition::unrecognized;
+        if (search_for_executable(entry.m_word.c_str(), entry.m_cwd.c_str(), found))
+            result = recognition::executable;
 
-            // Store result.
-            r->store(entry.m_key.c_str(), found.c_str(), result);
-            r->notify_ready(true);
-        }
+        lock.lock();
 
+        // Store result.
+        queue->m_busy = false;
+        --r->m_active;
+        if (queue->m_remote)
+            --r->m_active_remote;
         if (r->m_zombie)
             break;
+
+        r->store(entry.m_key.c_str(), found.c_str(), result);
+        r->notify_ready(true);
+
+        // When all queued words are finished, let end_line() stop waiting.
+        if (!r->m_active && !r->has_queued())
+        {
+            r->m_pending.clear();
+            r->notify_ready(false);
+        }
+
+        // Another worker may be waiting for this volume to become free.
+        r->m_wake.notify_all();
     }
 
+    lock.unlock();
     CoUninitialize();
 }
 
@@ -607,6 +1091,7 @@ extern "C" void end_recognizer()
 {
     s_recognizer.end_line();
     s_recognizer.clear();
+    s_path_index.next_line();
 }
 
 //------------------------------------------------------------------------------
@@ -697,7 +1182,7 @@ recognition recognize_command(const char* line, const char* word, bool quoted, b
         return recognition::unrecognized;
 
     // Queue for background thread processing.
-    str<> cwd;
+    str<280> cwd;
     os::get_current_dir(cwd);
     if (!s_recognizer.enqueue(orig_word, word, cwd.c_str(), &cached))
         return recognition::unknown;
@@ -0,0 +1,116 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "recognizer_cache.h"
+
+#include <core/base.h>
+#include <core/os.h>
+#include <core/path.h>
+#include <core/str.h>
+#include <core/str_hash.h>
+#include <core/str_tokeniser.h>
+#include <core/str_transform.h>
+
+//------------------------------------------------------------------------------
+// Whether DIR names the same directory regardless of the cwd (`\bin` and
+// `c:bin` depend on the cwd's drive or the drive's cwd).
+static bool is_absolute(const char* dir)
+{
+    if (*dir == '"')
+        ++dir;
+    if (path::is_unc(dir))
+        return true;
+    return dir[0] && dir[1] == ':' && path::is_separator(dir[2]);
+}
+
+//------------------------------------------------------------------------------
+shared_recognizer_cache::shared_recognizer_cache()
+: m_table(64, MAX_PATH, 512)
+{
+}
+
+//------------------------------------------------------------------------------
+bool shared_recognizer_cache::find(const char* word, str_base& file)
+{
+    char key[64];
+    if (!fold(word, key) || !open())
+        return false;
+
+    char found_file[MAX_PATH];
+    if (!m_table.find(key, found_file))
+        return false;
+    found_file[sizeof(found_file) - 1] = '\0';
+
+    // The file may have been removed since it was found.
+    if (os::get_path_type(found_file) != os::path_type_file)
+        return false;
+
+    file = found_file;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void shared_recognizer_cache::store(const char* word, const char* file)
+{
+    char key[64];
+    const size_t len = strlen(file);
+    if (!fold(word, key) || len >= MAX_PATH || !open())
+        return;
+
+    m_table.store(key, file, uint32(len + 1));
+}
+
+//------------------------------------------------------------------------------
+void shared_recognizer_cache::invalidate()
+{
+    if (open())
+        m_table.invalidate();
+}
+
+//------------------------------------------------------------------------------
+// Opens the table for the current PATH and PATHEXT.  The environment can
+// change during a session (e.g. `set PATH=...`), so it's checked every time.
+// A PATH with relative entries isn't shared, because what it finds depends on
+// the cwd.
+bool shared_recognizer_cache::open()
+{
+    str<> env;
+    str<> tmp;
+    os::get_env("PATH", env);
+
+    str_tokeniser tokens(env.c_str(), ";");
+    while (tokens.next(tmp))
+    {
+        tmp.trim();
+        if (!tmp.empty() && !is_absolute(tmp.c_str()))
+        {
+            m_table.close();
+            return false;
+        }
+    }
+
+    os::get_env("PATHEXT", tmp);
+    env.concat("\n", 1);
+    env.concat(tmp.c_str(), tmp.length());
+    str_ascii_tolower(env.data());
+
+    wstr<64> name;
+    name.format(L"Local\\clink_recognizer_%08x", str_hash(env.c_str(), env.length()));
+    return m_table.open(name.c_str());
+}
+
+//------------------------------------------------------------------------------
+// Words are compared caselessly (ASCII only, which covers nearly all command
+// names; other words just miss if typed with different case).
+bool shared_recognizer_cache::fold(const char* word, char (&out)[64])
+{
+    const size_t len = strlen(word);
+    if (!len || len >= sizeof(out))
+        return false;
+
+    for (size_t i = 0; i < len; ++i)
+        out[i] = ascii_tolower(word[i]);
+    out[len] = '\0';
+    return true;
+}
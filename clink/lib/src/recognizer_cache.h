@@ -0,0 +1,35 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <core/base.h>
+#include <lib/shared_table.h>
+
+class str_base;
+
+//------------------------------------------------------------------------------
+// Command words that were resolved through PATH, shared by all sessions that
+// have the same PATH and PATHEXT, so that a new session doesn't have to search
+// PATH again for commands other sessions already found.  Only cwd-independent
+// results are kept:  words found in the cwd aren't stored, and a PATH with
+// relative entries isn't shared at all.  A result is only used if the file
+// still exists.
+//
+// When a session notices that a PATH directory changed, it invalidates the
+// whole table, since a new file could shadow a command found later in PATH.
+class shared_recognizer_cache
+    : public no_copy
+{
+public:
+                        shared_recognizer_cache();
+    bool                find(const char* word, str_base& file);
+    void                store(const char* word, const char* file);
+    void                invalidate();
+
+private:
+    bool                open();
+    static bool         fold(const char* word, char (&out)[64]);
+
+    shared_table        m_table;
+};
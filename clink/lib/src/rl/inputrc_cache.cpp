@@ -0,0 +1,824 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "inputrc_cache.h"
+
+#include <core/base.h>
+#include <core/path.h>
+#include <core/log.h>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+extern "C" {
+#include <compat/config.h>
+#include <readline/readline.h>
+#include <readline/rlprivate.h>
+#include <readline/keymaps.h>
+#include <readline/xmalloc.h>
+}
+
+//------------------------------------------------------------------------------
+// The cache file is text, one record per line.  Strings are hex encoded so
+// they can't collide with the separators, and key sequences are encoded as
+// three hex digits per key so that ANYOTHERKEY can be represented.
+//
+//      clink_inputrc_cache 1
+//      key <hex>                           State hash + context.
+//      file <hex path> <size> <hash>       A file that was read.
+//      missing <hex path>                  A file that was looked for.
+//      last <hex path>                     rl_get_last_init_file().
+//      var <hex name> =<hex value>|-       rl_variable_bind(), in order.
+//      bind <root> <keys> f <hex name>     Bind a function (empty is unbound).
+//      bind <root> <keys> m <hex macro>    Bind a macro.
+//      bind <root> <keys> k                Bind a new empty keymap.
+//      bind <root> <keys> r <root>         Bind one of the root keymaps.
+//      end
+static const char c_cache_name[] = "clink_inputrc.cache";
+static const char c_cache_header[] = "clink_inputrc_cache 1";
+static const uint32 c_num_roots = 5;
+
+//------------------------------------------------------------------------------
+static Keymap get_root(uint32 index)
+{
+    switch (index)
+    {
+    case 0:     return vi_movement_keymap;
+    case 1:     return vi_insertion_keymap;
+    case 2:     return emacs_standard_keymap;
+    case 3:     return emacs_meta_keymap;
+    case 4:     return emacs_ctlx_keymap;
+    default:    return nullptr;
+    }
+}
+
+//------------------------------------------------------------------------------
+static int32 find_root(Keymap map)
+{
+    for (uint32 i = 0; i < c_num_roots; ++i)
+        if (get_root(i) == map)
+            return i;
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+static uint64 hash_bytes(const void* data, size_t len, uint64 hash=0xcbf29ce484222325ull)
+{
+    // FNV-1a.
+    const uint8* p = static_cast<const uint8*>(data);
+    for (size_t i = 0; i < len; ++i)
+        hash = (hash ^ p[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+//------------------------------------------------------------------------------
+static uint64 hash_str(const char* s, uint64 hash)
+{
+    // Include the terminator so adjacent strings can't run together.
+    return s ? hash_bytes(s, strlen(s) + 1, hash) : hash_bytes("\xff", 1, hash);
+}
+
+
+
+//------------------------------------------------------------------------------
+static void append_hex(str_base& out, const char* s, size_t len)
+{
+    static const char c_digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; ++i)
+    {
+        const uint8 c = uint8(s[i]);
+        const char hex[2] = { c_digits[c >> 4], c_digits[c & 0xf] };
+        out.concat(hex, 2);
+    }
+}
+
+//------------------------------------------------------------------------------
+static void append_hex(str_base& out, const char* s)
+{
+    append_hex(out, s, strlen(s));
+}
+
+//------------------------------------------------------------------------------
+static int32 hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+// Decodes the hex token at p, up to the next space or the end of the line.
+static bool parse_hex(const char*& p, str_base& out)
+{
+    out.clear();
+    while (*p && *p != ' ')
+    {
+        const int32 hi = hex_digit(p[0]);
+        const int32 lo = hi >= 0 ? hex_digit(p[1]) : -1;
+        if (lo < 0)
+            return false;
+        const char c = char((hi << 4) | lo);
+        out.concat(&c, 1);
+        p += 2;
+    }
+    if (*p == ' ')
+        ++p;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+static bool parse_keys(const char*& p, std::vector<uint16>& out)
+{
+    out.clear();
+    while (*p && *p != ' ')
+    {
+        int32 key = 0;
+        for (int32 i = 0; i < 3; ++i)
+        {
+            const int32 d = hex_digit(p[i]);
+            if (d < 0)
+                return false;
+            key = (key << 4) | d;
+        }
+        if (key >= KEYMAP_SIZE)
+            return false;
+        out.push_back(uint16(key));
+        p += 3;
+    }
+    if (*p == ' ')
+        ++p;
+    return !out.empty();
+}
+
+//------------------------------------------------------------------------------
+static bool get_file_hash(const char* path, uint64& size, uint64& hash)
+{
+    FILE* in = fopen(path, "rb");
+    if (!in)
+        return false;
+
+    size = 0;
+    hash = hash_bytes(nullptr, 0);
+
+    char buffer[4096];
+    while (true)
+    {
+        const size_t n = fread(buffer, 1, sizeof(buffer), in);
+        if (!n)
+            break;
+        size += n;
+        hash = hash_bytes(buffer, n, hash);
+    }
+
+    fclose(in);
+    return true;
+}
+
+
+
+//------------------------------------------------------------------------------
+class function_names
+{
+public:
+                    function_names();
+    const char*     get(rl_command_func_t* func) const;
+private:
+    std::unordered_map<rl_command_func_t*, const char*> m_names;
+};
+
+//------------------------------------------------------------------------------
+function_names::function_names()
+{
+    for (int32 i = 0; funmap && funmap[i]; ++i)
+        m_names.emplace(funmap[i]->function, funmap[i]->name);
+}
+
+//------------------------------------------------------------------------------
+const char* function_names::get(rl_command_func_t* func) const
+{
+    if (!func)
+        return "";
+    const auto i = m_names.find(func);
+    return (i != m_names.end()) ? i->second : nullptr;
+}
+
+
+
+//------------------------------------------------------------------------------
+static void free_keymap_copy(Keymap map);
+
+//------------------------------------------------------------------------------
+static void free_entry(KEYMAP_ENTRY& entry)
+{
+    switch (entry.type)
+    {
+    case ISMACR:
+        xfree(entry.function);
+        break;
+    case ISKMAP:
+        if (entry.function && find_root(Keymap(entry.function)) < 0)
+            free_keymap_copy(Keymap(entry.function));
+        break;
+    }
+
+    entry.type = ISFUNC;
+    entry.function = nullptr;
+}
+
+//------------------------------------------------------------------------------
+static void free_keymap_copy(Keymap map)
+{
+    if (!map)
+        return;
+    for (uint32 i = 0; i < KEYMAP_SIZE; ++i)
+        free_entry(map[i]);
+    xfree(map);
+}
+
+//------------------------------------------------------------------------------
+// Copies a keymap and its submaps, except references to the root keymaps.
+static Keymap copy_keymap(Keymap src)
+{
+    Keymap map = rl_make_bare_keymap();
+    for (uint32 i = 0; i < KEYMAP_SIZE; ++i)
+    {
+        map[i].type = src[i].type;
+        switch (src[i].type)
+        {
+        case ISMACR:
+            map[i].function = (rl_command_func_t*)savestring((const char*)src[i].function);
+            break;
+        case ISKMAP:
+            if (src[i].function && find_root(Keymap(src[i].function)) < 0)
+                map[i].function = KEYMAP_TO_FUNCTION(copy_keymap(Keymap(src[i].function)));
+            else
+                map[i].function = src[i].function;
+            break;
+        default:
+            map[i].function = src[i].function;
+            break;
+        }
+    }
+    return map;
+}
+
+//------------------------------------------------------------------------------
+// Moves the entries from src into dst, and frees src.
+static void move_keymap(Keymap dst, Keymap src)
+{
+    for (uint32 i = 0; i < KEYMAP_SIZE; ++i)
+    {
+        free_entry(dst[i]);
+        dst[i] = src[i];
+    }
+    xfree(src);
+}
+
+//------------------------------------------------------------------------------
+static bool hash_keymap(Keymap map, const function_names& names, uint64& hash)
+{
+    for (uint32 i = 0; i < KEYMAP_SIZE; ++i)
+    {
+        const KEYMAP_ENTRY& entry = map[i];
+        hash = hash_bytes(&entry.type, 1, hash);
+        switch (entry.type)
+        {
+        case ISFUNC:
+            {
+                const char* name = names.get(entry.function);
+                if (!name)
+                    return false;
+                hash = hash_str(name, hash);
+            }
+            break;
+        case ISMACR:
+            hash = hash_str((const char*)entry.function, hash);
+            break;
+        case ISKMAP:
+            {
+                const Keymap sub = Keymap(entry.function);
+                const int32 root = find_root(sub);
+                if (root >= 0 || !sub)
+                    hash = hash_bytes(&root, sizeof(root), hash);
+                else if (!hash_keymap(sub, names, hash))
+                    return false;
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+
+
+//------------------------------------------------------------------------------
+static void append_bind(str_base& out, uint32 root, const std::vector<uint16>& keys, char kind)
+{
+    str<16> tmp;
+    tmp.format("bind %u ", root);
+    out.concat(tmp.c_str(), tmp.length());
+    for (uint16 key : keys)
+    {
+        tmp.format("%03x", key);
+        out.concat(tmp.c_str(), tmp.length());
+    }
+    out.concat(" ");
+    out.concat(&kind, 1);
+}
+
+//------------------------------------------------------------------------------
+static bool diff_keymap(uint32 root, Keymap pre, Keymap post, std::vector<uint16>& keys, const function_names& names, str_base& out)
+{
+    for (uint32 i = 0; i < KEYMAP_SIZE; ++i)
+    {
+        const KEYMAP_ENTRY none = { ISFUNC, nullptr };
+        const KEYMAP_ENTRY& a = pre ? pre[i] : none;
+        const KEYMAP_ENTRY& b = post[i];
+
+        keys.push_back(uint16(i));
+
+        const Keymap sub = (b.type == ISKMAP) ? Keymap(b.function) : nullptr;
+        const int32 sub_root = sub ? find_root(sub) : -1;
+        if (sub && sub_root < 0)
+        {
+            const Keymap pre_sub = (a.type == ISKMAP && a.function && find_root(Keymap(a.function)) < 0) ? Keymap(a.function) : nullptr;
+            if (!pre_sub)
+            {
+                append_bind(out, root, keys, 'k');
+                out.concat("\n");
+            }
+            if (!diff_keymap(root, pre_sub, sub, keys, names, out))
+                return false;
+        }
+        else if (a.type != b.type ||
+                 (b.type == ISMACR ? strcmp((const char*)a.function, (const char*)b.function) != 0 : a.function != b.function))
+        {
+            switch (b.type)
+            {
+            case ISFUNC:
+                {
+                    const char* name = names.get(b.function);
+                    if (!name)
+                        return false;
+                    append_bind(out, root, keys, 'f');
+                    out.concat(" ");
+                    append_hex(out, name);
+                }
+                break;
+            case ISMACR:
+                append_bind(out, root, keys, 'm');
+                out.concat(" ");
+                append_hex(out, (const char*)b.function);
+                break;
+            case ISKMAP:
+                {
+                    if (sub_root < 0)
+                        return false;
+                    str<16> tmp;
+                    tmp.format(" %u", sub_root);
+                    append_bind(out, root, keys, 'r');
+                    out.concat(tmp.c_str(), tmp.length());
+                }
+                break;
+            default:
+                return false;
+            }
+            out.concat("\n");
+        }
+
+        keys.pop_back();
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+static bool apply_bind(Keymap* maps, uint32 root, const std::vector<uint16>& keys, char kind, const char* value)
+{
+    Keymap map = maps[root];
+    for (size_t i = 0; i + 1 < keys.size(); ++i)
+    {
+        const KEYMAP_ENTRY& entry = map[keys[i]];
+        if (entry.type != ISKMAP || !entry.function)
+            return false;
+        const int32 sub_root = find_root(Keymap(entry.function));
+        map = (sub_root >= 0) ? maps[sub_root] : Keymap(entry.function);
+    }
+
+    KEYMAP_ENTRY entry;
+    switch (kind)
+    {
+    case 'f':
+        entry.type = ISFUNC;
+        entry.function = *value ? rl_named_function(value) : nullptr;
+        if (*value && !entry.function)
+            return false;
+        break;
+    case 'm':
+        entry.type = ISMACR;
+        entry.function = (rl_command_func_t*)savestring(value);
+        break;
+    case 'k':
+        entry.type = ISKMAP;
+        entry.function = KEYMAP_TO_FUNCTION(rl_make_bare_keymap());
+        break;
+    case 'r':
+        {
+            const Keymap target = get_root(atoi(value));
+            if (!target)
+                return false;
+            entry.type = ISKMAP;
+            entry.function = KEYMAP_TO_FUNCTION(target);
+        }
+        break;
+    default:
+        return false;
+    }
+
+    free_entry(map[keys.back()]);
+    map[keys.back()] = entry;
+    return true;
+}
+
+
+
+//------------------------------------------------------------------------------
+struct inputrc_trace
+{
+    struct file
+    {
+        str_moveable    path;
+        bool            exists;
+        uint64          size;
+        uint64          hash;
+    };
+
+    std::vector<file>   files;
+    str_moveable        vars;
+};
+
+static inputrc_trace* s_trace = nullptr;
+
+//------------------------------------------------------------------------------
+static void trace_read_init_file(const char* filename, const char* buffer, size_t size)
+{
+    for (const auto& f : s_trace->files)
+        if (f.path.equals(filename))
+            return;
+
+    inputrc_trace::file f;
+    f.path = filename;
+    f.exists = !!buffer;
+    f.size = buffer ? size : 0;
+    f.hash = buffer ? hash_bytes(buffer, size) : 0;
+    s_trace->files.emplace_back(std::move(f));
+}
+
+//------------------------------------------------------------------------------
+static void trace_variable_bind(const char* name, const char* value)
+{
+    s_trace->vars.concat("var ");
+    append_hex(s_trace->vars, name);
+    if (value)
+    {
+        s_trace->vars.concat(" =");
+        append_hex(s_trace->vars, value);
+    }
+    else
+    {
+        s_trace->vars.concat(" -");
+    }
+    s_trace->vars.concat("\n");
+}
+
+
+
+//------------------------------------------------------------------------------
+inputrc_cache::inputrc_cache(const char* state_dir, const char* context)
+: m_context(context)
+{
+    if (state_dir && *state_dir)
+    {
+        m_path = state_dir;
+        path::append(m_path, c_cache_name);
+    }
+}
+
+//------------------------------------------------------------------------------
+inputrc_cache::~inputrc_cache()
+{
+    if (m_tracing)
+    {
+        rl_read_init_file_hook = nullptr;
+        rl_variable_bind_hook = nullptr;
+        delete s_trace;
+        s_trace = nullptr;
+    }
+    free_pre();
+}
+
+//------------------------------------------------------------------------------
+void inputrc_cache::free_pre()
+{
+    for (auto& map : m_pre)
+    {
+        free_keymap_copy(map);
+        map = nullptr;
+    }
+}
+
+//------------------------------------------------------------------------------
+// The key covers everything that can influence the outcome besides the files:
+// the keymaps and config variables beforehand, the terminal and application
+// names for $if, and the context (which files get looked for).
+bool inputrc_cache::get_key(str_base& out) const
+{
+    const function_names names;
+
+    uint64 hash = hash_str(m_context.c_str(), hash_bytes(nullptr, 0));
+    hash = hash_str(rl_readline_name, hash);
+    hash = hash_str(rl_terminal_name, hash);
+    hash = hash_bytes(&rl_editing_mode, sizeof(rl_editing_mode), hash);
+
+    for (uint32 i = 0; i < c_num_roots; ++i)
+        if (!hash_keymap(get_root(i), names, hash))
+            return false;
+
+    for (int32 i = 0; const char* name = rl_get_variable_name(i); ++i)
+    {
+        char* value = rl_variable_value(name);
+        hash = hash_str(name, hash);
+        hash = hash_str(value, hash);
+    }
+
+    out.format("%016llx", hash);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool inputrc_cache::apply()
+{
+    if (m_path.empty())
+        return false;
+
+    str_moveable text;
+    {
+        FILE* in = fopen(m_path.c_str(), "rb");
+        if (!in)
+            return false;
+        char buffer[4096];
+        while (size_t n = fread(buffer, 1, sizeof(buffer), in))
+            text.concat(buffer, int32(n));
+        fclose(in);
+    }
+
+    if (!get_key(m_key))
+        return false;
+
+    // Parse and validate everything before changing anything.
+    struct bind
+    {
+        uint32              root;
+        std::vector<uint16> keys;
+        char                kind;
+        str_moveable        value;
+    };
+
+    std::vector<bind> binds;
+    std::vector<std::pair<str_moveable, str_moveable>> vars;
+    std::vector<bool> null_vars;
+    str_moveable last;
+    bool header = false;
+    bool key = false;
+    bool ended = false;
+
+    str<280> tmp;
+    char* line = text.data();
+    while (*line && !ended)
+    {
+        char* eol = strchr(line, '\n');
+        if (eol)
+            *eol = '\0';
+        const char* p = line;
+        line = eol ? eol + 1 : line + strlen(line);
+
+        if (!header)
+        {
+            if (strcmp(p, c_cache_header) != 0)
+                return false;
+            header = true;
+        }
+        else if (strncmp(p, "key ", 4) == 0)
+        {
+            if (!m_key.equals(p + 4))
+                return false;
+            key = true;
+        }
+        else if (strncmp(p, "file ", 5) == 0)
+        {
+            p += 5;
+            if (!parse_hex(p, tmp))
+                return false;
+            uint64 size, hash;
+            if (!get_file_hash(tmp.c_str(), size, hash))
+                return false;
+            str<48> expected;
+            expected.format("%llu %016llx", size, hash);
+            if (!expected.equals(p))
+                return false;
+        }
+        else if (strncmp(p, "missing ", 8) == 0)
+        {
+            p += 8;
+            if (!parse_hex(p, tmp))
+                return false;
+            FILE* f = fopen(tmp.c_str(), "rb");
+            if (f)
+            {
+                fclose(f);
+                return false;
+            }
+        }
+        else if (strncmp(p, "last ", 5) == 0)
+        {
+            p += 5;
+            if (!parse_hex(p, last))
+                return false;
+        }
+        else if (strncmp(p, "var ", 4) == 0)
+        {
+            p += 4;
+            std::pair<str_moveable, str_moveable> var;
+            if (!parse_hex(p, var.first))
+                return false;
+            if (*p == '=')
+            {
+                ++p;
+                if (!parse_hex(p, var.second))
+                    return false;
+                null_vars.push_back(false);
+            }
+            else if (*p == '-')
+            {
+                null_vars.push_back(true);
+            }
+            else
+            {
+                return false;
+            }
+            vars.emplace_back(std::move(var));
+        }
+        else if (strncmp(p, "bind ", 5) == 0)
+        {
+            p += 5;
+            bind b;
+            b.root = uint32(atoi(p));
+            if (b.root >= c_num_roots)
+                return false;
+            while (*p && *p != ' ')
+                ++p;
+            if (*p == ' ')
+                ++p;
+            if (!parse_keys(p, b.keys))
+                return false;
+            b.kind = *(p++);
+            if (*p == ' ')
+                ++p;
+            if (b.kind == 'r')
+                b.value = p;
+            else if (!parse_hex(p, b.value))
+                return false;
+            binds.emplace_back(std::move(b));
+        }
+        else if (strcmp(p, "end") == 0)
+        {
+            ended = true;
+        }
+        else if (*p)
+        {
+            return false;
+        }
+    }
+
+    if (!header || !key || !ended)
+        return false;
+
+    // Apply the bindings to copies of the keymaps, so that nothing changes if
+    // the cache turns out not to fit.
+    Keymap copies[c_num_roots];
+    for (uint32 i = 0; i < c_num_roots; ++i)
+        copies[i] = copy_keymap(get_root(i));
+
+    for (const auto& b : binds)
+    {
+        if (!apply_bind(copies, b.root, b.keys, b.kind, b.value.c_str()))
+        {
+            for (auto& map : copies)
+                free_keymap_copy(map);
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < vars.size(); ++i)
+        rl_variable_bind(vars[i].first.c_str(), null_vars[i] ? nullptr : vars[i].second.c_str());
+
+    for (uint32 i = 0; i < c_num_roots; ++i)
+        move_keymap(get_root(i), copies[i]);
+
+    // Clear global "recent" pointer, since it could have been invalidated.
+    rl_binding_keymap = nullptr;
+
+    if (!last.empty())
+        rl_set_last_init_file(last.c_str());
+
+    LOG("Applied cached inputrc from '%s'", m_path.c_str());
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void inputrc_cache::begin()
+{
+    assert(!m_tracing);
+    assert(!s_trace);
+
+    if (m_path.empty())
+        return;
+    if (m_key.empty() && !get_key(m_key))
+        return;
+
+    for (uint32 i = 0; i < c_num_roots; ++i)
+        m_pre[i] = copy_keymap(get_root(i));
+
+    s_trace = new inputrc_trace;
+    rl_read_init_file_hook = trace_read_init_file;
+    rl_variable_bind_hook = trace_variable_bind;
+    m_errors = rl_init_file_error_count;
+    m_tracing = true;
+}
+
+//------------------------------------------------------------------------------
+void inputrc_cache::end()
+{
+    if (!m_tracing)
+        return;
+
+    rl_read_init_file_hook = nullptr;
+    rl_variable_bind_hook = nullptr;
+    m_tracing = false;
+
+    std::unique_ptr<inputrc_trace> trace(s_trace);
+    s_trace = nullptr;
+
+    // Don't cache errors; they should be reported each time.
+    bool ok = (m_errors == rl_init_file_error_count);
+
+    str_moveable out;
+    if (ok)
+    {
+        out << c_cache_header << "\nkey " << m_key.c_str() << "\n";
+
+        str<48> tmp;
+        for (const auto& f : trace->files)
+        {
+            out.concat(f.exists ? "file " : "missing ");
+            append_hex(out, f.path.c_str());
+            if (f.exists)
+            {
+                tmp.format(" %llu %016llx", f.size, f.hash);
+                out.concat(tmp.c_str(), tmp.length());
+            }
+            out.concat("\n");
+        }
+
+        if (const char* last = rl_get_last_init_file())
+        {
+            out.concat("last ");
+            append_hex(out, last);
+            out.concat("\n");
+        }
+
+        out.concat(trace->vars.c_str(), trace->vars.length());
+
+        const function_names names;
+        std::vector<uint16> keys;
+        for (uint32 i = 0; ok && i < c_num_roots; ++i)
+            ok = diff_keymap(i, m_pre[i], get_root(i), keys, names, out);
+
+        out.concat("end\n");
+    }
+
+    free_pre();
+
+    if (!ok)
+    {
+        _unlink(m_path.c_str());
+        return;
+    }
+
+    FILE* file = fopen(m_path.c_str(), "wb");
+    if (!file)
+        return;
+    fwrite(out.c_str(), out.length(), 1, file);
+    fclose(file);
+}
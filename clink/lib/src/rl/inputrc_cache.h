@@ -0,0 +1,37 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <core/str.h>
+
+typedef struct _keymap_entry* Keymap;
+
+//------------------------------------------------------------------------------
+// Caches the outcome of reading the inputrc files:  the config variables they
+// set and how the keymaps differ afterwards.  The cache is keyed on the content
+// of every file that was read or looked for, and on the keymaps and config
+// variables beforehand.  On a hit the outcome is applied directly, instead of
+// parsing each line and binding each key sequence again.
+//
+// Key bindings made later (e.g. by Lua scripts during clink.onbeginedit) are
+// applied on top of the result as usual.
+class inputrc_cache
+{
+public:
+                    inputrc_cache(const char* state_dir, const char* context);
+                    ~inputrc_cache();
+    bool            apply();
+    void            begin();
+    void            end();
+
+private:
+    bool            get_key(str_base& out) const;
+    void            free_pre();
+    str_moveable    m_path;
+    str_moveable    m_context;
+    str_moveable    m_key;
+    Keymap          m_pre[5] = {};
+    int32           m_errors = 0;
+    bool            m_tracing = false;
+};
@@ -20,11 +20,15 @@
 #include "rl_integration.h"
 #include "line_editor_integration.h"
 #include "suggestions.h"
+#include "keystroke_trace.h"
 
 #include <core/base.h>
 #include <core/log.h>
+#include <core/mem_stats.h>
+#include <core/os.h>
 #include <core/path.h>
 #include <core/settings.h>
+#include <core/startup_profile.h>
 #include <core/debugheap.h>
 #include <terminal/wcwidth.h>
 #include <terminal/printer.h>
@@ -313,7 +317,7 @@ class undo_entry_heap
     };
 
 public:
-    undo_entry_heap() : m_heap(32768)
+    undo_entry_heap() : m_heap(32768, mem_tag::editor)
     {
     }
 
@@ -1473,7 +1477,9 @@ int32 clink_accept_suggested_line(int32 count, int32 invoking_key)
 }
 
 //------------------------------------------------------------------------------
-int32 clink_popup_history(int32 count, int32 invoking_key)
+// Shows the history entries in a popup list.  If ENTRIES is not null, then only
+// the history entries at those indices (in ascending order) are shown.
+static int32 popup_history(int32 invoking_key, const std::vector<int32>* entries)
 {
     HIST_ENTRY** list = history_list();
     if (!list || !history_length)
@@ -1492,8 +1498,12 @@ int32 clink_popup_history(int32 count, int32 invoking_key)
     char** history = (char**)malloc(sizeof(*history) * history_length);
     entry_info* infos = (entry_info*)malloc(sizeof(*infos) * history_length);
     int32 total = 0;
-    for (int32 i = 0; i < history_length; i++)
+    const int32 candidates = entries ? int32(entries->size()) : history_length;
+    for (int32 j = 0; j < candidates; j++)
     {
+        const int32 i = entries ? (*entries)[j] : j;
+        if (i >= history_length)
+            break;
         if (!find_streqn(g_rl_buffer->get_buffer(), list[i]->line, search_len))
             continue;
         history[total] = list[i]->line;
@@ -1551,6 +1561,30 @@ int32 clink_popup_history(int32 count, int32 invoking_key)
     return 0;
 }
 
+//------------------------------------------------------------------------------
+int32 clink_popup_history(int32 count, int32 invoking_key)
+{
+    return popup_history(invoking_key, nullptr);
+}
+
+//------------------------------------------------------------------------------
+int32 clink_popup_cwd_history(int32 count, int32 invoking_key)
+{
+    // Only history entries entered in the current directory are listed, which
+    // requires the 'history.save_dir' setting.
+    str<> cwd;
+    os::get_current_dir(cwd);
+    history_database* h = history_database::get();
+    const std::vector<int32>* entries = h ? h->find_dir_entries(cwd.c_str()) : nullptr;
+    if (!entries)
+    {
+        rl_ding();
+        return 0;
+    }
+
+    return popup_history(invoking_key, entries);
+}
+
 
 
 //------------------------------------------------------------------------------
@@ -2641,6 +2675,49 @@ int32 clink_diagnostics(int32 count, int32 invoking_key)
         print_value("terminal", t.c_str());
     }
 
+    // Startup profile.
+
+    if (rl_explicit_arg && startup_profile::count())
+    {
+        print_heading("startup profile");
+
+        str_moveable profile;
+        startup_profile::format(profile);
+        printf("%s", profile.c_str());
+    }
+
+    // Keystroke latency.
+
+    if (rl_explicit_arg && keystroke_trace::count())
+    {
+        print_heading("keystroke latency");
+
+        str_moveable latency;
+        keystroke_trace::format(latency);
+        printf("%s", latency.c_str());
+
+        t = context.profile.c_str();
+        path::append(t, "clink_keystrokes.json");
+        if (keystroke_trace::write_chrome_trace(t.c_str()))
+            print_value("trace file", t.c_str());
+    }
+
+    // Memory by subsystem.
+
+    if (rl_explicit_arg)
+    {
+        print_heading(mem_stats::counts_heap() ? "memory" : "memory (linear allocators only)");
+
+        str_moveable mem;
+        mem_stats::format(mem);
+        printf("%s", mem.c_str());
+
+        size_t pool_bytes;
+        uint32 pool_pages;
+        linear_allocator::get_pool_stats(pool_bytes, pool_pages);
+        printf("  %-16s  %8zu KB in %u pages\n", "page pool", pool_bytes / 1024, pool_pages);
+    }
+
     host_call_lua_rl_global_function("clink._diagnostics");
 
     task_manager_diagnostics();
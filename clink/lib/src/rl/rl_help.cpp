@@ -40,10 +40,12 @@ extern setting_bool g_terminal_raw_esc;
 //------------------------------------------------------------------------------
 static linear_allocator s_macro_name_store(4096);
 static str_unordered_map<str_moveable> s_macro_descriptions;
+static uint32 s_desc_generation = 0;  // Changes when any description changes.
 
 //------------------------------------------------------------------------------
 void clear_macro_descriptions()
 {
+    ++s_desc_generation;
     s_macro_descriptions.clear();
     s_macro_name_store.reset();
 }
@@ -53,6 +55,8 @@ void add_macro_description(const char* macro, const char* desc)
 {
     dbg_ignore_scope(snapshot, "macro descriptions");
 
+    ++s_desc_generation;
+
     const auto iter = s_macro_descriptions.find(macro);
     if (iter == s_macro_descriptions.end())
     {
@@ -373,6 +377,8 @@ void clink_add_funmap_entry(const char *name, rl_command_func_t *func, int32 cat
 
     rl_add_funmap_entry(name, func);
 
+    ++s_desc_generation;
+
     if (!s_pmap_keydesc)
         s_pmap_keydesc = new keydesc_map;
 
@@ -914,6 +920,63 @@ static void free_collector(Keyentry* collector, int32 offset)
     free(collector);
 }
 
+//------------------------------------------------------------------------------
+// Hashes the bindings in MAP and all the keymaps it chains to.  This is much
+// cheaper than collecting the bindings, which translates each key sequence and
+// looks up each command.
+static void hash_keymap(Keymap map, uint64& hash)
+{
+    for (int32 i = 0; i < KEYMAP_SIZE; ++i)
+    {
+        const KEYMAP_ENTRY& entry = map[i];
+        hash = (hash ^ entry.type) * 1099511628211ull;
+        hash = (hash ^ uint64(uintptr_t(entry.function))) * 1099511628211ull;
+        if (!entry.function)
+            continue;
+
+        if (entry.type == ISKMAP)
+        {
+            hash_keymap((Keymap)entry.function, hash);
+        }
+        else if (entry.type == ISMACR)
+        {
+            for (const char* macro = (const char*)entry.function; *macro; ++macro)
+                hash = (hash ^ uint8(*macro)) * 1099511628211ull;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// The collected, sorted, and deduplicated bindings for a keymap.  Collecting
+// them is expensive, so the most recent collection is reused until the
+// bindings, the descriptions, or the collection options change.
+struct collected_bindings
+{
+                        ~collected_bindings() { clear(); }
+    void                clear();
+
+    Keyentry*           collector = nullptr;
+    int32               offset = 0;
+    std::vector<str_moveable> warnings;
+
+    Keymap              map = nullptr;
+    uint64              hash = 0;
+    uint32              desc_generation = 0;
+    uint32              options = 0;
+};
+
+//------------------------------------------------------------------------------
+void collected_bindings::clear()
+{
+    if (collector)
+        free_collector(collector, offset);
+    collector = nullptr;
+    offset = 0;
+    warnings.clear();
+}
+
+static collected_bindings s_collected_bindings;
+
 //------------------------------------------------------------------------------
 static int32 __cdecl cmp_sort_collector(const void* pv1, const void* pv2)
 {
@@ -1121,51 +1184,54 @@ static bool print_warnings(const std::vector<str_moveable>& warnings, int32 max_
 }
 
 //------------------------------------------------------------------------------
-struct key_binding_info { str_moveable name; str_moveable binding; const char* desc; const char* cat; };
-void show_key_bindings(bool friendly, int32 mode, std::vector<key_binding_info>* out=nullptr)
+static const collected_bindings* collect_bindings(bool friendly, bool categories, bool unbound, bool sort_by_cat)
 {
-    bool show_categories = out || !!(mode & 1);
-    bool show_descriptions = out || !!(mode & 2);
+    collected_bindings& collected = s_collected_bindings;
 
-    struct show_line
+    Keymap map = rl_get_keymap();
+    uint64 hash = 14695981039346656037ull;
+    hash_keymap(map, hash);
+    const uint32 options = ((friendly ? 0x01 : 0) |
+                            (categories ? 0x02 : 0) |
+                            (unbound ? 0x04 : 0) |
+                            (sort_by_cat ? 0x08 : 0) |
+                            (g_terminal_raw_esc.get() ? 0x10 : 0));
+
+    if (collected.collector &&
+        collected.map == map &&
+        collected.hash == hash &&
+        collected.desc_generation == s_desc_generation &&
+        collected.options == options)
     {
-        show_line(const char* heading, const Keyentry* entries, int32 count, int32 step)
-            : m_heading(heading), m_entries(entries), m_count(count), m_step(step) {}
+        return (collected.offset > 1) ? &collected : nullptr;
+    }
 
-        const char* const m_heading;
-        const Keyentry* const m_entries;
-        const int32 m_count;
-        const int32 m_step;
-    };
+    dbg_ignore_scope(snapshot, "collected bindings");
+
+    collected.clear();
 
-    Keymap map = rl_get_keymap();
     int32 offset = 1;
     int32 max_collect = 64;
     Keyentry* collector = (Keyentry*)malloc(sizeof(Keyentry) * max_collect);
     if (!collector)
-        return;
+        return nullptr;
     memset(&collector[0], 0, sizeof(collector[0]));
 
     // Collect the functions in the active keymap.
     str<32> keyseq;
-    std::vector<str_moveable> warnings;
-    collector = collect_keymap(map, collector, &offset, &max_collect, keyseq, friendly, show_categories, (map == emacs_standard_keymap) ? &warnings : nullptr);
+    std::vector<str_moveable>& warnings = collected.warnings;
+    collector = collect_keymap(map, collector, &offset, &max_collect, keyseq, friendly, categories, (map == emacs_standard_keymap) ? &warnings : nullptr);
 
     // Maybe include unbound commands.
-    if (mode & 4)
-        collector = collect_functions(collector, &offset, &max_collect, show_categories);
+    if (unbound)
+        collector = collect_functions(collector, &offset, &max_collect, categories);
 
-    if (offset <= 1)
+    if (offset > 1)
     {
-        free_collector(collector, offset);
-        return;
-    }
+        // Sort the collected keymap.
+        qsort(collector + 1, offset - 1, sizeof(*collector), sort_by_cat ? cmp_sort_collector_cat : cmp_sort_collector);
 
-    // Sort the collected keymap.
-    qsort(collector + 1, offset - 1, sizeof(*collector), out ? cmp_sort_collector : cmp_sort_collector_cat);
-
-    // Remove duplicates; these can happen due to ANYOTHERKEY.
-    {
+        // Remove duplicates; these can happen due to ANYOTHERKEY.
         Keyentry* tortoise = collector + 1;
         Keyentry* hare = collector + 1;
         int32 num = 1;
@@ -1188,6 +1254,41 @@ void show_key_bindings(bool friendly, int32 mode, std::vector<key_binding_info>*
         offset = num;
     }
 
+    collected.collector = collector;
+    collected.offset = offset;
+    collected.map = map;
+    collected.hash = hash;
+    collected.desc_generation = s_desc_generation;
+    collected.options = options;
+    return (offset > 1) ? &collected : nullptr;
+}
+
+//------------------------------------------------------------------------------
+struct key_binding_info { str_moveable name; str_moveable binding; const char* desc; const char* cat; };
+void show_key_bindings(bool friendly, int32 mode, std::vector<key_binding_info>* out=nullptr)
+{
+    bool show_categories = out || !!(mode & 1);
+    bool show_descriptions = out || !!(mode & 2);
+
+    struct show_line
+    {
+        show_line(const char* heading, const Keyentry* entries, int32 count, int32 step)
+            : m_heading(heading), m_entries(entries), m_count(count), m_step(step) {}
+
+        const char* const m_heading;
+        const Keyentry* const m_entries;
+        const int32 m_count;
+        const int32 m_step;
+    };
+
+    const collected_bindings* collected = collect_bindings(friendly, show_categories, !!(mode & 4), !out);
+    if (!collected)
+        return;
+
+    const Keyentry* const collector = collected->collector;
+    const int32 offset = collected->offset;
+    const std::vector<str_moveable>& warnings = collected->warnings;
+
     // Find the longest key name and function name.
     uint32 longest_key[keycat_MAX] = {};
     uint32 longest_func[keycat_MAX] = {};
@@ -1405,8 +1506,6 @@ void show_key_bindings(bool friendly, int32 mode, std::vector<key_binding_info>*
         // Reset (not redraw!) so that transient prompt draws properly.
         rl_reset_line_state();
     }
-
-    free_collector(collector, offset);
 }
 
 //------------------------------------------------------------------------------
@@ -14,6 +14,7 @@
 #include "popup.h"
 #include "textlist_impl.h"
 #include "match_colors.h"
+#include "deferred_init.h"
 #include "display_matches.h"
 #include "display_readline.h"
 #include "clink_ctrlevent.h"
@@ -21,6 +22,7 @@
 #include "sticky_search.h"
 #include "line_editor_integration.h"
 #include "rl_integration.h"
+#include "inputrc_cache.h"
 #include "suggestions.h"
 #include "slash_translation.h"
 
@@ -168,23 +170,23 @@ static setting_color g_color_argmatcher(
     "otherwise the doskey, cmd, or input color will be used.",
     "");
 
-static setting_color g_color_cmd(
+setting_color g_color_cmd(
     "color.cmd",
     "Shell command completions",
     "Used when Clink displays shell (CMD.EXE) command completions.",
     "bold");
 
-static setting_color g_color_cmdredir(
+setting_color g_color_cmdredir(
     "color.cmdredir",
     "Color for < and > redirection symbols",
     "bold");
 
-static setting_color g_color_cmdsep(
+setting_color g_color_cmdsep(
     "color.cmdsep",
     "Color for & and | command separators",
     "bold");
 
-static setting_color g_color_description(
+setting_color g_color_description(
     "color.description",
     "Description completion color",
     "The default color for descriptions of completions.",
@@ -342,6 +344,24 @@ setting_bool g_prompt_async(
     "Enables asynchronous prompt refresh",
     true);
 
+static setting_int g_prompt_filter_budget(
+    "prompt.filter_budget",
+    "Demote slow prompt filters to async",
+    "When this is greater than 0, a prompt filter whose :filter() or\n"
+    ":rightfilter() function takes longer than this many milliseconds is run in\n"
+    "the background for the rest of the session, the same as if it used\n"
+    "clink.promptcoroutine().  This has no effect when prompt.async is off.",
+    0);
+
+static setting_int g_max_undo_kb(
+    "clink.max_undo_kb",
+    "Memory limit for undo in the input line",
+    "When the undo information for the input line uses more than this many KB,\n"
+    "the oldest undo steps are discarded.  This keeps very large pastes or\n"
+    "repeated expansions of long lines from using unbounded memory.  Set this\n"
+    "to 0 for no limit.",
+    1024);
+
 static setting_bool g_rl_hide_stderr(
     "readline.hide_stderr",
     "Suppress stderr from the Readline library",
@@ -379,6 +399,38 @@ static void __cdecl dummy_display_matches_hook(char**, int32, int32)
 
 
 
+//------------------------------------------------------------------------------
+static str_moveable* s_deferred_errors = nullptr;
+static void collect_errmsg(char* msg)
+{
+    s_deferred_errors->concat("readline: ");
+    s_deferred_errors->concat(msg);
+    s_deferred_errors->concat("\n");
+}
+
+//------------------------------------------------------------------------------
+// Match colors are parsed once input is idle (or upon first use), by which
+// time the prompt has been displayed.  So error messages are collected and
+// printed below the input line, and then the input line is redisplayed, the
+// same as when listing completions.
+static void deferred_parse_match_colors()
+{
+    str_moveable errors;
+    {
+        rollback<str_moveable*> rb_errors(s_deferred_errors, &errors);
+        rollback<rl_vcpfunc_t*> rb_hook(rl_errmsg_hook_func, collect_errmsg);
+        parse_match_colors();
+    }
+
+    if (!errors.empty())
+    {
+        rl_crlf();
+        g_printer->print(errors.c_str(), errors.length());
+        rl_forced_update_display();
+    }
+}
+
+
 //------------------------------------------------------------------------------
 static void LOGCURSORPOS()
 {
@@ -702,6 +754,8 @@ static void terminal_write_thunk(FILE* stream, const char* chars, int32 char_cou
         if (stream == stderr && g_rl_hide_stderr.get())
             return;
 
+        wait_for_console_output();
+
         DWORD dw;
         HANDLE h = GetStdHandle(stream == stderr ? STD_ERROR_HANDLE : STD_OUTPUT_HANDLE);
         if (GetConsoleMode(h, &dw))
@@ -749,6 +803,8 @@ static void terminal_log_write(FILE* stream, const char* chars, int32 char_count
         if (stream == stderr && g_rl_hide_stderr.get())
             return;
 
+        wait_for_console_output();
+
         DWORD dw;
         HANDLE h = GetStdHandle(stream == stderr ? STD_ERROR_HANDLE : STD_OUTPUT_HANDLE);
         if (GetConsoleMode(h, &dw))
@@ -928,6 +984,8 @@ static void puts_face_func(const char* s, const char* face, int32 n)
 #endif
 
     str<280> out;
+    str<64> sgr;
+    str<64> last_sgr(c_normal);
     const char* const other_color = fallback_color(s_input_color, c_normal);
     char cur_face = FACE_NORMAL;
     bool hyperlink = false;
@@ -940,10 +998,12 @@ static void puts_face_func(const char* s, const char* face, int32 n)
             if (hyperlink)
             {
                 out << c_hyperlink << c_BEL;
+                last_sgr.clear();
                 hyperlink = false;
             }
 
             cur_face = *face;
+            sgr.clear();
             switch (cur_face)
             {
             default:
@@ -952,25 +1012,25 @@ static void puts_face_func(const char* s, const char* face, int32 n)
                     const char* color = s_classifications->get_face_output(cur_face);
                     if (color)
                     {
-                        out << "\x1b[";
+                        sgr << "\x1b[";
                         if (color[0] != '0' || color[1] != ';')
-                            out << "0;";
-                        out << color << "m";
+                            sgr << "0;";
+                        sgr << color << "m";
                         break;
                     }
                 }
                 // fall through
-            case FACE_NORMAL:       out << c_normal; break;
-            case FACE_STANDOUT:     out << fallback_color(_rl_active_region_start_color, "\x1b[0;7m"); break;
+            case FACE_NORMAL:       sgr << c_normal; break;
+            case FACE_STANDOUT:     sgr << fallback_color(_rl_active_region_start_color, "\x1b[0;7m"); break;
 
-            case FACE_INPUT:        out << fallback_color(s_input_color, c_normal); break;
-            case FACE_MODMARK:      out << fallback_color(_rl_display_modmark_color, c_normal); break;
-            case FACE_MESSAGE:      out << fallback_color(_rl_display_message_color, c_normal); break;
-            case FACE_SCROLL:       out << fallback_color(_rl_display_horizscroll_color, c_normal); break;
-            case FACE_SELECTION:    out << fallback_color(s_selection_color, "\x1b[0;7m"); break;
+            case FACE_INPUT:        sgr << fallback_color(s_input_color, c_normal); break;
+            case FACE_MODMARK:      sgr << fallback_color(_rl_display_modmark_color, c_normal); break;
+            case FACE_MESSAGE:      sgr << fallback_color(_rl_display_message_color, c_normal); break;
+            case FACE_SCROLL:       sgr << fallback_color(_rl_display_horizscroll_color, c_normal); break;
+            case FACE_SELECTION:    sgr << fallback_color(s_selection_color, "\x1b[0;7m"); break;
 
             case FACE_HISTEXPAND:
-                out << fallback_color(s_histexpand_color, "\x1b[0;97;45m") << c_hyperlink << c_doc_histexpand << c_BEL;
+                sgr << fallback_color(s_histexpand_color, "\x1b[0;97;45m") << c_hyperlink << c_doc_histexpand << c_BEL;
                 hyperlink = true;
                 break;
 
@@ -981,7 +1041,7 @@ static void puts_face_func(const char* s, const char* face, int32 n)
 #endif
                 assert(g_autosuggest_enable.get());
                 if (s_suggestion_color)
-                    out << s_suggestion_color;
+                    sgr << s_suggestion_color;
                 else
                 {
 #ifdef AUTO_DETECT_CONSOLE_COLOR_THEME
@@ -992,51 +1052,60 @@ static void puts_face_func(const char* s, const char* face, int32 n)
                         {
                             str<16> faint;
                             faint.format(";%u", get_console_faint_text());
-                            out << "\x1b[0;38;2" << faint << faint << faint << "m";
+                            sgr << "\x1b[0;38;2" << faint << faint << faint << "m";
                         }
                         break;
                     default:
-                        out << "\x1b[0;90m";
+                        sgr << "\x1b[0;90m";
                         break;
                     }
 #else
-                    out << "\x1b[0;90m";
+                    sgr << "\x1b[0;90m";
 #endif
                 }
 #ifdef USE_SUGGESTION_HINT_INLINE
                 if (cur_face == FACE_SUGGESTIONKEY)
-                    out << "\x1b[7m";
+                    sgr << "\x1b[7m";
                 else if (cur_face == FACE_SUGGESTIONLINK)
                 {
-                    out << c_hyperlink << c_doc_autosuggest << c_BEL;
+                    sgr << c_hyperlink << c_doc_autosuggest << c_BEL;
                     hyperlink = true;
                 }
 #endif
                 break;
 
-            case FACE_OTHER:        out << other_color; break;
-            case FACE_UNRECOGNIZED: out << fallback_color(s_unrecognized_color, other_color); break;
-            case FACE_EXECUTABLE:   out << fallback_color(s_executable_color, other_color); break;
+            case FACE_OTHER:        sgr << other_color; break;
+            case FACE_UNRECOGNIZED: sgr << fallback_color(s_unrecognized_color, other_color); break;
+            case FACE_EXECUTABLE:   sgr << fallback_color(s_executable_color, other_color); break;
             case FACE_COMMAND:
                 if (_rl_command_color)
-                    out << "\x1b[" << _rl_command_color << "m";
+                    sgr << "\x1b[" << _rl_command_color << "m";
                 else
-                    out << c_normal;
+                    sgr << c_normal;
                 break;
             case FACE_ALIAS:
                 if (_rl_alias_color)
-                    out << "\x1b[" << _rl_alias_color << "m";
+                    sgr << "\x1b[" << _rl_alias_color << "m";
                 else
-                    out << c_normal;
+                    sgr << c_normal;
                 break;
             case FACE_ARGMATCHER:
                 assert(s_argmatcher_color); // Shouldn't reach here otherwise.
                 if (s_argmatcher_color) // But avoid crashing, just in case.
-                    out << s_argmatcher_color;
+                    sgr << s_argmatcher_color;
                 break;
-            case FACE_ARGUMENT:     out << fallback_color(s_arg_color, fallback_color(s_input_color, c_normal)); break;
-            case FACE_FLAG:         out << fallback_color(s_flag_color, c_normal); break;
-            case FACE_NONE:         out << fallback_color(s_none_color, c_normal); break;
+            case FACE_ARGUMENT:     sgr << fallback_color(s_arg_color, fallback_color(s_input_color, c_normal)); break;
+            case FACE_FLAG:         sgr << fallback_color(s_flag_color, c_normal); break;
+            case FACE_NONE:         sgr << fallback_color(s_none_color, c_normal); break;
+            }
+
+            // Adjacent faces often produce the same output (for example when
+            // several faces fall back to the input color).  Reapplying SGR
+            // codes changes nothing, so skip emitting them again.
+            if (!sgr.equals(last_sgr.c_str()))
+            {
+                out << sgr;
+                last_sgr = sgr.c_str();
             }
         }
 
@@ -1057,7 +1126,7 @@ static void puts_face_func(const char* s, const char* face, int32 n)
 
     if (hyperlink)
         out << c_hyperlink << c_BEL;
-    if (cur_face != FACE_NORMAL)
+    if (hyperlink || !last_sgr.equals(c_normal))
         out << c_normal;
 
     ++s_puts_face;
@@ -1086,11 +1155,27 @@ void force_signaled_redisplay()
     s_force_signaled_redisplay = true;
 }
 
+//------------------------------------------------------------------------------
+// While a burst of queued input is being inserted (e.g. a paste), redisplay is
+// deferred until the burst ends.
+static bool s_input_burst = false;
+
 //------------------------------------------------------------------------------
 static void hook_display()
 {
+    if (s_input_burst)
+    {
+        _rl_want_redisplay = true;
+        return;
+    }
+
     struct clear_want { ~clear_want() { _rl_want_redisplay = false; } } clear_want;
 
+    // Display code queries the console (e.g. the cursor position), so output
+    // held by the printer must be written first.
+    if (g_printer)
+        g_printer->release_output();
+
     static bool s_busy = false;
     if (s_busy)
         return;
@@ -1276,10 +1361,72 @@ const char* get_last_prompt()
     return s_last_prompt.c_str();
 }
 
+//------------------------------------------------------------------------------
+static size_t undo_entry_size(const UNDO_LIST* undo)
+{
+    return sizeof(*undo) + (undo->text ? strlen(undo->text) + 1 : 0);
+}
+
+//------------------------------------------------------------------------------
+// Discards the oldest undo steps when the undo list for the input line exceeds
+// the clink.max_undo_kb limit.  The list only shrinks at the boundary between
+// undo groups, so that undoing a group still finds its beginning.
+static void trim_undo_list()
+{
+    const int32 limit_kb = g_max_undo_kb.get();
+    if (limit_kb <= 0 || !rl_undo_list || _rl_doing_an_undo)
+        return;
+
+    // Keep the newest steps that fit within half the limit, so trimming
+    // doesn't happen again on the very next keystroke.
+    const size_t limit = size_t(limit_kb) * 1024;
+    size_t total = 0;
+    size_t kept = 0;
+    int32 depth = 0;
+    UNDO_LIST* cut = nullptr;
+    for (UNDO_LIST* undo = rl_undo_list; undo; undo = undo->next)
+    {
+        total += undo_entry_size(undo);
+        if (undo->what == UNDO_END)
+            ++depth;
+        else if (undo->what == UNDO_BEGIN && depth > 0)
+            --depth;
+        if (!depth && total <= limit / 2)
+        {
+            cut = undo;
+            kept = total;
+        }
+    }
+
+    if (total <= limit || !cut || !cut->next)
+        return;
+
+    UNDO_LIST* discard = cut->next;
+    cut->next = nullptr;
+
+    // History entries can still refer to the discarded steps, when the input
+    // line came from history.
+    std::unordered_set<const void*> discarded;
+    for (const UNDO_LIST* undo = discard; undo; undo = undo->next)
+        discarded.insert(undo);
+    if (HIST_ENTRY** list = history_list())
+    {
+        for (int32 i = 0; i < history_length; ++i)
+        {
+            if (list[i] && list[i]->data && discarded.find(list[i]->data) != discarded.end())
+                list[i]->data = nullptr;
+        }
+    }
+
+    _rl_free_undo_list(discard);
+    LOG("discarded %zu bytes of undo information; kept %zu bytes", total - kept, kept);
+}
+
 //------------------------------------------------------------------------------
 static void after_dispatch_hook()
 {
     s_need_collect_words = true;
+    trim_undo_list();
 }
 
 //------------------------------------------------------------------------------
@@ -1628,9 +1775,15 @@ stop:
                 flags |= MATCH_FLAG_SUPPRESS_APPEND;
         }
 
+        // Leave lazy descriptions unresolved; match_adapter resolves them
+        // only for the matches that get displayed.
+        const bool lazy_description = iter.is_match_description_lazy();
+        if (lazy_description)
+            flags |= MATCH_FLAG_LAZY_DESCRIPTION;
+
         const char* const match = iter.get_match();
         const char* const display = iter.get_match_display();
-        const char* const description = iter.get_match_description();
+        const char* const description = lazy_description ? nullptr : iter.get_match_description();
         const size_t packed_size = calc_packed_size(match, display, description);
         char* ptr = (char*)malloc(packed_size);
 
@@ -1697,8 +1850,10 @@ static void postprocess_lcd(char* lcd, const char* text)
 }
 
 //------------------------------------------------------------------------------
-static void load_user_inputrc(const char* state_dir, bool no_user)
+static void get_user_inputrc_candidates(const char* state_dir, std::vector<str_moveable>& out)
 {
+    out.clear();
+
 #if defined(PLATFORM_WINDOWS)
     // Remember to update clink_info() if anything changes in here.
 
@@ -1717,8 +1872,6 @@ static void load_user_inputrc(const char* state_dir, bool no_user)
         "clink_inputrc",
     };
 
-    rollback<int32> rb_load_user_inputrc(_rl_load_user_init_file, !no_user);
-
     for (const char* env_var : env_vars)
     {
         str<280> path;
@@ -1733,17 +1886,27 @@ static void load_user_inputrc(const char* state_dir, bool no_user)
         {
             path.truncate(base_len);
             path::append(path, file_names[j]);
-
-            if (!rl_read_init_file(path.c_str()))
-            {
-                LOG("Found Readline inputrc at '%s'", path.c_str());
-                return;
-            }
+            out.emplace_back(path.c_str());
         }
     }
 #endif // PLATFORM_WINDOWS
 }
 
+//------------------------------------------------------------------------------
+static void load_user_inputrc(const std::vector<str_moveable>& candidates, bool no_user)
+{
+    rollback<int32> rb_load_user_inputrc(_rl_load_user_init_file, !no_user);
+
+    for (const auto& path : candidates)
+    {
+        if (!rl_read_init_file(path.c_str()))
+        {
+            LOG("Found Readline inputrc at '%s'", path.c_str());
+            return;
+        }
+    }
+}
+
 //------------------------------------------------------------------------------
 typedef const char* two_strings[2];
 static void bind_keyseq_list(const two_strings* list, Keymap map)
@@ -2110,6 +2273,7 @@ void initialise_readline(const char* shell_name, const char* state_dir, const ch
         clink_add_funmap_entry("clink-popup-complete-numbers", clink_popup_complete_numbers, keycat_completion, "Perform interactive completion from a list of numbers from the current screen");
         clink_add_funmap_entry("clink-popup-directories", clink_popup_directories, keycat_misc, "Show recent directories in a popup list.  In the popup, use Enter to 'cd /d' to the selected directory");
         clink_add_funmap_entry("clink-popup-history", clink_popup_history, keycat_history, "Show history entries in a popup list.  Filters using any text before the cursor point.  In the popup, use Enter to execute the selected history entry");
+        clink_add_funmap_entry("clink-popup-cwd-history", clink_popup_cwd_history, keycat_history, "Show history entries entered in the current directory in a popup list.  Filters using any text before the cursor point.  Requires the 'history.save_dir' setting");
         clink_add_funmap_entry("clink-popup-show-help", clink_popup_show_help, keycat_misc, "Show all key bindings in a searchable popup list.  In the popup, use Enter to invoke the selected key binding.  If a numeric argument of 4 is supplied, includes unbound commands");
         clink_add_funmap_entry("clink-reload", clink_reload, keycat_misc, "Reload Lua scripts and the .inputrc file");
         clink_add_funmap_entry("clink-reset-line", clink_reset_line, keycat_basic, "Clear the input line.  Can be undone, unlike 'revert-line'");
@@ -2377,11 +2541,29 @@ void initialise_readline(const char* shell_name, const char* state_dir, const ch
     bind_keyseq_list(vi_insertion_key_binds, vi_insertion_keymap);
     bind_keyseq_list(vi_movement_key_binds, vi_movement_keymap);
 
-    // Finally, load the inputrc file.
+    // Finally, load the inputrc file.  The outcome is cached, so that it can
+    // be applied directly when nothing has changed since the last time.
 #ifdef CLINK_USE_LUA_EDITOR_TESTER
     if (state_dir)
 #endif
-        load_user_inputrc(state_dir, no_user);
+    {
+        std::vector<str_moveable> candidates;
+        get_user_inputrc_candidates(state_dir, candidates);
+
+        str<> context;
+        context.format("%u %u %s\n", no_user, _rl_default_init_file_optional_set,
+                       _rl_default_init_file ? _rl_default_init_file : "");
+        for (const auto& path : candidates)
+            context << path.c_str() << "\n";
+
+        inputrc_cache cache(state_dir, context.c_str());
+        if (!cache.apply())
+        {
+            cache.begin();
+            load_user_inputrc(candidates, no_user);
+            cache.end();
+        }
+    }
 
     // Override the effect of any 'set keymap' assignments in the inputrc file.
     // This mimics what rl_initialize() does.
@@ -2795,6 +2977,12 @@ bool rl_module::is_input_pending()
     return is_readline_input_pending();
 }
 
+//------------------------------------------------------------------------------
+void rl_module::set_input_burst(bool burst)
+{
+    s_input_burst = burst;
+}
+
 //------------------------------------------------------------------------------
 bool rl_module::next_line(str_base& out)
 {
@@ -2845,10 +3033,9 @@ void rl_module::on_begin_line(const context& context)
 #endif
     clink_install_ctrlevent();
 
-    // Parse the match colors before installing the Readline callback handler,
-    // so that any error messages are printed before any prompt display
-    // happens.
-    parse_match_colors();
+    // Parsing the match colors isn't needed to display the prompt, so defer
+    // it until input is idle or the colors are first used.
+    defer_init(deferred_init_task::match_colors, deferred_parse_match_colors);
 
     // Readline only detects terminal size changes while its line editor is
     // active.  If the terminal size isn't what Readline thought, then update
@@ -3208,8 +3395,11 @@ void rl_module::done(const char* line)
 //------------------------------------------------------------------------------
 void rl_module::on_terminal_resize(int32, int32, const context& context)
 {
-    signal_terminal_resized();
-    resize_readline_display(context.prompt, context.buffer, m_rl_prompt.c_str(), m_rl_rprompt.c_str());
+    // Reflow the prompt and input line that are already displayed.  Prompt
+    // filters are only rerun (after a delay) if a script opted in, and only
+    // when the width changed, since that's all that affects the layout.
+    if (resize_readline_display(context.prompt, context.buffer, m_rl_prompt.c_str(), m_rl_rprompt.c_str()))
+        signal_terminal_resized();
 }
 
 //------------------------------------------------------------------------------
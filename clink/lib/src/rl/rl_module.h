@@ -50,6 +50,7 @@ public:
     void            set_prompt(const char* prompt, const char* rprompt, bool redisplay, bool transient=false);
 
     bool            is_input_pending();
+    void            set_input_burst(bool burst);
     bool            next_line(str_base& out);
 
     static bool     is_showing_argmatchers();
@@ -29,9 +29,12 @@
 #include <core/str_iter.h>
 #include <rl/rl_commands.h>
 #include <terminal/printer.h>
+#include <terminal/terminal_helpers.h>
 #include <terminal/ecma48_iter.h>
 #include <terminal/key_tester.h>
 
+#include <algorithm>
+
 extern "C" {
 #include <compat/config.h>
 #include <readline/readline.h>
@@ -213,7 +216,11 @@ bool selectcomplete_impl::activate(editor_module::result& result, bool reactivat
     m_anchor = -1;
     m_delimiter = 0;
     if (!is_regen_blocked())
-        reset_generate_matches();
+    {
+        // Reactivating restores the line the matches were generated for, so
+        // the completion cache can supply them without running generators.
+        reset_generate_matches(reactivate/*keep_cache*/);
+    }
 
     init_matches();
     assert(m_anchor >= 0);
@@ -267,6 +274,7 @@ cant_activate:
     {
         // I gave up trying to coax Readline into righting the cursor position
         // purely using only ANSI codes.
+        wait_for_console_output();
         CONSOLE_SCREEN_BUFFER_INFO csbi;
         HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
         GetConsoleScreenBufferInfo(h, &csbi);
@@ -289,6 +297,7 @@ cant_activate:
         // Restore cursor position.
         m_printer->print("\x1b[A");
         _rl_move_vert(vpos);
+        wait_for_console_output();
         GetConsoleScreenBufferInfo(h, &csbi);
         restore.Y = csbi.dwCursorPosition.Y;
         SetConsoleCursorPosition(h, restore);
@@ -1003,7 +1012,7 @@ void selectcomplete_impl::cancel(editor_module::result& result, bool can_reactiv
 
     pause_suggestions(false);
 
-    reset_generate_matches();
+    reset_generate_matches(can_reactivate/*keep_cache*/);
 
     update_display();
 
@@ -1216,17 +1225,16 @@ stop:
         int32 len = 0;
 
         match_type type = m_matches.get_match_type(i);
-        const char* match = m_matches.get_match(i);
         bool append = m_matches.is_append_display(i);
         if (use_display(append, type, i))
         {
             if (append)
-                len += printable_len(match, type);
+                len += m_matches.get_match_printable_len(i, type);
             len += m_matches.get_match_visible_display(i);
         }
         else
         {
-            len += printable_len(match, type);
+            len += m_matches.get_match_printable_len(i, type);
         }
 
         if (m_match_longest < len)
@@ -1289,19 +1297,37 @@ force_desc_below:
         }
     }
 
+    // The layout only depends on the matches and the screen width, so keep
+    // the layouts for a few recent widths to make resizing cheap.
     if (m_calc_widths)
+        m_widths_by_cols.clear();
+    if (m_calc_widths || m_widths_cols != m_screen_cols)
     {
+        auto cached = std::find_if(m_widths_by_cols.begin(), m_widths_by_cols.end(),
+                                   [this](const std::pair<int32, column_widths>& e) { return e.first == m_screen_cols; });
+        if (cached != m_widths_by_cols.end())
+        {
+            m_widths = cached->second;
+        }
+        else
+        {
 #ifdef DEBUG
-        const width_t col_extra = m_col_extra;
+            const width_t col_extra = m_col_extra;
 #else
-        const width_t col_extra = 0;
+            const width_t col_extra = 0;
 #endif
-        const bool best_fit = g_match_best_fit.get();
-        const int32 limit_fit = g_match_limit_fitted.get();
-        const bool desc_inline = !m_desc_below && m_matches.has_descriptions();
-        const bool one_column = desc_inline && m_matches.get_match_count() <= DESC_ONE_COLUMN_THRESHOLD;
-        rollback<int32> rcpdl(_rl_completion_prefix_display_length, 0);
-        m_widths = calculate_columns(m_matches, best_fit ? limit_fit : -1, one_column, m_desc_below, col_extra);
+            const bool best_fit = g_match_best_fit.get();
+            const int32 limit_fit = g_match_limit_fitted.get();
+            const bool desc_inline = !m_desc_below && m_matches.has_descriptions();
+            const bool one_column = desc_inline && m_matches.get_match_count() <= DESC_ONE_COLUMN_THRESHOLD;
+            rollback<int32> rcpdl(_rl_completion_prefix_display_length, 0);
+            m_widths = calculate_columns(m_matches, best_fit ? limit_fit : -1, one_column, m_desc_below, col_extra);
+
+            if (m_widths_by_cols.size() >= 8)
+                m_widths_by_cols.erase(m_widths_by_cols.begin());
+            m_widths_by_cols.emplace_back(m_screen_cols, m_widths);
+        }
+        m_widths_cols = m_screen_cols;
         m_calc_widths = false;
     }
 
@@ -1379,8 +1405,11 @@ void selectcomplete_impl::update_display()
 
     if (m_visible_rows > 0)
     {
+        synchronized_output_scope sync(*m_printer);
+
         // Remember the cursor position so it can be restored later to stay
         // consistent with Readline's view of the world.
+        wait_for_console_output();
         CONSOLE_SCREEN_BUFFER_INFO csbi;
         HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
         GetConsoleScreenBufferInfo(h, &csbi);
@@ -1776,10 +1805,12 @@ void selectcomplete_impl::update_display()
             s.format("\x1b[%dA", up);
             m_printer->print(s.c_str(), s.length());
         }
+        wait_for_console_output();
         GetConsoleScreenBufferInfo(h, &csbi);
         m_mouse_offset = csbi.dwCursorPosition.Y + 1/*to top item*/;
         _rl_move_vert(vpos);
         _rl_last_c_pos = cpos;
+        wait_for_console_output();
         GetConsoleScreenBufferInfo(h, &csbi);
         restore.Y = csbi.dwCursorPosition.Y;
         SetConsoleCursorPosition(h, restore);
@@ -12,6 +12,8 @@
 
 #include <core/str.h>
 
+#include <vector>
+
 class printer;
 enum class mouse_input_type : uint8;
 
@@ -86,6 +88,8 @@ private:
     bool            m_clear_display = false;
     bool            m_calc_widths = false;
     column_widths   m_widths;
+    int32           m_widths_cols = -1;
+    std::vector<std::pair<int32, column_widths>> m_widths_by_cols; // Recently used layouts per screen width.
 
     // Inserting matches.
     int32           m_anchor = -1;
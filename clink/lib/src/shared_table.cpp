@@ -0,0 +1,224 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "shared_table.h"
+
+#include <core/settings.h>
+#include <core/str_hash.h>
+#include <core/log.h>
+
+#include <assert.h>
+
+//------------------------------------------------------------------------------
+static setting_bool g_shared_cache(
+    "clink.shared_cache",
+    "Share caches between sessions",
+    "When enabled, Clink sessions share some of what they've looked up, such as\n"
+    "where commands were found in the PATH and the types of paths in the input\n"
+    "line, so a new session doesn't have to look them up again.  This can help\n"
+    "when many sessions are open at once.  Changes take effect the next time a\n"
+    "cache is used.",
+    true);
+
+//------------------------------------------------------------------------------
+shared_table::shared_table(uint32 key_size, uint32 value_size, uint32 slots)
+: m_key_size(key_size)
+, m_value_size(value_size)
+, m_slots(slots - slots % c_ways)
+, m_slot_size((sizeof(slot) + key_size + value_size + 7) & ~7)
+, m_layout(key_size ^ (value_size << 12) ^ (slots << 20))
+{
+    assert(m_slots);
+}
+
+//------------------------------------------------------------------------------
+shared_table::~shared_table()
+{
+    unmap();
+}
+
+//------------------------------------------------------------------------------
+// Opens the named section, if it isn't already the one that's open.  The name
+// can depend on things that change during a session (e.g. the environment), so
+// callers pass it every time.
+bool shared_table::open(const wchar_t* name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!g_shared_cache.get())
+    {
+        unmap();
+        return false;
+    }
+
+    if (m_header && m_name.equals(name))
+        return true;
+
+    unmap();
+    m_name = name;
+
+    const DWORD size = DWORD(sizeof(header) + m_slots * m_slot_size);
+    m_mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, size, name);
+    if (!m_mapping)
+    {
+        LOG("unable to open shared table; error %u", GetLastError());
+        return false;
+    }
+
+    m_header = static_cast<header*>(MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, size));
+    if (!m_header)
+    {
+        LOG("unable to map shared table; error %u", GetLastError());
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+        return false;
+    }
+
+    // The first session to open the section claims its layout.  A session from
+    // a different version with a different layout can't use it.
+    const LONG layout = InterlockedCompareExchange(reinterpret_cast<volatile LONG*>(&m_header->layout), LONG(m_layout), 0);
+    if (layout && uint32(layout) != m_layout)
+    {
+        LOG("shared table has a different layout");
+        UnmapViewOfFile(m_header);
+        CloseHandle(m_mapping);
+        m_header = nullptr;
+        m_mapping = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void shared_table::close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    unmap();
+}
+
+//------------------------------------------------------------------------------
+// The caller must hold m_mutex (or be the destructor).
+void shared_table::unmap()
+{
+    if (m_header)
+        UnmapViewOfFile(m_header);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    m_header = nullptr;
+    m_mapping = nullptr;
+}
+
+//------------------------------------------------------------------------------
+// Copies the value for the key into VALUE, which must have room for the table's
+// value size.  The key must be shorter than the table's key size.
+bool shared_table::find(const char* key, void* value)
+{
+    const uint32 key_len = uint32(strlen(key));
+    if (!key_len || key_len >= m_key_size)
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_header)
+        return false;
+
+    // Zero means an empty slot, so never use it as a hash.
+    const uint32 hash = str_hash(key, key_len) | 1;
+    const LONG generation = InterlockedCompareExchange(&m_header->generation, 0, 0);
+
+    const uint32 bucket = get_bucket(hash);
+    for (uint32 i = 0; i < c_ways; ++i)
+    {
+        slot* s = get_slot(bucket + i);
+
+        const LONG seq = InterlockedCompareExchange(&s->seq, 0, 0);
+        if (!seq || (seq & 1) || s->hash != hash || s->generation != generation)
+            continue;
+
+        const char* found_key = get_key(s);
+        const bool match = (strncmp(found_key, key, m_key_size) == 0);
+        if (match)
+            memcpy(value, get_value(s), m_value_size);
+
+        // Discard the copy if a writer touched the slot meanwhile.
+        if (InterlockedCompareExchange(&s->seq, 0, 0) != seq)
+            continue;
+
+        if (match)
+            return true;
+    }
+
+    return false;
+}
+
+//------------------------------------------------------------------------------
+void shared_table::store(const char* key, const void* value, uint32 value_len)
+{
+    const uint32 key_len = uint32(strlen(key));
+    if (!key_len || key_len >= m_key_size || value_len > m_value_size)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_header)
+        return;
+
+    const uint32 hash = str_hash(key, key_len) | 1;
+    const LONG generation = InterlockedCompareExchange(&m_header->generation, 0, 0);
+
+    // Reuse the slot that already has the key, or else an empty or outdated
+    // slot, or else evict a slot chosen by the hash.
+    const uint32 bucket = get_bucket(hash);
+    slot* target = nullptr;
+    for (uint32 i = 0; i < c_ways; ++i)
+    {
+        slot* s = get_slot(bucket + i);
+        if (s->hash == hash && strncmp(get_key(s), key, m_key_size) == 0)
+        {
+            target = s;
+            break;
+        }
+        if (!target && (!s->seq || s->generation != generation))
+            target = s;
+    }
+    if (!target)
+        target = get_slot(bucket + (hash >> 24) % c_ways);
+
+    // Skip it if another session is writing the slot.
+    const LONG seq = InterlockedCompareExchange(&target->seq, 0, 0);
+    if ((seq & 1) || InterlockedCompareExchange(&target->seq, seq + 1, seq) != seq)
+        return;
+
+    target->hash = hash;
+    target->generation = generation;
+    char* slot_key = get_key(target);
+    memset(slot_key, 0, m_key_size);
+    memcpy(slot_key, key, key_len);
+    char* slot_value = get_value(target);
+    memset(slot_value, 0, m_value_size);
+    memcpy(slot_value, value, value_len);
+
+    InterlockedIncrement(&target->seq);
+}
+
+//------------------------------------------------------------------------------
+// Makes every slot outdated, in all sessions.
+void shared_table::invalidate()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_header)
+        InterlockedIncrement(&m_header->generation);
+}
+
+//------------------------------------------------------------------------------
+shared_table::slot* shared_table::get_slot(uint32 index) const
+{
+    char* base = reinterpret_cast<char*>(m_header + 1);
+    return reinterpret_cast<slot*>(base + size_t(index) * m_slot_size);
+}
+
+//------------------------------------------------------------------------------
+uint32 shared_table::get_bucket(uint32 hash) const
+{
+    return (hash % (m_slots / c_ways)) * c_ways;
+}
@@ -55,17 +55,20 @@ static setting_bool g_original_case(
     "original capitalization from the suggestion.",
     true);
 
-static setting_str g_autosuggest_strategy(
+setting_str g_autosuggest_strategy(
     "autosuggest.strategy",
     "Controls how suggestions are chosen",
     "This determines how suggestions are chosen.  The suggestion generators are\n"
-    "tried in the order listed, until one provides a suggestion.  There are three\n"
+    "tried in the order listed, until one provides a suggestion.  There are four\n"
     "built-in suggestion generators, and scripts can provide new ones.\n"
     "'history' chooses the most recent matching command from the history.\n"
     "'completion' chooses the first of the matching completions.\n"
     "'match_prev_cmd' chooses the most recent matching command whose preceding\n"
     "history entry matches the most recently invoked command, but only when\n"
-    "the 'history.dupe_mode' setting is 'add'.",
+    "the 'history.dupe_mode' setting is 'add'.\n"
+    "'cwd_history' chooses the most recent matching command that was entered in\n"
+    "the current directory, but only when the 'history.save_dir' setting is\n"
+    "'true'.",
     "match_prev_cmd history completion");
 
 //------------------------------------------------------------------------------
@@ -207,11 +210,58 @@ bool suggestion_manager::can_suggest(const line_state& line)
     // line editor is considering whether to generate a new suggestion.
     m_endword_offset = line.get_end_word_offset();
 
+    // Typing through the suggestion keeps it, without generating a new one.
+    if (diff && extend_suggestion())
+        return false;
+
     // The buffers are not necessarily nul terminated!  Because of how
     // hook_display() hacks suggestions into the Readline display.
     return diff;
 }
 
+//------------------------------------------------------------------------------
+// When the input line only appends to the line that generated the suggestion,
+// and the input line still agrees with the suggestion, then the suggestion is
+// still valid and generating a new one would reach the same result in nearly
+// all cases.  So just adopt the input line as the suggestion's line.
+bool suggestion_manager::extend_suggestion()
+{
+    if (!m_iter.more() || m_suggestion_offset > m_line.length())
+        return false;
+
+    const char* const buffer = g_rl_buffer->get_buffer();
+    const uint32 len = g_rl_buffer->get_length();
+    if (len <= m_line.length() || strncmp(m_line.c_str(), buffer, m_line.length()) != 0)
+        return false;
+
+    // Do not allow relaxed comparison for suggestions, as it is too confusing,
+    // as a result of the logic to respect original case.
+    {
+        int32 scope = g_ignore_case.get() ? str_compare_scope::caseless : str_compare_scope::exact;
+        str_compare_scope compare(scope, g_fuzzy_accent.get());
+
+        str_iter orig(buffer + m_suggestion_offset, len - m_suggestion_offset);
+        str_iter sugg(m_suggestion.c_str(), m_suggestion.length());
+        str_compare<char, false/*compute_lcd*/, true/*exact_slash*/>(orig, sugg);
+
+        // Let a new suggestion be generated once the input line has consumed
+        // the whole suggestion.
+        if (orig.more() || !sugg.more())
+            return false;
+    }
+
+    m_line.clear();
+    m_line.concat(buffer, len);
+    m_started.clear();
+    m_started.concat(buffer, len);
+
+#ifdef DEBUG_SUGGEST
+    printf("\x1b[s\x1b[2Hextended: \"%s\"\x1b[K\x1b[u", m_line.c_str());
+#endif
+
+    return true;
+}
+
 //------------------------------------------------------------------------------
 bool suggestion_manager::can_update_matches()
 {
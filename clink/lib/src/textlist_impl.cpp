@@ -97,6 +97,9 @@ static bool s_standalone = false;
 static int32 s_old_default_popup_search_mode = -1;
 static int32 s_default_popup_search_mode = -1;
 const int32 min_screen_cols = 20;
+static const int32 c_min_lazy_items = 5000;     // Gather lists this long lazily.
+static const int32 c_width_samples = 1000;      // Items sampled to estimate width.
+static const size_t c_min_async_items = 2000;   // Filter lists this long in the background.
 
 //------------------------------------------------------------------------------
 static int32 make_item(const char* in, str_base& out)
@@ -173,6 +176,39 @@ static int32 limit_cells(const char* in, int32 limit, int32& cells, int32 horz_o
         *text_ptr = nullptr;
 
     cells = 0;
+
+    // Fast path for plain printable ASCII text, which is the common case.
+    if (!horz_offset && limit >= 0)
+    {
+        const int32 ascii = printable_ascii_len(in, limit + 1);
+        if (ascii <= limit && !in[ascii])
+        {
+            cells = ascii;
+            if (text_ptr)
+                *text_ptr = in;
+            return ascii;
+        }
+        if (ascii > limit)
+        {
+            cells = max<int32>(0, limit - (out ? ellipsis_cells : 0));
+            if (out)
+            {
+                out->concat(in, cells);
+                if (cells + ellipsis_cells <= limit)
+                {
+                    out->concat(ellipsis, ellipsis_len);
+                    cells += ellipsis_cells;
+                }
+                if (text_ptr)
+                    *text_ptr = out->c_str();
+                return out->length();
+            }
+            if (text_ptr)
+                *text_ptr = in;
+            return cells;
+        }
+    }
+
     wcwidth_iter iter(in, strlen(in));
 
     if (horz_offset)
@@ -545,10 +581,23 @@ popup_results textlist_impl::activate(const char* title, const char** entries, i
         dbgsetsanealloc(max<int32>(count * (32 + (sizeof(void*)*3)), 256*1024), 1024*1024, nullptr);
 #endif
 
-    // Gather the items.
+    // Gather the items.  Long plain lists (e.g. a big history) only escape
+    // items as they're needed for display or filtering, and estimate the
+    // widest item from an even sample.  Items wider than the estimate widen
+    // the layout when they become visible.
     str<> tmp;
     str<> tmp2;
-    for (int32 i = 0; i < count; i++)
+    const bool lazy = (!has_columns && !history_timestamps && count >= c_min_lazy_items);
+    m_lazy_items = lazy;
+    if (lazy)
+    {
+        m_items.resize(count);
+        const int32 stride = max<int32>(1, count / c_width_samples);
+        for (int32 i = 0; i < count; i += stride)
+            get_item(i);
+        get_item(count - 1);
+    }
+    else for (int32 i = 0; i < count; i++)
     {
         const char* text;
         if (has_columns)
@@ -598,7 +647,8 @@ popup_results textlist_impl::activate(const char* title, const char** entries, i
     m_reset_history_index = false;
     update_display();
 
-    m_dispatcher.dispatch(m_bind_group);
+    filter_idle idle(*this);
+    m_dispatcher.dispatch(m_bind_group, &idle);
 
     // Cancel if the dispatch loop is left unexpectedly (e.g. certain errors).
     if (m_active)
@@ -942,10 +992,12 @@ find:
             }
 
             // Remove the item from the popup list.
+            cancel_filter(true/*wait*/);
             const int32 old_rows = min<int32>(m_visible_rows, m_count);
             int32 move_count = (m_original_count - 1) - original_index;
             memmove(m_entries + original_index, m_entries + original_index + 1, move_count * sizeof(m_entries[0]));
             m_items.erase(m_items.begin() + original_index);
+            m_trigrams.clear();
             if (m_has_columns)
                 m_columns.erase_row(original_index);
             if (m_infos)
@@ -1484,8 +1536,11 @@ void textlist_impl::update_display()
     const bool is_filter_active = (m_original_count && !m_filter_string.empty());
     if (m_visible_rows > 0 || is_filter_active)
     {
+        synchronized_output_scope sync(*m_printer);
+
         // Remember the cursor position so it can be restored later to stay
         // consistent with Readline's view of the world.
+        wait_for_console_output();
         CONSOLE_SCREEN_BUFFER_INFO csbi;
         const HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
         GetConsoleScreenBufferInfo(h, &csbi);
@@ -1510,6 +1565,13 @@ void textlist_impl::update_display()
         {
             update_top();
 
+            // Items gathered lazily may be wider than the estimate.
+            const int32 old_longest = m_longest;
+            for (int32 row = 0; row < m_visible_rows && m_top + row < count; ++row)
+                get_item_text(m_top + row);
+            if (m_longest > old_longest)
+                m_prev_displayed = -1;
+
             const bool draw_border = (m_prev_displayed < 0) || m_override_title.length() || m_has_override_title;
             m_has_override_title = !m_override_title.empty();
 
@@ -1789,6 +1851,7 @@ void textlist_impl::update_display()
             s.format("\x1b[%dA", up);
             m_printer->print(s.c_str(), s.length());
         }
+        wait_for_console_output();
         GetConsoleScreenBufferInfo(h, &csbi);
         m_mouse_offset = csbi.dwCursorPosition.Y + 1/*to top item*/;
         if (!s_standalone)
@@ -1796,6 +1859,7 @@ void textlist_impl::update_display()
             m_mouse_offset += 1/*to border*/;
             _rl_move_vert(vpos);
             _rl_last_c_pos = cpos;
+            wait_for_console_output();
             GetConsoleScreenBufferInfo(h, &csbi);
         }
         restore.Y = csbi.dwCursorPosition.Y;
@@ -1881,6 +1945,8 @@ void textlist_impl::init_colors(const popup_config* config)
 //------------------------------------------------------------------------------
 void textlist_impl::reset()
 {
+    stop_filter_thread();
+
     // Don't reset screen row and cols; they stay in sync with the terminal.
 
     m_visible_rows = 0;
@@ -1900,6 +1966,7 @@ void textlist_impl::reset()
     m_entries = nullptr;    // Don't free; is only borrowed.
     m_infos = nullptr;      // Don't free; is only borrowed.
     m_items = std::move(std::vector<const char*>());
+    m_lazy_items = false;
     m_longest = 0;
     m_columns.clear();
 
@@ -1908,6 +1975,7 @@ void textlist_impl::reset()
     m_filter_saved_top = -1;
     m_original_count = 0;
     m_filtered_items = std::move(std::vector<int32>());
+    m_trigrams.clear();
 
     m_mode = textlist_mode::general;
     m_pref_height = 0;
@@ -1940,11 +2008,26 @@ int32 textlist_impl::get_original_index(int32 index) const
 }
 
 //------------------------------------------------------------------------------
-const char* textlist_impl::get_item_text(int32 index) const
+const char* textlist_impl::get_item(int32 original_index)
+{
+    const char* item = m_items[original_index];
+    if (!item)
+    {
+        // Only plain lists are gathered lazily, so the entry is the text.
+        str<> tmp;
+        m_longest = max<int32>(m_longest, make_item(m_entries[original_index], tmp));
+        item = m_store.add(tmp.c_str());
+        m_items[original_index] = item;
+    }
+    return item;
+}
+
+//------------------------------------------------------------------------------
+const char* textlist_impl::get_item_text(int32 index)
 {
     if (!m_filter_string.empty())
         index = m_filtered_items[index];
-    return m_items[index];
+    return get_item(index);
 }
 
 //------------------------------------------------------------------------------
@@ -1964,9 +2047,21 @@ const entry_info& textlist_impl::get_item_info(int32 index) const
     return m_infos[index];
 }
 
+//------------------------------------------------------------------------------
+// The filter may run on a background thread while display fills in lazily
+// gathered items, so for those lists it only reads the original entries.  They
+// have no columns, so the entry is the text.  Other lists' items are complete
+// before filtering starts.
+const char* textlist_impl::get_filter_text(int32 original_index) const
+{
+    return m_lazy_items ? m_entries[original_index] : m_items[original_index];
+}
+
 //------------------------------------------------------------------------------
 void textlist_impl::clear_filter()
 {
+    cancel_filter();
+
     if (!m_filter_string.empty())
     {
         m_count = m_original_count;
@@ -1980,11 +2075,94 @@ void textlist_impl::clear_filter()
     }
 }
 
+//------------------------------------------------------------------------------
+// Uses a trigram index to find the items that might match the needle, for long
+// lists where testing every item on each keystroke gets slow.  Returns false if
+// the index can't be used, in which case every item must be tested.
+bool textlist_impl::get_filter_candidates(const char* needle, std::vector<int32>& out)
+{
+    static const size_t c_min_indexed_items = 2000;
+
+    if (m_items.size() < c_min_indexed_items)
+        return false;
+
+    if (m_trigrams.empty() || !m_trigrams.is_compatible())
+    {
+        m_trigrams.clear();
+        for (size_t i = 0; i < m_items.size(); ++i)
+        {
+            m_trigrams.add(int32(i), get_filter_text(int32(i)));
+            if (m_has_columns)
+            {
+                for (int32 col = 0; col < max_columns; col++)
+                    m_trigrams.add(int32(i), m_columns.get_col_text(int32(i), col));
+            }
+        }
+    }
+
+    return m_trigrams.query(needle, out);
+}
+
+//------------------------------------------------------------------------------
+// Collects the original indices of the items that match the needle.  If narrow
+// is not null, only those items are tested.  Returns false if interrupted.
+bool textlist_impl::collect_matches(const char* needle, const std::vector<int32>* narrow, const std::function<bool()>& interrupt, std::vector<int32>& out)
+{
+    auto is_match = [&](int32 original_index) {
+        bool match = strstr_compare(needle, get_filter_text(original_index));
+        if (m_has_columns)
+        {
+            for (int32 col = 0; !match && col < max_columns; col++)
+                match = strstr_compare(needle, m_columns.get_col_text(original_index, col));
+        }
+        return match;
+    };
+
+    out.clear();
+
+    std::vector<int32> candidates;
+    if (get_filter_candidates(needle, candidates))
+    {
+        // Only the candidates from the index can match.  Any item that matches
+        // the needle also matched the previous filter string (if any), so the
+        // candidates don't need to be intersected with the filtered list.
+        narrow = &candidates;
+    }
+
+    if (narrow)
+    {
+        for (int32 original_index : *narrow)
+        {
+            // Interrupt if more input is available.
+            if (interrupt())
+                return false;
+            if (is_match(original_index))
+                out.push_back(original_index);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < m_items.size(); ++i)
+        {
+            // Interrupt if more input is available.
+            if (interrupt())
+                return false;
+            if (is_match(int32(i)))
+                out.push_back(int32(i));
+        }
+    }
+
+    return true;
+}
+
 //------------------------------------------------------------------------------
 bool textlist_impl::filter_items()
 {
     assert(!m_needle_is_number);
 
+    // Any filter still running in the background is out of date now.
+    cancel_filter();
+
     if (m_filter_string.equals(m_needle.c_str()))
         return false;
 
@@ -1997,12 +2175,38 @@ bool textlist_impl::filter_items()
     int32 mode = g_ignore_case.get();
     if (mode < 0 || mode >= str_compare_scope::num_scope_values)
         mode = str_compare_scope::exact;
-    str_compare_scope _(mode, g_fuzzy_accent.get());
+    const bool fuzzy_accent = g_fuzzy_accent.get();
+
+    // If the needle extends the filter string, only the filtered list needs to
+    // be tested.
+    const bool narrow = (!m_filter_string.empty() && strncmp(m_needle.c_str(), m_filter_string.c_str(), m_filter_string.length()) == 0);
+
+    // Long lists are filtered on a background thread, and the current results
+    // stay visible until the new results are ready.
+    if (m_items.size() >= c_min_async_items && start_filter_thread())
+    {
+        AcquireSRWLockExclusive(&m_filter_lock);
+        m_filter_job.needle = m_needle.c_str();
+        m_filter_job.use_narrow = narrow;
+        if (narrow)
+            m_filter_job.narrow = m_filtered_items;
+        else
+            m_filter_job.narrow.clear();
+        m_filter_job.mode = mode;
+        m_filter_job.fuzzy_accent = fuzzy_accent;
+        m_filter_job.generation = m_filter_generation;
+        m_filter_has_job = true;
+        ReleaseSRWLockExclusive(&m_filter_lock);
+        SetEvent(m_filter_wake);
+        return false;
+    }
+
+    str_compare_scope _(mode, fuzzy_accent);
 
     int32 defer_test = 0;
-    int32 tested = 0;
     auto test_input = [&](){
-        ++tested;
+        if (defer_test-- > 0)
+            return false;
         defer_test = 128;
         if (!m_dispatcher.available(0))
             return false;
@@ -2019,48 +2223,16 @@ bool textlist_impl::filter_items()
 
     // Build new filtered list.
     std::vector<int32> filtered_items;
-    if (!m_filter_string.empty() && strncmp(m_needle.c_str(), m_filter_string.c_str(), m_filter_string.length()) == 0)
-    {
-        // Further filter the filtered list.
-        for (size_t i = 0; i < m_filtered_items.size(); ++i)
-        {
-            // Interrupt if more input is available.
-            if (!defer_test-- && test_input())
-                return false;
-
-            const int32 original_index = m_filtered_items[i];
-
-            bool match = m_needle.empty() || strstr_compare(m_needle, m_items[original_index]);
-            if (m_has_columns)
-            {
-                for (int32 col = 0; !match && col < max_columns; col++)
-                    match = strstr_compare(m_needle, m_columns.get_col_text(original_index, col));
-            }
-
-            if (match)
-                filtered_items.push_back(original_index);
-        }
-    }
-    else
-    {
-        for (size_t i = 0; i < m_items.size(); ++i)
-        {
-            // Interrupt if more input is available.
-            if (!defer_test-- && test_input())
-                return false;
-
-            bool match = m_needle.empty() || strstr_compare(m_needle, m_items[i]);
-            if (m_has_columns)
-            {
-                for (int32 col = 0; !match && col < max_columns; col++)
-                    match = strstr_compare(m_needle, m_columns.get_col_text(i, col));
-            }
+    if (!collect_matches(m_needle.c_str(), narrow ? &m_filtered_items : nullptr, test_input, filtered_items))
+        return false;
 
-            if (match)
-                filtered_items.push_back(int32(i));
-        }
-    }
+    commit_filter(m_needle.c_str(), std::move(filtered_items));
+    return true;
+}
 
+//------------------------------------------------------------------------------
+void textlist_impl::commit_filter(const char* needle, std::vector<int32>&& filtered_items)
+{
     // Swap new filtered list into place.
     m_filtered_items = std::move(filtered_items);
     m_count = int32(m_filtered_items.size());
@@ -2073,7 +2245,7 @@ bool textlist_impl::filter_items()
     }
 
     // Remember the filter string.
-    m_filter_string = m_needle.c_str();
+    m_filter_string = needle;
 
     // Reset the selected item.
     if (m_reverse)
@@ -2087,10 +2259,171 @@ bool textlist_impl::filter_items()
     // Update the size of the scroll bar, since m_count may have changed.
     m_vert_scroll_car = calc_scroll_car_size(m_visible_rows, m_count);
 #endif
+}
+
+//------------------------------------------------------------------------------
+bool textlist_impl::start_filter_thread()
+{
+    if (m_filter_thread)
+        return true;
+
+    m_filter_stop = false;
+    m_filter_wake = CreateEvent(nullptr, false, false, nullptr);
+    m_filter_ready = CreateEvent(nullptr, false, false, nullptr);
+    if (m_filter_wake && m_filter_ready)
+        m_filter_thread = CreateThread(nullptr, 0, filter_thread_proc, this, 0, nullptr);
+
+    if (!m_filter_thread)
+    {
+        if (m_filter_wake)
+            CloseHandle(m_filter_wake);
+        if (m_filter_ready)
+            CloseHandle(m_filter_ready);
+        m_filter_wake = nullptr;
+        m_filter_ready = nullptr;
+        return false;
+    }
 
     return true;
 }
 
+//------------------------------------------------------------------------------
+void textlist_impl::stop_filter_thread()
+{
+    if (!m_filter_thread)
+        return;
+
+    m_filter_stop = true;
+    cancel_filter();
+    SetEvent(m_filter_wake);
+    WaitForSingleObject(m_filter_thread, INFINITE);
+
+    CloseHandle(m_filter_thread);
+    CloseHandle(m_filter_wake);
+    CloseHandle(m_filter_ready);
+    m_filter_thread = nullptr;
+    m_filter_wake = nullptr;
+    m_filter_ready = nullptr;
+
+    m_filter_has_job = false;
+    m_filter_job = filter_job();
+    m_filter_results = std::vector<int32>();
+    m_filter_results_needle.free();
+    m_filter_results_generation = -1;
+}
+
+//------------------------------------------------------------------------------
+// Makes any pending or running filter job obsolete.  When wait is true, this
+// also waits until the filter thread isn't using the list, so the list can be
+// modified.
+void textlist_impl::cancel_filter(bool wait)
+{
+    InterlockedIncrement(&m_filter_generation);
+
+    if (wait && m_filter_thread)
+    {
+        AcquireSRWLockExclusive(&m_filter_lock);
+        m_filter_has_job = false;
+        ReleaseSRWLockExclusive(&m_filter_lock);
+
+        AcquireSRWLockExclusive(&m_filter_busy);
+        ReleaseSRWLockExclusive(&m_filter_busy);
+    }
+}
+
+//------------------------------------------------------------------------------
+void textlist_impl::apply_filter_results()
+{
+    std::vector<int32> filtered_items;
+    str_moveable needle;
+
+    AcquireSRWLockExclusive(&m_filter_lock);
+    const bool current = (m_filter_results_generation == m_filter_generation);
+    if (current)
+    {
+        filtered_items = std::move(m_filter_results);
+        needle = std::move(m_filter_results_needle);
+        m_filter_results_generation = -1;
+    }
+    ReleaseSRWLockExclusive(&m_filter_lock);
+
+    if (!current || !m_active)
+        return;
+
+    commit_filter(needle.c_str(), std::move(filtered_items));
+    m_prev_displayed = -1;
+    m_force_clear = true;
+    update_display();
+}
+
+//------------------------------------------------------------------------------
+DWORD WINAPI textlist_impl::filter_thread_proc(void* param)
+{
+    textlist_impl* const self = static_cast<textlist_impl*>(param);
+
+    while (true)
+    {
+        WaitForSingleObject(self->m_filter_wake, INFINITE);
+        if (self->m_filter_stop)
+            break;
+
+        AcquireSRWLockExclusive(&self->m_filter_busy);
+
+        filter_job job;
+        AcquireSRWLockExclusive(&self->m_filter_lock);
+        const bool has_job = self->m_filter_has_job;
+        if (has_job)
+        {
+            job = std::move(self->m_filter_job);
+            self->m_filter_has_job = false;
+        }
+        ReleaseSRWLockExclusive(&self->m_filter_lock);
+
+        if (has_job && job.generation == self->m_filter_generation)
+        {
+            str_compare_scope _(job.mode, job.fuzzy_accent);
+
+            // A new keystroke starts a new generation, which cancels this job.
+            auto interrupt = [&](){
+                return job.generation != self->m_filter_generation;
+            };
+
+            std::vector<int32> filtered_items;
+            if (self->collect_matches(job.needle.c_str(), job.use_narrow ? &job.narrow : nullptr, interrupt, filtered_items))
+            {
+                AcquireSRWLockExclusive(&self->m_filter_lock);
+                if (job.generation == self->m_filter_generation)
+                {
+                    self->m_filter_results = std::move(filtered_items);
+                    self->m_filter_results_needle = std::move(job.needle);
+                    self->m_filter_results_generation = job.generation;
+                    SetEvent(self->m_filter_ready);
+                }
+                ReleaseSRWLockExclusive(&self->m_filter_lock);
+            }
+        }
+
+        ReleaseSRWLockExclusive(&self->m_filter_busy);
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+uint32 textlist_impl::filter_idle::get_wait_events(void** events, size_t max)
+{
+    if (!m_owner.m_filter_ready || !max)
+        return 0;
+    events[0] = m_owner.m_filter_ready;
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+void textlist_impl::filter_idle::on_wait_event(uint32 index)
+{
+    m_owner.apply_filter_results();
+}
+
 
 
 //------------------------------------------------------------------------------
@@ -2176,7 +2509,7 @@ public:
                         standalone_input(terminal& term);
 
     // input_dispatcher
-    void                dispatch(int32 bind_group) override;
+    void                dispatch(int32 bind_group, input_idle* idle=nullptr) override;
     bool                available(uint32 timeout) override;
     uint8               peek() override;
 
@@ -2242,7 +2575,7 @@ standalone_input::standalone_input(terminal& term)
 }
 
 //------------------------------------------------------------------------------
-void standalone_input::dispatch(int32 bind_group)
+void standalone_input::dispatch(int32 bind_group, input_idle* idle)
 {
     // Claim any pending binding, otherwise we'll try to dispatch it again.
 
@@ -2262,7 +2595,7 @@ void standalone_input::dispatch(int32 bind_group)
 
     do
     {
-        m_terminal.in->select();
+        m_terminal.in->select(idle);
         m_invalid_dispatch = false;
     }
     while (!update_input() || m_invalid_dispatch);
@@ -7,9 +7,13 @@
 #include "input_dispatcher.h"
 #include "popup.h"
 #include "scroll_helper.h"
+#include "trigram_index.h"
+
+#include <terminal/input_idle.h>
 
 #include <core/str.h>
 
+#include <functional>
 #include <vector>
 
 class printer;
@@ -92,11 +96,44 @@ private:
 
     // Filtering.
     int32           get_original_index(int32 index) const;
-    const char*     get_item_text(int32 index) const;
+    const char*     get_item(int32 original_index);
+    const char*     get_item_text(int32 index);
     const char*     get_col_text(int32 index, int32 col) const;
     const entry_info& get_item_info(int32 index) const;
+    const char*     get_filter_text(int32 original_index) const;
     void            clear_filter();
     bool            filter_items();
+    bool            collect_matches(const char* needle, const std::vector<int32>* narrow, const std::function<bool()>& interrupt, std::vector<int32>& out);
+    bool            get_filter_candidates(const char* needle, std::vector<int32>& out);
+    void            commit_filter(const char* needle, std::vector<int32>&& filtered_items);
+
+    // Background filtering.
+    struct filter_job
+    {
+        str_moveable        needle;
+        std::vector<int32>  narrow;
+        bool                use_narrow = false;
+        int32               mode = 0;
+        bool                fuzzy_accent = false;
+        LONG                generation = 0;
+    };
+    class filter_idle : public input_idle
+    {
+    public:
+                        filter_idle(textlist_impl& owner) : m_owner(owner) {}
+        void            reset() override {}
+        uint32          get_timeout() override { return INFINITE; }
+        uint32          get_wait_events(void** events, size_t max) override;
+        void            on_wait_event(uint32 index) override;
+        void            on_idle() override {}
+    private:
+        textlist_impl&  m_owner;
+    };
+    bool            start_filter_thread();
+    void            stop_filter_thread();
+    void            cancel_filter(bool wait=false);
+    void            apply_filter_results();
+    static DWORD WINAPI filter_thread_proc(void* param);
 
     // Result.
     popup_results   m_results;
@@ -137,7 +174,8 @@ private:
     int32           m_count = 0;
     const char**    m_entries = nullptr;    // Original entries from caller.
     entry_info*     m_infos = nullptr;      // Original entry numbers/etc from caller.
-    std::vector<const char*> m_items;       // Escaped entries for display.
+    std::vector<const char*> m_items;       // Escaped entries for display (null until needed).
+    bool            m_lazy_items = false;   // m_items are filled in during display.
     int32           m_longest = 0;
     addl_columns    m_columns;
 
@@ -147,6 +185,24 @@ private:
     int32           m_filter_saved_top = -1;
     int32           m_original_count = 0;   // Original count of items from caller.
     std::vector<int32> m_filtered_items;    // Maps filtered index to original index.
+    trigram_index   m_trigrams;             // Built on demand for long lists.
+
+    // Background filtering, for long lists.  Each filter request gets a new
+    // generation number, and results are only used if they're for the
+    // current generation.  Only the filter thread uses m_trigrams while it
+    // exists.
+    HANDLE          m_filter_thread = nullptr;
+    HANDLE          m_filter_wake = nullptr;        // Signaled when a job is posted.
+    HANDLE          m_filter_ready = nullptr;       // Signaled when results are ready.
+    SRWLOCK         m_filter_lock = SRWLOCK_INIT;   // Guards the job and the results.
+    SRWLOCK         m_filter_busy = SRWLOCK_INIT;   // Held while running a job.
+    volatile LONG   m_filter_generation = 0;
+    volatile bool   m_filter_stop = false;
+    bool            m_filter_has_job = false;
+    filter_job      m_filter_job;
+    std::vector<int32> m_filter_results;
+    str_moveable    m_filter_results_needle;
+    LONG            m_filter_results_generation = -1;
 
     // Display.
     int32           m_prev_content_width = 0;
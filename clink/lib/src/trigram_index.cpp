@@ -0,0 +1,120 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "trigram_index.h"
+
+#include <core/base.h>
+#include <core/path.h>
+#include <core/str_compare.h>
+#include <core/str_iter.h>
+
+#include <algorithm>
+#include <iterator>
+
+//------------------------------------------------------------------------------
+static uint64 make_trigram(const int32* c)
+{
+    // Codepoints fit in 21 bits.
+    return (uint64(c[0] & 0x1fffff) << 42) | (uint64(c[1] & 0x1fffff) << 21) | uint64(c[2] & 0x1fffff);
+}
+
+
+
+//------------------------------------------------------------------------------
+void trigram_index::clear()
+{
+    m_postings.clear();
+    m_mode = -1;
+}
+
+//------------------------------------------------------------------------------
+bool trigram_index::is_compatible() const
+{
+    return (m_mode == str_compare_scope::current() &&
+            m_fuzzy_accents == str_compare_scope::current_fuzzy_accents());
+}
+
+//------------------------------------------------------------------------------
+// Ids must be added in ascending order.  The same id may be added more than
+// once, to index several texts for it.
+void trigram_index::add(int32 id, const char* text)
+{
+    if (m_mode < 0)
+    {
+        m_mode = str_compare_scope::current();
+        m_fuzzy_accents = str_compare_scope::current_fuzzy_accents();
+    }
+
+    m_tmp.clear();
+    fold(text, m_tmp);
+    for (size_t i = 2; i < m_tmp.size(); ++i)
+    {
+        std::vector<int32>& posting = m_postings[make_trigram(&m_tmp[i - 2])];
+        assert(posting.empty() || posting.back() <= id);
+        if (posting.empty() || posting.back() != id)
+            posting.push_back(id);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Returns false if the needle is too short to use the index.  Otherwise fills
+// OUT with the ids (in ascending order) of texts that contain every trigram in
+// the needle.
+bool trigram_index::query(const char* needle, std::vector<int32>& out) const
+{
+    out.clear();
+
+    m_tmp.clear();
+    fold(needle, m_tmp);
+    if (m_tmp.size() < 3)
+        return false;
+
+    std::vector<const std::vector<int32>*> postings;
+    for (size_t i = 2; i < m_tmp.size(); ++i)
+    {
+        const auto found = m_postings.find(make_trigram(&m_tmp[i - 2]));
+        if (found == m_postings.end())
+            return true;
+        postings.push_back(&found->second);
+    }
+
+    // Intersect starting with the shortest posting lists.
+    std::sort(postings.begin(), postings.end(), [] (const std::vector<int32>* a, const std::vector<int32>* b) {
+        return a->size() < b->size();
+    });
+
+    out = *postings[0];
+    std::vector<int32> tmp;
+    for (size_t i = 1; i < postings.size() && !out.empty(); ++i)
+    {
+        if (postings[i] == postings[i - 1])
+            continue;
+        tmp.clear();
+        std::set_intersection(out.begin(), out.end(), postings[i]->begin(), postings[i]->end(), std::back_inserter(tmp));
+        out.swap(tmp);
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void trigram_index::fold(const char* text, std::vector<int32>& out) const
+{
+    if (!text)
+        return;
+
+    str_iter iter(text);
+    while (int32 c = iter.next())
+    {
+        c = str_compare_fold(c, m_mode, m_fuzzy_accents, false/*exact_slash*/);
+        out.push_back(c);
+
+        // Consecutive path separators compare equal to one.
+        if (c == '/')
+        {
+            while (path::is_separator(iter.peek()))
+                iter.next();
+        }
+    }
+}
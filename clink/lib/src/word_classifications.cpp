@@ -10,6 +10,7 @@
 #include <core/str.h>
 
 #include <assert.h>
+#include <algorithm>
 
 //------------------------------------------------------------------------------
 const size_t face_base = 128;
@@ -18,7 +19,6 @@ const size_t face_max = 100;
 //------------------------------------------------------------------------------
 word_classifications::~word_classifications()
 {
-    free(m_faces);
 }
 
 //------------------------------------------------------------------------------
@@ -26,22 +26,20 @@ word_classifications::word_classifications(word_classifications&& other)
 {
     m_info = std::move(other.m_info);
     m_face_definitions = std::move(other.m_face_definitions);
-    m_faces = other.m_faces;
+    m_runs = std::move(other.m_runs);
     m_length = other.m_length;
-    m_face_map = std::move(m_face_map);
+    m_face_map = std::move(other.m_face_map);
 
-    other.m_faces = nullptr;    // Transferred ownership above.
     other.clear();
 }
 
 //------------------------------------------------------------------------------
 void word_classifications::clear()
 {
-    free(m_faces);
-
     m_info.clear();
     m_face_definitions.clear();
-    m_faces = nullptr;
+    m_runs.clear();
+    m_run_hint = 0;
     m_length = 0;
     m_face_map.clear();
 }
@@ -61,16 +59,8 @@ void word_classifications::init(size_t line_length, const word_classifications*
         }
     }
 
-    if (line_length)
-    {
-        m_faces = static_cast<char*>(malloc(line_length));
-        if (m_faces)
-        {
-            m_length = uint32(line_length);
-            // Space means not classified; use default color.
-            memset(m_faces, FACE_SPACE, line_length);
-        }
-    }
+    // Characters outside of any run aren't classified; use default color.
+    m_length = uint32(line_length);
 }
 
 //------------------------------------------------------------------------------
@@ -118,34 +108,130 @@ void word_classifications::finish(bool show_argmatchers)
 
     for (const auto& info : m_info)
     {
-        const size_t end = min<uint32>(info.end, m_length);
-        for (size_t pos = info.start; pos < end; ++pos)
+        char face;
+        if (info.argmatcher && show_argmatchers)
+            face = FACE_ARGMATCHER;
+        else if (info.word_class < word_class::max)
+            face = c_faces[int32(info.word_class)];
+        else
+            continue;
+
+        fill_gaps(info.start, min<uint32>(info.end, m_length), face);
+    }
+}
+
+//------------------------------------------------------------------------------
+void command_classifications::clear()
+{
+    words.clear();
+    faces.clear();
+    face_definitions.clear();
+}
+
+//------------------------------------------------------------------------------
+// Saves the classifications for the command occupying start..start+length.
+// This must be used before finish(), so that only faces explicitly applied by
+// classifiers are saved.
+void word_classifications::save_command(uint32 start, uint32 length, command_classifications& out) const
+{
+    out.clear();
+
+    const uint32 end = start + length;
+    for (const auto& info : m_info)
+    {
+        if (info.start >= start && info.start < end)
         {
-            if (m_faces[pos] == FACE_SPACE)
-            {
-                if (info.argmatcher && show_argmatchers)
-                    m_faces[pos] = FACE_ARGMATCHER;
-                else if (info.word_class < word_class::max)
-                    m_faces[pos] = c_faces[int32(info.word_class)];
-            }
+            out.words.push_back(info);
+            out.words.back().start -= start;
+            out.words.back().end -= start;
+        }
+    }
+
+    // Custom faces are saved as indices into the command's own face
+    // definitions, since the face numbering can differ next time.
+    for (const auto& run : m_runs)
+    {
+        if (run.end <= start)
+            continue;
+        if (run.start >= end)
+            break;
+
+        char face = run.face;
+        if (const char* def = get_face_output(face))
+        {
+            size_t index = 0;
+            while (index < out.face_definitions.size() && !out.face_definitions[index].equals(def))
+                ++index;
+            if (index == out.face_definitions.size())
+                out.face_definitions.emplace_back(def);
+            face = char(face_base + index);
+        }
+
+        const uint32 run_start = max<uint32>(run.start, start) - start;
+        const uint32 run_end = min<uint32>(run.end, end) - start;
+        out.faces.push_back({ run_start, run_end, face });
+    }
+}
+
+//------------------------------------------------------------------------------
+// Reapplies saved classifications for a command that now begins at start.  Use
+// sort_words() after restoring commands out of order.
+void word_classifications::restore_command(uint32 start, const command_classifications& in)
+{
+    for (word_class_info info : in.words)
+    {
+        info.start += start;
+        info.end += start;
+        m_info.emplace_back(std::move(info));
+    }
+
+    char faces[face_max] = {};
+    for (const auto& run : in.faces)
+    {
+        char face = run.face;
+        const uint32 index = uint8(face) - face_base;
+        if (index < in.face_definitions.size())
+        {
+            if (!faces[index])
+                faces[index] = ensure_face(in.face_definitions[index].c_str());
+            face = faces[index];
+            if (!face)
+                continue;
         }
+        apply_face(start + run.start, run.end - run.start, face, true);
     }
 }
 
+//------------------------------------------------------------------------------
+void word_classifications::sort_words()
+{
+    std::stable_sort(m_info.begin(), m_info.end(), [](const word_class_info& a, const word_class_info& b) {
+        return a.start < b.start;
+    });
+}
+
 //------------------------------------------------------------------------------
 bool word_classifications::equals(const word_classifications& other) const
 {
-    if (!m_faces && !other.m_faces)
-        return true;
-    if (!m_faces || !other.m_faces)
+    if (m_length != other.m_length)
         return false;
+    if (!m_length)
+        return true;
 
     if (m_face_definitions.size() != other.m_face_definitions.size())
         return false;
-    if (m_length != other.m_length)
-        return false;
-    if (strncmp(m_faces, other.m_faces, m_length) != 0)
+
+    // Runs are always merged with adjacent runs of the same face, so equal
+    // faces means equal runs.
+    if (m_runs.size() != other.m_runs.size())
         return false;
+    for (size_t ii = m_runs.size(); ii--;)
+    {
+        const face_run& a = m_runs[ii];
+        const face_run& b = other.m_runs[ii];
+        if (a.start != b.start || a.end != b.end || a.face != b.face)
+            return false;
+    }
 
     for (size_t ii = m_face_definitions.size(); ii--;)
     {
@@ -169,9 +255,30 @@ bool word_classifications::get_word_class(uint32 index, word_class& wc) const
 //------------------------------------------------------------------------------
 char word_classifications::get_face(uint32 pos) const
 {
-    if (pos < 0 || pos >= m_length)
-        return ' ';
-    return m_faces[pos];
+    if (pos >= m_length)
+        return FACE_SPACE;
+
+    // Display asks for positions in order, so first try the run found last
+    // time and the one after it.
+    if (m_run_hint < m_runs.size() && m_runs[m_run_hint].start <= pos)
+    {
+        const face_run& run = m_runs[m_run_hint];
+        if (pos < run.end)
+            return run.face;
+        if (m_run_hint + 1 >= m_runs.size() || pos < m_runs[m_run_hint + 1].start)
+            return FACE_SPACE;
+        if (pos < m_runs[m_run_hint + 1].end)
+            return m_runs[++m_run_hint].face;
+    }
+
+    const auto it = std::partition_point(m_runs.begin(), m_runs.end(), [pos](const face_run& run) {
+        return run.end <= pos;
+    });
+    if (it == m_runs.end())
+        return FACE_SPACE;
+
+    m_run_hint = uint32(it - m_runs.begin());
+    return (it->start <= pos) ? it->face : FACE_SPACE;
 }
 
 //------------------------------------------------------------------------------
@@ -204,12 +311,98 @@ char word_classifications::ensure_face(const char* sgr)
 //------------------------------------------------------------------------------
 void word_classifications::apply_face(uint32 start, uint32 length, char face, bool overwrite)
 {
-    while (length > 0 && start < m_length)
+    if (start >= m_length || !length)
+        return;
+
+    const uint32 end = (length < m_length - start) ? start + length : m_length;
+    if (!overwrite)
+    {
+        fill_gaps(start, end, face);
+        return;
+    }
+
+    // Remove the overlapped runs, keeping the parts that stick out on either
+    // side.  Applying FACE_SPACE just clears the range.
+    const auto first = std::partition_point(m_runs.begin(), m_runs.end(), [start](const face_run& run) {
+        return run.end <= start;
+    });
+    const auto last = std::partition_point(first, m_runs.end(), [end](const face_run& run) {
+        return run.start < end;
+    });
+
+    face_run left = {};
+    face_run right = {};
+    if (first != last)
+    {
+        if (first->start < start)
+            left = { first->start, start, first->face };
+        if ((last - 1)->end > end)
+            right = { end, (last - 1)->end, (last - 1)->face };
+    }
+
+    auto it = m_runs.erase(first, last);
+    if (left.end)
+        it = insert_run(it, left) + 1;
+    if (face != FACE_SPACE)
+        it = insert_run(it, { start, end, face }) + 1;
+    if (right.end)
+        insert_run(it, right);
+}
+
+//------------------------------------------------------------------------------
+// Inserts a run before IT, merging it with adjacent runs that have the same
+// face.  Returns the run that now contains the inserted range.
+word_classifications::run_iter word_classifications::insert_run(run_iter it, const face_run& run)
+{
+    if (it != m_runs.begin())
+    {
+        const auto prev = it - 1;
+        if (prev->end == run.start && prev->face == run.face)
+        {
+            prev->end = run.end;
+            if (it != m_runs.end() && it->start == run.end && it->face == run.face)
+            {
+                prev->end = it->end;
+                m_runs.erase(it);
+            }
+            return prev;
+        }
+    }
+
+    if (it != m_runs.end() && it->start == run.end && it->face == run.face)
+    {
+        it->start = run.start;
+        return it;
+    }
+
+    return m_runs.insert(it, run);
+}
+
+//------------------------------------------------------------------------------
+// Applies the face to the parts of start..end that aren't in any run yet.
+void word_classifications::fill_gaps(uint32 start, uint32 end, char face)
+{
+    if (face == FACE_SPACE)
+        return;
+
+    auto it = std::partition_point(m_runs.begin(), m_runs.end(), [start](const face_run& run) {
+        return run.end <= start;
+    });
+
+    uint32 pos = start;
+    while (pos < end)
     {
-        if (overwrite || m_faces[start] == ' ')
-            m_faces[start] = face;
-        start++;
-        length--;
+        if (it != m_runs.end() && it->start <= pos)
+        {
+            pos = it->end;
+            ++it;
+            continue;
+        }
+
+        const uint32 gap_end = (it != m_runs.end() && it->start < end) ? it->start : end;
+        it = insert_run(it, { pos, gap_end, face });
+        pos = it->end;
+        ++it;
     }
 }
 
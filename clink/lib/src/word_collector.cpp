@@ -90,6 +90,17 @@ void word_collector::init_alias_cache()
         m_alias_cache = new alias_cache;
 }
 
+//------------------------------------------------------------------------------
+// Doskey aliases can change between edit sessions, and the words of a command
+// can depend on whether a word is an alias.
+void word_collector::clear_cache()
+{
+    m_cached_commands.clear();
+    m_next_cached_command = 0;
+    if (m_alias_cache)
+        m_alias_cache->clear();
+}
+
 //------------------------------------------------------------------------------
 char word_collector::get_opening_quote() const
 {
@@ -179,6 +190,25 @@ bool word_collector::is_alias_allowed(const char* buffer, uint32 offset) const
     return (spaces <= max_spaces);
 }
 
+//------------------------------------------------------------------------------
+const word_collector::cached_command* word_collector::find_cached_command(
+    const char* text, uint32 len, uint32 context, uint32 doskey_len,
+    bool first, bool deprecated_argmatcher, bool enhanced_doskey) const
+{
+    for (const auto& cached : m_cached_commands)
+    {
+        if (cached.text.length() == len &&
+            cached.context == context &&
+            cached.doskey_len == doskey_len &&
+            cached.first == first &&
+            cached.deprecated_argmatcher == deprecated_argmatcher &&
+            cached.enhanced_doskey == enhanced_doskey &&
+            memcmp(cached.text.c_str(), text, len) == 0)
+            return &cached;
+    }
+    return nullptr;
+}
+
 //------------------------------------------------------------------------------
 uint32 word_collector::collect_words(const char* line_buffer, uint32 line_length, uint32 line_cursor,
                                      std::vector<word>& words, collect_words_mode mode,
@@ -231,6 +261,28 @@ uint32 word_collector::collect_words(const char* line_buffer, uint32 line_length
             }
         }
 
+        // The words only depend on the command's text (plus up to two
+        // preceding characters, for the plus sign check below), so reuse them
+        // if the command was collected recently.
+        const uint32 context = min<uint32>(command.offset, 2);
+        const char* const cache_text = line_buffer + command.offset - context;
+        const uint32 cache_len = context + command.length;
+        const bool enhanced_doskey = g_enhanced_doskey.get();
+        if (const cached_command* cached = find_cached_command(cache_text, cache_len, context, doskey_len, first, deprecated_argmatcher, enhanced_doskey))
+        {
+            for (word w : cached->words)
+            {
+                w.offset += command.offset;
+                words.push_back(w);
+            }
+            if (!cached->words.empty())
+                first = false;
+            continue;
+        }
+
+        const size_t first_word_index = words.size();
+        const bool first_at_start = first;
+
         m_word_tokeniser->start(str_iter(line_buffer + command.offset + doskey_len, command.length - doskey_len), m_quote_pair, first);
         while (1)
         {
@@ -310,6 +362,22 @@ uint32 word_collector::collect_words(const char* line_buffer, uint32 line_length
 
             first = false;
         }
+
+        // Remember the command's words.
+        if (m_cached_commands.size() < c_max_cached_commands)
+            m_cached_commands.emplace_back();
+        cached_command& cached = m_cached_commands[m_next_cached_command];
+        m_next_cached_command = (m_next_cached_command + 1) % c_max_cached_commands;
+        cached.text.clear();
+        cached.text.concat(cache_text, cache_len);
+        cached.context = context;
+        cached.doskey_len = doskey_len;
+        cached.first = first_at_start;
+        cached.deprecated_argmatcher = deprecated_argmatcher;
+        cached.enhanced_doskey = enhanced_doskey;
+        cached.words.assign(words.begin() + first_word_index, words.end());
+        for (word& w : cached.words)
+            w.offset -= command.offset;
     }
 
     // Add an empty word if no words, or if stopping at the cursor and it's at
@@ -372,24 +440,19 @@ void command_line_states::set(const char* line_buffer, uint32 line_length, uint3
 {
     clear_internal();
 
-    // Pre-allocate words_storage so that emplace_back() doesn't invalidate
-    // pointers (references) stored in linestates.
-    m_words_storage.reserve(commands.size());
-
     // Build vector containing one line_state per command.
     size_t i = 0;
     auto command_iter = commands.begin();
-    std::vector<word> tmp;
-    tmp.reserve(words.size());
+    std::vector<word>* group = nullptr;
     while (true)
     {
-        if (!tmp.empty() && (i >= words.size() || words[i].command_word))
+        if (group && !group->empty() && (i >= words.size() || words[i].command_word))
         {
             // Make sure classifiers can tell whether the word has a space
             // before it, so that ` doskeyalias` gets classified as NOT a doskey
             // alias, since doskey::resolve() won't expand it as a doskey alias.
-            uint32 command_char_offset = tmp[0].offset;
-            if (tmp[0].quoted)
+            uint32 command_char_offset = (*group)[0].offset;
+            if ((*group)[0].quoted)
                 command_char_offset--;
             if (command_char_offset == 1 && line_buffer[0] == ' ')
                 command_char_offset--;
@@ -398,12 +461,9 @@ void command_line_states::set(const char* line_buffer, uint32 line_length, uint3
                      line_buffer[command_char_offset - 2] == ' ')
                 command_char_offset--;
 
-            m_words_storage.emplace_back(std::move(tmp));
-            assert(tmp.empty());
-            tmp.reserve(words.size());
-
-            // The !tmp.empty() check effectively discarded command ranges with
-            // no words.  Now it's still required for backward compatibility.
+            // The !group->empty() check effectively discarded command ranges
+            // with no words.  Now it's still required for backward
+            // compatibility.
             assert(command_iter != commands.end());
             while (command_iter->offset + command_iter->length < command_char_offset)
             {
@@ -418,21 +478,34 @@ void command_line_states::set(const char* line_buffer, uint32 line_length, uint3
                 command_char_offset,
                 command_iter->offset,
                 command_iter->length,
-                m_words_storage.back()
+                *group
             );
+            group = nullptr;
         }
 
         if (i >= words.size())
             break;
 
-        tmp.emplace_back(words[i]);
+        // The word vectors are kept from one call to the next, so that their
+        // capacity is reused instead of being reallocated on every keystroke.
+        // Adding to a deque doesn't move its elements, so line_states can
+        // safely refer to them.
+        if (!group)
+        {
+            if (m_words_used >= m_words_storage.size())
+                m_words_storage.emplace_back();
+            group = &m_words_storage[m_words_used++];
+            group->clear();
+        }
+
+        group->emplace_back(words[i]);
         i++;
     }
 
-    if (m_words_storage.size() > 0)
+    if (m_words_used > 0)
     {
         // Guarantee room for get_word_break_info() to append an empty end word.
-        std::vector<word>& last = m_words_storage.back();
+        std::vector<word>& last = m_words_storage[m_words_used - 1];
         last.reserve(last.size() + 1);
     }
 }
@@ -466,7 +539,7 @@ uint32 command_line_states::break_end_word(uint32 truncate, uint32 keep)
         split_word.quoted = false;
         split_word.delim = str_token::invalid_delim;
 
-        std::vector<word>* words = const_cast<std::vector<word>*>(&m_words_storage.back());
+        std::vector<word>* words = &m_words_storage[m_words_used - 1];
         end_word->length = truncate;
         words->push_back(split_word);
         end_word = &words->back();
@@ -482,14 +555,19 @@ void command_line_states::clear()
 {
     clear_internal();
 
-    m_words_storage.emplace_back();
+    if (m_words_storage.empty())
+        m_words_storage.emplace_back();
+    m_words_storage[0].clear();
+    m_words_used = 1;
     m_linestates.emplace_back(std::move(line_state(nullptr, 0, 0, 0, 0, 0, m_words_storage[0])));
 }
 
 //------------------------------------------------------------------------------
+// Forgets the line_states, but keeps the word vectors (and their capacity) for
+// reuse.
 void command_line_states::clear_internal()
 {
-    m_words_storage.clear();
+    m_words_used = 0;
     m_linestates.clear();
 #ifdef DEBUG
     m_broke_end_word = false;
@@ -179,4 +179,33 @@ TEST_CASE("Binder")
             }
         }
     }
+
+    SECTION("Many groups")
+    {
+        // More groups have binds than have compiled root tables.
+        auto& module = *(editor_module*)0;
+        static const int32 count = 24;
+        int32 groups[count];
+        for (int32 i = 0; i < count; ++i)
+        {
+            groups[i] = binder.create_group("group");
+            REQUIRE(binder.bind(groups[i], "ab", module, uint8(i)));
+            REQUIRE(binder.bind(groups[i], "c", module, uint8(i)));
+        }
+
+        for (int32 i = 0; i < count; ++i)
+        {
+            bind_resolver resolver(binder);
+            resolver.set_group(groups[i]);
+            REQUIRE(!resolver.step('a'));
+            REQUIRE(resolver.step('b'));
+
+            auto binding = resolver.next();
+            REQUIRE(binding);
+            REQUIRE(binding.get_id() == i);
+
+            REQUIRE(binder.is_bound(groups[i], "c", 1));
+            REQUIRE(!binder.is_bound(groups[i], "d", 1));
+        }
+    }
 }
@@ -0,0 +1,115 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "fs_fixture.h"
+#include "completion_cache.h"
+#include "line_state.h"
+#include "matches_impl.h"
+
+#include <core/base.h>
+#include <core/settings.h>
+#include <lib/matches.h>
+
+#include <vector>
+
+//------------------------------------------------------------------------------
+static void add_file_matches(matches_impl& matches)
+{
+    match_builder builder(matches);
+    REQUIRE(builder.add_match("dir1\\file1", match_type::file));
+    REQUIRE(builder.add_match("dir1\\file2", match_type::file));
+    builder.set_cacheable();
+}
+
+//------------------------------------------------------------------------------
+TEST_CASE("Completion cache")
+{
+    fs_fixture fs;
+
+    static const char c_line[] = "dir dir1\\f";
+    std::vector<word> words;
+    words.emplace_back(0, 3, true, false, false, false, 0);
+    words.emplace_back(4, 6, false, false, false, false, 0);
+    line_state line(c_line, 10, 10, 0, 0, 10, words);
+
+    completion_cache& cache = completion_cache::get();
+    cache.clear();
+
+    matches_impl matches;
+    add_file_matches(matches);
+    REQUIRE(matches.is_cacheable());
+    cache.store(line, matches);
+
+    SECTION("Hit")
+    {
+        matches_impl out;
+        REQUIRE(cache.lookup(line, out));
+        REQUIRE(out.get_match_count() == 2);
+        REQUIRE(strcmp(out.get_match(0), "dir1\\file1") == 0);
+    }
+
+    SECTION("Miss")
+    {
+        static const char c_other[] = "dir dir2\\f";
+        line_state other(c_other, 10, 10, 0, 0, 10, words);
+        matches_impl out;
+        REQUIRE(!cache.lookup(other, out));
+        REQUIRE(out.get_match_count() == 0);
+    }
+
+    SECTION("Directory changed")
+    {
+        FILE* f = fopen("dir1\\file3", "wt");
+        REQUIRE(f != nullptr);
+        fclose(f);
+
+        matches_impl out;
+        REQUIRE(!cache.lookup(line, out));
+    }
+
+    SECTION("Setting changed")
+    {
+        setting* setting = settings::find("files.system");
+        setting->set("true");
+
+        matches_impl out;
+        REQUIRE(!cache.lookup(line, out));
+
+        setting->set();
+        REQUIRE(cache.lookup(line, out));
+    }
+
+    SECTION("Cleared")
+    {
+        cache.clear();
+
+        matches_impl out;
+        REQUIRE(!cache.lookup(line, out));
+    }
+
+    SECTION("Other generators")
+    {
+        // Matches added after marking them cacheable aren't cacheable.
+        matches_impl more;
+        add_file_matches(more);
+        {
+            match_builder builder(more);
+            REQUIRE(builder.add_match("dir1\\only", match_type::file));
+        }
+        REQUIRE(!more.is_cacheable());
+
+        // Once a generator has added matches, later generators can't mark
+        // them cacheable.
+        matches_impl after;
+        {
+            match_builder builder(after);
+            REQUIRE(builder.add_match("dir1\\only", match_type::file));
+            builder.disable_cache();
+        }
+        add_file_matches(after);
+        REQUIRE(!after.is_cacheable());
+    }
+
+    cache.clear();
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+
+#include <core/base.h>
+#include <core/str_compare.h>
+#include <lib/fuzzy_match.h>
+
+#include <vector>
+
+//------------------------------------------------------------------------------
+TEST_CASE("Fuzzy match")
+{
+    str_compare_scope _(str_compare_scope::caseless, false);
+
+    SECTION("Subsequence")
+    {
+        fuzzy_matcher matcher("mpc");
+        REQUIRE(matcher.score("match_pipeline.cpp") >= 0);
+        REQUIRE(matcher.score("MatchPipelineCache") >= 0);
+        REQUIRE(matcher.score("mxpxc") >= 0);
+        REQUIRE(matcher.score("main.cpp") == fuzzy_matcher::no_match);
+        REQUIRE(matcher.score("cpm") == fuzzy_matcher::no_match);
+        REQUIRE(matcher.score("mp") == fuzzy_matcher::no_match);
+        REQUIRE(matcher.score("match_pipeline.cpp", 5) == fuzzy_matcher::no_match);
+    }
+
+    SECTION("Empty")
+    {
+        fuzzy_matcher matcher("");
+        REQUIRE(matcher.empty());
+        REQUIRE(matcher.score("abc") == 0);
+    }
+
+    SECTION("Ranking")
+    {
+        fuzzy_matcher matcher("mpc");
+        REQUIRE(matcher.score("mpc.h") > matcher.score("mxpxc"));
+        REQUIRE(matcher.score("match_pipeline.cpp") > matcher.score("mxpxc"));
+        REQUIRE(matcher.score("src/mpc") > matcher.score("srcmpc"));
+    }
+
+    SECTION("Top")
+    {
+        const char* const candidates[] = { "main.cpp", "mxpxc", "match_pipeline.cpp", "mpc.h", "xyz" };
+
+        fuzzy_matcher matcher("mpc");
+        std::vector<fuzzy_matcher::result> results;
+
+        matcher.top(_countof(candidates), 0, [&] (uint32 i) { return candidates[i]; }, results);
+        REQUIRE(results.size() == 3);
+        REQUIRE(results[0].index == 3);
+        REQUIRE(results[2].index == 1);
+
+        matcher.top(_countof(candidates), 2, [&] (uint32 i) { return candidates[i]; }, results);
+        REQUIRE(results.size() == 2);
+        REQUIRE(results[0].index == 3);
+        REQUIRE(results[1].index == 2);
+    }
+}
@@ -105,3 +105,66 @@ TEST_CASE("Match colors")
         REQUIRE(test_color(s, "43"));
     }
 }
+
+//------------------------------------------------------------------------------
+TEST_CASE("Match colors extensions")
+{
+    str<> s;
+
+    os::set_env("CLINK_MATCH_COLORS", "fi=1;34:x*.log=47:*.txt=44:*.log=43:not *.md ro=45:*.TXT di=46");
+
+    parse_match_colors();
+
+    SECTION("extension")
+    {
+        s.clear();
+        REQUIRE(get_match_color("foo.txt", match_type::file, s));
+        REQUIRE(test_color(s, "44"));
+
+        s.clear();
+        REQUIRE(get_match_color("FOO.TXT", match_type::file, s));
+        REQUIRE(test_color(s, "44"));
+
+        s.clear();
+        REQUIRE(get_match_color("a.b.txt", match_type::file, s));
+        REQUIRE(test_color(s, "44"));
+
+        s.clear();
+        REQUIRE(get_match_color("foo.txtx", match_type::file, s));
+        REQUIRE(test_color(s, "1;34"));
+
+        s.clear();
+        REQUIRE(get_match_color("foo.txt", match_type::dir, s));
+        REQUIRE(test_color(s, "46"));
+    }
+
+    SECTION("not")
+    {
+        s.clear();
+        REQUIRE(get_match_color("foo.c", match_type::file|match_type::readonly, s));
+        REQUIRE(test_color(s, "45"));
+
+        s.clear();
+        REQUIRE(get_match_color("foo.txt", match_type::file|match_type::readonly, s));
+        REQUIRE(test_color(s, "44"));
+    }
+
+    SECTION("order")
+    {
+        s.clear();
+        REQUIRE(get_match_color("x.log", match_type::file, s));
+        REQUIRE(test_color(s, "47"));
+
+        s.clear();
+        REQUIRE(get_match_color("y.log", match_type::file, s));
+        REQUIRE(test_color(s, "43"));
+
+        s.clear();
+        REQUIRE(get_match_color("X.LOG", match_type::file, s));
+        REQUIRE(test_color(s, "47"));
+
+        s.clear();
+        REQUIRE(get_match_color("y.log", match_type::file, s));
+        REQUIRE(test_color(s, "43"));
+    }
+}
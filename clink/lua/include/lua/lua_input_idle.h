@@ -29,14 +29,44 @@ public:
 private:
     bool            is_enabled();
     bool            has_coroutines();
+    void            refresh_schedule();
     void            resume_coroutines();
+    bool            arm_timer(DWORD remaining);
+    void            cancel_timer();
+    bool            is_gc_pending();
     lua_state&      m_state;
     uint32          m_iterations = 0;
     bool            m_enabled = true;
 
+    // The coroutine schedule last reported by Lua.  It can only change when
+    // Lua code runs, so it's reused until lua_state::get_call_serial() says
+    // some Lua code has run since.
+    bool            m_schedule_valid = false;
+    uint32          m_schedule_serial = 0;
+    bool            m_has_coroutines = false;
+    bool            m_has_target = false;
+    DWORD           m_target_tick = 0;
+
+    // Coroutines that are due at a later time are woken by a waitable timer
+    // instead of a wait timeout, so Windows can coalesce the wakeups with
+    // other timers.
+    HANDLE          m_timer = nullptr;
+    bool            m_timer_armed = false;
+    DWORD           m_timer_tick = 0;
+
+    // Garbage collection runs in idle time once memory use grows enough since
+    // the last idle collection cycle finished.
+    bool            m_gc_pending = false;
+    int32           m_gc_baseline_kb = 0;
+
+    // Suggestions for the likely next command are prefetched the first time
+    // the input loop goes idle after an edit session begins.
+    bool            m_prefetch_pending = false;
+
     uint32          m_index_recognizer = -1;
     uint32          m_index_task_manager = -1;
     uint32          m_index_force_idle = -1;
+    uint32          m_index_timer = -1;
 
     static bool     s_signaled_delayed_init;
     static bool     s_signaled_reclassify;
@@ -22,6 +22,8 @@ public:
 private:
     virtual bool    generate(const line_states& lines, match_builder& builder, bool old_filtering=false) override;
     virtual void    get_word_break_info(const line_state& line, word_break_info& info) const override;
+    virtual void    reset_display_filter() override;
+    virtual bool    get_lazy_description(const char* match, str_base& out) override;
     virtual bool    match_display_filter(const char* needle, char** matches, match_builder* builder, display_filter_flags flags, bool nosort, bool* old_filtering=nullptr) override;
     lua_State*      get_state() const;
     lua_state*      m_lua = nullptr;
@@ -8,6 +8,7 @@
 
 #include <functional>
 #include <list>
+#include <vector>
 
 extern "C" {
 #include <readline/readline.h>
@@ -15,6 +16,7 @@ extern "C" {
 }
 
 struct lua_State;
+class lua_allocator;
 class str_base;
 class line_state;
 class terminal_in;
@@ -59,6 +61,16 @@ enum class lua_state_flags : int32
 };
 DEFINE_ENUM_FLAG_OPERATORS(lua_state_flags);
 
+//------------------------------------------------------------------------------
+// A script file compiled to bytecode, so that it can be compiled by one
+// lua_State and executed by another.
+struct lua_compiled_file
+{
+    explicit        lua_compiled_file(const char* path) : path(path) {}
+    str_moveable    path;
+    std::vector<char> bytecode;         // Empty if compiling failed.
+};
+
 //------------------------------------------------------------------------------
 class lua_state
 {
@@ -71,6 +83,9 @@ public:
     void            shutdown();
     bool            do_string(const char* string, int32 length=-1, str_base* error=nullptr);
     bool            do_file(const char* path);
+    void            compile_files(std::vector<lua_compiled_file>& files) const;
+    bool            do_compiled_file(const lua_compiled_file& file);
+    void            set_bytecode_cache_dir(const char* dir) { m_bytecode_cache_dir = dir; }
     lua_State*      get_state() const;
 
     static bool     push_named_function(lua_State* L, const char* func_name, str_base* error=nullptr);
@@ -98,20 +113,38 @@ public:
     static bool     is_in_onfiltermatches() { return s_in_onfiltermatches; }
     static bool     is_interpreter() { return s_interpreter; }
     static bool     is_internal() { return s_internal; }
+    static uint32   get_call_serial() { return s_call_serial; }
+    static bool     is_in_pcall() { return s_pcall_depth > 0; }
+
+    static void     apply_gc_settings(lua_State* L);
+    static bool     step_gc(lua_State* L, uint32 budget_ms);
 
     static void     set_internal(bool internal) { s_internal = internal; }
 
+    static bool     is_standby_wanted();
+    static void     prepare_standby();
+    static void     discard_standby();
+    static bool     is_preparing_standby() { return s_preparing_standby; }
+
     static uint32   save_global_states(bool new_coroutine);
     static void     restore_global_states(uint32 states);
 
 private:
+    struct standby_tag {};
+    explicit        lua_state(standby_tag) : m_state(nullptr) {}
+    void            load_core(lua_state_flags flags, const char* package_path);
     static bool     send_event_internal(lua_State* L, const char* event_name, const char* event_mechanism, int32 nargs=0, int32 nret=0);
     lua_State*      m_state;
+    lua_allocator*  m_allocator = nullptr;
+    str_moveable    m_bytecode_cache_dir;
 
     static bool     s_internal;
     static bool     s_interpreter;
     static bool     s_in_luafunc;
     static bool     s_in_onfiltermatches;
+    static bool     s_preparing_standby;
+    static uint32   s_call_serial;      // Incremented by each pcall.
+    static uint32   s_pcall_depth;
 #ifdef DEBUG
     static bool     s_in_coroutine;
 #endif
@@ -136,6 +169,21 @@ private:
     int32 const m_top;
 };
 
+//------------------------------------------------------------------------------
+// Suspends garbage collection while latency-sensitive work runs on a
+// keystroke (e.g. classifying the input line); the collector catches up during
+// idle time instead (see lua_state::step_gc).  Nestable.
+class lua_gc_suspend
+{
+public:
+    lua_gc_suspend(lua_State* L);
+    ~lua_gc_suspend();
+private:
+    lua_State* const m_state;
+    static int32 s_depth;
+    static bool s_was_running;
+};
+
 //------------------------------------------------------------------------------
 void get_lua_srcinfo(lua_State* L, str_base& out);
 void set_lua_terminal(terminal_in* in, terminal_out* out);
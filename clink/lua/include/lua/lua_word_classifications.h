@@ -24,6 +24,8 @@ public:
 protected:
     int32                   classify_word(lua_State* state);
     int32                   apply_color(lua_State* state);
+    int32                   classify_words(lua_State* state);
+    int32                   apply_colors(lua_State* state);
     int32                   shift(lua_State* state);
     int32                   reset_shift(lua_State* state);
     int32                   break_word(lua_State* state);
@@ -35,6 +37,8 @@ protected:
 #endif
 
 private:
+    void                    classify_word_at(uint32 index, const char* s, bool overwrite);
+
     word_classifications&   m_classifications;
     const uint32            m_index_offset;
     uint32                  m_num_words;
@@ -8,6 +8,7 @@
 #include "lib/word_classifications.h"
 
 class lua_state;
+class line_state;
 
 //------------------------------------------------------------------------------
 class lua_word_classifier
@@ -17,6 +18,11 @@ public:
                     lua_word_classifier(lua_state& state);
     virtual void    classify(const line_states& commands, word_classifications& classifications) override;
 
+    static void     reset_native_classify();
+    static void     set_native_classify(bool enable);
+    static void     add_argmatcher_name(const char* name);
+
 private:
+    bool            classify_natively(const line_state& line, word_classifications& classifications) const;
     lua_state&      m_state;
 };
@@ -3,8 +3,9 @@
 
 #pragma once
 
+#include <core/str.h>
+
 class lua_state;
-class str_base;
 
 //------------------------------------------------------------------------------
 class prompt
@@ -44,11 +45,15 @@ public:
                     prompt_filter(lua_state& lua);
     bool            filter(const char* in, str_base& out); // For unit tests.
     bool            filter(const char* in, const char* rin, str_base& out, str_base& rout, bool transient=false, bool final=false);
+    bool            take_transient(str_base& out, str_base& rout);
 
     static bool     is_filtering() { return s_filtering; }
 
 private:
     lua_state&      m_lua;
+    str_moveable    m_transient;
+    str_moveable    m_transient_r;
+    bool            m_has_transient = false;
 
     static bool s_filtering;
 };
@@ -0,0 +1,13 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+class setting;
+
+//------------------------------------------------------------------------------
+bool save_script_settings(const char* file, const char* stamp);
+bool load_script_settings(const char* file, const char* stamp, std::vector<std::unique_ptr<setting>>& out);
@@ -5,6 +5,7 @@
 
 class lua_state;
 class str_base;
+class line_state;
 class line_states;
 class matches;
 
@@ -16,5 +17,6 @@ public:
     bool            suggest(const line_states& lines, matches* matches, int32 generation_id);
 
 private:
+    bool            suggest_native(const line_state& line, const matches* matches);
     lua_state&      m_lua;
 };
@@ -31,9 +31,23 @@ local _delayinit_generation = 0
 local _clear_onuse_coroutine = {}
 local _clear_delayinit_coroutine = {}
 
+--------------------------------------------------------------------------------
+-- Memo of _argreader state at word boundaries; see _argreader:_memo_begin().
+-- It's discarded whenever a new edit line begins or any argmatcher changes.
+local _argreader_memo = {}
+local _argreader_memo_nodes = 0
+local _argreader_memo_max_nodes = 4096
+local function clear_argreader_memo()
+    if _argreader_memo_nodes > 0 then
+        _argreader_memo = {}
+        _argreader_memo_nodes = 0
+    end
+end
+
 --------------------------------------------------------------------------------
 clink.onbeginedit(function ()
     _delayinit_generation = _delayinit_generation + 1
+    clear_argreader_memo()
 
     -- Clear dangling coroutine references in matchers.  Otherwise if a
     -- coroutine doesn't finish before a new edit line begins, there will be
@@ -242,15 +256,44 @@ local function do_onuse_callback(argmatcher, command_word)
 end
 
 --------------------------------------------------------------------------------
-local function is_word_present(word, arg, t, arg_match_type)
+-- Index of the words in each arg list, so checking whether a word is present
+-- doesn't need to scan the whole list.  An index remembers how many entries
+-- its list had, so entries added directly to a list are noticed as well.
+local word_indexes = setmetatable({}, { __mode="k" })
+
+local function get_word_index(arg)
+    local index = word_indexes[arg]
+    if index and index.len == #arg then
+        return index
+    end
+
+    local words = {}
+    local has_func
     for _, i in ipairs(arg) do
         local it = type(i)
         if it == "function" then
-            t = 'o' --other (placeholder; superseded by :classifyword).
-        elseif i == word or (it == "table" and i.match == word) then
-            return arg_match_type, true
+            has_func = true
+        elseif it == "string" then
+            words[i] = true
+        elseif it == "table" and type(i.match) == "string" then
+            words[i.match] = true
         end
     end
+
+    index = { len=#arg, words=words, has_func=has_func }
+    word_indexes[arg] = index
+    return index
+end
+
+--------------------------------------------------------------------------------
+local function is_word_present(word, arg, t, arg_match_type)
+    local index = get_word_index(arg)
+    if index.words[word] then
+        return arg_match_type, true
+    end
+    if index.has_func then
+        t = 'o' --other (placeholder; superseded by :classifyword).
+    end
     return t, false
 end
 
@@ -359,6 +402,7 @@ function _argreader:lookup_link(arg, arg_index, word, word_index, line_state)
         end
 
         if arg.onlink then
+            self._impure = true
             local override = arg.onlink(link, arg_index, word, word_index, line_state, self._user_data)
             if override == false then
                 link = nil
@@ -402,6 +446,7 @@ end
 --------------------------------------------------------------------------------
 -- NOTE: line_state may not be self._line_state if it came from extra.
 function _argreader:start_chained_command(line_state, word_index, mode, expand_aliases)
+    self._impure = true
     self._no_cmd = nil
     self._chain_command = true
     self._chain_command_expand_aliases = expand_aliases
@@ -525,9 +570,11 @@ function _argreader:update(word, word_index, extra, last_onadvance) -- luacheck:
             local arg = matcher._flags._args[1]
             if arg then
                 if arg.delayinit then
+                    self._impure = true
                     do_delayed_init(arg, matcher, 0)
                 end
                 if arg.onarg and clink._in_generate() then
+                    self._impure = true
                     arg.onarg(0, word, word_index, line_state, self._user_data)
                 end
             end
@@ -558,9 +605,11 @@ function _argreader:update(word, word_index, extra, last_onadvance) -- luacheck:
     local react, react_modes
     if arg and not is_flag then
         if arg.delayinit then
+            self._impure = true
             do_delayed_init(arg, realmatcher, arg_index)
         end
         if arg.onadvance then
+            self._impure = true
             react, react_modes = arg.onadvance(arg_index, word, word_index, line_state, self._user_data)
             if react then
                 -- 1 = Ignore; advance to next arg_index.
@@ -597,6 +646,7 @@ function _argreader:update(word, word_index, extra, last_onadvance) -- luacheck:
         local nowordbreakchars = arg.nowordbreakchars or default_flag_nowordbreakchars
         local adjusted, skip_word, len = line_state:_unbreak_word(word_index, nowordbreakchars)
         if adjusted then
+            self._impure = true
             self._line_state = adjusted
             line_state = adjusted
             if self._word_classifier then
@@ -702,9 +752,11 @@ function _argreader:update(word, word_index, extra, last_onadvance) -- luacheck:
     -- Run delayinit and onarg (is_flag runs them further above).
     if not is_flag then
         if arg.delayinit then
+            self._impure = true
             do_delayed_init(arg, realmatcher, arg_index)
         end
         if arg.onarg and clink._in_generate() then
+            self._impure = true
             arg.onarg(arg_index, word, word_index, line_state, self._user_data)
         end
     end
@@ -721,6 +773,9 @@ function _argreader:update(word, word_index, extra, last_onadvance) -- luacheck:
     -- Parse the word type.
     if self._word_classifier and not extra then
         local aidx = is_flag and 0 or arg_index
+        if realmatcher._classify_func then
+            self._impure = true
+        end
         if realmatcher._classify_func and realmatcher._classify_func(aidx, word, word_index, line_state, self._word_classifier, self._user_data) then -- luacheck: ignore 542
             -- The classifier function says it handled the word.
         else
@@ -815,6 +870,7 @@ function _argreader:update(word, word_index, extra, last_onadvance) -- luacheck:
         end
         if linked then
             if linked._delayinit_func then
+                self._impure = true
                 do_onuse_callback(linked, nil)
             end
             self:_push(linked)
@@ -934,6 +990,219 @@ function _argreader:_pop(next_is_flag)
     return true
 end
 
+--------------------------------------------------------------------------------
+-- The memo lets a walk over a command resume after the longest unchanged run
+-- of words, instead of re-parsing every word each time the line is classified
+-- or completed.
+--
+-- Each memo node represents one word, keyed on the text from the end of the
+-- previous word through the end of this word (so separators, quotes, and
+-- adjacency are part of the key), plus the cursor when it's within that span.
+-- A node holds the reader state from before parsing its word; it isn't stored
+-- on the previous word's node because parsing a word peeks at the next word.
+-- When classifying, a node also holds the classifications applied while
+-- parsing the previous word, so they can be replayed.
+--
+-- Only pure parsing is memoised:  once a word runs a callback or delayinit,
+-- alters the line_state, or chains, recording stops for the rest of the walk.
+local function memo_piece(line, line_state, cursor, word_index)
+    local info = line_state:getwordinfo(word_index)
+    local prev = line_state:getwordinfo(word_index - 1)
+    local s = prev.offset + prev.length
+    local e = info.offset + info.length
+    local piece = line:sub(s, e - 1)
+    if info.redir then
+        piece = piece.."\2"
+    end
+    if cursor >= s and cursor <= e then
+        piece = piece.."\1"..(cursor - s)
+    end
+    return piece
+end
+
+--------------------------------------------------------------------------------
+-- Stands in for the word_classifications object while recording, so that the
+-- classifications applied for each word can be saved in the memo.
+local _memo_recorder = {}
+function _memo_recorder:classifyword(word_index, t, overwrite)
+    table.insert(self._ops, { word_index, t, overwrite })
+    return self._real:classifyword(word_index, t, overwrite)
+end
+function _memo_recorder:applycolor(start, len, color, overwrite)
+    table.insert(self._ops, { start - self._base, len, color, overwrite, apply=true })
+    return self._real:applycolor(start, len, color, overwrite)
+end
+local _memo_recorder_mt = { __index=function (self, key)
+    local f = _memo_recorder[key]
+    if f then
+        return f
+    end
+    -- Anything else is forwarded to the real object, and stops recording.
+    local real = rawget(self, "_real")
+    local v = real[key]
+    if type(v) == "function" then
+        return function (_, ...)
+            rawget(self, "_reader")._impure = true
+            return v(real, ...)
+        end
+    end
+    return v
+end }
+
+--------------------------------------------------------------------------------
+-- Enables the memo for a walk over the words of the reader's line_state.  Only
+-- call this for the first command in a line_state, and not when consuming
+-- words from an expanded doskey alias.
+function _argreader:_memo_begin(classify)
+    local kind = (classify and "c" or "w")..(clink._in_generate() and "g" or "")
+    local roots = _argreader_memo[kind]
+    if not roots then
+        roots = {}
+        _argreader_memo[kind] = roots
+    end
+
+    local line_state = self._line_state
+    local cwi = line_state:getcommandwordindex()
+    local key = cwi..(self._cmd_wordbreak and "b" or "")..clink.translateslashes()
+    local by_key = roots[self._matcher]
+    if not by_key then
+        by_key = {}
+        roots[self._matcher] = by_key
+    end
+    local root = by_key[key]
+    if not root then
+        if _argreader_memo_nodes >= _argreader_memo_max_nodes then
+            clear_argreader_memo()
+            return self:_memo_begin(classify)
+        end
+        root = { next={} }
+        by_key[key] = root
+        _argreader_memo_nodes = _argreader_memo_nodes + 1
+    end
+
+    self._memo = root
+    self._memo_line = line_state:getline()
+    self._memo_cursor = line_state:getcursor()
+    self._impure = nil
+    if classify and self._word_classifier then
+        local base = line_state:getwordinfo(cwi).offset
+        self._word_classifier = setmetatable({ _real=self._word_classifier, _reader=self, _base=base, _ops={} }, _memo_recorder_mt)
+    end
+end
+
+--------------------------------------------------------------------------------
+-- Restores the state from the deepest memo node that matches the words of the
+-- line, and replays the classifications recorded for the skipped words.
+-- Returns the index of the first word that still needs to be parsed, which is
+-- at most last + 1.
+function _argreader:_memo_resume(first, last)
+    local node = self._memo
+    if not node then
+        return first
+    end
+
+    local line_state = self._line_state
+    local line = self._memo_line
+    local cursor = self._memo_cursor
+    local limit = math.min(last + 1, line_state:getwordcount())
+    local path = {}
+    local resume = first
+    for word_index = first, limit do
+        local child = node.next[memo_piece(line, line_state, cursor, word_index)]
+        if not child then
+            break
+        end
+        node = child
+        resume = word_index
+        table.insert(path, child)
+    end
+    self._memo = node
+
+    if resume > first then
+        local state = node.state
+        self._matcher = state.matcher
+        self._realmatcher = state.realmatcher
+        self._arg_index = state.arg_index
+        self._noflags = state.noflags
+        self._phantomposition = state.phantomposition
+        self._disabled = state.disabled
+        -- User data is only populated by callbacks, and callbacks never run
+        -- on a memoised path, so fresh user data tables are equivalent.
+        self._user_data = { shared_user_data=self._shared_user_data }
+        local stack = {}
+        for _, e in ipairs(state.stack) do
+            table.insert(stack, { e[1], e[2], e[3], e[4], { shared_user_data=self._shared_user_data } })
+        end
+        self._stack = stack
+
+        local recorder = self._word_classifier
+        if recorder then
+            local real = recorder._real
+            local base = recorder._base
+            for _, n in ipairs(path) do
+                for _, op in ipairs(n.ops) do
+                    if op.apply then
+                        real:applycolor(base + op[1], op[2], op[3], op[4])
+                    else
+                        real:classifyword(op[1], op[2], op[3])
+                    end
+                end
+            end
+        end
+    end
+
+    return resume
+end
+
+--------------------------------------------------------------------------------
+-- Records the state after parsing word_index (or skipping it because it's a
+-- redirection) in the memo node for the next word.
+function _argreader:_memo_record(word_index)
+    local node = self._memo
+    if not node then
+        return
+    end
+    local line_state = self._line_state
+    if self._impure or word_index >= line_state:getwordcount() then
+        self._memo = nil
+        return
+    end
+
+    local piece = memo_piece(self._memo_line, line_state, self._memo_cursor, word_index + 1)
+    local child = node.next[piece]
+    if not child then
+        if _argreader_memo_nodes >= _argreader_memo_max_nodes then
+            self._memo = nil
+            return
+        end
+        child = { next={} }
+        node.next[piece] = child
+        _argreader_memo_nodes = _argreader_memo_nodes + 1
+    end
+
+    local stack = {}
+    for _, e in ipairs(self._stack) do
+        table.insert(stack, { e[1], e[2], e[3], e[4] })
+    end
+    child.state = {
+        matcher=self._matcher,
+        realmatcher=self._realmatcher,
+        arg_index=self._arg_index,
+        noflags=self._noflags,
+        phantomposition=self._phantomposition,
+        disabled=self._disabled,
+        stack=stack,
+    }
+
+    local recorder = self._word_classifier
+    child.ops = recorder and recorder._ops or {}
+    if recorder then
+        recorder._ops = {}
+    end
+
+    self._memo = child
+end
+
 
 
 --------------------------------------------------------------------------------
@@ -1008,8 +1277,10 @@ local function apply_options_to_builder(reader, arg, builder)
             clink.co_state._argmatcher_fromhistory.argslot = reader._arg_index
             clink.co_state._argmatcher_fromhistory.builder = builder
             -- Let the C++ code iterate through the history and call back into
-            -- Lua to parse individual history lines.
-            clink._generate_from_history()
+            -- Lua to parse individual history lines.  It only parses lines
+            -- with command words that clink._accept_fromhistory_command()
+            -- accepts.
+            clink._generate_from_history(clink._accept_fromhistory_command)
             -- Clear references.  Clear builder because it goes out of scope,
             -- and clear other references to facilitate garbage collection.
             clink.co_state._argmatcher_fromhistory = {}
@@ -1076,6 +1347,7 @@ end
 --- See <a href="#adaptive-argmatchers">Adaptive Argmatchers</a> for more
 --- information.
 function _argmatcher:reset()
+    clear_argreader_memo()
     if self._is_flag_matcher then
         error("Cannot reset a flag matcher (it is internal and not exposed)")
     end
@@ -1247,6 +1519,7 @@ end
 --- -show:  :addarg("two", "dos")       -- third arg can be two or dos
 --- -show:  :loop(2)    -- fourth arg loops back to position 2, for one or uno, and so on
 function _argmatcher:loop(index)
+    clear_argreader_memo()
     self._loop = index or -1
     return self
 end
@@ -1280,6 +1553,7 @@ end
 --- -show:  :addflags(make_flags)   -- Only a function is added, so flag prefix characters cannot be determined automatically.
 --- -show:  :setflagprefix('-')     -- Force '-' to be considered as a flag prefix character.
 function _argmatcher:setflagprefix(...)
+    clear_argreader_memo()
     for _, i in ipairs({...}) do
         if type(i) ~= "string" or #i ~= 1 then
             error("Flag prefixes must be single character strings", 2)
@@ -1300,6 +1574,7 @@ end
 --- until an argument is encountered.  Otherwise they are recognized anywhere
 --- (which is the default).
 function _argmatcher:setflagsanywhere(anywhere)
+    clear_argreader_memo()
     if anywhere then
         self._flagsanywhere = true
     else
@@ -1318,6 +1593,7 @@ end
 --- true or nil, then "<code>--</code>" is used as the end of flags string.
 --- Otherwise, the end of flags string is cleared.
 function _argmatcher:setendofflags(endofflags)
+    clear_argreader_memo()
     if endofflags == true or endofflags == nil then
         endofflags = "--"
     elseif type(endofflags) ~= "string" then
@@ -1359,6 +1635,12 @@ end
 --- </code></pre>
 --- </ul>
 ---
+--- Starting in v1.6.17, a description string can instead be a function that
+--- returns the description string.  The function receives the match text, and
+--- is called only when the description is going to be displayed.  This helps
+--- when descriptions are expensive to get; see
+--- <a href="#builder:addmatch">builder:addmatch()</a>.
+---
 --- -show:  local foo = clink.argmatcher("foo")
 --- -show:  foo:addflags("-h", "--help", "--user")
 --- -show:  foo:addarg("info", "set")
@@ -1404,10 +1686,10 @@ function _argmatcher:adddescriptions(...)
             if type(desc) == "table" then
                 if type(desc[1]) ~= "string" then
                     error("bad argument #".._.." (descriptions table starting with '"..tostring(t[1]).."' does not have a string at index 1")
-                elseif desc[2] and type(desc[2]) ~= "string"  then
+                elseif desc[2] and type(desc[2]) ~= "string" and type(desc[2]) ~= "function" then
                     error("bad argument #".._.." (descriptions table starting with '"..tostring(t[1]).."' has a non-string at index 2")
                 end
-            elseif type(desc) ~= "string" then
+            elseif type(desc) ~= "string" and type(desc) ~= "function" then
                 error("bad argument #".._.." (descriptions table starting with '"..tostring(t[1]).."' is missing a 'description' field)")
             end
             for _,key in ipairs(t) do
@@ -1430,6 +1712,7 @@ end
 --- generators</a>.  You can use it to "dead end" a parser and suggest no
 --- completions.
 function _argmatcher:nofiles()
+    clear_argreader_memo()
     self._no_file_generation = true
     return self
 end
@@ -1495,6 +1778,7 @@ end
 --- gets executed.  It only affects how the argmatcher performs completions
 --- and input line coloring, to help the argmatcher be accurate.
 function _argmatcher:chaincommand(modes)
+    clear_argreader_memo()
     modes = modes or ""
     self._chain_command = true
     self._chain_command_mode = "cmd"
@@ -1512,6 +1796,7 @@ end
 --- handles, to classify the word as part of coloring the input text.  See
 --- <a href="#classifywords">Coloring the Input Text</a> for more information.
 function _argmatcher:setclassifier(func)
+    clear_argreader_memo()
     self._classify_func = func
     return self
 end
@@ -1526,6 +1811,7 @@ end
 --- <a href="#adaptive-argmatchers">Adaptive Argmatchers</a> for more
 --- information.
 function _argmatcher:setdelayinit(func)
+    clear_argreader_memo()
     self._delayinit_func = func
     return self
 end
@@ -1715,6 +2001,8 @@ end
 
 --------------------------------------------------------------------------------
 function _argmatcher:_add(list, addee, prefixes)
+    clear_argreader_memo()
+    word_indexes[list] = nil
     -- If addee is a flag like --foo= and is not linked, then link it to a
     -- default parser so its argument doesn't get confused as an arg for its
     -- parent argmatcher.
@@ -1759,6 +2047,7 @@ end
 
 --------------------------------------------------------------------------------
 function _argmatcher:_hide(list, addee)
+    clear_argreader_memo()
     -- Flatten out tables unless the table is a link
     local is_link = (getmetatable(addee) == _arglink)
     if type(addee) == "table" and not is_link and not addee.match then
@@ -1795,7 +2084,8 @@ function _argmatcher:_generate(reader, match_builder) -- luacheck: no unused
     -- Consume words and use them to move through matchers' arguments.
     local command_word_index = line_state:getcommandwordindex()
     local word_count = line_state:getwordcount()
-    for word_index = command_word_index + 1, (word_count - 1) do
+    local first = reader:_memo_resume(command_word_index + 1, word_count - 1)
+    for word_index = first, (word_count - 1) do
         local info = line_state:getwordinfo(word_index)
         if not info.redir then
             local word = line_state:getword(word_index)
@@ -1804,6 +2094,7 @@ function _argmatcher:_generate(reader, match_builder) -- luacheck: no unused
             end
             line_state = reader._line_state -- reader:update() can swap to a different line_state.
         end
+        reader:_memo_record(word_index)
     end
 
     -- If not generating matches, then just consume the end word and return.
@@ -2158,7 +2449,9 @@ function clink.argmatcher(...)
         matcher = _argmatcher()
         matcher._priority = priority
         for _, i in ipairs(input) do
-            _argmatchers[path.normalise(clink.lower(i))] = matcher
+            local key = path.normalise(clink.lower(i))
+            _argmatchers[key] = matcher
+            clink._add_argmatcher_name(key)
         end
     end
 
@@ -2173,6 +2466,14 @@ function clink.argmatcher(...)
     return matcher
 end
 
+--------------------------------------------------------------------------------
+-- When the builder only wants the first few matches, there's no need to glob
+-- more files than that.
+local function get_builder_limit()
+    local builder = clink.co_state._current_builder
+    return builder and builder.get_limit and builder:get_limit() or nil
+end
+
 --------------------------------------------------------------------------------
 local function dir_matches_impl(match_word, exact)
     local word, expanded = rl.expandtilde(match_word or "")
@@ -2197,6 +2498,7 @@ local function dir_matches_impl(match_word, exact)
     local flags = {
         hidden=hidden,
         system=settings.get("files.system"),
+        limit=get_builder_limit(),
     }
 
     local matches = {}
@@ -2238,6 +2540,7 @@ local function file_matches_impl(match_word, exact)
     local flags = {
         hidden=hidden,
         system=settings.get("files.system"),
+        limit=get_builder_limit(),
     }
 
     local matches = {}
@@ -2324,6 +2627,259 @@ end
 
 
 
+--------------------------------------------------------------------------------
+-- Cached generators, by name.  Each entry is { key=, time=, matches= }.
+local _generator_caches = {}
+local _generator_pending = {}   -- Async generators that haven't finished yet.
+local _generator_counter = 0
+
+--------------------------------------------------------------------------------
+local function escape_cache_key(key)
+    return (key:gsub("[%c%%]", function (c) return string.format("%%%02X", c:byte()) end))
+end
+
+--------------------------------------------------------------------------------
+local function get_generator_cache_file(name)
+    local dir = os.getenv("=clink.profile")
+    if not dir or dir == "" then
+        return
+    end
+    return path.join(dir, "clink_matchcache_"..name:gsub("[^%w_%-%.]", "_"))
+end
+
+--------------------------------------------------------------------------------
+-- Persisted caches are a line with the time and the escaped key, followed by a
+-- line per match with the match, type, and description separated by tabs.
+local function load_generator_cache(name)
+    local file = get_generator_cache_file(name)
+    local f = file and io.open(file, "r")
+    if not f then
+        return
+    end
+
+    local cache
+    local time, key = (f:read("l") or ""):match("^(%d+)\t(.*)$")
+    if time then
+        cache = { time=tonumber(time), key=key, matches={} }
+        for line in f:lines() do
+            local m, t, d = line:match("^([^\t]*)\t([^\t]*)\t?(.*)$")
+            if m then
+                table.insert(cache.matches, { match=m, type=(t ~= "" and t or nil), description=(d ~= "" and d or nil) })
+            end
+        end
+    end
+    f:close()
+    return cache
+end
+
+--------------------------------------------------------------------------------
+local function save_generator_cache(name, cache)
+    local lines = { cache.time.."\t"..cache.key }
+    for k, m in pairs(cache.matches) do
+        if type(k) ~= "number" then
+            return
+        end
+        if type(m) == "string" then
+            m = { match=m }
+        elseif type(m) ~= "table" or type(m.match) ~= "string" then
+            return
+        end
+        local t = m.type or ""
+        local d = m.description or ""
+        if type(d) == "function" then
+            d = "" -- Lazy descriptions aren't persisted.
+        end
+        local text = m.match.."\t"..t.."\t"..d
+        if type(t) ~= "string" or type(d) ~= "string" or text:find("[\r\n]") or select(2, text:gsub("\t", "")) ~= 2 then
+            return
+        end
+        table.insert(lines, text)
+    end
+
+    local file = get_generator_cache_file(name)
+    local f = file and io.open(file, "w")
+    if f then
+        f:write(table.concat(lines, "\n"), "\n")
+        f:close()
+    end
+end
+
+--------------------------------------------------------------------------------
+--- -name:  clink.cachedgenerator
+--- -ver:   1.6.17
+--- -arg:   func:function
+--- -arg:   [deps:table]
+--- -ret:   function
+--- Returns a function that can be used in an argmatcher in place of
+--- <span class="arg">func</span>, and which remembers the table of matches
+--- that <span class="arg">func</span> returns and reuses it until something
+--- listed in <span class="arg">deps</span> changes.  This avoids running
+--- expensive commands (such as listing git branches) every time completion
+--- or input line coloring needs the matches for the argument.
+---
+--- The <span class="arg">deps</span> table can have these fields:
+--- <table>
+--- <tr><th>Field</th><th>Description</th></tr>
+--- <tr><td><code>name</code></td><td>Cached generators with the same name share one cache, even across argmatchers and scripts.</td></tr>
+--- <tr><td><code>ttl</code></td><td>Number of seconds the matches stay valid.</td></tr>
+--- <tr><td><code>cwd</code></td><td>When true, the matches depend on the current directory.</td></tr>
+--- <tr><td><code>env</code></td><td>Table of environment variable names the matches depend on.</td></tr>
+--- <tr><td><code>files</code></td><td>Table of file names the matches depend on; when a file's timestamp or size changes, the matches are generated again.</td></tr>
+--- <tr><td><code>persist</code></td><td>When true and <code>name</code> is set, the matches are also saved in the profile directory so that new sessions can reuse them.</td></tr>
+--- <tr><td><code>async</code></td><td>When true, <span class="arg">func</span> runs in a coroutine so that it doesn't block completion (see below).</td></tr>
+--- </table>
+---
+--- The matches are not regenerated when the word being completed changes, so
+--- <span class="arg">func</span> should return all matches for the argument
+--- rather than only the ones that match the word.  If
+--- <span class="arg">func</span> returns something other than a table, the
+--- result is passed through and not cached.
+---
+--- Only the <code>match</code>, <code>type</code>, and
+--- <code>description</code> fields of matches are persisted; if a match
+--- contains tabs or newlines the matches aren't persisted.
+---
+--- When <code>async</code> is true, <span class="arg">func</span> can use
+--- <a href="#io.popenyield">io.popenyield()</a> to run programs without
+--- blocking, and it receives a sixth argument:  a table to which it can add
+--- matches as it finds them.  Until <span class="arg">func</span> finishes,
+--- completion uses whatever matches are in that table so far, and when it
+--- finishes the matches and the input line are refreshed.  It can return the
+--- full table of matches, or return nothing to use the table it was given.
+--- It runs in a coroutine, so it doesn't receive a builder object.
+--- -show:  local function git_branches()
+--- -show:  &nbsp;   local branches = {}
+--- -show:  &nbsp;   local f = io.popen("git branch --format=%(refname:short) 2>nul")
+--- -show:  &nbsp;   if f then
+--- -show:  &nbsp;       for line in f:lines() do
+--- -show:  &nbsp;           table.insert(branches, line)
+--- -show:  &nbsp;       end
+--- -show:  &nbsp;       f:close()
+--- -show:  &nbsp;   end
+--- -show:  &nbsp;   return branches
+--- -show:  end
+--- -show:
+--- -show:  local branches = clink.cachedgenerator(git_branches, {
+--- -show:  &nbsp;   name="git_branches", cwd=true, ttl=60,
+--- -show:  &nbsp;   files={ ".git/HEAD", ".git/packed-refs" },
+--- -show:  })
+--- -show:
+--- -show:  clink.argmatcher("git")
+--- -show:  :addarg({ "checkout"..clink.argmatcher():addarg({ branches }) })
+function clink.cachedgenerator(func, deps)
+    if type(func) ~= "function" then
+        error("bad argument #1 (function expected)", 2)
+    end
+    deps = deps or {}
+    if type(deps) ~= "table" then
+        error("bad argument #2 (table or nil expected)", 2)
+    end
+
+    local name = deps.name
+    if type(name) ~= "string" or name == "" then
+        _generator_counter = _generator_counter + 1
+        name = "\1"..tostring(_generator_counter)
+    end
+    local persist = deps.persist and name:byte() ~= 1
+    local ttl = tonumber(deps.ttl)
+    local async = deps.async
+
+    return function (...)
+        local key = escape_cache_key(clink._get_deps_key(deps))
+        local now = os.time()
+
+        local cache = _generator_caches[name]
+        if not cache and persist then
+            cache = load_generator_cache(name)
+            _generator_caches[name] = cache
+        end
+        if cache and cache.key == key and not (ttl and now - cache.time >= ttl) then
+            return cache.matches
+        end
+
+        local function store(matches, k, t)
+            if type(matches) == "table" then
+                local entry = { key=k, time=t, matches=matches }
+                _generator_caches[name] = entry
+                if persist then
+                    save_generator_cache(name, entry)
+                end
+            end
+        end
+
+        if not async then
+            local matches = func(...)
+            store(matches, key, now)
+            return matches
+        end
+
+        -- Run the function in a coroutine, and until it finishes use whatever
+        -- matches it has added to its partial table so far.
+        local pending = _generator_pending[name]
+        if not pending or pending.key ~= key then
+            local word, word_index, line_state, _, user_data = ...
+            pending = { key=key, partial={} }
+            _generator_pending[name] = pending
+
+            local c = coroutine.create(function ()
+                local ok, matches = pcall(func, word, word_index, line_state, nil, user_data, pending.partial)
+                if _generator_pending[name] == pending then
+                    _generator_pending[name] = nil
+                end
+                if not ok then
+                    pending.done = true
+                    error(matches, 0)
+                end
+                if matches == nil then
+                    matches = pending.partial
+                end
+                store(matches, pending.key, now)
+                pending.done = true
+                pending.result = matches
+                -- If it yielded, then refresh the matches and the input line.
+                if pending.yielded then
+                    clink._signal_delayed_init()
+                    clink.reclassifyline()
+                end
+            end)
+            clink.setcoroutinename(c, "cached generator")
+
+            -- Make sure the coroutine runs to completion, so the matches get
+            -- cached even if a new edit line begins before it finishes.
+            clink.runcoroutineuntilcomplete(c)
+
+            -- Run the coroutine up to the first yield, so that if it doesn't
+            -- need to yield at all then it completes right now.
+            local ok, ret = coroutine.resume(c)
+            if not ok and ret and settings.get("lua.debug") then
+                print("")
+                print("coroutine failed:")
+                _co_error_handler(c, ret)
+            end
+            if coroutine.status(c) ~= "dead" then
+                pending.yielded = true
+            end
+        end
+
+        if pending.done then
+            return pending.result
+        end
+
+        -- The matches are incomplete, so they must be generated again later.
+        local builder = select(4, ...)
+        if builder then
+            builder:setvolatile()
+        end
+        local partial = {}
+        for _, m in ipairs(pending.partial) do
+            table.insert(partial, m)
+        end
+        return partial
+    end
+end
+
+
+
 --------------------------------------------------------------------------------
 local function _is_argmatcher_loaded(command_word, quoted, no_cmd)
     local argmatcher
@@ -2400,6 +2956,14 @@ function clink._set_completion_dirs(str)
         for _,d in ipairs(string.explode(str, ";", '"')) do
             add_dirs_from_var(dirs, d, true)
         end
+
+        -- Commands with scripts in completion dirs might have argmatchers,
+        -- so the native classifier must leave them to Lua.
+        for _,d in ipairs(dirs) do
+            for _,f in ipairs(os.globfiles(path.join(d, "*.lua"))) do
+                clink._add_argmatcher_name(clink.lower(path.getbasename(f)))
+            end
+        end
     end
 end
 
@@ -2481,6 +3045,82 @@ local function attempt_load_argmatcher(command_word, quoted, no_cmd)
     end
 end
 
+--------------------------------------------------------------------------------
+local _lazy_argmatchers = {}
+
+--------------------------------------------------------------------------------
+--- -name:  clink.lazyargmatcher
+--- -ver:   1.6.17
+--- -arg:   file:string
+--- -arg:   commands...:string
+--- Registers a Lua script <span class="arg">file</span> that defines
+--- argmatchers for the listed <span class="arg">commands</span>, without
+--- loading it.  The script is loaded the first time one of the commands is
+--- typed.  If <span class="arg">file</span> is a relative path, it is relative
+--- to the directory of the script that calls this.
+---
+--- This lets a single small script act as a manifest for many completion
+--- scripts, so that startup time doesn't grow with the number of completion
+--- scripts that are installed.  The completion scripts themselves should be in
+--- a directory that isn't listed in the Clink scripts path, so that they
+--- aren't also loaded at startup.
+---
+--- The script receives the typed command word as its first argument, the same
+--- as scripts in a <a href="#completion-directories">completions
+--- directory</a>.
+--- -show:  -- Register git.lua and npm.lua from a "lazy" subdirectory.
+--- -show:  clink.lazyargmatcher("lazy\\git.lua", "git", "gitk")
+--- -show:  clink.lazyargmatcher("lazy\\npm.lua", "npm", "npx")
+function clink.lazyargmatcher(file, ...)
+    if type(file) ~= "string" or file == "" then
+        error("bad argument #1 (string expected)")
+    end
+
+    local info = debug.getinfo(2, "S")
+    if info and info.source and info.source:find("^@") then
+        file = path.join(path.getdirectory(info.source:sub(2)), file)
+    end
+
+    local entry = { file=file }
+    for _, i in ipairs({...}) do
+        local key = path.normalise(clink.lower(i))
+        _lazy_argmatchers[key] = entry
+        clink._add_argmatcher_name(key)
+    end
+end
+
+--------------------------------------------------------------------------------
+local function load_lazy_argmatcher(command_word, quoted, no_cmd)
+    local entry = _lazy_argmatchers[command_word] or _lazy_argmatchers[path.getname(command_word)]
+    if not entry and path.isexecext(command_word) then
+        entry = _lazy_argmatchers[path.getbasename(command_word)]
+    end
+    if not entry or entry.loaded then
+        return
+    end
+
+    -- A script is only loaded once, even if it's registered for several
+    -- commands or fails to load.
+    entry.loaded = true
+
+    local impl = function ()
+        local func, message = loadfile(entry.file)
+        if not func then
+            error(message)
+        end
+        func(command_word)
+    end
+    local ok, ret = xpcall(impl, _error_handler_ret)
+    if not ok then
+        print("")
+        print("loading lazy argmatcher script failed:")
+        print(ret)
+        return
+    end
+
+    return _is_argmatcher_loaded(command_word, quoted, no_cmd)
+end
+
 --------------------------------------------------------------------------------
 local function sanitize_command_word(command_word)
     if command_word then
@@ -2520,10 +3160,14 @@ local function _has_argmatcher(command_word, quoted, no_cmd)
 
     local argmatcher = _is_argmatcher_loaded(command_word, quoted, no_cmd)
 
-    -- If an argmatcher isn't loaded, look for a Lua script by that name in one
-    -- of the completions directories.  If found, load it and check again.
-    if not argmatcher and not loaded_argmatchers[command_word] and recognized then
-        argmatcher = attempt_load_argmatcher(command_word, quoted, no_cmd)
+    -- If an argmatcher isn't loaded, load a script registered for it by
+    -- clink.lazyargmatcher(), or look for a Lua script by that name in one of
+    -- the completions directories.  If found, load it and check again.
+    if not argmatcher and not loaded_argmatchers[command_word] then
+        argmatcher = load_lazy_argmatcher(command_word, quoted, no_cmd)
+        if not argmatcher and recognized then
+            argmatcher = attempt_load_argmatcher(command_word, quoted, no_cmd)
+        end
     end
 
     if argmatcher and not (clink.co_state._argmatcher_fromhistory and clink.co_state._argmatcher_fromhistory.argmatcher) then
@@ -2653,6 +3297,19 @@ function clink.getargmatcher(find)
     end
 end
 
+--------------------------------------------------------------------------------
+-- Tells clink._generate_from_history() whether history lines that use WORD as
+-- a command word can lead to the argmatcher that's generating matches from
+-- history.  Doskey aliases can expand to any command, so they're accepted.
+function clink._accept_fromhistory_command(word, quoted)
+    local alias = os.getalias(word)
+    if alias and alias ~= "" then
+        return true
+    end
+    local argmatcher = _has_argmatcher(word, quoted)
+    return argmatcher and argmatcher == clink.co_state._argmatcher_fromhistory_root
+end
+
 --------------------------------------------------------------------------------
 function clink._generate_from_historyline(line_state)
     local lookup
@@ -2710,6 +3367,7 @@ end
 clink.argmatcher_generator_priority = 24
 local argmatcher_generator = clink.generator(clink.argmatcher_generator_priority)
 local argmatcher_classifier = clink.classifier(clink.argmatcher_generator_priority)
+argmatcher_classifier._native = "argmatcher"
 
 --------------------------------------------------------------------------------
 local function do_generate(line_state, match_builder)
@@ -2732,6 +3390,9 @@ local function do_generate(line_state, match_builder)
         clink.co_state._argmatcher_fromhistory_root = argmatcher
 
         local reader = _argreader(argmatcher, line_state)
+        if not extra and no_cmd == nil then
+            reader:_memo_begin()
+        end
 
         -- Consume extra words from expanded doskey alias.
         if extra then
@@ -2791,6 +3452,9 @@ function argmatcher_generator:getwordbreakinfo(line_state) -- luacheck: no self
     end
     if argmatcher then
         local reader = _argreader(argmatcher, line_state)
+        if not extra and no_cmd == nil then
+            reader:_memo_begin()
+        end
 
         -- Consume extra words from expanded doskey alias.
         if extra then
@@ -2805,7 +3469,8 @@ function argmatcher_generator:getwordbreakinfo(line_state) -- luacheck: no self
         -- Consume words and use them to move through matchers' arguments.
         local command_word_index = line_state:getcommandwordindex()
         local word_count = line_state:getwordcount()
-        for word_index = command_word_index + 1, (word_count - 1) do
+        local first = reader:_memo_resume(command_word_index + 1, word_count - 1)
+        for word_index = first, (word_count - 1) do
             local info = line_state:getwordinfo(word_index)
             if not info.redir then
                 local word = line_state:getword(word_index)
@@ -2817,6 +3482,7 @@ function argmatcher_generator:getwordbreakinfo(line_state) -- luacheck: no self
                     goto do_command
                 end
             end
+            reader:_memo_record(word_index)
         end
 
         -- Special processing for last word, in case there's an onadvance callback.
@@ -2933,6 +3599,9 @@ function argmatcher_classifier:classify(commands) -- luacheck: no self
         if argmatcher then
             local reader = _argreader(argmatcher, line_state)
             reader._word_classifier = word_classifier
+            if not extra and no_cmd == nil then
+                reader:_memo_begin(true)
+            end
 
             -- Consume extra words from expanded doskey alias.
             if extra then
@@ -2945,7 +3614,9 @@ function argmatcher_classifier:classify(commands) -- luacheck: no self
             end
 
             -- Consume words and use them to move through matchers' arguments.
-            for word_index = command_word_index + 1, line_state:getwordcount() do
+            local word_count = line_state:getwordcount()
+            local first = reader:_memo_resume(command_word_index + 1, word_count)
+            for word_index = first, word_count do
                 local info = line_state:getwordinfo(word_index)
                 if not info.redir then
                     local word = line_state:getword(word_index)
@@ -2958,6 +3629,7 @@ function argmatcher_classifier:classify(commands) -- luacheck: no self
                         goto do_command
                     end
                 end
+                reader:_memo_record(word_index)
             end
         end
     end
@@ -3031,6 +3703,26 @@ function clink._diag_argmatchers(arg)
     if not any then
         clink.print("  none")
     end
+
+    local pending = {}
+    for k,v in pairs(_lazy_argmatchers) do
+        if not v.loaded then
+            pending[k] = v.file
+        end
+    end
+    if next(pending) then
+        clink.print(bold.."lazy argmatchers (not loaded yet):"..norm)
+        width = 0
+        for k in pairs(pending) do
+            if width < #k then
+                width = #k
+            end
+        end
+        fmt = "  %-"..width.."s  :  %s"
+        for k,v in spairs(pending) do
+            clink.print(string.format(fmt, k, v))
+        end
+    end
 end
 
 --------------------------------------------------------------------------------
@@ -3206,5 +3898,6 @@ function clink.arg.register_parser(cmd, parser)
 
     -- Register the parser.
     _argmatchers[cmd] = parser
+    clink._add_argmatcher_name(cmd)
     return matcher
 end
@@ -9,6 +9,10 @@ clink = clink or {}
 local _classifiers = {}
 local _classifiers_unsorted = false
 
+-- Argmatchers are defined after this, and tell the native classifier about
+-- themselves; start over since they're about to be defined anew.
+clink._reset_native_classify()
+
 if settings.get("lua.debug") or clink.DEBUG then
     -- Make it possible to inspect these locals in the debugger.
     clink.debug = clink.debug or {}
@@ -25,6 +29,19 @@ end
 clink.classifier_stopped = nil
 local function classifier_onbeginedit()
     clink.classifier_stopped = nil
+
+    -- The native classifier can stand in for the built-in cmd and argmatcher
+    -- classifiers, but only while there are no other classifiers.
+    local native = {}
+    for _, classifier in ipairs(_classifiers) do
+        if classifier._native then
+            native[classifier._native] = true
+        elseif classifier.classify then
+            native = {}
+            break
+        end
+    end
+    clink._set_native_classify(native.cmd and native.argmatcher)
 end
 clink.onbeginedit(classifier_onbeginedit)
 
@@ -157,6 +157,37 @@ function clink.split(str, sep)
     return ret
 end
 
+--------------------------------------------------------------------------------
+-- Appends the state named by a cache dependency table to PARTS, and returns
+-- the parts joined into a key.  When the key changes, the cached result is
+-- stale.  DEPS can have these fields:
+--      cwd         The current directory.
+--      errorlevel  The exit code of the last command.
+--      env         Table of environment variable names.
+--      files       Table of file names; their timestamps and sizes.
+function clink._get_deps_key(deps, parts)
+    parts = parts or {}
+    if deps.cwd then
+        table.insert(parts, os.getcwd())
+    end
+    if deps.errorlevel then
+        table.insert(parts, tostring(os.geterrorlevel()))
+    end
+    if type(deps.env) == "table" then
+        for _, name in ipairs(deps.env) do
+            table.insert(parts, os.getenv(name) or "\1")
+        end
+    end
+    if type(deps.files) == "table" then
+        for _, name in ipairs(deps.files) do
+            local t = os.globfiles(name, 2)
+            local info = t and t[1]
+            table.insert(parts, info and (info.mtime.."|"..info.size) or "\1")
+        end
+    end
+    return table.concat(parts, "\0")
+end
+
 
 
 --------------------------------------------------------------------------------
@@ -217,6 +248,72 @@ function os.globfiles(pattern, extrainfo, flags)
     end
 end
 
+--------------------------------------------------------------------------------
+--- -name:  os.walk
+--- -ver:   1.6.17
+--- -arg:   dir:string
+--- -arg:   [extrainfo:integer|boolean]
+--- -arg:   [flags:table]
+--- -ret:   table
+--- Recursively collects files (and optionally directories) under
+--- <span class="arg">dir</span> and returns them in a table of strings.  The
+--- names are relative to <span class="arg">dir</span>, and directory names end
+--- with a path separator.
+---
+--- The directory tree is walked natively on background threads, with
+--- subdirectories enumerated in parallel, so this is much faster than
+--- recursing with <a href="#os.globfiles">os.globfiles()</a>.  Junctions and
+--- symlinks to directories are listed but not followed.  The order of the
+--- results is unspecified.
+---
+--- When this is used in a coroutine it yields while the walk is in progress,
+--- so a huge tree doesn't block input.
+---
+--- The optional <span class="arg">extrainfo</span> argument returns a table of
+--- tables instead, the same as for <a href="#os.globfiles">os.globfiles()</a>.
+---
+--- The optional <span class="arg">flags</span> argument can be a table with
+--- fields that select how the walk should behave.  The
+--- <span class="tablescheme">ignore</span> patterns use the same format as
+--- <a href="https://git-scm.com/docs/gitignore#_pattern_format">.gitignore</a>
+--- files.
+--- -show:  local flags = {
+--- -show:  &nbsp;   files = true,       -- True includes files (default), or false omits them.
+--- -show:  &nbsp;   dirs = false,       -- True includes directories, or false omits them (default).
+--- -show:  &nbsp;   hidden = true,      -- True includes hidden files and directories (default), or false omits them.
+--- -show:  &nbsp;   system = false,     -- True includes system files and directories, or false omits them (default).
+--- -show:  &nbsp;   maxdepth = 0,       -- How many levels to walk; 1 is only dir itself, and 0 is unlimited (default).
+--- -show:  &nbsp;   pattern = "*.csproj", -- Only include names matching this wildcard pattern.
+--- -show:  &nbsp;   ignore = { "bin/", "obj/" }, -- Skip entries matching these patterns.
+--- -show:  &nbsp;   gitignore = true,   -- True also honors .gitignore files and skips .git dirs, or false doesn't (default).
+--- -show:  }
+--- -show:  local t = os.walk(".", false, flags)
+function os.walk(dir, extrainfo, flags)
+    if flags == nil and type(extrainfo) == "table" then
+        flags = extrainfo
+        extrainfo = nil
+    end
+
+    local c, ismain = coroutine.running()
+    if not ismain and clink._is_coroutine_canceled(c) then
+        return {}
+    end
+
+    local t = {}
+    local w = os._makewalker(dir or "", extrainfo, flags)
+    while w:next(t) do
+        if not ismain then
+            coroutine.yield()
+            if clink._is_coroutine_canceled(c) then
+                t = {}
+                break
+            end
+        end
+    end
+    w:close()
+    return t
+end
+
 --------------------------------------------------------------------------------
 local function normalize_stars(s)
     local start = 1
@@ -490,7 +587,7 @@ local function first_letter(s)
 end
 
 --------------------------------------------------------------------------------
-local function abbrev_child(parent, child)
+local function abbrev_child_uncached(parent, child)
     local letter = first_letter(child)
     if not letter or letter == "" then
         return child, false
@@ -516,6 +613,36 @@ local function abbrev_child(parent, child)
     return abbr, abbr ~= child
 end
 
+--------------------------------------------------------------------------------
+-- Prompt filters may abbreviate the same directories on every prompt, so the
+-- results are remembered until the parent directory's children may have
+-- changed.
+local _abbrev_cache = {}
+local _abbrev_cache_count = 0
+local function abbrev_child(parent, child)
+    local stamp = os._getdirstamp(parent)
+    if not stamp then
+        return abbrev_child_uncached(parent, child)
+    end
+
+    local key = parent.."|"..child
+    local cached = _abbrev_cache[key]
+    if cached and cached.stamp == stamp then
+        return cached.abbr, cached.did
+    end
+
+    local abbr, did = abbrev_child_uncached(parent, child)
+    if not cached then
+        if _abbrev_cache_count >= 256 then
+            _abbrev_cache = {}
+            _abbrev_cache_count = 0
+        end
+        _abbrev_cache_count = _abbrev_cache_count + 1
+    end
+    _abbrev_cache[key] = { stamp=stamp, abbr=abbr, did=did }
+    return abbr, did
+end
+
 --------------------------------------------------------------------------------
 --- -name:  os.abbreviatepath
 --- -ver:   1.4.1
@@ -1,4 +1,4 @@
--- Copyright (c) 2021 Christopher Antos
+﻿-- Copyright (c) 2021 Christopher Antos
 -- License: http://opensource.org/licenses/MIT
 
 -- luacheck: max line length 150
@@ -21,6 +21,21 @@ clink.co_state = _main_perthread_state
 
 local print = clink.print
 
+-- Priority classes for resuming coroutines.  Generator coroutines produce
+-- matches and suggestions for the current keystroke, so they're high by
+-- default.
+local _priority_classes = { high=1, normal=2, low=3 }
+
+-- Resuming stops for the current idle tick after this many seconds, so a few
+-- slow coroutines can't delay input processing; the rest resume next tick.
+local _resume_budget = 0.050
+
+-- How many yieldguards can be active at the same time in each category.
+-- Prompt coroutines belong to different prompt filters and don't depend on
+-- each other, so several of them can wait for commands in parallel instead of
+-- taking turns.  Other categories allow one at a time.
+local _yieldguard_limits = { prompt=4 }
+
 --------------------------------------------------------------------------------
 -- Scheme for entries in _coroutines:
 --
@@ -31,12 +46,16 @@ local print = clink.print
 --      resumed:        How many times the coroutine has been resumed.
 --      context:        The context in which the coroutine was created.
 --      generation:     The generation to which this coroutine belongs.
---      yield_category: The category, for serializing types of yieldguards.
+--      yield_category: The category, for limiting how many yieldguards run at once.
 --      isprompt:       True means this is a prompt coroutine.
 --      isgenerator:    True means this is a generator coroutine.
 --      state:          Global state context for the coroutine (contains variables that are swapped).
 --      co_state:       Global state context for the coroutine (the table itself is swapped).
 --      src:            The source code file and line for the coroutine function.
+--      priority:       Priority class; lower numbers are resumed first.
+--
+--  Set by clink.setcoroutinepriority:
+--      deadline:       The os.clock() by which the coroutine wants to finish.
 --
 --  Updated by the coroutine management system:
 --      resumed:        Number of times the coroutine has been resumed.
@@ -92,11 +111,25 @@ local function release_coroutine_yieldguard()
                 -- TODO: This is an arbitrary order, but the dequeue order
                 -- should ideally be FIFO.
                 for _,e in pairs(_coroutines) do
-                    if e.queued and e.category == category then
+                    if e.queued == "category" and e.yield_category == cyg.category then
                         e.queued = nil
                         break
                     end
                 end
+                -- Prompt coroutines are first in line for a global slot.
+                local other
+                for _,e in pairs(_coroutines) do
+                    if e.queued == "global" then
+                        if e.isprompt then
+                            other = e
+                            break
+                        end
+                        other = other or e
+                    end
+                end
+                if other then
+                    other.queued = nil
+                end
             end
         end
     end
@@ -105,6 +138,46 @@ local function release_coroutine_yieldguard()
     end
 end
 
+--------------------------------------------------------------------------------
+-- Returns the key of an unused yieldguard slot in the category, or nil if the
+-- category already has as many active yieldguards as it allows.
+local function get_free_yieldguard_slot(category)
+    local limit = _yieldguard_limits[category] or 1
+    for i = 1, limit do
+        local slot = (i == 1) and category or category.."#"..i
+        if not _coroutine_yieldguard[slot] then
+            return slot
+        end
+    end
+end
+
+--------------------------------------------------------------------------------
+-- Returns why a coroutine must wait before starting a yieldguard:  "category"
+-- if its category is full, "global" if lua.max_async_commands yieldguards are
+-- already active, or nil if it can start one now.  Prompt coroutines may use
+-- every slot, but other coroutines leave one free so that a burst of other
+-- commands can't hold up the prompt.
+local function get_yieldguard_wait(c, category)
+    if category and not get_free_yieldguard_slot(category) then
+        return "category"
+    end
+
+    local limit = settings.get("lua.max_async_commands") or 0
+    if limit > 0 then
+        local entry = _coroutines[c]
+        if limit > 1 and not (entry and entry.isprompt) then
+            limit = limit - 1
+        end
+        local active = 0
+        for _ in pairs(_coroutine_yieldguard) do
+            active = active + 1
+        end
+        if active >= limit then
+            return "global"
+        end
+    end
+end
+
 --------------------------------------------------------------------------------
 local function get_coroutine_generation(c)
     if c and _coroutines[c] then
@@ -124,9 +197,11 @@ local function set_coroutine_yieldguard(yieldguard)
     local t = coroutine.running()
     local entry = _coroutines[t]
     if yieldguard then
-        local cyg = { coroutine=t, yieldguard=yieldguard }
-        if entry.yield_category then
-            _coroutine_yieldguard[entry.yield_category] = cyg
+        local category = entry.yield_category
+        local cyg = { coroutine=t, yieldguard=yieldguard, category=category }
+        local slot = category and get_free_yieldguard_slot(category)
+        if slot then
+            _coroutine_yieldguard[slot] = cyg
         else
             table.insert(_coroutine_yieldguard, cyg)
         end
@@ -142,10 +217,30 @@ end
 local function set_coroutine_queued(queued)
     local t = coroutine.running()
     if t and _coroutines[t] then
-        _coroutines[t].queued = queued and true or nil
+        _coroutines[t].queued = queued or nil
     end
 end
 
+--------------------------------------------------------------------------------
+-- Yields until the coroutine may start a yieldguard.  Returns false if the
+-- coroutine was canceled while waiting.
+local function wait_for_yieldguard(c, category)
+    local wait = get_yieldguard_wait(c, category)
+    if not wait then
+        return true
+    end
+    repeat
+        set_coroutine_queued(wait)
+        coroutine.yield()
+        if clink._is_coroutine_canceled(c) then
+            break
+        end
+        wait = get_yieldguard_wait(c, category)
+    until not wait
+    set_coroutine_queued(false)
+    return not clink._is_coroutine_canceled(c)
+end
+
 --------------------------------------------------------------------------------
 local function cancel_coroutine(message)
     clink._cancel_coroutine()
@@ -266,6 +361,11 @@ function clink._resume_coroutines()
     local remove = {}
     local co
     local impl = function()
+        -- Collect the coroutines that are ready to resume.  Collecting them
+        -- first also avoids modifying _coroutines while traversing it, since
+        -- resuming a coroutine can create more coroutines.
+        local ready = {}
+        local now = os.clock()
         for c,entry in pairs(_coroutines) do
             co = c
             if coroutine.status(c) == "dead" then
@@ -275,39 +375,74 @@ function clink._resume_coroutines()
                 table.insert(remove, c)
             else
                 _coroutines_resumable = true
-                local now = os.clock()
-                if next_entry_target(entry, now) <= now and
+                local target = next_entry_target(entry, now)
+                if target <= now and
                         (not entry.asyncyield or entry.asyncyield:ready()) then
-                    if not entry.firstclock then
-                        entry.firstclock = now
-                    end
-                    if entry.asyncyield then
-                        entry.throttleclock = now
-                    end
-                    entry.resumed = entry.resumed + 1
-                    clink._set_coroutine_context(entry.context)
-                    local ok, ret
-                    if entry.isprompt or entry.isgenerator then
-                        ok, ret = coroutine.resume(c, true--[[async]])
-                    else
-                        ok, ret = coroutine.resume(c)
-                    end
-                    if ok then
-                        -- Use live clock so the interval excludes the execution
-                        -- time of the coroutine.
-                        entry.lastclock = os.clock()
-                    else
-                        if not entry.canceled then
-                            print("")
-                            print("coroutine failed:")
-                            _co_error_handler(c, ret)
-                            entry.error = ret
-                        end
-                    end
-                    if coroutine.status(c) == "dead" then
-                        table.insert(remove, c)
+                    table.insert(ready, { c=c, entry=entry, target=target })
+                end
+            end
+        end
+
+        -- Resume by priority class, then earliest deadline, then whichever has
+        -- been waiting longest.
+        table.sort(ready, function(a, b)
+            local pa = a.entry.priority or _priority_classes.normal
+            local pb = b.entry.priority or _priority_classes.normal
+            if pa ~= pb then
+                return pa < pb
+            end
+            local da = a.entry.deadline
+            local db = b.entry.deadline
+            if da ~= db then
+                if not da or not db then
+                    return da ~= nil
+                end
+                return da < db
+            end
+            return a.target < b.target
+        end)
+
+        local budget_end = now + _resume_budget
+        for i,r in ipairs(ready) do
+            -- Always resume at least one per tick, so progress is guaranteed.
+            if i > 1 and os.clock() >= budget_end then
+                break
+            end
+            local c = r.c
+            local entry = r.entry
+            co = c
+            -- An earlier coroutine may have removed it meanwhile.
+            if _coroutines[c] == entry and coroutine.status(c) ~= "dead" then
+                now = os.clock()
+                if not entry.firstclock then
+                    entry.firstclock = now
+                end
+                if entry.asyncyield then
+                    entry.throttleclock = now
+                end
+                entry.resumed = entry.resumed + 1
+                clink._set_coroutine_context(entry.context)
+                local ok, ret
+                if entry.isprompt or entry.isgenerator then
+                    ok, ret = coroutine.resume(c, true--[[async]])
+                else
+                    ok, ret = coroutine.resume(c)
+                end
+                if ok then
+                    -- Use live clock so the interval excludes the execution
+                    -- time of the coroutine.
+                    entry.lastclock = os.clock()
+                else
+                    if not entry.canceled then
+                        print("")
+                        print("coroutine failed:")
+                        _co_error_handler(c, ret)
+                        entry.error = ret
                     end
                 end
+                if coroutine.status(c) == "dead" then
+                    table.insert(remove, c)
+                end
             end
         end
     end
@@ -364,11 +499,10 @@ function clink._finish_coroutine(c)
 
         local duration = clink._wait_duration()
         if duration and duration > 0 then
-            local entry = _coroutines[c]
-            if entry.yield_category then
-                local cyg = _coroutine_yieldguard[entry.yield_category]
-                if cyg then
+            for _, cyg in pairs(_coroutine_yieldguard) do
+                if cyg.coroutine == c then
                     cyg.yieldguard:wait(duration)
+                    break
                 end
             end
         end
@@ -582,8 +716,11 @@ local function restore_coroutine_state(entry, thread)
         end
     end
 
+    -- Reuse the entry's old_state table; many coroutines get resumed on every
+    -- idle tick, and a new table per resume adds up to a lot of garbage.
     local state = entry.state
-    local old_state = {}
+    local old_state = entry.spare_old_state or {}
+    entry.spare_old_state = nil
 
     old_state.cwd = os.getcwd()
     if state.cwd and state.cwd ~= old_state.cwd then
@@ -595,11 +732,12 @@ local function restore_coroutine_state(entry, thread)
         rl_state = state.rl_state
         if not entry.keepevents then
             old_state.events = clink._set_coroutine_events(state.events)
+        else
+            old_state.events = nil
         end
     end
 
-    old_state.global_modes = clink._save_global_modes()
-    clink._restore_global_modes(state.global_modes)
+    old_state.global_modes = clink._swap_global_modes(state.global_modes or 0)
 
     entry.old_state = old_state
 end
@@ -632,12 +770,10 @@ local function save_coroutine_state(entry, thread)
     end
 
     -- When not old_state then this is a new coroutine.
-    state.global_modes = clink._save_global_modes(not old_state--[[new_coroutine]]);
-    if old_state then
-        clink._restore_global_modes(old_state.global_modes)
-    end
+    state.global_modes = clink._swap_global_modes(old_state and old_state.global_modes, not old_state--[[new_coroutine]])
 
     entry.old_state = nil
+    entry.spare_old_state = old_state
 end
 
 --------------------------------------------------------------------------------
@@ -680,6 +816,7 @@ function clink.removecoroutine(c)
                 entry.events = nil
                 entry.state = nil
                 entry.old_state = nil
+                entry.spare_old_state = nil
                 -- Move the coroutine's tracking entry to the dead list.
                 table.insert(_dead, entry)
             end
@@ -733,6 +870,50 @@ function clink.setcoroutineinterval(c, interval)
     _coroutines[c].interval = interval
 end
 
+--------------------------------------------------------------------------------
+--- -name:  clink.setcoroutinepriority
+--- -ver:   1.6.17
+--- -arg:   coroutine:coroutine
+--- -arg:   priority:string
+--- -arg:   [deadline:number]
+--- Sets the priority class for a coroutine, which affects the order in which
+--- coroutines are resumed.  <span class="arg">priority</span> can be "high",
+--- "normal", or "low".  Generator coroutines (which produce completions and
+--- suggestions) are "high" by default, and other coroutines are "normal".
+---
+--- The optional <span class="arg">deadline</span> is how many seconds from
+--- now the coroutine wants to finish.  Within a priority class, coroutines with
+--- earlier deadlines are resumed first.  Use nil to clear the deadline.
+---
+--- Resuming coroutines stops after about 50 milliseconds in each idle period
+--- (at least one coroutine is always resumed), and any remaining coroutines are
+--- resumed in the next idle period.  So, a latency-sensitive coroutine can
+--- use a higher priority or an earlier deadline than slower background work,
+--- to get resumed sooner.
+--- -show:  local c = coroutine.create(function () ... end)
+--- -show:  clink.setcoroutinepriority(c, "low")
+function clink.setcoroutinepriority(c, priority, deadline)
+    if type(c) ~= "thread" then
+        error("bad argument #1 (coroutine expected)")
+    end
+    local class = _priority_classes[priority]
+    if not class then
+        error("bad argument #2 ('high', 'normal', or 'low' expected)")
+    end
+    if deadline ~= nil and type(deadline) ~= "number" then
+        error("bad argument #3 (number or nil expected)")
+    end
+    if not _coroutines[c] then
+        if settings.get("lua.strict") then
+            error("bad argument #1 (coroutine does not exist)")
+        end
+        return
+    end
+
+    _coroutines[c].priority = class
+    _coroutines[c].deadline = deadline and (os.clock() + deadline) or nil
+end
+
 --------------------------------------------------------------------------------
 --- -name:  clink.runcoroutineuntilcomplete
 --- -ver:   1.3.5
@@ -870,20 +1051,11 @@ function io.popenyield(command, mode)
         end
     end
     if can_async then
-        -- Yield to ensure only one yieldable API is active at a time.
+        -- Yield until the category and the global limit allow another yieldable
+        -- API to be active.
         local category = _coroutines[c] and _coroutines[c].yield_category
-        if _coroutine_yieldguard[category] then
-            set_coroutine_queued(true)
-            while _coroutine_yieldguard[category] do
-                coroutine.yield()
-                if clink._is_coroutine_canceled(c) then
-                    break
-                end
-            end
-            set_coroutine_queued(false)
-            if clink._is_coroutine_canceled(c) then
-                return io.open("nul")
-            end
+        if not wait_for_yieldguard(c, category) then
+            return io.open("nul")
         end
         -- Cancel if not from the current generation.
         if not check_generation(c) then
@@ -899,8 +1071,8 @@ function io.popenyield(command, mode)
             while not yieldguard:ready() do
                 coroutine.yield()
                 -- Do not allow canceling once the process has been spawned.
-                -- This enforces no more than one spawned background process is
-                -- running at a time.
+                -- This enforces the limit on how many spawned background
+                -- processes are running at a time.
             end
             set_coroutine_yieldguard(nil)
             -- Make a pclose function.
@@ -920,8 +1092,8 @@ function io.popenyield(command, mode)
                 set_coroutine_yieldguard(yieldguard)
                 while not yieldguard:ready() do
                     coroutine.yield()
-                    -- Do not allow canceling.  This enforces no more than one spawned
-                    -- background process is running at a time.
+                    -- Do not allow canceling.  This enforces the limit on how
+                    -- many spawned background processes are running at a time.
                 end
                 set_coroutine_yieldguard(nil)
                 -- Return exit status.
@@ -934,6 +1106,152 @@ function io.popenyield(command, mode)
     end
 end
 
+--------------------------------------------------------------------------------
+local _helper = {}
+_helper.__index = _helper
+
+--------------------------------------------------------------------------------
+--- -name:  clink.runinworker
+--- -ver:   1.6.17
+--- -arg:   func:function
+--- -arg:   ...:any
+--- -ret:   boolean, ...
+--- Runs <span class="arg">func</span> on a background thread, in a separate
+--- Lua state, and returns true followed by whatever
+--- <span class="arg">func</span> returns.  If <span class="arg">func</span>
+--- raises an error, this returns false and the error message.  This is for
+--- CPU-heavy work such as parsing large JSON output or sorting a large number of
+--- strings, so that it doesn't block input.
+---
+--- When used in a coroutine it yields until the function finishes; otherwise
+--- it waits for the function to finish.
+---
+--- The worker Lua state only has the standard Lua libraries; Clink APIs and
+--- global variables from scripts are not available.  So,
+--- <span class="arg">func</span> must not use upvalues (local variables from
+--- enclosing scopes), which are nil in the worker.  The arguments and return
+--- values are copied between the Lua states, and can only be nil, booleans,
+--- numbers, strings, or tables containing those.
+---
+--- A worker is canceled when the input line ends (or when its coroutine is
+--- abandoned); then this returns false and "canceled".
+--- -show:  local function count_lines(text)
+--- -show:  &nbsp;   local n = 0
+--- -show:  &nbsp;   for _ in text:gmatch("[^\n]*\n") do
+--- -show:  &nbsp;       n = n + 1
+--- -show:  &nbsp;   end
+--- -show:  &nbsp;   return n
+--- -show:  end
+--- -show:
+--- -show:  local ok, lines = clink.runinworker(count_lines, big_text)
+function clink.runinworker(func, ...)
+    if type(func) ~= "function" then
+        error("bad argument #1 (function expected)")
+    end
+    local ok, bytecode = pcall(string.dump, func)
+    if not ok then
+        error("bad argument #1 (Lua function expected)")
+    end
+
+    local _, ismain = coroutine.running()
+    local worker, asyncyield = clink._run_in_worker(not ismain, bytecode, ...)
+    if asyncyield then
+        clink._set_coroutine_asyncyield(asyncyield)
+        while not asyncyield:ready() do
+            coroutine.yield()
+        end
+        clink._set_coroutine_asyncyield(nil)
+    else
+        worker:wait()
+    end
+    return worker:results()
+end
+
+--------------------------------------------------------------------------------
+--- -name:  io.spawnhelper
+--- -ver:   1.6.17
+--- -arg:   command:string
+--- -ret:   object
+--- Returns an object for sending requests to a long-lived helper process that
+--- runs <span class="arg">command</span>.  This is for tools that have a batch
+--- or server mode which reads requests from stdin and writes responses to
+--- stdout, such as <code>git cat-file --batch-check</code>.  Reusing one
+--- process avoids the cost of spawning a new process for every request.
+---
+--- Helper processes are shared:  if a helper for the same
+--- <span class="arg">command</span> and current directory is already running,
+--- it is reused, even across prompts and across reloading Lua scripts.  Up to
+--- 8 helpers run at a time; the least recently used one is stopped to make room
+--- for a new one.
+---
+--- If the process can't be started, this returns nil, an error message, and
+--- an error number.
+---
+--- The returned object has the following functions:
+--- <ul>
+--- <li><strong>request(input, [terminator], [timeout])</strong> - Writes
+--- <span class="arg">input</span> to the helper's stdin, and reads its stdout
+--- until <span class="arg">terminator</span> (default is <code>"\n"</code>).
+--- Returns the output before the terminator, or nil and an error message.  When
+--- used in a coroutine it yields until the response is ready.  If
+--- <span class="arg">timeout</span> seconds pass without a response, the
+--- helper is stopped and it returns nil and "timed out".
+--- <li><strong>isrunning()</strong> - Returns whether the helper process is
+--- still running.
+--- <li><strong>close()</strong> - Stops the helper process.
+--- </ul>
+--- -show:  local git = io.spawnhelper("git cat-file --batch-check")
+--- -show:  if git then
+--- -show:  &nbsp;   local info = git:request("HEAD\n")
+--- -show:  &nbsp;   print(info) -- e.g. "1f2e3d4c... commit 260"
+--- -show:  end
+function io.spawnhelper(command)
+    local h, message, code = io.spawnhelper_internal(command)
+    if not h then
+        return nil, message, code
+    end
+    return setmetatable({ _h=h }, _helper)
+end
+
+--------------------------------------------------------------------------------
+function _helper:request(input, terminator, timeout)
+    local yieldguard, message = self._h:send(input or "", terminator or "\n")
+    if not yieldguard then
+        return nil, message
+    end
+
+    local _, ismain = coroutine.running()
+    if ismain then
+        yieldguard:wait(timeout)
+    else
+        local expiration = timeout and (os.clock() + timeout)
+        while not yieldguard:ready() do
+            if expiration and os.clock() >= expiration then
+                break
+            end
+            coroutine.yield()
+        end
+    end
+
+    if not yieldguard:ready() then
+        -- Responses can't be matched to requests anymore, so stop the helper.
+        self._h:close()
+        return nil, "timed out"
+    end
+
+    return yieldguard:results()
+end
+
+--------------------------------------------------------------------------------
+function _helper:isrunning()
+    return self._h:isrunning()
+end
+
+--------------------------------------------------------------------------------
+function _helper:close()
+    self._h:close()
+end
+
 --------------------------------------------------------------------------------
 -- MAGIC:  Redirect io.popen to io.popenyield when used in read mode, so that
 -- match generators automatically yield in coroutines.
@@ -958,20 +1276,11 @@ os.execute = function (command)
     if ismain or command == nil then
         return old_os_execute(command)
     end
-    -- Yield to ensure only one yieldable API is active at a time.
+    -- Yield until the category and the global limit allow another yieldable
+    -- API to be active.
     local category = _coroutines[c] and _coroutines[c].yield_category
-    if _coroutine_yieldguard[category] then
-        set_coroutine_queued(true)
-        while _coroutine_yieldguard[category] do
-            coroutine.yield()
-            if clink._is_coroutine_canceled(c) then
-                break
-            end
-        end
-        set_coroutine_queued(false)
-        if clink._is_coroutine_canceled(c) then
-            return nil, "exit", -1, "canceled"
-        end
+    if not wait_for_yieldguard(c, category) then
+        return nil, "exit", -1, "canceled"
     end
     -- Cancel if not from the current generation.
     if not check_generation(c) then
@@ -986,8 +1295,8 @@ os.execute = function (command)
         while not yieldguard:ready() do
             coroutine.yield()
             -- Do not allow canceling once the process has been spawned.
-            -- This enforces no more than one spawned background process is
-            -- running at a time.
+            -- This enforces the limit on how many spawned background
+            -- processes are running at a time.
         end
         set_coroutine_yieldguard(nil)
         return yieldguard:results()
@@ -1041,6 +1350,7 @@ function coroutine.create(func) -- luacheck: ignore 122
         generation=_coroutine_generation,
         isprompt=isprompt,
         isgenerator=isgenerator,
+        priority=(isgenerator and _priority_classes.high or _priority_classes.normal),
         yield_category=(isprompt and "prompt" or (isgenerator and "generator")),
         state={},
         co_state={},
@@ -110,6 +110,8 @@ local pause_off = false
 local _g      = _G
 local cocreate, cowrap = coroutine.create, coroutine.wrap
 local pausemsg = 'pause'
+local bp_chunks                   --cache of which chunks contain breakpoints
+local hook_lapsed = false         --true after the hook was removed while running
 
 local aliases = {
     p = "over",
@@ -711,6 +713,7 @@ local function info() dumpvar( traceinfo, 0, 'traceinfo' ) end
 --{{{  local function set_breakpoint(file, line, once)
 
 local function set_breakpoint(file, line, once)
+  bp_chunks = nil
   if not breakpoints[line] then
     breakpoints[line] = {}
   end
@@ -725,11 +728,65 @@ end
 --{{{  local function remove_breakpoint(file, line)
 
 local function remove_breakpoint(file, line)
+  bp_chunks = nil
   if breakpoints[line] then
     breakpoints[line][file] = nil
   end
 end
 
+--}}}
+--{{{  local function chunk_has_breakpoints(file)
+
+--answers whether any breakpoint could match somewhere in the given file,
+--using the same 'sloppy' name matching as has_breakpoint()
+--the answers are cached per file name, and the cache is rebuilt whenever
+--the breakpoints table is found to have changed
+
+local function get_bp_chunks()
+  if not bp_chunks or bp_chunks.__BREAKPOINTS__ ~= breakpoints then
+    local files = {}
+    local any = false
+    for _, v in pairs(breakpoints) do
+      for f in pairs(v) do
+        files[f] = true
+        any = true
+      end
+    end
+    bp_chunks = {__BREAKPOINTS__ = breakpoints, __FILES__ = files, __ANY__ = any}
+  end
+  return bp_chunks
+end
+
+local function chunk_has_breakpoints(file)
+  local bp_chunks = get_bp_chunks()
+  if not bp_chunks.__ANY__ then return false end
+  local known = bp_chunks[file]
+  if known ~= nil then return known end
+  local files = bp_chunks.__FILES__
+  local found = false
+  local name = file
+  local noext = string.gsub(file,"(%..-)$",'',1)
+  if noext == file then noext = nil end
+  while name and not found do
+    found = files[name]
+    if IsWindows then
+      name = string.match(name,"[:/\\](.+)$")
+    else
+      name = string.match(name,"[:/](.+)$")
+    end
+  end
+  while noext and not found do
+    found = files[noext]
+    if IsWindows then
+      noext = string.match(noext,"[:/\\](.+)$")
+    else
+      noext = string.match(noext,"[:/](.+)$")
+    end
+  end
+  bp_chunks[file] = found and true or false
+  return bp_chunks[file]
+end
+
 --}}}
 --{{{  local function has_breakpoint(file, line)
 
@@ -1432,6 +1489,40 @@ local function debugger_loop(ev, vars, file, line, idx_watch)
 
 end
 
+--}}}
+--{{{  local function update_hook(level)
+
+--picks the cheapest hook mask that can still stop where needed, so that
+--resuming execution doesn't leave a line hook running on every instruction:
+--  stepping, watches, or tracing need line events everywhere ("crl")
+--  breakpoints need line events only while inside a chunk that has
+--    breakpoints, so the call and return events toggle the line hook
+--  otherwise the hook is removed, and only pause() or lua.break_on_error
+--    can re-enter the debugger
+--the level is the stack level of the function whose chunk decides whether
+--line events are needed; the hook is per coroutine, so it's reapplied using
+--whichever hook function is installed for the running coroutine
+
+local function update_hook(level)
+  local hook = debug.gethook()
+  if type(hook) ~= "function" then return end
+  if step_into or step_over or next(watches) or trace_calls or trace_returns or trace_lines then
+    debug.sethook(hook, "crl")
+  elseif not get_bp_chunks().__ANY__ then
+    debug.sethook()
+    hook_lapsed = true
+  else
+    local file = level and getinfo(level + 1, "source")
+    if file then
+      if string.find(file, "@") == 1 then
+        file = string.sub(file, 2)
+      end
+      if IsWindows then file = string.lower(file) end
+    end
+    debug.sethook(hook, (file and chunk_has_breakpoints(file)) and "crl" or "cr")
+  end
+end
+
 --}}}
 --{{{  local function debug_hook(event, line, level, thread)
 
@@ -1442,9 +1533,11 @@ local function debug_hook(event, line, level, thread)
   trace_event(event,line,level)
   if event == "call" then
     stack_level[current_thread] = stack_level[current_thread] + 1
+    if not step_into and not step_over then update_hook(level) end
   elseif event == "return" then
     stack_level[current_thread] = stack_level[current_thread] - 1
     if stack_level[current_thread] < 0 then stack_level[current_thread] = 0 end
+    if not step_into and not step_over then update_hook(level + 1) end
   else
     local vars,file,line = capture_vars(level,1,line)
     local stop, ev, idx = false, events.STEP, 0
@@ -1471,6 +1564,7 @@ local function debug_hook(event, line, level, thread)
         ev, idx = events.BREAK, 0
         break
       end
+      if not step_into and not step_over then update_hook(level) end
       return
     end
     tracestack(level)
@@ -1495,6 +1589,7 @@ local function debug_hook(event, line, level, thread)
       if next == 'ask' then
         next = debugger_loop(ev, vars, file, line, idx)
       elseif next == 'cont' then
+        update_hook(level)
         return
       elseif next == 'stop' then
         started = false
@@ -1624,12 +1719,18 @@ function pause(x,l,f)
   end
   show_stack = true                          --make debugger_loop show stack trace
   if started then
+    if hook_lapsed then
+      --the hook was removed while running, so the stack levels are stale
+      stack_level[current_thread] = 1
+      step_level [current_thread] = 0
+      hook_lapsed = false
+    end
     --we'll stop now 'cos the existing debug hook will grab us
     step_lines = lines + step_adjust_started
     step_into  = true
     debug.sethook(debug_hook, "crl")         --reset it in case some external agent fiddled with it
   else
-    io_write("\n\x1b[1mStarting Lua debugger; all Lua code runs slower while debugging.\x1b[m\n")
+    io_write("\n\x1b[1mStarting Lua debugger; Lua code runs slower while stepping or watching.\x1b[m\n")
     io_write("\x1b[1mType 'exit' at the debugger prompt to resume normal execution.\x1b[m\n")
     --set to stop when get out of pause()
     trace_level[current_thread] = 0
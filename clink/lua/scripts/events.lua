@@ -27,21 +27,6 @@ local function log_cost(tick, c)
     end
 end
 
---------------------------------------------------------------------------------
--- Sends a named event to all registered callback handlers for it.
-function clink._send_event(event, ...)
-    local callbacks = clink._event_callbacks[event]
-    if callbacks ~= nil then
-        for _, c in ipairs(callbacks) do
-            if c.func then
-                local tick = os.clock()
-                c.func(...)
-                log_cost(tick, c)
-            end
-        end
-    end
-end
-
 --------------------------------------------------------------------------------
 -- Sends a named event to all registered callback handlers for it.  If any
 -- handler returns a string then stop.
@@ -115,10 +100,17 @@ function clink._has_event_callbacks(event)
 end
 
 --------------------------------------------------------------------------------
-local function _add_event_callback(event, func)
+-- Callbacks are kept sorted by priority, and callbacks with the same priority
+-- are called in the order they were registered.  Events are dispatched by
+-- lua_state, which calls the callbacks in this order.
+local function _add_event_callback(event, func, priority, uselist)
     if type(func) ~= "function" then
         error(event.." requires a function", 2)
     end
+    if priority ~= nil and type(priority) ~= "number" then
+        error(event.." priority must be a number", 2)
+    end
+    priority = priority or 999
 
     local callbacks = clink._event_callbacks[event]
     if callbacks == nil then
@@ -128,7 +120,11 @@ local function _add_event_callback(event, func)
 
     if callbacks[func] == nil then
         callbacks[func] = true -- This prevents duplicates.
-        table.insert(callbacks, { func=func })
+        local pos = #callbacks + 1
+        while pos > 1 and (callbacks[pos - 1].priority or 999) > priority do
+            pos = pos - 1
+        end
+        table.insert(callbacks, pos, { func=func, priority=priority, uselist=uselist })
     end
 end
 
@@ -136,27 +132,38 @@ end
 --- -name:  clink.oninject
 --- -ver:   1.1.21
 --- -arg:   func:function
+--- -arg:   [priority:integer]
 --- Registers <span class="arg">func</span> to be called when Clink is injected
 --- into a CMD process.  The function is called only once per session.
-function clink.oninject(func)
-    _add_event_callback("oninject", func)
+---
+--- Starting in v1.6.17, the optional <span class="arg">priority</span> controls
+--- the order in which the handlers are called; lower numbers are called first,
+--- and the default is 999.
+function clink.oninject(func, priority)
+    _add_event_callback("oninject", func, priority)
 end
 
 --------------------------------------------------------------------------------
 --- -name:  clink.onbeginedit
 --- -ver:   1.1.11
 --- -arg:   func:function
+--- -arg:   [priority:integer]
 --- Registers <span class="arg">func</span> to be called when Clink's edit
 --- prompt is activated.  The function receives no arguments and has no return
 --- values.
-function clink.onbeginedit(func)
-    _add_event_callback("onbeginedit", func)
+---
+--- Starting in v1.6.17, the optional <span class="arg">priority</span> controls
+--- the order in which the handlers are called; lower numbers are called first,
+--- and the default is 999.
+function clink.onbeginedit(func, priority)
+    _add_event_callback("onbeginedit", func, priority)
 end
 
 --------------------------------------------------------------------------------
 --- -name:  clink.onprovideline
 --- -ver:   1.3.18
 --- -arg:   func:function
+--- -arg:   [priority:integer]
 ---
 --- Registers <span class="arg">func</span> to be called after the
 --- <a href="#clink.onbeginedit">onbeginedit</a> event but before the input line
@@ -172,14 +179,19 @@ end
 --- <kbd>Ctrl</kbd>-<kbd>Break</kbd> skips the next
 --- <a href="#clink.onprovideline">onprovideline</a> event, allowing the user
 --- to regain control.
-function clink.onprovideline(func)
-    _add_event_callback("onprovideline", func)
+---
+--- Starting in v1.6.17, the optional <span class="arg">priority</span> controls
+--- the order in which the handlers are called; lower numbers are called first,
+--- and the default is 999.
+function clink.onprovideline(func, priority)
+    _add_event_callback("onprovideline", func, priority)
 end
 
 --------------------------------------------------------------------------------
 --- -name:  clink.onendedit
 --- -ver:   1.1.20
 --- -arg:   func:function
+--- -arg:   [priority:integer]
 --- Registers <span class="arg">func</span> to be called when Clink's edit
 --- prompt ends.  The function receives a string argument containing the input
 --- text from the edit prompt.
@@ -187,14 +199,19 @@ end
 --- <strong>Breaking Change in v1.2.16:</strong>  The ability to replace the
 --- user's input has been moved to a separate
 --- <a href="#clink.onfilterinput">onfilterinput</a> event.
-function clink.onendedit(func)
-    _add_event_callback("onendedit", func)
+---
+--- Starting in v1.6.17, the optional <span class="arg">priority</span> controls
+--- the order in which the handlers are called; lower numbers are called first,
+--- and the default is 999.
+function clink.onendedit(func, priority)
+    _add_event_callback("onendedit", func, priority)
 end
 
 --------------------------------------------------------------------------------
 --- -name:  clink.onfilterinput
 --- -ver:   1.2.16
 --- -arg:   func:function
+--- -arg:   [priority:integer]
 --- Registers <span class="arg">func</span> to be called after Clink's edit
 --- prompt ends (it is called after the <a href="#clink.onendedit">onendedit</a>
 --- event).  The function receives a string argument containing the input text
@@ -209,14 +226,19 @@ end
 --- <strong>Note:</strong>  Be very careful if you replace the text; this has
 --- the potential to interfere with or even ruin the user's ability to enter
 --- command lines for CMD to process.
-function clink.onfilterinput(func)
-    _add_event_callback("onfilterinput", func)
+---
+--- Starting in v1.6.17, the optional <span class="arg">priority</span> controls
+--- the order in which the handlers are called; lower numbers are called first,
+--- and the default is 999.
+function clink.onfilterinput(func, priority)
+    _add_event_callback("onfilterinput", func, priority)
 end
 
 --------------------------------------------------------------------------------
 --- -name:  clink.onhistory
 --- -ver:   1.5.13
 --- -arg:   func:function
+--- -arg:   [priority:integer]
 --- Registers <span class="arg">func</span> to be called when an input line has
 --- been accepted and is about to be added to history.  The function receives a
 --- string argument containing the input text from the edit prompt.  The
@@ -226,14 +248,19 @@ end
 --- <strong>Note:</strong>  The onhistory handler functions are not called by
 --- <code><a href="#rlcmd-add-history">add-history</a></code> or the
 --- <code>clink history</code> command.
-function clink.onhistory(func)
-    _add_event_callback("onhistory", func)
+---
+--- Starting in v1.6.17, the optional <span class="arg">priority</span> controls
+--- the order in which the handlers are called; lower numbers are called first,
+--- and the default is 999.
+function clink.onhistory(func, priority)
+    _add_event_callback("onhistory", func, priority)
 end
 
 --------------------------------------------------------------------------------
 --- -name:  clink.oncommand
 --- -ver:   1.3.12
 --- -arg:   func:function
+--- -arg:   [priority:integer]
 --- Registers <span class="arg">func</span> to be called when the command word
 --- changes in the edit line.
 ---
@@ -247,8 +274,12 @@ end
 --- -show:  }
 ---
 --- The function has no return values.
-function clink.oncommand(func)
-    _add_event_callback("oncommand", func)
+---
+--- Starting in v1.6.17, the optional <span class="arg">priority</span> controls
+--- the order in which the handlers are called; lower numbers are called first,
+--- and the default is 999.
+function clink.oncommand(func, priority)
+    _add_event_callback("oncommand", func, priority)
 end
 
 --------------------------------------------------------------------------------
@@ -289,14 +320,59 @@ function clink.ondisplaymatches(func)
 end
 
 --------------------------------------------------------------------------------
+--- -name:  clink.ondisplaymatchlist
+--- -ver:   1.6.17
+--- -arg:   func:function
+--- Registers <span class="arg">func</span> to be called when Clink is about to
+--- display matches, the same as
+--- <a href="#clink.ondisplaymatches">clink.ondisplaymatches()</a> except that
+--- <span class="arg">func</span> receives a <a href="#match_list">match_list</a>
+--- instead of a table of tables.
+---
+--- The function can remove or reorder matches in the list and return nothing.
+--- Making a table for each match is slow when there are many matches, so this
+--- is faster when the function only needs to look at some of the matches or
+--- some of their fields.  If the function needs to add matches or change how
+--- they're displayed, it can instead return a table of matches, the same as an
+--- <a href="#clink.ondisplaymatches">clink.ondisplaymatches()</a> function.
+--- -show:  local function my_filter(list, popup)
+--- -show:  &nbsp;   -- Ignore matches with one or more digits.
+--- -show:  &nbsp;   for i = list:getcount(), 1, -1 do
+--- -show:  &nbsp;       if list:getmatch(i):find("[0-9]") then
+--- -show:  &nbsp;           list:remove(i)
+--- -show:  &nbsp;       end
+--- -show:  &nbsp;   end
+--- -show:  end
+--- -show:
+--- -show:  function my_match_generator:generate(line_state, match_builder)
+--- -show:  &nbsp;   ...
+--- -show:  &nbsp;   clink.ondisplaymatchlist(my_filter)
+--- -show:  end
+function clink.ondisplaymatchlist(func)
+    -- Shares the single ondisplaymatches handler; see clink.ondisplaymatches().
+    clink._event_callbacks["ondisplaymatches"] = {}
+    _add_event_callback("ondisplaymatches", func, nil, true)
+end
+
+--------------------------------------------------------------------------------
+-- The matches arrive as a match_list, and are converted to a table only when
+-- the handler wants a table.  Returning the match_list tells lua_match_generator
+-- to use the matches in the list, without reading them back from Lua.
 function clink._send_ondisplaymatches_event(matches, popup)
     local callbacks = clink._event_callbacks["ondisplaymatches"]
     if callbacks ~= nil then
         local c = callbacks[1]
         if c and c.func then
+            local list = c.uselist and matches
+            if not list then
+                matches = matches:totable()
+            end
             local tick = os.clock()
             local ret = c.func(matches, popup)
             log_cost(tick, c)
+            if ret == nil then
+                ret = list or nil
+            end
             return ret
         end
     end
@@ -307,17 +383,55 @@ end
 --- -name:  clink.onfiltermatches
 --- -ver:   1.1.41
 --- -arg:   func:function
+--- -arg:   [priority:integer]
 --- Registers <span class="arg">func</span> to be called after Clink generates
 --- matches for completion.  See <a href="#filteringmatchcompletions">
 --- Filtering Match Completions</a> for more information.
-function clink.onfiltermatches(func)
-    _add_event_callback("onfiltermatches", func)
+---
+--- Starting in v1.6.17, the optional <span class="arg">priority</span> controls
+--- the order in which the handlers are called; lower numbers are called first,
+--- and the default is 999.
+function clink.onfiltermatches(func, priority)
+    _add_event_callback("onfiltermatches", func, priority)
+end
+
+--------------------------------------------------------------------------------
+--- -name:  clink.onfiltermatchlist
+--- -ver:   1.6.17
+--- -arg:   func:function
+--- -arg:   [priority:integer]
+--- Registers <span class="arg">func</span> to be called after Clink generates
+--- matches for completion, the same as
+--- <a href="#clink.onfiltermatches">clink.onfiltermatches()</a> except that
+--- <span class="arg">func</span> receives a <a href="#match_list">match_list</a>
+--- instead of a table of tables.
+---
+--- The function removes matches from the list to filter them, and returns
+--- nothing.  Making a table for each match is slow when there are many
+--- matches, so this is faster when the function only needs to look at some of
+--- the matches or some of their fields.
+---
+--- The optional <span class="arg">priority</span> controls the order in which
+--- the handlers are called, together with handlers registered by
+--- <a href="#clink.onfiltermatches">clink.onfiltermatches()</a>; lower numbers
+--- are called first, and the default is 999.
+--- -show:  clink.onfiltermatchlist(function(list, completion_type, filename_completion_desired)
+--- -show:  &nbsp;   -- Remove backup files.
+--- -show:  &nbsp;   for i = list:getcount(), 1, -1 do
+--- -show:  &nbsp;       if list:getmatch(i):find("~$") then
+--- -show:  &nbsp;           list:remove(i)
+--- -show:  &nbsp;       end
+--- -show:  &nbsp;   end
+--- -show:  end)
+function clink.onfiltermatchlist(func, priority)
+    _add_event_callback("onfiltermatches", func, priority, true)
 end
 
 --------------------------------------------------------------------------------
 --- -name:  clink.oninputlinechanged
 --- -ver:   1.4.18
 --- -arg:   func:function
+--- -arg:   [priority:integer]
 --- Registers <span class="arg">func</span> to be called after an editing
 --- command (key binding) makes changes in the input line.
 ---
@@ -356,31 +470,55 @@ end
 --- -show:  function clink.oninputlinechanged(func)
 --- -show:  &nbsp;   _add_event_callback("oninputlinechanged", func)
 --- -show:  end
-function clink.oninputlinechanged(func)
-    _add_event_callback("oninputlinechanged", func)
+---
+--- Starting in v1.6.17, the optional <span class="arg">priority</span> controls
+--- the order in which the handlers are called; lower numbers are called first,
+--- and the default is 999.
+function clink.oninputlinechanged(func, priority)
+    _add_event_callback("oninputlinechanged", func, priority)
 end
 
 --------------------------------------------------------------------------------
 --- -name:  clink.onaftercommand
 --- -ver:   1.2.50
 --- -arg:   func:function
+--- -arg:   [priority:integer]
 --- Registers <span class="arg">func</span> to be called after every editing
 --- command (key binding).
-function clink.onaftercommand(func)
-    _add_event_callback("onaftercommand", func)
+---
+--- Starting in v1.6.17, the optional <span class="arg">priority</span> controls
+--- the order in which the handlers are called; lower numbers are called first,
+--- and the default is 999.
+function clink.onaftercommand(func, priority)
+    _add_event_callback("onaftercommand", func, priority)
 end
 
 --------------------------------------------------------------------------------
-function clink._send_onfiltermatches_event(matches, completion_type, filename_completion_desired)
+-- The matches arrive as a match_list.  A table is made from it only when a
+-- handler wants a table, and the results from a handler that returns a table
+-- are applied to the list before passing it to a handler that wants a list.
+-- Returning the match_list tells lua_match_generator to keep the matches in
+-- the list, without reading them back from Lua.
+function clink._send_onfiltermatches_event(list, completion_type, filename_completion_desired)
     local ret = nil
+    local matches = list
     local callbacks = clink._event_callbacks["onfiltermatches"]
     if callbacks ~= nil then
         for _, c in ipairs(callbacks) do
             if c and c.func then
+                if c.uselist then
+                    if matches ~= list then
+                        list:_keeponly(matches)
+                        matches = list
+                    end
+                    ret = list
+                elseif matches == list then
+                    matches = list:totable()
+                end
                 local tick = os.clock()
                 local m = c.func(matches, completion_type, filename_completion_desired)
                 log_cost(tick, c)
-                if m ~= nil then
+                if m ~= nil and not c.uselist then
                     matches = m
                     ret = matches
                 end
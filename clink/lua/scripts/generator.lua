@@ -92,7 +92,17 @@ function file_match_generator:generate(line_state, match_builder) -- luacheck: n
     if root == "~" then
         root = path.join(root, "")
     end
+    -- Plain file matches depend only on the word and the directory contents,
+    -- so they can be reused until the directory changes.  That's only true
+    -- when no other generator contributed matches or a display filter.
+    local cacheable = match_builder:isempty() and
+                      not clink.match_display_filter and
+                      not clink._event_callbacks["onfiltermatches"] and
+                      not clink._event_callbacks["ondisplaymatches"]
     match_builder:addmatches(clink.filematches(root))
+    if cacheable then
+        match_builder:setcacheable()
+    end
     return true
 end
 
@@ -136,9 +146,17 @@ end
 
 --------------------------------------------------------------------------------
 function clink._make_match_generate_coroutine(line, lines, matches, builder, generation_id) -- luacheck: no unused
-    -- Bail if there's already a match generator coroutine running.
+    -- Bail if there's already a match generator coroutine running for this
+    -- generation.  A coroutine for an older generation is canceled, since the
+    -- line editor discards matches from older generations anyway.
     if _match_generate_state.coroutine then
-        return
+        if _match_generate_state.generation_id == generation_id then
+            return
+        end
+        cancel_match_generate_coroutine()
+        if _match_generate_state.coroutine then
+            return
+        end
     end
 
     -- Create coroutine to generate matches.  The coroutine is automatically
@@ -178,6 +196,7 @@ function clink._make_match_generate_coroutine(line, lines, matches, builder, gen
 
     clink.setcoroutinename(c, "generate matches")
     _match_generate_state.coroutine = c
+    _match_generate_state.generation_id = generation_id
     _match_generate_state.started = nil
 end
 
@@ -217,6 +236,22 @@ function clink._reset_display_filter()
     clink._event_callbacks["ondisplaymatches"] = nil
 end
 
+--------------------------------------------------------------------------------
+-- Functions that provide descriptions for matches, by match.  See
+-- builder:addmatch().
+clink._lazy_descriptions = {}
+
+--------------------------------------------------------------------------------
+function clink._get_lazy_description(match)
+    local func = clink._lazy_descriptions[match]
+    if func then
+        local description = func(match)
+        if type(description) == "string" then
+            return description
+        end
+    end
+end
+
 --------------------------------------------------------------------------------
 function clink._in_generate()
     return clink.co_state._current_builder and true
@@ -242,6 +277,15 @@ function clink._generate(line_state, line_states, match_builder, old_filtering)
                 clink.generator_stopped = generator.generate
                 return true
             end
+            -- Stop when the caller only wanted the first few matches.
+            if match_builder:isfull() then
+                return true
+            end
+            -- Only one generator's matches can be cached; the others may
+            -- depend on more than the file system.
+            if not match_builder:isempty() then
+                match_builder:disable_cache()
+            end
         end
 
         if file_match_generator:generate(line_state, match_builder) then
@@ -252,6 +296,7 @@ function clink._generate(line_state, line_states, match_builder, old_filtering)
     end
 
     clink._reset_display_filter()
+    clink._lazy_descriptions = {}
     clink.co_state.use_old_filtering = old_filtering
     clink.co_state.argmatcher_line_states = line_states
 
@@ -339,6 +384,11 @@ function clink.generator(priority)
     local ret = { _priority = priority }
     table.insert(_generators, ret)
 
+    -- Cached matches didn't come from the new generator.
+    if clink._reset_generate_matches then
+        clink._reset_generate_matches()
+    end
+
     _generators_unsorted = true
     return ret
 end
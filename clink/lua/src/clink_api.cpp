@@ -3,9 +3,11 @@
 
 #include "pch.h"
 #include "lua_state.h"
+#include "lua_profiler.h"
 #include "lua_input_idle.h"
 #include "line_state_lua.h"
 #include "line_states_lua.h"
+#include "lua_word_classifier.h"
 #include "prompt.h"
 #include "async_lua_task.h"
 #include "command_link_dialog.h"
@@ -18,21 +20,29 @@
 #include <core/base.h>
 #include <core/os.h>
 #include <core/str_compare.h>
+#include <core/str_hash.h>
 #include <core/str_transform.h>
+#include <core/str_tokeniser.h>
 #include <core/str_unordered_set.h>
 #include <core/settings.h>
-#include <core/linear_allocator.h>
+#include <core/globber.h>
+#include <core/path.h>
 #include <core/callstack.h>
 #include <core/debugheap.h>
 #include <lib/popup.h>
 #include <lib/cmd_tokenisers.h>
+#include <lib/history_command_index.h>
+#include <lib/history_db.h>
+#include <lib/history_prefix_index.h>
 #include <lib/reclassify.h>
+#include <lib/deferred_init.h>
 #include <lib/recognizer.h>
 #include <lib/matches_lookaside.h>
 #include <lib/line_editor_integration.h>
 #include <lib/rl_integration.h>
 #include <lib/suggestions.h>
 #include <lib/slash_translation.h>
+#include <lib/shared_table.h>
 #include <terminal/terminal_helpers.h>
 #include <terminal/printer.h>
 #include <terminal/screen_buffer.h>
@@ -46,6 +56,8 @@ extern "C" {
 
 #include <share.h>
 #include <mutex>
+#include <algorithm>
+#include <list>
 
 
 
@@ -58,6 +70,10 @@ void set_test_harness() { s_test_harness = true; }
 //------------------------------------------------------------------------------
 extern setting_enum g_dupe_mode;
 extern setting_bool g_lua_breakonerror;
+extern setting_enum g_ignore_case;
+extern setting_bool g_fuzzy_accent;
+extern setting_bool g_autosuggest_enable;
+extern setting_str g_autosuggest_strategy;
 
 #ifdef _WIN64
 static const char c_uninstall_key[] = "SOFTWARE\\WOW6432Node\\Microsoft\\Windows\\CurrentVersion\\Uninstall";
@@ -356,6 +372,11 @@ static int32 clink_print(lua_State* state)
     {
         if (nl)
             out.concat("\n");
+
+        // Inside a callback, hold the output until the callback returns or
+        // something else needs the console (see lua_state::pcall_silent).
+        if (lua_state::is_in_pcall())
+            g_printer->hold_output();
         g_printer->print(out.c_str(), out.length());
     }
     else
@@ -1361,64 +1382,251 @@ static int32 is_transient_prompt_filter(lua_State* state)
 }
 
 //------------------------------------------------------------------------------
-// UNDOCUMENTED; internal use only.
-static int32 history_suggester(lua_State* state)
+static history_prefix_index s_history_prefix_index;
+
+//------------------------------------------------------------------------------
+// 'match_prev_cmd' suggestions for an empty line and for lines of a single
+// ASCII character, prefetched while idle at the start of an edit session so
+// the suggestion for the first keystroke is ready immediately.
+struct history_prefetch
 {
-    const char* line = checkstring(state, 1);
-    const int32 match_prev_cmd = lua_toboolean(state, 2);
-    if (!line)
-        return 0;
+    static const uint32 c_max_chars = 16;
+
+    bool                lookup(const char* line, int32& out) const;
+
+    const HIST_ENTRY*   first = nullptr;
+    const HIST_ENTRY*   last = nullptr;
+    const char*         last_line = nullptr;
+    int32               length = -1;
+    int32               mode = -1;
+    bool                fuzzy_accents = false;
+    bool                complete = false;   // Every first character was found.
+    int32               empty = -1;         // Suggestion for an empty line.
+    uint32              count = 0;
+    char                chars[c_max_chars];
+    int32               found[c_max_chars];
+};
+static history_prefetch s_history_prefetch;
+
+//------------------------------------------------------------------------------
+static char fold_prefetch_char(char c, bool caseless)
+{
+    return caseless ? ascii_tolower(c) : c;
+}
+
+//------------------------------------------------------------------------------
+// Returns false if LINE isn't covered by the prefetched suggestions, or if the
+// history or comparison mode has changed since they were prefetched.
+bool history_prefetch::lookup(const char* line, int32& out) const
+{
+    if (length != history_length || !length)
+        return false;
 
     HIST_ENTRY** history = history_list();
-    if (!history || history_length <= 0)
-        return 0;
+    if (!history || history[0] != first || history[length - 1] != last || last->line != last_line)
+        return false;
 
-    // 'match_prev_cmd' only works when 'history.dupe_mode' is 'add'.
-    if (match_prev_cmd && g_dupe_mode.get() != 0)
-        return 0;
+    if (mode != str_compare_scope::current() || fuzzy_accents != str_compare_scope::current_fuzzy_accents())
+        return false;
 
-    int32 scanned = 0;
-    const DWORD tick = GetTickCount();
+    if (!*line)
+    {
+        out = empty;
+        return true;
+    }
 
-    const int32 scan_min = 200;
-    const DWORD ms_max = 50;
+    if ((line[0] & 0x80) || line[1])
+        return false;
 
-    const char* prev_cmd = (match_prev_cmd && history_length > 0) ? history[history_length - 1]->line : nullptr;
-    for (int32 i = history_length; --i >= 0;)
+    const char c = fold_prefetch_char(line[0], mode == str_compare_scope::caseless);
+    for (uint32 i = 0; i < count; ++i)
     {
-        // Search at least SCAN_MIN entries.  But after that don't keep going
-        // unless it's been less than MS_MAX milliseconds.
-        if (scanned >= scan_min && !(scanned % 20) && GetTickCount() - tick >= ms_max)
-            break;
-        scanned++;
+        if (chars[i] == c)
+        {
+            out = found[i];
+            return true;
+        }
+    }
+
+    if (!complete)
+        return false;
+
+    out = -1;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Called while idle.  A single pass over the history, newest first, finds the
+// commands that followed the previous command, and keeps the newest one for an
+// empty line and for each of the first c_max_chars distinct first characters.
+void prefetch_history_suggestions()
+{
+    if (!g_autosuggest_enable.get() || g_dupe_mode.get() != 0)
+        return;
+
+    HIST_ENTRY** history = history_list();
+    if (!history || history_length <= 1)
+        return;
 
-        str_iter lhs(line);
-        str_iter rhs(history[i]->line);
-        int32 matchlen = str_compare<char, false/*compute_lcd*/, true/*exact_slash*/>(lhs, rhs);
+    bool match_prev_cmd = false;
+    {
+        str<32> name;
+        str_tokeniser tokens(g_autosuggest_strategy.get(), " ");
+        while (!match_prev_cmd && tokens.next(name))
+            match_prev_cmd = name.equals("match_prev_cmd");
+    }
+    if (!match_prev_cmd)
+        return;
+
+    // Use the same comparison mode as suggester::suggest().
+    int32 scope = g_ignore_case.get() ? str_compare_scope::caseless : str_compare_scope::exact;
+    str_compare_scope compare(scope, g_fuzzy_accent.get());
+
+    history_prefetch& p = s_history_prefetch;
+    const HIST_ENTRY* last = history[history_length - 1];
+    if (p.length == history_length && p.first == history[0] && p.last == last && p.last_line == last->line &&
+        p.mode == str_compare_scope::current() &&
+        p.fuzzy_accents == str_compare_scope::current_fuzzy_accents())
+        return;
 
-        // lhs isn't exhausted, or rhs is exhausted?  Continue searching.
-        if (lhs.more() || !rhs.more())
+    p = history_prefetch();
+
+    const bool caseless = (str_compare_scope::current() == str_compare_scope::caseless);
+    const char* prev_cmd = last->line;
+    int32 i;
+    for (i = history_length - 1; i > 0 && p.count < history_prefetch::c_max_chars; --i)
+    {
+        const char* line = history[i]->line;
+        if (!*line)
             continue;
+        if (str_compare<char, false/*compute_lcd*/, true/*exact_slash*/>(prev_cmd, history[i - 1]->line) != -1)
+            continue;
+
+        if (p.empty < 0)
+            p.empty = i;
 
-        // Zero matching length?  Is ok with 'match_prev_cmd', otherwise
-        // continue searching.
-        if (!matchlen && !match_prev_cmd)
+        // A suggestion must be longer than what was typed.
+        if ((line[0] & 0x80) || !line[1])
             continue;
 
+        const char c = fold_prefetch_char(line[0], caseless);
+        if (!memchr(p.chars, c, p.count))
+        {
+            p.chars[p.count] = c;
+            p.found[p.count] = i;
+            ++p.count;
+        }
+    }
+
+    p.complete = (i <= 0);
+    p.first = history[0];
+    p.last = last;
+    p.last_line = last->line;
+    p.length = history_length;
+    p.mode = str_compare_scope::current();
+    p.fuzzy_accents = str_compare_scope::current_fuzzy_accents();
+}
+
+//------------------------------------------------------------------------------
+// Returns the history entry to suggest for LINE, or nullptr.  This implements
+// both the 'history' and 'match_prev_cmd' suggestion strategies.
+const char* find_history_suggestion(const char* line, bool match_prev_cmd)
+{
+    ensure_deferred_init(deferred_init_task::history);
+
+    HIST_ENTRY** history = history_list();
+    if (!history || history_length <= 0)
+        return nullptr;
+
+    // 'match_prev_cmd' only works when 'history.dupe_mode' is 'add'.
+    if (match_prev_cmd && g_dupe_mode.get() != 0)
+        return nullptr;
+
+    // Zero matching length is only ok with 'match_prev_cmd'.
+    if (!*line && !match_prev_cmd)
+        return nullptr;
+
+    if (match_prev_cmd)
+    {
+        int32 prefetched;
+        if (s_history_prefetch.lookup(line, prefetched))
+            return (prefetched < 0) ? nullptr : history[prefetched]->line;
+    }
+
+    // The prefix index yields every history entry that begins with the line,
+    // newest first, so the search is exhaustive regardless of history size.
+    int32 found = -1;
+    const char* prev_cmd = match_prev_cmd ? history[history_length - 1]->line : nullptr;
+    s_history_prefix_index.find(line, [&] (int32 i) {
         // Match previous command, if needed.
         if (match_prev_cmd)
         {
             if (i <= 0 || str_compare<char, false/*compute_lcd*/, true/*exact_slash*/>(prev_cmd, history[i - 1]->line) != -1)
-                continue;
+                return true;
         }
 
-        // Suggest this history entry.
-        lua_pushstring(state, history[i]->line);
-        lua_pushinteger(state, 1);
-        return 2;
+        found = i;
+        return false;
+    });
+
+    return (found < 0) ? nullptr : history[found]->line;
+}
+
+//------------------------------------------------------------------------------
+// Returns the history entry to suggest for LINE, or nullptr.  This implements
+// the 'cwd_history' suggestion strategy, which only considers history entries
+// that were entered in the current directory.
+const char* find_cwd_history_suggestion(const char* line)
+{
+    ensure_deferred_init(deferred_init_task::history);
+
+    if (!*line)
+        return nullptr;
+
+    HIST_ENTRY** history = history_list();
+    history_database* db = history_database::get();
+    if (!history || history_length <= 0 || !db)
+        return nullptr;
+
+    str<> cwd;
+    os::get_current_dir(cwd);
+    const std::vector<int32>* entries = db->find_dir_entries(cwd.c_str());
+    if (!entries)
+        return nullptr;
+
+    // Only the entries from the current directory are compared, newest first.
+    const int32 line_len = int32(strlen(line));
+    for (auto iter = entries->rbegin(); iter != entries->rend(); ++iter)
+    {
+        if (*iter >= history_length)
+            continue;
+
+        const char* entry = history[*iter]->line;
+        if (str_compare<char, false/*compute_lcd*/, true/*exact_slash*/>(line, entry) == line_len)
+            return entry;
     }
 
-    return 0;
+    return nullptr;
+}
+
+//------------------------------------------------------------------------------
+// UNDOCUMENTED; internal use only.
+static int32 history_suggester(lua_State* state)
+{
+    const char* line = checkstring(state, 1);
+    const int32 match_prev_cmd = lua_toboolean(state, 2);
+    const bool cwd = !!lua_toboolean(state, 3);
+    if (!line)
+        return 0;
+
+    const char* suggestion = cwd ? find_cwd_history_suggestion(line) : find_history_suggestion(line, !!match_prev_cmd);
+    if (!suggestion)
+        return 0;
+
+    // Suggest this history entry.
+    lua_pushstring(state, suggestion);
+    lua_pushinteger(state, 1);
+    return 2;
 }
 
 //------------------------------------------------------------------------------
@@ -1485,32 +1693,143 @@ static int32 recognize_command(lua_State* state)
 }
 
 //------------------------------------------------------------------------------
-static str_unordered_map<int32> s_cached_path_type;
-static linear_allocator s_cached_path_store(2048);
-static std::recursive_mutex s_cached_path_type_mutex;
+// Path types found by async path type queries.  The cache is bounded and
+// least recently used entries are dropped first.  It survives across input
+// lines, and entries expire after a while so that creating or deleting a path
+// is eventually noticed.
+//
+// Entries are also shared with other sessions (see shared_table), since full
+// paths mean the same thing in every session.  Shared entries expire the same
+// way; GetTickCount64 is the same for all processes.
+class path_type_cache
+{
+    struct entry
+    {
+        str_moveable    path;
+        int32           type;
+        ULONGLONG       tick;
+    };
+
+    struct shared_value
+    {
+        ULONGLONG       tick;
+        int32           type;
+    };
+
+public:
+                        path_type_cache() : m_shared(MAX_PATH, sizeof(shared_value), 1024) {}
+    void                clear();
+    void                add(const char* full, int32 type, ULONGLONG tick=0);
+    bool                get(const char* full, int32& type);
+
+private:
+    bool                get_shared(const char* full, int32& type);
+    std::list<entry>    m_list;             // Most recently used first.
+    str_unordered_map<std::list<entry>::iterator> m_map;
+    std::recursive_mutex m_mutex;
+    shared_table        m_shared;
+
+    static const size_t c_max_entries = 1024;
+    static const ULONGLONG c_max_age = 30 * 1000;
+};
+
+//------------------------------------------------------------------------------
+void path_type_cache::clear()
+{
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    m_map.clear();
+    m_list.clear();
+}
+
+//------------------------------------------------------------------------------
+void path_type_cache::add(const char* full, int32 type, ULONGLONG tick)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    dbg_ignore_scope(snapshot, "add_cached_path_type");
+
+    // A tick means the entry came from the shared table; otherwise share it.
+    if (!tick)
+    {
+        tick = GetTickCount64();
+        if (m_shared.open(L"Local\\clink_path_types"))
+        {
+            const shared_value value = { tick, type };
+            m_shared.store(full, &value, sizeof(value));
+        }
+    }
+
+    const auto iter = m_map.find(full);
+    if (iter != m_map.end())
+    {
+        m_list.splice(m_list.begin(), m_list, iter->second);
+        iter->second->type = type;
+        iter->second->tick = tick;
+        return;
+    }
+
+    if (m_list.size() >= c_max_entries)
+    {
+        m_map.erase(m_list.back().path.c_str());
+        m_list.pop_back();
+    }
+
+    m_list.emplace_front();
+    entry& e = m_list.front();
+    e.path = full;
+    e.type = type;
+    e.tick = tick;
+    m_map.emplace(e.path.c_str(), m_list.begin());
+}
+
+//------------------------------------------------------------------------------
+bool path_type_cache::get(const char* full, int32& type)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+    const auto iter = m_map.find(full);
+    if (iter == m_map.end())
+        return get_shared(full, type);
+
+    if (GetTickCount64() - iter->second->tick > c_max_age)
+    {
+        m_list.erase(iter->second);
+        m_map.erase(iter);
+        return get_shared(full, type);
+    }
+
+    m_list.splice(m_list.begin(), m_list, iter->second);
+    type = iter->second->type;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool path_type_cache::get_shared(const char* full, int32& type)
+{
+    if (!m_shared.open(L"Local\\clink_path_types"))
+        return false;
+
+    shared_value value;
+    if (!m_shared.find(full, &value) || GetTickCount64() - value.tick > c_max_age)
+        return false;
+
+    add(full, value.type, value.tick);
+    type = value.type;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+static path_type_cache s_cached_path_type;
 void clear_path_type_cache()
 {
-    std::lock_guard<std::recursive_mutex> lock(s_cached_path_type_mutex);
     s_cached_path_type.clear();
-    s_cached_path_store.clear();
 }
 void add_cached_path_type(const char* full, int32 type)
 {
-    std::lock_guard<std::recursive_mutex> lock(s_cached_path_type_mutex);
-    dbg_ignore_scope(snapshot, "add_cached_path_type");
-    uint32 size = uint32(strlen(full) + 1);
-    char* key = static_cast<char*>(s_cached_path_store.alloc(size));
-    memcpy(key, full, size);
-    s_cached_path_type.emplace(key, type);
+    s_cached_path_type.add(full, type);
 }
 bool get_cached_path_type(const char* full, int32& type)
 {
-    std::lock_guard<std::recursive_mutex> lock(s_cached_path_type_mutex);
-    const auto& iter = s_cached_path_type.find(full);
-    if (iter == s_cached_path_type.end())
-        return false;
-    type = iter->second;
-    return true;
+    return s_cached_path_type.get(full, type);
 }
 
 //------------------------------------------------------------------------------
@@ -1599,6 +1918,186 @@ static int32 async_path_type(lua_State* state)
     return 1;
 }
 
+//------------------------------------------------------------------------------
+// Resolves the types of many paths on one worker thread.  When several paths
+// are in the same directory, one listing of the directory answers all of
+// them; paths not found in the listing are checked individually, which also
+// covers short names and case differences the listing comparison misses.
+class path_types_async_lua_task : public async_lua_task
+{
+public:
+    path_types_async_lua_task(const char* key, const char* src, std::vector<str_moveable>&& paths)
+    : async_lua_task(key, src)
+    , m_paths(std::move(paths))
+    {}
+
+protected:
+    void do_work() override;
+
+private:
+    std::vector<str_moveable> m_paths;
+
+    static const size_t c_min_group = 3;
+};
+
+//------------------------------------------------------------------------------
+void path_types_async_lua_task::do_work()
+{
+    const size_t count = m_paths.size();
+
+    std::vector<str_moveable> parents(count);
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const char* name = path::get_name(m_paths[i].c_str());
+        if (name && *name && !strpbrk(name, "*?"))
+            path::get_directory(m_paths[i].c_str(), parents[i]);
+        order[i] = i;
+    }
+
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return _stricmp(parents[a].c_str(), parents[b].c_str()) < 0;
+    });
+
+    std::vector<int32> types(count, os::path_type_invalid);
+    std::vector<bool> found(count, false);
+
+    size_t begin = 0;
+    while (begin < count)
+    {
+        if (is_canceled())
+            return;
+
+        const str_moveable& parent = parents[order[begin]];
+        size_t end = begin + 1;
+        while (end < count && _stricmp(parents[order[end]].c_str(), parent.c_str()) == 0)
+            ++end;
+
+        if (!parent.empty() && end - begin >= c_min_group)
+        {
+            str<280> pattern(parent.c_str());
+            path::append(pattern, "*");
+
+            globber globber(pattern.c_str());
+            globber.hidden(true);
+            globber.system(true);
+            globber.suffix_dirs(false);
+
+            str<280> file;
+            globber::extrainfo info;
+            while (!is_canceled() && globber.next(file, false, &info))
+            {
+                for (size_t k = begin; k < end; ++k)
+                {
+                    const size_t i = order[k];
+                    if (!found[i] && _stricmp(path::get_name(m_paths[i].c_str()), file.c_str()) == 0)
+                    {
+                        types[i] = (info.attr & FILE_ATTRIBUTE_DIRECTORY) ? os::path_type_dir : os::path_type_file;
+                        found[i] = true;
+                    }
+                }
+            }
+        }
+
+        for (size_t k = begin; k < end; ++k)
+        {
+            const size_t i = order[k];
+            if (!found[i])
+                types[i] = os::get_path_type(m_paths[i].c_str());
+            add_cached_path_type(m_paths[i].c_str(), types[i]);
+        }
+
+        begin = end;
+    }
+}
+
+//------------------------------------------------------------------------------
+// UNDOCUMENTED; internal use only.
+// Takes a table of paths and returns a table with "file", "dir", or false at
+// the same indices (or nil where the type isn't known yet), and whether all of
+// the types are known.  Unknown types are resolved together on one worker
+// thread, which invokes the optional callback when done.
+static int32 async_path_types(lua_State* state)
+{
+    if (!lua_istable(state, 1))
+        return 0;
+    int32 timeout = optinteger(state, 2, 0);
+
+    const int32 num = int32(lua_rawlen(state, 1));
+    std::vector<str_moveable> fulls(num);
+    std::vector<str_moveable> pending;
+    str<> joined;
+    for (int32 i = 0; i < num; ++i)
+    {
+        lua_rawgeti(state, 1, i + 1);
+        const char* path = lua_tostring(state, -1);
+        if (path && *path)
+            os::get_full_path_name(path, fulls[i]);
+        lua_pop(state, 1);
+
+        int32 type;
+        if (!fulls[i].empty() && !get_cached_path_type(fulls[i].c_str(), type))
+        {
+            pending.emplace_back(fulls[i].c_str());
+            joined << fulls[i] << "\n";
+        }
+    }
+
+    if (!pending.empty())
+    {
+        str_moveable key;
+        key.format("async_types||%08x||%u", str_hash(joined.c_str(), joined.length()), uint32(pending.size()));
+        std::shared_ptr<async_lua_task> task = find_async_lua_task(key.c_str());
+        if (!task)
+        {
+            str<> src;
+            get_lua_srcinfo(state, src);
+
+            task = std::make_shared<path_types_async_lua_task>(key.c_str(), src.c_str(), std::move(pending));
+            if (task && lua_isfunction(state, 3))
+            {
+                dbg_ignore_scope(snapshot, "async path types");
+                lua_pushvalue(state, 3);
+                int32 ref = luaL_ref(state, LUA_REGISTRYINDEX);
+                task->set_callback(std::make_shared<callback_ref>(ref));
+            }
+
+            add_async_lua_task(task);
+        }
+
+        if (timeout)
+            WaitForSingleObject(task->get_wait_handle(), timeout);
+
+        if (task->is_complete())
+            task->disable_callback();
+    }
+
+    bool ready = true;
+    lua_createtable(state, num, 0);
+    for (int32 i = 0; i < num; ++i)
+    {
+        int32 type;
+        if (fulls[i].empty())
+            type = os::path_type_invalid;
+        else if (!get_cached_path_type(fulls[i].c_str(), type))
+        {
+            ready = false;
+            continue;
+        }
+
+        switch (type)
+        {
+        case os::path_type_file:    lua_pushliteral(state, "file"); break;
+        case os::path_type_dir:     lua_pushliteral(state, "dir"); break;
+        default:                    lua_pushboolean(state, false); break;
+        }
+        lua_rawseti(state, -2, i + 1);
+    }
+
+    lua_pushboolean(state, ready);
+    return 2;
+}
+
 //------------------------------------------------------------------------------
 /// -name:  clink.recognizecommand
 /// -ver:   1.3.38
@@ -1684,14 +2183,26 @@ static int32 api_recognize_command(lua_State* state)
 }
 
 //------------------------------------------------------------------------------
+static history_command_index s_history_command_index;
+
+//------------------------------------------------------------------------------
+// Calls clink._generate_from_historyline() for each command in each history
+// line.  If a filter function is passed, it's called once for each distinct
+// command word in the history (with the word and whether it's quoted), and
+// only lines with a command word the filter accepts are tokenised and passed
+// to Lua.
 static int32 generate_from_history(lua_State* state)
 {
     LUA_ONLYONMAIN(state, "clink._generate_from_history");
 
+    ensure_deferred_init(deferred_init_task::history);
+
     HIST_ENTRY** list = history_list();
     if (!list)
         return 0;
 
+    const bool has_filter = lua_isfunction(state, 1);
+
     cmd_command_tokeniser command_tokeniser;
     cmd_word_tokeniser word_tokeniser;
     word_collector collector(&command_tokeniser, &word_tokeniser);
@@ -1702,42 +2213,73 @@ static int32 generate_from_history(lua_State* state)
     lua_getglobal(state, "clink");
     lua_pushliteral(state, "_generate_from_historyline");
     lua_rawget(state, -2);
+    const int32 func = lua_gettop(state);
 
-    while (*list)
-    {
-        const char* buffer = (*list)->line;
+    // Reused for each history line, so that their capacity is reused instead
+    // of being reallocated for every line.
+    std::vector<word> words;
+    std::vector<command> commands;
+    command_line_states command_line_states;
+
+    auto generate = [&] (const char* buffer) {
         uint32 len = uint32(strlen(buffer));
 
         // Collect one line_state for each command in the line.
-        std::vector<word> words;
-        std::vector<command> commands;
-        command_line_states command_line_states;
         collector.collect_words(buffer, len, len/*cursor*/, words, collect_words_mode::whole_command, &commands);
         command_line_states.set(buffer, len, 0, words, commands);
 
         for (const line_state& line : command_line_states.get_linestates(buffer, len))
         {
             // clink._generate_from_historyline
-            lua_pushvalue(state, -1);
+            lua_pushvalue(state, func);
 
             // line_state
             line_state_lua line_lua(line);
             line_lua.push(state);
 
             if (lua_state::pcall(state, 1, 0) != 0)
-                break;
+                return false;
         }
+        return true;
+    };
 
-        list++;
+    if (!has_filter)
+    {
+        while (*list)
+        {
+            generate((*list)->line);
+            list++;
+        }
+        return 0;
     }
 
+    auto accept = [&] (const char* word, bool quoted) {
+        lua_pushvalue(state, 1);
+        lua_pushstring(state, word);
+        lua_pushboolean(state, quoted);
+        if (lua_state::pcall(state, 2, 1) != 0)
+        {
+            lua_pop(state, 1);
+            return true;
+        }
+        const bool accepted = !!lua_toboolean(state, -1);
+        lua_pop(state, 1);
+        return accepted;
+    };
+
+    s_history_command_index.find(accept, [&] (int32 i) {
+        generate(list[i]->line);
+        return true;
+    });
+
     return 0;
 }
 
 //------------------------------------------------------------------------------
 static int32 api_reset_generate_matches(lua_State* state)
 {
-    reset_generate_matches();
+    if (!lua_state::is_preparing_standby())
+        reset_generate_matches();
     return 0;
 }
 
@@ -1750,6 +2292,30 @@ static int32 mark_deprecated_argmatcher(lua_State* state)
     return 0;
 }
 
+//------------------------------------------------------------------------------
+static int32 reset_native_classify(lua_State* state)
+{
+    if (!lua_state::is_preparing_standby())
+        lua_word_classifier::reset_native_classify();
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+static int32 set_native_classify(lua_State* state)
+{
+    lua_word_classifier::set_native_classify(lua_toboolean(state, 1));
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+static int32 add_argmatcher_name(lua_State* state)
+{
+    const char* name = checkstring(state, 1);
+    if (name)
+        lua_word_classifier::add_argmatcher_name(name);
+    return 0;
+}
+
 //------------------------------------------------------------------------------
 static int32 signal_delayed_init(lua_State* state)
 {
@@ -1833,26 +2399,25 @@ static int32 is_cmd_wordbreak(lua_State* state)
 }
 
 //------------------------------------------------------------------------------
-static int32 save_global_modes(lua_State* state)
+// Returns the current global modes and then switches to the given modes.
+// Coroutines swap the modes on every resume and every yield, so this does both
+// halves in one call, and only writes the modes when they actually differ
+// (which is rare; most coroutines never change them).  When modes is nil, the
+// current modes are only saved.
+static int32 swap_global_modes(lua_State* state)
 {
-    bool new_coroutine = lua_toboolean(state, 1);
-    uint32 modes = lua_state::save_global_states(new_coroutine);
-    lua_pushinteger(state, modes);
-    return 1;
-}
+    const bool new_coroutine = lua_toboolean(state, 2);
+    const uint32 old_modes = lua_state::save_global_states(new_coroutine);
 
-//------------------------------------------------------------------------------
-static int32 restore_global_modes(lua_State* state)
-{
-#ifdef DEBUG
-    const auto modes = checkinteger(state, 1);
-    if (!modes.isnum())
-        return 0;
-#else
-    uint32 modes = optinteger(state, 1, 0);
-#endif
-    lua_state::restore_global_states(modes);
-    return 0;
+    if (!lua_isnoneornil(state, 1))
+    {
+        const auto modes = checkinteger(state, 1);
+        if (modes.isnum() && (new_coroutine || uint32(modes) != old_modes))
+            lua_state::restore_global_states(modes);
+    }
+
+    lua_pushinteger(state, old_modes);
+    return 1;
 }
 
 //------------------------------------------------------------------------------
@@ -2248,6 +2813,88 @@ static int32 run_editor_test(lua_State* state)
 
     return 1;
 }
+
+//------------------------------------------------------------------------------
+// Replays input in the editor and reports how long each keystroke took, so that
+// different versions can be compared on the same workload.  Arg 1 is the input,
+// and arg 2 is an optional table of options:
+//      iterations  How many times to replay the input (default 1).
+//      recorded    True if the input is a session recorded by 'clink echo',
+//                  with each key press on a separate line.
+// Returns a table with count, and total, mean, p50, p95, p99, and max times in
+// milliseconds.  Or returns nil and an error message.
+static int32 run_editor_bench(lua_State* state)
+{
+    const char* input = checkstring(state, 1);
+    if (!input)
+        return 0;
+
+    int32 iterations = 1;
+    bool recorded = false;
+    if (lua_istable(state, 2))
+    {
+        lua_getfield(state, 2, "iterations");
+        if (lua_isnumber(state, -1))
+            iterations = max<int32>(1, int32(lua_tointeger(state, -1)));
+        lua_pop(state, 1);
+
+        lua_getfield(state, 2, "recorded");
+        recorded = lua_toboolean(state, -1);
+        lua_pop(state, 1);
+    }
+
+    str_moveable translated;
+    if (recorded)
+    {
+        lua_editor_tester::translate_recorded_input(input, translated);
+        input = translated.c_str();
+    }
+
+    rollback<printer*> rb_printer(g_printer, nullptr);
+    os::cwd_restorer cwd;
+
+    std::vector<double> latencies;
+    str_moveable message;
+    lua_editor_tester tester(state);
+    tester.set_latencies(&latencies);
+    for (int32 i = 0; i < iterations; ++i)
+    {
+        tester.set_input(input);
+        if (!tester.run(message))
+        {
+            lua_pushnil(state);
+            lua_pushlstring(state, message.c_str(), message.length());
+            return 2;
+        }
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    const size_t count = latencies.size();
+    double total = 0;
+    for (double l : latencies)
+        total += l;
+
+    auto percentile = [&] (uint32 pct) {
+        return count ? latencies[min<size_t>(count - 1, count * pct / 100)] : 0.0;
+    };
+
+    lua_createtable(state, 0, 7);
+    lua_pushinteger(state, lua_Integer(count));
+    lua_setfield(state, -2, "count");
+    lua_pushnumber(state, total * 1000);
+    lua_setfield(state, -2, "total");
+    lua_pushnumber(state, count ? total * 1000 / count : 0.0);
+    lua_setfield(state, -2, "mean");
+    lua_pushnumber(state, percentile(50) * 1000);
+    lua_setfield(state, -2, "p50");
+    lua_pushnumber(state, percentile(95) * 1000);
+    lua_setfield(state, -2, "p95");
+    lua_pushnumber(state, percentile(99) * 1000);
+    lua_setfield(state, -2, "p99");
+    lua_pushnumber(state, count ? latencies[count - 1] * 1000 : 0.0);
+    lua_setfield(state, -2, "max");
+    return 1;
+}
 #endif // CLINK_USE_LUA_EDITOR_TESTER
 
 
@@ -2259,6 +2906,10 @@ extern int32 get_current_dir(lua_State* state);
 extern int32 get_env(lua_State* state);
 extern int32 get_env_names(lua_State* state);
 extern int32 is_dir(lua_State* state);
+extern int32 run_in_worker_internal(lua_State* state);
+extern int32 http_request_internal(lua_State* state);
+extern int32 unzip_internal(lua_State* state);
+extern int32 get_gc_stats(lua_State* state);
 extern int32 explode(lua_State* state);
 
 //------------------------------------------------------------------------------
@@ -2314,16 +2965,23 @@ void clink_lua_initialise(lua_state& lua, bool lua_interpreter)
         { 0,    "set_suggestion_result",  &set_suggestion_result },
         { 0,    "kick_idle",              &kick_idle },
         { 0,    "_recognize_command",     &recognize_command },
+        { 0,    "_run_in_worker",         &run_in_worker_internal },
+        { 0,    "_get_gc_stats",          &get_gc_stats },
+        { 0,    "_get_profile",           &lua_profiler::get_profile },
+        { 0,    "_get_perf",              &lua_profiler::get_perf },
         { 0,    "_async_path_type",       &async_path_type },
+        { 0,    "_async_path_types",      &async_path_types },
         { 0,    "_generate_from_history", &generate_from_history },
         { 0,    "_reset_generate_matches", &api_reset_generate_matches },
         { 0,    "_mark_deprecated_argmatcher", &mark_deprecated_argmatcher },
         { 0,    "_signal_delayed_init",   &signal_delayed_init },
+        { 0,    "_reset_native_classify", &reset_native_classify },
+        { 0,    "_set_native_classify",   &set_native_classify },
+        { 0,    "_add_argmatcher_name",   &add_argmatcher_name },
         { 0,    "_get_cmd_commands",      &get_cmd_commands },
         { 0,    "is_cmd_command",         &is_cmd_command },
         { 0,    "is_cmd_wordbreak",       &is_cmd_wordbreak },
-        { 0,    "_save_global_modes",     &save_global_modes },
-        { 0,    "_restore_global_modes",  &restore_global_modes },
+        { 0,    "_swap_global_modes",     &swap_global_modes },
         { 0,    "_get_installation_type", &get_installation_type },
         { 0,    "_set_install_version",   &set_install_version },
         { 0,    "_expand_prompt_codes",   &expand_prompt_codes },
@@ -2333,6 +2991,8 @@ void clink_lua_initialise(lua_state& lua, bool lua_interpreter)
         { 0,    "_show_update_prompt",    &show_update_prompt },
         { 0,    "_acquire_updater_mutex", &acquire_updater_mutex },
         { 0,    "_release_updater_mutex", &release_updater_mutex },
+        { 0,    "_http_request",          &http_request_internal },
+        { 0,    "_unzip",                 &unzip_internal },
         { 1,    "_is_break_on_error",     &is_break_on_error },
 #if defined(DEBUG) && defined(_MSC_VER)
         { 0,    "last_allocation_number", &last_allocation_number },
@@ -2346,11 +3006,10 @@ void clink_lua_initialise(lua_state& lua, bool lua_interpreter)
 #ifdef CLINK_USE_LUA_EDITOR_TESTER
     static const method_def standalone_methods[] = {
         { 1,    "runeditortest",          &run_editor_test },
+        { 1,    "runeditorbench",         &run_editor_bench },
     };
 #endif
 
-    clear_deprecated_argmatchers();
-
     lua_State* state = lua.get_state();
 
     lua_createtable(state, sizeof_array(methods), 0);
@@ -2377,6 +3036,10 @@ void clink_lua_initialise(lua_state& lua, bool lua_interpreter)
     }
 #endif
 
+    lua_pushliteral(state, "perf");
+    lua_profiler::push_perf_api(state);
+    lua_rawset(state, -3);
+
     lua_pushliteral(state, "version_encoded");
     lua_pushinteger(state, CLINK_VERSION_ENCODED);
     lua_rawset(state, -3);
@@ -31,6 +31,15 @@ static SHORT GetConsoleNumLines(const CONSOLE_SCREEN_BUFFER_INFO& csbi)
     return bottom_Y + 1;
 }
 
+//------------------------------------------------------------------------------
+static BOOL get_screen_buffer_info(HANDLE h, CONSOLE_SCREEN_BUFFER_INFO* csbi)
+{
+    // The render thread may still be writing the input line; let it finish so
+    // the screen buffer reflects what has been output so far.
+    wait_for_console_output();
+    return GetConsoleScreenBufferInfo(h, csbi);
+}
+
 //------------------------------------------------------------------------------
 class input_scope
 {
@@ -204,7 +213,7 @@ static int32 get_width(lua_State* state)
 {
     CONSOLE_SCREEN_BUFFER_INFO csbiInfo;
     HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (!GetConsoleScreenBufferInfo(h, &csbiInfo))
+    if (!get_screen_buffer_info(h, &csbiInfo))
         return 0;
 
     lua_pushinteger(state, csbiInfo.dwSize.X);
@@ -220,7 +229,7 @@ static int32 get_height(lua_State* state)
 {
     CONSOLE_SCREEN_BUFFER_INFO csbiInfo;
     HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (!GetConsoleScreenBufferInfo(h, &csbiInfo))
+    if (!get_screen_buffer_info(h, &csbiInfo))
         return 0;
 
     lua_pushinteger(state, csbiInfo.srWindow.Bottom + 1 - csbiInfo.srWindow.Top);
@@ -236,7 +245,7 @@ static int32 get_num_lines(lua_State* state)
 {
     CONSOLE_SCREEN_BUFFER_INFO csbiInfo;
     HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (!GetConsoleScreenBufferInfo(h, &csbiInfo))
+    if (!get_screen_buffer_info(h, &csbiInfo))
         return 0;
 
     lua_pushinteger(state, GetConsoleNumLines(csbiInfo));
@@ -252,7 +261,7 @@ static int32 get_top(lua_State* state)
 {
     CONSOLE_SCREEN_BUFFER_INFO csbiInfo;
     HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (!GetConsoleScreenBufferInfo(h, &csbiInfo))
+    if (!get_screen_buffer_info(h, &csbiInfo))
         return 0;
 
     lua_pushinteger(state, csbiInfo.srWindow.Top + 1);
@@ -271,7 +280,7 @@ static int32 get_cursor_pos(lua_State* state)
 {
     CONSOLE_SCREEN_BUFFER_INFO csbiInfo;
     HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (!GetConsoleScreenBufferInfo(h, &csbiInfo))
+    if (!get_screen_buffer_info(h, &csbiInfo))
         return 0;
 
     lua_pushinteger(state, csbiInfo.dwCursorPosition.X + 1);
@@ -300,7 +309,7 @@ static int32 get_line_text(lua_State* state)
 
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (!GetConsoleScreenBufferInfo(h, &csbi))
+    if (!get_screen_buffer_info(h, &csbi))
         return 0;
 
     line = min<int32>(line, GetConsoleNumLines(csbi) - 1);
@@ -371,7 +380,7 @@ static int32 is_line_default_color(lua_State* state)
 
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (!GetConsoleScreenBufferInfo(h, &csbi))
+    if (!get_screen_buffer_info(h, &csbi))
         return 0;
 
     line = min<int32>(line, GetConsoleNumLines(csbi) - 1);
@@ -443,7 +452,7 @@ static int32 line_has_color(lua_State* state)
 
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (!GetConsoleScreenBufferInfo(h, &csbi))
+    if (!get_screen_buffer_info(h, &csbi))
         return 0;
 
     line = min<int32>(line, GetConsoleNumLines(csbi) - 1);
@@ -507,7 +516,7 @@ static int32 find_line(lua_State* state, int32 direction)
 
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (!GetConsoleScreenBufferInfo(h, &csbi))
+    if (!get_screen_buffer_info(h, &csbi))
         return 0;
 
     SHORT num_lines = GetConsoleNumLines(csbi);
@@ -0,0 +1,478 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "lua_state.h"
+#include "async_lua_task.h"
+#include "../../app/src/version.h" // Ugh.
+
+#include <core/base.h>
+#include <core/str.h>
+#include <core/debugheap.h>
+#include <core/delay_load.h>
+#include <core/zip.h>
+#include <core/log.h>
+
+#include <winhttp.h>
+
+#include <mutex>
+#include <string>
+
+#ifndef WINHTTP_FLAG_SECURE_PROTOCOL_TLS1_3
+#define WINHTTP_FLAG_SECURE_PROTOCOL_TLS1_3 0x00002000
+#endif
+
+//------------------------------------------------------------------------------
+static union
+{
+    FARPROC proc[11];
+    struct {
+        HINTERNET (WINAPI* WinHttpOpen)(LPCWSTR pszAgentW, DWORD dwAccessType, LPCWSTR pszProxyW, LPCWSTR pszProxyBypassW, DWORD dwFlags);
+        HINTERNET (WINAPI* WinHttpConnect)(HINTERNET hSession, LPCWSTR pswzServerName, INTERNET_PORT nServerPort, DWORD dwReserved);
+        HINTERNET (WINAPI* WinHttpOpenRequest)(HINTERNET hConnect, LPCWSTR pwszVerb, LPCWSTR pwszObjectName, LPCWSTR pwszVersion, LPCWSTR pwszReferrer, LPCWSTR* ppwszAcceptTypes, DWORD dwFlags);
+        BOOL (WINAPI* WinHttpSendRequest)(HINTERNET hRequest, LPCWSTR lpszHeaders, DWORD dwHeadersLength, LPVOID lpOptional, DWORD dwOptionalLength, DWORD dwTotalLength, DWORD_PTR dwContext);
+        BOOL (WINAPI* WinHttpReceiveResponse)(HINTERNET hRequest, LPVOID lpReserved);
+        BOOL (WINAPI* WinHttpQueryHeaders)(HINTERNET hRequest, DWORD dwInfoLevel, LPCWSTR pwszName, LPVOID lpBuffer, LPDWORD lpdwBufferLength, LPDWORD lpdwIndex);
+        BOOL (WINAPI* WinHttpReadData)(HINTERNET hRequest, LPVOID lpBuffer, DWORD dwNumberOfBytesToRead, LPDWORD lpdwNumberOfBytesRead);
+        BOOL (WINAPI* WinHttpCloseHandle)(HINTERNET hInternet);
+        BOOL (WINAPI* WinHttpCrackUrl)(LPCWSTR pwszUrl, DWORD dwUrlLength, DWORD dwFlags, LPURL_COMPONENTS lpUrlComponents);
+        BOOL (WINAPI* WinHttpSetOption)(HINTERNET hInternet, DWORD dwOption, LPVOID lpBuffer, DWORD dwBufferLength);
+        BOOL (WINAPI* WinHttpSetTimeouts)(HINTERNET hInternet, int nResolveTimeout, int nConnectTimeout, int nSendTimeout, int nReceiveTimeout);
+    };
+} s_winhttp;
+
+//------------------------------------------------------------------------------
+static bool delayload_winhttp()
+{
+    HMODULE hlib = delay_load_library("winhttp.dll");
+    if (!hlib)
+        return false;
+
+    s_winhttp.proc[0] = GetProcAddress(hlib, "WinHttpOpen");
+    s_winhttp.proc[1] = GetProcAddress(hlib, "WinHttpConnect");
+    s_winhttp.proc[2] = GetProcAddress(hlib, "WinHttpOpenRequest");
+    s_winhttp.proc[3] = GetProcAddress(hlib, "WinHttpSendRequest");
+    s_winhttp.proc[4] = GetProcAddress(hlib, "WinHttpReceiveResponse");
+    s_winhttp.proc[5] = GetProcAddress(hlib, "WinHttpQueryHeaders");
+    s_winhttp.proc[6] = GetProcAddress(hlib, "WinHttpReadData");
+    s_winhttp.proc[7] = GetProcAddress(hlib, "WinHttpCloseHandle");
+    s_winhttp.proc[8] = GetProcAddress(hlib, "WinHttpCrackUrl");
+    s_winhttp.proc[9] = GetProcAddress(hlib, "WinHttpSetOption");
+    s_winhttp.proc[10] = GetProcAddress(hlib, "WinHttpSetTimeouts");
+    for (auto proc : s_winhttp.proc)
+    {
+        if (!proc)
+            return false;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+struct winhttp_handle
+{
+                            winhttp_handle(HINTERNET h=nullptr) : m_h(h) {}
+                            ~winhttp_handle() { if (m_h) s_winhttp.WinHttpCloseHandle(m_h); }
+                            operator HINTERNET() const { return m_h; }
+    HINTERNET               m_h;
+};
+
+
+
+//------------------------------------------------------------------------------
+// Performs an HTTPS GET request on a worker thread, so that checking for and
+// downloading Clink updates doesn't need to launch PowerShell (which costs
+// more than a second of CPU time) and doesn't block input.  The response body
+// is either kept in memory or written to a file.
+class http_async_lua_task : public async_lua_task
+{
+public:
+    http_async_lua_task(const char* key, const char* src, async_yield_lua* asyncyield, const char* url, const char* file)
+    : async_lua_task(key, src, true/*run_until_complete*/)
+    , m_url(url)
+    , m_file(file ? file : "")
+    {
+        set_asyncyield(asyncyield);
+    }
+
+    bool wait(uint32 timeout)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_done)
+                return true;
+        }
+        const DWORD waited = WaitForSingleObject(get_wait_handle(), timeout);
+        return waited == WAIT_OBJECT_0;
+    }
+
+    void orphan()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_orphaned = true;
+        cancel();
+    }
+
+    void run_now()
+    {
+        do_work();
+    }
+
+    int32 push_results(lua_State* state)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_done)
+        {
+            lua_pushnil(state);
+            lua_pushliteral(state, "request has not finished");
+            return 2;
+        }
+        if (!m_error.empty())
+        {
+            lua_pushnil(state);
+            lua_pushlstring(state, m_error.c_str(), m_error.length());
+            if (!m_status)
+                return 2;
+            lua_pushinteger(state, m_status);
+            return 3;
+        }
+
+        if (m_file.empty())
+            lua_pushlstring(state, m_body.c_str(), m_body.length());
+        else
+            lua_pushboolean(state, true);
+        lua_pushnil(state);
+        lua_pushinteger(state, m_status);
+        return 3;
+    }
+
+protected:
+    void do_work() override;
+
+private:
+    bool request(str_base& error);
+    bool receive(HINTERNET request, str_base& error);
+
+    const str_moveable m_url;
+    const str_moveable m_file;
+    std::string m_body;                 // May contain NUL bytes.
+    str_moveable m_error;
+    uint32 m_status = 0;
+    std::mutex m_mutex;
+    bool m_done = false;
+    bool m_orphaned = false;
+};
+
+//------------------------------------------------------------------------------
+void http_async_lua_task::do_work()
+{
+    str<> error;
+    const bool ok = request(error);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!ok)
+    {
+        LOG("HTTP request for '%s' failed; %s", m_url.c_str(), error.c_str());
+        m_error = error.c_str();
+        m_body.clear();
+    }
+    m_done = true;
+
+    // An orphaned task's asyncyield may already have been garbage collected.
+    if (!m_orphaned)
+        wake_asyncyield();
+}
+
+//------------------------------------------------------------------------------
+bool http_async_lua_task::request(str_base& error)
+{
+    static bool s_has_winhttp = delayload_winhttp();
+    if (!s_has_winhttp)
+    {
+        error = "winhttp.dll is not available";
+        return false;
+    }
+
+    // Crack the url into pointers into wurl.
+    wstr<> wurl(m_url.c_str());
+    URL_COMPONENTS components = { sizeof(components) };
+    components.dwHostNameLength = DWORD(-1);
+    components.dwUrlPathLength = DWORD(-1);
+    components.dwExtraInfoLength = DWORD(-1);
+    if (!s_winhttp.WinHttpCrackUrl(wurl.c_str(), 0, 0, &components) ||
+        components.nScheme != INTERNET_SCHEME_HTTPS ||
+        !components.dwHostNameLength)
+    {
+        error.format("invalid https url '%s'", m_url.c_str());
+        return false;
+    }
+
+    wstr<> host;
+    wstr<> object;
+    host.concat(components.lpszHostName, int32(components.dwHostNameLength));
+    // The path and query are contiguous in the url; include the query.
+    if (components.lpszUrlPath)
+        object.concat(components.lpszUrlPath, int32(components.dwUrlPathLength + components.dwExtraInfoLength));
+    if (object.empty())
+        object = L"/";
+
+    wstr<64> agent;
+    agent.format(L"Clink/%u.%u.%u", CLINK_VERSION_MAJOR, CLINK_VERSION_MINOR, CLINK_VERSION_PATCH);
+
+    // Automatic proxy detection requires Windows 8.1 or newer.
+    winhttp_handle session(s_winhttp.WinHttpOpen(agent.c_str(), WINHTTP_ACCESS_TYPE_AUTOMATIC_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0));
+    if (!session)
+        session.m_h = s_winhttp.WinHttpOpen(agent.c_str(), WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+    if (!session)
+    {
+        error.format("unable to open http session; error %u", GetLastError());
+        return false;
+    }
+
+    // Older versions of Windows don't enable TLS 1.2 by default, and older
+    // versions don't recognize TLS 1.3.
+    DWORD protocols = WINHTTP_FLAG_SECURE_PROTOCOL_TLS1_2|WINHTTP_FLAG_SECURE_PROTOCOL_TLS1_3;
+    if (!s_winhttp.WinHttpSetOption(session, WINHTTP_OPTION_SECURE_PROTOCOLS, &protocols, sizeof(protocols)))
+    {
+        protocols = WINHTTP_FLAG_SECURE_PROTOCOL_TLS1_2;
+        s_winhttp.WinHttpSetOption(session, WINHTTP_OPTION_SECURE_PROTOCOLS, &protocols, sizeof(protocols));
+    }
+    s_winhttp.WinHttpSetTimeouts(session, 0, 30000, 30000, 60000);
+
+    winhttp_handle connect(s_winhttp.WinHttpConnect(session, host.c_str(), components.nPort, 0));
+    if (!connect)
+    {
+        error.format("unable to connect to server; error %u", GetLastError());
+        return false;
+    }
+
+    winhttp_handle request(s_winhttp.WinHttpOpenRequest(connect, L"GET", object.c_str(), nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, WINHTTP_FLAG_SECURE));
+    if (!request)
+    {
+        error.format("unable to open request; error %u", GetLastError());
+        return false;
+    }
+
+    static const wchar_t c_headers[] = L"Cache-Control: no-cache\r\n";
+    if (!s_winhttp.WinHttpSendRequest(request, c_headers, DWORD(-1), WINHTTP_NO_REQUEST_DATA, 0, 0, 0) ||
+        !s_winhttp.WinHttpReceiveResponse(request, nullptr))
+    {
+        error.format("request failed; error %u", GetLastError());
+        return false;
+    }
+
+    DWORD status = 0;
+    DWORD size = sizeof(status);
+    if (!s_winhttp.WinHttpQueryHeaders(request, WINHTTP_QUERY_STATUS_CODE|WINHTTP_QUERY_FLAG_NUMBER, WINHTTP_HEADER_NAME_BY_INDEX, &status, &size, WINHTTP_NO_HEADER_INDEX))
+    {
+        error.format("unable to get status code; error %u", GetLastError());
+        return false;
+    }
+    m_status = status;
+    if (status != HTTP_STATUS_OK)
+    {
+        error.format("server returned status %u", status);
+        return false;
+    }
+
+    return receive(request, error);
+}
+
+//------------------------------------------------------------------------------
+bool http_async_lua_task::receive(HINTERNET request, str_base& error)
+{
+    HANDLE file = INVALID_HANDLE_VALUE;
+    wstr<280> wfile;
+    if (!m_file.empty())
+    {
+        wfile = m_file.c_str();
+        file = CreateFileW(wfile.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            error.format("unable to create '%s'; error %u", m_file.c_str(), GetLastError());
+            return false;
+        }
+    }
+
+    bool ok = true;
+    size_t total = 0;
+    char buffer[16384];
+    while (true)
+    {
+        if (is_canceled())
+        {
+            error = "canceled";
+            ok = false;
+            break;
+        }
+
+        DWORD read = 0;
+        if (!s_winhttp.WinHttpReadData(request, buffer, sizeof(buffer), &read))
+        {
+            error.format("unable to read response; error %u", GetLastError());
+            ok = false;
+            break;
+        }
+        if (!read)
+            break;
+
+        total += read;
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            m_body.append(buffer, read);
+        }
+        else
+        {
+            DWORD written;
+            if (!WriteFile(file, buffer, read, &written, nullptr) || written != read)
+            {
+                error.format("unable to write '%s'; error %u", m_file.c_str(), GetLastError());
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(file);
+        if (!ok || !total)
+            DeleteFileW(wfile.c_str());
+    }
+
+    if (ok && !total)
+    {
+        error = "empty response";
+        ok = false;
+    }
+
+    return ok;
+}
+
+
+
+//------------------------------------------------------------------------------
+class http_request_lua
+    : public lua_bindable<http_request_lua>
+{
+public:
+                        http_request_lua(const std::shared_ptr<http_async_lua_task>& task) : m_task(task) {}
+                        ~http_request_lua() { m_task->orphan(); }
+
+protected:
+    int32               wait(lua_State* state);
+    int32               results(lua_State* state);
+
+private:
+    std::shared_ptr<http_async_lua_task> m_task;
+
+    friend class lua_bindable<http_request_lua>;
+    static const char* const c_name;
+    static const http_request_lua::method c_methods[];
+};
+
+//------------------------------------------------------------------------------
+int32 http_request_lua::wait(lua_State* state)
+{
+    m_task->wait(INFINITE);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+int32 http_request_lua::results(lua_State* state)
+{
+    return m_task->push_results(state);
+}
+
+//------------------------------------------------------------------------------
+const char* const http_request_lua::c_name = "http_request_lua";
+const http_request_lua::method http_request_lua::c_methods[] = {
+    { "wait",           &wait },
+    { "results",        &results },
+    {}
+};
+
+
+
+//------------------------------------------------------------------------------
+// UNDOCUMENTED; internal use only.  See http_get in update.lua.
+//
+// Arg 1 is whether to return an asyncyield object, arg 2 is an https url, and
+// arg 3 is an optional file name to receive the response body.  Returns a
+// request object, and an asyncyield object if requested.
+//
+// The request object's results() method returns the response body (or true
+// when a file name was given), nil, and the HTTP status code.  On failure it
+// returns nil, an error message, and the HTTP status code if one was received.
+int32 http_request_internal(lua_State* state)
+{
+    const bool async = !!lua_toboolean(state, 1);
+    const char* url = checkstring(state, 2);
+    const char* file = optstring(state, 3, nullptr);
+    if (!url)
+        return 0;
+
+    static uint32 s_counter = 0;
+    str_moveable key;
+    key.format("http||%08x", ++s_counter);
+
+    str<> src;
+    get_lua_srcinfo(state, src);
+
+    dbg_ignore_scope(snapshot, "async http");
+
+    // Push an asyncyield object.  It's created before the request object so
+    // that if both become garbage together, the request object's finalizer
+    // runs first and orphans the task before the asyncyield is freed.
+    async_yield_lua* asyncyield = nullptr;
+    if (async)
+    {
+        asyncyield = async_yield_lua::make_new(state, "http request");
+        if (!asyncyield)
+            return 0;
+    }
+
+    // Push a request object.
+    auto task = std::make_shared<http_async_lua_task>(key.c_str(), src.c_str(), asyncyield, url, file);
+    if (!task)
+        return 0;
+    http_request_lua* request = http_request_lua::make_new(state, task);
+    if (!request)
+        return 0;
+
+    // Without the task manager, run the request on this thread.
+    std::shared_ptr<async_lua_task> base(task);
+    if (!add_async_lua_task(base))
+        task->run_now();
+
+    if (!async)
+        return 1;
+
+    // Return the request object first.
+    lua_insert(state, -2);
+    return 2;
+}
+
+//------------------------------------------------------------------------------
+// UNDOCUMENTED; internal use only.
+//
+// Expands ZIP into the directory OUT.  Returns true on success, or nil and an
+// error message on failure.
+int32 unzip_internal(lua_State* state)
+{
+    const char* zip = checkstring(state, 1);
+    const char* out = checkstring(state, 2);
+    if (!zip || !out)
+        return 0;
+
+    str<> error;
+    if (!unzip_file(zip, out, error))
+    {
+        lua_pushnil(state);
+        lua_pushlstring(state, error.c_str(), error.length());
+        return 2;
+    }
+
+    lua_pushboolean(state, true);
+    return 1;
+}
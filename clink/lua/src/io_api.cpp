@@ -4,6 +4,8 @@
 #include "pch.h"
 #include "lua_state.h"
 #include "yield.h"
+#include "lua_input_idle.h"
+#include "lua_bindable.h"
 
 #include <core/base.h>
 #include <core/os.h>
@@ -16,8 +18,11 @@
 #include <stdio.h>
 #include <process.h>
 #include <share.h>
+#include <algorithm>
 #include <list>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include <assert.h>
 
 //------------------------------------------------------------------------------
@@ -223,6 +228,13 @@ struct pipe_pair
 
 
 //------------------------------------------------------------------------------
+// Collects a command's output while the command runs, so the command never
+// blocks on a full pipe, and then feeds the output to Lua through a second
+// pipe.  Ordinary size output is kept in memory and never touches the disk;
+// output larger than c_max_memory spills into a temp file.
+//
+// The output is ready for Lua as soon as the command's output ends; the pipe
+// is filled as Lua reads from it.
 struct popen_buffering : public yield_thread
 {
     popen_buffering(FILE* r, HANDLE w)
@@ -240,6 +252,10 @@ struct popen_buffering : public yield_thread
             fclose(m_read);
         if (m_write)
             CloseHandle(m_write);
+        if (m_spill)
+            fclose(m_spill);
+        if (m_output_event)
+            CloseHandle(m_output_event);
         if (m_stat_event)
             CloseHandle(m_stat_event);
         if (m_process_handle)
@@ -249,8 +265,9 @@ struct popen_buffering : public yield_thread
     bool createthread()
     {
         assert(!m_stat_event);
+        m_output_event = CreateEvent(nullptr, true, false, nullptr);
         m_stat_event = CreateEvent(nullptr, true, false, nullptr);
-        if (!m_stat_event)
+        if (!m_output_event || !m_stat_event)
             return false;
         return yield_thread::createthread();
     }
@@ -266,7 +283,7 @@ struct popen_buffering : public yield_thread
     {
         if (m_need_completion)
             return m_stat_event;
-        return yield_thread::get_ready_event();
+        return m_output_event;
     }
 
     void set_need_completion() override
@@ -281,28 +298,72 @@ struct popen_buffering : public yield_thread
     }
 
 private:
+    bool collect(const BYTE* data, DWORD len)
+    {
+        if (!m_spill && m_data.size() + len > c_max_memory)
+        {
+            m_spill = os::create_temp_file(nullptr, "clk", ".tmp", os::temp_file_mode::binary|os::temp_file_mode::delete_on_close);
+            if (!m_spill || fwrite(m_data.data(), 1, m_data.size(), m_spill) != m_data.size())
+                return false;
+            m_data.clear();
+            m_data.shrink_to_fit();
+        }
+
+        if (m_spill)
+            return fwrite(data, 1, len, m_spill) == len;
+
+        m_data.insert(m_data.end(), data, data + len);
+        return true;
+    }
+
+    bool feed(const BYTE* data, DWORD len)
+    {
+        while (len && !is_canceled())
+        {
+            // Fails once Lua closes the read end of the pipe.
+            DWORD written;
+            if (!WriteFile(m_write, data, len, &written, nullptr))
+                return false;
+            data += written;
+            len -= written;
+        }
+        return !len;
+    }
+
     void do_work() override
     {
         HANDLE rh = reinterpret_cast<HANDLE>(_get_osfhandle(fileno(m_read)));
-        HANDLE wh = m_write;
 
         while (!is_canceled())
         {
             DWORD len;
             if (!ReadFile(rh, m_buffer, sizeof_array(m_buffer), &len, nullptr))
                 break;
-
-            DWORD written;
-            if (!WriteFile(wh, m_buffer, len, &written, nullptr))
-                break;
-            if (written != len)
+            if (!collect(m_buffer, len))
                 break;
         }
 
-        // Reset file pointer so the read handle can read from the beginning.
-        SetFilePointer(wh, 0, nullptr, FILE_BEGIN);
+        // The output is complete, so Lua can start reading.
+        SetEvent(m_output_event);
+        SetEvent(lua_input_idle::get_idle_event());
+
+        if (!m_spill)
+        {
+            feed(m_data.data(), DWORD(m_data.size()));
+        }
+        else
+        {
+            fflush(m_spill);
+            rewind(m_spill);
+            while (!is_canceled())
+            {
+                const size_t len = fread(m_buffer, 1, sizeof_array(m_buffer), m_spill);
+                if (!len || !feed(m_buffer, DWORD(len)))
+                    break;
+            }
+        }
 
-        // Close the write handle since it's finished.
+        // Close the write handle so Lua reaches the end of the output.
         CloseHandle(m_write);
         m_write = nullptr;
     }
@@ -321,6 +382,9 @@ private:
 
     FILE*           m_read;
     HANDLE          m_write;
+    FILE*           m_spill = nullptr;
+    std::vector<BYTE> m_data;
+    HANDLE          m_output_event = 0;
     HANDLE          m_stat_event = 0;
     HANDLE          m_process_handle = 0;
 
@@ -329,6 +393,8 @@ private:
     volatile long   m_need_completion = false;
 
     BYTE            m_buffer[4096];
+
+    static const size_t c_max_memory = 4 * 1024 * 1024;
 };
 
 
@@ -469,8 +535,8 @@ private:
     yg = luaL_YieldGuard::make_new(state);
 
     bool failed = true;
-    FILE* temp_read = nullptr;
-    HANDLE temp_write = nullptr;
+    FILE* lua_read = nullptr;
+    HANDLE lua_write = nullptr;
     std::shared_ptr<popen_buffering> buffering;
     popenrw_info* info = nullptr;
 
@@ -478,28 +544,38 @@ private:
     {
         dbg_ignore_scope(snapshot, "Lua io_popenyield");
 
-        os::temp_file_mode tfmode = os::temp_file_mode::delete_on_close;
-        if (binary)
-            tfmode |= os::temp_file_mode::binary;
-        str<> name;
-        temp_read = os::create_temp_file(&name, "clk", ".tmp", tfmode);
-        if (!temp_read)
+        // Lua reads the output from a pipe that the buffering thread fills.
+        // Neither end is inheritable, so other spawned processes can't hold
+        // the pipe open.
+        HANDLE pipe_read;
+        if (!CreatePipe(&pipe_read, &lua_write, nullptr, 0))
+        {
+            errno = EMFILE;
             break;
-
-        temp_write = os::dup_handle(GetCurrentProcess(), reinterpret_cast<HANDLE>(_get_osfhandle(fileno(temp_read))), true/*inherit*/);
-        if (!temp_write)
+        }
+        const int32 fd = _open_osfhandle(intptr_t(pipe_read), _O_RDONLY | (binary ? _O_BINARY : _O_TEXT));
+        if (fd == -1)
+        {
+            CloseHandle(pipe_read);
+            break;
+        }
+        lua_read = _wfdopen(fd, binary ? L"rb" : L"rt");
+        if (!lua_read)
+        {
+            _close(fd);
             break;
+        }
 
-        // The pipe and temp_write are both binary to simplify the thread's job.
+        // The pipe and lua_write are both binary to simplify the thread's job.
         // Must provide pipe_stdin to the spawned process, or some processes may
         // error out due to missing stdin handle (e.g. FC and XCOPY).
         if (!pipe_stdin.init(true/*write*/, true/*binary*/) ||
             !pipe_stdout.init(false/*write*/, true/*binary*/))
             break;
 
-        buffering = std::make_shared<popen_buffering>(pipe_stdout.local, temp_write);
+        buffering = std::make_shared<popen_buffering>(pipe_stdout.local, lua_write);
         pipe_stdout.transfer_local();
-        temp_write = nullptr;
+        lua_write = nullptr;
         if (!buffering->createthread())
             break;
 
@@ -508,9 +584,9 @@ private:
         if (!process_handle)
             break;
 
-        pr->f = temp_read;
+        pr->f = lua_read;
         pr->closef = &pclosefile;
-        temp_read = nullptr;
+        lua_read = nullptr;
 
         info->r = pr->f;
         info->process_handle = reinterpret_cast<intptr_t>(process_handle);
@@ -529,10 +605,10 @@ private:
     {
         errno_t e = errno;
 
-        if (temp_read)
-            fclose(temp_read);
-        if (temp_write)
-            CloseHandle(temp_write);
+        if (lua_read)
+            fclose(lua_read);
+        if (lua_write)
+            CloseHandle(lua_write);
         delete info;
         buffering = nullptr;
 
@@ -545,6 +621,366 @@ private:
     return (failed) ? luaL_fileresult(state, 0, command) : 2;
 }
 
+//------------------------------------------------------------------------------
+// A long-lived child process that answers requests written to its stdin, for
+// tools that have a batch or server mode (e.g. `git cat-file --batch`).  This
+// avoids paying for spawning a process (plus cmd.exe) for every request.
+//
+// The process is in a job object, so that terminating it also terminates the
+// tool started by cmd.exe, and so nothing is left running when Clink exits.
+class helper_process
+{
+public:
+                        helper_process(const char* command, const char* cwd);
+                        ~helper_process();
+    bool                start();
+    void                stop();
+    bool                is_running() const;
+    bool                is_match(const char* command, const char* cwd) const;
+    bool                transact(const std::vector<char>& input, const std::vector<char>& terminator, std::vector<char>& out);
+
+private:
+    const str_moveable  m_command;
+    const str_moveable  m_cwd;
+    HANDLE              m_job = nullptr;
+    HANDLE              m_process = nullptr;
+    FILE*               m_stdin = nullptr;
+    FILE*               m_stdout = nullptr;
+    std::vector<char>   m_pending;          // Output read past the last response.
+    std::mutex          m_mutex;            // One transaction at a time.
+    volatile long       m_broken = false;
+};
+
+//------------------------------------------------------------------------------
+helper_process::helper_process(const char* command, const char* cwd)
+: m_command(command)
+, m_cwd(cwd)
+{
+}
+
+//------------------------------------------------------------------------------
+helper_process::~helper_process()
+{
+    stop();
+    if (m_process)
+        CloseHandle(m_process);
+    if (m_job)
+        CloseHandle(m_job);
+}
+
+//------------------------------------------------------------------------------
+bool helper_process::start()
+{
+    assert(!m_process);
+
+    // Win32 failures set errno, since the caller reports it.
+    m_job = CreateJobObjectW(nullptr, nullptr);
+    if (!m_job)
+    {
+        os::map_errno();
+        return false;
+    }
+
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits = {};
+    limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+    SetInformationJobObject(m_job, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+
+    pipe_pair pipe_stdin;
+    pipe_pair pipe_stdout;
+    if (!pipe_stdin.init(true/*write*/, true/*binary*/) ||
+        !pipe_stdout.init(false/*write*/, true/*binary*/))
+        return false;
+
+    // The process starts suspended, so that it's in the job before cmd.exe
+    // can start the tool; otherwise the tool could escape the job.
+    HANDLE thread = nullptr;
+    m_process = os::spawn_internal(m_command.c_str(), m_cwd.c_str(), pipe_stdin.remote, pipe_stdout.remote, &thread);
+    if (!m_process)
+        return false;
+
+    DWORD error = 0;
+    if (!AssignProcessToJobObject(m_job, m_process))
+        error = GetLastError();
+    else if (ResumeThread(thread) == DWORD(-1))
+        error = GetLastError();
+    CloseHandle(thread);
+
+    if (error)
+    {
+        // The process never ran, so just end it.
+        TerminateProcess(m_process, 1);
+        os::map_errno(error);
+        return false;
+    }
+
+    m_stdin = pipe_stdin.local;
+    m_stdout = pipe_stdout.local;
+    pipe_stdin.transfer_local();
+    pipe_stdout.transfer_local();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void helper_process::stop()
+{
+    // Terminating the job first unblocks a transaction that's waiting for a
+    // response, so the lock can be acquired.
+    m_broken = true;
+    if (m_job)
+        TerminateJobObject(m_job, 1);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stdin)
+        fclose(m_stdin);
+    if (m_stdout)
+        fclose(m_stdout);
+    m_stdin = nullptr;
+    m_stdout = nullptr;
+}
+
+//------------------------------------------------------------------------------
+bool helper_process::is_running() const
+{
+    return (!m_broken && m_process && WaitForSingleObject(m_process, 0) == WAIT_TIMEOUT);
+}
+
+//------------------------------------------------------------------------------
+bool helper_process::is_match(const char* command, const char* cwd) const
+{
+    return m_command.equals(command) && m_cwd.iequals(cwd);
+}
+
+//------------------------------------------------------------------------------
+// Writes INPUT to the process, and reads output until TERMINATOR.  OUT
+// receives the output before the terminator.
+bool helper_process::transact(const std::vector<char>& input, const std::vector<char>& terminator, std::vector<char>& out)
+{
+    assert(!terminator.empty());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_broken || !m_stdin || !m_stdout)
+        return false;
+
+    HANDLE hin = reinterpret_cast<HANDLE>(_get_osfhandle(fileno(m_stdin)));
+    HANDLE hout = reinterpret_cast<HANDLE>(_get_osfhandle(fileno(m_stdout)));
+
+    DWORD written;
+    if (!input.empty() &&
+        (!WriteFile(hin, input.data(), DWORD(input.size()), &written, nullptr) || written != input.size()))
+    {
+        m_broken = true;
+        return false;
+    }
+
+    size_t searched = 0;
+    while (true)
+    {
+        auto found = std::search(m_pending.begin() + searched, m_pending.end(), terminator.begin(), terminator.end());
+        if (found != m_pending.end())
+        {
+            out.assign(m_pending.begin(), found);
+            m_pending.erase(m_pending.begin(), found + terminator.size());
+            return true;
+        }
+
+        // Only the tail can still be the start of a terminator.
+        if (m_pending.size() >= terminator.size())
+            searched = m_pending.size() - terminator.size() + 1;
+
+        BYTE buffer[4096];
+        DWORD len;
+        if (!ReadFile(hout, buffer, sizeof_array(buffer), &len, nullptr) || !len)
+        {
+            // Responses can't be matched to requests anymore.
+            m_broken = true;
+            return false;
+        }
+        m_pending.insert(m_pending.end(), buffer, buffer + len);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Helper processes are kept across prompts (and across reloading Lua scripts),
+// so each prompt can reuse them.  The least recently used one is stopped when
+// too many are running.
+static std::vector<std::shared_ptr<helper_process>> s_helpers;
+static const size_t c_max_helpers = 8;
+
+//------------------------------------------------------------------------------
+static std::shared_ptr<helper_process> get_helper(const char* command, const char* cwd)
+{
+    for (size_t i = s_helpers.size(); i--;)
+    {
+        if (!s_helpers[i]->is_running())
+        {
+            s_helpers.erase(s_helpers.begin() + i);
+        }
+        else if (s_helpers[i]->is_match(command, cwd))
+        {
+            // Most recently used goes last.
+            auto helper = s_helpers[i];
+            s_helpers.erase(s_helpers.begin() + i);
+            s_helpers.emplace_back(helper);
+            return helper;
+        }
+    }
+
+    auto helper = std::make_shared<helper_process>(command, cwd);
+    if (!helper->start())
+        return nullptr;
+
+    if (s_helpers.size() >= c_max_helpers)
+    {
+        s_helpers.front()->stop();
+        s_helpers.erase(s_helpers.begin());
+    }
+    s_helpers.emplace_back(helper);
+    return helper;
+}
+
+//------------------------------------------------------------------------------
+struct helper_request : public yield_thread
+{
+    helper_request(const std::shared_ptr<helper_process>& helper, const char* input, size_t input_len, const char* terminator, size_t terminator_len)
+    : m_helper(helper)
+    , m_input(input, input + input_len)
+    , m_terminator(terminator, terminator + terminator_len)
+    {
+    }
+
+    int32 results(lua_State* state) override
+    {
+        if (!m_ok)
+        {
+            lua_pushnil(state);
+            lua_pushliteral(state, "helper process failed");
+            return 2;
+        }
+
+        lua_pushlstring(state, m_output.data(), m_output.size());
+        return 1;
+    }
+
+private:
+    void do_work() override
+    {
+        m_ok = m_helper->transact(m_input, m_terminator, m_output);
+    }
+
+    std::shared_ptr<helper_process> m_helper;
+    const std::vector<char> m_input;
+    const std::vector<char> m_terminator;
+    std::vector<char>   m_output;
+    bool                m_ok = false;
+};
+
+//------------------------------------------------------------------------------
+class helper_lua
+    : public lua_bindable<helper_lua>
+{
+public:
+                        helper_lua(const std::shared_ptr<helper_process>& helper) : m_helper(helper) {}
+                        ~helper_lua() {}
+
+protected:
+    int32               send(lua_State* state);
+    int32               close(lua_State* state);
+    int32               is_running(lua_State* state);
+
+private:
+    std::shared_ptr<helper_process> m_helper;
+
+    friend class lua_bindable<helper_lua>;
+    static const char* const c_name;
+    static const helper_lua::method c_methods[];
+};
+
+//------------------------------------------------------------------------------
+// Returns a yieldguard for the request; see io.spawnhelper in coroutines.lua.
+int32 helper_lua::send(lua_State* state)
+{
+    size_t input_len;
+    size_t terminator_len;
+    const char* input = luaL_checklstring(state, LUA_SELF + 1, &input_len);
+    const char* terminator = luaL_checklstring(state, LUA_SELF + 2, &terminator_len);
+    if (!terminator_len)
+        return luaL_argerror(state, LUA_SELF + 2, "terminator must not be empty");
+
+    if (!m_helper || !m_helper->is_running())
+    {
+        lua_pushnil(state);
+        lua_pushliteral(state, "helper process is not running");
+        return 2;
+    }
+
+    dbg_ignore_scope(snapshot, "Lua helper request");
+
+    luaL_YieldGuard* yg = luaL_YieldGuard::make_new(state);
+    auto request = std::make_shared<helper_request>(m_helper, input, input_len, terminator, terminator_len);
+    if (!request->createthread())
+    {
+        lua_pop(state, 1);
+        lua_pushnil(state);
+        lua_pushliteral(state, "unable to start helper request");
+        return 2;
+    }
+
+    yg->init(request, "helper request");
+    request->go();
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+int32 helper_lua::close(lua_State* state)
+{
+    if (m_helper)
+    {
+        m_helper->stop();
+        s_helpers.erase(std::remove(s_helpers.begin(), s_helpers.end(), m_helper), s_helpers.end());
+        m_helper = nullptr;
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+int32 helper_lua::is_running(lua_State* state)
+{
+    lua_pushboolean(state, m_helper && m_helper->is_running());
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+const char* const helper_lua::c_name = "helper_lua";
+const helper_lua::method helper_lua::c_methods[] = {
+    { "send",           &send },
+    { "close",          &close },
+    { "isrunning",      &is_running },
+    {}
+};
+
+//------------------------------------------------------------------------------
+// UNDOCUMENTED; internal use only.  See io.spawnhelper in coroutines.lua.
+static int32 io_spawnhelper(lua_State* state)
+{
+    const char* command = checkstring(state, 1);
+    if (!command || !*command)
+    {
+        lua_pushnil(state);
+        lua_pushliteral(state, "missing command");
+        return 2;
+    }
+
+    str<> cwd;
+    os::get_current_dir(cwd);
+
+    auto helper = get_helper(command, cwd.c_str());
+    if (!helper)
+        return luaL_fileresult(state, 0, command);
+
+    helper_lua::make_new(state, helper);
+    return 1;
+}
+
 //------------------------------------------------------------------------------
 /// -name:  io.open
 /// -ver:   0.0.1
@@ -706,6 +1142,7 @@ void io_lua_initialise(lua_state& lua)
     } methods[] = {
         { "popenrw",                    &io_popenrw },
         { "popenyield_internal",        &io_popenyield },
+        { "spawnhelper_internal",       &io_spawnhelper },
         { "sopen",                      &io_sopen },
         { "truncate",                   &io_truncate },
     };
@@ -0,0 +1,989 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "lua_state.h"
+
+#include <core/str.h>
+
+#include <math.h>
+
+//------------------------------------------------------------------------------
+static const int32 c_max_depth = 200;
+
+
+
+//------------------------------------------------------------------------------
+// Decodes JSON text directly into Lua values in a single pass over the text,
+// without building any intermediate representation.  When a path of keys is
+// given, everything outside the path is only scanned (not converted into Lua
+// values), and decoding stops as soon as the selected value is complete.
+class json_decoder
+{
+public:
+                    json_decoder(lua_State* state, const char* text, size_t len);
+    bool            decode();
+    bool            select(int32 path_index, int32 step, int32 count, bool& found);
+    void            push_error();
+
+private:
+    bool            value(bool build);
+    bool            object(bool build);
+    bool            array(bool build);
+    bool            string(bool build);
+    bool            number(bool build);
+    bool            literal(const char* word, uint32 len);
+    bool            read_string(const char*& out, uint32& out_len);
+    bool            read_hex4(uint32& out);
+    void            skip_ws();
+    bool            fail(const char* msg);
+
+    lua_State*      m_state;
+    const char*     m_start;
+    const char*     m_ptr;
+    const char*     m_end;
+    int32           m_depth = 0;
+    const char*     m_error = nullptr;
+    const char*     m_error_ptr = nullptr;
+    str_moveable    m_scratch;
+};
+
+//------------------------------------------------------------------------------
+json_decoder::json_decoder(lua_State* state, const char* text, size_t len)
+: m_state(state)
+, m_start(text)
+, m_ptr(text)
+, m_end(text + len)
+{
+}
+
+//------------------------------------------------------------------------------
+bool json_decoder::decode()
+{
+    if (!value(true))
+        return false;
+
+    skip_ws();
+    if (m_ptr < m_end)
+        return fail("unexpected text after value");
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Walks the keys in the path table at path_index, starting with step.  Pushes
+// the selected value and sets found, or pushes nothing and clears found if the
+// path doesn't exist in the text.
+bool json_decoder::select(int32 path_index, int32 step, int32 count, bool& found)
+{
+    if (step > count)
+    {
+        found = true;
+        return value(true);
+    }
+
+    found = false;
+
+    lua_rawgeti(m_state, path_index, step);
+    const int32 key_type = lua_type(m_state, -1);
+    size_t key_len = 0;
+    const char* key = (key_type == LUA_TSTRING) ? lua_tolstring(m_state, -1, &key_len) : nullptr;
+    const lua_Number key_num = (key_type == LUA_TNUMBER) ? lua_tonumber(m_state, -1) : 0;
+    lua_pop(m_state, 1);
+
+    // The key string stays valid after popping it, since the path table still
+    // references it.
+
+    skip_ws();
+    if (m_ptr >= m_end)
+        return fail("unexpected end of text");
+
+    if (*m_ptr == '{' && key)
+    {
+        ++m_ptr;
+        skip_ws();
+        if (m_ptr < m_end && *m_ptr == '}')
+            return true;
+
+        while (true)
+        {
+            skip_ws();
+            if (m_ptr >= m_end || *m_ptr != '"')
+                return fail("expected string key");
+
+            const char* name;
+            uint32 name_len;
+            if (!read_string(name, name_len))
+                return false;
+
+            skip_ws();
+            if (m_ptr >= m_end || *m_ptr != ':')
+                return fail("expected ':'");
+            ++m_ptr;
+
+            if (name_len == key_len && memcmp(name, key, key_len) == 0)
+                return select(path_index, step + 1, count, found);
+
+            if (!value(false))
+                return false;
+
+            skip_ws();
+            if (m_ptr < m_end && *m_ptr == ',')
+            {
+                ++m_ptr;
+                continue;
+            }
+            if (m_ptr < m_end && *m_ptr == '}')
+                return true;
+            return fail("expected ',' or '}'");
+        }
+    }
+
+    if (*m_ptr == '[' && key_type == LUA_TNUMBER && key_num >= 1 && key_num == floor(key_num))
+    {
+        ++m_ptr;
+        skip_ws();
+        if (m_ptr < m_end && *m_ptr == ']')
+            return true;
+
+        for (lua_Number index = 1;; ++index)
+        {
+            if (index == key_num)
+                return select(path_index, step + 1, count, found);
+
+            if (!value(false))
+                return false;
+
+            skip_ws();
+            if (m_ptr < m_end && *m_ptr == ',')
+            {
+                ++m_ptr;
+                continue;
+            }
+            if (m_ptr < m_end && *m_ptr == ']')
+                return true;
+            return fail("expected ',' or ']'");
+        }
+    }
+
+    // The path doesn't match the shape of the text.
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void json_decoder::push_error()
+{
+    lua_pushnil(m_state);
+    lua_pushfstring(m_state, "%s at position %d", m_error, int32(m_error_ptr - m_start) + 1);
+}
+
+//------------------------------------------------------------------------------
+bool json_decoder::fail(const char* msg)
+{
+    if (!m_error)
+    {
+        m_error = msg;
+        m_error_ptr = m_ptr;
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+void json_decoder::skip_ws()
+{
+    while (m_ptr < m_end && (*m_ptr == ' ' || *m_ptr == '\n' || *m_ptr == '\r' || *m_ptr == '\t'))
+        ++m_ptr;
+}
+
+//------------------------------------------------------------------------------
+// When build is true, pushes the value on the Lua stack.  Otherwise only
+// validates and skips over the value.  On failure the stack may hold partial
+// values; the caller restores the stack top.
+bool json_decoder::value(bool build)
+{
+    skip_ws();
+    if (m_ptr >= m_end)
+        return fail("unexpected end of text");
+
+    switch (*m_ptr)
+    {
+    case '{':   return object(build);
+    case '[':   return array(build);
+    case '"':   return string(build);
+    case 't':
+        if (!literal("true", 4))
+            return false;
+        if (build)
+            lua_pushboolean(m_state, true);
+        return true;
+    case 'f':
+        if (!literal("false", 5))
+            return false;
+        if (build)
+            lua_pushboolean(m_state, false);
+        return true;
+    case 'n':
+        if (!literal("null", 4))
+            return false;
+        if (build)
+            lua_pushlightuserdata(m_state, nullptr);
+        return true;
+    default:
+        if (*m_ptr == '-' || (*m_ptr >= '0' && *m_ptr <= '9'))
+            return number(build);
+        return fail("unexpected character");
+    }
+}
+
+//------------------------------------------------------------------------------
+bool json_decoder::object(bool build)
+{
+    if (++m_depth > c_max_depth)
+        return fail("too deeply nested");
+    if (build && !lua_checkstack(m_state, 4))
+        return fail("too deeply nested");
+
+    ++m_ptr;
+    if (build)
+        lua_createtable(m_state, 0, 4);
+
+    skip_ws();
+    if (m_ptr < m_end && *m_ptr == '}')
+    {
+        ++m_ptr;
+        --m_depth;
+        return true;
+    }
+
+    while (true)
+    {
+        skip_ws();
+        if (m_ptr >= m_end || *m_ptr != '"')
+            break;
+        if (!string(build))
+            break;
+
+        skip_ws();
+        if (m_ptr >= m_end || *m_ptr != ':')
+        {
+            fail("expected ':'");
+            break;
+        }
+        ++m_ptr;
+
+        if (!value(build))
+            break;
+        if (build)
+            lua_rawset(m_state, -3);
+
+        skip_ws();
+        if (m_ptr < m_end && *m_ptr == ',')
+        {
+            ++m_ptr;
+            continue;
+        }
+        if (m_ptr < m_end && *m_ptr == '}')
+        {
+            ++m_ptr;
+            --m_depth;
+            return true;
+        }
+        return fail("expected ',' or '}'");
+    }
+
+    return fail("expected string key");
+}
+
+//------------------------------------------------------------------------------
+bool json_decoder::array(bool build)
+{
+    if (++m_depth > c_max_depth)
+        return fail("too deeply nested");
+    if (build && !lua_checkstack(m_state, 4))
+        return fail("too deeply nested");
+
+    ++m_ptr;
+    if (build)
+        lua_createtable(m_state, 4, 0);
+
+    skip_ws();
+    if (m_ptr < m_end && *m_ptr == ']')
+    {
+        ++m_ptr;
+        --m_depth;
+        return true;
+    }
+
+    int32 index = 0;
+    while (true)
+    {
+        if (!value(build))
+            break;
+        if (build)
+            lua_rawseti(m_state, -2, ++index);
+
+        skip_ws();
+        if (m_ptr < m_end && *m_ptr == ',')
+        {
+            ++m_ptr;
+            continue;
+        }
+        if (m_ptr < m_end && *m_ptr == ']')
+        {
+            ++m_ptr;
+            --m_depth;
+            return true;
+        }
+        return fail("expected ',' or ']'");
+    }
+
+    return false;
+}
+
+//------------------------------------------------------------------------------
+bool json_decoder::string(bool build)
+{
+    const char* s;
+    uint32 len;
+    if (!read_string(s, len))
+        return false;
+
+    if (build)
+        lua_pushlstring(m_state, s, len);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Strings without escapes point straight into the text; otherwise the decoded
+// string is built in m_scratch.
+bool json_decoder::read_string(const char*& out, uint32& out_len)
+{
+    assert(*m_ptr == '"');
+    const char* begin = ++m_ptr;
+
+    while (m_ptr < m_end && *m_ptr != '"' && *m_ptr != '\\')
+    {
+        if (uint8(*m_ptr) < 0x20)
+            return fail("control character in string");
+        ++m_ptr;
+    }
+
+    if (m_ptr >= m_end)
+        return fail("unterminated string");
+
+    if (*m_ptr == '"')
+    {
+        out = begin;
+        out_len = uint32(m_ptr - begin);
+        ++m_ptr;
+        return true;
+    }
+
+    m_scratch.clear();
+    m_scratch.concat_no_truncate(begin, int32(m_ptr - begin));
+
+    while (true)
+    {
+        const char* run = m_ptr;
+        while (m_ptr < m_end && *m_ptr != '"' && *m_ptr != '\\')
+        {
+            if (uint8(*m_ptr) < 0x20)
+                return fail("control character in string");
+            ++m_ptr;
+        }
+        m_scratch.concat_no_truncate(run, int32(m_ptr - run));
+
+        if (m_ptr >= m_end)
+            return fail("unterminated string");
+        if (*m_ptr == '"')
+            break;
+
+        ++m_ptr;
+        if (m_ptr >= m_end)
+            return fail("unterminated string");
+
+        char c = *(m_ptr++);
+        switch (c)
+        {
+        case '"':
+        case '\\':
+        case '/':   break;
+        case 'b':   c = '\b'; break;
+        case 'f':   c = '\f'; break;
+        case 'n':   c = '\n'; break;
+        case 'r':   c = '\r'; break;
+        case 't':   c = '\t'; break;
+        case 'u':
+            {
+                uint32 cp;
+                if (!read_hex4(cp))
+                    return false;
+                if (cp >= 0xd800 && cp <= 0xdbff)
+                {
+                    uint32 lo;
+                    if (m_end - m_ptr < 2 || m_ptr[0] != '\\' || m_ptr[1] != 'u')
+                        return fail("invalid surrogate pair");
+                    m_ptr += 2;
+                    if (!read_hex4(lo))
+                        return false;
+                    if (lo < 0xdc00 || lo > 0xdfff)
+                        return fail("invalid surrogate pair");
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                }
+                else if (cp >= 0xdc00 && cp <= 0xdfff)
+                {
+                    return fail("invalid surrogate pair");
+                }
+
+                char utf8[4];
+                int32 n;
+                if (cp < 0x80)
+                {
+                    utf8[0] = char(cp);
+                    n = 1;
+                }
+                else if (cp < 0x800)
+                {
+                    utf8[0] = char(0xc0 | (cp >> 6));
+                    utf8[1] = char(0x80 | (cp & 0x3f));
+                    n = 2;
+                }
+                else if (cp < 0x10000)
+                {
+                    utf8[0] = char(0xe0 | (cp >> 12));
+                    utf8[1] = char(0x80 | ((cp >> 6) & 0x3f));
+                    utf8[2] = char(0x80 | (cp & 0x3f));
+                    n = 3;
+                }
+                else
+                {
+                    utf8[0] = char(0xf0 | (cp >> 18));
+                    utf8[1] = char(0x80 | ((cp >> 12) & 0x3f));
+                    utf8[2] = char(0x80 | ((cp >> 6) & 0x3f));
+                    utf8[3] = char(0x80 | (cp & 0x3f));
+                    n = 4;
+                }
+                m_scratch.concat_no_truncate(utf8, n);
+            }
+            continue;
+        default:
+            --m_ptr;
+            return fail("invalid escape");
+        }
+
+        m_scratch.concat_no_truncate(&c, 1);
+    }
+
+    ++m_ptr;
+    out = m_scratch.c_str();
+    out_len = m_scratch.length();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool json_decoder::read_hex4(uint32& out)
+{
+    if (m_end - m_ptr < 4)
+        return fail("invalid \\u escape");
+
+    out = 0;
+    for (int32 i = 0; i < 4; ++i)
+    {
+        const char c = *(m_ptr++);
+        out <<= 4;
+        if (c >= '0' && c <= '9')
+            out |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            out |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            out |= c - 'A' + 10;
+        else
+        {
+            --m_ptr;
+            return fail("invalid \\u escape");
+        }
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool json_decoder::number(bool build)
+{
+    const char* begin = m_ptr;
+
+    if (*m_ptr == '-')
+        ++m_ptr;
+    if (m_ptr >= m_end || !(*m_ptr >= '0' && *m_ptr <= '9'))
+        return fail("invalid number");
+    if (*m_ptr == '0')
+        ++m_ptr;
+    else
+        while (m_ptr < m_end && *m_ptr >= '0' && *m_ptr <= '9')
+            ++m_ptr;
+
+    if (m_ptr < m_end && *m_ptr == '.')
+    {
+        ++m_ptr;
+        if (m_ptr >= m_end || !(*m_ptr >= '0' && *m_ptr <= '9'))
+            return fail("invalid number");
+        while (m_ptr < m_end && *m_ptr >= '0' && *m_ptr <= '9')
+            ++m_ptr;
+    }
+
+    if (m_ptr < m_end && (*m_ptr == 'e' || *m_ptr == 'E'))
+    {
+        ++m_ptr;
+        if (m_ptr < m_end && (*m_ptr == '+' || *m_ptr == '-'))
+            ++m_ptr;
+        if (m_ptr >= m_end || !(*m_ptr >= '0' && *m_ptr <= '9'))
+            return fail("invalid number");
+        while (m_ptr < m_end && *m_ptr >= '0' && *m_ptr <= '9')
+            ++m_ptr;
+    }
+
+    if (build)
+    {
+        // The text is a Lua string, so it's nul terminated and strtod can't
+        // read past the end.  The syntax was already validated above.
+        lua_pushnumber(m_state, lua_Number(strtod(begin, nullptr)));
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool json_decoder::literal(const char* word, uint32 len)
+{
+    if (uint32(m_end - m_ptr) < len || memcmp(m_ptr, word, len) != 0)
+        return fail("unexpected character");
+    m_ptr += len;
+    return true;
+}
+
+
+
+//------------------------------------------------------------------------------
+class json_encoder
+{
+public:
+                    json_encoder(lua_State* state, const char* indent);
+    bool            encode(int32 index);
+    void            push_result();
+    void            push_error();
+
+private:
+    bool            value(int32 index, int32 depth);
+    bool            table(int32 index, int32 depth);
+    void            string(const char* s, size_t len);
+    void            number(lua_Number num);
+    void            newline(int32 depth);
+    bool            fail(const char* msg);
+
+    lua_State*      m_state;
+    const char*     m_indent;
+    int32           m_indent_len;
+    str_moveable    m_out;
+    str<64>         m_error;
+};
+
+//------------------------------------------------------------------------------
+json_encoder::json_encoder(lua_State* state, const char* indent)
+: m_state(state)
+, m_indent(indent)
+, m_indent_len(indent ? int32(strlen(indent)) : 0)
+{
+}
+
+//------------------------------------------------------------------------------
+bool json_encoder::encode(int32 index)
+{
+    return value(index, 0);
+}
+
+//------------------------------------------------------------------------------
+void json_encoder::push_result()
+{
+    lua_pushlstring(m_state, m_out.c_str(), m_out.length());
+}
+
+//------------------------------------------------------------------------------
+void json_encoder::push_error()
+{
+    lua_pushnil(m_state);
+    lua_pushlstring(m_state, m_error.c_str(), m_error.length());
+}
+
+//------------------------------------------------------------------------------
+bool json_encoder::fail(const char* msg)
+{
+    if (m_error.empty())
+        m_error = msg;
+    return false;
+}
+
+//------------------------------------------------------------------------------
+void json_encoder::newline(int32 depth)
+{
+    if (!m_indent)
+        return;
+    m_out.concat_no_truncate("\n", 1);
+    while (depth-- > 0)
+        m_out.concat_no_truncate(m_indent, m_indent_len);
+}
+
+//------------------------------------------------------------------------------
+bool json_encoder::value(int32 index, int32 depth)
+{
+    switch (lua_type(m_state, index))
+    {
+    case LUA_TNIL:
+        m_out.concat_no_truncate("null", 4);
+        return true;
+    case LUA_TBOOLEAN:
+        if (lua_toboolean(m_state, index))
+            m_out.concat_no_truncate("true", 4);
+        else
+            m_out.concat_no_truncate("false", 5);
+        return true;
+    case LUA_TNUMBER:
+        {
+            const lua_Number num = lua_tonumber(m_state, index);
+            if (num != num || num - num != 0)
+                return fail("cannot encode NaN or infinity");
+            number(num);
+        }
+        return true;
+    case LUA_TSTRING:
+        {
+            size_t len;
+            const char* s = lua_tolstring(m_state, index, &len);
+            string(s, len);
+        }
+        return true;
+    case LUA_TLIGHTUSERDATA:
+        if (lua_touserdata(m_state, index) == nullptr)
+        {
+            m_out.concat_no_truncate("null", 4);
+            return true;
+        }
+        break;
+    case LUA_TTABLE:
+        return table(index, depth);
+    }
+
+    str<64> msg;
+    msg.format("cannot encode %s", luaL_typename(m_state, index));
+    return fail(msg.c_str());
+}
+
+//------------------------------------------------------------------------------
+// A table is encoded as an array if its keys are exactly 1..n, otherwise as an
+// object.  An empty table is encoded as an empty object.
+bool json_encoder::table(int32 index, int32 depth)
+{
+    if (depth >= c_max_depth)
+        return fail("too deeply nested, or table contains a cycle");
+    if (!lua_checkstack(m_state, 4))
+        return fail("too deeply nested");
+
+    const size_t len = lua_rawlen(m_state, index);
+    bool is_array = (len > 0);
+    if (is_array)
+    {
+        size_t count = 0;
+        lua_pushnil(m_state);
+        while (lua_next(m_state, index))
+        {
+            lua_pop(m_state, 1);
+            if (lua_type(m_state, -1) != LUA_TNUMBER)
+            {
+                is_array = false;
+                lua_pop(m_state, 1);
+                break;
+            }
+            const lua_Number key = lua_tonumber(m_state, -1);
+            if (key < 1 || key > lua_Number(len) || key != floor(key))
+            {
+                is_array = false;
+                lua_pop(m_state, 1);
+                break;
+            }
+            ++count;
+        }
+        if (count != len)
+            is_array = false;
+    }
+
+    if (is_array)
+    {
+        m_out.concat_no_truncate("[", 1);
+        for (size_t i = 1; i <= len; ++i)
+        {
+            if (i > 1)
+                m_out.concat_no_truncate(",", 1);
+            newline(depth + 1);
+            lua_rawgeti(m_state, index, int32(i));
+            const bool ok = value(lua_gettop(m_state), depth + 1);
+            lua_pop(m_state, 1);
+            if (!ok)
+                return false;
+        }
+        newline(depth);
+        m_out.concat_no_truncate("]", 1);
+        return true;
+    }
+
+    bool first = true;
+    m_out.concat_no_truncate("{", 1);
+    lua_pushnil(m_state);
+    while (lua_next(m_state, index))
+    {
+        if (!first)
+            m_out.concat_no_truncate(",", 1);
+        first = false;
+        newline(depth + 1);
+
+        // Numeric keys are converted to strings.  Don't use lua_tolstring on
+        // the key itself, since that would confuse lua_next.
+        const int32 key_type = lua_type(m_state, -2);
+        if (key_type == LUA_TSTRING)
+        {
+            size_t len;
+            const char* s = lua_tolstring(m_state, -2, &len);
+            string(s, len);
+        }
+        else if (key_type == LUA_TNUMBER)
+        {
+            m_out.concat_no_truncate("\"", 1);
+            number(lua_tonumber(m_state, -2));
+            m_out.concat_no_truncate("\"", 1);
+        }
+        else
+        {
+            lua_pop(m_state, 2);
+            return fail("table keys must be strings or numbers");
+        }
+
+        if (m_indent)
+            m_out.concat_no_truncate(": ", 2);
+        else
+            m_out.concat_no_truncate(":", 1);
+
+        if (!value(lua_gettop(m_state), depth + 1))
+        {
+            lua_pop(m_state, 2);
+            return false;
+        }
+        lua_pop(m_state, 1);
+    }
+    if (!first)
+        newline(depth);
+    m_out.concat_no_truncate("}", 1);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void json_encoder::string(const char* s, size_t len)
+{
+    static const char c_hex[] = "0123456789abcdef";
+
+    m_out.concat_no_truncate("\"", 1);
+
+    const char* end = s + len;
+    while (s < end)
+    {
+        const char* run = s;
+        while (s < end && uint8(*s) >= 0x20 && *s != '"' && *s != '\\')
+            ++s;
+        m_out.concat_no_truncate(run, int32(s - run));
+        if (s >= end)
+            break;
+
+        char esc[6] = { '\\' };
+        int32 n = 2;
+        switch (*s)
+        {
+        case '"':   esc[1] = '"'; break;
+        case '\\':  esc[1] = '\\'; break;
+        case '\b':  esc[1] = 'b'; break;
+        case '\f':  esc[1] = 'f'; break;
+        case '\n':  esc[1] = 'n'; break;
+        case '\r':  esc[1] = 'r'; break;
+        case '\t':  esc[1] = 't'; break;
+        default:
+            esc[1] = 'u';
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = c_hex[(uint8(*s) >> 4) & 0xf];
+            esc[5] = c_hex[uint8(*s) & 0xf];
+            n = 6;
+            break;
+        }
+        m_out.concat_no_truncate(esc, n);
+        ++s;
+    }
+
+    m_out.concat_no_truncate("\"", 1);
+}
+
+//------------------------------------------------------------------------------
+void json_encoder::number(lua_Number num)
+{
+    char buf[32];
+    int32 len;
+    if (num == floor(num) && fabs(num) < 9007199254740992.0)
+        len = _snprintf_s(buf, sizeof(buf), _TRUNCATE, "%lld", (long long)num);
+    else
+        len = _snprintf_s(buf, sizeof(buf), _TRUNCATE, "%.17g", num);
+    if (len > 0)
+        m_out.concat_no_truncate(buf, len);
+}
+
+
+
+//------------------------------------------------------------------------------
+/// -name:  json.decode
+/// -ver:   1.6.17
+/// -arg:   text:string
+/// -arg:   [path:table]
+/// -ret:   any, string
+/// Decodes the JSON <span class="arg">text</span> and returns the resulting
+/// Lua value.  Objects become tables with string keys, arrays become tables
+/// with integer keys starting at 1, and <code>null</code> becomes
+/// <a href="#json.null">json.null</a>.
+///
+/// If the text is not valid JSON, it returns nil and a string describing the
+/// problem and its position in the text.
+///
+/// The optional <span class="arg">path</span> is a table of keys (strings for
+/// object members, integers for array elements) that selects a value nested
+/// inside the text.  Only the selected value is converted into Lua values; the
+/// rest of the text is only scanned, and decoding stops as soon as the selected
+/// value is complete.  This is much faster when only a small part of a large
+/// document is needed.  If the path isn't present in the text, it returns nil.
+/// -show:  local r = io.popen("kubectl config view -o json")
+/// -show:  local text = r:read("*a")
+/// -show:  r:close()
+/// -show:
+/// -show:  -- Only decodes the name of the current context.
+/// -show:  local name = json.decode(text, { "current-context" })
+/// -show:
+/// -show:  -- Only decodes the first cluster entry.
+/// -show:  local cluster = json.decode(text, { "clusters", 1 })
+static int32 decode(lua_State* state)
+{
+    size_t len;
+    const char* text = (lua_type(state, 1) == LUA_TSTRING) ? lua_tolstring(state, 1, &len) : nullptr;
+    if (!text)
+        return luaL_argerror(state, 1, "string expected");
+
+    const bool has_path = !lua_isnoneornil(state, 2);
+    if (has_path)
+        luaL_checktype(state, 2, LUA_TTABLE);
+
+    lua_settop(state, 2);
+
+    json_decoder decoder(state, text, len);
+
+    if (has_path)
+    {
+        bool found;
+        if (!decoder.select(2, 1, int32(lua_rawlen(state, 2)), found))
+        {
+            lua_settop(state, 2);
+            decoder.push_error();
+            return 2;
+        }
+        if (!found)
+            lua_pushnil(state);
+        return 1;
+    }
+
+    if (!decoder.decode())
+    {
+        lua_settop(state, 2);
+        decoder.push_error();
+        return 2;
+    }
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  json.encode
+/// -ver:   1.6.17
+/// -arg:   value:any
+/// -arg:   [indent:string]
+/// -ret:   string, string
+/// Encodes <span class="arg">value</span> as JSON text and returns it.
+///
+/// A table whose keys are exactly the integers 1 through n is encoded as an
+/// array; any other table is encoded as an object, with numeric keys converted
+/// to strings.  An empty table is encoded as an empty object.  Both nil and
+/// <a href="#json.null">json.null</a> are encoded as <code>null</code>.
+///
+/// If <span class="arg">indent</span> is provided, the text is formatted on
+/// multiple lines, with nested values indented by repeating
+/// <span class="arg">indent</span>.  Otherwise the text is compact.
+///
+/// If the value can't be encoded (for example it contains a function, or a
+/// table that refers to itself), it returns nil and a string describing the
+/// problem.
+static int32 encode(lua_State* state)
+{
+    const char* indent = optstring(state, 2, nullptr);
+
+    lua_settop(state, 1);
+
+    json_encoder encoder(state, indent);
+    if (!encoder.encode(1))
+    {
+        encoder.push_error();
+        return 2;
+    }
+
+    encoder.push_result();
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  json.null
+/// -ver:   1.6.17
+/// -var:   userdata
+/// A unique value that represents JSON <code>null</code>.  It's what
+/// <a href="#json.decode">json.decode()</a> produces for <code>null</code>
+/// (so that arrays keep their positions), and
+/// <a href="#json.encode">json.encode()</a> encodes it as <code>null</code>.
+/// -show:  local t = json.decode('{"a":null}')
+/// -show:  if t.a == json.null then
+/// -show:  &nbsp;   print("a is null")
+/// -show:  end
+
+
+
+//------------------------------------------------------------------------------
+void json_lua_initialise(lua_state& lua)
+{
+    struct {
+        const char* name;
+        int32       (*method)(lua_State*);
+    } methods[] = {
+        { "decode",     &decode },
+        { "encode",     &encode },
+    };
+
+    lua_State* state = lua.get_state();
+
+    lua_createtable(state, 0, sizeof_array(methods) + 1);
+
+    for (const auto& method : methods)
+    {
+        lua_pushstring(state, method.name);
+        lua_pushcfunction(state, method.method);
+        lua_rawset(state, -3);
+    }
+
+    lua_pushliteral(state, "null");
+    lua_pushlightuserdata(state, nullptr);
+    lua_rawset(state, -3);
+
+    lua_setglobal(state, "json");
+}
@@ -154,6 +154,90 @@ line_state_lua::~line_state_lua()
     delete m_copy;
 }
 
+//------------------------------------------------------------------------------
+// Strings from getline(), getword(), and getendword() are cached for as long as
+// the input line text stays the same, since the many callbacks for a keystroke
+// (classifiers, generators, suggesters) keep asking for the same words.  Words
+// are keyed by offset and length rather than index, so the cache stays valid
+// when words are broken or merged in a copy, or for each command in the line.
+static char s_string_cache_key;
+static str_moveable s_string_cache_line;
+static uint32 s_string_cache_id = 0;
+
+//------------------------------------------------------------------------------
+void line_state_lua::push_string_cache(lua_State* state)
+{
+    lua_rawgetp(state, LUA_REGISTRYINDEX, &s_string_cache_key);
+
+    // Only compare the line text the first time each object uses the cache.
+    if (lua_istable(state, -1))
+    {
+        lua_rawgeti(state, -1, 0);
+        const uint32 id = uint32(lua_tointeger(state, -1));
+        lua_pop(state, 1);
+
+        if (id == s_string_cache_id)
+        {
+            if (m_cache_id == id)
+                return;
+            if (s_string_cache_line.length() == m_line->get_length() &&
+                memcmp(s_string_cache_line.c_str(), m_line->get_line(), m_line->get_length()) == 0)
+            {
+                m_cache_id = id;
+                return;
+            }
+        }
+    }
+    lua_pop(state, 1);
+
+    // Start a new cache for this line text.
+    s_string_cache_line.clear();
+    s_string_cache_line.concat(m_line->get_line(), m_line->get_length());
+    m_cache_id = ++s_string_cache_id;
+
+    lua_createtable(state, 0, 16);
+    lua_pushinteger(state, m_cache_id);
+    lua_rawseti(state, -2, 0);
+    lua_pushvalue(state, -1);
+    lua_rawsetp(state, LUA_REGISTRYINDEX, &s_string_cache_key);
+}
+
+//------------------------------------------------------------------------------
+void line_state_lua::push_word(lua_State* state, uint32 index)
+{
+    const auto& words = m_line->get_words();
+    if (index >= words.size())
+    {
+        lua_pushliteral(state, "");
+        return;
+    }
+
+    push_string_cache(state);
+
+    // Whether quotes are stripped is part of the key, since it differs during
+    // getwordbreakinfo().
+    const word& word = words[index];
+    const bool strip = line_state::can_strip_quotes();
+    lua_pushnumber(state, (double(word.offset) * 0x10000 + word.length) * 2 + (strip ? 1 : 0) + 1);
+    lua_pushvalue(state, -1);
+    lua_rawget(state, -3);
+    if (lua_isstring(state, -1))
+    {
+        lua_replace(state, -3);
+        lua_pop(state, 1);
+        return;
+    }
+    lua_pop(state, 1);
+
+    str<32> tmp;
+    m_line->get_word(index, tmp);
+    lua_pushlstring(state, tmp.c_str(), tmp.length());
+    lua_pushvalue(state, -1);
+    lua_insert(state, -4);
+    lua_rawset(state, -3);
+    lua_pop(state, 1);
+}
+
 //------------------------------------------------------------------------------
 /// -name:  line_state:getline
 /// -ver:   1.0.0
@@ -161,7 +245,15 @@ line_state_lua::~line_state_lua()
 /// Returns the current line in its entirety.
 int32 line_state_lua::get_line(lua_State* state)
 {
-    lua_pushlstring(state, m_line->get_line(), m_line->get_length());
+    push_string_cache(state);
+    lua_rawgeti(state, -1, -1);
+    if (!lua_isstring(state, -1))
+    {
+        lua_pop(state, 1);
+        lua_pushlstring(state, m_line->get_line(), m_line->get_length());
+        lua_pushvalue(state, -1);
+        lua_rawseti(state, -3, -1);
+    }
     return 1;
 }
 
@@ -344,10 +436,8 @@ int32 line_state_lua::get_word(lua_State* state)
     if (!lua_isnumber(state, LUA_SELF + 1))
         return 0;
 
-    str<32> word;
     uint32 index = int32(lua_tointeger(state, LUA_SELF + 1)) - 1;
-    m_line->get_word(m_shift + index, word);
-    lua_pushlstring(state, word.c_str(), word.length());
+    push_word(state, m_shift + index);
     return 1;
 }
 
@@ -373,9 +463,11 @@ int32 line_state_lua::get_word(lua_State* state)
 /// could be garbled.
 int32 line_state_lua::get_end_word(lua_State* state)
 {
-    str<32> word;
-    m_line->get_end_word(word);
-    lua_pushlstring(state, word.c_str(), word.length());
+    const uint32 count = m_line->get_word_count();
+    if (count)
+        push_word(state, count - 1);
+    else
+        lua_pushliteral(state, "");
     return 1;
 }
 
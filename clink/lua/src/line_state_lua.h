@@ -43,9 +43,12 @@ protected:
     int32               set_alias(lua_State* state);
 
 private:
+    void                push_string_cache(lua_State* state);
+    void                push_word(lua_State* state, uint32 index);
     const line_state*   m_line;
     line_state_copy*    m_copy;
     uint32              m_shift = 0;
+    uint32              m_cache_id = 0;
 
     friend class lua_bindable<line_state_lua>;
     static const char* const c_name;
@@ -46,7 +46,11 @@ int32 get_file(lua_State* state)
 {
     const char* name = file_logger::get_path();
     if (name)
+    {
+        // The caller may be about to read the file.
+        logger::get()->flush();
         lua_pushstring(state, name);
+    }
     else
         lua_pushnil(state);
     return 1;
@@ -0,0 +1,203 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "lua_allocator.h"
+
+#include <core/mem_stats.h>
+
+extern "C" {
+#include <lua.h>
+}
+
+#include <assert.h>
+
+//------------------------------------------------------------------------------
+lua_allocator::lua_allocator()
+{
+}
+
+//------------------------------------------------------------------------------
+lua_allocator::~lua_allocator()
+{
+    // Lua frees every block when the state is closed, so only the slabs are
+    // left.
+    assert(!m_large_blocks);
+
+    while (m_slabs)
+    {
+        char* next = *reinterpret_cast<char**>(m_slabs);
+        free(m_slabs);
+        m_slabs = next;
+    }
+
+    if (m_slab_count)
+        mem_stats::sub(mem_tag::lua, size_t(m_slab_count) * c_slab_size, m_slab_count);
+}
+
+//------------------------------------------------------------------------------
+// This is the lua_Alloc function; ud is the lua_allocator.
+void* lua_allocator::alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+    return static_cast<lua_allocator*>(ud)->realloc_block(ptr, osize, nsize);
+}
+
+//------------------------------------------------------------------------------
+lua_allocator* lua_allocator::from_state(lua_State* L)
+{
+    void* ud = nullptr;
+    if (lua_getallocf(L, &ud) != &alloc)
+        return nullptr;
+    return static_cast<lua_allocator*>(ud);
+}
+
+//------------------------------------------------------------------------------
+void lua_allocator::get_stats(stats& out) const
+{
+    out.slab_bytes = size_t(m_slab_count) * c_slab_size;
+    out.small_bytes = m_small_bytes;
+    out.large_bytes = m_large_bytes;
+    out.slabs = m_slab_count;
+    out.small_blocks = m_small_blocks;
+    out.large_blocks = m_large_blocks;
+}
+
+//------------------------------------------------------------------------------
+void* lua_allocator::realloc_block(void* ptr, size_t osize, size_t nsize)
+{
+    // When ptr is null, Lua passes the type of object in osize.
+    if (!ptr)
+        osize = 0;
+
+    const bool was_small = (ptr && osize <= c_max_small);
+
+    if (!nsize)
+    {
+        if (was_small)
+            free_small(ptr, size_class(osize));
+        else if (ptr)
+            free_large(ptr, osize);
+        return nullptr;
+    }
+
+    if (nsize > c_max_small)
+    {
+        if (!was_small)
+            return alloc_large(ptr, osize, nsize);
+
+        void* p = alloc_large(nullptr, 0, nsize);
+        if (p)
+        {
+            memcpy(p, ptr, osize);
+            free_small(ptr, size_class(osize));
+        }
+        return p;
+    }
+
+    const uint32 index = size_class(nsize);
+    if (was_small && size_class(osize) == index)
+        return ptr;
+
+    void* p = alloc_small(index);
+    if (!p)
+    {
+        // Lua assumes shrinking never fails.  A small block that's bigger than
+        // needed still works, but a large block can't become a small one.
+        return (was_small && nsize < osize) ? ptr : nullptr;
+    }
+
+    if (ptr)
+    {
+        memcpy(p, ptr, min(osize, nsize));
+        if (was_small)
+            free_small(ptr, size_class(osize));
+        else
+            free_large(ptr, osize);
+    }
+    return p;
+}
+
+//------------------------------------------------------------------------------
+void* lua_allocator::alloc_small(uint32 index)
+{
+    assert(index < c_classes);
+    const uint32 size = (index + 1) * c_granularity;
+
+    free_block* block = m_free[index];
+    if (block)
+    {
+        m_free[index] = block->next;
+    }
+    else
+    {
+        if (m_carve_end - m_carve < ptrdiff_t(size) && !new_slab())
+            return nullptr;
+        block = reinterpret_cast<free_block*>(m_carve);
+        m_carve += size;
+    }
+
+    m_small_bytes += size;
+    ++m_small_blocks;
+    return block;
+}
+
+//------------------------------------------------------------------------------
+void lua_allocator::free_small(void* ptr, uint32 index)
+{
+    assert(index < c_classes);
+    free_block* block = static_cast<free_block*>(ptr);
+    block->next = m_free[index];
+    m_free[index] = block;
+
+    m_small_bytes -= (index + 1) * c_granularity;
+    --m_small_blocks;
+}
+
+//------------------------------------------------------------------------------
+void* lua_allocator::alloc_large(void* ptr, size_t osize, size_t nsize)
+{
+    void* p = realloc(ptr, nsize);
+    if (!p)
+        return nullptr;
+
+    if (ptr)
+    {
+        mem_stats::sub(mem_tag::lua, osize, 0);
+        mem_stats::add(mem_tag::lua, nsize, 0);
+        m_large_bytes += nsize - osize;
+    }
+    else
+    {
+        mem_stats::add(mem_tag::lua, nsize);
+        m_large_bytes += nsize;
+        ++m_large_blocks;
+    }
+    return p;
+}
+
+//------------------------------------------------------------------------------
+void lua_allocator::free_large(void* ptr, size_t osize)
+{
+    free(ptr);
+    mem_stats::sub(mem_tag::lua, osize);
+    m_large_bytes -= osize;
+    --m_large_blocks;
+}
+
+//------------------------------------------------------------------------------
+// Starts a new slab.  The unused tail of the previous slab is abandoned; it's
+// always smaller than the largest size class.
+bool lua_allocator::new_slab()
+{
+    char* slab = static_cast<char*>(malloc(c_slab_size));
+    if (!slab)
+        return false;
+
+    *reinterpret_cast<char**>(slab) = m_slabs;
+    m_slabs = slab;
+    m_carve = slab + c_slab_header;
+    m_carve_end = slab + c_slab_size;
+    ++m_slab_count;
+    mem_stats::add(mem_tag::lua, c_slab_size);
+    return true;
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <core/base.h>
+
+struct lua_State;
+
+//------------------------------------------------------------------------------
+// Allocator for a Lua state.  Lua makes huge numbers of small allocations of a
+// few sizes (strings, tables, closures, upvalues), so small blocks are carved
+// from slabs and recycled through per size class free lists instead of going
+// to the CRT heap.  Larger blocks still go to the heap.
+//
+// A Lua state is only used by one thread at a time, so each state gets its own
+// allocator and there's no locking.  Slabs are only released when the state
+// is closed and the allocator is destroyed.
+class lua_allocator
+    : public no_copy
+{
+public:
+    struct stats
+    {
+        size_t          slab_bytes;         // Bytes in slabs.
+        size_t          small_bytes;        // Bytes in small blocks in use.
+        size_t          large_bytes;        // Bytes in large blocks.
+        uint32          slabs;
+        uint32          small_blocks;
+        uint32          large_blocks;
+    };
+
+                        lua_allocator();
+                        ~lua_allocator();
+    static void*        alloc(void* ud, void* ptr, size_t osize, size_t nsize);
+    static lua_allocator* from_state(lua_State* L);
+    void                get_stats(stats& out) const;
+
+private:
+    struct free_block
+    {
+        free_block*     next;
+    };
+
+    void*               realloc_block(void* ptr, size_t osize, size_t nsize);
+    void*               alloc_small(uint32 index);
+    void                free_small(void* ptr, uint32 index);
+    void*               alloc_large(void* ptr, size_t osize, size_t nsize);
+    void                free_large(void* ptr, size_t osize);
+    bool                new_slab();
+
+    static uint32       size_class(size_t size) { return uint32((size - 1) / c_granularity); }
+
+    static const uint32 c_granularity = 16;
+    static const uint32 c_max_small = 256;
+    static const uint32 c_classes = c_max_small / c_granularity;
+    static const uint32 c_slab_size = 64 * 1024;
+    static const uint32 c_slab_header = 16; // Keeps blocks 16 byte aligned.
+
+    free_block*         m_free[c_classes] = {};
+    char*               m_slabs = nullptr;  // Chain of slabs.
+    char*               m_carve = nullptr;  // Unused space in the newest slab.
+    char*               m_carve_end = nullptr;
+    size_t              m_small_bytes = 0;
+    size_t              m_large_bytes = 0;
+    uint32              m_slab_count = 0;
+    uint32              m_small_blocks = 0;
+    uint32              m_large_blocks = 0;
+};
@@ -0,0 +1,217 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "lua_bytecode_cache.h"
+#include "lua_state.h"
+
+#include <core/base.h>
+#include <core/os.h>
+#include <core/path.h>
+#include <core/str.h>
+#include <core/str_hash.h>
+#include <core/str_transform.h>
+#include <core/log.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+}
+
+//------------------------------------------------------------------------------
+static const char c_bytecode_magic[4] = { 'C', 'L', 'B', 'C' };
+static const uint32 c_bytecode_version = 1;
+
+//------------------------------------------------------------------------------
+// Small numbers of scripts aren't worth the cost of starting threads.
+static const uint32 c_max_compile_threads = 8;
+static const size_t c_files_per_compile_thread = 8;
+
+//------------------------------------------------------------------------------
+// The header is followed by the script's full path (folded to lowercase, not
+// NUL terminated), and then by the bytecode from lua_dump().
+struct bytecode_header
+{
+    char            magic[4];
+    uint32          version;
+    uint64          size;               // Size of the script file.
+    FILETIME        stamp;              // Last write time of the script file.
+    uint32          key_len;
+    uint32          reserved;
+};
+
+//------------------------------------------------------------------------------
+static bool make_cache_key(const char* path, str_base& key, bytecode_header& header)
+{
+    if (!os::get_full_path_name(path, key))
+        return false;
+
+    str_ascii_tolower(key.data());
+
+    wstr<280> wpath(path);
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(wpath.c_str(), GetFileExInfoStandard, &data) ||
+        (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        return false;
+
+    memcpy(header.magic, c_bytecode_magic, sizeof(c_bytecode_magic));
+    header.version = c_bytecode_version;
+    header.size = (uint64(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    header.stamp = data.ftLastWriteTime;
+    header.key_len = key.length();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+static bool load_from_cache(lua_State* L, const char* cache_file, const char* chunkname,
+                            const char* key, const bytecode_header& expected)
+{
+    wstr<280> wcache(cache_file);
+    HANDLE h = CreateFileW(wcache.c_str(), GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_DELETE,
+                           nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+
+    bool ok = false;
+    DWORD read;
+    bytecode_header header;
+    const DWORD file_size = GetFileSize(h, nullptr);
+    if (file_size != INVALID_FILE_SIZE &&
+        file_size > sizeof(header) + expected.key_len &&
+        ReadFile(h, &header, sizeof(header), &read, nullptr) &&
+        read == sizeof(header) &&
+        memcmp(header.magic, expected.magic, sizeof(header.magic)) == 0 &&
+        header.version == expected.version &&
+        header.size == expected.size &&
+        CompareFileTime(&header.stamp, &expected.stamp) == 0 &&
+        header.key_len == expected.key_len)
+    {
+        std::vector<char> data(file_size - sizeof(header));
+        if (ReadFile(h, data.data(), DWORD(data.size()), &read, nullptr) &&
+            read == data.size() &&
+            memcmp(data.data(), key, header.key_len) == 0)
+        {
+            // Mode "b" refuses anything other than a binary chunk, and Lua
+            // verifies the chunk's own header (version, sizes, and format).
+            const char* bytecode = data.data() + header.key_len;
+            const size_t len = data.size() - header.key_len;
+            if (luaL_loadbufferx(L, bytecode, len, chunkname, "b") == LUA_OK)
+                ok = true;
+            else
+                lua_pop(L, 1);
+        }
+    }
+
+    CloseHandle(h);
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+static int32 bytecode_writer(lua_State* L, const void* p, size_t sz, void* ud)
+{
+    auto* out = static_cast<std::vector<char>*>(ud);
+    out->insert(out->end(), static_cast<const char*>(p), static_cast<const char*>(p) + sz);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Saves the function on the top of the stack.
+static void save_to_cache(lua_State* L, const char* cache_dir, const char* cache_file,
+                          const char* key, const bytecode_header& header)
+{
+    std::vector<char> bytecode;
+    if (lua_dump(L, bytecode_writer, &bytecode) != 0 || bytecode.empty())
+        return;
+
+    os::make_dir(cache_dir);
+
+    // Write to a temporary file and then replace the cache file, so that other
+    // processes never see a partially written cache file.
+    str<280> tmp;
+    tmp.format("%s.%u", cache_file, GetCurrentProcessId());
+
+    wstr<280> wtmp(tmp.c_str());
+    HANDLE h = CreateFileW(wtmp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+        return;
+
+    DWORD written;
+    const DWORD bytecode_bytes = DWORD(bytecode.size());
+    bool ok = (WriteFile(h, &header, sizeof(header), &written, nullptr) && written == sizeof(header) &&
+               WriteFile(h, key, header.key_len, &written, nullptr) && written == header.key_len &&
+               WriteFile(h, bytecode.data(), bytecode_bytes, &written, nullptr) && written == bytecode_bytes);
+    CloseHandle(h);
+
+    wstr<280> wcache(cache_file);
+    if (ok)
+        ok = !!MoveFileExW(wtmp.c_str(), wcache.c_str(), MOVEFILE_REPLACE_EXISTING);
+    if (!ok)
+    {
+        LOG("unable to save bytecode cache '%s'; error %u", cache_file, GetLastError());
+        DeleteFileW(wtmp.c_str());
+    }
+}
+
+//------------------------------------------------------------------------------
+int32 load_file_cached(lua_State* L, const char* path, const char* cache_dir)
+{
+    str<280> key;
+    bytecode_header header = {};
+    if (!cache_dir || !*cache_dir || !make_cache_key(path, key, header))
+        return luaL_loadfile(L, path);
+
+    str<280> name;
+    name.format("%08x.luac", str_hash(key.c_str(), int32(key.length())));
+    str<280> cache_file;
+    path::join(cache_dir, name.c_str(), cache_file);
+
+    // Same chunk name as luaL_loadfile(), for error messages.
+    str<280> chunkname;
+    chunkname << "@" << path;
+
+    if (load_from_cache(L, cache_file.c_str(), chunkname.c_str(), key.c_str(), header))
+        return LUA_OK;
+
+    const int32 err = luaL_loadfile(L, path);
+    if (err == LUA_OK)
+        save_to_cache(L, cache_dir, cache_file.c_str(), key.c_str(), header);
+    return err;
+}
+
+//------------------------------------------------------------------------------
+void compile_files(lua_compiled_file* files, size_t count, const char* cache_dir)
+{
+    std::atomic<size_t> next(0);
+    auto worker = [&] ()
+    {
+        lua_State* L = luaL_newstate();
+        if (!L)
+            return;
+
+        for (size_t i; (i = next++) < count;)
+        {
+            lua_compiled_file& file = files[i];
+            lua_settop(L, 0);
+            if (load_file_cached(L, file.path.c_str(), cache_dir) != LUA_OK ||
+                lua_dump(L, bytecode_writer, &file.bytecode) != 0)
+                file.bytecode.clear();
+        }
+
+        lua_close(L);
+    };
+
+    const uint32 threads = clamp<uint32>(min<uint32>(std::thread::hardware_concurrency(), uint32(count / c_files_per_compile_thread)), 1, c_max_compile_threads);
+    std::vector<std::thread> helpers;
+    for (uint32 i = 1; i < threads; ++i)
+        helpers.emplace_back(worker);
+
+    worker();
+
+    for (auto& t : helpers)
+        t.join();
+}
@@ -0,0 +1,19 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+struct lua_State;
+struct lua_compiled_file;
+
+//------------------------------------------------------------------------------
+// Loads a Lua script file the same as luaL_loadfile(), but keeps the compiled
+// bytecode in CACHE_DIR so that loading the script again can skip parsing it.
+// Cache files are keyed by the script's full path, and are only used while the
+// script's last write time and size still match.
+int32 load_file_cached(lua_State* L, const char* path, const char* cache_dir);
+
+//------------------------------------------------------------------------------
+// Compiles each of FILES to bytecode on worker threads, each using its own
+// throwaway lua_State.  Files that fail to compile are left with no bytecode.
+void compile_files(lua_compiled_file* files, size_t count, const char* cache_dir);
@@ -165,6 +165,53 @@ void lua_editor_tester::set_expected_output(const char* expected)
     }
 }
 
+//------------------------------------------------------------------------------
+// When LATENCIES is set, run() records how many seconds each keystroke took to
+// process, and doesn't require any expectations.
+void lua_editor_tester::set_latencies(std::vector<double>* latencies)
+{
+    m_latencies = latencies;
+}
+
+//------------------------------------------------------------------------------
+// Translates a session recorded by 'clink echo' into input.  Each line holds
+// the key sequence for one key press in Readline's quoted key sequence syntax,
+// e.g. "\e[A" or "\C-a".  Lines that aren't quoted are ignored, and so is the
+// Ctrl-C that ends recording.
+void lua_editor_tester::translate_recorded_input(const char* in, str_base& out)
+{
+    out.clear();
+
+    str<> seq;
+    str<> translated;
+    while (*in)
+    {
+        const char* eol = strpbrk(in, "\r\n");
+        const uint32 len = uint32(eol ? eol - in : strlen(in));
+
+        if (len >= 2 && in[0] == '"' && in[len - 1] == '"')
+        {
+            seq.clear();
+            seq.concat(in + 1, len - 2);
+            if (seq.equals("Rubout"))
+            {
+                out.concat("\x7f", 1);
+            }
+            else if (!seq.equals("\\C-c"))
+            {
+                int32 translated_len = 0;
+                translated.reserve(seq.length() + 1);
+                if (rl_translate_keyseq(seq.c_str(), translated.data(), &translated_len) == 0)
+                    out.concat(translated.c_str(), translated_len);
+            }
+        }
+
+        in += len;
+        while (*in == '\r' || *in == '\n')
+            ++in;
+    }
+}
+
 //------------------------------------------------------------------------------
 static const char* sanitize(const char* text)
 {
@@ -203,7 +250,7 @@ bool lua_editor_tester::run(str_base& message)
 #define REQUIREEX(expr, code) if (!(expr)) { code; return false; }
 
     const bool has_expectations = m_has_matches || m_has_classifications || m_has_output;
-    REQUIRE(has_expectations, "missing expectations");
+    REQUIRE(has_expectations || m_latencies, "missing expectations");
 
     REQUIRE(m_has_input, "missing input");
     m_terminal_in.set_input(m_input.c_str());
@@ -218,7 +265,20 @@ bool lua_editor_tester::run(str_base& message)
     REQUIRE(m_editor->update(), "internal input failure");
     do
     {
+        const char* const before = m_terminal_in.get_read_pointer();
+        LARGE_INTEGER start;
+        QueryPerformanceCounter(&start);
+
         REQUIRE(m_editor->update(), "internal input failure");
+
+        // Only updates that consumed input count as keystrokes.
+        if (m_latencies && m_terminal_in.get_read_pointer() != before)
+        {
+            LARGE_INTEGER end, freq;
+            QueryPerformanceCounter(&end);
+            QueryPerformanceFrequency(&freq);
+            m_latencies->push_back(double(end.QuadPart - start.QuadPart) / double(freq.QuadPart));
+        }
     }
     while (rl_pending_input || m_terminal_in.has_input());
 
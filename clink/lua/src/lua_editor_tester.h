@@ -27,6 +27,7 @@ class test_terminal_in
 {
 public:
     bool                    has_input() const { return (m_read == nullptr) ? false : (*m_read != '\0'); }
+    const char*             get_read_pointer() const { return m_read; }
     void                    set_input(const char* input) { m_input = m_read = input; }
     virtual int32           begin(bool) override {}
     virtual int32           end(bool) override {}
@@ -52,6 +53,8 @@ public:
     virtual void            close() override {}
     virtual void            write(const char* chars, int32 length) override {}
     virtual void            flush() override {}
+    virtual void            begin_batch() override {}
+    virtual void            end_batch() override {}
     virtual int32           get_columns() const override { return 80; }
     virtual int32           get_rows() const override { return 25; }
     virtual bool            get_line_text(int32 line, str_base& out) const { return false; }
@@ -71,7 +74,9 @@ public:
     void                        set_expected_matches(std::vector<str_moveable>& matches);
     void                        set_expected_classifications(const char* classifications, bool mark_argmatchers=false);
     void                        set_expected_output(const char* output);
+    void                        set_latencies(std::vector<double>* latencies);
     bool                        run(str_base& message);
+    static void                 translate_recorded_input(const char* in, str_base& out);
 
 private:
     bool                        get_line(str_base& line);
@@ -90,6 +95,7 @@ private:
     std::vector<str_moveable>   m_expected_matches;
     str_moveable                m_expected_classifications;
     str_moveable                m_expected_output;
+    std::vector<double>*        m_latencies = nullptr;
     bool                        m_mark_argmatchers = false;
     bool                        m_has_input = false;
     bool                        m_has_matches = false;
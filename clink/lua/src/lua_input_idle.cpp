@@ -9,6 +9,7 @@
 
 #include <core/base.h>
 #include <lib/reclassify.h>
+#include <lib/deferred_init.h>
 #include <lib/line_editor_integration.h>
 
 #include <assert.h>
@@ -19,6 +20,9 @@ extern "C" {
 #include <lualib.h>
 }
 
+//------------------------------------------------------------------------------
+void prefetch_history_suggestions();
+
 //------------------------------------------------------------------------------
 static lua_input_idle* s_idle = nullptr;
 
@@ -39,17 +43,35 @@ static DWORD s_terminal_resized = 0;    // Tick count of most recent resize.
 // automatically rerunning the prompt filters.
 const DWORD c_terminal_resize_refilter_delay = 500;
 
+// When there's garbage to collect, run incremental collection steps for up to
+// c_idle_gc_budget milliseconds after every c_idle_gc_delay milliseconds of
+// idle time, until a collection cycle finishes.  Collection becomes pending
+// again once memory use grows by c_idle_gc_threshold_kb.
+const DWORD c_idle_gc_delay = 50;
+const uint32 c_idle_gc_budget = 4;
+const int32 c_idle_gc_threshold_kb = 256;
+
+// The coroutine timer may fire up to 1/c_timer_tolerance_divisor of the wait
+// late (but no more than c_max_timer_tolerance milliseconds late), so that
+// Windows can coalesce it with other timers in the system.
+const DWORD c_timer_tolerance_divisor = 10;
+const DWORD c_max_timer_tolerance = 500;
+
 //------------------------------------------------------------------------------
 lua_input_idle::lua_input_idle(lua_state& state)
 : m_state(state)
 {
     assert(!s_idle);
     s_idle = this;
+
+    m_timer = CreateWaitableTimerW(nullptr, false, nullptr);
 }
 
 //------------------------------------------------------------------------------
 lua_input_idle::~lua_input_idle()
 {
+    if (m_timer)
+        CloseHandle(m_timer);
     s_idle = nullptr;
 }
 
@@ -61,6 +83,8 @@ void lua_input_idle::reset()
 
     m_enabled = true;
     m_iterations = 0;
+    m_schedule_valid = false;
+    m_prefetch_pending = true;
 }
 
 //------------------------------------------------------------------------------
@@ -69,7 +93,8 @@ bool lua_input_idle::is_enabled()
     if (!m_enabled)
         return false;
 
-    if (!has_coroutines())
+    refresh_schedule();
+    if (!m_has_coroutines)
         m_enabled = false;
 
     return m_enabled;
@@ -88,26 +113,29 @@ uint32 lua_input_idle::get_timeout()
 
     m_iterations++;
 
-    if (!is_enabled())
-        return INFINITE;
-
-    lua_State* state = m_state.get_state();
-    save_stack_top ss(state);
+    DWORD timeout = INFINITE;
+    if (is_enabled() && m_has_target)
+    {
+        const DWORD remaining = m_target_tick - GetTickCount();
+        if (int32(remaining) <= 0)
+            timeout = 0;
+        else if (!arm_timer(remaining))
+            timeout = remaining;
+    }
+    else
+    {
+        cancel_timer();
+    }
 
-    // Call to Lua to check for coroutines.
-    lua_getglobal(state, "clink");
-    lua_pushliteral(state, "_wait_duration");
-    lua_rawget(state, -2);
+    if (is_gc_pending())
+        timeout = min<DWORD>(timeout, c_idle_gc_delay);
 
-    if (m_state.pcall(state, 0, 1) != 0)
-        return INFINITE;
+    timeout = min<DWORD>(timeout, get_speculate_matches_timeout());
 
-    int32 isnum;
-    double sec = lua_tonumberx(state, -1, &isnum);
-    if (!isnum)
-        return INFINITE;
+    if (m_prefetch_pending || has_deferred_init() || lua_state::is_standby_wanted())
+        timeout = 0;
 
-    return (sec > 0) ? uint32(sec * 1000) : 0;
+    return timeout;
 }
 
 //------------------------------------------------------------------------------
@@ -131,6 +159,7 @@ uint32 lua_input_idle::get_wait_events(void** events, size_t max)
     m_index_recognizer = add_event(events, index, total, max, get_recognizer_event());
     m_index_task_manager = add_event(events, index, total, max, get_task_manager_event());
     m_index_force_idle = add_event(events, index, total, max, get_idle_event());
+    m_index_timer = add_event(events, index, total, max, m_timer);
     assert(total <= max);
     return index;
 }
@@ -142,12 +171,17 @@ void lua_input_idle::on_wait_event(uint32 index)
     else if (index == m_index_recognizer)   refresh_recognizer();
     else if (index == m_index_task_manager) task_manager_on_idle(m_state);
     else if (index == m_index_force_idle)   on_idle();
+    else if (index == m_index_timer)        { m_timer_armed = false; on_idle(); }
     else                                    assert(false);
 }
 
 //------------------------------------------------------------------------------
 void lua_input_idle::on_idle()
 {
+    // Async operations signal the idle event when they become ready, which
+    // can change the schedule without any Lua code running.
+    m_schedule_valid = false;
+
     // Don't resume coroutines while the terminal resize timeout is in effect,
     // as that would bypass the resume frequency logic.
     if (s_terminal_resized)
@@ -177,12 +211,47 @@ void lua_input_idle::on_idle()
             resume_coroutines();
     }
 
+    // Collect garbage while idle, instead of while responding to input (see
+    // lua_gc_suspend).
+    if (m_gc_pending)
+    {
+        lua_State* state = m_state.get_state();
+        if (lua_state::step_gc(state, c_idle_gc_budget))
+        {
+            m_gc_pending = false;
+            m_gc_baseline_kb = lua_gc(state, LUA_GCCOUNT, 0);
+        }
+    }
+
+    // Finish deferred initialization one task per idle call, so that input
+    // stays responsive.  Prefetching uses the history, so it waits until the
+    // deferred initialization is finished.
+    if (has_deferred_init())
+    {
+        run_deferred_init();
+    }
+    else if (m_prefetch_pending)
+    {
+        m_prefetch_pending = false;
+        prefetch_history_suggestions();
+    }
+    else if (lua_state::is_standby_wanted())
+    {
+        lua_state::prepare_standby();
+    }
+
     if (s_signaled_delayed_init)
     {
         s_signaled_delayed_init = false;
         host_invalidate_matches();
     }
 
+    // Generate matches ahead of time once the cursor has rested at the end of
+    // a word long enough (see match.speculate_delay).  Generators may not be
+    // fully available until deferred initialization is finished.
+    if (!has_deferred_init())
+        speculate_matches();
+
     if (s_signaled_reclassify)
     {
         s_signaled_reclassify = false;
@@ -193,6 +262,7 @@ void lua_input_idle::on_idle()
 //------------------------------------------------------------------------------
 void lua_input_idle::kick()
 {
+    m_schedule_valid = false;
     if (!m_enabled && has_coroutines())
     {
         m_enabled = true;
@@ -253,6 +323,89 @@ bool lua_input_idle::has_coroutines()
     return has;
 }
 
+//------------------------------------------------------------------------------
+// The input loop asks for the timeout and wait events every time it wakes up,
+// but the coroutine schedule only changes when Lua code runs.  Asking Lua
+// only after some Lua code has run avoids walking the coroutine tables on
+// every wakeup (e.g. console events, or the recognizer or task manager events).
+void lua_input_idle::refresh_schedule()
+{
+    if (m_schedule_valid && m_schedule_serial == lua_state::get_call_serial())
+        return;
+
+    m_has_coroutines = has_coroutines();
+    m_has_target = false;
+
+    if (m_has_coroutines)
+    {
+        lua_State* state = m_state.get_state();
+        save_stack_top ss(state);
+
+        // Call to Lua to get the time until the next coroutine is due.
+        lua_getglobal(state, "clink");
+        lua_pushliteral(state, "_wait_duration");
+        lua_rawget(state, -2);
+
+        if (m_state.pcall(state, 0, 1) == 0)
+        {
+            int32 isnum;
+            const double sec = lua_tonumberx(state, -1, &isnum);
+            if (isnum)
+            {
+                m_has_target = true;
+                m_target_tick = GetTickCount() + ((sec > 0) ? DWORD(sec * 1000) : 0);
+            }
+        }
+    }
+
+    // Record the serial after the calls above, since they increment it.
+    m_schedule_valid = true;
+    m_schedule_serial = lua_state::get_call_serial();
+}
+
+//------------------------------------------------------------------------------
+bool lua_input_idle::arm_timer(DWORD remaining)
+{
+    if (!m_timer)
+        return false;
+
+    // The input loop asks for the timeout every time it wakes up; only reset
+    // the timer when the target changes.
+    if (m_timer_armed && m_timer_tick == m_target_tick)
+        return true;
+
+    LARGE_INTEGER due;
+    due.QuadPart = -LONGLONG(remaining) * 10000;    // Relative, in 100ns units.
+    const DWORD tolerance = min<DWORD>(remaining / c_timer_tolerance_divisor, c_max_timer_tolerance);
+    if (!SetWaitableTimerEx(m_timer, &due, 0, nullptr, nullptr, nullptr, tolerance))
+        return false;
+
+    m_timer_armed = true;
+    m_timer_tick = m_target_tick;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void lua_input_idle::cancel_timer()
+{
+    if (m_timer_armed)
+    {
+        CancelWaitableTimer(m_timer);
+        m_timer_armed = false;
+    }
+}
+
+//------------------------------------------------------------------------------
+bool lua_input_idle::is_gc_pending()
+{
+    if (!m_gc_pending)
+    {
+        const int32 kb = lua_gc(m_state.get_state(), LUA_GCCOUNT, 0);
+        m_gc_pending = (kb >= m_gc_baseline_kb + c_idle_gc_threshold_kb);
+    }
+    return m_gc_pending;
+}
+
 //------------------------------------------------------------------------------
 void lua_input_idle::resume_coroutines()
 {
@@ -9,6 +9,7 @@
 #include "line_state_lua.h"
 #include "line_states_lua.h"
 #include "match_builder_lua.h"
+#include "match_list_lua.h"
 
 #include <core/str_hash.h>
 #include <core/str_unordered_set.h>
@@ -31,6 +32,10 @@ char* __printable_part(char* pathname);
 
 #include <unordered_set>
 
+//------------------------------------------------------------------------------
+extern void start_glob_prefetch(const char* word);
+extern void cancel_glob_prefetch();
+
 //------------------------------------------------------------------------------
 lua_match_generator::lua_match_generator(lua_state& lua)
 : m_lua(&lua)
@@ -76,7 +81,15 @@ bool lua_match_generator::generate(const line_states& lines, match_builder& buil
 
     os::cwd_restorer cwd;
 
-    if (lua_state::pcall(state, 4, 1) != 0)
+    // Start enumerating files for the end word while the Lua generators run;
+    // os.globfiles() uses the results if it's asked for the same files.
+    str<280> endword;
+    lines.back().get_end_word(endword);
+    start_glob_prefetch(endword.c_str());
+
+    const bool ok = (lua_state::pcall(state, 4, 1) == 0);
+    cancel_glob_prefetch();
+    if (!ok)
         return false;
 
     int32 use_matches = lua_toboolean(state, -1);
@@ -118,61 +131,76 @@ void lua_match_generator::get_word_break_info(const line_state& line, word_break
 }
 
 //------------------------------------------------------------------------------
-static void push_match_fields(lua_State* state, const char* match, const match_details& details, str_base& tmp)
+// Reusing cached matches skips clink._generate(), so this clears any display
+// filter left over from the last time generators ran.
+void lua_match_generator::reset_display_filter()
 {
-    lua_pushliteral(state, "match");
+    lua_State* state = get_state();
+    save_stack_top ss(state);
+
+    lua_getglobal(state, "clink");
+    lua_pushliteral(state, "_reset_display_filter");
+    lua_rawget(state, -2);
+
+    lua_state::pcall(state, 0, 0);
+}
+
+//------------------------------------------------------------------------------
+bool lua_match_generator::get_lazy_description(const char* match, str_base& out)
+{
+    lua_State* state = get_state();
+    save_stack_top ss(state);
+
+    lua_getglobal(state, "clink");
+    lua_pushliteral(state, "_get_lazy_description");
+    lua_rawget(state, -2);
+
     lua_pushstring(state, match);
-    lua_rawset(state, -3);
-
-    lua_pushliteral(state, "type");
-    match_type_to_string(details.get_type(), tmp);
-    lua_pushlstring(state, tmp.c_str(), tmp.length());
-    lua_rawset(state, -3);
-
-    // The display field is special:
-    //  - When MATCH_FLAG_APPEND_DISPLAY is set, add it as "arginfo".
-    //  - When display and match are different, add it as "display".
-    //  - Otherwise do nothing with it.
-    const char* display = details.get_display();
-    if (display && *display)
-    {
-        if (details.get_flags() & MATCH_FLAG_APPEND_DISPLAY)
-        {
-            lua_pushliteral(state, "arginfo");
-            lua_pushstring(state, display);
-            lua_rawset(state, -3);
-        }
-        else if (strcmp(display, match))
-        {
-            lua_pushliteral(state, "display");
-            lua_pushstring(state, display);
-            lua_rawset(state, -3);
-        }
-    }
 
-    const char* description = details.get_description();
-    if (description && *description)
-    {
-        lua_pushliteral(state, "description");
-        lua_pushstring(state, description);
-        lua_rawset(state, -3);
-    }
+    if (lua_state::pcall(state, 1, 1) != 0)
+        return false;
 
-    char append_char = details.get_append_char();
-    if (append_char)
-    {
-        lua_pushliteral(state, "appendchar");
-        lua_pushlstring(state, &append_char, 1);
-        lua_rawset(state, -3);
-    }
+    if (!lua_isstring(state, -1))
+        return false;
+
+    out = lua_tostring(state, -1);
+    return true;
+}
 
-    uint8 flags = details.get_flags();
-    if (flags & MATCH_FLAG_HAS_SUPPRESS_APPEND)
+//------------------------------------------------------------------------------
+static void add_match_list(const match_list_lua& list, match_builder* builder)
+{
+    bool one_column = false;
+    for (uint32 i = 0; i < list.size(); ++i)
     {
-        lua_pushliteral(state, "suppressappend");
-        lua_pushboolean(state, !!(flags & MATCH_FLAG_SUPPRESS_APPEND));
-        lua_rawset(state, -3);
+        const char* match = list.at(i);
+        match_details details = lookup_match(match);
+
+        const uint8 flags = details.get_flags();
+        const bool append_display = !!(flags & MATCH_FLAG_APPEND_DISPLAY);
+        const char* display = details.get_display();
+        if (!display || !*display)
+            display = match;
+        const char* description = details.get_description();
+        if (description && !*description)
+            description = nullptr;
+
+        if (!display[0])
+            continue;
+
+        match_desc md(match, display, description, details.get_type());
+        md.append_char = details.get_append_char();
+        md.suppress_append = (flags & MATCH_FLAG_HAS_SUPPRESS_APPEND) ? !!(flags & MATCH_FLAG_SUPPRESS_APPEND) : -1;
+        md.append_display = append_display && display != match;
+        builder->add_match(md);
+
+        if (description)
+            one_column = true;
     }
+
+    builder->set_no_sort();
+    if (one_column)
+        builder->set_has_descriptions();
 }
 
 //------------------------------------------------------------------------------
@@ -181,6 +209,7 @@ bool lua_match_generator::match_display_filter(const char* needle, char** matche
     bool ret = false;
     lua_State* state = get_state();
     const bool selectable = (flags & display_filter_flags::selectable) == display_filter_flags::selectable;
+    lua_gc_suspend gc(state);
 
     // A small note about the contents of 'matches' - the first match isn't
     // really a match, it's the word being completed. Readline ignores it when
@@ -254,29 +283,18 @@ done:
     int32 match_count = only_lcd ? 1 : 0;
     for (i = 1; matches[i]; ++i, ++match_count);
 
-    // Convert matches to a Lua table.
-    lua_createtable(state, match_count, 0);
+    // Pass the matches as a match_list; the event dispatcher converts it to a
+    // table only for a filter that wants a table.
+    match_list_lua list(matches + (only_lcd ? 0 : 1), match_count);
     if (ondisplaymatches)
     {
-        str<> tmp;
-
-        int32 mi = only_lcd ? 0 : 1;
-        for (i = 1; i <= match_count; ++i)
-        {
-            const char* match = matches[mi++];
-            match_details details = lookup_match(match);
-
-            lua_createtable(state, 0, 2);
-
-            push_match_fields(state, match, details, tmp);
-
-            lua_rawseti(state, -2, i);
-        }
-
+        list.push(state);
         lua_pushboolean(state, selectable); // The "popup" argument.
     }
     else
     {
+        // Convert matches to a Lua table.
+        lua_createtable(state, match_count, 0);
         int32 mi = only_lcd ? 0 : 1;
         for (i = 1; i <= match_count; ++i)
         {
@@ -289,12 +307,19 @@ done:
     if (lua_state::pcall(state, ondisplaymatches ? 2 : 1, 1) != 0)
         goto done;
 
+    // A match_list can only have had matches removed or reordered, so its
+    // matches can be added without going through Lua.
+    if (match_list_lua::test(state, -1) == &list)
+    {
+        add_match_list(list, builder);
+        goto success;
+    }
+
     // Bail out if filter function didn't return a table.
     if (!lua_istable(state, -1))
         goto done;
 
     // Convert table returned by the Lua filter function to C.
-    int32 j = 1;
     bool one_column = false;
     int32 new_len = int32(lua_rawlen(state, -1));
     for (i = 1; i <= new_len; ++i)
@@ -440,21 +465,10 @@ bool lua_match_generator::filter_matches(char** matches, char completion_type, b
     if (lua_isnil(state, -1))
         return false;
 
-    // Convert matches to a Lua table (arg 1).
-    str<> tmp;
-    int32 mi = only_lcd ? 0 : 1;
-    lua_createtable(state, match_count, 0);
-    for (int32 i = 1; i <= match_count; ++i)
-    {
-        const char* match = matches[mi++];
-        match_details details = lookup_match(match);
-
-        lua_createtable(state, 0, 2);
-
-        push_match_fields(state, match, details, tmp);
-
-        lua_rawseti(state, -2, i);
-    }
+    // Pass the matches as a match_list (arg 1); the event dispatcher converts
+    // it to a table only for a filter that wants a table.
+    match_list_lua list(matches + (only_lcd ? 0 : 1), match_count);
+    list.push(state);
 
     // Push completion type (arg 2).
     char completion_type_str[2] = { completion_type };
@@ -471,9 +485,20 @@ bool lua_match_generator::filter_matches(char** matches, char completion_type, b
     if (lua_isnil(state, -1))
         return false;
 
+    // A match_list refers to the original match strings, so there's no need
+    // to look them up by name.
+    std::unordered_set<const char*> keep_list;
+    const bool use_list = (match_list_lua::test(state, -1) == &list);
+    if (use_list)
+    {
+        keep_list.reserve(list.size());
+        for (uint32 i = 0; i < list.size(); ++i)
+            keep_list.insert(list.at(i));
+    }
+
     // Hash the filtered matches to be kept.
     str_unordered_set keep_typeless;
-    int32 num_matches = int32(lua_rawlen(state, -1));
+    int32 num_matches = use_list ? 0 : int32(lua_rawlen(state, -1));
     for (int32 i = 1; i <= num_matches; ++i)
     {
         save_stack_top ss(state);
@@ -517,7 +542,10 @@ bool lua_match_generator::filter_matches(char** matches, char completion_type, b
     char** write = &matches[!only_lcd];
     while (*read)
     {
-        if (keep_typeless.find(*read) == keep_typeless.end())
+        const bool keep = (use_list ?
+                           keep_list.find(*read) != keep_list.end() :
+                           keep_typeless.find(*read) != keep_typeless.end());
+        if (!keep)
         {
             discarded = true;
             free(*read);
@@ -0,0 +1,501 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "lua_profiler.h"
+
+#include <core/base.h>
+#include <core/settings.h>
+#include <core/str.h>
+#include <core/str_unordered_set.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <vector>
+
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+}
+
+//------------------------------------------------------------------------------
+static setting_bool g_lua_profile(
+    "lua.profile",
+    "Profile Lua scripts",
+    "When enabled, Clink measures how much time and memory allocation each Lua\n"
+    "script function costs, and clink-diagnostics lists the most expensive ones.\n"
+    "This can help find which script is slowing down the prompt or input.  It\n"
+    "adds some overhead, so only enable it while investigating.  This can be\n"
+    "changed while Clink is running, and the measurements are reset whenever Lua\n"
+    "scripts are reloaded.  This also enables the timers and counters that\n"
+    "scripts report through clink.perf.",
+    false);
+
+//------------------------------------------------------------------------------
+static const int32 c_hook_count = 1000; // Instructions between samples.
+
+//------------------------------------------------------------------------------
+struct profile_entry
+{
+    str_moveable    src;
+    double          seconds = 0;
+    uint64          bytes = 0;
+    uint32          samples = 0;
+};
+
+// Keyed by the source string pointer (interned by Lua) and the line where the
+// function is defined, to avoid building a string for each sample.
+typedef std::pair<const void*, int32> profile_key;
+
+static std::map<profile_key, profile_entry> s_entries;
+static profile_entry* s_current = nullptr;  // Charged when time is unattributed.
+static bool s_enabled = false;
+static int32 s_depth = 0;
+static int64 s_mark = 0;
+static uint64 s_alloc_bytes = 0;
+static uint64 s_alloc_mark = 0;
+static lua_Alloc s_orig_alloc = nullptr;
+
+//------------------------------------------------------------------------------
+// Named timers and counters that scripts report through clink.perf.
+struct perf_entry
+{
+    str_moveable    name;
+    double          seconds = 0;
+    int64           start = 0;
+    uint32          depth = 0;          // Nested starts; only the outermost is timed.
+    uint32          calls = 0;
+    double          count = 0;
+};
+
+static str_unordered_map<perf_entry*> s_perf_map;
+static std::vector<std::unique_ptr<perf_entry>> s_perf_entries;
+
+//------------------------------------------------------------------------------
+static int64 get_ticks()
+{
+    LARGE_INTEGER li;
+    QueryPerformanceCounter(&li);
+    return li.QuadPart;
+}
+
+//------------------------------------------------------------------------------
+static double get_freq()
+{
+    static double s_freq = 0;
+    if (!s_freq)
+    {
+        LARGE_INTEGER li;
+        QueryPerformanceFrequency(&li);
+        s_freq = double(li.QuadPart);
+    }
+    return s_freq;
+}
+
+//------------------------------------------------------------------------------
+// Counts bytes allocated.  When ptr is null, osize is a type code rather than a
+// size, so it doesn't count as already allocated.
+static void* counting_alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+    const size_t old_size = ptr ? osize : 0;
+    if (nsize > old_size)
+        s_alloc_bytes += nsize - old_size;
+    return s_orig_alloc(ud, ptr, osize, nsize);
+}
+
+//------------------------------------------------------------------------------
+// Same rule as clink._is_internal_script() in core.lua.
+static bool is_internal_script(const char* short_src)
+{
+    return (strncmp(short_src, "~clink~", 7) == 0 && (short_src[7] == '/' || short_src[7] == '\\'));
+}
+
+//------------------------------------------------------------------------------
+static profile_entry* find_entry(lua_State* L)
+{
+    lua_Debug ar;
+    for (int32 level = 0; lua_getstack(L, level, &ar); ++level)
+    {
+        if (!lua_getinfo(L, "S", &ar) || ar.what[0] == 'C')
+            continue;
+        if (is_internal_script(ar.short_src))
+            continue;
+
+        profile_key key(ar.source, ar.linedefined);
+        auto iter = s_entries.find(key);
+        if (iter == s_entries.end())
+        {
+            iter = s_entries.emplace(key, profile_entry()).first;
+            iter->second.src.format("%s:%d", ar.short_src, ar.linedefined);
+        }
+        return &iter->second;
+    }
+
+    profile_key key(nullptr, 0);
+    auto iter = s_entries.find(key);
+    if (iter == s_entries.end())
+    {
+        iter = s_entries.emplace(key, profile_entry()).first;
+        iter->second.src = "(clink)";
+    }
+    return &iter->second;
+}
+
+//------------------------------------------------------------------------------
+// Charges the time and allocations since the last mark to the current entry.
+static void charge()
+{
+    const int64 now = get_ticks();
+    if (s_current)
+    {
+        s_current->seconds += double(now - s_mark) / get_freq();
+        s_current->bytes += s_alloc_bytes - s_alloc_mark;
+        s_current->samples++;
+    }
+    s_mark = now;
+    s_alloc_mark = s_alloc_bytes;
+}
+
+//------------------------------------------------------------------------------
+static void hook(lua_State* L, lua_Debug* ar)
+{
+    // Coroutines inherit the hook, so they may still have it after profiling
+    // is turned off.
+    if (!s_enabled)
+    {
+        lua_sethook(L, nullptr, 0, 0);
+        return;
+    }
+
+    if (ar->event == LUA_HOOKCOUNT)
+    {
+        // The first sample after entering Lua also covers the time before it.
+        profile_entry* entry = find_entry(L);
+        if (!s_current)
+            s_current = entry;
+        charge();
+        s_current = entry;
+    }
+}
+
+//------------------------------------------------------------------------------
+static lua_State* get_main_thread(lua_State* L)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+    lua_State* main = lua_tothread(L, -1);
+    lua_pop(L, 1);
+    return main;
+}
+
+//------------------------------------------------------------------------------
+static void enable(lua_State* L, bool enable)
+{
+    if (enable == s_enabled)
+        return;
+
+    s_enabled = enable;
+
+    void* ud;
+    const lua_Alloc alloc = lua_getallocf(L, &ud);
+    lua_State* main = get_main_thread(L);
+    if (enable)
+    {
+        if (alloc != counting_alloc)
+        {
+            s_orig_alloc = alloc;
+            lua_setallocf(L, counting_alloc, ud);
+        }
+        lua_sethook(main, hook, LUA_MASKCOUNT, c_hook_count);
+        if (L != main)
+            lua_sethook(L, hook, LUA_MASKCOUNT, c_hook_count);
+    }
+    else
+    {
+        if (alloc == counting_alloc)
+            lua_setallocf(L, s_orig_alloc, ud);
+        lua_sethook(main, nullptr, 0, 0);
+        if (L != main)
+            lua_sethook(L, nullptr, 0, 0);
+    }
+}
+
+
+
+//------------------------------------------------------------------------------
+lua_profile_scope::lua_profile_scope(lua_State* L)
+{
+    if (s_depth++ > 0)
+        return;
+
+    // The setting can change at any time.
+    enable(L, g_lua_profile.get());
+
+    if (s_enabled)
+    {
+        s_mark = get_ticks();
+        s_alloc_mark = s_alloc_bytes;
+        s_current = nullptr;
+    }
+}
+
+//------------------------------------------------------------------------------
+lua_profile_scope::~lua_profile_scope()
+{
+    assert(s_depth > 0);
+    if (--s_depth > 0 || !s_enabled)
+        return;
+
+    // Charge the time since the last sample to whatever was running then.
+    charge();
+    s_current = nullptr;
+}
+
+
+
+//------------------------------------------------------------------------------
+static perf_entry* get_perf_entry(lua_State* L)
+{
+    const char* name = luaL_checkstring(L, 1);
+    auto iter = s_perf_map.find(name);
+    if (iter != s_perf_map.end())
+        return iter->second;
+
+    s_perf_entries.emplace_back(std::make_unique<perf_entry>());
+    perf_entry* entry = s_perf_entries.back().get();
+    entry->name = name;
+    s_perf_map.emplace(entry->name.c_str(), entry);
+    return entry;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  clink.perf.start
+/// -ver:   1.6.17
+/// -arg:   name:string
+/// Starts the timer named <span class="arg">name</span>.  Each start should be
+/// paired with a <a href="#clink.perf.stop">clink.perf.stop()</a> for the same
+/// name.  Nested starts of the same name are allowed, and only the outermost
+/// pair is timed, so recursive functions aren't counted more than once.
+///
+/// Timers and counters only record anything while the
+/// <code><a href="#lua_profile">lua.profile</a></code> setting is enabled;
+/// otherwise they return immediately.  The results are listed by
+/// <code>clink-diagnostics</code> (<kbd>Ctrl</kbd>-<kbd>X</kbd>,<kbd>Ctrl</kbd>-<kbd>Z</kbd>)
+/// alongside the other profiling information.
+/// -show:  clink.perf.start("git status")
+/// -show:  local r = io.popen("git status --porcelain 2>nul")
+/// -show:  -- etc
+/// -show:  clink.perf.stop("git status")
+static int32 perf_start(lua_State* L)
+{
+    if (!g_lua_profile.get())
+        return 0;
+
+    perf_entry* entry = get_perf_entry(L);
+    if (entry->depth++ == 0)
+        entry->start = get_ticks();
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  clink.perf.stop
+/// -ver:   1.6.17
+/// -arg:   name:string
+/// Stops the timer named <span class="arg">name</span>, and adds the elapsed
+/// time since the matching
+/// <a href="#clink.perf.start">clink.perf.start()</a> to its total.
+static int32 perf_stop(lua_State* L)
+{
+    if (!g_lua_profile.get())
+        return 0;
+
+    perf_entry* entry = get_perf_entry(L);
+    if (!entry->depth)
+        return 0;   // The setting was enabled between start and stop.
+
+    if (--entry->depth == 0)
+    {
+        entry->seconds += double(get_ticks() - entry->start) / get_freq();
+        entry->calls++;
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  clink.perf.count
+/// -ver:   1.6.17
+/// -arg:   name:string
+/// -arg:   [amount:number]
+/// Adds <span class="arg">amount</span> to the counter named
+/// <span class="arg">name</span>.  If <span class="arg">amount</span> is
+/// omitted, it adds 1.
+/// -show:  clink.perf.count("my_generator cache misses")
+static int32 perf_count(lua_State* L)
+{
+    if (!g_lua_profile.get())
+        return 0;
+
+    perf_entry* entry = get_perf_entry(L);
+    entry->count += luaL_optnumber(L, 2, 1);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  clink.perf.measure
+/// -ver:   1.6.17
+/// -arg:   name:string
+/// -arg:   func:function
+/// -arg:   [...]:any
+/// -ret:   ...
+/// Calls <span class="arg">func</span> with the remaining arguments, and times
+/// it as the timer named <span class="arg">name</span>.  Returns whatever
+/// <span class="arg">func</span> returns.  If <span class="arg">func</span>
+/// raises an error, the timer is stopped and the error is passed along.
+/// -show:  local function my_filter(prompt)
+/// -show:  &nbsp;   -- etc
+/// -show:  end
+/// -show:
+/// -show:  local pf = clink.promptfilter(50)
+/// -show:  function pf:filter(prompt)
+/// -show:  &nbsp;   return clink.perf.measure("my prompt filter", my_filter, prompt)
+/// -show:  end
+static int32 perf_measure(lua_State* L)
+{
+    luaL_checkstring(L, 1);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+
+    const int32 nargs = lua_gettop(L) - 2;
+    if (!g_lua_profile.get())
+    {
+        lua_call(L, nargs, LUA_MULTRET);
+        return lua_gettop(L) - 1;
+    }
+
+    perf_entry* entry = get_perf_entry(L);
+    if (entry->depth++ == 0)
+        entry->start = get_ticks();
+
+    const int32 status = lua_pcall(L, nargs, LUA_MULTRET, 0);
+
+    // The entry stays valid even if the call reloaded scripts, because the
+    // registry is only reset when the Lua state closes.
+    if (entry->depth && --entry->depth == 0)
+    {
+        entry->seconds += double(get_ticks() - entry->start) / get_freq();
+        entry->calls++;
+    }
+
+    if (status != LUA_OK)
+        return lua_error(L);
+    return lua_gettop(L) - 1;
+}
+
+
+
+namespace lua_profiler
+{
+
+//------------------------------------------------------------------------------
+// Called when the Lua state is closed, since the keys point into it.
+void reset()
+{
+    s_entries.clear();
+    s_current = nullptr;
+    s_enabled = false;
+    s_perf_map.clear();
+    s_perf_entries.clear();
+}
+
+//------------------------------------------------------------------------------
+void push_perf_api(lua_State* L)
+{
+    static const luaL_Reg methods[] = {
+        { "start",      &perf_start },
+        { "stop",       &perf_stop },
+        { "count",      &perf_count },
+        { "measure",    &perf_measure },
+        {}
+    };
+
+    lua_createtable(L, 0, sizeof_array(methods) - 1);
+    luaL_setfuncs(L, methods, 0);
+}
+
+//------------------------------------------------------------------------------
+// UNDOCUMENTED; internal use only.  Returns whether profiling is enabled, and
+// a table of { src, ms, kb, samples } sorted by time, most expensive first.
+int32 get_profile(lua_State* L)
+{
+    std::vector<const profile_entry*> sorted;
+    sorted.reserve(s_entries.size());
+    for (const auto& iter : s_entries)
+        sorted.push_back(&iter.second);
+    std::sort(sorted.begin(), sorted.end(), [](const profile_entry* a, const profile_entry* b) {
+        return a->seconds > b->seconds;
+    });
+
+    lua_pushboolean(L, g_lua_profile.get());
+
+    lua_createtable(L, int32(sorted.size()), 0);
+    int32 i = 0;
+    for (const profile_entry* entry : sorted)
+    {
+        lua_createtable(L, 0, 4);
+
+        lua_pushliteral(L, "src");
+        lua_pushlstring(L, entry->src.c_str(), entry->src.length());
+        lua_rawset(L, -3);
+
+        lua_pushliteral(L, "ms");
+        lua_pushnumber(L, entry->seconds * 1000);
+        lua_rawset(L, -3);
+
+        lua_pushliteral(L, "kb");
+        lua_pushnumber(L, double(entry->bytes) / 1024);
+        lua_rawset(L, -3);
+
+        lua_pushliteral(L, "samples");
+        lua_pushinteger(L, entry->samples);
+        lua_rawset(L, -3);
+
+        lua_rawseti(L, -2, ++i);
+    }
+
+    return 2;
+}
+
+//------------------------------------------------------------------------------
+// UNDOCUMENTED; internal use only.  Returns a table of the clink.perf timers
+// and counters as { name, ms, calls, count }, in the order they were first
+// used.
+int32 get_perf(lua_State* L)
+{
+    lua_createtable(L, int32(s_perf_entries.size()), 0);
+    int32 i = 0;
+    for (const auto& entry : s_perf_entries)
+    {
+        lua_createtable(L, 0, 4);
+
+        lua_pushliteral(L, "name");
+        lua_pushlstring(L, entry->name.c_str(), entry->name.length());
+        lua_rawset(L, -3);
+
+        lua_pushliteral(L, "ms");
+        lua_pushnumber(L, entry->seconds * 1000);
+        lua_rawset(L, -3);
+
+        lua_pushliteral(L, "calls");
+        lua_pushinteger(L, entry->calls);
+        lua_rawset(L, -3);
+
+        lua_pushliteral(L, "count");
+        lua_pushnumber(L, entry->count);
+        lua_rawset(L, -3);
+
+        lua_rawseti(L, -2, ++i);
+    }
+
+    return 1;
+}
+
+}; // namespace lua_profiler
@@ -0,0 +1,32 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+struct lua_State;
+
+//------------------------------------------------------------------------------
+// When the lua.profile setting is enabled, a count hook samples which script
+// is running every so often, and the time and allocations since the previous
+// sample are charged to the innermost function on the stack that isn't part of
+// Clink's own scripts.  That identifies the script (and the function in it)
+// responsible for the cost, even when it runs inside Clink's event, generator,
+// prompt filter, or coroutine dispatchers.
+//
+// The profiler only runs while Lua is being called from C++, so time spent
+// waiting at the prompt is never charged to a script.
+class lua_profile_scope
+{
+public:
+                    lua_profile_scope(lua_State* L);
+                    ~lua_profile_scope();
+};
+
+//------------------------------------------------------------------------------
+namespace lua_profiler
+{
+void                reset();
+int32               get_profile(lua_State* L);  // Lua API:  clink._get_profile().
+int32               get_perf(lua_State* L);     // Lua API:  clink._get_perf().
+void                push_perf_api(lua_State* L);
+};
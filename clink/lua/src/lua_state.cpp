@@ -3,24 +3,33 @@
 
 #include "pch.h"
 #include "lua_state.h"
+#include "lua_allocator.h"
+#include "lua_bytecode_cache.h"
+#include "lua_profiler.h"
 #include "lua_script_loader.h"
 #include "lua_task_manager.h"
+#include "lua_word_classifier.h"
 #include "rl_buffer_lua.h"
 #include "line_state_lua.h"
 
 #include <core/settings.h>
+#include <core/startup_profile.h>
 #include <core/str.h>
 #include <core/str_tokeniser.h>
 #include <core/os.h>
 #include <core/debugheap.h>
+#include <core/log.h>
+#include <core/mem_stats.h>
 #include <lib/cmd_tokenisers.h>
 #include <lib/recognizer.h>
 #include <lib/line_editor_integration.h>
 #include <lib/rl_integration.h>
+#include <terminal/printer.h>
 #include <terminal/terminal_helpers.h>
 
 #include <memory>
 #include <assert.h>
+#include <time.h>
 
 extern "C" {
 #include <lua.h>
@@ -52,6 +61,49 @@ static setting_str g_lua_path(
     "in require() statements.",
     "");
 
+static setting_bool g_lua_bytecode_cache(
+    "lua.bytecode_cache",
+    "Caches compiled Lua scripts",
+    "When enabled, Lua scripts that are loaded from files are compiled once and\n"
+    "the compiled bytecode is saved in the profile directory.  Loading a script\n"
+    "again uses the saved bytecode until the script file changes.",
+    true);
+
+static setting_int g_lua_gc_pause(
+    "lua.gc_pause",
+    "Lua garbage collector pause",
+    "How long the Lua garbage collector waits before starting a new cycle, as a\n"
+    "percentage of the memory in use after the previous cycle.  200 waits until\n"
+    "memory use doubles; smaller values collect more often.",
+    200);
+
+static setting_int g_lua_gc_stepmul(
+    "lua.gc_stepmul",
+    "Lua garbage collector step multiplier",
+    "How much work the Lua garbage collector does per step, relative to memory\n"
+    "allocation, as a percentage.  Larger values make the collector more\n"
+    "aggressive but make each step longer.",
+    200);
+
+static setting_int g_lua_memory_soft_cap(
+    "lua.memory_soft_cap",
+    "Soft limit for Lua memory (MB)",
+    "When the Lua scripts use more than this many megabytes, Clink runs a full\n"
+    "garbage collection the next time it's idle, instead of the usual small\n"
+    "collection steps.  It doesn't stop scripts from using more.  0 means no\n"
+    "limit.",
+    0);
+
+static setting_int g_lua_max_async_commands(
+    "lua.max_async_commands",
+    "Limit for commands running in parallel",
+    "The most commands that coroutines can run at the same time through\n"
+    "io.popenyield(), os.executeyield(), or io.popen() and os.execute() inside\n"
+    "coroutines.  More wait until one finishes, and prompt filters get the first\n"
+    "turn.  This keeps a burst of scripts from starting dozens of processes at\n"
+    "once on small machines.  0 means no limit.",
+    8);
+
 static setting_bool g_lua_tracebackonerror(
     "lua.traceback_on_error",
     "Prints stack trace on Lua errors",
@@ -84,6 +136,7 @@ setting_bool g_lua_strict(
 void clink_lua_initialise(lua_state&, bool lua_interpreter=false);
 void os_lua_initialise(lua_state&);
 void io_lua_initialise(lua_state&);
+void json_lua_initialise(lua_state&);
 void console_lua_initialise(lua_state&);
 void path_lua_initialise(lua_state&);
 void rl_lua_initialise(lua_state&, bool lua_interpreter=false);
@@ -91,6 +144,7 @@ void settings_lua_initialise(lua_state&);
 void string_lua_initialise(lua_state&);
 void unicode_lua_initialise(lua_state&);
 void log_lua_initialise(lua_state&);
+void prefetch_shares(const char* line);
 
 
 
@@ -175,10 +229,23 @@ bool lua_state::s_internal = false;
 bool lua_state::s_interpreter = false;
 bool lua_state::s_in_luafunc = false;
 bool lua_state::s_in_onfiltermatches = false;
+bool lua_state::s_preparing_standby = false;
+uint32 lua_state::s_call_serial = 0;
+uint32 lua_state::s_pcall_depth = 0;
 #ifdef DEBUG
 bool lua_state::s_in_coroutine = false;
 #endif
 
+//------------------------------------------------------------------------------
+#ifndef USE_MEMORY_TRACKING
+// The same as the panic handler that luaL_newstate() sets.
+static int32 panic(lua_State* L)
+{
+    fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", lua_tostring(L, -1));
+    return 0;
+}
+#endif
+
 //------------------------------------------------------------------------------
 lua_state::lua_state(lua_state_flags flags)
 : m_state(nullptr)
@@ -192,6 +259,40 @@ lua_state::~lua_state()
     shutdown();
 }
 
+//------------------------------------------------------------------------------
+// Reloading scripts replaces the whole Lua state.  Once a reload has happened,
+// more are likely (lua.reload_scripts, or editing a script and reloading), so
+// a spare state with the core scripts already loaded is prepared while idle,
+// and the next initialise() adopts it instead of running the core scripts.
+static struct
+{
+    lua_State*          state = nullptr;
+    lua_allocator*      allocator = nullptr;
+    lua_state_flags     flags = lua_state_flags::none;
+    bool                debugger = false;
+    bool                debug = false;
+    str_moveable        package_path;
+} s_standby;
+
+static uint32 s_initialise_count = 0;
+
+//------------------------------------------------------------------------------
+static void get_package_path(str_base& out)
+{
+    out.clear();
+    if (!os::get_env("lua_path_" LUA_VERSION_MAJOR "_" LUA_VERSION_MINOR, out))
+        os::get_env("lua_path", out);
+
+    const char* p = g_lua_path.get();
+    if (*p)
+    {
+        if (!out.empty())
+            out << ";";
+
+        out << p;
+    }
+}
+
 //------------------------------------------------------------------------------
 void lua_state::initialise(lua_state_flags flags)
 {
@@ -200,12 +301,63 @@ void lua_state::initialise(lua_state_flags flags)
     shutdown();
 
     const bool interpreter = !!int32(flags & lua_state_flags::interpreter);
-    const bool no_env = !!int32(flags & lua_state_flags::no_env);
 
     s_interpreter = interpreter;
 
-    // Create a new Lua state.
+    startup_phase phase("lua_state::initialise");
+    os::high_resolution_clock clock;
+
+    str<280> path;
+    get_package_path(path);
+
+    clear_deprecated_argmatchers();
+
+    const bool debugger = g_force_load_debugger || g_lua_debug.get();
+    if (s_standby.state &&
+        s_standby.flags == flags &&
+        s_standby.debugger == debugger &&
+        s_standby.debug == g_lua_debug.get() &&
+        path.equals(s_standby.package_path.c_str()))
+    {
+        m_state = s_standby.state;
+        m_allocator = s_standby.allocator;
+        s_standby.state = nullptr;
+        s_standby.allocator = nullptr;
+
+        // Loading the core scripts resets these, but that was skipped while
+        // preparing the standby state so the live state wasn't affected.
+        lua_word_classifier::reset_native_classify();
+        reset_generate_matches();
+
+        apply_gc_settings(m_state);
+        LOG("Adopted prepared Lua core state");
+    }
+    else
+    {
+        discard_standby();
+        load_core(flags, path.c_str());
+        LOG("Initialized Lua core scripts in %u ms", unsigned(clock.elapsed() * 1000));
+    }
+
+    if (!interpreter)
+        s_initialise_count++;
+}
+
+//------------------------------------------------------------------------------
+void lua_state::load_core(lua_state_flags flags, const char* package_path)
+{
+    const bool interpreter = !!int32(flags & lua_state_flags::interpreter);
+    const bool no_env = !!int32(flags & lua_state_flags::no_env);
+
+    // Create a new Lua state.  Debug builds use the debug heap for Lua, so
+    // that it can check each allocation.
+#ifdef USE_MEMORY_TRACKING
     m_state = luaL_newstate();
+#else
+    m_allocator = new lua_allocator;
+    m_state = lua_newstate(&lua_allocator::alloc, m_allocator);
+    lua_atpanic(m_state, &panic);
+#endif
 
     // Suspend collection during initialization.
     lua_gc(m_state, LUA_GCSTOP, 0);
@@ -221,24 +373,11 @@ void lua_state::initialise(lua_state_flags flags)
     luaL_openlibs(m_state);
 
     // Set up the package.path value for require() statements.
-    str<280> path;
-    if (!os::get_env("lua_path_" LUA_VERSION_MAJOR "_" LUA_VERSION_MINOR, path))
-        os::get_env("lua_path", path);
-
-    const char* p = g_lua_path.get();
-    if (*p)
-    {
-        if (!path.empty())
-            path << ";";
-
-        path << p;
-    }
-
-    if (!path.empty())
+    if (*package_path)
     {
         lua_getglobal(m_state, "package");
         lua_pushliteral(m_state, "path");
-        lua_pushlstring(m_state, path.c_str(), path.length());
+        lua_pushstring(m_state, package_path);
         lua_rawset(m_state, -3);
     }
 
@@ -253,6 +392,7 @@ void lua_state::initialise(lua_state_flags flags)
     rl_lua_initialise(self, interpreter);
     settings_lua_initialise(self);
     string_lua_initialise(self);
+    json_lua_initialise(self);
     unicode_lua_initialise(self);
     log_lua_initialise(self);
 
@@ -279,6 +419,59 @@ void lua_state::initialise(lua_state_flags flags)
     }
 
     lua_gc(m_state, LUA_GCRESTART, 0);  // Resume collection.
+    apply_gc_settings(m_state);
+}
+
+//------------------------------------------------------------------------------
+bool lua_state::is_standby_wanted()
+{
+    if (s_standby.state || s_interpreter || s_internal || is_in_pcall())
+        return false;
+    return s_initialise_count > 1;
+}
+
+//------------------------------------------------------------------------------
+void lua_state::prepare_standby()
+{
+    if (!is_standby_wanted())
+        return;
+
+    os::high_resolution_clock clock;
+
+    str<280> path;
+    get_package_path(path);
+
+    // The core scripts reset some global state while loading; that would
+    // affect the live state, so it's skipped here and done when the standby
+    // state is adopted.
+    lua_state standby { standby_tag() };
+    s_preparing_standby = true;
+    standby.load_core(lua_state_flags::none, path.c_str());
+    s_preparing_standby = false;
+
+    s_standby.state = standby.m_state;
+    s_standby.allocator = standby.m_allocator;
+    s_standby.flags = lua_state_flags::none;
+    s_standby.debugger = g_force_load_debugger || g_lua_debug.get();
+    s_standby.debug = g_lua_debug.get();
+    s_standby.package_path = path.c_str();
+    standby.m_state = nullptr;
+    standby.m_allocator = nullptr;
+
+    LOG("Prepared standby Lua core state in %u ms", unsigned(clock.elapsed() * 1000));
+}
+
+//------------------------------------------------------------------------------
+void lua_state::discard_standby()
+{
+    if (!s_standby.state)
+        return;
+
+    lua_close(s_standby.state);
+    s_standby.state = nullptr;
+
+    delete s_standby.allocator;
+    s_standby.allocator = nullptr;
 }
 
 //------------------------------------------------------------------------------
@@ -289,9 +482,13 @@ void lua_state::shutdown()
 
     shutdown_task_manager(false/*final*/);
 
+    lua_profiler::reset();
     lua_close(m_state);
     m_state = nullptr;
 
+    delete m_allocator;
+    m_allocator = nullptr;
+
     s_interpreter = false;
 }
 
@@ -344,7 +541,10 @@ bool lua_state::do_file(const char* path)
 
     save_stack_top ss(L);
 
-    int32 err = luaL_loadfile(L, path);
+    // Internal scripts are only loaded from files in debug builds, where
+    // they're being edited, so only user scripts use the bytecode cache.
+    const bool use_cache = (!is_internal() && g_lua_bytecode_cache.get());
+    int32 err = load_file_cached(L, path, use_cache ? m_bytecode_cache_dir.c_str() : nullptr);
     if (err)
     {
         if (g_lua_debug.get())
@@ -362,6 +562,36 @@ bool lua_state::do_file(const char* path)
     return true;
 }
 
+//------------------------------------------------------------------------------
+// Compiles the files in parallel, so that loading many scripts only has to wait
+// for executing them one by one.  Use do_compiled_file() to execute them.
+void lua_state::compile_files(std::vector<lua_compiled_file>& files) const
+{
+    const bool use_cache = (!is_internal() && g_lua_bytecode_cache.get());
+    ::compile_files(files.data(), files.size(), use_cache ? m_bytecode_cache_dir.c_str() : nullptr);
+}
+
+//------------------------------------------------------------------------------
+bool lua_state::do_compiled_file(const lua_compiled_file& file)
+{
+    // If compiling failed, do_file() compiles it again and reports the error.
+    if (file.bytecode.empty())
+        return do_file(file.path.c_str());
+
+    lua_State* L = get_state();
+
+    save_stack_top ss(L);
+
+    // Same chunk name as luaL_loadfile(), for error messages.
+    str<280> chunkname;
+    chunkname << "@" << file.path.c_str();
+
+    if (luaL_loadbufferx(L, file.bytecode.data(), file.bytecode.size(), chunkname.c_str(), "b") != LUA_OK)
+        return do_file(file.path.c_str());
+
+    return pcall(L, 0, LUA_MULTRET) == 0;
+}
+
 //------------------------------------------------------------------------------
 bool lua_state::push_named_function(lua_State* L, const char* func_name, str_base* e)
 {
@@ -436,6 +666,13 @@ int32 lua_state::pcall_silent(lua_State* L, int32 nargs, int32 nresults)
     GetConsoleMode(hOut, &modeOut);
     modeIn = cleanup_console_input_mode(modeIn);
 
+    // Lets callers tell whether any Lua code may have run since they last
+    // looked at Lua state.
+    ++s_call_serial;
+
+    lua_profile_scope profile(L);
+    mem_tag_scope tag(mem_tag::lua);
+
     // Calculate stack position for message handler.
     int32 hpos = lua_gettop(L) - nargs;
 
@@ -446,7 +683,16 @@ int32 lua_state::pcall_silent(lua_State* L, int32 nargs, int32 nresults)
     lua_insert(L, hpos);
 
     // Call lua_pcall with custom handler.
-    int32 ret = lua_pcall(L, nargs, nresults, hpos);
+    int32 ret;
+    {
+        rollback<uint32> rb_depth(s_pcall_depth, s_pcall_depth + 1);
+        ret = lua_pcall(L, nargs, nresults, hpos);
+    }
+
+    // Output printed by the callback is held until it returns (see
+    // clink_print), so that printing many lines writes to the console once.
+    if (!s_pcall_depth && g_printer)
+        g_printer->release_output();
 
     // Remove custom error message handler from stack.
     lua_remove(L, hpos);
@@ -468,6 +714,8 @@ int32 lua_state::pcall(lua_State* L, int32 nargs, int32 nresults, str_base* erro
             *error = errmsg;
         else if (errmsg)
         {
+            if (g_printer)
+                g_printer->release_output();
             puts("");
             puts(errmsg);
         }
@@ -537,6 +785,94 @@ void dump_lua_stack(lua_State* L, int32 pos)
 }
 #endif
 
+//------------------------------------------------------------------------------
+// Pushes the list of callbacks registered for event_name.  If there are none,
+// then nothing is pushed and it returns false.  This only looks in tables, so
+// events without handlers never need to call into Lua.
+static bool push_event_callbacks(lua_State* L, const char* event_name)
+{
+    lua_getglobal(L, "clink");
+    if (!lua_istable(L, -1))
+    {
+        lua_pop(L, 1);
+        return false;
+    }
+
+    lua_pushliteral(L, "_event_callbacks");
+    lua_rawget(L, -2);
+    if (!lua_istable(L, -1))
+    {
+        lua_pop(L, 2);
+        return false;
+    }
+
+    lua_pushstring(L, event_name);
+    lua_rawget(L, -2);
+    if (!lua_istable(L, -1) || !lua_rawlen(L, -1))
+    {
+        lua_pop(L, 3);
+        return false;
+    }
+
+    lua_replace(L, -3);
+    lua_pop(L, 1);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+static bool has_event_callbacks(lua_State* L, const char* event_name)
+{
+    if (!push_event_callbacks(L, event_name))
+        return false;
+    lua_pop(L, 1);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Updates the cost stats in the callback entry at the top of the stack, for
+// the clink-diagnostics report.
+static void log_event_cost(lua_State* L, clock_t tick)
+{
+    const lua_Number elapsed = lua_Number(clock() - tick) * 1000 / CLOCKS_PER_SEC;
+
+    lua_pushliteral(L, "cost");
+    lua_rawget(L, -2);
+    if (!lua_istable(L, -1))
+    {
+        lua_pop(L, 1);
+        lua_createtable(L, 0, 4);
+        lua_pushliteral(L, "cost");
+        lua_pushvalue(L, -2);
+        lua_rawset(L, -4);
+    }
+
+    lua_pushliteral(L, "total");
+    lua_rawget(L, -2);
+    const lua_Number total = lua_tonumber(L, -1) + elapsed;
+    lua_pushliteral(L, "num");
+    lua_rawget(L, -3);
+    const lua_Number num = lua_tonumber(L, -1) + 1;
+    lua_pushliteral(L, "peak");
+    lua_rawget(L, -4);
+    const lua_Number peak = max<lua_Number>(lua_tonumber(L, -1), elapsed);
+    lua_pop(L, 3);
+
+    lua_pushliteral(L, "last");
+    lua_pushnumber(L, elapsed);
+    lua_rawset(L, -3);
+    lua_pushliteral(L, "total");
+    lua_pushnumber(L, total);
+    lua_rawset(L, -3);
+    lua_pushliteral(L, "num");
+    lua_pushnumber(L, num);
+    lua_rawset(L, -3);
+    lua_pushliteral(L, "peak");
+    lua_pushnumber(L, peak);
+    lua_rawset(L, -3);
+
+    lua_pop(L, 1);
+}
+
 //------------------------------------------------------------------------------
 // Calls any event_name callbacks registered by scripts.  Arguments can be
 // passed by passing nargs equal to the number of pushed arguments.  On success,
@@ -550,6 +886,12 @@ bool lua_state::send_event_internal(lua_State* L, const char* event_name, const
     int32 pos = top - nargs;
     assert(pos >= 0);
 
+    if (!has_event_callbacks(L, event_name))
+    {
+        lua_pop(L, nargs);
+        return false;
+    }
+
     // Push the global _send_event function.
     lua_getglobal(L, "clink");
     lua_pushstring(L, event_mechanism);
@@ -582,10 +924,57 @@ bool lua_state::send_event_internal(lua_State* L, const char* event_name, const
 }
 
 //------------------------------------------------------------------------------
-// Calls any event_name callbacks registered by scripts.
+// Calls any event_name callbacks registered by scripts, in the order of their
+// priorities.  The callbacks are called directly rather than through a Lua
+// dispatch function.  An error in a callback stops calling further callbacks.
+// The nargs arguments are popped.
 bool lua_state::send_event(lua_State* L, const char* event_name, int32 nargs)
 {
-    return send_event_internal(L, event_name, "_send_event", nargs);
+    const int32 base = lua_gettop(L) - nargs;
+    assert(base >= 0);
+
+    if (!push_event_callbacks(L, event_name))
+    {
+        lua_settop(L, base);
+        return false;
+    }
+
+    // Preserve cwd around events.
+    os::cwd_restorer cwd;
+
+    // Like ipairs(), this sees callbacks added by earlier callbacks.
+    const int32 callbacks = lua_gettop(L);
+    bool ok = true;
+    for (int32 i = 1; ok; ++i)
+    {
+        lua_rawgeti(L, callbacks, i);
+        if (lua_isnil(L, -1))
+        {
+            lua_pop(L, 1);
+            break;
+        }
+
+        if (lua_istable(L, -1))
+        {
+            lua_pushliteral(L, "func");
+            lua_rawget(L, -2);
+            if (lua_isfunction(L, -1))
+            {
+                for (int32 arg = base + 1; arg <= base + nargs; ++arg)
+                    lua_pushvalue(L, arg);
+
+                const clock_t tick = clock();
+                ok = (pcall(L, nargs, 0) == 0);
+                if (ok)
+                    log_event_cost(L, tick);
+            }
+        }
+
+        lua_settop(L, callbacks);
+    }
+
+    lua_settop(L, base);
+    return ok;
 }
 
 //------------------------------------------------------------------------------
@@ -674,6 +1063,9 @@ bool lua_state::send_oncommand_event(line_state& line, const char* command, bool
         return false;
 
     lua_State* L = get_state();
+    if (!has_event_callbacks(L, "oncommand"))
+        return false;
+
     line_state_lua line_lua(line);
 
     const char* type;
@@ -710,7 +1102,12 @@ bool lua_state::send_oncommand_event(line_state& line, const char* command, bool
 //------------------------------------------------------------------------------
 bool lua_state::send_oninputlinechanged_event(const char* line)
 {
+    prefetch_shares(line);
+
     lua_State* L = get_state();
+    if (!has_event_callbacks(L, "oninputlinechanged"))
+        return false;
+
     lua_pushstring(L, line);
     return send_event(L, "oninputlinechanged", 1);
 }
@@ -806,6 +1203,157 @@ void lua_state::dump_stack(int32 pos)
 
 
 
+//------------------------------------------------------------------------------
+static struct
+{
+    uint32              idle_steps = 0;
+    uint32              idle_cycles = 0;
+    double              idle_seconds = 0;
+    uint32              suspended = 0;
+    uint32              cap_collections = 0;
+} s_gc_stats;
+
+//------------------------------------------------------------------------------
+void lua_state::apply_gc_settings(lua_State* L)
+{
+    lua_gc(L, LUA_GCSETPAUSE, max<int32>(g_lua_gc_pause.get(), 50));
+    lua_gc(L, LUA_GCSETSTEPMUL, max<int32>(g_lua_gc_stepmul.get(), 100));
+}
+
+//------------------------------------------------------------------------------
+// Runs incremental collection steps until a cycle finishes or budget_ms have
+// elapsed.  Returns true if a cycle finished.
+bool lua_state::step_gc(lua_State* L, uint32 budget_ms)
+{
+    // Settings can change at any time.
+    apply_gc_settings(L);
+
+    // Over the soft cap, collect everything at once.  This compares the live
+    // bytes rather than the allocator's footprint:  slabs aren't released, so
+    // after one spike the footprint would stay over the cap and every idle
+    // step would run a full collection.
+    const int32 cap_mb = g_lua_memory_soft_cap.get();
+    if (cap_mb > 0 && lua_gc(L, LUA_GCCOUNT, 0) > cap_mb * 1024)
+    {
+        const double start = os::clock();
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        s_gc_stats.idle_seconds += os::clock() - start;
+        ++s_gc_stats.cap_collections;
+        ++s_gc_stats.idle_cycles;
+        return true;
+    }
+
+    const double start = os::clock();
+    const double end = start + double(budget_ms) / 1000;
+    bool finished = false;
+    do
+    {
+        ++s_gc_stats.idle_steps;
+        finished = !!lua_gc(L, LUA_GCSTEP, 0);
+    }
+    while (!finished && os::clock() < end);
+
+    s_gc_stats.idle_seconds += os::clock() - start;
+    if (finished)
+        ++s_gc_stats.idle_cycles;
+    return finished;
+}
+
+//------------------------------------------------------------------------------
+int32 lua_gc_suspend::s_depth = 0;
+bool lua_gc_suspend::s_was_running = false;
+
+//------------------------------------------------------------------------------
+lua_gc_suspend::lua_gc_suspend(lua_State* L)
+: m_state(L)
+{
+    if (s_depth++ == 0)
+    {
+        s_was_running = !!lua_gc(m_state, LUA_GCISRUNNING, 0);
+        if (s_was_running)
+            lua_gc(m_state, LUA_GCSTOP, 0);
+        ++s_gc_stats.suspended;
+    }
+}
+
+//------------------------------------------------------------------------------
+lua_gc_suspend::~lua_gc_suspend()
+{
+    assert(s_depth > 0);
+    if (--s_depth == 0 && s_was_running)
+        lua_gc(m_state, LUA_GCRESTART, 0);
+}
+
+//------------------------------------------------------------------------------
+// UNDOCUMENTED; internal use only.  Returns a table of garbage collection
+// statistics for clink-diagnostics.
+int32 get_gc_stats(lua_State* state)
+{
+    lua_createtable(state, 0, 13);
+
+    lua_pushliteral(state, "kb");
+    lua_pushinteger(state, lua_gc(state, LUA_GCCOUNT, 0));
+    lua_rawset(state, -3);
+
+    lua_pushliteral(state, "pause");
+    lua_pushinteger(state, g_lua_gc_pause.get());
+    lua_rawset(state, -3);
+
+    lua_pushliteral(state, "stepmul");
+    lua_pushinteger(state, g_lua_gc_stepmul.get());
+    lua_rawset(state, -3);
+
+    lua_pushliteral(state, "idle_steps");
+    lua_pushinteger(state, s_gc_stats.idle_steps);
+    lua_rawset(state, -3);
+
+    lua_pushliteral(state, "idle_cycles");
+    lua_pushinteger(state, s_gc_stats.idle_cycles);
+    lua_rawset(state, -3);
+
+    lua_pushliteral(state, "idle_ms");
+    lua_pushnumber(state, s_gc_stats.idle_seconds * 1000);
+    lua_rawset(state, -3);
+
+    lua_pushliteral(state, "suspended");
+    lua_pushinteger(state, s_gc_stats.suspended);
+    lua_rawset(state, -3);
+
+    lua_pushliteral(state, "cap_collections");
+    lua_pushinteger(state, s_gc_stats.cap_collections);
+    lua_rawset(state, -3);
+
+    if (const lua_allocator* allocator = lua_allocator::from_state(state))
+    {
+        lua_allocator::stats stats;
+        allocator->get_stats(stats);
+
+        lua_pushliteral(state, "slab_kb");
+        lua_pushinteger(state, lua_Integer(stats.slab_bytes / 1024));
+        lua_rawset(state, -3);
+
+        lua_pushliteral(state, "small_kb");
+        lua_pushinteger(state, lua_Integer(stats.small_bytes / 1024));
+        lua_rawset(state, -3);
+
+        lua_pushliteral(state, "small_blocks");
+        lua_pushinteger(state, stats.small_blocks);
+        lua_rawset(state, -3);
+
+        lua_pushliteral(state, "large_kb");
+        lua_pushinteger(state, lua_Integer(stats.large_bytes / 1024));
+        lua_rawset(state, -3);
+
+        lua_pushliteral(state, "large_blocks");
+        lua_pushinteger(state, stats.large_blocks);
+        lua_rawset(state, -3);
+    }
+
+    return 1;
+}
+
+
+
 //------------------------------------------------------------------------------
 save_stack_top::save_stack_top(lua_State* L)
 : m_state(L)
@@ -24,6 +24,8 @@ const char* const lua_word_classifications::c_name = "lua_word_classifications";
 const lua_word_classifications::method lua_word_classifications::c_methods[] = {
     { "classifyword",     &classify_word },
     { "applycolor",       &apply_color },
+    { "classifywords",    &classify_words },
+    { "applycolors",      &apply_colors },
     // UNDOCUMENTED; internal use only.
     { "_shift",           &shift },
     { "_reset_shift",     &reset_shift },
@@ -89,6 +91,13 @@ int32 lua_word_classifications::classify_word(lua_State* state)
     if (index >= m_num_words)
         return luaL_argerror(state, LUA_SELF + 1, "word index out of bounds");
 
+    classify_word_at(index, s, overwrite);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+void lua_word_classifications::classify_word_at(uint32 index, const char* s, bool overwrite)
+{
     const bool has_argmatcher = (*s == 'm');
     if (has_argmatcher)
         s++;
@@ -110,7 +119,6 @@ int32 lua_word_classifications::classify_word(lua_State* state)
     m_classifications.classify_word(m_index_offset + index, wc, overwrite);
     if (has_argmatcher && index == m_command_word_index)
         m_classifications.set_word_has_argmatcher(m_index_offset + index);
-    return 0;
 }
 
 //------------------------------------------------------------------------------
@@ -157,6 +165,110 @@ int32 lua_word_classifications::apply_color(lua_State* state)
     return 0;
 }
 
+//------------------------------------------------------------------------------
+/// -name:  word_classifications:classifywords
+/// -ver:   1.6.17
+/// -arg:   words:table
+/// -arg:   [overwrite:boolean]
+/// This is like <a href="#word_classifications:classifyword">word_classifications:classifyword()</a>,
+/// but classifies many words in one call.  Each entry in
+/// <span class="arg">words</span> is a table <code>{ word_index, word_class }</code>.
+/// Entries with a word index that is out of bounds are skipped.
+///
+/// Classifiers that classify many words can use this to avoid calling
+/// <code>classifyword()</code> once per word.
+/// -show:  classifications:classifywords({ { 1, "c" }, { 2, "f" }, { 3, "a" } })
+int32 lua_word_classifications::classify_words(lua_State* state)
+{
+    if (!lua_istable(state, LUA_SELF + 1))
+        return luaL_argerror(state, LUA_SELF + 1, "table expected");
+    bool overwrite = !lua_isboolean(state, LUA_SELF + 2) || lua_toboolean(state, LUA_SELF + 2);
+
+    const int32 num = int32(lua_rawlen(state, LUA_SELF + 1));
+    for (int32 i = 1; i <= num; ++i)
+    {
+        lua_rawgeti(state, LUA_SELF + 1, i);
+        if (lua_istable(state, -1))
+        {
+            lua_rawgeti(state, -1, 1);
+            lua_rawgeti(state, -2, 2);
+
+            int32 isnum;
+            const lua_Integer _index = lua_tointegerx(state, -2, &isnum);
+            const char* s = lua_tostring(state, -1);
+            if (isnum && s && _index > 0)
+            {
+                const uint32 index = uint32(_index - 1) + m_shift;
+                if (index < m_num_words)
+                    classify_word_at(index, s, overwrite);
+            }
+
+            lua_pop(state, 2);
+        }
+        lua_pop(state, 1);
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  word_classifications:applycolors
+/// -ver:   1.6.17
+/// -arg:   spans:table
+/// -arg:   [overwrite:boolean]
+/// This is like <a href="#word_classifications:applycolor">word_classifications:applycolor()</a>,
+/// but applies many colors in one call.  Each entry in
+/// <span class="arg">spans</span> is a table <code>{ start, length, color }</code>.
+///
+/// Classifiers that color many parts of the input line (for example each
+/// token in a JSON argument) can use this to avoid calling
+/// <code>applycolor()</code> once per part.
+/// -show:  classifications:applycolors({ { 1, 4, "93" }, { 6, 2, "1;31" }, { 9, 3, "93" } })
+int32 lua_word_classifications::apply_colors(lua_State* state)
+{
+    if (!lua_istable(state, LUA_SELF + 1))
+        return luaL_argerror(state, LUA_SELF + 1, "table expected");
+    bool overwrite = !lua_isboolean(state, LUA_SELF + 2) || lua_toboolean(state, LUA_SELF + 2);
+
+    // Spans often repeat the same few colors.  The strings are kept alive by
+    // the spans table, so the same pointer means the same color.
+    const char* last_color = nullptr;
+    char face = 0;
+
+    const int32 num = int32(lua_rawlen(state, LUA_SELF + 1));
+    for (int32 i = 1; i <= num; ++i)
+    {
+        lua_rawgeti(state, LUA_SELF + 1, i);
+        if (lua_istable(state, -1))
+        {
+            lua_rawgeti(state, -1, 1);
+            lua_rawgeti(state, -2, 2);
+            lua_rawgeti(state, -3, 3);
+
+            int32 isnum_start;
+            int32 isnum_length;
+            const lua_Integer start = lua_tointegerx(state, -3, &isnum_start);
+            const lua_Integer length = lua_tointegerx(state, -2, &isnum_length);
+            const char* color = (lua_type(state, -1) == LUA_TSTRING) ? lua_tostring(state, -1) : nullptr;
+            if (isnum_start && isnum_length && color && start > 0 && length > 0)
+            {
+                if (color != last_color)
+                {
+                    face = m_classifications.ensure_face(color);
+                    last_color = color;
+                }
+                if (face)
+                    m_classifications.apply_face(uint32(start - 1), uint32(length), face, overwrite);
+            }
+
+            lua_pop(state, 3);
+        }
+        lua_pop(state, 1);
+    }
+
+    return 0;
+}
+
 //------------------------------------------------------------------------------
 // UNDOCUMENTED; internal use only.
 int32 lua_word_classifications::shift(lua_State* state)
@@ -7,8 +7,15 @@
 #include "line_states_lua.h"
 
 #include <core/base.h>
+#include <core/linear_allocator.h>
+#include <core/path.h>
+#include <core/settings.h>
+#include <core/str_unordered_set.h>
 #include <lib/line_state.h>
 #include <lib/word_classifications.h>
+#include <lib/cmd_tokenisers.h>
+#include <lib/recognizer.h>
+#include <lib/display_readline.h>
 
 #include <assert.h>
 
@@ -18,6 +25,79 @@ extern "C" {
 #include <lualib.h>
 }
 
+//------------------------------------------------------------------------------
+extern setting_color g_color_cmd;
+extern setting_color g_color_cmdredir;
+extern setting_color g_color_cmdsep;
+extern setting_color g_color_description;
+extern setting_color g_color_executable;
+extern setting_color g_color_unrecognized;
+
+//------------------------------------------------------------------------------
+// The native pass stands in for the built-in cmd and argmatcher classifiers,
+// for commands that don't have argmatchers.  Lua enables it only while those
+// are the only classifiers, and tells it the names of commands that have (or
+// might load) argmatchers.
+typedef std::unordered_set<const char*, match_hasher_caseless, match_comparator_caseless> names_set;
+static bool s_native_classify = false;
+static linear_allocator s_name_store(4096, mem_tag::lua);
+static names_set s_argmatcher_names;
+
+//------------------------------------------------------------------------------
+static bool is_argmatcher_name(const char* word)
+{
+    if (s_argmatcher_names.find(word) != s_argmatcher_names.end())
+        return true;
+
+    const char* name = path::get_name(word);
+    if (name != word && s_argmatcher_names.find(name) != s_argmatcher_names.end())
+        return true;
+
+    if (path::is_executable_extension(word))
+    {
+        str<> base;
+        path::get_base_name(word, base);
+        if (s_argmatcher_names.find(base.c_str()) != s_argmatcher_names.end())
+            return true;
+    }
+
+    return false;
+}
+
+//------------------------------------------------------------------------------
+static void apply_color(word_classifications& classifications, uint32 start, uint32 length, const char* sgr)
+{
+    const char face = classifications.ensure_face(sgr);
+    if (face)
+        classifications.apply_face(start, length, face);
+}
+
+//------------------------------------------------------------------------------
+static void color_separators(const char* line, uint32 start, uint32 end, word_classifications& classifications)
+{
+    char seen = 0;
+    uint32 num = 0;
+    for (uint32 i = start; i < end; ++i)
+    {
+        const char c = line[i];
+        if (c == '&' || c == '|')
+        {
+            if (!seen)
+                seen = c;
+            else if (seen != c)
+                num = 9;
+            ++num;
+            apply_color(classifications, i, 1, (num <= 2) ? g_color_cmdsep.get() : g_color_unrecognized.get());
+        }
+        else if (seen)
+        {
+            num = 9;
+        }
+    }
+}
+
+
+
 //------------------------------------------------------------------------------
 word_class to_word_class(char ch)
 {
@@ -53,19 +133,217 @@ lua_word_classifier::lua_word_classifier(lua_state& state)
 {
 }
 
+//------------------------------------------------------------------------------
+// Lua calls this when it loads the classifier scripts, before any argmatchers
+// are defined.
+void lua_word_classifier::reset_native_classify()
+{
+    s_native_classify = false;
+    s_argmatcher_names.clear();
+    s_name_store.clear();
+}
+
+//------------------------------------------------------------------------------
+void lua_word_classifier::set_native_classify(bool enable)
+{
+    s_native_classify = enable;
+}
+
+//------------------------------------------------------------------------------
+void lua_word_classifier::add_argmatcher_name(const char* name)
+{
+    if (!name || !*name || s_argmatcher_names.find(name) != s_argmatcher_names.end())
+        return;
+
+    str<> tmp(name);
+    path::normalise_separators(tmp);
+    const char* stored = s_name_store.store(tmp.c_str());
+    if (stored)
+        s_argmatcher_names.insert(stored);
+}
+
 //------------------------------------------------------------------------------
 void lua_word_classifier::classify(const line_states& commands, word_classifications& classifications)
 {
+    // Classify natively whatever commands can be, and only call into Lua for
+    // the rest.
+    line_states remaining;
+    const line_states* lua_commands = &commands;
+    if (s_native_classify)
+    {
+        for (const auto& line : commands)
+        {
+            if (!classify_natively(line, classifications))
+                remaining.push_back(line);
+        }
+
+        if (remaining.empty())
+            return;
+        lua_commands = &remaining;
+    }
+
     lua_State* state = m_state.get_state();
     save_stack_top ss(state);
+    lua_gc_suspend gc(state);
 
     // Call to Lua to generate matches.
     lua_getglobal(state, "clink");
     lua_pushliteral(state, "_classify");
     lua_rawget(state, -2);
 
-    line_states_lua lines(commands, classifications);
+    line_states_lua lines(*lua_commands, classifications);
     lines.push(state);
 
     m_state.pcall(state, 1, 1);
+
+    // Lua's commands were added after the native ones, so put them in order.
+    if (lua_commands->size() < commands.size())
+        classifications.sort_words();
+}
+
+//------------------------------------------------------------------------------
+// Does what the cmd classifier and argmatcher classifier in Lua do for a
+// command without an argmatcher.  Returns false without touching the
+// classifications if the command needs Lua.
+bool lua_word_classifier::classify_natively(const line_state& line, word_classifications& classifications) const
+{
+    const std::vector<word>& words = line.get_words();
+    const uint32 command_word_index = line.get_command_word_index();
+
+    // Figure out how to classify the command word.
+    char face = 0;
+    if (command_word_index < words.size())
+    {
+        const word& info = words[command_word_index];
+        if (info.is_alias)
+            return false;
+
+        str<> command_word;
+        line.get_word(command_word_index, command_word);
+        if (command_word.empty() || command_word.c_str()[0] == '@')
+            return false;
+
+        // Argmatcher lookups use the file the recognizer found, if any.
+        path::normalise_separators(command_word);
+        if (is_argmatcher_name(command_word.c_str()))
+            return false;
+        bool ready;
+        str<> file;
+        recognize_command(nullptr, command_word.c_str(), true, ready, &file);
+        if (!file.empty() && is_argmatcher_name(file.c_str()))
+            return false;
+
+        const bool unrecognized_color = *g_color_unrecognized.get();
+        const bool executable_color = *g_color_executable.get();
+        if (!info.quoted && is_cmd_command(command_word.c_str()))
+        {
+            face = FACE_COMMAND;
+        }
+        else if (unrecognized_color || executable_color)
+        {
+            const recognition recognized = recognize_command(line.get_line(), command_word.c_str(), info.quoted, ready, nullptr);
+            if (int32(recognized) < 0)
+                face = unrecognized_color ? FACE_UNRECOGNIZED : FACE_OTHER;
+            else if (int32(recognized) > 0)
+                face = executable_color ? FACE_EXECUTABLE : FACE_OTHER;
+            else
+                face = FACE_OTHER;
+        }
+        else
+        {
+            face = FACE_OTHER;
+        }
+    }
+
+    const uint32 index_offset = classifications.add_command(line);
+    const char* const text = line.get_line();
+    const uint32 length = line.get_length();
+    const uint32 range_start = line.get_range_offset();
+    const uint32 range_end = min<uint32>(range_start + line.get_range_length(), length);
+
+    // Redirection symbols.
+    bool quote = false;
+    for (uint32 i = range_start; i < range_end; ++i)
+    {
+        const char c = text[i];
+        if (c == '^')
+        {
+            ++i;
+        }
+        else if (c == '"')
+        {
+            quote = !quote;
+        }
+        else if (!quote && (c == '>' || c == '<'))
+        {
+            bool err = false;
+            uint32 x = i;
+            const char* color = g_color_cmdredir.get();
+            if (c == '>' && text[i + 1] == '&')
+            {
+                ++i;
+                if (text[i + 1] && (text[i + 1] < '0' || text[i + 1] > '9'))
+                {
+                    color = g_color_unrecognized.get();
+                    err = true;
+                }
+            }
+            if (!err && x > 0 && text[x - 1] >= '0' && text[x - 1] <= '9')
+            {
+                if (x == 1 || (text[x - 2] && strchr(" \t=;,()", text[x - 2])))
+                {
+                    --x;
+                }
+                else if (x > 1 && text[x - 2] == '@')
+                {
+                    // A digit redirection cannot immediately follow @.
+                    --x;
+                    color = g_color_unrecognized.get();
+                }
+            }
+            apply_color(classifications, x, i + 1 - x, color);
+        }
+    }
+
+    // @ before the first word, redirection arguments, and the rem command.
+    for (uint32 index = 0; index < words.size(); ++index)
+    {
+        const word& info = words[index];
+        if (index == 0)
+        {
+            for (uint32 i = range_start; i < info.offset; ++i)
+                if (text[i] == '@')
+                    apply_color(classifications, i, 1, g_color_cmd.get());
+        }
+        if (info.is_redir_arg)
+        {
+            apply_color(classifications, info.offset, info.length, g_color_cmdredir.get());
+        }
+        else if (index == 0)
+        {
+            str<16> first;
+            line.get_word(0, first);
+            if (first.equals("rem"))
+            {
+                const char* color = g_color_description.get();
+                classifications.classify_word(index_offset, FACE_COMMAND);
+                apply_color(classifications, info.offset + info.length, length, *color ? color : "0");
+                break;
+            }
+        }
+    }
+
+    if (face)
+        classifications.classify_word(index_offset + command_word_index, face, false);
+
+    // Command separators following the command.
+    if (!words.empty())
+    {
+        uint32 end = range_end;
+        while (end < length && strchr(" \t&|", text[end]))
+            ++end;
+        color_separators(text, range_end, end, classifications);
+    }
+
+    return true;
 }
@@ -14,7 +14,9 @@ const char* const match_builder_lua::c_name = "match_builder_lua";
 const match_builder_lua::method match_builder_lua::c_methods[] = {
     { "addmatch",           &add_match },
     { "addmatches",         &add_matches },
+    { "addmatchlist",       &add_match_list },
     { "isempty",            &is_empty },
+    { "isfull",             &is_full },
     { "setappendcharacter", &set_append_character },
     { "setsuppressappend",  &set_suppress_append },
     { "setsuppressquoting", &set_suppress_quoting },
@@ -22,6 +24,7 @@ const match_builder_lua::method match_builder_lua::c_methods[] = {
     { "setfullyqualify",    &set_fully_qualify },
     { "setnosort",          &set_no_sort },
     { "setvolatile",        &set_volatile },
+    { "setcacheable",       &set_cacheable },
     // Only for backward compatibility:
     { "deprecated_addmatch", &deprecated_add_match },
     { "setmatchesarefiles", &set_matches_are_files },
@@ -29,6 +32,9 @@ const match_builder_lua::method match_builder_lua::c_methods[] = {
     { "clear_toolkit",      &clear_toolkit },
     { "set_input_line",     &set_input_line },
     { "matches_ready",      &matches_ready },
+    { "set_limit",          &set_limit },
+    { "get_limit",          &get_limit },
+    { "disable_cache",      &disable_cache },
     {}
 };
 
@@ -72,7 +78,7 @@ int32 match_builder_lua::do_add_matches(lua_State* state, bool self_on_stack)
 
     int32 count = 0;
     int32 total = int32(lua_rawlen(state, lua_self + 1));
-    for (int32 i = 1; i <= total; ++i)
+    for (int32 i = 1; i <= total && !m_builder->is_full(); ++i)
     {
         lua_rawgeti(state, lua_self + 1, i);
         count += !!add_match_impl(state, -1, type);
@@ -103,7 +109,7 @@ int32 match_builder_lua::do_add_matches(lua_State* state, bool self_on_stack)
 /// -show:  &nbsp;   match           = "..."    -- [string] The match text.
 /// -show:  &nbsp;   display         = "..."    -- [string] OPTIONAL; alternative text to display when listing possible completions.
 /// -show:  &nbsp;   arginfo         = "..."    -- [string] OPTIONAL; an argument info string (requires v1.5.4 or greater).
-/// -show:  &nbsp;   description     = "..."    -- [string] OPTIONAL; a description for the match.
+/// -show:  &nbsp;   description     = "..."    -- [string | function] OPTIONAL; a description for the match (a function requires v1.6.17 or greater).
 /// -show:  &nbsp;   type            = "..."    -- [string] OPTIONAL; the match type.
 /// -show:  &nbsp;   appendchar      = "..."    -- [string] OPTIONAL; character to append after the match.
 /// -show:  &nbsp;   suppressappend  = t_or_f   -- [boolean] OPTIONAL; whether to suppress appending a character after the match.
@@ -120,7 +126,11 @@ int32 match_builder_lua::do_add_matches(lua_State* state, bool self_on_stack)
 /// greater.)
 /// <li>The <code>description</code> field is optional, and is displayed in
 /// addition to <code>match</code> or <code>display</code> when listing possible
-/// completions.  (Requires v1.2.38 or greater.)
+/// completions.  (Requires v1.2.38 or greater.)  It can also be a function
+/// (requires v1.6.17 or greater), which is called with the match text only
+/// when the description is going to be displayed, and returns the description
+/// string.  This is useful when descriptions are expensive to get and there
+/// may be many matches.
 /// <li>The <code>type</code> field is optional.  If omitted, then the
 /// <span class="arg">type</span> argument is used for that element.
 /// <li>The <code>appendchar</code> field is optional, and overrides the normal
@@ -190,6 +200,26 @@ int32 match_builder_lua::is_empty(lua_State* state)
     return 1;
 }
 
+//------------------------------------------------------------------------------
+/// -name:  builder:isfull
+/// -ver:   1.6.17
+/// -ret:   boolean
+/// Returns whether the match builder is full.  Some callers only need the
+/// first few matches (for example the <code>completion</code> suggestion
+/// strategy), and then no more matches can be added after the builder is full.
+/// A match generator that produces many matches can check this to stop early.
+/// -show:  for line in f:lines() do
+/// -show:  &nbsp;   if builder:isfull() then
+/// -show:  &nbsp;       break
+/// -show:  &nbsp;   end
+/// -show:  &nbsp;   builder:addmatch(line, "word")
+/// -show:  end
+int32 match_builder_lua::is_full(lua_State* state)
+{
+    lua_pushboolean(state, m_builder->is_full());
+    return 1;
+}
+
 //------------------------------------------------------------------------------
 /// -name:  builder:setappendcharacter
 /// -ver:   1.1.2
@@ -310,6 +340,29 @@ int32 match_builder_lua::set_volatile(lua_State* state)
     return 0;
 }
 
+//------------------------------------------------------------------------------
+/// -name:  builder:setcacheable
+/// -ver:   1.6.17
+/// Allows the generated matches to be reused the next time completion is
+/// invoked for the same words in the same directory.
+///
+/// Clink remembers a few recently generated lists of cacheable matches, keyed
+/// by the input line up to the end of the word being completed, the current
+/// directory, and the last write time of the directory the word refers to.
+/// Creating, deleting, or renaming files in that directory makes the cached
+/// matches stale, so they are generated anew.
+///
+/// Only use this when the matches depend on nothing but the words and the
+/// file system contents of that directory, and call it after adding the
+/// matches.  The matches are not cached if any other generator adds matches,
+/// or if any generator calls
+/// <a href="#builder:setvolatile">builder:setvolatile()</a>.
+int32 match_builder_lua::set_cacheable(lua_State* state)
+{
+    m_builder->set_cacheable();
+    return 0;
+}
+
 //------------------------------------------------------------------------------
 // Undocumented because it exists only to enable the clink.add_match backward
 // compatibility.
@@ -369,6 +422,38 @@ int32 match_builder_lua::matches_ready(lua_State* state)
     return 1;
 }
 
+//------------------------------------------------------------------------------
+// UNDOCUMENTED; internal use only.
+int32 match_builder_lua::set_limit(lua_State* state)
+{
+    const auto limit = optinteger(state, LUA_SELF + 1, 0);
+    if (!limit.isnum())
+        return 0;
+
+    m_builder->set_limit(limit > 0 ? uint32(limit) : 0);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// UNDOCUMENTED; internal use only.
+int32 match_builder_lua::get_limit(lua_State* state)
+{
+    const uint32 limit = m_builder->get_limit();
+    if (!limit)
+        return 0;
+
+    lua_pushinteger(state, limit);
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+// UNDOCUMENTED; internal use only.
+int32 match_builder_lua::disable_cache(lua_State* state)
+{
+    m_builder->disable_cache();
+    return 0;
+}
+
 //------------------------------------------------------------------------------
 /// -name:  builder:addmatches
 /// -ver:   1.0.0
@@ -396,6 +481,158 @@ int32 match_builder_lua::add_matches(lua_State* state)
     return do_add_matches(state, true/*self_on_stack*/);
 }
 
+//------------------------------------------------------------------------------
+/// -name:  builder:addmatchlist
+/// -ver:   1.6.17
+/// -arg:   matches:table|string
+/// -arg:   [type:string]
+/// -arg:   [options:table]
+/// -ret:   integer, boolean
+/// Adds a batch of plain match strings that all share the same type and
+/// options.  Returns the number of matches added and a boolean indicating if
+/// all matches were added successfully.
+///
+/// This is faster than <a href="#builder:addmatches">builder:addmatches()</a>
+/// for large numbers of matches, because the type and options are parsed once
+/// for the whole batch instead of once per match.
+///
+/// The <span class="arg">matches</span> argument can be a table of match
+/// strings, or a single string containing one match per line (for example the
+/// output of a program read with <code>file:read("a")</code>).  Empty lines
+/// are skipped.  Unlike <code>builder:addmatches()</code>, table entries must
+/// be strings; any other entries are skipped and count as not added, the same
+/// as entries that <code>builder:addmatches()</code> can't add.
+///
+/// The <span class="arg">type</span> argument is the match type for all of
+/// the matches, and is "none" if omitted.
+///
+/// The optional <span class="arg">options</span> table can contain the
+/// <code>appendchar</code> and <code>suppressappend</code> fields from
+/// <a href="#builder:addmatch">builder:addmatch()</a>, which are then applied
+/// to every match in the batch.
+/// -show:  local f = io.popen("git branch -a --format=%(refname:short) 2>nul")
+/// -show:  if f then
+/// -show:  &nbsp;   builder:addmatchlist(f:read("a"), "word")
+/// -show:  &nbsp;   f:close()
+/// -show:  end
+/// -show:
+/// -show:  builder:addmatchlist({ "red", "green", "blue" }, "arg", { appendchar="," })
+int32 match_builder_lua::add_match_list(lua_State* state)
+{
+    const bool is_table = lua_istable(state, LUA_SELF + 1);
+    if (!is_table && lua_type(state, LUA_SELF + 1) != LUA_TSTRING)
+    {
+        lua_pushinteger(state, 0);
+        lua_pushboolean(state, 0);
+        return 2;
+    }
+
+    const char* type_str = optstring(state, LUA_SELF + 2, "");
+    if (!type_str)
+        return 0;
+
+    const match_type type = to_match_type(type_str);
+    char append_char = 0;
+    char suppress_append = -1;
+    if (lua_istable(state, LUA_SELF + 3))
+    {
+        lua_pushliteral(state, "appendchar");
+        lua_rawget(state, LUA_SELF + 3);
+        if (lua_isstring(state, -1))
+            append_char = *lua_tostring(state, -1);
+        lua_pop(state, 1);
+
+        lua_pushliteral(state, "suppressappend");
+        lua_rawget(state, LUA_SELF + 3);
+        if (lua_isboolean(state, -1))
+            suppress_append = lua_toboolean(state, -1);
+        lua_pop(state, 1);
+    }
+
+    // Every table entry counts toward the total, like in do_add_matches(), so
+    // entries that are skipped (or not reached because the builder is full)
+    // make the second return value false.
+    int32 count = 0;
+    int32 total = 0;
+    auto add = [&](const char* match)
+    {
+        match_desc desc(match, nullptr, nullptr, type);
+        if (append_char)
+            desc.append_char = append_char;
+        if (suppress_append >= 0)
+            desc.suppress_append = suppress_append;
+        count += !!m_builder->add_match(desc);
+    };
+
+    if (is_table)
+    {
+        total = int32(lua_rawlen(state, LUA_SELF + 1));
+        m_builder->reserve(total);
+        for (int32 i = 1; i <= total && !m_builder->is_full(); ++i)
+        {
+            lua_rawgeti(state, LUA_SELF + 1, i);
+            if (lua_type(state, -1) == LUA_TSTRING)
+                add(lua_tostring(state, -1));
+            lua_pop(state, 1);
+        }
+    }
+    else
+    {
+        size_t len;
+        const char* text = lua_tolstring(state, LUA_SELF + 1, &len);
+        const char* const end = text + len;
+
+        str<280> line;
+        while (text < end && !m_builder->is_full())
+        {
+            const char* eol = static_cast<const char*>(memchr(text, '\n', end - text));
+            if (!eol)
+                eol = end;
+
+            const char* trim = eol;
+            if (trim > text && trim[-1] == '\r')
+                --trim;
+
+            if (trim > text)
+            {
+                line.clear();
+                line.concat(text, int32(trim - text));
+                add(line.c_str());
+                ++total;
+            }
+
+            text = eol + 1;
+        }
+
+        // Lines not reached because the builder is full weren't added.
+        if (text < end)
+            ++total;
+    }
+
+    lua_pushinteger(state, count);
+    lua_pushboolean(state, count == total);
+    return 2;
+}
+
+//------------------------------------------------------------------------------
+// Remembers the function at the top of the stack as the provider of the
+// description for the match.  See clink._get_lazy_description().
+static bool add_lazy_description(lua_State* state, const char* match)
+{
+    save_stack_top ss(state);
+
+    lua_getglobal(state, "clink");
+    lua_pushliteral(state, "_lazy_descriptions");
+    lua_rawget(state, -2);
+    if (!lua_istable(state, -1))
+        return false;
+
+    lua_pushstring(state, match);
+    lua_pushvalue(state, -4);
+    lua_rawset(state, -3);
+    return true;
+}
+
 //------------------------------------------------------------------------------
 bool match_builder_lua::add_match_impl(lua_State* state, int32 stack_index, match_type type)
 {
@@ -450,6 +687,8 @@ bool match_builder_lua::add_match_impl(lua_State* state, int32 stack_index, matc
             lua_rawget(state, stack_index);
             if (lua_isstring(state, -1))
                 desc.description = lua_tostring(state, -1);
+            else if (lua_isfunction(state, -1))
+                desc.lazy_description = add_lazy_description(state, match);
             lua_pop(state, 1);
 
             lua_pushliteral(state, "appendchar");
@@ -25,7 +25,9 @@ public:
 protected:
     int32           add_match(lua_State* state);
     int32           add_matches(lua_State* state);
+    int32           add_match_list(lua_State* state);
     int32           is_empty(lua_State* state);
+    int32           is_full(lua_State* state);
     int32           set_append_character(lua_State* state);
     int32           set_suppress_append(lua_State* state);
     int32           set_suppress_quoting(lua_State* state);
@@ -33,6 +35,7 @@ protected:
     int32           set_fully_qualify(lua_State* state);
     int32           set_no_sort(lua_State* state);
     int32           set_volatile(lua_State* state);
+    int32           set_cacheable(lua_State* state);
 
     int32           deprecated_add_match(lua_State* state);
     int32           set_matches_are_files(lua_State* state);
@@ -40,6 +43,9 @@ protected:
     int32           clear_toolkit(lua_State* state);
     int32           set_input_line(lua_State* state);
     int32           matches_ready(lua_State* state);
+    int32           set_limit(lua_State* state);
+    int32           get_limit(lua_State* state);
+    int32           disable_cache(lua_State* state);
 
 private:
     bool            add_match_impl(lua_State* state, int32 stack_index, match_type type);
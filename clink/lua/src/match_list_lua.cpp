@@ -0,0 +1,308 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "lua_state.h"
+#include "match_list_lua.h"
+
+#include <core/str_unordered_set.h>
+#include <lib/matches.h>
+#include <lib/matches_lookaside.h>
+
+#include <algorithm>
+
+//------------------------------------------------------------------------------
+const char* const match_list_lua::c_name = "match_list_lua";
+const match_list_lua::method match_list_lua::c_methods[] = {
+    { "getcount",               &count },
+    { "getmatch",               &get_match },
+    { "gettype",                &get_type },
+    { "getdescription",         &get_description },
+    { "get",                    &get },
+    { "remove",                 &remove },
+    { "move",                   &move },
+    { "totable",                &to_table },
+    // UNDOCUMENTED; internal use only.
+    { "_keeponly",              &keep_only },
+    {}
+};
+
+
+
+//------------------------------------------------------------------------------
+match_list_lua::match_list_lua(char** matches, uint32 count)
+: m_matches(matches, matches + count)
+{
+}
+
+//------------------------------------------------------------------------------
+void match_list_lua::push_match_fields(lua_State* state, const char* match, const match_details& details, str_base& tmp)
+{
+    lua_pushliteral(state, "match");
+    lua_pushstring(state, match);
+    lua_rawset(state, -3);
+
+    lua_pushliteral(state, "type");
+    match_type_to_string(details.get_type(), tmp);
+    lua_pushlstring(state, tmp.c_str(), tmp.length());
+    lua_rawset(state, -3);
+
+    // The display field is special:
+    //  - When MATCH_FLAG_APPEND_DISPLAY is set, add it as "arginfo".
+    //  - When display and match are different, add it as "display".
+    //  - Otherwise do nothing with it.
+    const char* display = details.get_display();
+    if (display && *display)
+    {
+        if (details.get_flags() & MATCH_FLAG_APPEND_DISPLAY)
+        {
+            lua_pushliteral(state, "arginfo");
+            lua_pushstring(state, display);
+            lua_rawset(state, -3);
+        }
+        else if (strcmp(display, match))
+        {
+            lua_pushliteral(state, "display");
+            lua_pushstring(state, display);
+            lua_rawset(state, -3);
+        }
+    }
+
+    const char* description = details.get_description();
+    if (description && *description)
+    {
+        lua_pushliteral(state, "description");
+        lua_pushstring(state, description);
+        lua_rawset(state, -3);
+    }
+
+    char append_char = details.get_append_char();
+    if (append_char)
+    {
+        lua_pushliteral(state, "appendchar");
+        lua_pushlstring(state, &append_char, 1);
+        lua_rawset(state, -3);
+    }
+
+    uint8 flags = details.get_flags();
+    if (flags & MATCH_FLAG_HAS_SUPPRESS_APPEND)
+    {
+        lua_pushliteral(state, "suppressappend");
+        lua_pushboolean(state, !!(flags & MATCH_FLAG_SUPPRESS_APPEND));
+        lua_rawset(state, -3);
+    }
+}
+
+//------------------------------------------------------------------------------
+bool match_list_lua::check_index(lua_State* state, int32 arg, uint32& index) const
+{
+    const auto _index = checkinteger(state, arg);
+    if (!_index.isnum())
+        return false;
+
+    index = _index - 1;
+    return index < m_matches.size();
+}
+
+//------------------------------------------------------------------------------
+/// -name:  match_list:getcount
+/// -ver:   1.6.17
+/// -ret:   integer
+/// Returns the number of matches in the list.
+int32 match_list_lua::count(lua_State* state)
+{
+    lua_pushinteger(state, int32(m_matches.size()));
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  match_list:getmatch
+/// -ver:   1.6.17
+/// -arg:   index:integer
+/// -ret:   string | nil
+/// Returns the match text for the <span class="arg">index</span> match, or nil
+/// if <span class="arg">index</span> is out of range.
+int32 match_list_lua::get_match(lua_State* state)
+{
+    uint32 index;
+    if (!check_index(state, LUA_SELF + 1, index))
+        return 0;
+
+    lua_pushstring(state, m_matches[index]);
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  match_list:gettype
+/// -ver:   1.6.17
+/// -arg:   index:integer
+/// -ret:   string | nil
+/// Returns the match type for the <span class="arg">index</span> match, or nil
+/// if <span class="arg">index</span> is out of range.
+int32 match_list_lua::get_type(lua_State* state)
+{
+    uint32 index;
+    if (!check_index(state, LUA_SELF + 1, index))
+        return 0;
+
+    str<> type;
+    match_type_to_string(lookup_match(m_matches[index]).get_type(), type);
+    lua_pushlstring(state, type.c_str(), type.length());
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  match_list:getdescription
+/// -ver:   1.6.17
+/// -arg:   index:integer
+/// -ret:   string | nil
+/// Returns the description for the <span class="arg">index</span> match, or
+/// nil if it has no description.
+int32 match_list_lua::get_description(lua_State* state)
+{
+    uint32 index;
+    if (!check_index(state, LUA_SELF + 1, index))
+        return 0;
+
+    const char* description = lookup_match(m_matches[index]).get_description();
+    if (!description || !*description)
+        return 0;
+
+    lua_pushstring(state, description);
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  match_list:get
+/// -ver:   1.6.17
+/// -arg:   index:integer
+/// -ret:   table | nil
+/// Returns a table with all the fields for the <span class="arg">index</span>
+/// match, in the same form that
+/// <a href="#clink.onfiltermatches">clink.onfiltermatches()</a> handlers
+/// receive in their matches table.
+int32 match_list_lua::get(lua_State* state)
+{
+    uint32 index;
+    if (!check_index(state, LUA_SELF + 1, index))
+        return 0;
+
+    str<> tmp;
+    const char* match = m_matches[index];
+    lua_createtable(state, 0, 2);
+    push_match_fields(state, match, lookup_match(match), tmp);
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  match_list:remove
+/// -ver:   1.6.17
+/// -arg:   index:integer
+/// Removes the <span class="arg">index</span> match from the list.  The
+/// matches after it move down by one.
+/// -show:  -- Remove matches that start with a dot.
+/// -show:  for i = list:getcount(), 1, -1 do
+/// -show:  &nbsp;   if list:getmatch(i):find("^%.") then
+/// -show:  &nbsp;       list:remove(i)
+/// -show:  &nbsp;   end
+/// -show:  end
+int32 match_list_lua::remove(lua_State* state)
+{
+    uint32 index;
+    if (check_index(state, LUA_SELF + 1, index))
+        m_matches.erase(m_matches.begin() + index);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  match_list:move
+/// -ver:   1.6.17
+/// -arg:   from:integer
+/// -arg:   to:integer
+/// Moves the <span class="arg">from</span> match so that it becomes the
+/// <span class="arg">to</span> match; the matches in between shift by one to
+/// make room.
+///
+/// The order only matters for display filters; match completion filters sort
+/// the matches afterwards anyway.
+int32 match_list_lua::move(lua_State* state)
+{
+    uint32 from;
+    uint32 to;
+    if (!check_index(state, LUA_SELF + 1, from) ||
+        !check_index(state, LUA_SELF + 2, to))
+        return 0;
+
+    auto begin = m_matches.begin();
+    if (from < to)
+        std::rotate(begin + from, begin + from + 1, begin + to + 1);
+    else if (to < from)
+        std::rotate(begin + to, begin + from, begin + from + 1);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  match_list:totable
+/// -ver:   1.6.17
+/// -ret:   table
+/// Returns a table of tables for all of the matches, the same as what
+/// <a href="#clink.onfiltermatches">clink.onfiltermatches()</a> handlers
+/// receive.  This is slow with many matches, so use it only when a filter
+/// really needs everything at once.
+int32 match_list_lua::to_table(lua_State* state)
+{
+    str<> tmp;
+    lua_createtable(state, int32(m_matches.size()), 0);
+    for (uint32 i = 0; i < m_matches.size(); ++i)
+    {
+        const char* match = m_matches[i];
+        lua_createtable(state, 0, 2);
+        push_match_fields(state, match, lookup_match(match), tmp);
+        lua_rawseti(state, -2, i + 1);
+    }
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+// Keeps only the matches named in a table of matches, in the order of the
+// table.  This lets the event dispatcher hand the results from a filter that
+// uses tables to a filter that uses a match_list.
+int32 match_list_lua::keep_only(lua_State* state)
+{
+    if (!lua_istable(state, LUA_SELF + 1))
+        return 0;
+
+    str_unordered_map<uint32> positions;
+    positions.reserve(m_matches.size());
+    for (uint32 i = 0; i < m_matches.size(); ++i)
+        positions.emplace(m_matches[i], i);
+
+    std::vector<const char*> kept;
+    const int32 num = int32(lua_rawlen(state, LUA_SELF + 1));
+    for (int32 i = 1; i <= num; ++i)
+    {
+        lua_rawgeti(state, LUA_SELF + 1, i);
+        if (lua_istable(state, -1))
+        {
+            lua_pushliteral(state, "match");
+            lua_rawget(state, -2);
+            lua_remove(state, -2);
+        }
+
+        const char* match = lua_isstring(state, -1) ? lua_tostring(state, -1) : nullptr;
+        if (match)
+        {
+            const auto it = positions.find(match);
+            if (it != positions.end())
+            {
+                kept.push_back(m_matches[it->second]);
+                positions.erase(it);
+            }
+        }
+
+        lua_pop(state, 1);
+    }
+
+    m_matches = std::move(kept);
+    return 0;
+}
@@ -0,0 +1,46 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#pragma once
+
+#include "lua_bindable.h"
+
+#include <vector>
+
+class match_details;
+
+//------------------------------------------------------------------------------
+// A view of the matches that have been generated, for match filters.  Instead
+// of building a table for each match up front, filters read only the fields
+// they need, and remove or reorder matches in place.  The view refers to the
+// match strings owned by the caller, so it must not outlive them.
+class match_list_lua
+    : public lua_bindable<match_list_lua>
+{
+public:
+                        match_list_lua(char** matches, uint32 count);
+                        ~match_list_lua() = default;
+
+    uint32              size() const { return uint32(m_matches.size()); }
+    const char*         at(uint32 index) const { return m_matches[index]; }
+
+protected:
+    int32               count(lua_State* state);
+    int32               get_match(lua_State* state);
+    int32               get_type(lua_State* state);
+    int32               get_description(lua_State* state);
+    int32               get(lua_State* state);
+    int32               remove(lua_State* state);
+    int32               move(lua_State* state);
+    int32               to_table(lua_State* state);
+    int32               keep_only(lua_State* state);
+
+private:
+    static void         push_match_fields(lua_State* state, const char* match, const match_details& details, str_base& tmp);
+    bool                check_index(lua_State* state, int32 arg, uint32& index) const;
+    std::vector<const char*> m_matches;
+
+    friend class lua_bindable<match_list_lua>;
+    static const char* const c_name;
+    static const match_list_lua::method c_methods[];
+};
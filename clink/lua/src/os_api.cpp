@@ -7,15 +7,21 @@
 #include "yield.h"
 
 #include <core/base.h>
+#include <core/delay_load.h>
 #include <core/globber.h>
 #include <core/os.h>
 #include <core/path.h>
 #include <core/settings.h>
 #include <core/str.h>
 #include <core/str_iter.h>
+#include <core/str_transform.h>
+#include <core/str_unordered_set.h>
 #include <lib/doskey.h>
 #include <lib/clink_ctrlevent.h>
+#include <lib/recognizer.h>
+#include <lib/shared_table.h>
 #include <process/process.h>
+#include <terminal/terminal_helpers.h>
 #include <sys/utime.h>
 #include <ntverp.h> // for VER_PRODUCTMAJORVERSION to deduce SDK version
 #include <assert.h>
@@ -25,7 +31,11 @@ extern "C" {
 extern int _rl_match_hidden_files;
 }
 
+#include <algorithm>
+#include <condition_variable>
 #include <memory>
+#include <thread>
+#include <vector>
 
 //#define USE_WNETOPENENUM
 //#define DEBUG_TRAVERSE_GLOBAL_NET
@@ -35,6 +45,7 @@ extern int _rl_match_hidden_files;
 #include <lmcons.h>
 #include <lmshare.h>
 #include <shlwapi.h>
+#include <wildmatch/wildmatch.h>
 
 //------------------------------------------------------------------------------
 extern setting_bool g_files_hidden;
@@ -99,6 +110,11 @@ static int32 close_file(lua_State *state)
 
 
 
+//------------------------------------------------------------------------------
+inline bool is_main_coroutine(lua_State* state) { return G(state)->mainthread == state; }
+
+
+
 //------------------------------------------------------------------------------
 struct glob_flags
 {
@@ -106,19 +122,201 @@ struct glob_flags
     bool system = false;
 };
 
+//------------------------------------------------------------------------------
+struct glob_entry
+{
+    str_moveable        name;
+    globber::extrainfo  info;
+};
+
+//------------------------------------------------------------------------------
+// Globs on a worker thread.  Used to prefetch the end word's directory while
+// the Lua match generators run, to keep a coroutine that generates matches
+// from blocking input on a huge or slow directory, and to let Ctrl-C
+// interrupt a stalled network request.  Entries can be taken as they arrive,
+// and canceling stops the enumeration.
+class glob_worker
+{
+public:
+                            glob_worker(const char* pattern, const glob_flags& flags, bool dirs_only);
+                            ~glob_worker() { if (m_done) CloseHandle(m_done); }
+    static std::shared_ptr<glob_worker> start(const char* pattern, const glob_flags& flags, bool dirs_only);
+    const char*             pattern() const { return m_pattern.c_str(); }
+    const glob_flags&       flags() const { return m_flags; }
+    bool                    is_canceled() const { return m_canceled; }
+    void                    cancel() { m_canceled = true; }
+    bool                    wait();
+    bool                    take(std::vector<glob_entry>& out);
+
+private:
+    static void             proc(std::shared_ptr<glob_worker> worker);
+    const str_moveable      m_pattern;
+    const glob_flags        m_flags;
+    const bool              m_dirs_only;
+    HANDLE                  m_done;
+    std::mutex              m_mutex;
+    std::vector<glob_entry> m_entries;
+    bool                    m_finished = false;
+    volatile bool           m_canceled = false;
+};
+
+//------------------------------------------------------------------------------
+glob_worker::glob_worker(const char* pattern, const glob_flags& flags, bool dirs_only)
+: m_pattern(pattern)
+, m_flags(flags)
+, m_dirs_only(dirs_only)
+, m_done(CreateEvent(nullptr, true, false, nullptr))
+{
+}
+
+//------------------------------------------------------------------------------
+std::shared_ptr<glob_worker> glob_worker::start(const char* pattern, const glob_flags& flags, bool dirs_only)
+{
+    dbg_ignore_scope(snapshot, "async glob");
+
+    auto worker = std::make_shared<glob_worker>(pattern, flags, dirs_only);
+    if (!worker->m_done)
+        return nullptr;
+
+    // The thread is detached so that canceling never has to wait for a slow
+    // directory enumeration to finish; the shared pointer keeps the results
+    // alive until both sides are done with them.
+    std::thread thread(&proc, worker);
+    thread.detach();
+    return worker;
+}
+
+//------------------------------------------------------------------------------
+// Waits for the worker to finish, checking for Ctrl-C every 50 ms.  Returns
+// false (and cancels the worker) if Ctrl-C interrupted the wait.
+bool glob_worker::wait()
+{
+    while (WaitForSingleObject(m_done, 50) == WAIT_TIMEOUT)
+    {
+        if (clink_is_signaled())
+        {
+            cancel();
+            return false;
+        }
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Moves the entries found so far into OUT.  Returns true once the worker has
+// finished or been canceled, so nothing found after the last take is lost.
+bool glob_worker::take(std::vector<glob_entry>& out)
+{
+    out.clear();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    out.swap(m_entries);
+    return m_finished || m_canceled;
+}
+
+//------------------------------------------------------------------------------
+void glob_worker::proc(std::shared_ptr<glob_worker> worker)
+{
+    globber globber(worker->m_pattern.c_str());
+    globber.files(!worker->m_dirs_only);
+    globber.hidden(worker->m_flags.hidden);
+    globber.system(worker->m_flags.system);
+
+    str<288> file;
+    globber::extrainfo info;
+    while (!worker->m_canceled && globber.next(file, false, &info))
+    {
+        if (clink_is_signaled())
+        {
+            worker->m_canceled = true;
+            break;
+        }
+
+        glob_entry e;
+        e.name = file.c_str();
+        e.info = info;
+
+        std::lock_guard<std::mutex> lock(worker->m_mutex);
+        worker->m_entries.emplace_back(std::move(e));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(worker->m_mutex);
+        worker->m_finished = true;
+    }
+    SetEvent(worker->m_done);
+}
+
+//------------------------------------------------------------------------------
+// Network directories can take a long time to enumerate, and a stalled request
+// can't be interrupted.
+static bool is_remote_glob(const char* pattern)
+{
+    if (path::is_unc(pattern))
+        return true;
+
+    str<280> full;
+    if (!os::get_full_path_name(*pattern ? pattern : ".", full))
+        return false;
+    if (path::is_unc(full.c_str()))
+        return true;
+
+    path::get_drive(full);
+    path::append(full, "");
+    return os::get_drive_type(full.c_str()) == os::drive_type_remote;
+}
+
+
+
+//------------------------------------------------------------------------------
+// Native filtering and ordering of glob results, from fields in the flags
+// table.  This lets scripts ask for only the entries they need, without
+// building a Lua table for (or crossing into Lua with) every entry in a huge
+// directory.
+enum class glob_sort : uint8 { none, name, size, mtime };
+
+class glob_filter
+{
+public:
+    void                parse(lua_State* state, int32 index);
+    bool                active() const { return m_active; }
+    bool                add(lua_State* state, const str_base& file, const globber::extrainfo& info, str_base& parent, int32* index, int32 extrainfo);
+    void                finish(lua_State* state, str_base& parent, int32* index, int32 extrainfo);
+
+private:
+    bool                accept(const char* name, const globber::extrainfo& info) const;
+    std::vector<str_moveable> m_extensions;
+    str_moveable        m_prefix;
+    lua_Number          m_newer = 0;
+    lua_Number          m_older = 0;
+    int32               m_offset = 0;
+    int32               m_limit = 0;
+    int32               m_skipped = 0;
+    int32               m_added = 0;
+    glob_sort           m_sort = glob_sort::none;
+    bool                m_reverse = false;
+    bool                m_active = false;
+    std::vector<glob_entry> m_sorted;
+};
+
+
+
 //------------------------------------------------------------------------------
 class globber_lua
     : public lua_bindable<globber_lua>
 {
 public:
-                        globber_lua(const char* pattern, int32 extrainfo, const glob_flags& flags, bool dirs_only, bool back_compat=false);
+                        globber_lua(const char* pattern, int32 extrainfo, const glob_flags& flags, glob_filter* filter, bool dirs_only, bool back_compat, const std::shared_ptr<glob_worker>& worker);
+                        ~globber_lua();
 
 protected:
     int32               next(lua_State* state);
     int32               close(lua_State* state);
 
 private:
-    globber             m_globber;
+    std::unique_ptr<globber> m_globber;
+    std::shared_ptr<glob_worker> m_worker;
+    std::vector<glob_entry> m_taken;
+    glob_filter         m_filter;
     str<288>            m_parent;
     int32               m_extrainfo;
     int32               m_index = 1;
@@ -137,26 +335,60 @@ const globber_lua::method globber_lua::c_methods[] = {
 };
 
 //------------------------------------------------------------------------------
-globber_lua::globber_lua(const char* pattern, int32 extrainfo, const glob_flags& flags, bool dirs_only, bool back_compat)
-: m_globber(pattern)
+globber_lua::globber_lua(const char* pattern, int32 extrainfo, const glob_flags& flags, glob_filter* filter, bool dirs_only, bool back_compat, const std::shared_ptr<glob_worker>& worker)
+: m_worker(worker)
+, m_filter(std::move(*filter))
 , m_parent(pattern)
 , m_extrainfo(extrainfo)
 {
     path::to_parent(m_parent, nullptr);
 
-    m_globber.files(!dirs_only);
-    m_globber.hidden(flags.hidden);
-    m_globber.system(flags.system);
+    if (m_worker)
+        return;
+
+    m_globber = std::make_unique<globber>(pattern);
+    m_globber->files(!dirs_only);
+    m_globber->hidden(flags.hidden);
+    m_globber->system(flags.system);
     if (back_compat)
-        m_globber.suffix_dirs(false);
+        m_globber->suffix_dirs(false);
 }
 
 //------------------------------------------------------------------------------
-static bool glob_next(lua_State* state, globber& globber, str_base& parent, int32* index, int32 extrainfo);
+globber_lua::~globber_lua()
+{
+    if (m_worker)
+        m_worker->cancel();
+}
+
+//------------------------------------------------------------------------------
+static bool glob_next(lua_State* state, globber& globber, str_base& parent, int32* index, int32 extrainfo, glob_filter* filter=nullptr);
 int32 globber_lua::next(lua_State* state)
 {
     // Arg is table into which to glob files/dirs; glob_next appends into it.
 
+    if (m_worker)
+    {
+        // Append whatever the worker thread has found so far.
+        bool done = m_worker->take(m_taken);
+        for (const auto& e : m_taken)
+        {
+            if (!m_filter.add(state, e.name, e.info, m_parent, &m_index, m_extrainfo))
+            {
+                m_worker->cancel();
+                done = true;
+                break;
+            }
+        }
+        m_taken.clear();
+
+        if (done)
+            m_filter.finish(state, m_parent, &m_index, m_extrainfo);
+
+        lua_pushboolean(state, !done);
+        return 1;
+    }
+
     const DWORD ms_max = 20;
     const DWORD num_max = 250;
     const DWORD tick = GetTickCount();
@@ -164,13 +396,16 @@ int32 globber_lua::next(lua_State* state)
     bool ret = false;
     for (size_t c = 0; c < num_max; c++)
     {
-        ret = glob_next(state, m_globber, m_parent, &m_index, m_extrainfo);
+        ret = glob_next(state, *m_globber, m_parent, &m_index, m_extrainfo, m_filter.active() ? &m_filter : nullptr);
         if (!ret)
             break;
         if (GetTickCount() - tick > ms_max)
             break;
     }
 
+    if (!ret)
+        m_filter.finish(state, m_parent, &m_index, m_extrainfo);
+
     lua_pushboolean(state, ret);
     return 1;
 }
@@ -178,7 +413,15 @@ int32 globber_lua::next(lua_State* state)
 //------------------------------------------------------------------------------
 int32 globber_lua::close(lua_State* state)
 {
-    m_globber.close();
+    if (m_worker)
+    {
+        m_worker->cancel();
+        m_worker.reset();
+    }
+    else
+    {
+        m_globber->close();
+    }
     return 0;
 }
 
@@ -339,7 +582,7 @@ bool delay_load_version::init()
     if (!m_initialized)
     {
         m_initialized = true;
-        HMODULE hlib = LoadLibrary("version.dll");
+        HMODULE hlib = delay_load_library("version.dll");
         if (hlib)
         {
             m_procs.proc[0] = GetProcAddress(hlib, "GetFileVersionInfoSizeW");
@@ -640,14 +883,8 @@ static void add_type_tag(str_base& out, const char* tag)
 }
 
 //------------------------------------------------------------------------------
-static bool glob_next(lua_State* state, globber& globber, str_base& parent, int32* index, int32 extrainfo)
+static void push_glob_entry(lua_State* state, const str_base& file, const globber::extrainfo& info, str_base& parent, int32* index, int32 extrainfo)
 {
-    str<288> file;
-    globber::extrainfo info;
-    globber::extrainfo* info_ptr = extrainfo ? &info : nullptr;
-    if (!globber.next(file, false, info_ptr))
-        return false;
-
     if (!extrainfo)
     {
         lua_pushlstring(state, file.c_str(), file.length());
@@ -710,9 +947,221 @@ static bool glob_next(lua_State* state, globber& globber, str_base& parent, int3
 
     if (index)
         lua_rawseti(state, -2, (*index)++);
+}
+
+//------------------------------------------------------------------------------
+// Returns false when there are no more entries, or when the filter has
+// reached its limit.
+static bool glob_next(lua_State* state, globber& globber, str_base& parent, int32* index, int32 extrainfo, glob_filter* filter)
+{
+    str<288> file;
+    globber::extrainfo info;
+    globber::extrainfo* info_ptr = (extrainfo || filter) ? &info : nullptr;
+    if (!globber.next(file, false, info_ptr))
+        return false;
+
+    if (filter)
+        return filter->add(state, file, info, parent, index, extrainfo);
+
+    push_glob_entry(state, file, info, parent, index, extrainfo);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void glob_filter::parse(lua_State* state, int32 index)
+{
+    if (!lua_istable(state, index))
+        return;
+
+    lua_pushliteral(state, "extensions");
+    lua_rawget(state, index);
+    if (lua_istable(state, -1))
+    {
+        const int32 count = int32(lua_rawlen(state, -1));
+        for (int32 i = 1; i <= count; ++i)
+        {
+            lua_rawgeti(state, -1, i);
+            if (const char* ext = lua_tostring(state, -1))
+            {
+                str_moveable tmp;
+                if (*ext != '.')
+                    tmp = ".";
+                tmp.concat(ext);
+                m_extensions.emplace_back(std::move(tmp));
+            }
+            lua_pop(state, 1);
+        }
+        m_active = true;
+    }
+    lua_pop(state, 1);
+
+    lua_pushliteral(state, "prefix");
+    lua_rawget(state, index);
+    if (const char* prefix = lua_tostring(state, -1))
+    {
+        m_prefix = prefix;
+        m_active = true;
+    }
+    lua_pop(state, 1);
+
+    struct { const char* name; lua_Number* out; } times[] =
+    {
+        { "newer", &m_newer },
+        { "older", &m_older },
+    };
+    for (const auto& t : times)
+    {
+        lua_pushstring(state, t.name);
+        lua_rawget(state, index);
+        if (lua_isnumber(state, -1))
+        {
+            *t.out = lua_tonumber(state, -1);
+            m_active = true;
+        }
+        lua_pop(state, 1);
+    }
+
+    struct { const char* name; int32* out; } counts[] =
+    {
+        { "offset", &m_offset },
+        { "limit", &m_limit },
+    };
+    for (const auto& c : counts)
+    {
+        lua_pushstring(state, c.name);
+        lua_rawget(state, index);
+        if (lua_isnumber(state, -1))
+        {
+            *c.out = max<int32>(0, int32(lua_tointeger(state, -1)));
+            m_active = true;
+        }
+        lua_pop(state, 1);
+    }
+
+    lua_pushliteral(state, "sort");
+    lua_rawget(state, index);
+    if (const char* sort = lua_tostring(state, -1))
+    {
+        if (stricmp(sort, "name") == 0)
+            m_sort = glob_sort::name;
+        else if (stricmp(sort, "size") == 0)
+            m_sort = glob_sort::size;
+        else if (stricmp(sort, "mtime") == 0)
+            m_sort = glob_sort::mtime;
+        m_active |= (m_sort != glob_sort::none);
+    }
+    lua_pop(state, 1);
+
+    lua_pushliteral(state, "reverse");
+    lua_rawget(state, index);
+    m_reverse = !!lua_toboolean(state, -1);
+    lua_pop(state, 1);
+}
+
+//------------------------------------------------------------------------------
+bool glob_filter::accept(const char* name, const globber::extrainfo& info) const
+{
+    if (!m_prefix.empty() && _strnicmp(name, m_prefix.c_str(), m_prefix.length()) != 0)
+        return false;
+
+    // Extensions only filter files, so that directories can still be
+    // navigated.
+    if (!m_extensions.empty() && !(info.attr & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        const char* ext = path::get_extension(name);
+        if (!ext)
+            return false;
+
+        bool found = false;
+        for (const auto& e : m_extensions)
+        {
+            if (_stricmp(ext, e.c_str()) == 0)
+            {
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            return false;
+    }
+
+    if (m_newer || m_older)
+    {
+        const lua_Number mtime = lua_Number(os::filetime_to_time_t(info.modified));
+        if (m_newer && mtime < m_newer)
+            return false;
+        if (m_older && mtime >= m_older)
+            return false;
+    }
+
     return true;
 }
 
+//------------------------------------------------------------------------------
+// Returns false once the limit has been reached, so the caller can stop
+// enumerating.  When sorting, entries are held until finish().
+bool glob_filter::add(lua_State* state, const str_base& file, const globber::extrainfo& info, str_base& parent, int32* index, int32 extrainfo)
+{
+    if (!m_active)
+    {
+        push_glob_entry(state, file, info, parent, index, extrainfo);
+        return true;
+    }
+
+    if (!accept(file.c_str(), info))
+        return true;
+
+    if (m_sort != glob_sort::none)
+    {
+        glob_entry e;
+        e.name = file.c_str();
+        e.info = info;
+        m_sorted.emplace_back(std::move(e));
+        return true;
+    }
+
+    if (m_skipped < m_offset)
+    {
+        ++m_skipped;
+        return true;
+    }
+
+    push_glob_entry(state, file, info, parent, index, extrainfo);
+    ++m_added;
+    return !m_limit || m_added < m_limit;
+}
+
+//------------------------------------------------------------------------------
+void glob_filter::finish(lua_State* state, str_base& parent, int32* index, int32 extrainfo)
+{
+    if (m_sort == glob_sort::none)
+        return;
+
+    const glob_sort sort = m_sort;
+    const bool reverse = m_reverse;
+    std::stable_sort(m_sorted.begin(), m_sorted.end(), [sort, reverse](const glob_entry& a, const glob_entry& b) {
+        const glob_entry& l = reverse ? b : a;
+        const glob_entry& r = reverse ? a : b;
+        switch (sort)
+        {
+        case glob_sort::size:
+            return l.info.size < r.info.size;
+        case glob_sort::mtime:
+            return CompareFileTime(&l.info.modified, &r.info.modified) < 0;
+        default:
+            return _stricmp(l.name.c_str(), r.name.c_str()) < 0;
+        }
+    });
+
+    const size_t begin = min<size_t>(m_offset, m_sorted.size());
+    const size_t end = m_limit ? min<size_t>(begin + m_limit, m_sorted.size()) : m_sorted.size();
+    for (size_t i = begin; i < end; ++i)
+        push_glob_entry(state, m_sorted[i].name, m_sorted[i].info, parent, index, extrainfo);
+
+    m_sorted.clear();
+    m_sort = glob_sort::none;
+}
+
 //------------------------------------------------------------------------------
 static void get_glob_flags(lua_State* state, int32 index, glob_flags& out, bool back_compat)
 {
@@ -750,62 +1199,214 @@ static void get_glob_flags(lua_State* state, int32 index, glob_flags& out, bool
 }
 
 //------------------------------------------------------------------------------
-int32 glob_impl(lua_State* state, bool dirs_only, bool back_compat=false)
+// Globs files and directories on a worker thread, so that enumerating the
+// directory for the word being completed can overlap with running the Lua
+// match generators.  Most completions end up asking os.globfiles() for the
+// end word (argmatchers default to file matches, and the file match generator
+// is the fallback), and on slow or large directories the enumeration usually
+// costs more than everything else in generating matches.
+class glob_prefetch
 {
-    const char* mask = checkstring(state, 1);
-    if (!mask)
-        return 0;
-
-    int32 extrainfo;
-    if (back_compat)
-        extrainfo = 0;
-    else if (lua_isboolean(state, 2))
-        extrainfo = lua_toboolean(state, 2);
-    else
-        extrainfo = optinteger(state, 2, 0);
-
-    glob_flags flags;
-    get_glob_flags(state, 3, flags, back_compat);
+public:
+                            ~glob_prefetch() { cancel(); }
+    void                    start(const char* pattern, const glob_flags& flags);
+    void                    cancel();
+    bool                    take(const char* pattern, const glob_flags& flags, lua_State* state, int32 extrainfo, glob_filter& filter);
 
-    lua_createtable(state, 0, 0);
+private:
+    std::shared_ptr<glob_worker> m_worker;
+    str_moveable            m_cwd;
+};
 
-    globber globber(mask);
-    globber.files(!dirs_only);
-    globber.hidden(flags.hidden);
-    globber.system(flags.system);
-    if (back_compat)
-        globber.suffix_dirs(false);
+//------------------------------------------------------------------------------
+void glob_prefetch::start(const char* pattern, const glob_flags& flags)
+{
+    cancel();
 
-    str_moveable tmp(mask);
-    path::to_parent(tmp, nullptr);
+    os::get_current_dir(m_cwd);
+    m_worker = glob_worker::start(pattern, flags, false);
+}
 
-    int32 i = 1;
-    if (back_compat)
-    {
-        while (true)
-            if (!glob_next(state, globber, tmp, &i, extrainfo))
-                break;
-    }
-    else
+//------------------------------------------------------------------------------
+void glob_prefetch::cancel()
+{
+    if (m_worker)
     {
-        while (true)
-        {
-            if (!glob_next(state, globber, tmp, &i, extrainfo))
-                break;
-            if (!(i & 0x03) && clink_is_signaled())
-                break;
-        }
+        m_worker->cancel();
+        m_worker.reset();
     }
-
-    return 1;
 }
 
 //------------------------------------------------------------------------------
-int32 globber_impl(lua_State* state, bool dirs_only, bool back_compat=false)
+// If PATTERN and FLAGS are what was prefetched (and the cwd hasn't changed),
+// this waits for the prefetch to finish and appends the results to the table
+// at the top of the Lua stack.  Returns false if the caller needs to glob.
+bool glob_prefetch::take(const char* pattern, const glob_flags& flags, lua_State* state, int32 extrainfo, glob_filter& filter)
 {
-    const char* mask = checkstring(state, 1);
-    if (!mask)
-        return 0;
+    if (!m_worker)
+        return false;
+
+    std::shared_ptr<glob_worker> worker = m_worker;
+    m_worker.reset();
+
+    if (strcmp(pattern, worker->pattern()) != 0 ||
+        flags.hidden != worker->flags().hidden ||
+        flags.system != worker->flags().system)
+    {
+        worker->cancel();
+        return false;
+    }
+
+    str<280> cwd;
+    os::get_current_dir(cwd);
+    if (!cwd.equals(m_cwd.c_str()))
+    {
+        worker->cancel();
+        return false;
+    }
+
+    if (!worker->wait())
+        return true;
+
+    if (worker->is_canceled())
+        return false;
+
+    str_moveable parent(pattern);
+    path::to_parent(parent, nullptr);
+
+    std::vector<glob_entry> entries;
+    worker->take(entries);
+
+    int32 i = 1;
+    for (const auto& e : entries)
+        if (!filter.add(state, e.name, e.info, parent, &i, extrainfo))
+            break;
+    filter.finish(state, parent, &i, extrainfo);
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+static glob_prefetch s_glob_prefetch;
+
+//------------------------------------------------------------------------------
+// Starts prefetching file matches for WORD, the same way file_matches_impl()
+// in arguments.lua globs them.  Words that need special handling there (tilde
+// expansion, enumerating shares) or that are on a network drive aren't
+// prefetched.
+void start_glob_prefetch(const char* word)
+{
+    s_glob_prefetch.cancel();
+
+    if (*word == '~' || is_remote_glob(word))
+        return;
+
+    glob_flags flags;
+    flags.hidden = g_files_hidden.get() && _rl_match_hidden_files;
+    flags.system = g_files_system.get();
+
+    str<280> pattern(word);
+    pattern << "*";
+    s_glob_prefetch.start(pattern.c_str(), flags);
+}
+
+//------------------------------------------------------------------------------
+void cancel_glob_prefetch()
+{
+    s_glob_prefetch.cancel();
+}
+
+//------------------------------------------------------------------------------
+int32 glob_impl(lua_State* state, bool dirs_only, bool back_compat=false)
+{
+    const char* mask = checkstring(state, 1);
+    if (!mask)
+        return 0;
+
+    int32 extrainfo;
+    if (back_compat)
+        extrainfo = 0;
+    else if (lua_isboolean(state, 2))
+        extrainfo = lua_toboolean(state, 2);
+    else
+        extrainfo = optinteger(state, 2, 0);
+
+    glob_flags flags;
+    get_glob_flags(state, 3, flags, back_compat);
+
+    glob_filter filter;
+    if (!back_compat)
+        filter.parse(state, 3);
+
+    lua_createtable(state, 0, 0);
+
+    if (!dirs_only && !back_compat && s_glob_prefetch.take(mask, flags, state, extrainfo, filter))
+        return 1;
+
+    // Enumerate network directories on a worker thread, so that Ctrl-C can
+    // interrupt even a stalled request.  Non-blocking globs never wait on the
+    // network, so they don't need a worker.
+    if (!back_compat && is_remote_glob(mask) && !globber::is_nonblocking())
+    {
+        auto worker = glob_worker::start(mask, flags, dirs_only);
+        if (worker)
+        {
+            worker->wait();
+
+            str_moveable parent(mask);
+            path::to_parent(parent, nullptr);
+
+            std::vector<glob_entry> entries;
+            worker->take(entries);
+
+            int32 i = 1;
+            for (const auto& e : entries)
+                if (!filter.add(state, e.name, e.info, parent, &i, extrainfo))
+                    break;
+            filter.finish(state, parent, &i, extrainfo);
+            return 1;
+        }
+    }
+
+    globber globber(mask);
+    globber.files(!dirs_only);
+    globber.hidden(flags.hidden);
+    globber.system(flags.system);
+    if (back_compat)
+        globber.suffix_dirs(false);
+
+    str_moveable tmp(mask);
+    path::to_parent(tmp, nullptr);
+
+    int32 i = 1;
+    if (back_compat)
+    {
+        while (true)
+            if (!glob_next(state, globber, tmp, &i, extrainfo))
+                break;
+    }
+    else
+    {
+        glob_filter* filter_ptr = filter.active() ? &filter : nullptr;
+        for (uint32 n = 1;; ++n)
+        {
+            if (!glob_next(state, globber, tmp, &i, extrainfo, filter_ptr))
+                break;
+            if (!(n & 0x03) && clink_is_signaled())
+                break;
+        }
+        filter.finish(state, tmp, &i, extrainfo);
+    }
+
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+int32 globber_impl(lua_State* state, bool dirs_only, bool back_compat=false)
+{
+    const char* mask = checkstring(state, 1);
+    if (!mask)
+        return 0;
 
     int32 extrainfo;
     if (back_compat)
@@ -818,7 +1419,17 @@ int32 globber_impl(lua_State* state, bool dirs_only, bool back_compat=false)
     glob_flags flags;
     get_glob_flags(state, 3, flags, back_compat);
 
-    if (!globber_lua::make_new(state, mask, extrainfo, flags, dirs_only, back_compat))
+    // In a coroutine, enumerate on a worker thread so the coroutine never
+    // blocks input while waiting for the file system.
+    std::shared_ptr<glob_worker> worker;
+    if (!back_compat && !is_main_coroutine(state))
+        worker = glob_worker::start(mask, flags, dirs_only);
+
+    glob_filter filter;
+    if (!back_compat)
+        filter.parse(state, 3);
+
+    if (!globber_lua::make_new(state, mask, extrainfo, flags, &filter, dirs_only, back_compat, worker))
         return 0;
 
     return 1;
@@ -839,6 +1450,9 @@ int32 globber_impl(lua_State* state, bool dirs_only, bool back_compat=false)
 ///
 /// Starting in v1.3.1, when this is used in a coroutine it automatically yields
 /// periodically.
+/// Starting in v1.6.17, when this is used in a coroutine the directory is
+/// enumerated on a background thread, so a huge or slow directory doesn't
+/// block input.
 ///
 /// The optional <span class="arg">extrainfo</span> argument can return a table
 /// of tables instead, where each sub-table corresponds to one directory and has
@@ -866,6 +1480,22 @@ int32 globber_impl(lua_State* state, bool dirs_only, bool back_compat=false)
 /// -show:  &nbsp;   system = false,     -- True includes system directories, or false omits them (default).
 /// -show:  }
 /// -show:  local t = os.globdirs("*", true, flags)
+///
+/// Starting in v1.6.17, the <span class="arg">flags</span> table can also
+/// select which entries to return and in what order.  The filtering happens
+/// natively while enumerating, which is much faster than filtering a full
+/// table in Lua for directories with many entries.
+/// -show:  local flags = {
+/// -show:  &nbsp;   extensions = { ".lua", ".txt" }, -- Only files with these extensions (directories aren't affected).
+/// -show:  &nbsp;   prefix = "clink",   -- Only names starting with this (ignores case).
+/// -show:  &nbsp;   newer = t1,         -- Only entries modified at or after t1 (compatible with os.time()).
+/// -show:  &nbsp;   older = t2,         -- Only entries modified before t2 (compatible with os.time()).
+/// -show:  &nbsp;   sort = "name",      -- Sort by "name", "size", or "mtime" (unsorted by default).
+/// -show:  &nbsp;   reverse = true,     -- True sorts in descending order.
+/// -show:  &nbsp;   offset = 20,        -- Skip this many matching entries.
+/// -show:  &nbsp;   limit = 10,         -- Return at most this many entries.
+/// -show:  }
+/// -show:  local t = os.globdirs("*", true, flags)
 int32 glob_dirs(lua_State* state)
 {
     return glob_impl(state, true);
@@ -886,6 +1516,9 @@ int32 glob_dirs(lua_State* state)
 ///
 /// Starting in v1.3.1, when this is used in a coroutine it automatically yields
 /// periodically.
+/// Starting in v1.6.17, when this is used in a coroutine the directory is
+/// enumerated on a background thread, so a huge or slow directory doesn't
+/// block input.
 ///
 /// The optional <span class="arg">extrainfo</span> argument can return a table
 /// of tables instead, where each sub-table corresponds to one file or directory
@@ -912,6 +1545,22 @@ int32 glob_dirs(lua_State* state)
 /// -show:  &nbsp;   system = false,     -- True includes system files, or false omits them (default).
 /// -show:  }
 /// -show:  local t = os.globfiles("*", true, flags)
+///
+/// Starting in v1.6.17, the <span class="arg">flags</span> table can also
+/// select which entries to return and in what order.  The filtering happens
+/// natively while enumerating, which is much faster than filtering a full
+/// table in Lua for directories with many entries.
+/// -show:  local flags = {
+/// -show:  &nbsp;   extensions = { ".lua", ".txt" }, -- Only files with these extensions (directories aren't affected).
+/// -show:  &nbsp;   prefix = "clink",   -- Only names starting with this (ignores case).
+/// -show:  &nbsp;   newer = t1,         -- Only entries modified at or after t1 (compatible with os.time()).
+/// -show:  &nbsp;   older = t2,         -- Only entries modified before t2 (compatible with os.time()).
+/// -show:  &nbsp;   sort = "name",      -- Sort by "name", "size", or "mtime" (unsorted by default).
+/// -show:  &nbsp;   reverse = true,     -- True sorts in descending order.
+/// -show:  &nbsp;   offset = 20,        -- Skip this many matching entries.
+/// -show:  &nbsp;   limit = 10,         -- Return at most this many entries.
+/// -show:  }
+/// -show:  local t = os.globfiles("*", true, flags)
 int32 glob_files(lua_State* state)
 {
     return glob_impl(state, false);
@@ -929,6 +1578,483 @@ int32 make_file_globber(lua_State* state)
     return globber_impl(state, false);
 }
 
+
+
+//------------------------------------------------------------------------------
+// One rule from a .gitignore file or from the ignore list in the flags table,
+// using the same pattern format as .gitignore files.
+struct walk_ignore_rule
+{
+    str_moveable        pattern;
+    bool                negate = false;
+    bool                dir_only = false;
+    bool                anchored = false;   // Matches the path relative to the base, not just the name.
+};
+
+//------------------------------------------------------------------------------
+// The rules that apply to a directory.  Each .gitignore file adds a list that
+// chains to the rules of the parent directory, so subdirectories share them.
+struct walk_ignore_list
+{
+    std::shared_ptr<const walk_ignore_list> parent;
+    str_moveable        base;               // Relative dir that the rules are relative to.
+    std::vector<walk_ignore_rule> rules;
+};
+
+//------------------------------------------------------------------------------
+struct walk_options
+{
+    str_moveable        root;
+    str_moveable        pattern;
+    std::shared_ptr<const walk_ignore_list> ignore;
+    int32               maxdepth = 0;       // 0 means unlimited.
+    bool                files = true;
+    bool                dirs = false;
+    bool                hidden = true;
+    bool                system = false;
+    bool                gitignore = false;
+};
+
+//------------------------------------------------------------------------------
+static bool add_walk_ignore_rule(walk_ignore_list& list, const char* line)
+{
+    str<> tmp(line);
+    while (tmp.length() && strchr(" \t\r\n", tmp.c_str()[tmp.length() - 1]))
+        tmp.truncate(tmp.length() - 1);
+    if (tmp.empty() || tmp.c_str()[0] == '#')
+        return false;
+
+    walk_ignore_rule rule;
+    const char* p = tmp.c_str();
+    if (*p == '!')
+    {
+        rule.negate = true;
+        ++p;
+    }
+    else if (*p == '\\' && (p[1] == '#' || p[1] == '!'))
+    {
+        ++p;
+    }
+
+    str<> pat(p);
+    if (pat.length() && (pat.c_str()[pat.length() - 1] == '/' || pat.c_str()[pat.length() - 1] == '\\'))
+    {
+        rule.dir_only = true;
+        pat.truncate(pat.length() - 1);
+    }
+    if (pat.empty())
+        return false;
+
+    rule.anchored = !!strpbrk(pat.c_str(), "/\\");
+    rule.pattern = pat.c_str() + ((*pat.c_str() == '/' || *pat.c_str() == '\\') ? 1 : 0);
+    list.rules.emplace_back(std::move(rule));
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Returns whether the entry at REL (relative to the walk root) is ignored.
+// The innermost list wins, and within a list the last matching rule wins, the
+// same as git.
+static bool is_walk_ignored(const walk_ignore_list* list, const char* rel, const char* name, bool is_dir)
+{
+    for (; list; list = list->parent.get())
+    {
+        const uint32 base_len = list->base.length();
+        const char* sub = rel + base_len + (base_len ? 1 : 0);
+        for (size_t i = list->rules.size(); i--;)
+        {
+            const walk_ignore_rule& rule = list->rules[i];
+            if (rule.dir_only && !is_dir)
+                continue;
+            const bool match = rule.anchored ?
+                (wildmatch(rule.pattern.c_str(), sub, WM_PATHNAME|WM_WILDSTAR|WM_CASEFOLD|WM_SLASHFOLD) == WM_MATCH) :
+                (wildmatch(rule.pattern.c_str(), name, WM_CASEFOLD) == WM_MATCH);
+            if (match)
+                return !rule.negate;
+        }
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+static std::shared_ptr<const walk_ignore_list> load_gitignore(const char* dir, const char* rel, const std::shared_ptr<const walk_ignore_list>& parent)
+{
+    str<280> file(dir);
+    path::append(file, ".gitignore");
+    wstr<280> wfile(file.c_str());
+
+    FILE* f = _wfopen(wfile.c_str(), L"rb");
+    if (!f)
+        return parent;
+
+    auto list = std::make_shared<walk_ignore_list>();
+    list->parent = parent;
+    list->base = rel;
+
+    char line[1024];
+    while (fgets(line, sizeof_array(line), f))
+        add_walk_ignore_rule(*list, line);
+    fclose(f);
+
+    if (list->rules.empty())
+        return parent;
+    return list;
+}
+
+//------------------------------------------------------------------------------
+// Walks a directory tree on worker threads.  Subdirectories go into a shared
+// queue, and a small pool of threads takes directories from it, so that wide
+// trees are enumerated in parallel.  Entries can be taken as they arrive, and
+// canceling the task stops the walk.
+class walk_async_lua_task : public async_lua_task
+{
+    struct walk_item
+    {
+        str_moveable    rel;
+        int32           depth;
+        std::shared_ptr<const walk_ignore_list> ignore;
+    };
+
+public:
+    walk_async_lua_task(const char* key, const char* src, walk_options&& options)
+    : async_lua_task(key, src)
+    , m_options(std::move(options))
+    {}
+
+    void take(std::vector<glob_entry>& out)
+    {
+        out.clear();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        out.swap(m_entries);
+    }
+
+protected:
+    void do_work() override;
+
+private:
+    void worker();
+    void walk_dir(walk_item& item);
+
+    const walk_options m_options;
+    std::mutex m_mutex;
+    std::vector<glob_entry> m_entries;
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::vector<walk_item> m_queue;
+    int32 m_busy = 0;
+
+    static const uint32 c_max_threads = 4;
+};
+
+//------------------------------------------------------------------------------
+void walk_async_lua_task::do_work()
+{
+    walk_item root;
+    root.depth = 1;
+    root.ignore = m_options.ignore;
+    m_queue.emplace_back(std::move(root));
+
+    const uint32 threads = clamp<uint32>(std::thread::hardware_concurrency(), 1, c_max_threads);
+    std::vector<std::thread> helpers;
+    for (uint32 i = 1; i < threads; ++i)
+        helpers.emplace_back(&walk_async_lua_task::worker, this);
+
+    worker();
+
+    for (auto& t : helpers)
+        t.join();
+}
+
+//------------------------------------------------------------------------------
+void walk_async_lua_task::worker()
+{
+    while (true)
+    {
+        walk_item item;
+        {
+            std::unique_lock<std::mutex> lock(m_queue_mutex);
+            while (m_queue.empty() && m_busy > 0 && !is_canceled())
+                m_queue_cv.wait_for(lock, std::chrono::milliseconds(50));
+            if (m_queue.empty() || is_canceled())
+            {
+                m_queue_cv.notify_all();
+                return;
+            }
+
+            // Taking the most recently queued directory keeps the walk mostly
+            // depth first, which keeps the queue small.
+            item = std::move(m_queue.back());
+            m_queue.pop_back();
+            ++m_busy;
+        }
+
+        walk_dir(item);
+
+        {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+            --m_busy;
+        }
+        m_queue_cv.notify_all();
+    }
+}
+
+//------------------------------------------------------------------------------
+void walk_async_lua_task::walk_dir(walk_item& item)
+{
+    str<280> dir(m_options.root.c_str());
+    path::append(dir, item.rel.c_str());
+
+    std::shared_ptr<const walk_ignore_list> ignore = item.ignore;
+    if (m_options.gitignore)
+        ignore = load_gitignore(dir.c_str(), item.rel.c_str(), ignore);
+
+    str<280> pattern(dir.c_str());
+    path::append(pattern, "*");
+
+    globber globber(pattern.c_str());
+    globber.files(true);
+    globber.directories(true);
+    globber.hidden(m_options.hidden);
+    globber.system(m_options.system);
+    globber.suffix_dirs(false);
+
+    std::vector<glob_entry> found;
+    std::vector<walk_item> subdirs;
+
+    str<288> name;
+    str<280> rel;
+    globber::extrainfo info;
+    while (!is_canceled() && globber.next(name, false, &info))
+    {
+        const bool is_dir = !!(info.attr & FILE_ATTRIBUTE_DIRECTORY);
+        if (is_dir && m_options.gitignore && _stricmp(name.c_str(), ".git") == 0)
+            continue;
+
+        rel = item.rel.c_str();
+        path::append(rel, name.c_str());
+        if (is_walk_ignored(ignore.get(), rel.c_str(), name.c_str(), is_dir))
+            continue;
+
+        if ((is_dir ? m_options.dirs : m_options.files) &&
+            (m_options.pattern.empty() || wildmatch(m_options.pattern.c_str(), name.c_str(), WM_CASEFOLD) == WM_MATCH))
+        {
+            glob_entry e;
+            e.name = rel.c_str();
+            if (is_dir)
+                path::append(e.name, "");
+            e.info = info;
+            found.emplace_back(std::move(e));
+        }
+
+        // Don't follow junctions or symlinks, since they can form cycles.
+        if (is_dir && !(info.attr & FILE_ATTRIBUTE_REPARSE_POINT) &&
+            (!m_options.maxdepth || item.depth < m_options.maxdepth))
+        {
+            walk_item sub;
+            sub.rel = rel.c_str();
+            sub.depth = item.depth + 1;
+            sub.ignore = ignore;
+            subdirs.emplace_back(std::move(sub));
+        }
+    }
+
+    if (!found.empty())
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& e : found)
+            m_entries.emplace_back(std::move(e));
+    }
+
+    if (!subdirs.empty())
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        for (auto& s : subdirs)
+            m_queue.emplace_back(std::move(s));
+    }
+}
+
+//------------------------------------------------------------------------------
+class walker_lua
+    : public lua_bindable<walker_lua>
+{
+public:
+                        walker_lua(const char* root, int32 extrainfo, const std::shared_ptr<walk_async_lua_task>& task);
+                        ~walker_lua();
+
+protected:
+    int32               next(lua_State* state);
+    int32               close(lua_State* state);
+
+private:
+    std::shared_ptr<walk_async_lua_task> m_task;
+    std::vector<glob_entry> m_taken;
+    str<288>            m_root;
+    int32               m_extrainfo;
+    int32               m_index = 1;
+
+    friend class lua_bindable<walker_lua>;
+    static const char* const c_name;
+    static const method c_methods[];
+};
+
+//------------------------------------------------------------------------------
+const char* const walker_lua::c_name = "walker_lua";
+const walker_lua::method walker_lua::c_methods[] = {
+    { "next",                   &next },
+    { "close",                  &close },
+    {}
+};
+
+//------------------------------------------------------------------------------
+walker_lua::walker_lua(const char* root, int32 extrainfo, const std::shared_ptr<walk_async_lua_task>& task)
+: m_task(task)
+, m_root(root)
+, m_extrainfo(extrainfo)
+{
+}
+
+//------------------------------------------------------------------------------
+walker_lua::~walker_lua()
+{
+    if (m_task)
+        m_task->cancel();
+}
+
+//------------------------------------------------------------------------------
+int32 walker_lua::next(lua_State* state)
+{
+    // Arg is table into which to append the entries found so far.
+
+    if (!m_task)
+    {
+        lua_pushboolean(state, false);
+        return 1;
+    }
+
+    // The main coroutine can't yield, so wait for the walk to finish (Ctrl-C
+    // cancels it).
+    if (is_main_coroutine(state))
+    {
+        while (WaitForSingleObject(m_task->get_wait_handle(), 50) == WAIT_TIMEOUT)
+        {
+            if (clink_is_signaled())
+            {
+                m_task->cancel();
+                break;
+            }
+        }
+    }
+
+    // Checking for completion first ensures nothing found after the check is
+    // lost.
+    const bool done = m_task->is_complete() || m_task->is_canceled();
+    m_task->take(m_taken);
+    for (const auto& e : m_taken)
+        push_glob_entry(state, e.name, e.info, m_root, &m_index, m_extrainfo);
+    m_taken.clear();
+
+    lua_pushboolean(state, !done);
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+int32 walker_lua::close(lua_State* state)
+{
+    if (m_task)
+    {
+        m_task->cancel();
+        m_task.reset();
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// UNDOCUMENTED; internal use only.  The public os.walk method is in core.lua.
+int32 make_walker(lua_State* state)
+{
+    const char* root = checkstring(state, 1);
+    if (!root)
+        return 0;
+
+    int32 extrainfo;
+    if (lua_isboolean(state, 2))
+        extrainfo = lua_toboolean(state, 2);
+    else
+        extrainfo = optinteger(state, 2, 0);
+
+    walk_options options;
+    options.root = root;
+
+    if (lua_istable(state, 3))
+    {
+        struct { const char* name; bool* out; } bools[] =
+        {
+            { "files",      &options.files },
+            { "dirs",       &options.dirs },
+            { "hidden",     &options.hidden },
+            { "system",     &options.system },
+            { "gitignore",  &options.gitignore },
+        };
+        for (const auto& b : bools)
+        {
+            lua_pushstring(state, b.name);
+            lua_rawget(state, 3);
+            if (!lua_isnoneornil(state, -1))
+                *b.out = !!lua_toboolean(state, -1);
+            lua_pop(state, 1);
+        }
+
+        lua_pushliteral(state, "maxdepth");
+        lua_rawget(state, 3);
+        if (lua_isnumber(state, -1))
+            options.maxdepth = max<int32>(0, int32(lua_tointeger(state, -1)));
+        lua_pop(state, 1);
+
+        lua_pushliteral(state, "pattern");
+        lua_rawget(state, 3);
+        if (const char* pattern = lua_tostring(state, -1))
+            options.pattern = pattern;
+        lua_pop(state, 1);
+
+        lua_pushliteral(state, "ignore");
+        lua_rawget(state, 3);
+        if (lua_istable(state, -1))
+        {
+            auto list = std::make_shared<walk_ignore_list>();
+            const int32 count = int32(lua_rawlen(state, -1));
+            for (int32 i = 1; i <= count; ++i)
+            {
+                lua_rawgeti(state, -1, i);
+                if (const char* line = lua_tostring(state, -1))
+                    add_walk_ignore_rule(*list, line);
+                lua_pop(state, 1);
+            }
+            if (!list->rules.empty())
+                options.ignore = list;
+        }
+        lua_pop(state, 1);
+    }
+
+    static uint32 s_counter = 0;
+    str_moveable key;
+    key.format("walk||%08x", ++s_counter);
+
+    str<> src;
+    get_lua_srcinfo(state, src);
+
+    dbg_ignore_scope(snapshot, "async walk");
+
+    auto task = std::make_shared<walk_async_lua_task>(key.c_str(), src.c_str(), std::move(options));
+    std::shared_ptr<async_lua_task> base(task);
+    if (!add_async_lua_task(base))
+        task.reset();
+
+    if (!walker_lua::make_new(state, root, extrainfo, task))
+        return 0;
+
+    return 1;
+}
+
 //------------------------------------------------------------------------------
 int32 has_file_association(lua_State* state)
 {
@@ -950,6 +2076,90 @@ int32 has_file_association(lua_State* state)
     return 1;
 }
 
+//------------------------------------------------------------------------------
+/// -name:  os.getpathexecutables
+/// -ver:   1.6.17
+/// -arg:   [prefix:string]
+/// -arg:   [associations:boolean]
+/// -ret:   table, table
+/// Returns a table of the executable files in the directories listed in the
+/// <code>PATH</code> environment variable whose names begin with
+/// <span class="arg">prefix</span>.  A file is executable if its extension is
+/// listed in the <code>PATHEXT</code> environment variable.  If
+/// <span class="arg">associations</span> is true, then files with registered
+/// file associations are included as well.
+///
+/// Each entry in the returned table is a table with the following scheme,
+/// suitable for adding as a match:
+/// -show:  {
+/// -show:  &nbsp;   match = "...",  -- The file name, without its directory.
+/// -show:  &nbsp;   type = "...",   -- "file", possibly followed by ",hidden", ",system", and ",readonly".
+/// -show:  }
+///
+/// The directories are indexed and each one is only listed again after it
+/// changes, so this is much faster than globbing each directory.  Remote
+/// directories and directories that don't allow listing their files aren't
+/// indexed; they're returned in the second table, so the caller can decide
+/// whether to glob them.
+///
+/// Hidden and system files are included or omitted the same as for
+/// <a href="#clink.filematches">clink.filematches()</a>.
+/// -show:  local matches, unindexed = os.getpathexecutables("note")
+/// -show:  for _, m in ipairs(matches) do
+/// -show:  &nbsp;   print(m.match)
+/// -show:  end
+static int32 get_path_executables(lua_State* state)
+{
+    const char* prefix = optstring(state, 1, "");
+    if (!prefix)
+        return 0;
+
+    path_executables_flags flags;
+    flags.associations = lua_toboolean(state, 2);
+    flags.hidden = g_files_hidden.get() && _rl_match_hidden_files;
+    flags.system = g_files_system.get();
+
+    std::vector<path_executable> executables;
+    std::vector<str_moveable> unindexed;
+    get_path_executables(prefix, flags, executables, unindexed);
+
+    lua_createtable(state, int32(executables.size()), 0);
+    str<32> type;
+    int32 count = 0;
+    for (const auto& exe : executables)
+    {
+        lua_createtable(state, 0, 2);
+
+        lua_pushliteral(state, "match");
+        lua_pushlstring(state, exe.name.c_str(), exe.name.length());
+        lua_rawset(state, -3);
+
+        type = "file";
+        if (exe.attr & FILE_ATTRIBUTE_HIDDEN)
+            add_type_tag(type, "hidden");
+        if (exe.attr & FILE_ATTRIBUTE_SYSTEM)
+            add_type_tag(type, "system");
+        if (exe.attr & FILE_ATTRIBUTE_READONLY)
+            add_type_tag(type, "readonly");
+
+        lua_pushliteral(state, "type");
+        lua_pushlstring(state, type.c_str(), type.length());
+        lua_rawset(state, -3);
+
+        lua_rawseti(state, -2, ++count);
+    }
+
+    lua_createtable(state, int32(unindexed.size()), 0);
+    count = 0;
+    for (const auto& dir : unindexed)
+    {
+        lua_pushlstring(state, dir.c_str(), dir.length());
+        lua_rawseti(state, -2, ++count);
+    }
+
+    return 2;
+}
+
 //------------------------------------------------------------------------------
 #ifdef USE_WNETOPENENUM
 static union
@@ -976,7 +2186,7 @@ static union
 #ifdef USE_WNETOPENENUM
 static bool delayload_mpr()
 {
-    HMODULE hlib = LoadLibrary("mpr.dll");
+    HMODULE hlib = delay_load_library("mpr.dll");
     if (!hlib)
         return false;
 
@@ -994,7 +2204,7 @@ static bool delayload_mpr()
 #else
 static bool delayload_netapi()
 {
-    HMODULE hlib = LoadLibrary("netapi32.dll");
+    HMODULE hlib = delay_load_library("netapi32.dll");
     if (!hlib)
         return false;
 
@@ -1183,16 +2393,194 @@ BOOL WINAPI EnumerateFunc(LPNETRESOURCEW lpnr)
         return FALSE;
     }
 
-    return TRUE;
+    return TRUE;
+}
+#endif // USE_WNETOPENENUM && DEBUG_TRAVERSE_GLOBAL_NET
+
+//------------------------------------------------------------------------------
+// Caches the share names of servers, since enumerating the shares on a busy
+// file server can take seconds.  Entries expire after a few minutes so that
+// added or removed shares are eventually noticed.
+//
+// Entries are also shared with other sessions (see shared_table) when the
+// names fit in a shared value.  Shared entries expire the same way, since
+// GetTickCount64 is the same for all processes.
+//
+// Names are stored with a '0' or '1' prefix that says whether the share is a
+// special share (like ADMIN$ or C$), so one entry serves with or without
+// hidden shares.
+class share_cache
+{
+    struct entry
+    {
+        str_moveable    server;
+        std::vector<str_moveable> shares;
+        ULONGLONG       tick;
+    };
+
+    struct shared_value
+    {
+        ULONGLONG       tick;
+        uint32          count;
+        char            names[2036];        // NUL separated.
+    };
+
+public:
+                        share_cache() : m_shared(MAX_PATH, sizeof(shared_value), 64) {}
+    void                add(const char* server, const std::vector<str_moveable>& shares, ULONGLONG tick=0);
+    bool                get(const char* server, std::vector<str_moveable>& shares);
+
+private:
+    bool                get_shared(const char* key, std::vector<str_moveable>& shares);
+    static void         make_key(const char* server, str_base& out);
+    std::vector<entry>  m_entries;
+    std::mutex          m_mutex;
+    shared_table        m_shared;
+
+    static const size_t c_max_entries = 32;
+    static const ULONGLONG c_max_age = 5 * 60 * 1000;
+};
+
+static share_cache s_share_cache;
+
+//------------------------------------------------------------------------------
+void share_cache::make_key(const char* server, str_base& out)
+{
+    out = server;
+    str_ascii_tolower(out.data());
+}
+
+//------------------------------------------------------------------------------
+void share_cache::add(const char* server, const std::vector<str_moveable>& shares, ULONGLONG tick)
+{
+    str<> key;
+    make_key(server, key);
+
+    // A tick means the entry came from the shared table; otherwise share it.
+    if (!tick)
+    {
+        tick = GetTickCount64();
+        if (m_shared.open(L"Local\\clink_shares"))
+        {
+            shared_value value = { tick };
+            uint32 used = 0;
+            for (const auto& share : shares)
+            {
+                if (used + share.length() + 1 > sizeof(value.names))
+                {
+                    value.count = 0;
+                    break;
+                }
+                memcpy(value.names + used, share.c_str(), share.length() + 1);
+                used += share.length() + 1;
+                ++value.count;
+            }
+            if (value.count == shares.size())
+                m_shared.store(key.c_str(), &value, uint32(offsetof(shared_value, names) + used));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    dbg_ignore_scope(snapshot, "share cache");
+
+    entry* e = nullptr;
+    for (auto& existing : m_entries)
+    {
+        if (existing.server.equals(key.c_str()))
+        {
+            e = &existing;
+            break;
+        }
+    }
+
+    if (!e)
+    {
+        // Drop the oldest entry when full.
+        if (m_entries.size() >= c_max_entries)
+        {
+            auto oldest = std::min_element(m_entries.begin(), m_entries.end(), [](const entry& a, const entry& b) {
+                return a.tick < b.tick;
+            });
+            m_entries.erase(oldest);
+        }
+        m_entries.emplace_back();
+        e = &m_entries.back();
+        e->server = key.c_str();
+    }
+
+    e->shares.clear();
+    for (const auto& share : shares)
+        e->shares.emplace_back(share.c_str());
+    e->tick = tick;
+}
+
+//------------------------------------------------------------------------------
+bool share_cache::get(const char* server, std::vector<str_moveable>& shares)
+{
+    str<> key;
+    make_key(server, key);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto iter = m_entries.begin(); iter != m_entries.end(); ++iter)
+        {
+            if (!iter->server.equals(key.c_str()))
+                continue;
+
+            if (GetTickCount64() - iter->tick > c_max_age)
+            {
+                m_entries.erase(iter);
+                break;
+            }
+
+            dbg_ignore_scope(snapshot, "share cache");
+            shares.clear();
+            for (const auto& share : iter->shares)
+                shares.emplace_back(share.c_str());
+            return true;
+        }
+    }
+
+    return get_shared(key.c_str(), shares);
+}
+
+//------------------------------------------------------------------------------
+bool share_cache::get_shared(const char* key, std::vector<str_moveable>& shares)
+{
+    if (!m_shared.open(L"Local\\clink_shares"))
+        return false;
+
+    shared_value value;
+    if (!m_shared.find(key, &value))
+        return false;
+    if (GetTickCount64() - value.tick > c_max_age)
+        return false;
+
+    dbg_ignore_scope(snapshot, "share cache");
+    shares.clear();
+    const char* name = value.names;
+    const char* const end = value.names + sizeof(value.names);
+    for (uint32 i = value.count; i--;)
+    {
+        const size_t len = strnlen(name, end - name);
+        if (name + len >= end)
+            return false;
+        shares.emplace_back(name);
+        name += len + 1;
+    }
+
+    add(key, shares, value.tick);
+    return true;
 }
-#endif // USE_WNETOPENENUM && DEBUG_TRAVERSE_GLOBAL_NET
+
+
 
 //------------------------------------------------------------------------------
 class enumshares_async_lua_task : public async_lua_task
 {
 public:
-    enumshares_async_lua_task(const char* key, const char* src, async_yield_lua* asyncyield, const char* server, bool hidden)
-    : async_lua_task(key, src)
+    enumshares_async_lua_task(const char* key, const char* src, async_yield_lua* asyncyield, const char* server, bool hidden, bool run_until_complete=false)
+    : async_lua_task(key, src, run_until_complete)
     , m_server(server)
     , m_hidden(hidden)
     , m_ismain(!asyncyield)
@@ -1200,6 +2588,26 @@ public:
         set_asyncyield(asyncyield);
     }
 
+    // Fills in the shares from the cache, when possible; then there's no need
+    // to start the task.
+    bool from_cache()
+    {
+        std::vector<str_moveable> shares;
+        if (!s_share_cache.get(m_server.c_str(), shares))
+            return false;
+
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        for (auto& share : shares)
+        {
+            if (m_hidden || share.c_str()[0] == '0')
+                m_shares.emplace_back(std::move(share));
+        }
+        m_cached = true;
+        return true;
+    }
+
+    bool is_cached() const { return m_cached; }
+
     bool next(str_base& out, bool* special=nullptr)
     {
         bool ret = false;
@@ -1221,6 +2629,8 @@ public:
     bool wait(uint32 timeout)
     {
         assert(m_ismain);
+        if (m_cached)
+            return true;
         const DWORD waited = WaitForSingleObject(get_wait_handle(), timeout);
         return waited == WAIT_OBJECT_0;
     }
@@ -1232,6 +2642,7 @@ private:
     const str_moveable m_server;
     const bool m_hidden;
     const bool m_ismain;
+    bool m_cached = false;
     std::recursive_mutex m_mutex;
     std::vector<str_moveable> m_shares;
     size_t m_index = 0;
@@ -1322,6 +2733,7 @@ void enumshares_async_lua_task::do_work()
     DWORD entries_read;
     DWORD total_entries;
     DWORD resume_handle = 0;
+    std::vector<str_moveable> all;
     NET_API_STATUS res = ERROR_MORE_DATA;
     while (!is_canceled() && res == ERROR_MORE_DATA)
     {
@@ -1337,8 +2749,6 @@ void enumshares_async_lua_task::do_work()
                 for (PSHARE_INFO_1 info = buffer; entries_read--; ++info)
                 {
                     const bool special = !!(info->shi1_type & STYPE_SPECIAL);
-                    if (special && !g_files_hidden.get())
-                        continue;
                     if ((info->shi1_type & STYPE_MASK) == STYPE_DISKTREE)
                     {
 #ifdef DEBUG_SLEEP
@@ -1348,6 +2758,11 @@ std::lock_guard<std::recursive_mutex> lock(m_mutex);
                         dbg_ignore_scope(snapshot, "async enum shares");
                         wstr_moveable netname;
                         netname.format(L"%c%s", special ? '1' : '0', info->shi1_netname);
+                        // The cache keeps special shares too, for requests
+                        // that include hidden shares.
+                        all.emplace_back(netname.c_str());
+                        if (special && !m_hidden)
+                            continue;
                         m_shares.emplace_back(netname.c_str());
 #ifdef DEBUG_SLEEP
 wake_asyncyield();
@@ -1361,6 +2776,10 @@ wake_asyncyield();
         }
     };
 
+    // Only complete enumerations are cached.
+    if (res == ERROR_SUCCESS && !is_canceled())
+        s_share_cache.add(m_server.c_str(), all);
+
     wake_asyncyield();
 }
 
@@ -1389,9 +2808,6 @@ private:
     static const enumshares_lua::method c_methods[];
 };
 
-//------------------------------------------------------------------------------
-inline bool is_main_coroutine(lua_State* state) { return G(state)->mainthread == state; }
-
 //------------------------------------------------------------------------------
 int32 enumshares_lua::iter_aux(lua_State* state)
 {
@@ -1424,7 +2840,11 @@ int32 enumshares_lua::iter_aux(lua_State* state)
         return 3;
     }
 
-    if (async && async->is_expired())
+    if (self->m_task->is_cached())
+    {
+        return 0;
+    }
+    else if (async && async->is_expired())
     {
         self->m_task->cancel();
         return 0;
@@ -1467,6 +2887,10 @@ const enumshares_lua::method enumshares_lua::c_methods[] = {
 /// available on the given <span class="arg">server</span> one name at a time.
 /// (This only enumerates SMB UNC share names.)
 ///
+/// Starting in v1.6.17, the share names are cached for a few minutes (and
+/// shared with other Clink sessions), so enumerating the same server again is
+/// fast.
+///
 /// When <span class="arg">hidden</span> is true, special hidden shares like
 /// ADMIN$ or C$ are included.
 ///
@@ -1539,7 +2963,8 @@ static int32 enum_shares(lua_State* state)
     enumshares_lua* es = enumshares_lua::make_new(state, task);
     if (!es)
         return 0;
-    add_async_lua_task(std::shared_ptr<async_lua_task>(task));
+    if (!task->from_cache())
+        add_async_lua_task(std::shared_ptr<async_lua_task>(task));
 
     // If a timeout was given and this is the main coroutine, wait for
     // completion until the timeout, and then cancel the task if not yet
@@ -1556,6 +2981,48 @@ static int32 enum_shares(lua_State* state)
     return 1;
 }
 
+//------------------------------------------------------------------------------
+// Starts enumerating a server's shares as soon as "\\server\" is typed at the
+// end of the input line, so that the share names are usually already cached
+// by the time they're completed.
+void prefetch_shares(const char* line)
+{
+    const char* word = line;
+    for (const char* p = line; *p; ++p)
+    {
+        if (*p == ' ' || *p == '\t' || *p == '"' || *p == '=')
+            word = p + 1;
+    }
+
+    if (word[0] != '\\' || word[1] != '\\')
+        return;
+    const char* const server = word + 2;
+    const char* const sep = strchr(server, '\\');
+    if (!sep || sep == server || sep[1])
+        return;
+
+    str<> name;
+    name.concat(server, int32(sep - server));
+    if (strpbrk(name.c_str(), "/:*?<>|"))
+        return;
+
+    std::vector<str_moveable> shares;
+    if (s_share_cache.get(name.c_str(), shares))
+        return;
+
+    str_moveable key;
+    key.format("enumshares||prefetch||%s", name.c_str());
+    if (find_async_lua_task(key.c_str()))
+        return;
+
+    dbg_ignore_scope(snapshot, "async enum shares");
+
+    // Run until complete, so that the result gets cached even if the input
+    // line ends first.
+    std::shared_ptr<async_lua_task> task = std::make_shared<enumshares_async_lua_task>(key.c_str(), "prefetch shares", nullptr, name.c_str(), false, true);
+    add_async_lua_task(task);
+}
+
 //------------------------------------------------------------------------------
 static void get_bool_field(lua_State* state, const char* field, bool& out)
 {
@@ -2080,6 +3547,7 @@ int32 get_screen_info_impl(lua_State* state, bool back_compat)
     int32 values[4];
     CONSOLE_SCREEN_BUFFER_INFO csbi;
 
+    wait_for_console_output();
     GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi);
     values[0] = csbi.dwSize.X;
     values[1] = csbi.dwSize.Y;
@@ -2589,6 +4057,42 @@ static int32 expand_abbreviated_path(lua_State *state)
     return 3;
 }
 
+//------------------------------------------------------------------------------
+// UNDOCUMENTED; internal use only.  Returns a string that changes whenever the
+// set of children in the directory may have changed (its creation or last
+// write time changed), or nil if the directory can't be read.  Also returns nil
+// if the directory changed within the last 2 seconds, since another change
+// that soon might not produce a different file time.
+static int32 get_dir_stamp(lua_State* state)
+{
+    const char* dir = checkstring(state, 1);
+    if (!dir)
+        return 0;
+
+    wstr<280> wdir(dir);
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!GetFileAttributesExW(wdir.c_str(), GetFileExInfoStandard, &fad) ||
+        !(fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        return 0;
+
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    ULARGE_INTEGER a, b;
+    a.LowPart = now.dwLowDateTime;
+    a.HighPart = now.dwHighDateTime;
+    b.LowPart = fad.ftLastWriteTime.dwLowDateTime;
+    b.HighPart = fad.ftLastWriteTime.dwHighDateTime;
+    if (a.QuadPart <= b.QuadPart + 2 * 10000000ull)
+        return 0;
+
+    str<48> stamp;
+    stamp.format("%08x%08x.%08x%08x",
+                 fad.ftCreationTime.dwHighDateTime, fad.ftCreationTime.dwLowDateTime,
+                 fad.ftLastWriteTime.dwHighDateTime, fad.ftLastWriteTime.dwLowDateTime);
+    lua_pushlstring(state, stamp.c_str(), stamp.length());
+    return 1;
+}
+
 //------------------------------------------------------------------------------
 /// -name:  os.isuseradmin
 /// -ver:   1.4.17
@@ -2602,115 +4106,69 @@ static int32 is_user_admin(lua_State *state)
 }
 
 //------------------------------------------------------------------------------
-static bool maybe_rawset(lua_State *state, const char* name, const char* value)
+// Version info read from a file, cached by full path and validated by the
+// file's size and modified time.  Reading the version resource means loading
+// the file's resources, which is much slower than the directory lookup needed
+// to validate the cache entry.
+struct file_version_info
 {
-    if (!value || !*value)
-        return false;
+    str_moveable        path;
+    uint64              size = 0;
+    FILETIME            modified = {};
+    DWORD               error = 0;      // Nonzero when the file has no version info.
+    std::vector<std::pair<const char*, str_moveable>> fields;
+    std::vector<const char*> fileflags;
+};
 
-    lua_pushstring(state, name);
-    lua_pushstring(state, value);
-    lua_rawset(state, -3);
-    return true;
-}
+static str_unordered_map_caseless<std::unique_ptr<file_version_info>> s_file_versions;
+static const size_t c_max_cached_file_versions = 256;
 
 //------------------------------------------------------------------------------
-/// -name:  os.getfileversion
-/// -ver:   1.4.17
-/// -arg:   file:string
-/// -ret:   table | nil
-/// This tries to get a Windows file version info resource from the specified
-/// file.  It tries to get translated strings in the closest available language
-/// to the current user language configured in the OS.
-///
-/// If successful, the returned table contains as many of the following fields
-/// as were available in the file's version info resource.
-/// -show:  local info = os.getfileversion("c:/windows/notepad.exe")
-/// -show:  -- info.filename            c:\windows\notepad.exe
-/// -show:  -- info.filevernum          10.0.19041.1865
-/// -show:  -- info.productvernum       10.0.19041.1865
-/// -show:  -- info.fileflags
-/// -show:  -- info.osplatform          Windows NT
-/// -show:  -- info.osqualifier
-/// -show:  -- info.comments
-/// -show:  -- info.companyname         Microsoft Corporation
-/// -show:  -- info.filedescription     Notepad
-/// -show:  -- info.fileversion         10.0.19041.1 (WinBuild.160101.0800)
-/// -show:  -- info.internalname        Notepad
-/// -show:  -- info.legalcopyright      © Microsoft Corporation. All rights reserved.
-/// -show:  -- info.legaltrademarks
-/// -show:  -- info.originalfilename    NOTEPAD.EXE.MUI
-/// -show:  -- info.productname         Microsoft® Windows® Operating System
-/// -show:  -- info.productversion      10.0.19041.1
-/// -show:  -- info.privatebuild
-/// -show:  -- info.specialbuild
-/// Note:  The <span class="arg">fileflags</span> field may be nil (omitted),
-/// or it may contain a table with additional fields.
-/// -show:  if info.fileflags then
-/// -show:  -- info.fileflags.debug
-/// -show:  -- info.fileflags.prerelease
-/// -show:  -- info.fileflags.patched
-/// -show:  -- info.fileflags.privatebuild
-/// -show:  -- info.fileflags.specialbuild
-/// -show:  end
-static int32 get_file_version(lua_State *state)
+static void add_version_field(file_version_info& info, const char* name, const char* value)
 {
-    const char* file = checkstring(state, 1);
-    if (!file)
-        return 0;
-
-    if (!s_version.init())
-        return 0;
+    if (!value || !*value)
+        return;
+    info.fields.emplace_back(name, str_moveable(value));
+}
 
-    str<> full_file;
+//------------------------------------------------------------------------------
+static void read_file_version(file_version_info& info)
+{
     str<> tmp;
     void* pv;
     UINT cb;
 
-    os::get_full_path_name(file, full_file);
-
-    globber globber(full_file.c_str());
-    globber.directories(false);
-    globber.hidden(true);
-    globber.system(true);
-
-    globber::extrainfo extra;
-    if (!globber.next(tmp, true, &extra))
-    {
-os_error:
-        map_errno();
-os_stringresult:
-        return lua_osstringresult(state, nullptr, false);
-    }
-
-    DWORD dwErr = 0;
     DWORD dwHandle;
-    wstr<> wfile(full_file.c_str());
+    wstr<> wfile(info.path.c_str());
     const DWORD dwSize = s_version.GetFileVersionInfoSizeW(wfile.c_str(), &dwHandle);
     if (!dwSize)
     {
-        dwErr = GetLastError();
+        DWORD dwErr = GetLastError();
         if (dwErr == ERROR_RESOURCE_DATA_NOT_FOUND ||
             dwErr == ERROR_RESOURCE_TYPE_NOT_FOUND ||
             dwErr == ERROR_RESOURCE_NAME_NOT_FOUND ||
             dwErr == ERROR_RESOURCE_LANG_NOT_FOUND)
             dwErr = ERROR_FILE_NOT_FOUND;
-        map_errno(dwErr);
-        goto os_stringresult;
+        info.error = dwErr ? dwErr : ERROR_FILE_NOT_FOUND;
+        return;
     }
 
     autoptr<BYTE> verinfo(static_cast<BYTE*>(malloc(dwSize)));
     if (!verinfo.get())
     {
-        map_errno(ERROR_OUTOFMEMORY);
-        goto os_stringresult;
+        info.error = ERROR_OUTOFMEMORY;
+        return;
     }
 
     if (!s_version.GetFileVersionInfoW(wfile.c_str(), dwHandle, dwSize, verinfo.get()))
-        goto os_error;
-
-    lua_createtable(state, 0, 10);
+    {
+        info.error = GetLastError();
+        if (!info.error)
+            info.error = ERROR_FILE_NOT_FOUND;
+        return;
+    }
 
-    maybe_rawset(state, "filename", full_file.c_str());
+    add_version_field(info, "filename", info.path.c_str());
 
     pv = nullptr;
     cb = 0;
@@ -2723,14 +4181,14 @@ os_stringresult:
             LOWORD(pffi->dwFileVersionMS),
             HIWORD(pffi->dwFileVersionLS),
             LOWORD(pffi->dwFileVersionLS));
-        maybe_rawset(state, "filevernum", tmp.c_str());
+        add_version_field(info, "filevernum", tmp.c_str());
 
         tmp.format("%u.%u.%u.%u",
             HIWORD(pffi->dwProductVersionMS),
             LOWORD(pffi->dwProductVersionMS),
             HIWORD(pffi->dwProductVersionLS),
             LOWORD(pffi->dwProductVersionLS));
-            maybe_rawset(state, "productvernum", tmp.c_str());
+        add_version_field(info, "productvernum", tmp.c_str());
 
         struct FlagEntry
         {
@@ -2748,26 +4206,12 @@ os_stringresult:
                 { VS_FF_SPECIALBUILD, "specialbuild" },
             };
 
-            lua_pushliteral(state, "fileflags");
-            lua_createtable(state, 0, 5);
-
-            bool any = false;
             for (uint32 ii = 0; ii < _countof(c_file_flags); ++ii)
             {
                 if ((c_file_flags[ii].dw & pffi->dwFileFlagsMask) &&
                     (c_file_flags[ii].dw & pffi->dwFileFlags))
-                {
-                    lua_pushstring(state, c_file_flags[ii].psz);
-                    lua_pushboolean(state, true);
-                    lua_rawset(state, -3);
-                    any = true;
-                }
+                    info.fileflags.push_back(c_file_flags[ii].psz);
             }
-
-            if (any)
-                lua_rawset(state, -3);
-            else
-                lua_pop(state, 2);
         }
 
         {
@@ -2796,9 +4240,7 @@ os_stringresult:
             {
                 if (c_platforms[ii].dw == (dwFileOS & 0xffff0000))
                 {
-                    lua_pushliteral(state, "osplatform");
-                    lua_pushstring(state, c_platforms[ii].psz);
-                    lua_rawset(state, -3);
+                    add_version_field(info, "osplatform", c_platforms[ii].psz);
                     break;
                 }
             }
@@ -2806,9 +4248,7 @@ os_stringresult:
             {
                 if (c_qualifiers[ii].dw == LOWORD(dwFileOS))
                 {
-                    lua_pushlightuserdata(state, "osqualifier");
-                    lua_pushstring(state, c_qualifiers[ii].psz);
-                    lua_rawset(state, -3);
+                    add_version_field(info, "osqualifier", c_qualifiers[ii].psz);
                     break;
                 }
             }
@@ -2893,20 +4333,205 @@ os_stringresult:
                 { L"SpecialBuild", "specialbuild", VS_FF_SPECIALBUILD },
             };
 
-            for (const auto& info : c_info)
+            for (const auto& field : c_info)
             {
                 pv = nullptr;
                 cb = 0;
                 translationPath.truncate(len_translationPath);
-                translationPath.concat(info.stringName);
+                translationPath.concat(field.stringName);
                 if (s_version.VerQueryValueW(verinfo.get(), translationPath.c_str(), &pv, &cb) && pv && cb)
                 {
                     tmp = static_cast<WCHAR*>(pv);
-                    maybe_rawset(state, info.fieldName, tmp.c_str());
+                    add_version_field(info, field.fieldName, tmp.c_str());
                 }
             }
         }
     }
+}
+
+//------------------------------------------------------------------------------
+// Returns the cached version info for FILE, reading it if the file changed
+// since it was cached.  Returns nullptr and sets errno if the file wasn't
+// found or has no version info.
+static const file_version_info* get_file_version_info(const char* file)
+{
+    str<> full_file;
+    str<> tmp;
+    os::get_full_path_name(file, full_file);
+
+    globber globber(full_file.c_str());
+    globber.directories(false);
+    globber.hidden(true);
+    globber.system(true);
+
+    globber::extrainfo extra;
+    if (!globber.next(tmp, true, &extra))
+    {
+        map_errno();
+        return nullptr;
+    }
+
+    auto iter = s_file_versions.find(full_file.c_str());
+    if (iter != s_file_versions.end())
+    {
+        const file_version_info* info = iter->second.get();
+        if (info->size == extra.size && CompareFileTime(&info->modified, &extra.modified) == 0)
+        {
+            if (!info->error)
+                return info;
+            map_errno(info->error);
+            return nullptr;
+        }
+        s_file_versions.erase(iter);
+    }
+
+    auto info = std::make_unique<file_version_info>();
+    info->path = full_file.c_str();
+    info->size = extra.size;
+    info->modified = extra.modified;
+    read_file_version(*info);
+
+    const DWORD error = info->error;
+    const file_version_info* ret = error ? nullptr : info.get();
+
+    // Out of memory isn't a property of the file, so don't remember it.
+    if (error != ERROR_OUTOFMEMORY)
+    {
+        if (s_file_versions.size() >= c_max_cached_file_versions)
+            s_file_versions.clear();
+        const char* key = info->path.c_str();
+        s_file_versions.emplace(key, std::move(info));
+    }
+
+    if (error)
+        map_errno(error);
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+static void push_file_version(lua_State* state, const file_version_info& info)
+{
+    lua_createtable(state, 0, int32(info.fields.size() + 1));
+
+    for (const auto& field : info.fields)
+    {
+        lua_pushstring(state, field.first);
+        lua_pushlstring(state, field.second.c_str(), field.second.length());
+        lua_rawset(state, -3);
+    }
+
+    if (!info.fileflags.empty())
+    {
+        lua_pushliteral(state, "fileflags");
+        lua_createtable(state, 0, int32(info.fileflags.size()));
+        for (const char* flag : info.fileflags)
+        {
+            lua_pushstring(state, flag);
+            lua_pushboolean(state, true);
+            lua_rawset(state, -3);
+        }
+        lua_rawset(state, -3);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// -name:  os.getfileversion
+/// -ver:   1.4.17
+/// -arg:   file:string
+/// -ret:   table | nil
+/// This tries to get a Windows file version info resource from the specified
+/// file.  It tries to get translated strings in the closest available language
+/// to the current user language configured in the OS.
+///
+/// If successful, the returned table contains as many of the following fields
+/// as were available in the file's version info resource.
+/// -show:  local info = os.getfileversion("c:/windows/notepad.exe")
+/// -show:  -- info.filename            c:\windows\notepad.exe
+/// -show:  -- info.filevernum          10.0.19041.1865
+/// -show:  -- info.productvernum       10.0.19041.1865
+/// -show:  -- info.fileflags
+/// -show:  -- info.osplatform          Windows NT
+/// -show:  -- info.osqualifier
+/// -show:  -- info.comments
+/// -show:  -- info.companyname         Microsoft Corporation
+/// -show:  -- info.filedescription     Notepad
+/// -show:  -- info.fileversion         10.0.19041.1 (WinBuild.160101.0800)
+/// -show:  -- info.internalname        Notepad
+/// -show:  -- info.legalcopyright      © Microsoft Corporation. All rights reserved.
+/// -show:  -- info.legaltrademarks
+/// -show:  -- info.originalfilename    NOTEPAD.EXE.MUI
+/// -show:  -- info.productname         Microsoft® Windows® Operating System
+/// -show:  -- info.productversion      10.0.19041.1
+/// -show:  -- info.privatebuild
+/// -show:  -- info.specialbuild
+/// Note:  The <span class="arg">fileflags</span> field may be nil (omitted),
+/// or it may contain a table with additional fields.
+/// -show:  if info.fileflags then
+/// -show:  -- info.fileflags.debug
+/// -show:  -- info.fileflags.prerelease
+/// -show:  -- info.fileflags.patched
+/// -show:  -- info.fileflags.privatebuild
+/// -show:  -- info.fileflags.specialbuild
+/// -show:  end
+///
+/// Starting in v1.6.17, the version info is cached for the rest of the
+/// session, and is only read from the file again if its size or modified time
+/// changes.
+static int32 get_file_version(lua_State *state)
+{
+    const char* file = checkstring(state, 1);
+    if (!file)
+        return 0;
+
+    if (!s_version.init())
+        return 0;
+
+    const file_version_info* info = get_file_version_info(file);
+    if (!info)
+        return lua_osstringresult(state, nullptr, false);
+
+    push_file_version(state, *info);
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  os.getfileversions
+/// -ver:   1.6.17
+/// -arg:   files:table
+/// -ret:   table
+/// Gets the Windows file version info for each file in the
+/// <span class="arg">files</span> table, the same as
+/// <a href="#os.getfileversion">os.getfileversion()</a>.  Returns a table
+/// where each entry corresponds to the entry at the same index in
+/// <span class="arg">files</span>, and is either a version info table or false
+/// if the file couldn't be found or has no version info.
+/// -show:  local infos = os.getfileversions({ "c:/windows/notepad.exe", "c:/windows/regedit.exe" })
+/// -show:  for i, info in ipairs(infos) do
+/// -show:  &nbsp;   print(i, info and info.filevernum or "none")
+/// -show:  end
+static int32 get_file_versions(lua_State *state)
+{
+    luaL_checktype(state, 1, LUA_TTABLE);
+
+    if (!s_version.init())
+        return 0;
+
+    const int32 count = int32(lua_rawlen(state, 1));
+    lua_createtable(state, count, 0);
+
+    for (int32 i = 1; i <= count; ++i)
+    {
+        lua_rawgeti(state, 1, i);
+        const char* file = lua_tostring(state, -1);
+        const file_version_info* info = file ? get_file_version_info(file) : nullptr;
+        lua_pop(state, 1);
+
+        if (info)
+            push_file_version(state, *info);
+        else
+            lua_pushboolean(state, false);
+        lua_rawseti(state, -2, i);
+    }
 
     return 1;
 }
@@ -2963,14 +4588,18 @@ void os_lua_initialise(lua_state& lua)
         { "expandabbreviatedpath", &expand_abbreviated_path },
         { "isuseradmin", &is_user_admin },
         { "getfileversion", &get_file_version },
+        { "getfileversions", &get_file_versions },
         { "enumshares",  &enum_shares },
         { "findfiles",   &find_files },
+        { "getpathexecutables", &get_path_executables },
         // UNDOCUMENTED; internal use only.
         { "_globdirs",   &glob_dirs },  // Public os.globdirs method is in core.lua.
         { "_globfiles",  &glob_files }, // Public os.globfiles method is in core.lua.
         { "_makedirglobber", &make_dir_globber },
         { "_makefileglobber", &make_file_globber },
+        { "_makewalker", &make_walker },
         { "_hasfileassociation", &has_file_association },
+        { "_getdirstamp", &get_dir_stamp },
     };
 
     lua_State* state = lua.get_state();
@@ -253,6 +253,114 @@ static int32 to_parent(lua_State* state)
     return 2;
 }
 
+//------------------------------------------------------------------------------
+// Calls FUNC for each string in the table at INDEX and returns a new table of
+// the results at the same indices.  Returns false if INDEX isn't a table.
+template <typename T>
+static bool map_strings(lua_State* state, int32 index, T&& func)
+{
+    if (!lua_istable(state, index))
+        return false;
+
+    str<288> out;
+    const int32 num = int32(lua_rawlen(state, index));
+    lua_createtable(state, num, 0);
+    for (int32 i = 1; i <= num; ++i)
+    {
+        lua_rawgeti(state, index, i);
+        const char* in = lua_tostring(state, -1);
+        out.clear();
+        if (in)
+            func(in, out);
+        lua_pop(state, 1);
+
+        if (in)
+            lua_pushlstring(state, out.c_str(), out.length());
+        else
+            lua_pushboolean(state, false);
+        lua_rawseti(state, -2, i);
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  path.joinmany
+/// -ver:   1.6.17
+/// -arg:   left:string
+/// -arg:   names:table
+/// -ret:   table
+/// Returns a table with the result of
+/// <a href="#path.join">path.join()</a> for <span class="arg">left</span> and
+/// each string in <span class="arg">names</span>, at the same indices.  This
+/// is much faster than calling <code>path.join()</code> in a loop when there
+/// are many names.  Any non-string entries in <span class="arg">names</span>
+/// produce <code>false</code> at the same index.
+/// -show:  path.joinmany("c:\dir", { "a.txt", "b.txt" })
+/// -show:  -- returns { "c:\dir\a.txt", "c:\dir\b.txt" }
+static int32 join_many(lua_State* state)
+{
+    const char* lhs = checkstring(state, 1);
+    if (!lhs)
+        return 0;
+
+    if (!map_strings(state, 2, [lhs](const char* in, str_base& out) {
+            path::join(lhs, in, out);
+        }))
+        return 0;
+
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  path.getnames
+/// -ver:   1.6.17
+/// -arg:   paths:table
+/// -ret:   table
+/// Returns a table with the result of
+/// <a href="#path.getname">path.getname()</a> for each string in
+/// <span class="arg">paths</span>, at the same indices.  Any non-string entries
+/// in <span class="arg">paths</span> produce <code>false</code> at the same
+/// index.
+/// -show:  path.getnames({ "c:\dir\a.txt", "b.txt" })
+/// -show:  -- returns { "a.txt", "b.txt" }
+static int32 get_names(lua_State* state)
+{
+    if (!map_strings(state, 1, [](const char* in, str_base& out) {
+            path::get_name(in, out);
+        }))
+        return 0;
+
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  path.normalisemany
+/// -ver:   1.6.17
+/// -arg:   paths:table
+/// -arg:   [separator:string]
+/// -ret:   table
+/// Returns a table with the result of
+/// <a href="#path.normalise">path.normalise()</a> for each string in
+/// <span class="arg">paths</span>, at the same indices.  Any non-string entries
+/// in <span class="arg">paths</span> produce <code>false</code> at the same
+/// index.
+static int32 normalise_many(lua_State* state)
+{
+    int32 separator = 0;
+    if (const char* sep_str = optstring(state, 2, ""))
+        separator = sep_str[0];
+    else
+        return 0;
+
+    if (!map_strings(state, 1, [separator](const char* in, str_base& out) {
+            out = in;
+            path::normalise(out, separator);
+        }))
+        return 0;
+
+    return 1;
+}
+
 //------------------------------------------------------------------------------
 /// -name:  path.fnmatch
 /// -ver:   1.4.24
@@ -362,6 +470,9 @@ void path_lua_initialise(lua_state& lua)
         { "join",          &join },
         { "isexecext",     &is_exec_ext },
         { "toparent",      &to_parent },
+        { "joinmany",      &join_many },
+        { "getnames",      &get_names },
+        { "normalisemany", &normalise_many },
         { "fnmatch",       &api_fnmatch },
         // UNDOCUMENTED; internal use only.
         { "isdevice",      &is_device },
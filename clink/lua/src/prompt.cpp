@@ -9,6 +9,7 @@
 #include <core/str_iter.h>
 #include <core/os.h>
 #include <lib/line_buffer.h>
+#include <terminal/terminal_helpers.h>
 #include "lua_script_loader.h"
 #include "lua_state.h"
 
@@ -451,30 +452,62 @@ bool prompt_filter::filter(const char* in, const char* rin, str_base& out, str_b
         lua_pushnil(state);
     }
 
+    // Any transient prompt kept from before is only valid for the prompt it
+    // was assembled with.
+    m_has_transient = false;
+
     rollback<bool> rb(s_filtering, true);
-    if (m_lua.pcall(state, 5, 3) != 0)
+    if (m_lua.pcall(state, 5, 5) != 0)
     {
         lua_settop(state, top);
         return !transient;
     }
 
     // Collect the filtered prompt.
-    const char* prompt = lua_tostring(state, -3);
-    const char* rprompt = lua_tostring(state, -2);
-    const bool ok = lua_toboolean(state, -1);
+    const char* prompt = lua_tostring(state, -5);
+    const char* rprompt = lua_tostring(state, -4);
+    const bool ok = lua_toboolean(state, -3);
     out = prompt;
     rout = rprompt;
 
+    // Keep the transient prompt, if prompt filter segments provided it.
+    const char* tprompt = lua_tostring(state, -2);
+    if (!transient && tprompt)
+    {
+        const char* trprompt = lua_tostring(state, -1);
+        m_transient = tprompt;
+        m_transient_r = trprompt ? trprompt : "";
+        m_has_transient = true;
+    }
+
     lua_settop(state, top);
     return ok && (!transient || (prompt && rprompt));
 }
 
+//------------------------------------------------------------------------------
+// Gets the transient prompt that was assembled from prompt filter segments while
+// filtering the most recent prompt, so the transient prompt can be shown without
+// running the prompt filters again.  It can only be used once.
+bool prompt_filter::take_transient(str_base& out, str_base& rout)
+{
+    if (!m_has_transient)
+        return false;
+
+    out = m_transient.c_str();
+    rout = m_transient_r.c_str();
+    m_has_transient = false;
+    return true;
+}
+
 
 
 //------------------------------------------------------------------------------
 prompt prompt_utils::extract_from_console()
 {
     // Find where the cursor is. This will be the end of the prompt to extract.
+    // Pending output must reach the console first, or the cursor position and
+    // the text read back would be stale.
+    wait_for_console_output();
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE);
     if (GetConsoleScreenBufferInfo(handle, &csbi) == FALSE)
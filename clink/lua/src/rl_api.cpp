@@ -12,11 +12,13 @@
 #include <core/str_compare.h>
 #include <core/str_iter.h>
 #include <terminal/ecma48_iter.h>
+#include <terminal/terminal_helpers.h>
 #include <lib/host_callbacks.h>
 #include <lib/line_editor_integration.h>
 #include <lib/rl_integration.h>
 #include <lib/matches.h>
 #include <lib/match_colors.h>
+#include <lib/deferred_init.h>
 #include "match_builder_lua.h"
 #include "prompt.h"
 
@@ -941,6 +943,7 @@ static int32 get_prompt_info(lua_State* state)
         lua_rawset(state, -3);
     }
 
+    wait_for_console_output();
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi))
     {
@@ -1099,6 +1102,8 @@ static int32 get_match_color(lua_State* state)
 /// Returns the number of history items.
 static int32 get_history_count(lua_State* state)
 {
+    ensure_deferred_init(deferred_init_task::history);
+
     lua_pushinteger(state, history_length);
     return 1;
 }
@@ -1125,6 +1130,8 @@ static int32 get_history_count(lua_State* state)
 /// not have an associated time.
 static int32 get_history_items(lua_State* state)
 {
+    ensure_deferred_init(deferred_init_task::history);
+
     const auto _start = checkinteger(state, 1);
     const auto _end = checkinteger(state, 2);
     if (!_start.isnum() || !_end.isnum())
@@ -1163,6 +1170,90 @@ static int32 get_history_items(lua_State* state)
     return 1;
 }
 
+//------------------------------------------------------------------------------
+static int32 history_items_aux(lua_State* state)
+{
+    int32 index = int32(lua_tointeger(state, lua_upvalueindex(1)));
+    const int32 step = int32(lua_tointeger(state, lua_upvalueindex(2)));
+    size_t find_len = 0;
+    const char* find = lua_tolstring(state, lua_upvalueindex(3), &find_len);
+    const bool prefix = !!lua_toboolean(state, lua_upvalueindex(4));
+
+    HIST_ENTRY const* const* const items = history_list();
+    if (!items)
+        return 0;
+
+    for (; index >= 0 && index < history_length; index += step)
+    {
+        const char* line = items[index]->line;
+        if (find && find_len)
+        {
+            if (prefix ? strncmp(line, find, find_len) != 0 : !strstr(line, find))
+                continue;
+        }
+
+        lua_pushinteger(state, index + step);
+        lua_replace(state, lua_upvalueindex(1));
+
+        lua_pushinteger(state, index + 1);
+        lua_pushstring(state, line);
+        if (items[index]->timestamp)
+            lua_pushinteger(state, atoi(items[index]->timestamp));
+        else
+            lua_pushnil(state);
+        return 3;
+    }
+
+    lua_pushinteger(state, index);
+    lua_replace(state, lua_upvalueindex(1));
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  rl.historyitems
+/// -ver:   1.6.17
+/// -arg:   [reverse:boolean]
+/// -arg:   [text:string]
+/// -arg:   [mode:string]
+/// -ret:   iterator
+/// Returns an iterator function for use in a <code>for</code> loop, which
+/// visits history items one at a time without building a table of the whole
+/// history.  Each iteration returns the item's index, its command line string,
+/// and its time (compatible with os.time()) or nil if the item has no time.
+///
+/// When <span class="arg">reverse</span> is true, the iterator starts with the
+/// most recent history item and works backwards.
+///
+/// When <span class="arg">text</span> is provided, the iterator skips items
+/// that don't contain <span class="arg">text</span>.  If
+/// <span class="arg">mode</span> is <code>"prefix"</code> then it skips items
+/// that don't begin with <span class="arg">text</span> instead.  The comparison
+/// is case sensitive and is done without creating Lua strings for the skipped
+/// items.
+/// -show:  -- Find the most recent git command.
+/// -show:  for index, line, time in rl.historyitems(true, "git ", "prefix") do
+/// -show:  &nbsp;   print(index, line)
+/// -show:  &nbsp;   break
+/// -show:  end
+static int32 history_items(lua_State* state)
+{
+    ensure_deferred_init(deferred_init_task::history);
+
+    const bool reverse = !!lua_toboolean(state, 1);
+    const char* find = optstring(state, 2, nullptr);
+    const char* mode = optstring(state, 3, nullptr);
+
+    lua_pushinteger(state, reverse ? history_length - 1 : 0);
+    lua_pushinteger(state, reverse ? -1 : 1);
+    if (find)
+        lua_pushstring(state, find);
+    else
+        lua_pushnil(state);
+    lua_pushboolean(state, mode && strcmp(mode, "prefix") == 0);
+    lua_pushcclosure(state, history_items_aux, 4);
+    return 1;
+}
+
 //------------------------------------------------------------------------------
 /// -name:  rl.describemacro
 /// -ver:   1.3.41
@@ -1483,6 +1574,7 @@ void rl_lua_initialise(lua_state& lua, bool lua_interpreter)
         { 1, "getmatchcolor",           &get_match_color },
         { 0, "gethistorycount",         &get_history_count },
         { 0, "gethistoryitems",         &get_history_items },
+        { 0, "historyitems",            &history_items },
         { 0, "describemacro",           &describe_macro },
         { 1, "needquotes",              &need_quotes },
         { 0, "islineequal",             &is_line_equal },
@@ -7,6 +7,7 @@
 
 #include <core/str_iter.h>
 #include <lib/line_buffer.h>
+#include <lib/line_editor_integration.h>
 #include <lib/suggestions.h>
 
 extern "C" {
@@ -32,6 +33,9 @@ const rl_buffer_lua::method rl_buffer_lua::c_methods[] = {
     { "remove",             &remove },
     { "beginundogroup",     &begin_undo_group },
     { "endundogroup",       &end_undo_group },
+    { "beginbatch",         &begin_batch },
+    { "endbatch",           &end_batch },
+    { "batch",              &batch },
     { "beginoutput",        &begin_output },
     { "refreshline",        &refresh_line },
     { "getargument",        &get_argument },
@@ -53,6 +57,12 @@ rl_buffer_lua::rl_buffer_lua(line_buffer& buffer)
 //------------------------------------------------------------------------------
 rl_buffer_lua::~rl_buffer_lua()
 {
+    while (m_num_batch > 0)
+    {
+        end_edit_batch();
+        m_num_batch--;
+    }
+
     while (m_num_undo > 0)
     {
         m_rl_buffer.end_undo_group();
@@ -234,6 +244,78 @@ int32 rl_buffer_lua::end_undo_group(lua_State* state)
     return 0;
 }
 
+//------------------------------------------------------------------------------
+/// -name:  rl_buffer:beginbatch
+/// -ver:   1.6.17
+/// Starts a batch of edits.  Until the batch ends, editing the input line
+/// doesn't update the input line coloring, suggestions, or display.  When the
+/// batch ends, they're updated once for all of the edits.  This can make a key
+/// binding much faster if it changes the input line in many steps, e.g. by
+/// using <a href="#rl.invokecommand">rl.invokecommand()</a> many times.
+///
+/// Batches can be nested; the updates happen when the outermost batch ends.
+///
+/// Note:  all batches are automatically ended when a key binding finishes
+/// execution.
+int32 rl_buffer_lua::begin_batch(lua_State* state)
+{
+    m_num_batch++;
+    begin_edit_batch();
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  rl_buffer:endbatch
+/// -ver:   1.6.17
+/// Ends a batch of edits started by
+/// <a href="#rl_buffer:beginbatch">rl_buffer:beginbatch()</a>.
+int32 rl_buffer_lua::end_batch(lua_State* state)
+{
+    if (m_num_batch > 0)
+    {
+        m_num_batch--;
+        end_edit_batch();
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  rl_buffer:batch
+/// -ver:   1.6.17
+/// -arg:   func:function
+/// Calls <span class="arg">func</span> inside a batch of edits, the same as
+/// surrounding it with
+/// <a href="#rl_buffer:beginbatch">rl_buffer:beginbatch()</a> and
+/// <a href="#rl_buffer:endbatch">rl_buffer:endbatch()</a>.  The batch ends
+/// even if <span class="arg">func</span> raises an error.
+/// -show:  function upcase_line(rl_buffer)
+/// -show:  &nbsp;   rl_buffer:batch(function()
+/// -show:  &nbsp;       rl.invokecommand("beginning-of-line")
+/// -show:  &nbsp;       while rl_buffer:getcursor() <= rl_buffer:getlength() do
+/// -show:  &nbsp;           local before = rl_buffer:getcursor()
+/// -show:  &nbsp;           rl.invokecommand("upcase-word")
+/// -show:  &nbsp;           if rl_buffer:getcursor() == before then break end
+/// -show:  &nbsp;       end
+/// -show:  &nbsp;   end)
+/// -show:  end
+int32 rl_buffer_lua::batch(lua_State* state)
+{
+    luaL_checktype(state, LUA_SELF + 1, LUA_TFUNCTION);
+
+    m_num_batch++;
+    begin_edit_batch();
+
+    lua_pushvalue(state, LUA_SELF + 1);
+    const int32 err = lua_pcall(state, 0, 0, 0);
+
+    m_num_batch--;
+    end_edit_batch();
+
+    if (err)
+        return lua_error(state);
+    return 0;
+}
+
 //------------------------------------------------------------------------------
 /// -name:  rl_buffer:beginoutput
 /// -ver:   1.1.20
@@ -30,6 +30,9 @@ protected:
     int32                   remove(lua_State* state);
     int32                   begin_undo_group(lua_State* state);
     int32                   end_undo_group(lua_State* state);
+    int32                   begin_batch(lua_State* state);
+    int32                   end_batch(lua_State* state);
+    int32                   batch(lua_State* state);
     int32                   begin_output(lua_State* state);
     int32                   refresh_line(lua_State* state);
     int32                   get_argument(lua_State* state);
@@ -41,6 +44,7 @@ protected:
 private:
     line_buffer&            m_rl_buffer;
     int32                   m_num_undo = 0;
+    int32                   m_num_batch = 0;
     bool                    m_began_output = false;
 
     friend class lua_bindable<rl_buffer_lua>;
@@ -3,6 +3,7 @@
 
 #include "pch.h"
 #include "lua_state.h"
+#include "script_settings.h"
 
 #include <core/base.h>
 #include <core/log.h>
@@ -13,10 +14,74 @@
 #include <terminal/terminal_out.h>
 
 #include <new.h>
+#include <unordered_map>
 
 //------------------------------------------------------------------------------
 extern setting_bool g_lua_strict;
 
+//------------------------------------------------------------------------------
+// Scripts call settings.get() with the same few names over and over, so the
+// setting found for each name is cached in a Lua table keyed by the name.  Lua
+// strings are interned with their hash already computed, so a hit costs one
+// table lookup.  The cache is discarded whenever a setting is added or removed.
+static char s_lookup_cache_key;
+
+//------------------------------------------------------------------------------
+// The default value of each setting added by scripts, as text, so that the
+// script settings registry can recreate the settings without running scripts.
+static std::unordered_map<const setting*, str_moveable> s_script_defaults;
+
+//------------------------------------------------------------------------------
+static setting* find_setting(lua_State* state, int32 index, const char* key)
+{
+    if (lua_type(state, index) != LUA_TSTRING)
+        return settings::find(key);
+
+    const uint32 generation = settings::get_registry_generation();
+
+    lua_rawgetp(state, LUA_REGISTRYINDEX, &s_lookup_cache_key);
+    if (lua_istable(state, -1))
+    {
+        lua_rawgeti(state, -1, 0);
+        const bool current = (uint32(lua_tointeger(state, -1)) == generation);
+        lua_pop(state, 1);
+        if (!current)
+        {
+            lua_pop(state, 1);
+            lua_pushnil(state);
+        }
+    }
+
+    if (!lua_istable(state, -1))
+    {
+        lua_pop(state, 1);
+        lua_createtable(state, 0, 32);
+        lua_pushinteger(state, generation);
+        lua_rawseti(state, -2, 0);
+        lua_pushvalue(state, -1);
+        lua_rawsetp(state, LUA_REGISTRYINDEX, &s_lookup_cache_key);
+    }
+
+    lua_pushvalue(state, index);
+    lua_rawget(state, -2);
+    setting* s = static_cast<setting*>(lua_touserdata(state, -1));
+    lua_pop(state, 1);
+
+    if (!s)
+    {
+        s = settings::find(key);
+        if (s)
+        {
+            lua_pushvalue(state, index);
+            lua_pushlightuserdata(state, s);
+            lua_rawset(state, -3);
+        }
+    }
+
+    lua_pop(state, 1);
+    return s;
+}
+
 
 
 //------------------------------------------------------------------------------
@@ -50,7 +115,7 @@ static int32 get(lua_State* state)
     if (!key)
         return 0;
 
-    const setting* setting = settings::find(key);
+    const setting* setting = find_setting(state, 1, key);
     if (setting == nullptr)
         return 0;
 
@@ -126,7 +191,7 @@ static int32 set(lua_State* state)
     if (!key)
         return 0;
 
-    setting* setting = settings::find(key);
+    setting* setting = find_setting(state, 1, key);
     if (setting == nullptr)
         return 0;
 
@@ -251,7 +316,7 @@ static int32 overlay(lua_State* state)
 }
 
 //------------------------------------------------------------------------------
-template <typename S, typename... V> void add_impl(lua_State* state, V... value)
+template <typename S, typename... V> void add_impl(lua_State* state, const char* default_text, V... value)
 {
     const char* name = checkstring(state, 1);
     const char* short_desc = (lua_gettop(state) > 2) ? checkstring(state, 3) : "";
@@ -269,6 +334,7 @@ template <typename S, typename... V> void add_impl(lua_State* state, V... value)
         ((setting*)addr)->set_source(source.c_str());
     }
     ((S*)addr)->deferred_load();
+    s_script_defaults.emplace((const setting*)addr, default_text);
     dbg_ignore_since_snapshot(snapshot, "Settings");
 
     if (luaL_newmetatable(state, "settings_mt"))
@@ -276,6 +342,7 @@ template <typename S, typename... V> void add_impl(lua_State* state, V... value)
         lua_pushliteral(state, "__gc");
         lua_pushcfunction(state, [](lua_State* state) -> int32 {
             setting* s = (setting*)lua_touserdata(state, -1);
+            s_script_defaults.erase(s);
             s->~setting();
             return 0;
         });
@@ -353,18 +420,29 @@ static int32 add(lua_State* state)
     switch (lua_type(state, 2))
     {
     case LUA_TNUMBER:
-        add_impl<setting_int>(state, int32(lua_tointeger(state, 2)));
+        {
+            const int32 value = int32(lua_tointeger(state, 2));
+            str<16> text;
+            text.format("%d", value);
+            add_impl<setting_int>(state, text.c_str(), value);
+        }
         break;
 
     case LUA_TBOOLEAN:
-        add_impl<setting_bool>(state, lua_toboolean(state, 2) == 1);
+        {
+            const bool value = (lua_toboolean(state, 2) == 1);
+            add_impl<setting_bool>(state, value ? "true" : "false", value);
+        }
         break;
 
     case LUA_TSTRING:
-        if (_strnicmp(name, "color.", 6) == 0)
-            add_impl<setting_color>(state, (const char *)lua_tostring(state, 2));
-        else
-            add_impl<setting_str>(state, (const char *)lua_tostring(state, 2));
+        {
+            const char* value = lua_tostring(state, 2);
+            if (_strnicmp(name, "color.", 6) == 0)
+                add_impl<setting_color>(state, value, value);
+            else
+                add_impl<setting_str>(state, value, value);
+        }
         break;
 
     case LUA_TTABLE:
@@ -381,7 +459,8 @@ static int32 add(lua_State* state)
                 lua_pop(state, 1);
             }
 
-            add_impl<setting_enum>(state, options.c_str(), 0);
+            // The default for an enum is always the first option.
+            add_impl<setting_enum>(state, "", options.c_str(), 0);
         }
         break;
 
@@ -612,3 +691,222 @@ int32 get_clink_setting(lua_State* state)
 {
     return get(state);
 }
+
+
+
+//------------------------------------------------------------------------------
+// The script settings registry is a binary snapshot of the settings that
+// scripts added, so that `clink set` can list and validate them without
+// loading the scripts.  It's only used while the stamp still matches, i.e.
+// while the scripts are unchanged since the registry was written.
+//
+// Layout (strings are a uint32 length, the text, and a NUL terminator):
+//      magic, total size, stamp, num settings,
+//      { type, name, default, options, short desc, long desc, source }...
+static const uint32 c_script_settings_magic = 0x31737363;   // "css1"
+
+//------------------------------------------------------------------------------
+static void append(std::string& data, uint32 value)
+{
+    data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+//------------------------------------------------------------------------------
+static void append(std::string& data, const char* s)
+{
+    const uint32 len = uint32(strlen(s));
+    append(data, len);
+    data.append(s, len + 1);
+}
+
+//------------------------------------------------------------------------------
+class script_settings_reader
+{
+public:
+                    script_settings_reader(const char* data, uint32 size) : m_data(data), m_size(size) {}
+    bool            read(uint32& value);
+    bool            read(const char*& s);
+private:
+    const char*     m_data;
+    uint32          m_size;
+    uint32          m_pos = 0;
+};
+
+//------------------------------------------------------------------------------
+bool script_settings_reader::read(uint32& value)
+{
+    if (m_size - m_pos < sizeof(value))
+        return false;
+    memcpy(&value, m_data + m_pos, sizeof(value));
+    m_pos += sizeof(value);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool script_settings_reader::read(const char*& s)
+{
+    uint32 len;
+    if (!read(len) || m_size - m_pos <= len || m_data[m_pos + len])
+        return false;
+    s = m_data + m_pos;
+    m_pos += len + 1;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+static bool read_file(const char* file, std::string& out)
+{
+    out.clear();
+
+    FILE* in = fopen(file, "rb");
+    if (!in)
+        return false;
+
+    fseek(in, 0, SEEK_END);
+    const long size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    if (size > 0 && size < 16 * 1024 * 1024)
+    {
+        out.resize(size);
+        if (fread(&out[0], size, 1, in) != 1)
+            out.clear();
+    }
+    fclose(in);
+
+    return !out.empty();
+}
+
+//------------------------------------------------------------------------------
+template <typename S, typename... V> setting* make_script_setting(
+    const char* name, const char* short_desc, const char* long_desc, const char* source, V... value)
+{
+    S* s = new S(name, short_desc, long_desc, value...);
+    if (*source)
+        s->set_source(source);
+    s->deferred_load();
+    return s;
+}
+
+//------------------------------------------------------------------------------
+// Writes the settings currently added by scripts into FILE, tagged with STAMP.
+// The file is only rewritten if its content would change.
+bool save_script_settings(const char* file, const char* stamp)
+{
+    std::string data;
+    append(data, c_script_settings_magic);
+    append(data, uint32(0));
+    append(data, stamp);
+
+    const size_t count_offset = data.length();
+    append(data, uint32(0));
+
+    uint32 count = 0;
+    for (setting_iter iter = settings::first(); const setting* s = iter.next();)
+    {
+        const auto def = s_script_defaults.find(s);
+        if (def == s_script_defaults.end())
+            continue;
+
+        const char* source = s->get_source();
+        append(data, uint32(s->get_type()));
+        append(data, s->get_name());
+        append(data, def->second.c_str());
+        append(data, (s->get_type() == setting::type_enum) ? ((const setting_enum*)s)->get_options() : "");
+        append(data, s->get_short_desc());
+        append(data, s->get_long_desc());
+        append(data, source ? source : "");
+        ++count;
+    }
+
+    memcpy(&data[count_offset], &count, sizeof(count));
+    const uint32 total = uint32(data.length());
+    memcpy(&data[sizeof(uint32)], &total, sizeof(total));
+
+    std::string existing;
+    if (read_file(file, existing) && existing == data)
+        return true;
+
+    FILE* out = fopen(file, "wb");
+    if (!out)
+        return false;
+    const bool ok = (fwrite(data.c_str(), data.length(), 1, out) == 1);
+    fclose(out);
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+// Adds the settings listed in FILE, if it was written with the same STAMP.
+// Returns false without adding anything if the registry is missing, stale, or
+// damaged.  The added settings are owned by OUT.
+bool load_script_settings(const char* file, const char* stamp, std::vector<std::unique_ptr<setting>>& out)
+{
+    std::string data;
+    if (!read_file(file, data))
+        return false;
+
+    script_settings_reader reader(data.c_str(), uint32(data.length()));
+
+    uint32 magic;
+    uint32 total;
+    uint32 count;
+    const char* cached_stamp;
+    if (!reader.read(magic) || magic != c_script_settings_magic ||
+        !reader.read(total) || total != data.length() ||
+        !reader.read(cached_stamp) || strcmp(cached_stamp, stamp) != 0 ||
+        !reader.read(count))
+        return false;
+
+    struct entry
+    {
+        uint32      type;
+        const char* name;
+        const char* def;
+        const char* options;
+        const char* short_desc;
+        const char* long_desc;
+        const char* source;
+    };
+
+    std::vector<entry> entries;
+    entries.reserve(count);
+    while (count--)
+    {
+        entry e;
+        if (!reader.read(e.type) || !reader.read(e.name) || !reader.read(e.def) ||
+            !reader.read(e.options) || !reader.read(e.short_desc) ||
+            !reader.read(e.long_desc) || !reader.read(e.source))
+            return false;
+        entries.push_back(e);
+    }
+
+    for (const auto& e : entries)
+    {
+        if (settings::find(e.name))
+            continue;
+
+        setting* s = nullptr;
+        switch (e.type)
+        {
+        case setting::type_int:
+            s = make_script_setting<setting_int>(e.name, e.short_desc, e.long_desc, e.source, int32(atoi(e.def)));
+            break;
+        case setting::type_bool:
+            s = make_script_setting<setting_bool>(e.name, e.short_desc, e.long_desc, e.source, strcmp(e.def, "true") == 0);
+            break;
+        case setting::type_string:
+            s = make_script_setting<setting_str>(e.name, e.short_desc, e.long_desc, e.source, e.def);
+            break;
+        case setting::type_enum:
+            s = make_script_setting<setting_enum>(e.name, e.short_desc, e.long_desc, e.source, e.options, 0);
+            break;
+        case setting::type_color:
+            s = make_script_setting<setting_color>(e.name, e.short_desc, e.long_desc, e.source, e.def);
+            break;
+        }
+
+        if (s)
+            out.emplace_back(s);
+    }
+
+    return true;
+}
@@ -8,6 +8,9 @@
 #include <core/str_tokeniser.h>
 #include <core/str_compare.h>
 #include <lib/matches.h>
+#include <lib/fuzzy_match.h>
+
+#include <vector>
 
 //------------------------------------------------------------------------------
 /// -name:  string.equalsi
@@ -38,6 +41,7 @@ static int32 equalsi(lua_State* state)
 /// -arg:   text:string
 /// -arg:   [delims:string]
 /// -arg:   [quote_pair:string]
+/// -arg:   [reuse:table]
 /// -ret:   table
 /// Splits <span class="arg">text</span> delimited by
 /// <span class="arg">delims</span> (or by spaces if not provided) and returns a
@@ -46,6 +50,11 @@ static int32 equalsi(lua_State* state)
 /// The optional <span class="arg">quote_pair</span> can provide a beginning
 /// quote character and an ending quote character.  If only one character is
 /// provided it is used as both a beginning and ending quote character.
+///
+/// Starting in v1.6.17, the optional <span class="arg">reuse</span> table is
+/// filled and returned instead of creating a new table.  Any entries after
+/// the last substring are removed from it.  This avoids creating a new table
+/// each time when splitting text repeatedly, such as on every keystroke.
 int32 explode(lua_State* state)
 {
     const char* in = checkstring(state, 1);
@@ -57,7 +66,16 @@ int32 explode(lua_State* state)
     str_tokeniser tokens(in, delims);
     tokens.add_quote_pair(quote_pair);
 
-    lua_createtable(state, 16, 0);
+    int32 old_count = 0;
+    if (lua_istable(state, 4))
+    {
+        lua_settop(state, 4);
+        old_count = int32(lua_rawlen(state, 4));
+    }
+    else
+    {
+        lua_createtable(state, 16, 0);
+    }
 
     int32 count = 0;
     const char* start;
@@ -68,6 +86,74 @@ int32 explode(lua_State* state)
         lua_rawseti(state, -2, ++count);
     }
 
+    for (int32 i = old_count; i > count; --i)
+    {
+        lua_pushnil(state);
+        lua_rawseti(state, -2, i);
+    }
+
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+static int32 explode_iter_aux(lua_State* state)
+{
+    const char* in = lua_tostring(state, lua_upvalueindex(1));
+    const char* delims = lua_tostring(state, lua_upvalueindex(2));
+    const char* quote_pair = lua_tostring(state, lua_upvalueindex(3));
+    const int32 pos = int32(lua_tointeger(state, lua_upvalueindex(4)));
+    if (!in || pos < 0)
+        return 0;
+
+    // Tokens never end inside quotes, so tokenising can resume where the
+    // previous token ended.
+    str_tokeniser tokens(in + pos, delims);
+    tokens.add_quote_pair(quote_pair);
+
+    const char* start;
+    int32 length;
+    if (!tokens.next(start, length))
+    {
+        lua_pushinteger(state, -1);
+        lua_replace(state, lua_upvalueindex(4));
+        return 0;
+    }
+
+    lua_pushinteger(state, int32(tokens.get_pointer() - in));
+    lua_replace(state, lua_upvalueindex(4));
+
+    lua_pushlstring(state, start, length);
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  string.explodeiter
+/// -ver:   1.6.17
+/// -arg:   text:string
+/// -arg:   [delims:string]
+/// -arg:   [quote_pair:string]
+/// -ret:   iterator
+/// Returns an iterator function for use in a <code>for</code> loop, which
+/// splits <span class="arg">text</span> the same way as
+/// <a href="#string.explode">string.explode()</a>, but returns the substrings
+/// one at a time instead of creating a table of all of them.  This is useful
+/// when a loop may stop early, or when the text is large.
+/// -show:  for word in string.explodeiter("abc def ghi") do
+/// -show:  &nbsp;   print(word)
+/// -show:  end
+static int32 explode_iter(lua_State* state)
+{
+    const char* in = checkstring(state, 1);
+    const char* delims = optstring(state, 2, " ");
+    const char* quote_pair = optstring(state, 3, "");
+    if (!in || !delims || !quote_pair)
+        return 0;
+
+    lua_settop(state, 1);
+    lua_pushstring(state, delims);
+    lua_pushstring(state, quote_pair);
+    lua_pushinteger(state, 0);
+    lua_pushcclosure(state, explode_iter_aux, 4);
     return 1;
 }
 
@@ -187,6 +273,99 @@ static int32 api_compare_matches(lua_State* state)
     return 1;
 }
 
+//------------------------------------------------------------------------------
+/// -name:  string.fuzzyscore
+/// -ver:   1.6.17
+/// -arg:   needle:string
+/// -arg:   text:string
+/// -ret:   integer | nil
+/// Returns a score for how well <span class="arg">needle</span> fuzzy matches
+/// <span class="arg">text</span>, or nil if the characters in
+/// <span class="arg">needle</span> don't all occur in order in
+/// <span class="arg">text</span>.  Higher scores are better matches; matches
+/// at the beginning of words, at camel case humps, and runs of consecutive
+/// characters score higher.  This respects the
+/// <code><a href="#match_ignore_case">match.ignore_case</a></code> and
+/// <code><a href="#match_ignore_accent">match.ignore_accent</a></code> Clink
+/// settings.
+/// -show:  string.fuzzyscore("mpc", "match_pipeline.cpp")  -- returns a score
+/// -show:  string.fuzzyscore("mpx", "match_pipeline.cpp")  -- returns nil
+static int32 fuzzy_score(lua_State* state)
+{
+    const char* needle = checkstring(state, 1);
+    const char* text = checkstring(state, 2);
+    if (!needle || !text)
+        return 0;
+
+    fuzzy_matcher matcher(needle);
+    const int32 score = matcher.score(text);
+    if (score == fuzzy_matcher::no_match)
+        return 0;
+
+    lua_pushinteger(state, score);
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// -name:  string.fuzzyfilter
+/// -ver:   1.6.17
+/// -arg:   needle:string
+/// -arg:   candidates:table
+/// -arg:   [limit:integer]
+/// -ret:   table, table
+/// Returns a table of the entries in <span class="arg">candidates</span> that
+/// <span class="arg">needle</span> fuzzy matches, best match first, and a
+/// table of their scores.  See
+/// <a href="#string.fuzzyscore">string.fuzzyscore()</a> for how they're
+/// scored.
+///
+/// Each entry in <span class="arg">candidates</span> can be a string, or a
+/// table with a <code>match</code> field (such as the matches passed to
+/// <a href="#match-filtering">onfiltermatches</a> functions).  Entries with the
+/// same score stay in their original order.
+///
+/// When <span class="arg">limit</span> is provided, at most that many entries
+/// are returned; this is faster than sorting all of the entries that match.
+/// -show:  local files = string.fuzzyfilter("mpc", { "main.cpp", "match_pipeline.cpp", "mpc.h" }, 10)
+static int32 fuzzy_filter(lua_State* state)
+{
+    const char* needle = checkstring(state, 1);
+    if (!needle)
+        return 0;
+    if (!lua_istable(state, 2))
+        return luaL_argerror(state, 2, "table expected");
+    const int32 limit = optinteger(state, 3, 0);
+
+    const uint32 count = uint32(lua_rawlen(state, 2));
+
+    fuzzy_matcher matcher(needle);
+    std::vector<fuzzy_matcher::result> results;
+    matcher.top(count, uint32(max<int32>(limit, 0)), [state] (uint32 i) {
+        lua_rawgeti(state, 2, i + 1);
+        if (lua_istable(state, -1))
+        {
+            lua_pushliteral(state, "match");
+            lua_rawget(state, -2);
+            lua_remove(state, -2);
+        }
+        const char* text = (lua_type(state, -1) == LUA_TSTRING) ? lua_tostring(state, -1) : nullptr;
+        lua_pop(state, 1);
+        return text;
+    }, results);
+
+    lua_createtable(state, int32(results.size()), 0);
+    lua_createtable(state, int32(results.size()), 0);
+    for (uint32 i = 0; i < results.size(); ++i)
+    {
+        lua_rawgeti(state, 2, results[i].index + 1);
+        lua_rawseti(state, -3, i + 1);
+        lua_pushinteger(state, results[i].score);
+        lua_rawseti(state, -2, i + 1);
+    }
+
+    return 2;
+}
+
 //------------------------------------------------------------------------------
 void string_lua_initialise(lua_state& lua)
 {
@@ -196,9 +375,12 @@ void string_lua_initialise(lua_state& lua)
     } methods[] = {
         { "equalsi",    &equalsi },
         { "explode",    &explode },
+        { "explodeiter", &explode_iter },
         { "hash",       &hash },
         { "matchlen",   &match_len },
         { "comparematches", &api_compare_matches },
+        { "fuzzyscore", &fuzzy_score },
+        { "fuzzyfilter", &fuzzy_filter },
     };
 
     lua_State* state = lua.get_state();
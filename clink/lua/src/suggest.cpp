@@ -9,6 +9,7 @@
 #include <core/str_iter.h>
 #include <core/str_compare.h>
 #include <core/settings.h>
+#include <core/str_tokeniser.h>
 #include <core/os.h>
 #include <lib/line_state.h>
 #include <lib/matches.h>
@@ -24,11 +25,51 @@ extern "C" {
 #include <lua.h>
 #include <lauxlib.h>
 #include <lualib.h>
+#include <compat/config.h>
+#include <readline/readline.h>
+#include <readline/rldefs.h>
+#include <readline/rlprivate.h>
 }
 
 //------------------------------------------------------------------------------
 extern setting_enum g_ignore_case;
 extern setting_bool g_fuzzy_accent;
+extern setting_str g_autosuggest_strategy;
+const char* find_history_suggestion(const char* line, bool match_prev_cmd);
+const char* find_cwd_history_suggestion(const char* line);
+
+//------------------------------------------------------------------------------
+// Implements the 'completion' suggestion strategy:  the first of the first 10
+// matches that isn't the same as the typed word, and that doesn't need quotes
+// unless the word is already quoted.
+static const char* find_completion_suggestion(const line_state& line, const matches& matches, uint32& offset)
+{
+    const std::vector<word>& words = line.get_words();
+    if (words.empty())
+        return nullptr;
+
+    const word& info = words.back();
+    if (info.offset >= line.get_cursor())
+        return nullptr;
+
+    const char* const typed = line.get_line() + info.offset;
+    const uint32 typed_len = line.get_cursor() - info.offset;
+
+    const uint32 count = min<uint32>(matches.get_match_count(), 10);
+    for (uint32 i = 0; i < count; ++i)
+    {
+        const char* match = matches.get_match(i);
+        if (strlen(match) == typed_len && strncmp(match, typed, typed_len) == 0)
+            continue;
+        if (!info.quoted && _rl_strpbrk(match, rl_filename_quote_characters) != 0)
+            continue;
+
+        offset = info.offset;
+        return match;
+    }
+
+    return nullptr;
+}
 
 //------------------------------------------------------------------------------
 suggester::suggester(lua_state& lua)
@@ -36,6 +77,64 @@ suggester::suggester(lua_state& lua)
 {
 }
 
+//------------------------------------------------------------------------------
+// Runs the built-in suggestion strategies without calling into Lua.  Returns
+// false if Lua is needed:  when the strategy includes a suggester defined by a
+// script (or a script replaced a built-in one), or when the 'completion'
+// strategy is reached and matches must be generated on demand.
+bool suggester::suggest_native(const line_state& line, const matches* matches)
+{
+    lua_State* state = m_lua.get_state();
+    save_stack_top ss(state);
+
+    // suggest.lua lists the built-in suggesters that haven't been replaced.
+    lua_getglobal(state, "clink");
+    if (!lua_istable(state, -1))
+        return false;
+    lua_pushliteral(state, "_native_suggesters");
+    lua_rawget(state, -2);
+    if (!lua_istable(state, -1))
+        return false;
+    const int32 native = lua_gettop(state);
+
+    str<> text;
+    text.concat(line.get_line(), line.get_length());
+
+    str<32> name;
+    str_tokeniser tokens(g_autosuggest_strategy.get(), " ");
+    while (tokens.next(name))
+    {
+        lua_pushlstring(state, name.c_str(), name.length());
+        lua_rawget(state, native);
+        const bool is_native = !!lua_toboolean(state, -1);
+        lua_pop(state, 1);
+        if (!is_native)
+            return false;
+
+        const char* suggestion = nullptr;
+        uint32 offset = 0;
+        if (name.equals("history"))
+            suggestion = find_history_suggestion(text.c_str(), false);
+        else if (name.equals("match_prev_cmd"))
+            suggestion = find_history_suggestion(text.c_str(), true);
+        else if (name.equals("cwd_history"))
+            suggestion = find_cwd_history_suggestion(text.c_str());
+        else if (name.equals("completion") && matches)
+            suggestion = find_completion_suggestion(line, *matches, offset);
+        else
+            return false;
+
+        if (suggestion)
+        {
+            set_suggestion(text.c_str(), line.get_end_word_offset(), suggestion, offset);
+            return true;
+        }
+    }
+
+    set_suggestion(text.c_str(), line.get_end_word_offset(), nullptr, 0);
+    return true;
+}
+
 //------------------------------------------------------------------------------
 bool suggester::suggest(const line_states& lines, matches* matches, int32 generation_id)
 {
@@ -50,12 +149,16 @@ nosuggest:
 
     lua_State* state = m_lua.get_state();
     save_stack_top ss(state);
+    lua_gc_suspend gc(state);
 
     // Do not allow relaxed comparison for suggestions, as it is too confusing,
     // as a result of the logic to respect original case.
     int32 scope = g_ignore_case.get() ? str_compare_scope::caseless : str_compare_scope::exact;
     str_compare_scope compare(scope, g_fuzzy_accent.get());
 
+    if (suggest_native(line, matches))
+        return true;
+
     // Call Lua to filter prompt
     lua_getglobal(state, "clink");
     lua_pushliteral(state, "_suggest");
@@ -5,6 +5,7 @@
 #include "lua_state.h"
 
 #include <core/base.h>
+#include <core/delay_load.h>
 #include <core/str_tokeniser.h>
 
 #include <winnls.h>
@@ -44,7 +45,7 @@ bool delay_load_normaliz::init()
     if (!m_initialized)
     {
         m_initialized = true;
-        m_hlib = LoadLibrary("normaliz.dll");
+        m_hlib = delay_load_library("normaliz.dll");
         if (m_hlib)
         {
             m_procs.proc[0] = GetProcAddress(m_hlib, "NormalizeString");
@@ -91,6 +92,76 @@ static bool is_combining_mark(int32 c)
             in_range(0x3099, c, 0x309a));
 }
 
+//------------------------------------------------------------------------------
+// Returns true when TEXT is known to already be normalized in form NORM,
+// without needing to convert it to UTF16 and ask the OS.  ASCII text is
+// normalized in every form, and text with no codepoints at or above U+0300
+// (where the combining marks begin) is already normalized in form C.  Text
+// that isn't ASCII is scanned as UTF8 only for form C.
+static bool is_quick_normalized(NORM_FORM norm, const char* text)
+{
+    const char* p = text;
+    while (uint8(*p) < 0x80 && *p)
+        ++p;
+    if (!*p)
+        return true;
+
+    if (norm != NormalizationC)
+        return false;
+
+    str_iter iter(p);
+    while (int32 c = iter.next())
+    {
+        if (c >= 0x0300)
+            return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// A few recent normalizations are remembered, since filters tend to normalize
+// the same strings repeatedly (for example the word being completed).
+struct normalize_cache_entry
+{
+    NORM_FORM           norm;
+    str_moveable        in;
+    str_moveable        out;
+};
+
+static const uint32 c_max_cached_normalizations = 16;
+static const uint32 c_max_cached_normalization_len = 1024;
+static normalize_cache_entry s_normalize_cache[c_max_cached_normalizations];
+static uint32 s_normalize_cache_count = 0;
+static uint32 s_normalize_cache_next = 0;
+
+//------------------------------------------------------------------------------
+static const normalize_cache_entry* find_cached_normalization(NORM_FORM norm, const char* text)
+{
+    for (uint32 i = 0; i < s_normalize_cache_count; ++i)
+    {
+        const normalize_cache_entry& e = s_normalize_cache[i];
+        if (e.norm == norm && strcmp(e.in.c_str(), text) == 0)
+            return &e;
+    }
+    return nullptr;
+}
+
+//------------------------------------------------------------------------------
+static void add_cached_normalization(NORM_FORM norm, const char* text, const str_base& out)
+{
+    if (strlen(text) > c_max_cached_normalization_len)
+        return;
+
+    normalize_cache_entry& e = s_normalize_cache[s_normalize_cache_next];
+    e.norm = norm;
+    e.in = text;
+    e.out = out.c_str();
+
+    if (s_normalize_cache_count < c_max_cached_normalizations)
+        ++s_normalize_cache_count;
+    s_normalize_cache_next = (s_normalize_cache_next + 1) % c_max_cached_normalizations;
+}
+
 
 
 //------------------------------------------------------------------------------
@@ -151,6 +222,18 @@ static int32 normalize(lua_State* state)
     default: assert(false); return 0;
     }
 
+    if (is_quick_normalized(norm, text))
+    {
+        lua_settop(state, 2);
+        return 1;
+    }
+
+    if (const normalize_cache_entry* cached = find_cached_normalization(norm, text))
+    {
+        lua_pushlstring(state, cached->out.c_str(), cached->out.length());
+        return 1;
+    }
+
     wstr_moveable in(text);
     wstr_moveable tmp;
 
@@ -184,6 +267,7 @@ failed:
     }
 
     str_moveable out(tmp.c_str());
+    add_cached_normalization(norm, text, out);
     lua_pushlstring(state, out.c_str(), out.length());
     return 1;
 }
@@ -240,6 +324,12 @@ static int32 isnormalized(lua_State* state)
     default: assert(false); return 0;
     }
 
+    if (is_quick_normalized(norm, text))
+    {
+        lua_pushboolean(state, true);
+        return 1;
+    }
+
     wstr_moveable in(text);
     BOOL ret = s_normaliz.IsNormalizedString(norm, in.c_str(), in.length());
     DWORD err = GetLastError();
@@ -0,0 +1,421 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "lua_state.h"
+#include "async_lua_task.h"
+
+#include <core/base.h>
+#include <core/str.h>
+#include <core/debugheap.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Tables nested deeper than this can't be passed to or from a worker; this
+// also catches tables that refer to themselves.
+static const int32 c_max_worker_depth = 32;
+
+// Workers check for cancellation every this many instructions.
+static const int32 c_worker_hook_count = 10000;
+
+//------------------------------------------------------------------------------
+// A value copied between Lua states.  Only plain data can be copied, since a
+// worker has its own Lua state.
+struct worker_value
+{
+    int32                   type = LUA_TNIL;
+    bool                    boolean = false;
+    lua_Number              number = 0;
+    std::string             string;             // May contain NUL bytes.
+    std::vector<worker_value> table;            // Alternating keys and values.
+};
+
+//------------------------------------------------------------------------------
+static bool to_worker_value(lua_State* state, int32 index, worker_value& out, int32 depth, str_base& error)
+{
+    index = lua_absindex(state, index);
+    out.type = lua_type(state, index);
+
+    switch (out.type)
+    {
+    case LUA_TNIL:
+        return true;
+
+    case LUA_TBOOLEAN:
+        out.boolean = !!lua_toboolean(state, index);
+        return true;
+
+    case LUA_TNUMBER:
+        out.number = lua_tonumber(state, index);
+        return true;
+
+    case LUA_TSTRING:
+        {
+            size_t len;
+            const char* s = lua_tolstring(state, index, &len);
+            out.string.assign(s, len);
+        }
+        return true;
+
+    case LUA_TTABLE:
+        if (depth >= c_max_worker_depth)
+        {
+            error = "table nested too deeply or refers to itself";
+            return false;
+        }
+        if (!lua_checkstack(state, 3))
+        {
+            error = "stack overflow";
+            return false;
+        }
+        lua_pushnil(state);
+        while (lua_next(state, index))
+        {
+            out.table.emplace_back();
+            if (!to_worker_value(state, -2, out.table.back(), depth + 1, error))
+            {
+                lua_pop(state, 2);
+                return false;
+            }
+            out.table.emplace_back();
+            if (!to_worker_value(state, -1, out.table.back(), depth + 1, error))
+            {
+                lua_pop(state, 2);
+                return false;
+            }
+            lua_pop(state, 1);
+        }
+        return true;
+
+    default:
+        error.format("%s values cannot be passed to or from a worker", lua_typename(state, out.type));
+        return false;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Values are at most c_max_worker_depth deep, and each level needs up to 3
+// stack slots; the caller must make sure the stack has room.
+static void push_worker_value(lua_State* state, const worker_value& value)
+{
+    switch (value.type)
+    {
+    case LUA_TBOOLEAN:
+        lua_pushboolean(state, value.boolean);
+        break;
+
+    case LUA_TNUMBER:
+        lua_pushnumber(state, value.number);
+        break;
+
+    case LUA_TSTRING:
+        lua_pushlstring(state, value.string.c_str(), value.string.length());
+        break;
+
+    case LUA_TTABLE:
+        lua_createtable(state, 0, int32(value.table.size() / 2));
+        for (size_t i = 0; i + 1 < value.table.size(); i += 2)
+        {
+            push_worker_value(state, value.table[i]);
+            push_worker_value(state, value.table[i + 1]);
+            lua_rawset(state, -3);
+        }
+        break;
+
+    default:
+        lua_pushnil(state);
+        break;
+    }
+}
+
+
+
+//------------------------------------------------------------------------------
+class worker_async_lua_task : public async_lua_task
+{
+public:
+    worker_async_lua_task(const char* key, const char* src, async_yield_lua* asyncyield, const char* bytecode, size_t len, std::vector<worker_value>&& args)
+    : async_lua_task(key, src)
+    , m_bytecode(bytecode, len)
+    , m_args(std::move(args))
+    {
+        set_asyncyield(asyncyield);
+    }
+
+    bool wait(uint32 timeout)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_done)
+                return true;
+        }
+        const DWORD waited = WaitForSingleObject(get_wait_handle(), timeout);
+        return waited == WAIT_OBJECT_0;
+    }
+
+    void fail(const char* message)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_error = message;
+        finish();
+    }
+
+    void orphan()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_orphaned = true;
+        cancel();
+    }
+
+    int32 push_results(lua_State* state)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_done)
+        {
+            lua_pushboolean(state, false);
+            lua_pushliteral(state, "worker has not finished");
+            return 2;
+        }
+        if (!m_error.empty())
+        {
+            lua_pushboolean(state, false);
+            lua_pushlstring(state, m_error.c_str(), m_error.length());
+            return 2;
+        }
+
+        luaL_checkstack(state, int32(m_results.size()) + 1 + 3 * c_max_worker_depth, "too many results");
+        lua_pushboolean(state, true);
+        for (const auto& value : m_results)
+            push_worker_value(state, value);
+        return 1 + int32(m_results.size());
+    }
+
+protected:
+    void do_work() override;
+
+private:
+    void finish();
+    static int32 run(lua_State* state);
+    static void hook(lua_State* state, lua_Debug* ar);
+
+    const std::string m_bytecode;
+    std::vector<worker_value> m_args;
+    std::vector<worker_value> m_results;
+    str_moveable m_error;
+    std::mutex m_mutex;
+    bool m_done = false;
+    bool m_orphaned = false;
+};
+
+//------------------------------------------------------------------------------
+static char s_worker_task_key;
+
+//------------------------------------------------------------------------------
+// Runs the function in a new Lua state that only has the standard Lua
+// libraries, so nothing is shared with the main Lua state.
+void worker_async_lua_task::do_work()
+{
+    std::vector<worker_value> results;
+    str_moveable error;
+
+    lua_State* state = luaL_newstate();
+    if (!state)
+    {
+        error = "unable to create worker Lua state";
+    }
+    else
+    {
+        luaL_openlibs(state);
+
+        lua_pushlightuserdata(state, this);
+        lua_rawsetp(state, LUA_REGISTRYINDEX, &s_worker_task_key);
+        lua_sethook(state, &hook, LUA_MASKCOUNT, c_worker_hook_count);
+
+        lua_pushcfunction(state, &run);
+        lua_pushlightuserdata(state, this);
+        if (lua_pcall(state, 1, LUA_MULTRET, 0) != LUA_OK)
+        {
+            const char* message = lua_tostring(state, -1);
+            error = message ? message : "worker failed";
+        }
+        else
+        {
+            const int32 top = lua_gettop(state);
+            results.resize(top);
+            for (int32 i = 1; i <= top; ++i)
+            {
+                if (!to_worker_value(state, i, results[i - 1], 0, error))
+                {
+                    results.clear();
+                    break;
+                }
+            }
+        }
+
+        lua_close(state);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_results = std::move(results);
+    m_error = std::move(error);
+    finish();
+}
+
+//------------------------------------------------------------------------------
+// Loads and calls the function inside a protected call, so that errors while
+// pushing the arguments are reported the same as errors from the function.
+int32 worker_async_lua_task::run(lua_State* state)
+{
+    auto* task = static_cast<worker_async_lua_task*>(lua_touserdata(state, 1));
+    lua_pop(state, 1);
+
+    const std::string& bytecode = task->m_bytecode;
+    if (luaL_loadbufferx(state, bytecode.c_str(), bytecode.length(), "=worker", "b") != LUA_OK)
+        return lua_error(state);
+
+    const auto& args = task->m_args;
+    luaL_checkstack(state, int32(args.size()) + 3 * c_max_worker_depth, "too many arguments");
+    for (const auto& value : args)
+        push_worker_value(state, value);
+
+    lua_call(state, int32(args.size()), LUA_MULTRET);
+    return lua_gettop(state);
+}
+
+//------------------------------------------------------------------------------
+// Caller must hold m_mutex.
+void worker_async_lua_task::finish()
+{
+    m_done = true;
+    m_args.clear();
+
+    // An orphaned task's asyncyield may already have been garbage collected.
+    if (!m_orphaned)
+        wake_asyncyield();
+}
+
+//------------------------------------------------------------------------------
+// Stops the worker once its task is canceled, e.g. when the input line ends
+// or the coroutine that started it was abandoned.
+void worker_async_lua_task::hook(lua_State* state, lua_Debug* ar)
+{
+    lua_rawgetp(state, LUA_REGISTRYINDEX, &s_worker_task_key);
+    auto* task = static_cast<worker_async_lua_task*>(lua_touserdata(state, -1));
+    lua_pop(state, 1);
+
+    if (task && task->is_canceled())
+        luaL_error(state, "canceled");
+}
+
+
+
+//------------------------------------------------------------------------------
+class worker_lua
+    : public lua_bindable<worker_lua>
+{
+public:
+                        worker_lua(const std::shared_ptr<worker_async_lua_task>& task) : m_task(task) {}
+                        ~worker_lua() { m_task->orphan(); }
+
+protected:
+    int32               wait(lua_State* state);
+    int32               results(lua_State* state);
+
+private:
+    std::shared_ptr<worker_async_lua_task> m_task;
+
+    friend class lua_bindable<worker_lua>;
+    static const char* const c_name;
+    static const worker_lua::method c_methods[];
+};
+
+//------------------------------------------------------------------------------
+int32 worker_lua::wait(lua_State* state)
+{
+    m_task->wait(INFINITE);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+int32 worker_lua::results(lua_State* state)
+{
+    return m_task->push_results(state);
+}
+
+//------------------------------------------------------------------------------
+const char* const worker_lua::c_name = "worker_lua";
+const worker_lua::method worker_lua::c_methods[] = {
+    { "wait",           &wait },
+    { "results",        &results },
+    {}
+};
+
+
+
+//------------------------------------------------------------------------------
+// UNDOCUMENTED; internal use only.  See clink.runinworker in coroutines.lua.
+//
+// Arg 1 is whether to return an asyncyield object, arg 2 is the bytecode for
+// the function, and the rest are arguments for the function.  Returns a
+// worker object, and an asyncyield object if requested.
+int32 run_in_worker_internal(lua_State* state)
+{
+    const bool async = !!lua_toboolean(state, 1);
+    size_t len;
+    const char* bytecode = luaL_checklstring(state, 2, &len);
+
+    // Copy the arguments.  Argument numbers in errors match the arguments to
+    // clink.runinworker().
+    std::vector<worker_value> args;
+    const int32 top = lua_gettop(state);
+    if (top > 2)
+        args.resize(top - 2);
+    for (int32 i = 3; i <= top; ++i)
+    {
+        str<> error;
+        if (!to_worker_value(state, i, args[i - 3], 0, error))
+            return luaL_error(state, "bad argument #%d (%s)", i - 1, error.c_str());
+    }
+
+    static uint32 s_counter = 0;
+    str_moveable key;
+    key.format("worker||%08x", ++s_counter);
+
+    str<> src;
+    get_lua_srcinfo(state, src);
+
+    dbg_ignore_scope(snapshot, "async worker");
+
+    // Push an asyncyield object.  It's created before the worker object so
+    // that if both become garbage together, the worker object's finalizer
+    // runs first and orphans the task before the asyncyield is freed.
+    async_yield_lua* asyncyield = nullptr;
+    if (async)
+    {
+        asyncyield = async_yield_lua::make_new(state, "clink.runinworker");
+        if (!asyncyield)
+            return 0;
+    }
+
+    // Push a worker object.
+    auto task = std::make_shared<worker_async_lua_task>(key.c_str(), src.c_str(), asyncyield, bytecode, len, std::move(args));
+    if (!task)
+        return 0;
+    worker_lua* worker = worker_lua::make_new(state, task);
+    if (!worker)
+        return 0;
+
+    std::shared_ptr<async_lua_task> base(task);
+    if (!add_async_lua_task(base))
+        task->fail("unable to start worker");
+
+    if (!async)
+        return 1;
+
+    // Return the worker object first.
+    lua_insert(state, -2);
+    return 2;
+}
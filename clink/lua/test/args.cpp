@@ -433,6 +433,38 @@ TEST_CASE("Lua arg parsers")
         }
     }
 
+    SECTION("Cached generator")
+    {
+        const char* script = "\
+            gen_calls = 0 \
+            local function gen() gen_calls = gen_calls + 1 return { 'alpha', 'beta' } end \
+            local cached = clink.cachedgenerator(gen, { name='argtest', env={ 'ARGTEST_GEN' } }) \
+            local shared = clink.cachedgenerator(gen, { name='argtest', env={ 'ARGTEST_GEN' } }) \
+            clink.argmatcher('argcmd_cached'):addarg({ cached }) \
+            clink.argmatcher('argcmd_shared'):addarg({ shared }) \
+        ";
+
+        REQUIRE_LUA_DO_STRING(lua, script);
+
+        tester.set_input("argcmd_cached ");
+        tester.set_expected_matches("alpha", "beta");
+        tester.run();
+
+        tester.set_input("argcmd_shared a");
+        tester.set_expected_matches("alpha");
+        tester.run();
+
+        REQUIRE_LUA_DO_STRING(lua, "assert(gen_calls == 1, gen_calls)");
+
+        os::set_env("ARGTEST_GEN", "x");
+        tester.set_input("argcmd_cached ");
+        tester.set_expected_matches("alpha", "beta");
+        tester.run();
+        os::set_env("ARGTEST_GEN", nullptr);
+
+        REQUIRE_LUA_DO_STRING(lua, "assert(gen_calls == 2, gen_calls)");
+    }
+
     SECTION("Tables 2")
     {
         const char* script = "\
@@ -819,6 +851,30 @@ TEST_CASE("Lua arg parsers")
         }
     }
 
+    SECTION("Lazy")
+    {
+        const char* script = "\
+            local f = io.open('lazy.lua', 'w')\
+            f:write('lazy_loads = (lazy_loads or 0) + 1 ')\
+            f:write('clink.argmatcher(\\'lazycmd\\', \\'lazyalt\\'):addarg(\\'aaa\\', \\'bbb\\')')\
+            f:close()\
+            clink.lazyargmatcher('lazy.lua', 'lazycmd', 'lazyalt')\
+        ";
+
+        REQUIRE_LUA_DO_STRING(lua, script);
+        REQUIRE_LUA_DO_STRING(lua, "assert(not lazy_loads)");
+
+        tester.set_input("lazycmd ");
+        tester.set_expected_matches("aaa", "bbb");
+        tester.run();
+
+        tester.set_input("lazyalt ");
+        tester.set_expected_matches("aaa", "bbb");
+        tester.run();
+
+        REQUIRE_LUA_DO_STRING(lua, "assert(lazy_loads == 1)");
+    }
+
     SECTION("Paired")
     {
         const char* script = "\
@@ -391,6 +391,33 @@ TEST_CASE("Lua word classification")
             tester.run();
         }
 
+        SECTION("Native")
+        {
+            REQUIRE_LUA_DO_STRING(lua, "clink._set_native_classify(true)");
+
+            tester.set_input("echo");
+            tester.set_expected_classifications("c");
+            tester.run();
+
+            tester.set_input("asdflkj etc");
+            tester.set_expected_classifications("o");
+            tester.run();
+
+            tester.set_input("dkalias");
+            tester.set_expected_classifications("d");
+            tester.run();
+
+            tester.set_input("cd /d asdf");
+            tester.set_expected_classifications("cfo");
+            tester.run();
+
+            tester.set_input("xyz abc green | asdfjkl etc | echo etc | xyz -a def && argcmd t");
+            tester.set_expected_classifications("oano c ofaoo");
+            tester.run();
+
+            REQUIRE_LUA_DO_STRING(lua, "clink._set_native_classify(false)");
+        }
+
         SECTION("No separator")
         {
             tester.set_input("argcmd three four \"  &&foobar\" f");
@@ -592,5 +619,24 @@ TEST_CASE("Lua word classification")
         }
     }
 
+    SECTION("Batch")
+    {
+        const char* script = "\
+            local batch = clink.classifier(1)\
+            function batch:classify(commands)\
+                local c = commands[1].classifications\
+                c:classifywords({ { 1, 'x' }, { 2, 'f' }, { 3, 'a' }, { 9, 'n' } })\
+                c:applycolors({ { 9, 2, '1' }, { 12, 1, '1' }, { 0, 1, '1' } })\
+                return true\
+            end\
+        ";
+
+        REQUIRE_LUA_DO_STRING(lua, script);
+
+        tester.set_input("qqq -x abcdef");
+        tester.set_expected_faces("xxx ff a\x80\x80" "a\x80" "a");
+        tester.run();
+    }
+
     AddConsoleAliasW(const_cast<wchar_t*>(L"dkalias"), nullptr, host);
 }
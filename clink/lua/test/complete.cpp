@@ -74,6 +74,29 @@ TEST_CASE("Rl matches")
         tester.run();
     }
 
+    SECTION("match list completion")
+    {
+        const char* script = "\
+            local g = clink.generator(1) \
+            function g:generate(line_state, builder) \
+                if line_state:getword(1) ~= 'colors' then return end \
+                local n1, ok1 = builder:addmatchlist('red\\r\\ngreen\\n\\nblue\\n', 'word') \
+                local n2, ok2 = builder:addmatchlist({ 'cyan', 42, 'red' }, 'word') \
+                list_results = { n1, ok1, ok2 } \
+                return true \
+            end \
+        ";
+
+        REQUIRE_LUA_DO_STRING(lua, script);
+
+        tester.set_input("colors \t");
+        tester.set_expected_matches("red", "green", "blue", "cyan");
+        tester.run();
+
+        // The non-string entry counts as not added.
+        REQUIRE_LUA_DO_STRING(lua, "assert(list_results[1] == 3 and list_results[2] == true and list_results[3] == false)");
+    }
+
     SECTION("numbers completion")
     {
         MAKE_CLEANUP([](){ rl_unbind_key_in_map(0x0e, emacs_meta_keymap); });
@@ -0,0 +1,61 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+
+#include <lua/lua_state.h>
+
+extern "C" {
+#include <lua.h>
+}
+
+//------------------------------------------------------------------------------
+TEST_CASE("Lua events")
+{
+    lua_state lua;
+    lua_State* state = lua.get_state();
+
+    SECTION("No handlers")
+    {
+        const int32 top = lua_gettop(state);
+        lua_pushstring(state, "arg");
+        REQUIRE(!lua.send_event("onendedit", 1));
+        REQUIRE(lua_gettop(state) == top);
+    }
+
+    SECTION("Priority")
+    {
+        const char* script = "\
+            order = '' \
+            clink.onendedit(function(line) order = order..'b'..line end) \
+            clink.onendedit(function(line) order = order..'a'..line end, 10) \
+            clink.onendedit(function(line) order = order..'c'..line end) \
+            clink.onendedit(function(line) order = order..'d'..line end, 1000) \
+        ";
+
+        REQUIRE_LUA_DO_STRING(lua, script);
+
+        const int32 top = lua_gettop(state);
+        lua_pushstring(state, "!");
+        REQUIRE(lua.send_event("onendedit", 1));
+        REQUIRE(lua_gettop(state) == top);
+
+        REQUIRE_LUA_DO_STRING(lua, "assert(order == 'a!b!c!d!', order)");
+    }
+
+    SECTION("Error")
+    {
+        const char* script = "\
+            order = '' \
+            clink.onhistory(function() order = order..'a' end) \
+            clink.onhistory(function() error('oops') end) \
+            clink.onhistory(function() order = order..'c' end) \
+        ";
+
+        REQUIRE_LUA_DO_STRING(lua, script);
+
+        REQUIRE(!lua.send_event("onhistory"));
+        REQUIRE_LUA_DO_STRING(lua, "assert(order == 'a', order)");
+        REQUIRE_LUA_DO_STRING(lua, "assert(clink._event_callbacks.onhistory[1].cost.num == 1)");
+    }
+}
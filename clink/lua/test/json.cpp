@@ -0,0 +1,78 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+
+#include <lua/lua_state.h>
+
+//------------------------------------------------------------------------------
+TEST_CASE("Lua json")
+{
+    lua_state lua;
+
+    SECTION("Decode")
+    {
+        const char* script = "\
+            local t = json.decode(' { \"a\" : [1, 2.5, -3e2, true, false, null], \"b\" : {\"c\" : \"x\\\\ty\\\\u00e9\\\\ud83d\\\\ude00\"} } ') \
+            assert(#t.a == 6) \
+            assert(t.a[1] == 1 and t.a[2] == 2.5 and t.a[3] == -300) \
+            assert(t.a[4] == true and t.a[5] == false and t.a[6] == json.null) \
+            assert(t.b.c == 'x\\ty\\195\\169\\240\\159\\152\\128') \
+            assert(json.decode('\"\"') == '') \
+            assert(next(json.decode('{}')) == nil) \
+        ";
+
+        REQUIRE_LUA_DO_STRING(lua, script);
+    }
+
+    SECTION("Errors")
+    {
+        const char* script = "\
+            local bad = { '', '{', '[1,]', '{\"a\" 1}', '01', '1.', 'nul', '\"abc', '[1] x', '\"\\\\q\"' } \
+            for _, text in ipairs(bad) do \
+                local v, err = json.decode(text) \
+                assert(v == nil and type(err) == 'string', text) \
+            end \
+            local v, err = json.decode('[1, x]') \
+            assert(err == 'unexpected character at position 5', err) \
+        ";
+
+        REQUIRE_LUA_DO_STRING(lua, script);
+    }
+
+    SECTION("Path")
+    {
+        const char* script = "\
+            local text = '{\"skip\":[{\"x\":1}], \"items\":[{\"name\":\"one\"}, {\"name\":\"two\"}]} garbage' \
+            assert(json.decode(text, { 'items', 2, 'name' }) == 'two') \
+            assert(json.decode(text, { 'items', 3 }) == nil) \
+            assert(json.decode(text, { 'missing' }) == nil) \
+            assert(json.decode(text, { 'skip', 'x' }) == nil) \
+            assert(type(json.decode(text, {})) == 'table') \
+        ";
+
+        REQUIRE_LUA_DO_STRING(lua, script);
+    }
+
+    SECTION("Encode")
+    {
+        const char* script = "\
+            assert(json.encode({1, 2, 'x'}) == '[1,2,\"x\"]') \
+            assert(json.encode({}) == '{}') \
+            assert(json.encode({a=json.null}) == '{\"a\":null}') \
+            assert(json.encode('a\"b\\\\c\\n\\1') == '\"a\\\\\"b\\\\\\\\c\\\\n\\\\u0001\"') \
+            assert(json.encode(0.5) == '0.5') \
+            assert(json.encode({{}}, '  ') == '[\\n  {}\\n]') \
+            local v, err = json.encode({f=print}) \
+            assert(v == nil and err == 'cannot encode function', err) \
+            local cyclic = {} \
+            cyclic.self = cyclic \
+            assert(json.encode(cyclic) == nil) \
+            local t = { n=42, s='hi', list={true, false}, nested={k='v'} } \
+            local r = json.decode(json.encode(t)) \
+            assert(r.n == 42 and r.s == 'hi' and r.list[2] == false and r.nested.k == 'v') \
+        ";
+
+        REQUIRE_LUA_DO_STRING(lua, script);
+    }
+}
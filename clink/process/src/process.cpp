@@ -7,6 +7,7 @@
 #include "pe.h"
 
 #include <core/base.h>
+#include <core/delay_load.h>
 #include <core/log.h>
 #include <core/path.h>
 #include <core/str.h>
@@ -42,7 +43,7 @@ bool __EnumProcesses(std::vector<DWORD>& processes)
     if (!s_EnumProcesses)
     {
         *(FARPROC*)&s_EnumProcesses = GetProcAddress(
-            LoadLibraryA("psapi.dll"), "EnumProcesses");
+            delay_load_library("psapi.dll"), "EnumProcesses");
         if (!s_EnumProcesses)
             return false;
     }
@@ -74,7 +75,7 @@ static bool __EnumProcessModules(HANDLE hProcess, std::vector<HMODULE>& modules)
     if (!s_EnumProcessModules)
     {
         *(FARPROC*)&s_EnumProcessModules = GetProcAddress(
-            LoadLibraryA("psapi.dll"), "EnumProcessModules");
+            delay_load_library("psapi.dll"), "EnumProcessModules");
         if (!s_EnumProcessModules)
             return false;
     }
@@ -138,7 +139,7 @@ bool process::get_file_name(str_base& out, HMODULE module) const
 
     static DWORD (WINAPI *func)(HANDLE, HMODULE, LPWSTR, DWORD) = nullptr;
     if (func == nullptr)
-        if (HMODULE psapi = LoadLibrary("psapi.dll"))
+        if (HMODULE psapi = delay_load_library("psapi.dll"))
             *(FARPROC*)&func = GetProcAddress(psapi, "GetModuleFileNameExW");
 
     if (func != nullptr)
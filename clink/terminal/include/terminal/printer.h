@@ -32,6 +32,8 @@ public:
     int32                   find_line(int32 starting_line, int32 distance, const char* text, find_line_mode mode, const BYTE* attrs=nullptr, int32 num_attrs=0, BYTE mask=0xff) const;
     attributes              set_attributes(const attributes attr);
     attributes              get_attributes() const;
+    void                    hold_output();
+    void                    release_output();
 
 private: /* TODO: unimplemented API */
     typedef uint32          cursor_state;
@@ -46,6 +48,21 @@ private:
     attributes              m_set_attr;
     attributes              m_next_attr;
     bool                    m_nodiff;
+    bool                    m_holding = false;
+};
+
+//------------------------------------------------------------------------------
+// Brackets the output in its scope with the synchronized output codes (DEC
+// private mode 2026) when the terminal supports them, so that the terminal
+// draws everything in the scope at once.
+class synchronized_output_scope
+{
+public:
+                            synchronized_output_scope(printer& printer);
+                            ~synchronized_output_scope();
+private:
+    printer&                m_printer;
+    const bool              m_active;
 };
 
 //------------------------------------------------------------------------------
@@ -43,6 +43,8 @@ public:
     virtual void    close() = 0;
     virtual void    write(const char* data, int32 length) = 0;
     virtual void    flush() = 0;
+    virtual void    begin_batch() = 0;  // Nestable; writes may be held until the outermost end_batch().
+    virtual void    end_batch() = 0;
     virtual int32   get_columns() const = 0;
     virtual int32   get_rows() const = 0;
     virtual bool    get_line_text(int32 line, str_base& out) const = 0;
@@ -25,6 +25,9 @@ extern "C" void terminal_begin_command();
 extern "C" void terminal_end_command();
 extern const char* get_found_ansi_handler();
 extern bool get_is_auto_ansi_handler();
+extern bool use_synchronized_output();
+extern void wait_for_console_output();
+extern bool is_console_output_pending();
 
 //------------------------------------------------------------------------------
 // Scoped configuration of console mode.
@@ -48,6 +51,19 @@ private:
     bool            m_prev_accept_mouse_input;
 };
 
+//------------------------------------------------------------------------------
+// Output flushed within the scope may be written by the render thread (see
+// terminal.render_thread), so the caller doesn't wait for the console.  Any
+// other console output, or reading the console state, must first wait for it
+// with wait_for_console_output().
+class async_output_scope
+{
+public:
+                    async_output_scope();
+                    ~async_output_scope();
+                    async_output_scope(const async_output_scope&) = delete;
+};
+
 //------------------------------------------------------------------------------
 class printer_context
 {
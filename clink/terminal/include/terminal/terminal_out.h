@@ -23,6 +23,8 @@ public:
     template <int32 S> void write(const char (&chars)[S]);
     virtual bool            get_line_text(int32 line, str_base& out) const = 0;
     virtual void            flush() = 0;
+    virtual void            begin_batch() = 0;  // Nestable; writes may be held until the outermost end_batch().
+    virtual void            end_batch() = 0;
     virtual int32           get_columns() const = 0;
     virtual int32           get_rows() const = 0;
     virtual int32           is_line_default_color(int32 line) const = 0;
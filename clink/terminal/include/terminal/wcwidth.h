@@ -11,6 +11,7 @@ extern "C" wcwidth_t *wcwidth;
 extern "C" void reset_wcwidths();
 extern "C" int32 test_ambiguous_width_char(char32_t ucs, str_iter* iter);
 extern "C" void reset_cached_font();
+extern "C" uint32 get_wcwidths_generation(); // Changes whenever character widths may have changed.
 bool is_fully_qualified_double_width_prefix(char32_t ucs);
 
 //------------------------------------------------------------------------------
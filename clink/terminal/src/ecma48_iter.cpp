@@ -9,6 +9,7 @@
 #include "screen_buffer.h"
 
 #include <core/base.h>
+#include <core/str_compare.h>
 #include <core/str_tokeniser.h>
 
 #include <assert.h>
@@ -365,6 +366,13 @@ bool ecma48_iter::next_char(int32 c)
         return true;
     }
 
+    // Plain ASCII can't start a code, so skip the whole run at once.
+    if (c < 0x80)
+    {
+        m_iter.skip_units(str_scan_plain_ascii(m_iter.get_pointer(), m_iter.max_units()));
+        return false;
+    }
+
     m_iter.next();
     return false;
 }
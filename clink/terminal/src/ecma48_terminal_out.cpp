@@ -71,6 +71,18 @@ void ecma48_terminal_out::flush()
     reset_pending();
 }
 
+//------------------------------------------------------------------------------
+void ecma48_terminal_out::begin_batch()
+{
+    m_screen.begin_batch();
+}
+
+//------------------------------------------------------------------------------
+void ecma48_terminal_out::end_batch()
+{
+    m_screen.end_batch();
+}
+
 //------------------------------------------------------------------------------
 int32 ecma48_terminal_out::get_columns() const
 {
@@ -226,6 +238,10 @@ void ecma48_terminal_out::write(const char* chars, int32 length)
         return;
     }
 
+    // Text runs between the codes reach the console together when possible,
+    // instead of each run being a separate console call.
+    m_screen.begin_batch();
+
     int32 need_next = (length == 1 || (chars[0] && !chars[1]));
     ecma48_iter iter(chars, m_state, length);
     while (const ecma48_code& code = iter.next())
@@ -249,6 +265,8 @@ void ecma48_terminal_out::write(const char* chars, int32 length)
             break;
         }
     }
+
+    m_screen.end_batch();
 }
 
 //------------------------------------------------------------------------------
@@ -13,6 +13,27 @@
 
 #include <regex>
 
+//------------------------------------------------------------------------------
+// Returns the offset of FIND in the first LEN characters of TEXT, or -1.  TEXT
+// doesn't need to be nul terminated.  Scanning for the first character with
+// wmemchr is much faster than comparing at every position.
+static int32 find_in_row(const wchar_t* text, int32 len, const wchar_t* find, int32 find_len)
+{
+    if (find_len <= 0)
+        return 0;
+
+    const wchar_t* const end = text + len;
+    for (const wchar_t* p = text; end - p >= find_len; ++p)
+    {
+        p = wmemchr(p, find[0], (end - p) - (find_len - 1));
+        if (!p)
+            break;
+        if (wmemcmp(p, find, find_len) == 0)
+            return int32(p - text);
+    }
+    return -1;
+}
+
 //------------------------------------------------------------------------------
 int32 find_line(HANDLE h, const CONSOLE_SCREEN_BUFFER_INFO& csbi,
               wchar_t* chars_buffer, int32 chars_capacity,
@@ -62,32 +83,76 @@ int32 find_line(HANDLE h, const CONSOLE_SCREEN_BUFFER_INFO& csbi,
         }
     }
 
+    const int32 width = csbi.dwSize.X;
+    const bool check_attrs = (attrs && num_attrs > 0);
+
+    // Rows are read from the console in chunks, since each read is a round
+    // trip to the console host.  Text searches read characters in chunks and
+    // then read attributes only for rows whose text matches.  Attribute-only
+    // searches read attributes in chunks.
+    const int32 chunk_capacity = text ? chars_capacity : attrs_capacity;
+    const int32 max_chunk_rows = max<int32>(1, chunk_capacity / max<int32>(1, width));
+    int32 chunk_first = 0;
+    int32 chunk_rows = 0;
+
     int32 start_found = 0;
-    int32 len_found = csbi.dwSize.X;
+    int32 len_found = width;
 
     while (distance != 0)
     {
         if (starting_line < 0 || starting_line >= csbi.dwSize.Y)
             return 0;
 
-        bool found_text = true;
-        if (text)
+        if (starting_line < chunk_first || starting_line >= chunk_first + chunk_rows)
         {
-            COORD coord = { 0, SHORT(starting_line) };
+            if (!text && !check_attrs)
+                chunk_rows = 1;
+            else
+                chunk_rows = min<int32>(max_chunk_rows, distance > 0 ? distance : -distance);
+            if (distance > 0)
+            {
+                chunk_first = starting_line;
+                chunk_rows = min<int32>(chunk_rows, csbi.dwSize.Y - chunk_first);
+            }
+            else
+            {
+                chunk_first = max<int32>(0, starting_line - chunk_rows + 1);
+                chunk_rows = starting_line - chunk_first + 1;
+            }
+
+            const COORD coord = { 0, SHORT(chunk_first) };
+            const DWORD want = DWORD(chunk_rows) * width;
             DWORD len = 0;
-            if (!ReadConsoleOutputCharacterW(h, chars_buffer, csbi.dwSize.X, coord, &len))
-                return -1;
-            if (len != csbi.dwSize.X)
-                return -1;
+            if (text)
+            {
+                if (!ReadConsoleOutputCharacterW(h, chars_buffer, want, coord, &len))
+                    return -1;
+                if (len != want)
+                    return -1;
+            }
+            else if (check_attrs)
+            {
+                if (!ReadConsoleOutputAttribute(h, attrs_buffer, want, coord, &len))
+                    return -2;
+                if (len != want)
+                    return -2;
+            }
+        }
 
-            while (len > 0 && iswspace(chars_buffer[len - 1]))
+        const int32 row_offset = (starting_line - chunk_first) * width;
+
+        bool found_text = true;
+        if (text)
+        {
+            const wchar_t* const row_text = chars_buffer + row_offset;
+            int32 len = width;
+            while (len > 0 && iswspace(row_text[len - 1]))
                 len--;
-            chars_buffer[len] = '\0';
 
-            const wchar_t* line_text = chars_buffer;
+            const wchar_t* line_text = row_text;
             if (!regex && (mode & find_line_mode::ignore_case))
             {
-                str_transform(chars_buffer, len, tmp, transform_mode::lower);
+                str_transform(row_text, len, tmp, transform_mode::lower);
                 line_text = tmp.c_str();
                 len = tmp.length();
             }
@@ -115,27 +180,32 @@ int32 find_line(HANDLE h, const CONSOLE_SCREEN_BUFFER_INFO& csbi,
             {
                 // Presume that str_transform preserved the alignment between
                 // text and attributes.
-                const wchar_t* found = wcsstr(chars_buffer, find.c_str());
-                found_text = !!found;
-                start_found = int32(found - chars_buffer);
+                const int32 found = find_in_row(line_text, len, find.c_str(), find.length());
+                found_text = (found >= 0);
+                start_found = found;
                 len_found = find.length();
             }
         }
 
         bool found_attr = true;
-        if (attrs && num_attrs)
+        if (found_text && check_attrs)
         {
-            found_attr = false;
-
-            COORD coord = { SHORT(start_found), SHORT(starting_line) };
-            DWORD len = 0;
-            if (!ReadConsoleOutputAttribute(h, attrs_buffer, len_found, coord, &len))
-                return -2;
-            if (len != len_found)
-                return -2;
+            const WORD* row_attrs = attrs_buffer + row_offset;
+            DWORD len = width;
+            if (text)
+            {
+                COORD coord = { SHORT(start_found), SHORT(starting_line) };
+                len = 0;
+                if (!ReadConsoleOutputAttribute(h, attrs_buffer, len_found, coord, &len))
+                    return -2;
+                if (len != len_found)
+                    return -2;
+                row_attrs = attrs_buffer;
+            }
 
+            found_attr = false;
             const BYTE* end_attrs = attrs + num_attrs;
-            for (const WORD* attr = attrs_buffer; len--; attr++)
+            for (const WORD* attr = row_attrs; len--; attr++)
             {
                 for (const BYTE* find_attr = attrs; find_attr < end_attrs; find_attr++)
                     if ((BYTE(*attr) & mask) == (*find_attr & mask))
@@ -4,6 +4,7 @@
 #include "pch.h"
 #include "printer.h"
 #include "terminal_out.h"
+#include "terminal_helpers.h"
 
 #include <core/str.h>
 
@@ -16,6 +17,24 @@ void set_scrolled_screen_buffer()
 
 
 
+//------------------------------------------------------------------------------
+synchronized_output_scope::synchronized_output_scope(printer& printer)
+: m_printer(printer)
+, m_active(use_synchronized_output())
+{
+    if (m_active)
+        m_printer.print("\x1b[?2026h");
+}
+
+//------------------------------------------------------------------------------
+synchronized_output_scope::~synchronized_output_scope()
+{
+    if (m_active)
+        m_printer.print("\x1b[?2026l");
+}
+
+
+
 //------------------------------------------------------------------------------
 printer::printer(terminal_out& terminal)
 : m_terminal(terminal)
@@ -194,6 +213,30 @@ attributes printer::get_attributes() const
     return m_next_attr;
 }
 
+//------------------------------------------------------------------------------
+// Holds output written to the terminal (by anything, not just the printer), so
+// that many small prints reach the console in a few large writes.  Output is
+// written when the terminal's batch fills, when something else needs the
+// console (e.g. moving the cursor), or when release_output() is called.
+void printer::hold_output()
+{
+    if (!m_holding)
+    {
+        m_holding = true;
+        m_terminal.begin_batch();
+    }
+}
+
+//------------------------------------------------------------------------------
+void printer::release_output()
+{
+    if (m_holding)
+    {
+        m_holding = false;
+        m_terminal.end_batch();
+    }
+}
+
 //------------------------------------------------------------------------------
 void printer::insert(int32 count)
 {
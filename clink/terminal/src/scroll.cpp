@@ -3,6 +3,7 @@
 
 #include "pch.h"
 #include "scroll.h"
+#include "terminal_helpers.h"
 
 //------------------------------------------------------------------------------
 // Terminal can't #include from Readline.
@@ -28,6 +29,7 @@ void reset_scroll_mode()
 int32 ScrollConsoleRelative(HANDLE h, int32 direction, SCRMODE mode)
 {
     // Get the current screen buffer window position.
+    wait_for_console_output();
     CONSOLE_SCREEN_BUFFER_INFO csbiInfo;
     if (!GetConsoleScreenBufferInfo(h, &csbiInfo))
         return 0;
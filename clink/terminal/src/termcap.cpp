@@ -223,7 +223,9 @@ void terminal_out::visible_bell()
         write(c_default_term_vs);
 
     // Not sure why the cursor position gets refreshed here.  Maybe it resets
-    // the blink timer?
+    // the blink timer?  Pending output must reach the console first, or this
+    // would move the cursor back to a stale position.
+    wait_for_console_output();
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     GetConsoleScreenBufferInfo(handle, &csbi);
     COORD xy = { csbi.dwCursorPosition.X, csbi.dwCursorPosition.Y };
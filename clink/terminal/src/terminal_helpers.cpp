@@ -238,7 +238,67 @@ void detect_console_theme()
 
 
 //------------------------------------------------------------------------------
-int32 get_nearest_color(const CONSOLE_SCREEN_BUFFER_INFOEX& csbix, const uint8 (&rgb)[3])
+// Downgrading true color happens for every attribute change on every redraw,
+// so the nearest palette index is remembered for each cell of a 32x32x32 RGB
+// cube.  Cells are filled on first use (measured from the center of the cell),
+// and the cube is discarded whenever the console color table changes.
+class nearest_color_cube
+{
+    typedef decltype(CONSOLE_SCREEN_BUFFER_INFOEX::ColorTable) color_table;
+    static const uint8 c_unknown = 0xff;
+    static const uint32 c_bits = 5;
+    static const uint32 c_num_colors = 16;
+    static_assert(sizeof(color_table) == c_num_colors * sizeof(COLORREF), "unexpected console color table size");
+
+public:
+    int32           lookup(const color_table& table, const uint8 (&rgb)[3]);
+
+private:
+    void            set_table(const color_table& table);
+    int32           search(const uint8 (&rgb)[3]) const;
+
+    color_table     m_table = {};
+    cie::lab        m_labs[c_num_colors];
+    uint8           m_cube[1 << (c_bits * 3)];
+    bool            m_valid = false;
+};
+
+//------------------------------------------------------------------------------
+int32 nearest_color_cube::lookup(const color_table& table, const uint8 (&rgb)[3])
+{
+    if (!m_valid || memcmp(table, m_table, sizeof(m_table)) != 0)
+        set_table(table);
+
+    const uint32 shift = 8 - c_bits;
+    const uint32 index = ((rgb[0] >> shift) << (c_bits * 2)) |
+                         ((rgb[1] >> shift) << c_bits) |
+                         (rgb[2] >> shift);
+
+    uint8& cell = m_cube[index];
+    if (cell == c_unknown)
+    {
+        const uint8 half = 1 << (shift - 1);
+        const uint8 mask = uint8(0xff << shift);
+        const uint8 center[3] = { uint8((rgb[0] & mask) | half),
+                                  uint8((rgb[1] & mask) | half),
+                                  uint8((rgb[2] & mask) | half) };
+        cell = uint8(search(center));
+    }
+    return cell;
+}
+
+//------------------------------------------------------------------------------
+void nearest_color_cube::set_table(const color_table& table)
+{
+    memcpy(m_table, table, sizeof(m_table));
+    for (uint32 i = 0; i < c_num_colors; ++i)
+        m_labs[i].from_rgb(m_table[i]);
+    memset(m_cube, c_unknown, sizeof(m_cube));
+    m_valid = true;
+}
+
+//------------------------------------------------------------------------------
+int32 nearest_color_cube::search(const uint8 (&rgb)[3]) const
 {
     cie::lab target(RGB(rgb[0], rgb[1], rgb[2]));
     double best_deltaE = 0;
@@ -247,10 +307,9 @@ int32 get_nearest_color(const CONSOLE_SCREEN_BUFFER_INFOEX& csbix, const uint8 (
     // FUTURE: consider using Oklab instead?
     // https://bottosson.github.io/posts/oklab/
     // https://github.com/chrisant996/dirx/blob/90d9f7422fee098776375360fb1a40b4d3da52e9/colors.cpp#L1780-L1847
-    for (int32 i = sizeof_array(csbix.ColorTable); i--;)
+    for (int32 i = c_num_colors; i--;)
     {
-        cie::lab candidate(csbix.ColorTable[i]);
-        double deltaE = cie::deltaE_2(target, candidate);
+        double deltaE = cie::deltaE_2(target, m_labs[i]);
         if (best_idx < 0 || best_deltaE > deltaE)
         {
             best_deltaE = deltaE;
@@ -261,6 +320,13 @@ int32 get_nearest_color(const CONSOLE_SCREEN_BUFFER_INFOEX& csbix, const uint8 (
     return best_idx;
 }
 
+//------------------------------------------------------------------------------
+int32 get_nearest_color(const CONSOLE_SCREEN_BUFFER_INFOEX& csbix, const uint8 (&rgb)[3])
+{
+    static nearest_color_cube s_cube;
+    return s_cube.lookup(csbix.ColorTable, rgb);
+}
+
 //------------------------------------------------------------------------------
 static constexpr uint8 c_colors[] = { 30, 34, 32, 36, 31, 35, 33, 37, 90, 94, 92, 96, 91, 95, 93, 97 };
 const char* get_popup_colors()
@@ -77,6 +77,18 @@ extern "C" {
 #endif
 
 static int32 resolve_ambiguous_wcwidth(char32_t ucs);
+static uint8 get_wcwidth_class(char32_t ucs);
+
+/* width classes; see get_wcwidth_class() */
+enum {
+  WC_ZERO       = 0x00,
+  WC_ONE        = 0x01,
+  WC_TWO        = 0x02,
+  WC_CONTROL    = 0x03,
+  WC_WIDTH_MASK = 0x03,
+  WC_EMOJI      = 0x04,   /* double width when color emoji are enabled */
+  WC_AMBIGUOUS  = 0x08,   /* East Asian Ambiguous */
+};
 
 struct interval {
   char32_t first;
@@ -202,17 +214,20 @@ static int32 mk_wcwidth(char32_t ucs)
   if (ucs < 0xa0)
     return -1;
 
+  /* table lookup of the width class */
+  const uint8 c = get_wcwidth_class(ucs);
+
   /* special processing for color emoji */
-  if (g_color_emoji &&
-      bisearch(ucs, emojis, _countof(emojis) - 1))
+  if (g_color_emoji && (c & WC_EMOJI))
     return 2;
 
-  /* binary search in table of non-spacing characters */
-  if (bisearch(ucs, combining, _countof(combining) - 1))
-    return 0;
+  return ((c & WC_WIDTH_MASK) == WC_CONTROL) ? -1 : (c & WC_WIDTH_MASK);
+}
 
-  /* if we arrive here, ucs is not a combining or C0/C1 control character */
-  return 1 +
+/* width of a character that's not a combining or C0/C1 control character */
+static uint8 get_spacing_wcwidth(char32_t ucs)
+{
+  return uint8(1 +
     (ucs >= 0x1100 &&
      (ucs <= 0x115f ||                    /* Hangul Jamo init. consonants */
       ucs == 0x2329 || ucs == 0x232a ||
@@ -225,7 +240,7 @@ static int32 mk_wcwidth(char32_t ucs)
       (ucs >= 0xff00 && ucs <= 0xff60) || /* Fullwidth Forms */
       (ucs >= 0xffe0 && ucs <= 0xffe6) ||
       (ucs >= 0x20000 && ucs <= 0x2fffd) ||
-      (ucs >= 0x30000 && ucs <= 0x3fffd)));
+      (ucs >= 0x30000 && ucs <= 0x3fffd))));
 }
 
 
@@ -304,6 +319,135 @@ static const struct interval ambiguous[] = {
   { 0xFFFD, 0xFFFD }, { 0xF0000, 0xFFFFD }, { 0x100000, 0x10FFFD }
 };
 
+/*
+ * Two-level lookup table of width classes.  The interval tables above are
+ * searched once to build the table, instead of searched for every character.
+ * The first level maps each block of 256 characters to one of the unique
+ * blocks in the second level; most blocks are identical, so only a few dozen
+ * unique blocks are needed.
+ *
+ * The emoji tables are generated by 'premake5 embed', and building the table
+ * at compile time would exceed the compiler's constexpr evaluation limits, so
+ * it's built the first time a width is needed.
+ */
+#define WC_BLOCK_SHIFT      8
+#define WC_BLOCK_SIZE       (1 << WC_BLOCK_SHIFT)
+#define WC_NUM_BLOCKS       (0x110000 >> WC_BLOCK_SHIFT)
+#define WC_MAX_BLOCKS       128
+#define WC_NO_BLOCK         0xff  /* not in the table; classify directly */
+
+static uint8 s_wc_stage1[WC_NUM_BLOCKS];
+static uint8 s_wc_stage2[WC_MAX_BLOCKS][WC_BLOCK_SIZE];
+
+static uint8 classify_wcwidth(char32_t ucs)
+{
+  uint8 c;
+  if (ucs == 0)
+    return WC_ZERO;
+  if (ucs < 32)
+    return WC_CONTROL;
+  if (ucs <= 0x7e)
+    return WC_ONE;
+  if (ucs < 0xa0)
+    return WC_CONTROL;
+
+  if (bisearch(ucs, combining, _countof(combining) - 1))
+    c = WC_ZERO;
+  else
+    c = get_spacing_wcwidth(ucs);
+  if (bisearch(ucs, emojis, _countof(emojis) - 1))
+    c = uint8(c | WC_EMOJI);
+  if (bisearch(ucs, ambiguous, _countof(ambiguous) - 1))
+    c = uint8(c | WC_AMBIGUOUS);
+  return c;
+}
+
+/* applies the intervals that overlap a block; the cursor advances through the
+ * table as successive blocks are painted */
+static void paint_wcwidth_block(uint8 *block, char32_t first, const struct interval *table, int32 count, int32 *cursor, uint8 mask, uint8 bits)
+{
+  const char32_t last = first + WC_BLOCK_SIZE - 1;
+
+  while (*cursor < count && table[*cursor].last < first)
+    ++*cursor;
+
+  for (int32 i = *cursor; i < count && table[i].first <= last; ++i) {
+    const char32_t lo = max<char32_t>(table[i].first, first);
+    const char32_t hi = min<char32_t>(table[i].last, last);
+    for (char32_t ucs = lo; ucs <= hi; ++ucs)
+      block[ucs - first] = uint8((block[ucs - first] & ~mask) | bits);
+  }
+}
+
+static bool build_wcwidth_classes()
+{
+  uint8 block[WC_BLOCK_SIZE];
+  uint32 hashes[WC_MAX_BLOCKS];
+  uint32 num_blocks = 0;
+  int32 cursor_combining = 0;
+  int32 cursor_emojis = 0;
+  int32 cursor_ambiguous = 0;
+
+  for (uint32 b = 0; b < WC_NUM_BLOCKS; ++b) {
+    const char32_t first = b << WC_BLOCK_SHIFT;
+
+    for (uint32 i = 0; i < WC_BLOCK_SIZE; ++i) {
+      const char32_t ucs = first + i;
+      if (ucs == 0)
+        block[i] = WC_ZERO;
+      else if (ucs < 32 || (ucs >= 0x7f && ucs < 0xa0))
+        block[i] = WC_CONTROL;
+      else if (ucs <= 0x7e)
+        block[i] = WC_ONE;
+      else
+        block[i] = get_spacing_wcwidth(ucs);
+    }
+
+    paint_wcwidth_block(block, first, combining, _countof(combining), &cursor_combining, WC_WIDTH_MASK, WC_ZERO);
+    paint_wcwidth_block(block, first, emojis, _countof(emojis), &cursor_emojis, 0, WC_EMOJI);
+    paint_wcwidth_block(block, first, ambiguous, _countof(ambiguous), &cursor_ambiguous, 0, WC_AMBIGUOUS);
+
+    uint32 hash = 2166136261u;
+    for (uint32 i = 0; i < WC_BLOCK_SIZE; ++i)
+      hash = (hash ^ block[i]) * 16777619u;
+
+    uint32 index = 0;
+    while (index < num_blocks &&
+           (hashes[index] != hash || memcmp(s_wc_stage2[index], block, sizeof(block)) != 0))
+      ++index;
+
+    if (index >= num_blocks) {
+      if (num_blocks >= WC_MAX_BLOCKS) {
+        assert(false); /* increase WC_MAX_BLOCKS */
+        s_wc_stage1[b] = WC_NO_BLOCK;
+        continue;
+      }
+      memcpy(s_wc_stage2[index], block, sizeof(block));
+      hashes[index] = hash;
+      ++num_blocks;
+    }
+
+    s_wc_stage1[b] = uint8(index);
+  }
+
+  static_assert(WC_MAX_BLOCKS < WC_NO_BLOCK, "block index collides with WC_NO_BLOCK");
+  return true;
+}
+
+static uint8 get_wcwidth_class(char32_t ucs)
+{
+  if (ucs >= 0x110000)
+    return WC_ONE;
+
+  static const bool s_built = build_wcwidth_classes();
+  (void)s_built;
+
+  const uint8 index = s_wc_stage1[ucs >> WC_BLOCK_SHIFT];
+  if (index == WC_NO_BLOCK)
+    return classify_wcwidth(ucs);
+  return s_wc_stage2[index][ucs & (WC_BLOCK_SIZE - 1)];
+}
+
 /*
  * The following functions are the same as mk_wcwidth() and
  * mk_wcswidth(), except that spacing characters in the East Asian
@@ -315,8 +459,8 @@ static const struct interval ambiguous[] = {
  */
 static int32 mk_wcwidth_cjk(char32_t ucs)
 {
-  /* binary search in table of ambiguous width chars in CJK codepages */
-  if (bisearch(ucs, ambiguous, _countof(ambiguous) - 1))
+  /* table lookup of ambiguous width chars in CJK codepages */
+  if (ucs >= 0xa0 && (get_wcwidth_class(ucs) & WC_AMBIGUOUS))
     return resolve_ambiguous_wcwidth(ucs);
 
   return mk_wcwidth(ucs);
@@ -366,7 +510,6 @@ bool is_fully_qualified_double_width_prefix(char32_t ucs)
 }
 
 #include <core/settings.h>
-#include <map>
 
 enum { EAA_font, EAA_one, EAA_two, EAA_auto, EAA_MAX };
 
@@ -391,7 +534,8 @@ static setting_enum g_terminal_east_asian_ambiguous(
 
 static HDC s_hdc = NULL;
 static HFONT s_hfont = NULL;
-static std::map<char32_t, int32> s_map_ambiguous;
+static int8* s_font_wcwidths[WC_NUM_BLOCKS]; // Per block; -1 means not measured yet.
+static uint32 s_font_wcwidths_count = 0;
 static int32 s_cell = 0;
 static int32 s_cell_rounding = 0;
 static int32 s_resolve = EAA_auto;
@@ -461,16 +605,24 @@ static int32 resolve_ambiguous_wcwidth(char32_t ucs)
   case EAA_font:
     {
 use_font:
-      auto i = s_map_ambiguous.find(ucs);
-      if (i != s_map_ambiguous.end())
-        return i->second;
+      // Measuring with the font is slow, so the results are remembered
+      // until the font changes.
+      int8*& widths = s_font_wcwidths[ucs >> WC_BLOCK_SHIFT];
+      if (widths && widths[ucs & (WC_BLOCK_SIZE - 1)] >= 0)
+        return widths[ucs & (WC_BLOCK_SIZE - 1)];
 
       int32 width = get_wcwidth_from_font(ucs);
       if (width < 0)
         width = 2;
 
-      dbg_ignore_scope(snapshot, "East Asian Ambiguous width map");
-      s_map_ambiguous[ucs] = width;
+      if (!widths)
+      {
+        dbg_ignore_scope(snapshot, "East Asian Ambiguous width map");
+        widths = new int8[WC_BLOCK_SIZE];
+        memset(widths, -1, WC_BLOCK_SIZE);
+        ++s_font_wcwidths_count;
+      }
+      widths[ucs & (WC_BLOCK_SIZE - 1)] = int8(min<int32>(width, 127));
       return width;
     }
 
@@ -492,9 +644,18 @@ use_font:
   }
 }
 
+static uint32 s_wcwidths_generation = 0;
+
+uint32 get_wcwidths_generation()
+{
+  return s_wcwidths_generation;
+}
+
 void reset_cached_font()
 {
-  if (s_hdc || s_hfont || s_cell || !s_map_ambiguous.empty())
+  ++s_wcwidths_generation;
+
+  if (s_hdc || s_hfont || s_cell || s_font_wcwidths_count)
     LOG("resetting cached font info");
 
   if (s_hdc)
@@ -510,7 +671,16 @@ void reset_cached_font()
   }
   s_cell = 0;
   s_cell_rounding = 0;
-  s_map_ambiguous.clear();
+
+  if (s_font_wcwidths_count)
+  {
+    for (auto& widths : s_font_wcwidths)
+    {
+      delete [] widths;
+      widths = nullptr;
+    }
+    s_font_wcwidths_count = 0;
+  }
 }
 
 static void init_cached_font()
@@ -587,6 +757,8 @@ void reset_wcwidths()
 {
     int32 use_cjk = true;
 
+    ++s_wcwidths_generation;
+
     s_resolve = g_terminal_east_asian_ambiguous.get();
 
     str<> env;
@@ -4,16 +4,111 @@
 #include "pch.h"
 #include "wcwidth.h"
 
+#include <core/str_compare.h>
+
 #include <assert.h>
 
 //------------------------------------------------------------------------------
-extern "C" uint32 clink_wcswidth(const char* s, uint32 len)
+// Prompts with many emoji or symbol glyphs (e.g. powerline themes) get measured
+// over and over, and the same runs of non-ASCII characters keep recurring.  So
+// each thread has a small direct-mapped cache from a run of non-ASCII text to
+// its width, which turns measuring a repeated run into a hash and a compare.
+// Entries are only valid for the generation of character widths and the
+// color emoji mode they were measured with.
+static const uint32 c_max_cached_run = 48;
+static const uint32 c_run_cache_size = 64;
+
+struct run_width_entry
 {
-    uint32 count = 0;
+    uint32          generation;     // Widths generation + 1; 0 means empty.
+    uint32          width;
+    uint8           len;
+    bool            color_emoji;
+    char            run[c_max_cached_run];
+};
 
+static threadlocal run_width_entry t_run_cache[c_run_cache_size];
+
+//------------------------------------------------------------------------------
+// Returns the number of bytes up to the next plain ASCII character (or NUL).
+static uint32 scan_non_plain(const char* s, uint32 len)
+{
+    uint32 n = 0;
+    for (; n < len && s[n]; ++n)
+    {
+        const uint8 c = uint8(s[n]);
+        if (c >= 0x20 && c < 0x80)
+            break;
+    }
+    return n;
+}
+
+//------------------------------------------------------------------------------
+static uint32 measure_run(const char* s, uint32 len)
+{
+    uint32 count = 0;
     wcwidth_iter inner_iter(s, len);
     while (inner_iter.next())
         count += inner_iter.character_wcwidth_onectrl();
+    return count;
+}
+
+//------------------------------------------------------------------------------
+static uint32 measure_run_cached(const char* s, uint32 len)
+{
+    if (len > c_max_cached_run)
+        return measure_run(s, len);
+
+    uint32 hash = 2166136261u;
+    for (uint32 i = 0; i < len; ++i)
+        hash = (hash ^ uint8(s[i])) * 16777619u;
+
+    extern bool g_color_emoji;
+    const uint32 generation = get_wcwidths_generation() + 1;
+    run_width_entry& entry = t_run_cache[hash % c_run_cache_size];
+    if (entry.generation == generation &&
+        entry.color_emoji == g_color_emoji &&
+        entry.len == len &&
+        memcmp(entry.run, s, len) == 0)
+        return entry.width;
+
+    const uint32 width = measure_run(s, len);
+    entry.generation = generation;
+    entry.width = width;
+    entry.len = uint8(len);
+    entry.color_emoji = g_color_emoji;
+    memcpy(entry.run, s, len);
+    return width;
+}
+
+//------------------------------------------------------------------------------
+extern "C" uint32 clink_wcswidth(const char* s, uint32 len)
+{
+    uint32 count = 0;
+
+    while (true)
+    {
+        // Plain ASCII is one cell per byte.  Zero width characters that follow
+        // it add nothing, and no ASCII character starts a fully qualified
+        // emoji, so the rest can be measured separately.
+        const uint32 plain = str_scan_plain_ascii(s, len);
+        count += plain;
+        s += plain;
+        if (len != UINT_MAX)
+            len -= plain;
+        if (!len || !*s)
+            break;
+
+        // Measure up to the next plain ASCII character.  A run never extends
+        // into plain ASCII, since no plain ASCII character has zero width.
+        const uint32 used = scan_non_plain(s, len);
+        if (!used)
+            break;
+        count += measure_run_cached(s, used);
+        s += used;
+        if (len != UINT_MAX)
+            len -= used;
+    }
 
     return count;
 }
@@ -17,7 +17,11 @@
 
 #include <assert.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <regex>
+#include <thread>
 
 // For compatibility with Windows 8.1 SDK.
 #if !defined( ENABLE_VIRTUAL_TERMINAL_PROCESSING )
@@ -188,12 +192,224 @@ static setting_enum g_terminal_color_emoji(
     "off,on,auto",
     2);
 
+static setting_enum g_terminal_synchronized_output(
+    "terminal.synchronized_output",
+    "Draw each screen update all at once",
+    "When enabled, Clink asks the terminal to hold each update of the input line\n"
+    "or popup list and then draw it all at once (synchronized output, DEC private\n"
+    "mode 2026).  This avoids flicker and tearing, especially over slow remote\n"
+    "connections.  When set to 'auto' (the default) it's used with Windows\n"
+    "Terminal, WezTerm, and ConEmu.  It requires native terminal support.",
+    "off,on,auto",
+    2);
+
+static setting_bool g_terminal_render_thread(
+    "terminal.render_thread",
+    "Write input line updates from a separate thread",
+    "When enabled, updates to the input line are written to the console by a\n"
+    "separate thread, so that a slow console (e.g. under heavy load or over a\n"
+    "remote desktop connection) doesn't delay handling the next key.  Updates\n"
+    "that arrive while a write is in progress are combined into a single write,\n"
+    "at most about 60 times per second.  It requires native terminal support.",
+    false);
+
+//------------------------------------------------------------------------------
+bool use_synchronized_output()
+{
+    switch (g_terminal_synchronized_output.get())
+    {
+    case 0:
+        return false;
+    case 1:
+        // The codes must reach the terminal; emulation would discard them.
+        return s_current_ansi_handler >= ansi_handler::first_native;
+    default:
+        return (s_current_ansi_handler == ansi_handler::winterminal ||
+                s_current_ansi_handler == ansi_handler::wezterm ||
+                s_current_ansi_handler == ansi_handler::conemu);
+    }
+}
+
+
+
+//------------------------------------------------------------------------------
+// Writes Readline's display updates to the console on a separate thread.  Each
+// update is a complete VT sequence for one redisplay, relative to the previous
+// one, so updates are never dropped; instead updates that queue up while a
+// write is in progress (or during the minimum frame interval) are appended and
+// reach the console together in one WriteConsoleW call.
+class render_thread
+{
+public:
+                    ~render_thread();
+    void            start(HANDLE handle);
+    void            stop();
+    void            submit(const WCHAR* chars, uint32 len);
+    void            wait();
+    bool            is_pending() const { return m_busy; }
+
+private:
+    void            proc();
+
+    HANDLE          m_handle = nullptr;
+    std::unique_ptr<std::thread> m_thread;
+    std::mutex      m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    std::vector<WCHAR> m_pending;
+    std::vector<WCHAR> m_writing;
+    std::atomic<bool> m_busy { false };
+    bool            m_hurry = false;
+    bool            m_stop = false;
+    DWORD           m_last_write = 0;
+
+    static const DWORD c_min_frame_interval = 16;
+};
+
+//------------------------------------------------------------------------------
+static render_thread s_render_thread;
+static int32 s_async_output = 0;
+
+//------------------------------------------------------------------------------
+render_thread::~render_thread()
+{
+    // By the time static objects are destroyed, ExitProcess has already ended
+    // the thread, and joining it while holding the loader lock could hang.
+    if (m_thread)
+        m_thread->detach();
+}
+
+//------------------------------------------------------------------------------
+void render_thread::start(HANDLE handle)
+{
+    if (m_thread)
+    {
+        if (m_handle == handle)
+            return;
+        stop();
+    }
+
+    dbg_ignore_scope(snapshot, "Render thread");
+
+    m_handle = handle;
+    m_stop = false;
+    m_thread = std::make_unique<std::thread>(&render_thread::proc, this);
+}
+
+//------------------------------------------------------------------------------
+void render_thread::stop()
+{
+    if (!m_thread)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_thread->join();
+    m_thread.reset();
+    m_handle = nullptr;
+}
+
+//------------------------------------------------------------------------------
+void render_thread::submit(const WCHAR* chars, uint32 len)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.insert(m_pending.end(), chars, chars + len);
+        m_busy = true;
+    }
+    m_wake.notify_one();
+}
+
+//------------------------------------------------------------------------------
+// Returns after everything submitted so far has been written to the console.
+void render_thread::wait()
+{
+    if (!m_busy)
+        return;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_hurry = true;
+    m_wake.notify_one();
+    m_idle.wait(lock, [this]{ return !m_busy; });
+    m_hurry = false;
+}
+
+//------------------------------------------------------------------------------
+void render_thread::proc()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wake.wait(lock, [this]{ return m_stop || !m_pending.empty(); });
+        if (m_pending.empty())
+            break;
+
+        // Cap the frame rate; updates submitted in the meantime are coalesced
+        // into the same write.
+        const DWORD elapsed = GetTickCount() - m_last_write;
+        if (elapsed < c_min_frame_interval)
+        {
+            m_wake.wait_for(lock, std::chrono::milliseconds(c_min_frame_interval - elapsed),
+                            [this]{ return m_stop || m_hurry; });
+        }
+
+        m_writing.swap(m_pending);
+        m_pending.clear();
+
+        lock.unlock();
+        DWORD written;
+        WriteConsoleW(m_handle, m_writing.data(), DWORD(m_writing.size()), &written, nullptr);
+        lock.lock();
+
+        m_last_write = GetTickCount();
+        if (m_pending.empty())
+        {
+            m_busy = false;
+            m_idle.notify_all();
+        }
+    }
+
+    m_busy = false;
+    m_idle.notify_all();
+}
+
+//------------------------------------------------------------------------------
+async_output_scope::async_output_scope()
+{
+    ++s_async_output;
+}
+
+//------------------------------------------------------------------------------
+async_output_scope::~async_output_scope()
+{
+    assert(s_async_output > 0);
+    --s_async_output;
+}
+
+//------------------------------------------------------------------------------
+void wait_for_console_output()
+{
+    s_render_thread.wait();
+}
+
+//------------------------------------------------------------------------------
+bool is_console_output_pending()
+{
+    return s_render_thread.is_pending();
+}
+
+
+
 //------------------------------------------------------------------------------
 win_screen_buffer::~win_screen_buffer()
 {
     close();
     free(m_attrs);
     free(m_chars);
+    free(m_out);
 }
 
 //------------------------------------------------------------------------------
@@ -379,6 +595,8 @@ void win_screen_buffer::begin()
 //------------------------------------------------------------------------------
 void win_screen_buffer::end()
 {
+    flush_out();
+
     if (m_ready > 0)
     {
         m_ready--;
@@ -393,64 +611,76 @@ void win_screen_buffer::end()
 //------------------------------------------------------------------------------
 void win_screen_buffer::close()
 {
+    flush_out();
+    s_render_thread.stop();
+
     m_handle = nullptr;
 }
 
 //------------------------------------------------------------------------------
+// Output is converted into a reused UTF-16 buffer.  Inside a batch it's held
+// there, so that consecutive writes reach the console in one WriteConsoleW
+// call; anything else that touches the console writes it out first.
 void win_screen_buffer::write(const char* data, int32 length)
 {
     assert(m_ready);
 
-    str_iter iter(data, length);
-
-#ifdef DEBUG
-    const uint32 stack_buf_len = 64;
-#else
-    const uint32 stack_buf_len = 384;
-#endif
-
-    if (length < stack_buf_len)
+    if (data)
     {
-        wchar_t wbuf[stack_buf_len];
-        int32 n = to_utf16(wbuf, sizeof_array(wbuf), iter);
+        // Each UTF-8 byte produces at most one UTF-16 code unit, so the byte
+        // count is enough room and the text only needs to be scanned once.
+        // This matters for large outputs passed through to a native VT host.
+        if (length < 0)
+            length = int32(strlen(data));
+        if (!ensure_out_buffer(m_out_len + uint32(max<int32>(length, 1))))
+            return;
+
+        str_iter iter(data, length);
+        int32 n = to_utf16(m_out + m_out_len, m_out_capacity - m_out_len + 1, iter);
         if (length && !n && !*data)
         {
             assert(false); // Very inefficient, and shouldn't be possible.
-            wbuf[0] = '\0';
+            m_out[m_out_len] = '\0';
             n = 1;
         }
-
-        DWORD written;
-        WriteConsoleW(m_handle, data ? wbuf : nullptr, n, &written, nullptr);
+        m_out_len += n;
     }
-    else
-    {
-        wstr_moveable out;
-        out.reserve(length);
-        int32 n = to_utf16(out, iter);
-        if (length && !n && !*data)
-        {
-            assert(false); // Very inefficient, and shouldn't be possible.
-            assert(out.c_str()[0] == '\0');
-            n = 1;
-        }
 
-        DWORD written;
-        WriteConsoleW(m_handle, out.c_str(), n, &written, nullptr);
-    }
+    // Keep a batch from holding an unbounded amount of output.
+    if (!m_batch || m_out_len >= 0x10000)
+        flush_out();
 }
 
 //------------------------------------------------------------------------------
 void win_screen_buffer::flush()
 {
+    flush_out();
+
     // When writing to the console conhost.exe will restart the cursor blink
     // timer and hide it which can be disorientating, especially when moving
-    // around a line. The below will make sure it stays visible.
+    // around a line. The below will make sure it stays visible.  Skip it while
+    // the render thread is writing, since the cursor position isn't final yet.
+    if (s_render_thread.is_pending())
+        return;
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     GetConsoleScreenBufferInfo(m_handle, &csbi);
     SetConsoleCursorPosition(m_handle, csbi.dwCursorPosition);
 }
 
+//------------------------------------------------------------------------------
+void win_screen_buffer::begin_batch()
+{
+    ++m_batch;
+}
+
+//------------------------------------------------------------------------------
+void win_screen_buffer::end_batch()
+{
+    assert(m_batch > 0);
+    if (m_batch > 0 && !--m_batch)
+        flush_out();
+}
+
 //------------------------------------------------------------------------------
 int32 win_screen_buffer::get_columns() const
 {
@@ -470,6 +700,8 @@ int32 win_screen_buffer::get_rows() const
 //------------------------------------------------------------------------------
 bool win_screen_buffer::get_line_text(int32 line, str_base& out) const
 {
+    sync_out();
+
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     if (!GetConsoleScreenBufferInfo(m_handle, &csbi))
         return false;
@@ -500,6 +732,8 @@ bool win_screen_buffer::has_native_vt_processing() const
 //------------------------------------------------------------------------------
 void win_screen_buffer::clear(clear_type type)
 {
+    flush_out();
+
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     GetConsoleScreenBufferInfo(m_handle, &csbi);
 
@@ -539,6 +773,8 @@ void win_screen_buffer::clear(clear_type type)
 //------------------------------------------------------------------------------
 void win_screen_buffer::clear_line(clear_type type)
 {
+    flush_out();
+
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     GetConsoleScreenBufferInfo(m_handle, &csbi);
 
@@ -570,6 +806,8 @@ void win_screen_buffer::clear_line(clear_type type)
 //------------------------------------------------------------------------------
 void win_screen_buffer::set_horiz_cursor(int32 column)
 {
+    flush_out();
+
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     GetConsoleScreenBufferInfo(m_handle, &csbi);
 
@@ -586,6 +824,8 @@ void win_screen_buffer::set_horiz_cursor(int32 column)
 //------------------------------------------------------------------------------
 void win_screen_buffer::set_cursor(int32 column, int32 row)
 {
+    flush_out();
+
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     GetConsoleScreenBufferInfo(m_handle, &csbi);
 
@@ -603,6 +843,8 @@ void win_screen_buffer::set_cursor(int32 column, int32 row)
 //------------------------------------------------------------------------------
 void win_screen_buffer::move_cursor(int32 dx, int32 dy)
 {
+    flush_out();
+
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     GetConsoleScreenBufferInfo(m_handle, &csbi);
 
@@ -616,6 +858,8 @@ void win_screen_buffer::move_cursor(int32 dx, int32 dy)
 //------------------------------------------------------------------------------
 void win_screen_buffer::save_cursor()
 {
+    flush_out();
+
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     GetConsoleScreenBufferInfo(m_handle, &csbi);
 
@@ -638,6 +882,8 @@ void win_screen_buffer::restore_cursor()
 //------------------------------------------------------------------------------
 void win_screen_buffer::insert_chars(int32 count)
 {
+    flush_out();
+
     if (count <= 0)
         return;
 
@@ -661,6 +907,8 @@ void win_screen_buffer::insert_chars(int32 count)
 //------------------------------------------------------------------------------
 void win_screen_buffer::delete_chars(int32 count)
 {
+    flush_out();
+
     if (count <= 0)
         return;
 
@@ -695,6 +943,8 @@ void win_screen_buffer::delete_chars(int32 count)
 //------------------------------------------------------------------------------
 void win_screen_buffer::set_attributes(attributes attr)
 {
+    flush_out();
+
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     GetConsoleScreenBufferInfo(m_handle, &csbi);
 
@@ -844,6 +1094,8 @@ bool win_screen_buffer::get_nearest_color(attributes& attr) const
 //------------------------------------------------------------------------------
 int32 win_screen_buffer::is_line_default_color(int32 line) const
 {
+    sync_out();
+
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     if (!GetConsoleScreenBufferInfo(m_handle, &csbi))
         return -1;
@@ -869,6 +1121,8 @@ int32 win_screen_buffer::is_line_default_color(int32 line) const
 //------------------------------------------------------------------------------
 int32 win_screen_buffer::line_has_color(int32 line, const BYTE* attrs, int32 num_attrs, BYTE mask) const
 {
+    sync_out();
+
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     if (!GetConsoleScreenBufferInfo(m_handle, &csbi))
         return -1;
@@ -895,16 +1149,26 @@ int32 win_screen_buffer::line_has_color(int32 line, const BYTE* attrs, int32 num
     return false;
 }
 
+//------------------------------------------------------------------------------
+static const int32 c_find_line_chunk_rows = 64;
+static const int32 c_find_line_chunk_chars = 32 * 1024;
+
 //------------------------------------------------------------------------------
 int32 win_screen_buffer::find_line(int32 starting_line, int32 distance, const char* text, find_line_mode mode, const BYTE* attrs, int32 num_attrs, BYTE mask) const
 {
+    sync_out();
+
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     if (!GetConsoleScreenBufferInfo(m_handle, &csbi))
         return -2;
 
-    if (text && !ensure_chars_buffer(csbi.dwSize.X))
+    // Room to read several rows per round trip to the console host; see
+    // ::find_line().  Text searches read attributes only one row at a time.
+    const int32 width = csbi.dwSize.X;
+    const int32 chunk = width * max<int32>(1, min<int32>(c_find_line_chunk_rows, c_find_line_chunk_chars / max<int32>(1, width)));
+    if (text && !ensure_chars_buffer(chunk))
         return -2;
-    if (attrs && num_attrs > 0 && !ensure_attrs_buffer(csbi.dwSize.X))
+    if (attrs && num_attrs > 0 && !ensure_attrs_buffer(text ? width : chunk))
         return -2;
 
     return ::find_line(m_handle, csbi,
@@ -938,10 +1202,64 @@ bool win_screen_buffer::ensure_attrs_buffer(int32 width) const
 {
     if (width > m_attrs_capacity)
     {
-        m_attrs = static_cast<WORD*>(malloc((width + 1) * sizeof(*m_attrs)));
-        if (!m_attrs)
+        WORD* attrs = static_cast<WORD*>(realloc(m_attrs, (width + 1) * sizeof(*m_attrs)));
+        if (!attrs)
             return false;
+        m_attrs = attrs;
         m_attrs_capacity = width;
     }
     return true;
 }
+
+//------------------------------------------------------------------------------
+bool win_screen_buffer::ensure_out_buffer(uint32 count)
+{
+    if (count > m_out_capacity)
+    {
+        const uint32 capacity = max<uint32>(count, max<uint32>(256, m_out_capacity * 2));
+        WCHAR* out = static_cast<WCHAR*>(realloc(m_out, (capacity + 1) * sizeof(*m_out)));
+        if (!out)
+            return false;
+        m_out = out;
+        m_out_capacity = capacity;
+#ifdef USE_MEMORY_TRACKING
+        dbgsetignore(out, 1);
+        dbgsetlabel(out, "win_screen_buffer::m_out", false);
+#endif
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void win_screen_buffer::flush_out() const
+{
+    // Only whole VT sequences can be handed to the render thread; emulation
+    // interleaves console API calls with the text.
+    if (m_out_len && s_async_output && m_native_vt > 0 && g_terminal_render_thread.get())
+    {
+        s_render_thread.start(m_handle);
+        s_render_thread.submit(m_out, m_out_len);
+        m_out_len = 0;
+        return;
+    }
+
+    // Everything else touches the console directly, so it must wait until
+    // the render thread has written everything before it.
+    s_render_thread.wait();
+
+    if (m_out_len)
+    {
+        DWORD written;
+        WriteConsoleW(m_handle, m_out, m_out_len, &written, nullptr);
+        m_out_len = 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Reading the console must see everything written so far, including output
+// that flush_out() handed to the render thread.
+void win_screen_buffer::sync_out() const
+{
+    flush_out();
+    s_render_thread.wait();
+}
@@ -20,6 +20,8 @@ public:
     virtual void    close() override;
     virtual void    write(const char* data, int32 length) override;
     virtual void    flush() override;
+    virtual void    begin_batch() override;
+    virtual void    end_batch() override;
     virtual int32   get_columns() const override;
     virtual int32   get_rows() const override;
     virtual bool    get_line_text(int32 line, str_base& out) const override;
@@ -42,6 +44,9 @@ public:
 private:
     bool            ensure_chars_buffer(int32 width) const;
     bool            ensure_attrs_buffer(int32 width) const;
+    bool            ensure_out_buffer(uint32 count);
+    void            flush_out() const;
+    void            sync_out() const;
 
     enum : unsigned short
     {
@@ -61,10 +66,16 @@ private:
     char            m_native_vt = -1;
 
     mutable WORD*   m_attrs = nullptr;
-    mutable SHORT   m_attrs_capacity = 0;
+    mutable int32   m_attrs_capacity = 0;
 
     mutable WCHAR*  m_chars = nullptr;
-    mutable SHORT   m_chars_capacity = 0;
+    mutable int32   m_chars_capacity = 0;
 
     COORD           m_saved_cursor = {};
+
+    // Pending UTF-16 output; grows as needed and is reused.
+    mutable WCHAR*  m_out = nullptr;
+    mutable uint32  m_out_len = 0;
+    uint32          m_out_capacity = 0;
+    int32           m_batch = 0;
 };
@@ -9,6 +9,7 @@
 #include "wcwidth.h"
 #include "terminal_helpers.h"
 #include "screen_buffer.h"
+#include "printer.h"
 
 #include <core/base.h>
 #include <core/str.h>
@@ -549,9 +550,14 @@ enum : uint8
 
 
 
+//------------------------------------------------------------------------------
+// Minimum milliseconds between reporting terminal resizes.
+const DWORD c_resize_frame_interval = 33;
+
 //------------------------------------------------------------------------------
 uint32 win_terminal_in::get_dimensions()
 {
+    wait_for_console_output();
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     GetConsoleScreenBufferInfo(m_stdout, &csbi);
     auto cols = short(csbi.dwSize.X);
@@ -624,6 +630,16 @@ int32 win_terminal_in::end(bool can_show_cursor)
 bool win_terminal_in::available(uint32 _timeout)
 {
     bool ret = (m_buffer_count > 0 || m_has_pending_record);
+
+    // Quick check for whether anything is queued, since line_editor_impl asks
+    // after every key to detect bursts of input (e.g. pastes).
+    if (!ret && !_timeout)
+    {
+        DWORD count;
+        if (GetNumberOfConsoleInputEvents(m_stdin, &count) && !count)
+            return false;
+    }
+
     const DWORD stop = GetTickCount() + _timeout;
     while (!ret)
     {
@@ -665,6 +681,16 @@ int32 win_terminal_in::read()
     uint32 dimensions = get_dimensions();
     if (dimensions != m_dimensions)
     {
+        // Dragging a window edge produces a stream of size changes.  Report at
+        // most one per frame interval; changes that arrive meanwhile coalesce,
+        // since only the final dimensions matter for redrawing.
+        const DWORD elapsed = GetTickCount() - m_resize_tick;
+        if (elapsed < c_resize_frame_interval)
+        {
+            Sleep(c_resize_frame_interval - elapsed);
+            dimensions = get_dimensions();
+        }
+        m_resize_tick = GetTickCount();
         m_dimensions = dimensions;
         return terminal_in::input_terminal_resize;
     }
@@ -834,6 +860,10 @@ void win_terminal_in::read_console(input_idle* callback, DWORD _timeout, bool pe
         return;
     }
 
+    // Output held by the printer must be visible before waiting for input.
+    if (!peek && g_printer)
+        g_printer->release_output();
+
     // Hide the cursor unless we're accepting input so we don't have to see it
     // jump around as the screen's drawn.
     const bool cursor_visibility = (m_cursor_visibility && !peek);
@@ -847,10 +877,15 @@ void win_terminal_in::read_console(input_idle* callback, DWORD _timeout, bool pe
     // Conhost restarts the cursor blink when writing to the console. It restarts
     // hidden which means that if you type faster than the blink the cursor turns
     // invisible. Fortunately, moving the cursor restarts the blink on visible.
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    GetConsoleScreenBufferInfo(m_stdout, &csbi);
-    if (cursor_visibility && !is_scroll_mode())
-        SetConsoleCursorPosition(m_stdout, csbi.dwCursorPosition);
+    // Skip it while the render thread is still writing, since the position
+    // would be stale and waiting for it would delay reading the next key.
+    if (!is_console_output_pending())
+    {
+        CONSOLE_SCREEN_BUFFER_INFO csbi;
+        GetConsoleScreenBufferInfo(m_stdout, &csbi);
+        if (cursor_visibility && !is_scroll_mode())
+            SetConsoleCursorPosition(m_stdout, csbi.dwCursorPosition);
+    }
 
     // Reset interrupt detection (allow Ctrl+Break to cancel input).
     if (s_interrupt)
@@ -870,7 +905,7 @@ void win_terminal_in::read_console(input_idle* callback, DWORD _timeout, bool pe
         while (true)
         {
             uint32 count = 1;
-            HANDLE handles[5] = { m_stdin };
+            HANDLE handles[6] = { m_stdin };
 
             if (s_interrupt)
                 handles[count++] = s_interrupt;
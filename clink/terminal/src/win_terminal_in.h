@@ -40,6 +40,7 @@ private:
     void*           m_stdin = nullptr;
     void*           m_stdout = nullptr;
     uint32          m_dimensions = 0;
+    DWORD           m_resize_tick = 0;
     unsigned long   m_prev_mode = 0;
     DWORD           m_prev_mouse_button_state = 0;
     uint8           m_buffer_head = 0;
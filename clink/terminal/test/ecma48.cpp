@@ -4,7 +4,10 @@
 #include "pch.h"
 
 #include <core/base.h>
+#include <core/os.h>
+#include <core/str.h>
 #include <terminal/ecma48_iter.h>
+#include <terminal/wcwidth.h>
 
 #include <new>
 
@@ -446,3 +449,102 @@ TEST_CASE("ecma48 osc envvar")
         REQUIRE(code->get_length() == 2);
     }
 }
+
+//------------------------------------------------------------------------------
+TEST_CASE("ecma48 plain runs")
+{
+    SECTION("Chars")
+    {
+        // Runs longer than 16 bytes, so the fast path spans several blocks.
+        const char* input = "0123456789abcdefghij\x1b[1mxyz";
+
+        const ecma48_code* code;
+
+        ecma48_iter iter(input, g_state);
+        code = &iter.next();
+        REQUIRE(*code);
+        REQUIRE(code->get_type() == ecma48_code::type_chars);
+        REQUIRE(code->get_length() == 20);
+
+        code = &iter.next();
+        REQUIRE(*code);
+        REQUIRE(code->get_type() == ecma48_code::type_c1);
+        REQUIRE(code->get_code() == ecma48_code::c1_csi);
+
+        code = &iter.next();
+        REQUIRE(*code);
+        REQUIRE(code->get_type() == ecma48_code::type_chars);
+        REQUIRE(code->get_length() == 3);
+
+        REQUIRE(!iter.next());
+    }
+
+    SECTION("Length limit")
+    {
+        ecma48_iter iter("0123456789abcdefghij", g_state, 18);
+        const ecma48_code& code = iter.next();
+        REQUIRE(code);
+        REQUIRE(code.get_type() == ecma48_code::type_chars);
+        REQUIRE(code.get_length() == 18);
+        REQUIRE(!iter.next());
+    }
+
+    SECTION("Cells")
+    {
+        REQUIRE(cell_count("0123456789abcdefghijkl") == 22);
+        REQUIRE(cell_count("0123456789abcdefghijkl\xe4\xb8\x80mno") == 27);
+        REQUIRE(cell_count("\x1b[1m0123456789abcdefghijkl\x1b[m") == 22);
+        REQUIRE(cell_count("0123456789abcdefe\xcc\x81ghi") == 20);
+        REQUIRE(clink_wcswidth("0123456789abcdefghij", 18) == 18);
+        REQUIRE(clink_wcswidth("ab\x01" "cd", 5) == 5);
+    }
+
+    SECTION("Benchmark")
+    {
+        // Something like a colored match list.  Timings are only printed when
+        // CLINK_TEST_BENCHMARK is set.
+        str_moveable input;
+        for (int32 i = 0; i < 200; ++i)
+        {
+            str<> line;
+            line.format("\x1b[0;1;34msome_directory_%03d\\\x1b[m  \x1b[33mfile_name_%03d.txt\x1b[m\n", i, i);
+            input.concat(line.c_str(), line.length());
+        }
+        const int32 iterations = 500;
+
+        uint32 expected = 0;
+        {
+            ecma48_state state;
+            ecma48_iter iter(input.c_str(), state);
+            while (const ecma48_code& code = iter.next())
+                if (code.get_type() == ecma48_code::type_chars)
+                    expected += code.get_length();
+        }
+        REQUIRE(expected == 200 * uint32(strlen("some_directory_000\\  file_name_000.txt\n")) - 200);
+
+        const double start_iter = os::clock();
+        for (int32 i = 0; i < iterations; ++i)
+        {
+            uint32 chars = 0;
+            ecma48_state state;
+            ecma48_iter iter(input.c_str(), state);
+            while (const ecma48_code& code = iter.next())
+                if (code.get_type() == ecma48_code::type_chars)
+                    chars += code.get_length();
+            REQUIRE(chars == expected);
+        }
+        const double elapsed_iter = os::clock() - start_iter;
+
+        const double start_cells = os::clock();
+        for (int32 i = 0; i < iterations; ++i)
+            REQUIRE(cell_count(input.c_str()) == expected);
+        const double elapsed_cells = os::clock() - start_cells;
+
+        if (getenv("CLINK_TEST_BENCHMARK"))
+        {
+            const double mb = double(input.length()) * iterations / (1024 * 1024);
+            printf("ecma48 x%d:  iterate %.3f ms (%.1f MB/s), cell_count %.3f ms (%.1f MB/s)\n",
+                   iterations, elapsed_iter * 1000, mb / elapsed_iter, elapsed_cells * 1000, mb / elapsed_cells);
+        }
+    }
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2026 Christopher Antos
+// License: http://opensource.org/licenses/MIT
+
+#include "pch.h"
+
+#include <core/base.h>
+#include <core/settings.h>
+#include <core/str.h>
+#include <terminal/screen_buffer.h>
+#include <terminal/terminal.h>
+#include <terminal/terminal_helpers.h>
+
+//------------------------------------------------------------------------------
+TEST_CASE("render thread console reads")
+{
+    // The render thread needs a real console with native VT processing.
+    CONSOLE_SCREEN_BUFFER_INFO csbi;
+    if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi))
+        return;
+
+    setting* setting = settings::find("terminal.render_thread");
+    setting->set("true");
+
+    terminal term = terminal_create();
+    screen_buffer& screen = *term.screen;
+    screen.begin();
+
+    if (screen.has_native_vt_processing())
+    {
+        GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi);
+        const int32 line = csbi.dwCursorPosition.Y;
+
+        str<> text;
+        {
+            // Each write is handed to the render thread; reading the console
+            // right away must still see it.
+            async_output_scope async;
+            screen.write("\r\x1b[Krender", -1);
+            screen.write(" thread", -1);
+            REQUIRE(screen.get_line_text(line, text));
+            REQUIRE(text.equals("render thread"));
+            REQUIRE(!is_console_output_pending());
+
+            screen.write("\r\x1b[K", -1);
+            REQUIRE(screen.get_line_text(line, text));
+            REQUIRE(text.empty());
+        }
+    }
+
+    screen.end();
+    terminal_destroy(term);
+    setting->set();
+}
@@ -140,4 +140,77 @@ TEST_CASE("wcwidth_iter")
 
         g_color_emoji = false;
     }
+
+    SECTION("table lookup")
+    {
+        struct testcase
+        {
+            char32_t ucs;
+            int32 width;
+            int32 emoji_width;
+        };
+
+        // Includes characters at the edges of table blocks and intervals.
+        static const testcase c_testcases[] =
+        {
+            { 0x0000,   0,  0 },
+            { 0x001f,   -1, -1 },
+            { 'a',      1,  1 },
+            { 0x007f,   -1, -1 },
+            { 0x00a0,   1,  1 },
+            { 0x02ff,   1,  1 },
+            { 0x0300,   0,  0 },
+            { 0x036f,   0,  0 },
+            { 0x0370,   1,  1 },
+            { 0x1100,   2,  2 },
+            { 0x1160,   0,  0 },
+            { 0x231a,   1,  2 },
+            { 0x303f,   1,  1 },
+            { 0x4e00,   2,  2 },
+            { 0xffff,   1,  1 },
+            { 0x1f600,  1,  2 },
+            { 0x20000,  2,  2 },
+            { 0x3fffe,  1,  1 },
+            { 0xe0001,  0,  0 },
+            { 0x10ffff, 1,  1 },
+            { 0x110000, 1,  1 },
+        };
+
+        const bool old = g_color_emoji;
+
+        for (auto const& t : c_testcases)
+        {
+            g_color_emoji = false;
+            REQUIRE(wcwidth(t.ucs) == t.width);
+            g_color_emoji = true;
+            REQUIRE(wcwidth(t.ucs) == t.emoji_width);
+        }
+
+        g_color_emoji = old;
+    }
+
+    SECTION("wcswidth cached runs")
+    {
+        const bool old = g_color_emoji;
+
+        // Repeated measurement hits the cache, which must still honor the
+        // color emoji mode.
+        str<> s(L"y\u2714\ufe0fx \u2714\ufe0f\u2714\ufe0f");
+        for (int32 i = 0; i < 2; ++i)
+        {
+            g_color_emoji = false;
+            REQUIRE(clink_wcswidth(s.c_str(), s.length()) == 6);
+            g_color_emoji = true;
+            REQUIRE(clink_wcswidth(s.c_str(), s.length()) == 9);
+        }
+
+        // A run that's too long to cache is measured the same way.
+        str<> long_run;
+        for (int32 i = 0; i < 20; ++i)
+            long_run.concat("\xe2\x94\x80", 3);
+        REQUIRE(clink_wcswidth(long_run.c_str(), long_run.length()) == 20);
+        REQUIRE(clink_wcswidth(long_run.c_str(), UINT_MAX) == 20);
+
+        g_color_emoji = old;
+    }
 }
@@ -46,6 +46,8 @@ public:
     virtual void            close() override {}
     virtual void            write(const char* chars, int32 length) override {}
     virtual void            flush() override {}
+    virtual void            begin_batch() override {}
+    virtual void            end_batch() override {}
     virtual int32           get_columns() const override { return 80; }
     virtual int32           get_rows() const override { return 25; }
     virtual bool            get_line_text(int32 line, str_base& out) const { return false; }
@@ -23,6 +23,12 @@
 static int luaB_print (lua_State *L) {
   int n = lua_gettop(L);  /* number of arguments */
   int i;
+/* begin_clink_change */
+#if defined(_WIN32)
+  if (g_clink_callbacks)
+    g_clink_callbacks->before_write_console();
+#endif
+/* end_clink_change */
   lua_getglobal(L, "tostring");
   for (i=1; i<=n; i++) {
     const char *s;
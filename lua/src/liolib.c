@@ -572,6 +572,12 @@ static int io_readline (lua_State *L) {
 static int g_write (lua_State *L, FILE *f, int arg) {
   int nargs = lua_gettop(L) - arg;
   int status = 1;
+/* begin_clink_change */
+#if defined(_WIN32)
+  if ((f == stdout || f == stderr) && g_clink_callbacks)
+    g_clink_callbacks->before_write_console();
+#endif
+/* end_clink_change */
   for (; nargs--; arg++) {
     if (lua_type(L, arg) == LUA_TNUMBER) {
       /* optimization: could be done exactly as for strings */
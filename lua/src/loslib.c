@@ -79,7 +79,14 @@
 
 static int os_execute (lua_State *L) {
   const char *cmd = luaL_optstring(L, 1, NULL);
-  int stat = system(cmd);
+  int stat;
+/* begin_clink_change */
+#if defined(_WIN32)
+  if (cmd != NULL && g_clink_callbacks)
+    g_clink_callbacks->before_write_console();
+#endif
+/* end_clink_change */
+  stat = system(cmd);
   if (cmd != NULL)
     return luaL_execresult(L, stat);
   else {
@@ -584,6 +584,7 @@ typedef struct {
 typedef struct {
     void (*before_read_stdin)(lua_saved_console_mode* saved, void* stream);
     void (*after_read_stdin)(lua_saved_console_mode* saved);
+    void (*before_write_console)(void);
 } lua_clink_callbacks;
 extern const lua_clink_callbacks* g_clink_callbacks;
 void __lua_set_clink_callbacks(const lua_clink_callbacks* callbacks);
@@ -484,6 +484,15 @@ clink_dll("clink_app_dll")
 
     filter "action:vs*"
         links("dbghelp")
+        -- Non-critical system DLLs load on first use, instead of while cmd.exe
+        -- holds the loader lock during injection (see core/delay_load.h).
+        links("delayimp")
+        linkoptions("/DELAYLOAD:dbghelp.dll")
+        linkoptions("/DELAYLOAD:gdi32.dll")
+        linkoptions("/DELAYLOAD:ole32.dll")
+        linkoptions("/DELAYLOAD:shell32.dll")
+        linkoptions("/DELAYLOAD:shlwapi.dll")
+        linkoptions("/DELAYLOAD:version.dll")
 
     filter "action:gmake"
         buildoptions("-fpermissive")
@@ -567,6 +576,50 @@ clink_exe("clink_test")
         links("ole32")
         linkgroups("on")
 
+--------------------------------------------------------------------------------
+clink_exe("clink_bench")
+    links("clink_app_common")
+    links("clink_core")
+    links("clink_lib")
+    links("clink_lua")
+    links("clink_process")
+    links("clink_terminal")
+    links("detours")
+    links("wildmatch")
+    links("lua")
+    links("readline")
+    links("shlwapi")
+    links("rpcrt4")
+    includedirs("clink/bench/src")
+    includedirs("clink/test/src")
+    includedirs("clink/app/src")
+    includedirs("clink/core/include")
+    includedirs("clink/lib/include")
+    includedirs("clink/lib/include/lib")
+    includedirs("clink/lib/src")
+    includedirs("clink/lua/include")
+    includedirs("clink/process/include")
+    includedirs("clink/terminal/include")
+    includedirs("lua/src")
+    includedirs("readline")
+    includedirs("readline/compat")
+    files("clink/bench/**")
+    files("clink/test/src/**")
+    excludes("clink/test/src/main.cpp")
+
+    exceptionhandling("on")
+
+    filter "action:vs*"
+        pchheader("pch.h")
+        pchsource("clink/test/src/pch.cpp")
+
+    filter "action:gmake"
+        buildoptions("-fpermissive")
+        buildoptions("-std=c++17")
+        links("gdi32")
+        links("ole32")
+        linkgroups("on")
+
 --------------------------------------------------------------------------------
 require "vstudio"
 local function add_tag(tag, value, project_name)
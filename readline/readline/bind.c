@@ -74,6 +74,13 @@ int _rl_default_init_file_optional_set = 0;
 int _rl_load_user_init_file = 1;
 static int _rl_inputrc_optional_set = 0;
 static int fake_byte_oriented = 0;
+
+/* Called with the contents of each init file read (or with NULL if it could
+   not be read), and with each config variable set.  Together with the error
+   count, these let Clink cache the outcome of reading the init files. */
+rl_read_init_file_hook_func_t *rl_read_init_file_hook = (rl_read_init_file_hook_func_t *)NULL;
+rl_variable_bind_hook_func_t *rl_variable_bind_hook = (rl_variable_bind_hook_func_t *)NULL;
+int rl_init_file_error_count = 0;
 #undef rl_byte_oriented
 #define rl_byte_oriented fake_byte_oriented
 /* end_clink_change */
@@ -1094,6 +1101,10 @@ _rl_read_init_file (const char *filename, int include_level)
 
   openname = tilde_expand (filename);
   buffer = _rl_read_file (openname, &file_size);
+/* begin_clink_change */
+  if (rl_read_init_file_hook)
+    (*rl_read_init_file_hook) (openname, buffer, buffer ? file_size : 0);
+/* end_clink_change */
   xfree (openname);
 
   RL_CHECK_SIGNALS ();
@@ -1158,6 +1169,10 @@ _rl_init_file_error (const char *format, ...)
 {
   va_list args;
 
+/* begin_clink_change */
+  rl_init_file_error_count++;
+/* end_clink_change */
+
   va_start (args, format);
   fprintf (stderr, "readline: ");
   if (currently_reading_init_file)
@@ -2306,6 +2321,11 @@ rl_variable_bind (const char *name, const char *value)
   register int i;
   int	v;
 
+/* begin_clink_change */
+  if (rl_variable_bind_hook)
+    (*rl_variable_bind_hook) (name, value);
+/* end_clink_change */
+
   /* Check for simple variables first. */
   i = find_boolean_var (name);
   if (i >= 0)
@@ -3337,6 +3357,31 @@ rl_get_last_init_file (void)
 {
   return last_readline_init_file;
 }
+
+void
+rl_set_last_init_file (const char *filename)
+{
+  FREE (last_readline_init_file);
+  last_readline_init_file = filename ? savestring (filename) : (char *)NULL;
+}
+
+/* Returns the name of the Nth config variable, or NULL past the end. */
+const char *
+rl_get_variable_name (int index)
+{
+  int i;
+
+  for (i = 0; boolean_varlist[i].name; i++)
+    if (i == index)
+      return boolean_varlist[i].name;
+  index -= i;
+
+  for (i = 0; string_varlist[i].name; i++)
+    if (i == index)
+      return string_varlist[i].name;
+
+  return (const char *)NULL;
+}
 /* end_clink_change */
 
 /* Return non-zero if any members of ARRAY are a substring in STRING. */
@@ -120,6 +120,9 @@ int history_return_expansions = 0;
 
 /* Cache the most recent history event lookup. */
 history_event_lookup_cache_t history_event_lookup_cache = { 0 };
+
+/* Optionally finds history events without searching the history list. */
+history_event_search_func_t *history_event_search_hook = NULL;
 /* end_clink_change */
 
 int history_quoting_state = 0;
@@ -377,6 +380,18 @@ get_history_event (const char *string, int *caller_index, int delimiting_quote)
 /* end_clink_change */
   while (1)
     {
+/* begin_clink_change */
+      /* The hook only says which entry matches; the search function still
+	 computes the match offset, starting at that entry. */
+      if (history_event_search_hook)
+	{
+	  int found = (*history_event_search_hook) (temp, substring_okay, history_offset);
+	  if (found == -1)
+	    FAIL_SEARCH ();
+	  if (found >= 0)
+	    history_offset = found;
+	}
+/* end_clink_change */
       local_index = (*search_func) (temp, -1);
 
       if (local_index < 0)
@@ -94,6 +94,10 @@ int history_offset;
 /* The next prev-history type of command should use the current history entry
    rather than moving to the previous entry. */
 int history_prev_use_curr = 0;
+
+/* If non-null, called to release lines and timestamps owned by history
+   entries. */
+rl_history_free_string_func_t *history_free_string_hook = (rl_history_free_string_func_t *)NULL;
 /* end_clink_change */
 
 /* The number of strings currently stored in the history list. */
@@ -297,12 +301,48 @@ hist_inittime (void)
 /* end_clink_change */
 }
 
+/* begin_clink_change */
+/* Release a line or timestamp owned by a history entry. */
+void
+history_free_string (char *string)
+{
+  if (string == 0)
+    return;
+  if (history_free_string_hook)
+    (*history_free_string_hook) (string);
+  else
+    xfree (string);
+}
+
+static void add_history_entry (HIST_ENTRY *);
+
 /* Place STRING at the end of the history list.  The data field
    is  set to NULL. */
 void
 add_history (const char *string)
+{
+  add_history_entry (alloc_history_entry ((char *)string, hist_inittime ()));
+}
+
+/* Place STRING at the end of the history list with timestamp TS, without
+   copying them.  The data field is set to NULL. */
+void
+add_history_nocopy (char *string, char *ts)
 {
   HIST_ENTRY *temp;
+
+  temp = (HIST_ENTRY *)xmalloc (sizeof (HIST_ENTRY));
+
+  temp->line = string;
+  temp->data = (char *)NULL;
+  temp->timestamp = ts;
+
+  add_history_entry (temp);
+}
+
+static void
+add_history_entry (HIST_ENTRY *temp)
+{
   int new_length;
 
   if (history_stifled && (history_length == history_max_entries))
@@ -310,7 +350,11 @@ add_history (const char *string)
       /* If the history is stifled, and history_length is zero,
 	 and it equals history_max_entries, we don't save items. */
       if (history_length == 0)
-	return;
+	{
+	  (void) free_history_entry (temp);
+	  return;
+	}
+/* end_clink_change */
 
       /* If there is something in the slot, then remove it. */
       if (the_history[0])
@@ -348,7 +392,9 @@ add_history (const char *string)
 	}
     }
 
-  temp = alloc_history_entry ((char *)string, hist_inittime ());
+/* begin_clink_change */
+  //temp = alloc_history_entry ((char *)string, hist_inittime ());
+/* end_clink_change */
 
   the_history[new_length] = (HIST_ENTRY *)NULL;
   the_history[new_length - 1] = temp;
@@ -364,7 +410,10 @@ add_history_time (const char *string)
   if (string == 0 || history_length < 1)
     return;
   hs = the_history[history_length - 1];
-  FREE (hs->timestamp);
+/* begin_clink_change */
+  //FREE (hs->timestamp);
+  history_free_string (hs->timestamp);
+/* end_clink_change */
   hs->timestamp = savestring (string);
 }
 
@@ -377,8 +426,12 @@ free_history_entry (HIST_ENTRY *hist)
 
   if (hist == 0)
     return ((histdata_t) 0);
-  FREE (hist->line);
-  FREE (hist->timestamp);
+/* begin_clink_change */
+  //FREE (hist->line);
+  //FREE (hist->timestamp);
+  history_free_string (hist->line);
+  history_free_string (hist->timestamp);
+/* end_clink_change */
   x = hist->data;
   xfree (hist);
   return (x);
@@ -449,7 +502,13 @@ _hs_append_history_line (int which, const char *line)
     newlen = minlen;
   /* Assume that realloc returns the same pointer and doesn't try a new
      alloc/copy if the new size is the same as the one last passed. */
-  newline = realloc (hent->line, newlen);
+/* begin_clink_change */
+  //newline = realloc (hent->line, newlen);
+  /* The line may not have come from malloc, so it can't be reallocated. */
+  newline = (char *)xmalloc (newlen);
+  memcpy (newline, hent->line, curlen + 1);
+  history_free_string (hent->line);
+/* end_clink_change */
   if (newline)
     {
       hent->line = newline;
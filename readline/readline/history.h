@@ -91,6 +91,23 @@ extern void add_history (const char *);
    STRING. */
 extern void add_history_time (const char *);
 
+/* begin_clink_change */
+/* Place STRING at the end of the history list with timestamp TIMESTAMP
+   (which may be NULL), without copying them.  The history entry takes
+   ownership of both, and releases them via history_free_string(). */
+extern void add_history_nocopy (char *, char *);
+
+/* Release a line or timestamp owned by a history entry.  This calls
+   history_free_string_hook if set, otherwise it frees the string. */
+extern void history_free_string (char *);
+
+/* If non-null, called to release lines and timestamps owned by history
+   entries.  This lets an application supply history strings from its own
+   storage via add_history_nocopy(). */
+typedef void rl_history_free_string_func_t (char *);
+extern rl_history_free_string_func_t *history_free_string_hook;
+/* end_clink_change */
+
 /* Remove an entry from the history list.  WHICH is the magic number that
    tells us which element to delete.  The elements are numbered from 0. */
 extern HIST_ENTRY *remove_history (int);
@@ -284,6 +301,14 @@ extern void restore_history_expansion_state (void);
 
 extern int history_return_expansions;
 extern int history_search_time_limit;
+
+/* If set, this is called to find the newest history entry at or before
+   START that begins with STRING (or contains STRING, if SUBSTRING is
+   non-zero), for the !string and !?string? event designators.  It returns
+   the index of the entry, -1 if there is no such entry, or -2 to search the
+   history list as usual. */
+typedef int history_event_search_func_t (const char *, int, int);
+extern history_event_search_func_t *history_event_search_hook;
 /* end_clink_change */
 
 extern int history_quotes_inhibit_expansion;
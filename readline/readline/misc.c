@@ -363,9 +363,11 @@ _rl_free_history_entry (HIST_ENTRY *entry)
   if (entry == 0)
     return;
 
-  FREE (entry->line);
-  FREE (entry->timestamp);
 /* begin_clink_change */
+  //FREE (entry->line);
+  //FREE (entry->timestamp);
+  history_free_string (entry->line);
+  history_free_string (entry->timestamp);
   // WARNING: This assumes the caller manages lifetime of entry->data.
 /* end_clink_change */
 
@@ -383,8 +385,12 @@ rl_maybe_replace_line (void)
   if (temp && ((UNDO_LIST *)(temp->data) != rl_undo_list))
     {
       temp = replace_history_entry (where_history (), rl_line_buffer, (histdata_t)rl_undo_list);
-      xfree (temp->line);
-      FREE (temp->timestamp);
+/* begin_clink_change */
+      //xfree (temp->line);
+      //FREE (temp->timestamp);
+      history_free_string (temp->line);
+      history_free_string (temp->timestamp);
+/* end_clink_change */
       xfree (temp);
       /* What about _rl_saved_line_for_history? if the saved undo list is
 	 rl_undo_list, and we just put that into a history entry, should
@@ -540,7 +546,10 @@ _rl_revert_previous_lines (void)
 	    rl_do_undo ();
 	  /* And copy the reverted line back to the history entry, preserving
 	     the timestamp. */
-	  FREE (entry->line);
+/* begin_clink_change */
+	  //FREE (entry->line);
+	  history_free_string (entry->line);
+/* end_clink_change */
 	  entry->line = savestring (rl_line_buffer);
 	}
       entry = previous_history ();
@@ -390,6 +390,11 @@ extern int rl_parse_and_bind (char *);
 /* begin_clink_change */
 extern const char *rl_get_last_init_file (void);
 extern int rl_translate_old_keyseq (const char *, char **);
+extern void rl_set_last_init_file (const char *);
+extern const char *rl_get_variable_name (int);
+extern rl_read_init_file_hook_func_t *rl_read_init_file_hook;
+extern rl_variable_bind_hook_func_t *rl_variable_bind_hook;
+extern int rl_init_file_error_count;
 /* end_clink_change */
 
 /* Functions for manipulating keymaps. */
@@ -807,6 +812,7 @@ extern int rl_key_sequence_length;
 /* begin_clink_change */
 extern rl_macro_hook_func_t *rl_macro_hook_func;
 extern rl_voidfunc_t *rl_last_func_hook_func;
+extern rl_vcpfunc_t *rl_errmsg_hook_func;
 /* end_clink_change */
 
 /* Display variables. */
@@ -88,6 +88,10 @@ typedef int rl_macro_hook_func_t (const char* macro);
 struct undo_list;
 typedef struct undo_list UNDO_LIST;
 typedef int rl_can_concat_undo_hook_func_t (UNDO_LIST* undo, const char* string);
+/* Type for function to observe init files being read */
+typedef void rl_read_init_file_hook_func_t (const char *filename, const char *buffer, size_t size);
+/* Type for function to observe config variables being set */
+typedef void rl_variable_bind_hook_func_t (const char *name, const char *value);
 /* end_clink_change */
 
 /* Input function type */
@@ -251,8 +251,12 @@ rl_do_undo (void)
       if (cur && cur->data && (UNDO_LIST *)cur->data == release)
 	{
 	  temp = replace_history_entry (where_history (), rl_line_buffer, (histdata_t)rl_undo_list);
-	  xfree (temp->line);
-	  FREE (temp->timestamp);
+/* begin_clink_change */
+	  //xfree (temp->line);
+	  //FREE (temp->timestamp);
+	  history_free_string (temp->line);
+	  history_free_string (temp->timestamp);
+/* end_clink_change */
 	  xfree (temp);
 	}
 
@@ -64,6 +64,10 @@
 /* **************************************************************** */
 
 /* begin_clink_change */
+/* If set, error messages are passed to this function instead of being printed
+   to stderr. */
+rl_vcpfunc_t *rl_errmsg_hook_func = (rl_vcpfunc_t *)NULL;
+
 /* Filename completion inserts this as the path separator character. */
 char rl_preferred_path_separator = '/';
 
@@ -303,6 +307,18 @@ _rl_errmsg (const char *format, ...)
 
   va_start (args, format);
 
+/* begin_clink_change */
+  if (rl_errmsg_hook_func)
+    {
+      char msg[1024];
+      vsnprintf (msg, sizeof (msg), format, args);
+      msg[sizeof (msg) - 1] = '\0';
+      va_end (args);
+      (*rl_errmsg_hook_func) (msg);
+      return;
+    }
+/* end_clink_change */
+
   fprintf (stderr, "readline: ");
   vfprintf (stderr, format, args);
   fprintf (stderr, "\n");